@@ -0,0 +1,198 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Intrusive pairing heap
+ *
+ * A pairing heap is a min-heap that provides O(1) insertion and minimum
+ * lookup, and O(log n) amortized removal of arbitrary nodes. Nodes are
+ * embedded into the objects that are stored in the heap, so no memory needs
+ * to be allocated for heap operations. The order is defined by a user-supplied
+ * comparison function.
+ */
+
+#ifndef __UK_PHEAP_H__
+#define __UK_PHEAP_H__
+
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct uk_pheap_node {
+	struct uk_pheap_node *child; /* Leftmost child */
+	struct uk_pheap_node *next;  /* Right sibling */
+	struct uk_pheap_node *prev;  /* Left sibling, or parent if leftmost */
+};
+
+struct uk_pheap {
+	struct uk_pheap_node *root;
+};
+
+/**
+ * Returns non-zero if node `a` has to be ordered before node `b`.
+ */
+typedef int (*uk_pheap_less_t)(const struct uk_pheap_node *a,
+			       const struct uk_pheap_node *b);
+
+#define UK_PHEAP_INITIALIZER { .root = __NULL }
+
+#define uk_pheap_entry(node, type, member) \
+	__containerof(node, type, member)
+
+static inline void uk_pheap_init(struct uk_pheap *h)
+{
+	h->root = __NULL;
+}
+
+static inline void uk_pheap_node_init(struct uk_pheap_node *n)
+{
+	n->child = __NULL;
+	n->next = __NULL;
+	n->prev = __NULL;
+}
+
+static inline int uk_pheap_empty(const struct uk_pheap *h)
+{
+	return h->root == __NULL;
+}
+
+/**
+ * Returns the minimum node of the heap or NULL if the heap is empty.
+ */
+static inline struct uk_pheap_node *uk_pheap_min(const struct uk_pheap *h)
+{
+	return h->root;
+}
+
+/**
+ * Returns non-zero if the node is linked to the heap. The node must have
+ * been initialized with `uk_pheap_node_init()` before its first insertion.
+ */
+static inline int uk_pheap_linked(const struct uk_pheap *h,
+				  const struct uk_pheap_node *n)
+{
+	return n->prev != __NULL || h->root == n;
+}
+
+/* Links two heaps and returns the new root */
+static inline struct uk_pheap_node *_uk_pheap_meld(struct uk_pheap_node *a,
+						   struct uk_pheap_node *b,
+						   uk_pheap_less_t less)
+{
+	struct uk_pheap_node *tmp;
+
+	if (less(b, a)) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	b->prev = a;
+	b->next = a->child;
+	if (a->child)
+		a->child->prev = b;
+	a->child = b;
+
+	a->next = __NULL;
+	a->prev = __NULL;
+	return a;
+}
+
+/* Two-pass pairing of a sibling list: Meld pairs from left to right, then
+ * meld the resulting heaps from right to left.
+ */
+static inline struct uk_pheap_node *
+_uk_pheap_merge_pairs(struct uk_pheap_node *first, uk_pheap_less_t less)
+{
+	struct uk_pheap_node *a, *b, *next, *list = __NULL;
+
+	while (first) {
+		a = first;
+		b = a->next;
+		if (!b) {
+			a->next = list;
+			list = a;
+			break;
+		}
+
+		next = b->next;
+		a = _uk_pheap_meld(a, b, less);
+		a->next = list;
+		list = a;
+		first = next;
+	}
+
+	first = __NULL;
+	while (list) {
+		next = list->next;
+		list->next = __NULL;
+		list->prev = __NULL;
+		first = first ? _uk_pheap_meld(first, list, less) : list;
+		list = next;
+	}
+
+	return first;
+}
+
+/**
+ * Inserts a node into the heap. The node must not be linked to a heap.
+ */
+static inline void uk_pheap_insert(struct uk_pheap *h, struct uk_pheap_node *n,
+				   uk_pheap_less_t less)
+{
+	uk_pheap_node_init(n);
+	h->root = h->root ? _uk_pheap_meld(h->root, n, less) : n;
+}
+
+/**
+ * Removes a node from the heap. The node must be linked to the heap.
+ */
+static inline void uk_pheap_remove(struct uk_pheap *h, struct uk_pheap_node *n,
+				   uk_pheap_less_t less)
+{
+	struct uk_pheap_node *sub;
+
+	sub = _uk_pheap_merge_pairs(n->child, less);
+
+	if (n == h->root) {
+		h->root = sub;
+	} else {
+		/* Unlink from sibling list */
+		if (n->prev->child == n)
+			n->prev->child = n->next;
+		else
+			n->prev->next = n->next;
+		if (n->next)
+			n->next->prev = n->prev;
+
+		if (sub)
+			h->root = _uk_pheap_meld(h->root, sub, less);
+	}
+
+	uk_pheap_node_init(n);
+}
+
+/**
+ * Removes and returns the minimum node of the heap, or NULL if the heap is
+ * empty.
+ */
+static inline struct uk_pheap_node *uk_pheap_pop(struct uk_pheap *h,
+						 uk_pheap_less_t less)
+{
+	struct uk_pheap_node *n = h->root;
+
+	if (n)
+		uk_pheap_remove(h, n, less);
+	return n;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __UK_PHEAP_H__ */
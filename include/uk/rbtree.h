@@ -0,0 +1,424 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Intrusive red-black tree
+ *
+ * A self-balancing binary search tree with O(log n) insertion, removal, and
+ * lookup. Nodes are embedded into the objects that are stored in the tree.
+ * The tree does not know about keys: Lookups are open-coded by the user by
+ * walking down from the root, and insertions are done by first finding the
+ * link where the node has to be attached and then calling
+ * `uk_rb_insert()`.
+ *
+ * The tree optionally maintains augmented data (e.g., the maximum of some
+ * value in a subtree). For this, the user passes an augment callback that
+ * recomputes the augmented data of a node from the node itself and its
+ * children. The callback is invoked for all nodes whose subtree changes.
+ * After changing a value that affects the augmented data of a node without
+ * modifying the tree, `uk_rb_augment_propagate()` must be called for the
+ * node.
+ */
+
+#ifndef __UK_RBTREE_H__
+#define __UK_RBTREE_H__
+
+#include <uk/essentials.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+struct uk_rb_node {
+	struct uk_rb_node *parent;
+	struct uk_rb_node *left;
+	struct uk_rb_node *right;
+	int red;
+};
+
+struct uk_rb_tree {
+	struct uk_rb_node *root;
+};
+
+/**
+ * Recomputes the augmented data of a node from its own data and the
+ * augmented data of its children. May be NULL if the tree is not augmented.
+ */
+typedef void (*uk_rb_augment_t)(struct uk_rb_node *n);
+
+#define UK_RB_TREE_INITIALIZER { .root = __NULL }
+
+#define uk_rb_entry(node, type, member) \
+	__containerof(node, type, member)
+
+#define uk_rb_entry_safe(node, type, member)				\
+	({								\
+		struct uk_rb_node *__n = (node);			\
+		__n ? uk_rb_entry(__n, type, member) : __NULL;		\
+	})
+
+static inline void uk_rb_init(struct uk_rb_tree *t)
+{
+	t->root = __NULL;
+}
+
+static inline int uk_rb_empty(const struct uk_rb_tree *t)
+{
+	return t->root == __NULL;
+}
+
+static inline struct uk_rb_node *uk_rb_first(const struct uk_rb_tree *t)
+{
+	struct uk_rb_node *n = t->root;
+
+	if (n)
+		while (n->left)
+			n = n->left;
+	return n;
+}
+
+static inline struct uk_rb_node *uk_rb_last(const struct uk_rb_tree *t)
+{
+	struct uk_rb_node *n = t->root;
+
+	if (n)
+		while (n->right)
+			n = n->right;
+	return n;
+}
+
+/**
+ * Returns the in-order successor of a node, or NULL for the last node.
+ */
+static inline struct uk_rb_node *uk_rb_next(const struct uk_rb_node *n)
+{
+	const struct uk_rb_node *p;
+
+	if (n->right) {
+		n = n->right;
+		while (n->left)
+			n = n->left;
+		return (struct uk_rb_node *) n;
+	}
+
+	while ((p = n->parent) && n == p->right)
+		n = p;
+	return (struct uk_rb_node *) p;
+}
+
+/**
+ * Returns the in-order predecessor of a node, or NULL for the first node.
+ */
+static inline struct uk_rb_node *uk_rb_prev(const struct uk_rb_node *n)
+{
+	const struct uk_rb_node *p;
+
+	if (n->left) {
+		n = n->left;
+		while (n->right)
+			n = n->right;
+		return (struct uk_rb_node *) n;
+	}
+
+	while ((p = n->parent) && n == p->left)
+		n = p;
+	return (struct uk_rb_node *) p;
+}
+
+/**
+ * Updates the augmented data of a node and all its ancestors.
+ */
+static inline void uk_rb_augment_propagate(struct uk_rb_node *n,
+					   uk_rb_augment_t augment)
+{
+	if (!augment)
+		return;
+
+	for (; n; n = n->parent)
+		augment(n);
+}
+
+static inline void _uk_rb_replace_child(struct uk_rb_tree *t,
+					struct uk_rb_node *p,
+					struct uk_rb_node *old,
+					struct uk_rb_node *new)
+{
+	if (!p)
+		t->root = new;
+	else if (p->left == old)
+		p->left = new;
+	else
+		p->right = new;
+}
+
+static inline void _uk_rb_rotate_left(struct uk_rb_tree *t,
+				      struct uk_rb_node *x,
+				      uk_rb_augment_t augment)
+{
+	struct uk_rb_node *y = x->right;
+
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+
+	y->parent = x->parent;
+	_uk_rb_replace_child(t, x->parent, x, y);
+
+	y->left = x;
+	x->parent = y;
+
+	if (augment) {
+		augment(x);
+		augment(y);
+	}
+}
+
+static inline void _uk_rb_rotate_right(struct uk_rb_tree *t,
+				       struct uk_rb_node *x,
+				       uk_rb_augment_t augment)
+{
+	struct uk_rb_node *y = x->left;
+
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+
+	y->parent = x->parent;
+	_uk_rb_replace_child(t, x->parent, x, y);
+
+	y->right = x;
+	x->parent = y;
+
+	if (augment) {
+		augment(x);
+		augment(y);
+	}
+}
+
+static inline int _uk_rb_is_red(const struct uk_rb_node *n)
+{
+	return n && n->red;
+}
+
+/**
+ * Inserts a node into the tree.
+ *
+ * @param t the tree
+ * @param n the node to insert
+ * @param parent the parent of the new node, NULL if the tree is empty
+ * @param link the child pointer of `parent` (or the root pointer of the
+ *    tree) where the node is attached. Must point to NULL
+ * @param augment augment callback, or NULL
+ */
+static inline void uk_rb_insert(struct uk_rb_tree *t, struct uk_rb_node *n,
+				struct uk_rb_node *parent,
+				struct uk_rb_node **link,
+				uk_rb_augment_t augment)
+{
+	struct uk_rb_node *p, *g, *u;
+
+	n->parent = parent;
+	n->left = __NULL;
+	n->right = __NULL;
+	n->red = 1;
+	*link = n;
+
+	/* Rotations retain the set of nodes in the subtree of the rotated
+	 * pair. So it is sufficient to update the path to the root once
+	 * before rebalancing.
+	 */
+	uk_rb_augment_propagate(n, augment);
+
+	while ((p = n->parent) && p->red) {
+		/* The root is black, so a red parent has a parent */
+		g = p->parent;
+
+		if (p == g->left) {
+			u = g->right;
+			if (_uk_rb_is_red(u)) {
+				p->red = 0;
+				u->red = 0;
+				g->red = 1;
+				n = g;
+				continue;
+			}
+
+			if (n == p->right) {
+				_uk_rb_rotate_left(t, p, augment);
+				n = p;
+				p = n->parent;
+			}
+
+			p->red = 0;
+			g->red = 1;
+			_uk_rb_rotate_right(t, g, augment);
+		} else {
+			u = g->left;
+			if (_uk_rb_is_red(u)) {
+				p->red = 0;
+				u->red = 0;
+				g->red = 1;
+				n = g;
+				continue;
+			}
+
+			if (n == p->left) {
+				_uk_rb_rotate_right(t, p, augment);
+				n = p;
+				p = n->parent;
+			}
+
+			p->red = 0;
+			g->red = 1;
+			_uk_rb_rotate_left(t, g, augment);
+		}
+	}
+
+	t->root->red = 0;
+}
+
+static inline void _uk_rb_erase_fixup(struct uk_rb_tree *t,
+				      struct uk_rb_node *x,
+				      struct uk_rb_node *xp,
+				      uk_rb_augment_t augment)
+{
+	struct uk_rb_node *w;
+
+	/* x carries an extra black. A black node that was removed has a
+	 * sibling, so w is never NULL below.
+	 */
+	while (x != t->root && !_uk_rb_is_red(x)) {
+		if (x == xp->left) {
+			w = xp->right;
+			if (w->red) {
+				w->red = 0;
+				xp->red = 1;
+				_uk_rb_rotate_left(t, xp, augment);
+				w = xp->right;
+			}
+
+			if (!_uk_rb_is_red(w->left) &&
+			    !_uk_rb_is_red(w->right)) {
+				w->red = 1;
+				x = xp;
+				xp = x->parent;
+				continue;
+			}
+
+			if (!_uk_rb_is_red(w->right)) {
+				w->left->red = 0;
+				w->red = 1;
+				_uk_rb_rotate_right(t, w, augment);
+				w = xp->right;
+			}
+
+			w->red = xp->red;
+			xp->red = 0;
+			w->right->red = 0;
+			_uk_rb_rotate_left(t, xp, augment);
+		} else {
+			w = xp->left;
+			if (w->red) {
+				w->red = 0;
+				xp->red = 1;
+				_uk_rb_rotate_right(t, xp, augment);
+				w = xp->left;
+			}
+
+			if (!_uk_rb_is_red(w->left) &&
+			    !_uk_rb_is_red(w->right)) {
+				w->red = 1;
+				x = xp;
+				xp = x->parent;
+				continue;
+			}
+
+			if (!_uk_rb_is_red(w->left)) {
+				w->right->red = 0;
+				w->red = 1;
+				_uk_rb_rotate_left(t, w, augment);
+				w = xp->left;
+			}
+
+			w->red = xp->red;
+			xp->red = 0;
+			w->left->red = 0;
+			_uk_rb_rotate_right(t, xp, augment);
+		}
+
+		x = t->root;
+	}
+
+	if (x)
+		x->red = 0;
+}
+
+/**
+ * Removes a node from the tree. The node must be linked to the tree.
+ *
+ * @param t the tree
+ * @param n the node to remove
+ * @param augment augment callback, or NULL
+ */
+static inline void uk_rb_erase(struct uk_rb_tree *t, struct uk_rb_node *n,
+			       uk_rb_augment_t augment)
+{
+	struct uk_rb_node *y, *x, *xp;
+	int y_red;
+
+	/* y is the node that is actually unlinked from its position: n itself
+	 * if it has at most one child, its successor otherwise.
+	 */
+	if (!n->left || !n->right) {
+		y = n;
+	} else {
+		y = n->right;
+		while (y->left)
+			y = y->left;
+	}
+
+	x = y->left ? y->left : y->right;
+	xp = y->parent;
+	y_red = y->red;
+
+	if (x)
+		x->parent = xp;
+	_uk_rb_replace_child(t, xp, y, x);
+
+	if (y != n) {
+		/* Move the successor into the position of n */
+		if (xp == n)
+			xp = y;
+
+		y->parent = n->parent;
+		y->left = n->left;
+		y->right = n->right;
+		y->red = n->red;
+		if (y->left)
+			y->left->parent = y;
+		if (y->right)
+			y->right->parent = y;
+		_uk_rb_replace_child(t, n->parent, n, y);
+	}
+
+	/* The path from xp to the root covers all subtrees that changed,
+	 * including the new position of the successor
+	 */
+	uk_rb_augment_propagate(xp, augment);
+
+	if (!y_red)
+		_uk_rb_erase_fixup(t, x, xp, augment);
+
+	n->parent = __NULL;
+	n->left = __NULL;
+	n->right = __NULL;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __UK_RBTREE_H__ */
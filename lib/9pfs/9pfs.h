@@ -34,6 +34,7 @@
 #define __UK_9PFS__
 
 #include <stdbool.h>
+#include <uk/config.h>
 #include <uk/9pdev.h>
 #include <uk/9pfid.h>
 
@@ -81,6 +82,32 @@ struct uk_9pfs_mount_data {
 	 * offering several exported file systems.
 	 */
 	char			*aname;
+	/* Whether regular files use the vfscore page cache */
+	int			cache;
+};
+
+/**
+ * Data that is read ahead of sequential reads from a file
+ */
+struct uk_9pfs_readahead {
+	/*
+	 * Buffer of `CONFIG_LIB9PFS_READAHEAD` KiB, allocated
+	 * when the file is read sequentially for the first time
+	 */
+	char                   *buf;
+	/* File offset of the first byte in `buf` */
+	off_t                  off;
+	/* Number of bytes in `buf`, including the ones still requested */
+	size_t                 len;
+	/* Offset at which the next sequential read starts */
+	off_t                  next;
+	/* Outstanding 9P read requests for `buf`, in file order */
+	struct uk_9preq        *req[CONFIG_LIB9PFS_IO_WINDOW];
+	/* Number of bytes requested by each of `req` */
+	uint32_t               count[CONFIG_LIB9PFS_IO_WINDOW];
+	int                    nb_req;
+	/* Value of `uk_9pfs_node_data.gen` when `buf` was requested */
+	unsigned long          gen;
 };
 
 /**
@@ -101,6 +128,10 @@ struct uk_9pfs_file_data {
 	int                    readdir_off;
 	/* Total size of the data in the `readdir` buf */
 	int                    readdir_sz;
+#if CONFIG_LIB9PFS_READAHEAD
+	/* Readahead of sequential reads, for mounts without cache */
+	struct uk_9pfs_readahead ra;
+#endif /* CONFIG_LIB9PFS_READAHEAD */
 };
 
 /**
@@ -113,6 +144,11 @@ struct uk_9pfs_node_data {
 	int                    nb_open_files;
 	/* Is a 9P remove call required when `nb_open_files` reaches 0? */
 	bool                   removed;
+	/*
+	 * Incremented with every write and truncation, so that data that
+	 * was read ahead before is not used afterwards
+	 */
+	unsigned long          gen;
 };
 
 /**
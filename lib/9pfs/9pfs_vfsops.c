@@ -100,6 +100,13 @@ static int uk_9pfs_parse_option(struct uk_9pfs_mount_data *md,
 		md->aname = strdup(option + 6);
 		if (!md->aname)
 			return -ENOMEM;
+	} else if (strncmp(option, "cache=", 6) == 0) {
+		if (strcmp(option + 6, "loose") == 0)
+			md->cache = 1;
+		else if (strcmp(option + 6, "none") == 0)
+			md->cache = 0;
+		else
+			return -EINVAL;
 	}
 
 	return 0;
@@ -126,6 +133,7 @@ static int uk_9pfs_parse_options(struct uk_9pfs_mount_data *md,
 	options = options_tok = strdup(data);
 
 	md->proto = UK_9P_PROTO_2000U;
+	md->cache = 0;
 	md->uname = strdup("");
 	md->aname = strdup("");
 
@@ -219,6 +227,10 @@ static int uk_9pfs_mount(struct mount *mp, const char *dev,
 		goto out_disconnect;
 	}
 
+	/* The host may change files behind our back, so caching is opt-in */
+	if (md->cache)
+		mp->m_flags |= MNT_PAGECACHE;
+
 	return 0;
 
 out_disconnect:
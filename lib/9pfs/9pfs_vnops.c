@@ -164,6 +164,7 @@ int uk_9pfs_allocate_vnode_data(struct vnode *vp, struct uk_9pfid *fid)
 	nd->fid = fid;
 	nd->nb_open_files = 0;
 	nd->removed = false;
+	nd->gen = 0;
 	vp->v_data = nd;
 
 	return 0;
@@ -185,6 +186,263 @@ void uk_9pfs_free_vnode_data(struct vnode *vp)
 	vp->v_data = NULL;
 }
 
+static void uk_9pfs_uio_advance(struct uio *uio, size_t bytes)
+{
+	struct iovec *iov = uio->uio_iov;
+	size_t n;
+
+	UK_ASSERT(uio->uio_offset <= __OFF_MAX - (off_t)bytes);
+	UK_ASSERT((size_t)uio->uio_resid >= bytes);
+
+	uio->uio_offset += bytes;
+	uio->uio_resid -= bytes;
+
+	while (bytes) {
+		UK_ASSERT(uio->uio_iovcnt > 0);
+		n = MIN(bytes, iov->iov_len);
+		iov->iov_base = (char *)iov->iov_base + n;
+		iov->iov_len -= n;
+		bytes -= n;
+		if (!iov->iov_len) {
+			uio->uio_iov = ++iov;
+			uio->uio_iovcnt--;
+		}
+	}
+}
+
+/*
+ * Reads or writes `uio` with up to `CONFIG_LIB9PFS_IO_WINDOW` requests in
+ * flight. Replies are consumed in order, and the first one that is short
+ * ends the window, so that `uio` is only advanced by contiguous data.
+ * Reads do not keep requests in flight beyond `end`, the known file size.
+ * Writes after a short one may still have reached the server. If `acked` is
+ * given, it is raised to the end of the furthest data the server confirmed.
+ */
+static int uk_9pfs_transfer_window(struct uk_9pdev *dev, struct uk_9pfid *fid,
+				   struct uio *uio, off_t end, bool write,
+				   size_t *done, off_t *acked)
+{
+	struct uk_9preq *req[CONFIG_LIB9PFS_IO_WINDOW];
+	uint32_t count[CONFIG_LIB9PFS_IO_WINDOW];
+	off_t start[CONFIG_LIB9PFS_IO_WINDOW];
+	int head = 0, nb_req = 0, slot;
+	struct iovec *iov = uio->uio_iov;
+	struct iovec *iov_end = iov + uio->uio_iovcnt;
+	size_t skip = 0;
+	off_t off = uio->uio_offset;
+	bool send = true, ok = true;
+	int64_t bytes;
+	int rc = 0;
+
+	*done = 0;
+	for (;;) {
+		while (send && nb_req < CONFIG_LIB9PFS_IO_WINDOW &&
+		       iov != iov_end) {
+			if (skip == iov->iov_len) {
+				iov++;
+				skip = 0;
+				continue;
+			}
+			if (!write && nb_req && off >= end)
+				break;
+
+			slot = (head + nb_req) % CONFIG_LIB9PFS_IO_WINDOW;
+			count[slot] = MIN(iov->iov_len - skip, UINT32_MAX);
+			start[slot] = off;
+			if (write)
+				req[slot] = uk_9p_write_async(dev, fid, off,
+						&count[slot],
+						(char *)iov->iov_base + skip);
+			else
+				req[slot] = uk_9p_read_async(dev, fid, off,
+						&count[slot],
+						(char *)iov->iov_base + skip);
+			if (unlikely(PTRISERR(req[slot]))) {
+				if (!nb_req)
+					rc = PTR2ERR(req[slot]);
+				send = false;
+				break;
+			}
+
+			nb_req++;
+			skip += count[slot];
+			off += count[slot];
+		}
+
+		if (!nb_req)
+			break;
+
+		/* Requests after a failed one are waited for, but do not
+		 * count as transferred
+		 */
+		slot = head;
+		head = (head + 1) % CONFIG_LIB9PFS_IO_WINDOW;
+		nb_req--;
+		if (write)
+			bytes = uk_9p_write_wait(dev, req[slot]);
+		else
+			bytes = uk_9p_read_wait(dev, req[slot]);
+		if (acked && bytes > 0)
+			*acked = MAX(*acked, start[slot] + (off_t)bytes);
+		if (!ok)
+			continue;
+
+		if (unlikely(bytes < 0)) {
+			if (!*done)
+				rc = (int)bytes;
+			send = ok = false;
+			continue;
+		}
+
+		UK_ASSERT((uint64_t)bytes <= count[slot]);
+		*done += bytes;
+		if ((uint64_t)bytes < count[slot])
+			send = ok = false;
+	}
+
+	return rc;
+}
+
+static int uk_9pfs_transfer(struct uk_9pdev *dev, struct uk_9pfid *fid,
+			    struct uio *uio, off_t end, bool write,
+			    off_t *acked)
+{
+	size_t done;
+	int rc;
+
+	while (uio->uio_resid) {
+		rc = uk_9pfs_transfer_window(dev, fid, uio, end, write, &done,
+					     acked);
+		if (unlikely(rc < 0))
+			return -rc;
+
+		uk_9pfs_uio_advance(uio, done);
+
+		/*
+		 * A short reply ends the window. Continue after it, unless
+		 * nothing was transferred or a read reached the end of file.
+		 */
+		if (!done || (!write && uio->uio_offset >= end))
+			break;
+	}
+
+	return 0;
+}
+
+#if CONFIG_LIB9PFS_READAHEAD
+#define UK_9PFS_RA_SIZE ((size_t)CONFIG_LIB9PFS_READAHEAD * 1024)
+
+/*
+ * Waits for the outstanding readahead requests. `ra->len` is cut to the
+ * data up to the first request that failed or was short.
+ */
+static void uk_9pfs_ra_wait(struct uk_9pdev *dev, struct uk_9pfs_readahead *ra)
+{
+	size_t len = ra->len;
+	bool ok = true;
+	int64_t bytes;
+	int i;
+
+	for (i = 0; i < ra->nb_req; i++)
+		len -= ra->count[i];
+
+	for (i = 0; i < ra->nb_req; i++) {
+		bytes = uk_9p_read_wait(dev, ra->req[i]);
+		if (!ok)
+			continue;
+		if (bytes > 0)
+			len += bytes;
+		if (bytes < (int64_t)ra->count[i])
+			ok = false;
+	}
+
+	ra->nb_req = 0;
+	ra->len = len;
+}
+
+static void uk_9pfs_ra_drop(struct uk_9pdev *dev, struct uk_9pfs_readahead *ra)
+{
+	uk_9pfs_ra_wait(dev, ra);
+	ra->off = 0;
+	ra->len = 0;
+}
+
+/* Requests the data following `ra->next` into the readahead buffer */
+static void uk_9pfs_ra_start(struct uk_9pdev *dev, struct uk_9pfid *fid,
+			     struct uk_9pfs_readahead *ra, off_t size,
+			     unsigned long gen)
+{
+	size_t len;
+	uint32_t count;
+
+	UK_ASSERT(!ra->nb_req);
+
+	if (!ra->buf) {
+		ra->buf = malloc(UK_9PFS_RA_SIZE);
+		if (unlikely(!ra->buf))
+			return;
+	}
+
+	ra->off = ra->next;
+	ra->len = 0;
+	ra->gen = gen;
+	len = MIN(UK_9PFS_RA_SIZE, (size_t)(size - ra->off));
+	while (ra->len < len && ra->nb_req < CONFIG_LIB9PFS_IO_WINDOW) {
+		count = len - ra->len;
+		ra->req[ra->nb_req] = uk_9p_read_async(dev, fid,
+						       ra->off + ra->len,
+						       &count,
+						       ra->buf + ra->len);
+		if (unlikely(PTRISERR(ra->req[ra->nb_req])))
+			break;
+
+		ra->count[ra->nb_req++] = count;
+		ra->len += count;
+	}
+}
+
+static int uk_9pfs_ra_read(struct uk_9pdev *dev, struct uk_9pfid *fid,
+			   struct vnode *vp, struct uk_9pfs_readahead *ra,
+			   struct uio *uio)
+{
+	unsigned long gen = UK_9PFS_ND(vp)->gen;
+	size_t n;
+	int rc;
+
+	if (uio->uio_offset != ra->next || ra->gen != gen) {
+		/* Not sequential, or the file was written meanwhile */
+		uk_9pfs_ra_drop(dev, ra);
+		rc = uk_9pfs_transfer(dev, fid, uio, vp->v_size, false, NULL);
+		ra->next = uio->uio_offset;
+		ra->gen = gen;
+		return rc;
+	}
+
+	uk_9pfs_ra_wait(dev, ra);
+	if (uio->uio_offset >= ra->off &&
+	    uio->uio_offset < ra->off + (off_t)ra->len) {
+		n = MIN((size_t)(ra->off + ra->len - uio->uio_offset),
+			(size_t)uio->uio_resid);
+		rc = vfscore_uiomove(ra->buf + (uio->uio_offset - ra->off),
+				     (int)n, uio);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	rc = 0;
+	if (uio->uio_resid && uio->uio_offset < (off_t)vp->v_size)
+		rc = uk_9pfs_transfer(dev, fid, uio, vp->v_size, false, NULL);
+	ra->next = uio->uio_offset;
+
+	/* Read ahead once the buffer is used up */
+	if (!rc && ra->next >= ra->off + (off_t)ra->len &&
+	    ra->next < (off_t)vp->v_size)
+		uk_9pfs_ra_start(dev, fid, ra, vp->v_size, gen);
+
+	return rc;
+}
+#endif /* CONFIG_LIB9PFS_READAHEAD */
+
 static int uk_9pfs_open(struct vfscore_file *file)
 {
 	struct uk_9pfs_mount_data *md = UK_9PFS_MD(file->f_dentry->d_mount);
@@ -220,6 +478,10 @@ static int uk_9pfs_open(struct vfscore_file *file)
 		goto out_err;
 
 	fd->fid = openedfid;
+#if CONFIG_LIB9PFS_READAHEAD
+	/* Only writes after the open invalidate readahead */
+	fd->ra.gen = UK_9PFS_ND(file->f_dentry->d_vnode)->gen;
+#endif /* CONFIG_LIB9PFS_READAHEAD */
 	file->f_data = fd;
 	UK_9PFS_ND(file->f_dentry->d_vnode)->nb_open_files++;
 
@@ -239,6 +501,12 @@ static int uk_9pfs_close(struct vnode *vn __unused, struct vfscore_file *file)
 	if (fd->readdir_buf)
 		free(fd->readdir_buf);
 
+#if CONFIG_LIB9PFS_READAHEAD
+	/* The outstanding requests still read into the buffer */
+	uk_9pfs_ra_drop(UK_9PFS_MD(file->f_dentry->d_mount)->dev, &fd->ra);
+	free(fd->ra.buf);
+#endif /* CONFIG_LIB9PFS_READAHEAD */
+
 	uk_9pfid_put(fd->fid);
 	free(fd);
 	UK_9PFS_ND(file->f_dentry->d_vnode)->nb_open_files--;
@@ -575,11 +843,8 @@ out:
 static int uk_9pfs_read(struct vnode *vp, struct vfscore_file *fp,
 			struct uio *uio, int ioflag __unused)
 {
-	struct uk_9pdev *dev = UK_9PFS_MD(vp->v_mount)->dev;
+	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
 	struct uk_9pfid *fid = UK_9PFS_FD(fp)->fid;
-	struct iovec *iov;
-	int64_t bytes;
-	int i = 0;
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
@@ -592,31 +857,14 @@ static int uk_9pfs_read(struct vnode *vp, struct vfscore_file *fp,
 	if (!uio->uio_resid)
 		return 0;
 
-	while (i < uio->uio_iovcnt) {
-		iov = &uio->uio_iov[i];
-		if (!iov->iov_len) {
-			i++;
-			continue;
-		}
-
-		bytes = uk_9p_read(dev, fid, uio->uio_offset,
-				   iov->iov_len, iov->iov_base);
-		if (unlikely(bytes < 0))
-			return -(int)bytes;
-		if (!bytes)
-			break;
+#if CONFIG_LIB9PFS_READAHEAD
+	/* With the page cache, vfscore reads ahead by itself */
+	if (!md->cache)
+		return uk_9pfs_ra_read(md->dev, fid, vp, &UK_9PFS_FD(fp)->ra,
+				       uio);
+#endif /* CONFIG_LIB9PFS_READAHEAD */
 
-		UK_ASSERT(uio->uio_offset <= __OFF_MAX - bytes);
-		UK_ASSERT(uio->uio_resid >= bytes);
-		UK_ASSERT(iov->iov_len >= (uint64_t)bytes);
-
-		iov->iov_base = (char *)iov->iov_base + bytes;
-		iov->iov_len -= bytes;
-		uio->uio_offset += bytes;
-		uio->uio_resid -= bytes;
-	}
-
-	return 0;
+	return uk_9pfs_transfer(md->dev, fid, uio, vp->v_size, false, NULL);
 }
 
 static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
@@ -624,9 +872,8 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 	struct uk_9pfs_mount_data *md = UK_9PFS_MD(vp->v_mount);
 	struct uk_9pdev *dev = md->dev;
 	struct uk_9pfid *fid;
-	struct iovec *iov;
-	int64_t bytes;
-	int rc, i = 0;
+	off_t acked;
+	int rc;
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
@@ -657,39 +904,17 @@ static int uk_9pfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 	if (rc < 0)
 		goto out;
 
-	while (i < uio->uio_iovcnt) {
-		iov = &uio->uio_iov[i];
-		if (!iov->iov_len) {
-			i++;
-			continue;
-		}
-
-		bytes = uk_9p_write(dev, fid, uio->uio_offset,
-				    iov->iov_len, iov->iov_base);
-		if (unlikely(bytes < 0)) {
-			rc = (int)bytes;
-			break;
-		}
-		if (!bytes)
-			break;
-
-		UK_ASSERT(uio->uio_offset <= __OFF_MAX - bytes);
-		UK_ASSERT(uio->uio_resid >= bytes);
-		UK_ASSERT(iov->iov_len >= (uint64_t)bytes);
-
-		iov->iov_base = (char *)iov->iov_base + bytes;
-		iov->iov_len -= bytes;
-		uio->uio_offset += bytes;
-		uio->uio_resid -= bytes;
-	}
+	UK_9PFS_ND(vp)->gen++;
+	acked = uio->uio_offset;
+	rc = -uk_9pfs_transfer(dev, fid, uio, 0, true, &acked);
 
 	/*
-	 * If the uio offset after completion of the write requests is bigger
-	 * than the vnode's associated size, then the size must be updated
-	 * accordingly.
+	 * The file grows up to the furthest byte that the server confirmed.
+	 * This may lie beyond the uio offset if a write in the middle was
+	 * short.
 	 */
-	if (uio->uio_offset > vp->v_size)
-		vp->v_size = uio->uio_offset;
+	if (acked > vp->v_size)
+		vp->v_size = acked;
 
 out:
 	uk_9pfid_put(fid);
@@ -900,10 +1125,16 @@ static int uk_9pfs_fsync(struct vnode *vp, struct vfscore_file *fp)
 
 static int uk_9pfs_truncate(struct vnode *vp, off_t off)
 {
-	return uk_9pfs_setattr(vp, &(struct vattr){
+	int rc;
+
+	rc = uk_9pfs_setattr(vp, &(struct vattr){
 		.va_mask = AT_SIZE,
 		.va_size = off,
 	});
+	if (!rc)
+		vp->v_size = off;
+	UK_9PFS_ND(vp)->gen++;
+	return rc;
 }
 
 static int uk_9pfs_rename(struct vnode *dvp1, struct vnode *vp1,
@@ -1011,6 +1242,7 @@ static int uk_9pfs_symlink(struct vnode *dvp, const char *op, const char *np)
 #define uk_9pfs_cache		((vnop_cache_t)NULL)
 #define uk_9pfs_fallocate	((vnop_fallocate_t)vfscore_vop_nullop)
 #define uk_9pfs_poll		((vnop_poll_t)vfscore_vop_einval)
+#define uk_9pfs_splice_read	((vnop_splice_read_t)NULL)
 
 struct vnops uk_9pfs_vnops = {
 	.vop_open	= uk_9pfs_open,
@@ -1037,4 +1269,5 @@ struct vnops uk_9pfs_vnops = {
 	.vop_readlink	= uk_9pfs_readlink,
 	.vop_symlink	= uk_9pfs_symlink,
 	.vop_poll	= uk_9pfs_poll,
+	.vop_splice_read = uk_9pfs_splice_read,
 };
@@ -278,6 +278,10 @@ struct vnops devfs_vnops = {
 	devfs_readlink,		/* read link */
 	devfs_symlink,		/* symbolic link */
 	devfs_poll,		/* poll */
+	(vnop_splice_read_t) NULL, /* splice read */
+	(vnop_map_t) NULL,	/* map */
+	(vnop_unmap_t) NULL,	/* unmap */
+	(vnop_getpage_t) NULL,	/* get page */
 };
 
 /*
@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __EXT2FS_H__
+#define __EXT2FS_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/wait.h>
+#include <uk/blkdev.h>
+#include <vfscore/vnode.h>
+#include <vfscore/uio.h>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "ext2fs only supports little-endian architectures"
+#endif
+
+/*
+ * On-disk format
+ */
+
+#define EXT2_SUPER_MAGIC		0xEF53
+#define EXT2_SUPERBLOCK_OFFSET		1024
+#define EXT2_MIN_BLOCK_LOG_SIZE		10
+#define EXT2_MAX_BLOCK_LOG_SIZE		16
+
+#define EXT2_GOOD_OLD_REV		0
+#define EXT2_GOOD_OLD_FIRST_INO		11
+#define EXT2_GOOD_OLD_INODE_SIZE	128
+
+#define EXT2_ROOT_INO			2
+#define EXT2_LINK_MAX			32000
+
+#define EXT2_VALID_FS			0x0001
+
+#define EXT2_FEATURE_INCOMPAT_FILETYPE	0x0002
+#define EXT2_FEATURE_INCOMPAT_FLEX_BG	0x0200
+/* Everything we can read and write */
+#define EXT2_FEATURE_INCOMPAT_SUPP	(EXT2_FEATURE_INCOMPAT_FILETYPE | \
+					 EXT2_FEATURE_INCOMPAT_FLEX_BG)
+
+#define EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
+#define EXT2_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
+/* Everything we can write, other features only allow read-only mounts */
+#define EXT2_FEATURE_RO_COMPAT_SUPP	(EXT2_FEATURE_RO_COMPAT_SPARSE_SUPER | \
+					 EXT2_FEATURE_RO_COMPAT_LARGE_FILE)
+
+#define EXT2_NDIR_BLOCKS		12
+#define EXT2_IND_BLOCK			EXT2_NDIR_BLOCKS
+#define EXT2_N_BLOCKS			15
+/* Inline symlink targets are stored in i_block */
+#define EXT2_FAST_SYMLINK_MAX		(EXT2_N_BLOCKS * 4)
+
+#define EXT2_INDEX_FL			0x00001000
+
+#define EXT2_NAME_LEN			255
+
+#define EXT2_FT_UNKNOWN			0
+#define EXT2_FT_REG_FILE		1
+#define EXT2_FT_DIR			2
+#define EXT2_FT_CHRDEV			3
+#define EXT2_FT_BLKDEV			4
+#define EXT2_FT_FIFO			5
+#define EXT2_FT_SOCK			6
+#define EXT2_FT_SYMLINK			7
+
+struct ext2_super_block {
+	__u32	s_inodes_count;
+	__u32	s_blocks_count;
+	__u32	s_r_blocks_count;
+	__u32	s_free_blocks_count;
+	__u32	s_free_inodes_count;
+	__u32	s_first_data_block;
+	__u32	s_log_block_size;
+	__u32	s_log_frag_size;
+	__u32	s_blocks_per_group;
+	__u32	s_frags_per_group;
+	__u32	s_inodes_per_group;
+	__u32	s_mtime;
+	__u32	s_wtime;
+	__u16	s_mnt_count;
+	__s16	s_max_mnt_count;
+	__u16	s_magic;
+	__u16	s_state;
+	__u16	s_errors;
+	__u16	s_minor_rev_level;
+	__u32	s_lastcheck;
+	__u32	s_checkinterval;
+	__u32	s_creator_os;
+	__u32	s_rev_level;
+	__u16	s_def_resuid;
+	__u16	s_def_resgid;
+	/* EXT2_DYNAMIC_REV only */
+	__u32	s_first_ino;
+	__u16	s_inode_size;
+	__u16	s_block_group_nr;
+	__u32	s_feature_compat;
+	__u32	s_feature_incompat;
+	__u32	s_feature_ro_compat;
+	__u8	s_uuid[16];
+	char	s_volume_name[16];
+	char	s_last_mounted[64];
+	__u32	s_algorithm_usage_bitmap;
+	__u8	s_prealloc_blocks;
+	__u8	s_prealloc_dir_blocks;
+	__u16	s_reserved_gdt_blocks;
+	__u8	s_journal_uuid[16];
+	__u32	s_journal_inum;
+	__u32	s_journal_dev;
+	__u32	s_last_orphan;
+	__u32	s_hash_seed[4];
+	__u8	s_def_hash_version;
+	__u8	s_reserved_char_pad;
+	__u16	s_desc_size;
+	__u32	s_default_mount_opts;
+	__u32	s_first_meta_bg;
+	__u32	s_reserved[190];
+};
+
+UK_CTASSERT(sizeof(struct ext2_super_block) == 1024);
+
+struct ext2_group_desc {
+	__u32	bg_block_bitmap;
+	__u32	bg_inode_bitmap;
+	__u32	bg_inode_table;
+	__u16	bg_free_blocks_count;
+	__u16	bg_free_inodes_count;
+	__u16	bg_used_dirs_count;
+	__u16	bg_flags;
+	__u32	bg_reserved[3];
+};
+
+UK_CTASSERT(sizeof(struct ext2_group_desc) == 32);
+
+struct ext2_inode {
+	__u16	i_mode;
+	__u16	i_uid;
+	__u32	i_size;
+	__u32	i_atime;
+	__u32	i_ctime;
+	__u32	i_mtime;
+	__u32	i_dtime;
+	__u16	i_gid;
+	__u16	i_links_count;
+	__u32	i_blocks;	/* in 512-byte units */
+	__u32	i_flags;
+	__u32	i_osd1;
+	__u32	i_block[EXT2_N_BLOCKS];
+	__u32	i_generation;
+	__u32	i_file_acl;
+	__u32	i_size_high;	/* i_dir_acl for directories */
+	__u32	i_faddr;
+	__u8	i_osd2[12];
+};
+
+UK_CTASSERT(sizeof(struct ext2_inode) == EXT2_GOOD_OLD_INODE_SIZE);
+
+struct ext2_dir_entry {
+	__u32	inode;
+	__u16	rec_len;
+	__u8	name_len;
+	__u8	file_type;	/* name_len high byte without FILETYPE */
+	char	name[];
+};
+
+#define EXT2_DIR_ENTRY_HDR	8
+#define EXT2_DIR_REC_LEN(len)	((EXT2_DIR_ENTRY_HDR + (len) + 3) & ~3U)
+
+/*
+ * In-memory structures
+ */
+
+/* Cached metadata block */
+struct ext2fs_buf {
+	struct uk_hlist_node hash_link;
+	struct uk_list_head lru_link;	/* unreferenced buffers, oldest first */
+	struct uk_list_head dirty_link;
+	__u32 blkno;
+	unsigned int ref;
+	int dirty;
+	void *data;
+};
+
+#define EXT2FS_BHASH_SIZE	64
+
+struct ext2fs_mount {
+	/* Block device */
+	struct uk_blkdev *bd;
+	size_t ssize;			/* sector size */
+	__sector blk_sectors;		/* sectors per file system block */
+	__sector max_sectors;		/* sectors per request */
+	size_t ioalign;
+	int polled;			/* completions are polled */
+	struct uk_mutex io_lock;	/* serializes queue accesses */
+	struct uk_waitq io_wq;		/* woken on every completion */
+	unsigned long io_completed;
+
+	/* Protects everything below and all nodes of the mount */
+	struct uk_mutex lock;
+	int rdonly;
+
+	struct ext2fs_buf *sb_buf;
+	struct ext2_super_block *sb;
+	struct ext2fs_buf **gd_bufs;
+	__u32 ngroups;
+	__u32 ngd_blocks;
+	__u32 gd_per_block;
+
+	__u32 bsize;
+	unsigned int bshift;
+	__u32 addr_per_block;
+	unsigned int addr_shift;
+	__u64 max_size;			/* of regular files */
+	__u32 inode_size;
+	__u32 first_ino;
+	int filetype;			/* dir entries hold file types */
+
+	/* Metadata block cache */
+	struct uk_hlist_head bhash[EXT2FS_BHASH_SIZE];
+	struct uk_list_head blru;
+	struct uk_list_head bdirty;
+	unsigned long nbufs;
+};
+
+/* Private data of a vnode */
+struct ext2fs_node {
+	__u32 ino;
+	struct ext2_inode inode;
+	__u32 alloc_goal;		/* next block to try to allocate */
+};
+
+#define EXT2FS_MP(mp)		((struct ext2fs_mount *) (mp)->m_data)
+#define EXT2FS_VFS(vp)		EXT2FS_MP((vp)->v_mount)
+#define EXT2FS_NODE(vp)		((struct ext2fs_node *) (vp)->v_data)
+
+static inline __u64 ext2fs_isize(const struct ext2_inode *ip)
+{
+	__u64 size = ip->i_size;
+
+	if ((ip->i_mode & S_IFMT) == S_IFREG)
+		size |= (__u64) ip->i_size_high << 32;
+	return size;
+}
+
+static inline void ext2fs_set_isize(struct ext2_inode *ip, __u64 size)
+{
+	ip->i_size = (__u32) size;
+	if ((ip->i_mode & S_IFMT) == S_IFREG)
+		ip->i_size_high = (__u32) (size >> 32);
+}
+
+/* Returns the current time in seconds for inode timestamps */
+__u32 ext2fs_now(void);
+
+/*
+ * ext2fs_io.c: Block I/O and metadata block cache
+ */
+
+/* Batch of block requests that are in flight at the same time */
+struct ext2fs_io {
+	struct ext2fs_mount *fs;
+	unsigned int nreqs;		/* submitted requests in reqs */
+	int pending;			/* requests not completed yet */
+	int error;
+	/* Request that is built up and not submitted yet */
+	int open;
+	struct uk_blkreq reqs[CONFIG_LIBEXT2FS_MAX_INFLIGHT];
+};
+
+int ext2fs_io_attach(struct ext2fs_mount *fs, unsigned int id);
+void ext2fs_io_detach(struct ext2fs_mount *fs);
+
+void *ext2fs_io_alloc(struct ext2fs_mount *fs, size_t size);
+void ext2fs_io_free(struct ext2fs_mount *fs, void *buf);
+
+void ext2fs_io_init(struct ext2fs_mount *fs, struct ext2fs_io *io);
+/* Adds a transfer of nblks blocks, adjacent transfers are merged */
+int ext2fs_io_add(struct ext2fs_io *io, enum uk_blkreq_op op, __u32 blkno,
+		  __u32 nblks, void *buf);
+/* Waits for all requests of the batch, returns a positive errno value */
+int ext2fs_io_wait(struct ext2fs_io *io);
+/* Synchronously transfers a single run of blocks */
+int ext2fs_io_rw(struct ext2fs_mount *fs, enum uk_blkreq_op op, __u32 blkno,
+		 __u32 nblks, void *buf);
+int ext2fs_io_flush(struct ext2fs_mount *fs);
+
+void ext2fs_bcache_init(struct ext2fs_mount *fs);
+void ext2fs_bcache_destroy(struct ext2fs_mount *fs);
+int ext2fs_bread(struct ext2fs_mount *fs, __u32 blkno,
+		 struct ext2fs_buf **bpp);
+/* Like ext2fs_bread() but returns a zeroed buffer without reading */
+int ext2fs_bget(struct ext2fs_mount *fs, __u32 blkno,
+		struct ext2fs_buf **bpp);
+void ext2fs_brelse(struct ext2fs_mount *fs, struct ext2fs_buf *bp);
+void ext2fs_bdirty(struct ext2fs_mount *fs, struct ext2fs_buf *bp);
+/* Drops the cached copy of a block that was freed */
+void ext2fs_binval(struct ext2fs_mount *fs, __u32 blkno);
+int ext2fs_bsync(struct ext2fs_mount *fs);
+
+/*
+ * ext2fs_alloc.c: Group descriptors, bitmaps, and the inode table
+ */
+
+struct ext2_group_desc *ext2fs_gd(struct ext2fs_mount *fs, __u32 group);
+void ext2fs_gd_dirty(struct ext2fs_mount *fs, __u32 group);
+
+int ext2fs_balloc(struct ext2fs_mount *fs, __u32 goal, __u32 *blknop);
+void ext2fs_bfree(struct ext2fs_mount *fs, __u32 blkno);
+int ext2fs_ialloc(struct ext2fs_mount *fs, __u32 dir_ino, int is_dir,
+		  __u32 *inop);
+void ext2fs_ifree(struct ext2fs_mount *fs, __u32 ino, int is_dir);
+
+int ext2fs_iread(struct ext2fs_mount *fs, __u32 ino, struct ext2_inode *ip);
+int ext2fs_iwrite(struct ext2fs_mount *fs, __u32 ino,
+		  const struct ext2_inode *ip);
+
+/*
+ * ext2fs_inode.c: Block mapping and file data
+ */
+
+int ext2fs_bmap(struct ext2fs_mount *fs, struct ext2fs_node *np, __u32 lblk,
+		int alloc, __u32 *blknop);
+/* Frees the blocks past size without changing the inode size */
+int ext2fs_truncate_blocks(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			   __u64 size);
+/* Changes the size of a regular file and writes the inode */
+int ext2fs_resize(struct ext2fs_mount *fs, struct ext2fs_node *np,
+		    __u64 size);
+int ext2fs_rdwr(struct vnode *vp, struct uio *uio, int ioflag);
+
+/*
+ * ext2fs_dir.c: Directories
+ */
+
+int ext2fs_dir_lookup(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		      const char *name, __u32 *inop);
+int ext2fs_dir_add(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		   const char *name, __u32 ino, __u16 mode);
+int ext2fs_dir_remove(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		      const char *name);
+int ext2fs_dir_init(struct ext2fs_mount *fs, struct ext2fs_node *np,
+		    __u32 parent_ino);
+/* Points an existing entry to another inode */
+int ext2fs_dir_replace(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		       const char *name, __u32 ino, __u16 mode);
+int ext2fs_dir_set_parent(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			  __u32 parent_ino);
+/* Returns 0 if the directory only holds "." and "..", ENOTEMPTY otherwise */
+int ext2fs_dir_empty(struct ext2fs_mount *fs, struct ext2fs_node *np);
+/* Reads the entry at or after *offp and advances *offp past it */
+int ext2fs_dir_next(struct ext2fs_mount *fs, struct ext2fs_node *np,
+		    off_t *offp, __u32 *inop, __u8 *typep, char *name);
+
+#endif /* __EXT2FS_H__ */
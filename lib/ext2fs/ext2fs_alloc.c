@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ext2fs_alloc.c - block and inode allocation of the ext2 file system.
+ *
+ * The group descriptors stay referenced in the block cache while the file
+ * system is mounted. Bitmaps and inode tables are read through the block
+ * cache on demand. Free counters of the groups and of the super block are
+ * updated together with the bitmaps and reach the disk on sync.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+
+#include "ext2fs.h"
+
+struct ext2_group_desc *ext2fs_gd(struct ext2fs_mount *fs, __u32 group)
+{
+	UK_ASSERT(group < fs->ngroups);
+
+	return (struct ext2_group_desc *)
+		fs->gd_bufs[group / fs->gd_per_block]->data +
+		group % fs->gd_per_block;
+}
+
+void ext2fs_gd_dirty(struct ext2fs_mount *fs, __u32 group)
+{
+	ext2fs_bdirty(fs, fs->gd_bufs[group / fs->gd_per_block]);
+}
+
+/* Returns the first clear bit in [start, nbits) or -1 */
+static long ext2fs_bitmap_ffz(const __u8 *map, __u32 start, __u32 nbits)
+{
+	__u32 i = start;
+
+	while (i < nbits) {
+		if ((i & 7) == 0 && map[i >> 3] == 0xff) {
+			i += 8;
+			continue;
+		}
+		if (!(map[i >> 3] & (1 << (i & 7))))
+			return i;
+		i++;
+	}
+	return -1;
+}
+
+static inline __u32 ext2fs_group_blocks(struct ext2fs_mount *fs, __u32 group)
+{
+	__u32 first = fs->sb->s_first_data_block +
+		      group * fs->sb->s_blocks_per_group;
+
+	return MIN(fs->sb->s_blocks_per_group,
+		   fs->sb->s_blocks_count - first);
+}
+
+int ext2fs_balloc(struct ext2fs_mount *fs, __u32 goal, __u32 *blknop)
+{
+	struct ext2_super_block *sb = fs->sb;
+	struct ext2_group_desc *gd;
+	struct ext2fs_buf *bp;
+	__u32 g0, g, i, start;
+	__u8 *map;
+	long bit;
+	int rc;
+
+	if (sb->s_free_blocks_count == 0)
+		return ENOSPC;
+
+	if (goal < sb->s_first_data_block || goal >= sb->s_blocks_count)
+		goal = sb->s_first_data_block;
+	g0 = (goal - sb->s_first_data_block) / sb->s_blocks_per_group;
+	start = (goal - sb->s_first_data_block) % sb->s_blocks_per_group;
+
+	/* The goal group is visited twice to search before the goal, too */
+	for (i = 0; i <= fs->ngroups; i++, start = 0) {
+		g = (g0 + i) % fs->ngroups;
+		gd = ext2fs_gd(fs, g);
+		if (gd->bg_free_blocks_count == 0)
+			continue;
+
+		rc = ext2fs_bread(fs, gd->bg_block_bitmap, &bp);
+		if (unlikely(rc))
+			return rc;
+
+		map = bp->data;
+		bit = ext2fs_bitmap_ffz(map, start, ext2fs_group_blocks(fs, g));
+		if (bit < 0) {
+			ext2fs_brelse(fs, bp);
+			continue;
+		}
+
+		map[bit >> 3] |= 1 << (bit & 7);
+		ext2fs_bdirty(fs, bp);
+		ext2fs_brelse(fs, bp);
+
+		gd->bg_free_blocks_count--;
+		ext2fs_gd_dirty(fs, g);
+		sb->s_free_blocks_count--;
+		ext2fs_bdirty(fs, fs->sb_buf);
+
+		*blknop = sb->s_first_data_block +
+			  g * sb->s_blocks_per_group + (__u32) bit;
+		return 0;
+	}
+	return ENOSPC;
+}
+
+void ext2fs_bfree(struct ext2fs_mount *fs, __u32 blkno)
+{
+	struct ext2_super_block *sb = fs->sb;
+	struct ext2_group_desc *gd;
+	struct ext2fs_buf *bp;
+	__u32 g, bit;
+	__u8 *map;
+
+	if (unlikely(blkno < sb->s_first_data_block ||
+		     blkno >= sb->s_blocks_count)) {
+		uk_pr_err("Freeing invalid block %"PRIu32"\n", blkno);
+		return;
+	}
+
+	ext2fs_binval(fs, blkno);
+
+	g = (blkno - sb->s_first_data_block) / sb->s_blocks_per_group;
+	bit = (blkno - sb->s_first_data_block) % sb->s_blocks_per_group;
+	gd = ext2fs_gd(fs, g);
+	if (unlikely(ext2fs_bread(fs, gd->bg_block_bitmap, &bp))) {
+		uk_pr_err("Failed to free block %"PRIu32"\n", blkno);
+		return;
+	}
+
+	map = bp->data;
+	if (unlikely(!(map[bit >> 3] & (1 << (bit & 7))))) {
+		uk_pr_warn("Block %"PRIu32" is already free\n", blkno);
+		ext2fs_brelse(fs, bp);
+		return;
+	}
+	map[bit >> 3] &= ~(1 << (bit & 7));
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+
+	gd->bg_free_blocks_count++;
+	ext2fs_gd_dirty(fs, g);
+	sb->s_free_blocks_count++;
+	ext2fs_bdirty(fs, fs->sb_buf);
+}
+
+/* Directories are spread over the groups with the most free inodes, other
+ * inodes are placed close to their directory.
+ */
+static __u32 ext2fs_ialloc_group(struct ext2fs_mount *fs, __u32 dir_ino,
+				 int is_dir)
+{
+	struct ext2_group_desc *gd;
+	__u32 g, best = 0, best_free = 0;
+
+	if (!is_dir)
+		return (dir_ino - 1) / fs->sb->s_inodes_per_group;
+
+	for (g = 0; g < fs->ngroups; g++) {
+		gd = ext2fs_gd(fs, g);
+		if (gd->bg_free_blocks_count == 0)
+			continue;
+		if (gd->bg_free_inodes_count > best_free) {
+			best = g;
+			best_free = gd->bg_free_inodes_count;
+		}
+	}
+	return best;
+}
+
+int ext2fs_ialloc(struct ext2fs_mount *fs, __u32 dir_ino, int is_dir,
+		  __u32 *inop)
+{
+	struct ext2_super_block *sb = fs->sb;
+	struct ext2_group_desc *gd;
+	struct ext2fs_buf *bp;
+	__u32 g0, g, i, start;
+	__u8 *map;
+	long bit;
+	int rc;
+
+	if (sb->s_free_inodes_count == 0)
+		return ENOSPC;
+
+	g0 = ext2fs_ialloc_group(fs, dir_ino, is_dir);
+	for (i = 0; i < fs->ngroups; i++) {
+		g = (g0 + i) % fs->ngroups;
+		gd = ext2fs_gd(fs, g);
+		if (gd->bg_free_inodes_count == 0)
+			continue;
+
+		rc = ext2fs_bread(fs, gd->bg_inode_bitmap, &bp);
+		if (unlikely(rc))
+			return rc;
+
+		/* The first inodes are reserved */
+		start = (g == 0) ? fs->first_ino - 1 : 0;
+		map = bp->data;
+		bit = ext2fs_bitmap_ffz(map, start, sb->s_inodes_per_group);
+		if (bit < 0) {
+			ext2fs_brelse(fs, bp);
+			continue;
+		}
+
+		map[bit >> 3] |= 1 << (bit & 7);
+		ext2fs_bdirty(fs, bp);
+		ext2fs_brelse(fs, bp);
+
+		gd->bg_free_inodes_count--;
+		if (is_dir)
+			gd->bg_used_dirs_count++;
+		ext2fs_gd_dirty(fs, g);
+		sb->s_free_inodes_count--;
+		ext2fs_bdirty(fs, fs->sb_buf);
+
+		*inop = g * sb->s_inodes_per_group + (__u32) bit + 1;
+		return 0;
+	}
+	return ENOSPC;
+}
+
+void ext2fs_ifree(struct ext2fs_mount *fs, __u32 ino, int is_dir)
+{
+	struct ext2_super_block *sb = fs->sb;
+	struct ext2_group_desc *gd;
+	struct ext2fs_buf *bp;
+	__u32 g, bit;
+	__u8 *map;
+
+	UK_ASSERT(ino >= 1 && ino <= sb->s_inodes_count);
+
+	g = (ino - 1) / sb->s_inodes_per_group;
+	bit = (ino - 1) % sb->s_inodes_per_group;
+	gd = ext2fs_gd(fs, g);
+	if (unlikely(ext2fs_bread(fs, gd->bg_inode_bitmap, &bp))) {
+		uk_pr_err("Failed to free inode %"PRIu32"\n", ino);
+		return;
+	}
+
+	map = bp->data;
+	if (unlikely(!(map[bit >> 3] & (1 << (bit & 7))))) {
+		uk_pr_warn("Inode %"PRIu32" is already free\n", ino);
+		ext2fs_brelse(fs, bp);
+		return;
+	}
+	map[bit >> 3] &= ~(1 << (bit & 7));
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+
+	gd->bg_free_inodes_count++;
+	if (is_dir)
+		gd->bg_used_dirs_count--;
+	ext2fs_gd_dirty(fs, g);
+	sb->s_free_inodes_count++;
+	ext2fs_bdirty(fs, fs->sb_buf);
+}
+
+/* Locates the on-disk inode in the inode table */
+static int ext2fs_iloc(struct ext2fs_mount *fs, __u32 ino, __u32 *blknop,
+		       __u32 *offp)
+{
+	struct ext2_group_desc *gd;
+	__u32 idx, off;
+
+	if (unlikely(ino < 1 || ino > fs->sb->s_inodes_count)) {
+		uk_pr_err("Invalid inode number %"PRIu32"\n", ino);
+		return EIO;
+	}
+
+	gd = ext2fs_gd(fs, (ino - 1) / fs->sb->s_inodes_per_group);
+	idx = (ino - 1) % fs->sb->s_inodes_per_group;
+	off = idx * fs->inode_size;
+
+	*blknop = gd->bg_inode_table + (off >> fs->bshift);
+	*offp = off & (fs->bsize - 1);
+	return 0;
+}
+
+int ext2fs_iread(struct ext2fs_mount *fs, __u32 ino, struct ext2_inode *ip)
+{
+	struct ext2fs_buf *bp;
+	__u32 blkno, off;
+	int rc;
+
+	rc = ext2fs_iloc(fs, ino, &blkno, &off);
+	if (unlikely(rc))
+		return rc;
+
+	rc = ext2fs_bread(fs, blkno, &bp);
+	if (unlikely(rc))
+		return rc;
+
+	memcpy(ip, (char *) bp->data + off, sizeof(*ip));
+	ext2fs_brelse(fs, bp);
+	return 0;
+}
+
+int ext2fs_iwrite(struct ext2fs_mount *fs, __u32 ino,
+		  const struct ext2_inode *ip)
+{
+	struct ext2fs_buf *bp;
+	__u32 blkno, off;
+	int rc;
+
+	rc = ext2fs_iloc(fs, ino, &blkno, &off);
+	if (unlikely(rc))
+		return rc;
+
+	rc = ext2fs_bread(fs, blkno, &bp);
+	if (unlikely(rc))
+		return rc;
+
+	/* Only the base inode is replaced, extra fields of large inodes are
+	 * kept
+	 */
+	memcpy((char *) bp->data + off, ip, sizeof(*ip));
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+	return 0;
+}
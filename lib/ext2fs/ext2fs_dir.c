@@ -0,0 +1,362 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ext2fs_dir.c - directories of the ext2 file system.
+ *
+ * Directories are read and modified as linear lists of entries through the
+ * block cache. Hashed directory indexes are not used. As their blocks look
+ * like regular directory blocks, indexed directories can still be read.
+ * When an indexed directory is modified, its index flag is cleared, which
+ * tells other implementations to rebuild the index.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+
+#include "ext2fs.h"
+
+static inline int ext2fs_dirent_valid(struct ext2fs_mount *fs,
+				      const struct ext2_dir_entry *e,
+				      __u32 off)
+{
+	return e->rec_len >= EXT2_DIR_ENTRY_HDR && !(e->rec_len & 3) &&
+	       off + e->rec_len <= fs->bsize &&
+	       EXT2_DIR_REC_LEN(e->name_len) <= e->rec_len;
+}
+
+static inline struct ext2_dir_entry *ext2fs_dirent(struct ext2fs_buf *bp,
+						   __u32 off)
+{
+	return (struct ext2_dir_entry *) ((char *) bp->data + off);
+}
+
+static __u8 ext2fs_dirent_type(__u16 mode)
+{
+	switch (mode & S_IFMT) {
+	case S_IFREG:
+		return EXT2_FT_REG_FILE;
+	case S_IFDIR:
+		return EXT2_FT_DIR;
+	case S_IFCHR:
+		return EXT2_FT_CHRDEV;
+	case S_IFBLK:
+		return EXT2_FT_BLKDEV;
+	case S_IFIFO:
+		return EXT2_FT_FIFO;
+	case S_IFSOCK:
+		return EXT2_FT_SOCK;
+	case S_IFLNK:
+		return EXT2_FT_SYMLINK;
+	default:
+		return EXT2_FT_UNKNOWN;
+	}
+}
+
+static void ext2fs_dirent_set(struct ext2fs_mount *fs,
+			      struct ext2_dir_entry *e, const char *name,
+			      size_t len, __u32 ino, __u16 mode)
+{
+	e->inode = ino;
+	e->name_len = len;
+	e->file_type = fs->filetype ? ext2fs_dirent_type(mode) : 0;
+	memcpy(e->name, name, len);
+}
+
+/* Reads a block of a directory */
+static int ext2fs_dir_bread(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+			    __u32 lblk, struct ext2fs_buf **bpp)
+{
+	__u32 blkno;
+	int rc;
+
+	rc = ext2fs_bmap(fs, dnp, lblk, 0, &blkno);
+	if (unlikely(rc))
+		return rc;
+	if (unlikely(!blkno)) {
+		uk_pr_err("Directory %"PRIu32" has a hole\n", dnp->ino);
+		return EIO;
+	}
+	return ext2fs_bread(fs, blkno, bpp);
+}
+
+static void ext2fs_dir_modified(struct ext2fs_node *dnp)
+{
+	dnp->inode.i_flags &= ~EXT2_INDEX_FL;
+	dnp->inode.i_mtime = dnp->inode.i_ctime = ext2fs_now();
+}
+
+/*
+ * Finds the entry with the given name. On success, the directory block stays
+ * referenced in *bpp, *offp is the offset of the entry in the block, and
+ * *prevp the offset of the previous entry or -1 for the first entry.
+ */
+static int ext2fs_dir_find(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+			   const char *name, struct ext2fs_buf **bpp,
+			   __u32 *offp, long *prevp)
+{
+	__u32 nblks = ext2fs_isize(&dnp->inode) >> fs->bshift;
+	size_t len = strlen(name);
+	struct ext2_dir_entry *e;
+	struct ext2fs_buf *bp;
+	__u32 lblk, off;
+	long prev;
+	int rc;
+
+	for (lblk = 0; lblk < nblks; lblk++) {
+		rc = ext2fs_dir_bread(fs, dnp, lblk, &bp);
+		if (unlikely(rc))
+			return rc;
+
+		prev = -1;
+		for (off = 0; off < fs->bsize; prev = off, off += e->rec_len) {
+			e = ext2fs_dirent(bp, off);
+			if (unlikely(!ext2fs_dirent_valid(fs, e, off))) {
+				uk_pr_err("Corrupted directory %"PRIu32"\n",
+					  dnp->ino);
+				ext2fs_brelse(fs, bp);
+				return EIO;
+			}
+			if (e->inode && e->name_len == len &&
+			    memcmp(e->name, name, len) == 0) {
+				*bpp = bp;
+				*offp = off;
+				*prevp = prev;
+				return 0;
+			}
+		}
+		ext2fs_brelse(fs, bp);
+	}
+	return ENOENT;
+}
+
+int ext2fs_dir_lookup(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		      const char *name, __u32 *inop)
+{
+	struct ext2fs_buf *bp;
+	__u32 off;
+	long prev;
+	int rc;
+
+	rc = ext2fs_dir_find(fs, dnp, name, &bp, &off, &prev);
+	if (rc)
+		return rc;
+
+	*inop = ext2fs_dirent(bp, off)->inode;
+	ext2fs_brelse(fs, bp);
+	return 0;
+}
+
+int ext2fs_dir_add(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		   const char *name, __u32 ino, __u16 mode)
+{
+	__u32 nblks = ext2fs_isize(&dnp->inode) >> fs->bshift;
+	size_t len = strlen(name);
+	__u32 need = EXT2_DIR_REC_LEN(len);
+	struct ext2_dir_entry *e, *ne;
+	struct ext2fs_buf *bp;
+	__u32 lblk, off, used, blkno;
+	int rc;
+
+	UK_ASSERT(len > 0 && len <= EXT2_NAME_LEN);
+
+	/* Look for an entry with enough slack */
+	for (lblk = 0; lblk < nblks; lblk++) {
+		rc = ext2fs_dir_bread(fs, dnp, lblk, &bp);
+		if (unlikely(rc))
+			return rc;
+
+		for (off = 0; off < fs->bsize; off += e->rec_len) {
+			e = ext2fs_dirent(bp, off);
+			if (unlikely(!ext2fs_dirent_valid(fs, e, off))) {
+				ext2fs_brelse(fs, bp);
+				return EIO;
+			}
+
+			used = e->inode ? EXT2_DIR_REC_LEN(e->name_len) : 0;
+			if (e->rec_len - used < need)
+				continue;
+
+			if (used) {
+				ne = ext2fs_dirent(bp, off + used);
+				ne->rec_len = e->rec_len - used;
+				e->rec_len = used;
+				e = ne;
+			}
+			ext2fs_dirent_set(fs, e, name, len, ino, mode);
+			ext2fs_bdirty(fs, bp);
+			ext2fs_brelse(fs, bp);
+			goto out;
+		}
+		ext2fs_brelse(fs, bp);
+	}
+
+	/* Append a new block */
+	rc = ext2fs_bmap(fs, dnp, nblks, 1, &blkno);
+	if (unlikely(rc))
+		return rc;
+	rc = ext2fs_bget(fs, blkno, &bp);
+	if (unlikely(rc))
+		return rc;
+
+	e = ext2fs_dirent(bp, 0);
+	e->rec_len = fs->bsize;
+	ext2fs_dirent_set(fs, e, name, len, ino, mode);
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+	ext2fs_set_isize(&dnp->inode, (__u64) (nblks + 1) << fs->bshift);
+
+out:
+	ext2fs_dir_modified(dnp);
+	return ext2fs_iwrite(fs, dnp->ino, &dnp->inode);
+}
+
+int ext2fs_dir_remove(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		      const char *name)
+{
+	struct ext2_dir_entry *e;
+	struct ext2fs_buf *bp;
+	__u32 off;
+	long prev;
+	int rc;
+
+	rc = ext2fs_dir_find(fs, dnp, name, &bp, &off, &prev);
+	if (rc)
+		return rc;
+
+	/* Merge the entry into the previous one of the block */
+	e = ext2fs_dirent(bp, off);
+	if (prev >= 0)
+		ext2fs_dirent(bp, prev)->rec_len += e->rec_len;
+	else
+		e->inode = 0;
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+
+	ext2fs_dir_modified(dnp);
+	return ext2fs_iwrite(fs, dnp->ino, &dnp->inode);
+}
+
+int ext2fs_dir_init(struct ext2fs_mount *fs, struct ext2fs_node *np,
+		    __u32 parent_ino)
+{
+	struct ext2_dir_entry *e;
+	struct ext2fs_buf *bp;
+	__u32 blkno;
+	int rc;
+
+	rc = ext2fs_bmap(fs, np, 0, 1, &blkno);
+	if (unlikely(rc))
+		return rc;
+	rc = ext2fs_bget(fs, blkno, &bp);
+	if (unlikely(rc))
+		return rc;
+
+	e = ext2fs_dirent(bp, 0);
+	e->rec_len = EXT2_DIR_REC_LEN(1);
+	ext2fs_dirent_set(fs, e, ".", 1, np->ino, S_IFDIR);
+
+	e = ext2fs_dirent(bp, EXT2_DIR_REC_LEN(1));
+	e->rec_len = fs->bsize - EXT2_DIR_REC_LEN(1);
+	ext2fs_dirent_set(fs, e, "..", 2, parent_ino, S_IFDIR);
+
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+	ext2fs_set_isize(&np->inode, fs->bsize);
+	return 0;
+}
+
+int ext2fs_dir_replace(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+		       const char *name, __u32 ino, __u16 mode)
+{
+	struct ext2_dir_entry *e;
+	struct ext2fs_buf *bp;
+	__u32 off;
+	long prev;
+	int rc;
+
+	rc = ext2fs_dir_find(fs, dnp, name, &bp, &off, &prev);
+	if (rc)
+		return rc;
+
+	e = ext2fs_dirent(bp, off);
+	e->inode = ino;
+	e->file_type = fs->filetype ? ext2fs_dirent_type(mode) : 0;
+	ext2fs_bdirty(fs, bp);
+	ext2fs_brelse(fs, bp);
+
+	ext2fs_dir_modified(dnp);
+	return ext2fs_iwrite(fs, dnp->ino, &dnp->inode);
+}
+
+int ext2fs_dir_set_parent(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			  __u32 parent_ino)
+{
+	int rc;
+
+	rc = ext2fs_dir_replace(fs, np, "..", parent_ino, S_IFDIR);
+	return rc == ENOENT ? EIO : rc;
+}
+
+int ext2fs_dir_empty(struct ext2fs_mount *fs, struct ext2fs_node *np)
+{
+	off_t off = 0;
+	char name[EXT2_NAME_LEN + 1];
+	__u32 ino;
+	__u8 type;
+	int rc;
+
+	while ((rc = ext2fs_dir_next(fs, np, &off, &ino, &type, name)) == 0) {
+		if (strcmp(name, ".") && strcmp(name, ".."))
+			return ENOTEMPTY;
+	}
+	return rc == ENOENT ? 0 : rc;
+}
+
+int ext2fs_dir_next(struct ext2fs_mount *fs, struct ext2fs_node *np,
+		    off_t *offp, __u32 *inop, __u8 *typep, char *name)
+{
+	__u64 size = ext2fs_isize(&np->inode);
+	struct ext2_dir_entry *e;
+	struct ext2fs_buf *bp;
+	__u32 lblk, boff, off;
+	int rc;
+
+	while ((__u64) *offp < size) {
+		lblk = *offp >> fs->bshift;
+		boff = *offp & (fs->bsize - 1);
+		rc = ext2fs_dir_bread(fs, np, lblk, &bp);
+		if (unlikely(rc))
+			return rc;
+
+		/* Offsets are entry boundaries only when walking from the
+		 * start of the block
+		 */
+		for (off = 0; off < fs->bsize; off += e->rec_len) {
+			e = ext2fs_dirent(bp, off);
+			if (unlikely(!ext2fs_dirent_valid(fs, e, off))) {
+				ext2fs_brelse(fs, bp);
+				return EIO;
+			}
+			if (off < boff || !e->inode)
+				continue;
+
+			*inop = e->inode;
+			*typep = fs->filetype ? e->file_type : EXT2_FT_UNKNOWN;
+			memcpy(name, e->name, e->name_len);
+			name[e->name_len] = '\0';
+			*offp = ((off_t) lblk << fs->bshift) + off + e->rec_len;
+			ext2fs_brelse(fs, bp);
+			return 0;
+		}
+		ext2fs_brelse(fs, bp);
+		*offp = (off_t) (lblk + 1) << fs->bshift;
+	}
+	return ENOENT;
+}
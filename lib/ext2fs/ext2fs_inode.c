@@ -0,0 +1,454 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ext2fs_inode.c - block mapping and file data of the ext2 file system.
+ *
+ * File data is transferred in chunks through a staging buffer. All blocks
+ * of a chunk are mapped first, then the transfers of the chunk are issued
+ * as one batch, in which physically contiguous blocks become a single
+ * request. Writes allocate missing blocks before the data is copied, so that
+ * a full file system results in a short write instead of a failed one.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <vfscore/mount.h>
+
+#include "ext2fs.h"
+
+#define EXT2FS_CHUNK_SIZE	(128U * 1024)
+#define EXT2FS_CHUNK_MAX	(EXT2FS_CHUNK_SIZE >> EXT2_MIN_BLOCK_LOG_SIZE)
+
+/* Largest size of regular files without the LARGE_FILE feature */
+#define EXT2FS_SMALL_FILE_MAX	0x7fffffffULL
+
+static __u32 ext2fs_goal(struct ext2fs_mount *fs, struct ext2fs_node *np)
+{
+	__u32 group;
+
+	if (np->alloc_goal)
+		return np->alloc_goal;
+
+	/* Start in the group of the inode */
+	group = (np->ino - 1) / fs->sb->s_inodes_per_group;
+	return fs->sb->s_first_data_block + group * fs->sb->s_blocks_per_group;
+}
+
+static int ext2fs_alloc_block(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			      int meta, __u32 *blknop)
+{
+	struct ext2fs_buf *bp;
+	__u32 blkno;
+	int rc;
+
+	rc = ext2fs_balloc(fs, ext2fs_goal(fs, np), &blkno);
+	if (unlikely(rc))
+		return rc;
+
+	/* Indirect blocks must not point to stale data */
+	if (meta) {
+		rc = ext2fs_bget(fs, blkno, &bp);
+		if (unlikely(rc)) {
+			ext2fs_bfree(fs, blkno);
+			return rc;
+		}
+		ext2fs_bdirty(fs, bp);
+		ext2fs_brelse(fs, bp);
+	}
+
+	np->inode.i_blocks += fs->bsize >> 9;
+	np->alloc_goal = blkno + 1;
+	*blknop = blkno;
+	return 0;
+}
+
+static void ext2fs_free_block(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			      __u32 blkno)
+{
+	ext2fs_bfree(fs, blkno);
+	np->inode.i_blocks -= fs->bsize >> 9;
+}
+
+static inline int ext2fs_valid_block(struct ext2fs_mount *fs, __u32 blkno)
+{
+	if (unlikely(blkno >= fs->sb->s_blocks_count)) {
+		uk_pr_err("Invalid block number %"PRIu32"\n", blkno);
+		return 0;
+	}
+	return 1;
+}
+
+int ext2fs_bmap(struct ext2fs_mount *fs, struct ext2fs_node *np, __u32 lblk,
+		int alloc, __u32 *blknop)
+{
+	struct ext2fs_buf *bp;
+	unsigned int level;
+	__u64 idx = lblk, span;
+	__u32 *slot, blkno, next;
+	int rc;
+
+	UK_ASSERT(!alloc || !fs->rdonly);
+
+	/* Find the tree that holds the block */
+	if (idx < EXT2_NDIR_BLOCKS) {
+		level = 0;
+		slot = &np->inode.i_block[idx];
+	} else {
+		idx -= EXT2_NDIR_BLOCKS;
+		for (level = 1; level <= 3; level++) {
+			span = 1ULL << (fs->addr_shift * level);
+			if (idx < span)
+				break;
+			idx -= span;
+		}
+		if (unlikely(level > 3))
+			return EFBIG;
+		slot = &np->inode.i_block[EXT2_IND_BLOCK + level - 1];
+	}
+
+	blkno = *slot;
+	if (!blkno) {
+		if (!alloc)
+			goto out;
+		rc = ext2fs_alloc_block(fs, np, level > 0, &blkno);
+		if (unlikely(rc))
+			return rc;
+		*slot = blkno;
+	}
+
+	for (; level > 0; level--) {
+		if (unlikely(!ext2fs_valid_block(fs, blkno)))
+			return EIO;
+
+		rc = ext2fs_bread(fs, blkno, &bp);
+		if (unlikely(rc))
+			return rc;
+
+		slot = (__u32 *) bp->data +
+		       ((idx >> (fs->addr_shift * (level - 1))) &
+			(fs->addr_per_block - 1));
+		next = *slot;
+		if (!next && alloc) {
+			rc = ext2fs_alloc_block(fs, np, level > 1, &next);
+			if (unlikely(rc)) {
+				ext2fs_brelse(fs, bp);
+				return rc;
+			}
+			*slot = next;
+			ext2fs_bdirty(fs, bp);
+		}
+		ext2fs_brelse(fs, bp);
+
+		blkno = next;
+		if (!blkno)
+			goto out;
+	}
+
+	if (unlikely(!ext2fs_valid_block(fs, blkno)))
+		return EIO;
+out:
+	*blknop = blkno;
+	return 0;
+}
+
+/*
+ * Frees the blocks from index start on in the tree of the given level below
+ * *slot. The tree itself is freed when it becomes empty.
+ */
+static int ext2fs_free_tree(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			    __u32 *slot, unsigned int level, __u64 start)
+{
+	__u64 span = 1ULL << (fs->addr_shift * (level - 1));
+	struct ext2fs_buf *bp;
+	__u32 *ptrs, i;
+	int rc;
+
+	if (unlikely(!ext2fs_valid_block(fs, *slot)))
+		return EIO;
+
+	rc = ext2fs_bread(fs, *slot, &bp);
+	if (unlikely(rc))
+		return rc;
+
+	ptrs = bp->data;
+	for (i = start / span; i < fs->addr_per_block; i++) {
+		if (!ptrs[i])
+			continue;
+
+		if (level == 1) {
+			ext2fs_free_block(fs, np, ptrs[i]);
+			ptrs[i] = 0;
+		} else {
+			rc = ext2fs_free_tree(fs, np, &ptrs[i], level - 1,
+					      i == start / span ?
+					      start % span : 0);
+			if (unlikely(rc))
+				break;
+		}
+		ext2fs_bdirty(fs, bp);
+	}
+	ext2fs_brelse(fs, bp);
+
+	if (!rc && start == 0) {
+		ext2fs_free_block(fs, np, *slot);
+		*slot = 0;
+	}
+	return rc;
+}
+
+int ext2fs_truncate_blocks(struct ext2fs_mount *fs, struct ext2fs_node *np,
+			   __u64 size)
+{
+	__u64 first = (size + fs->bsize - 1) >> fs->bshift;
+	__u64 base, span;
+	unsigned int level;
+	__u32 *slot;
+	__u64 i;
+	int rc;
+
+	for (i = first; i < EXT2_NDIR_BLOCKS; i++) {
+		if (np->inode.i_block[i]) {
+			ext2fs_free_block(fs, np, np->inode.i_block[i]);
+			np->inode.i_block[i] = 0;
+		}
+	}
+
+	base = EXT2_NDIR_BLOCKS;
+	for (level = 1; level <= 3; level++) {
+		span = 1ULL << (fs->addr_shift * level);
+		slot = &np->inode.i_block[EXT2_IND_BLOCK + level - 1];
+		if (*slot && first < base + span) {
+			rc = ext2fs_free_tree(fs, np, slot, level,
+					      first > base ? first - base : 0);
+			if (unlikely(rc))
+				return rc;
+		}
+		base += span;
+	}
+
+	np->alloc_goal = 0;
+	return 0;
+}
+
+/* Checks whether a regular file may grow to the given size */
+static int ext2fs_check_size(struct ext2fs_mount *fs, __u64 size)
+{
+	struct ext2_super_block *sb = fs->sb;
+
+	if (size <= EXT2FS_SMALL_FILE_MAX)
+		return 0;
+	if (size > fs->max_size || sb->s_rev_level == EXT2_GOOD_OLD_REV)
+		return EFBIG;
+
+	if (!(sb->s_feature_ro_compat & EXT2_FEATURE_RO_COMPAT_LARGE_FILE)) {
+		sb->s_feature_ro_compat |= EXT2_FEATURE_RO_COMPAT_LARGE_FILE;
+		ext2fs_bdirty(fs, fs->sb_buf);
+	}
+	return 0;
+}
+
+int ext2fs_resize(struct ext2fs_mount *fs, struct ext2fs_node *np,
+		    __u64 size)
+{
+	__u64 old = ext2fs_isize(&np->inode);
+	__u32 blkno = 0, boff;
+	char *buf;
+	int rc;
+
+	if (size > old) {
+		rc = ext2fs_check_size(fs, size);
+		if (unlikely(rc))
+			return rc;
+
+		/* The last block may hold stale data past the old end */
+		boff = old & (fs->bsize - 1);
+		if (boff) {
+			rc = ext2fs_bmap(fs, np, old >> fs->bshift, 0, &blkno);
+			if (unlikely(rc))
+				return rc;
+		}
+		if (boff && blkno) {
+			buf = ext2fs_io_alloc(fs, fs->bsize);
+			if (unlikely(!buf))
+				return ENOMEM;
+			rc = ext2fs_io_rw(fs, UK_BLKREQ_READ, blkno, 1, buf);
+			if (!rc) {
+				memset(buf + boff, 0, fs->bsize - boff);
+				rc = ext2fs_io_rw(fs, UK_BLKREQ_WRITE, blkno, 1,
+						  buf);
+			}
+			ext2fs_io_free(fs, buf);
+			if (unlikely(rc))
+				return rc;
+		}
+	} else if (size < old) {
+		rc = ext2fs_truncate_blocks(fs, np, size);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	ext2fs_set_isize(&np->inode, size);
+	np->inode.i_mtime = np->inode.i_ctime = ext2fs_now();
+	return ext2fs_iwrite(fs, np->ino, &np->inode);
+}
+
+int ext2fs_rdwr(struct vnode *vp, struct uio *uio, int ioflag)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	struct ext2fs_node *np = EXT2FS_NODE(vp);
+	int write = (uio->uio_rw == UIO_WRITE);
+	unsigned char fresh[EXT2FS_CHUNK_MAX];
+	__u32 pblk[EXT2FS_CHUNK_MAX];
+	__u64 off, end, size, bstart, bend;
+	__u32 first, i, n, nchunk;
+	ssize_t resid = uio->uio_resid;
+	int rc = 0, rc2, keep, alloced, short_write = 0;
+	struct ext2fs_io io;
+	size_t len, boff;
+	char *buf, *bp;
+
+	nchunk = MAX(EXT2FS_CHUNK_SIZE >> fs->bshift, 1U);
+	buf = ext2fs_io_alloc(fs, (size_t) nchunk << fs->bshift);
+	if (unlikely(!buf))
+		return ENOMEM;
+
+	if (write && (ioflag & IO_APPEND))
+		uio->uio_offset = ext2fs_isize(&np->inode);
+
+	while (uio->uio_resid > 0 && !short_write) {
+		off = uio->uio_offset;
+		size = ext2fs_isize(&np->inode);
+		len = uio->uio_resid;
+		if (!write) {
+			if (off >= size)
+				break;
+			len = MIN(len, size - off);
+		}
+
+		first = off >> fs->bshift;
+		boff = off & (fs->bsize - 1);
+		n = MIN(nchunk, (boff + len + fs->bsize - 1) >> fs->bshift);
+		len = MIN(len, ((size_t) n << fs->bshift) - boff);
+		end = off + len;
+
+		/* Map the chunk, allocating missing blocks for writes */
+		uk_mutex_lock(&fs->lock);
+		if (write) {
+			rc = ext2fs_check_size(fs, end);
+			if (unlikely(rc)) {
+				uk_mutex_unlock(&fs->lock);
+				goto out;
+			}
+		}
+		alloced = 0;
+		for (i = 0; i < n; i++) {
+			fresh[i] = 0;
+			rc = ext2fs_bmap(fs, np, first + i, 0, &pblk[i]);
+			if (unlikely(rc))
+				break;
+			if (pblk[i] || !write)
+				continue;
+
+			rc = ext2fs_bmap(fs, np, first + i, 1, &pblk[i]);
+			if (rc == ENOSPC && i > 0) {
+				/* Write what fits */
+				rc = 0;
+				n = i;
+				len = ((size_t) n << fs->bshift) - boff;
+				end = off + len;
+				short_write = 1;
+				break;
+			}
+			if (unlikely(rc))
+				break;
+			fresh[i] = 1;
+			alloced = 1;
+		}
+		if (alloced)
+			ext2fs_iwrite(fs, np->ino, &np->inode);
+		uk_mutex_unlock(&fs->lock);
+		if (unlikely(rc)) {
+			/* Report a short write if some data made it */
+			if (rc == ENOSPC && uio->uio_resid < resid)
+				rc = 0;
+			goto out;
+		}
+
+		/* Read the blocks, or for writes, the parts that are kept */
+		ext2fs_io_init(fs, &io);
+		for (i = 0; i < n; i++) {
+			bp = buf + ((size_t) i << fs->bshift);
+			bstart = (__u64) (first + i) << fs->bshift;
+			bend = bstart + fs->bsize;
+			if (write) {
+				keep = (off > bstart && bstart < size) ||
+				       (end < bend && end < size);
+				if (fresh[i] || !keep) {
+					if (off > bstart || end < bend)
+						memset(bp, 0, fs->bsize);
+					continue;
+				}
+			} else if (!pblk[i]) {
+				memset(bp, 0, fs->bsize);
+				continue;
+			}
+
+			rc = ext2fs_io_add(&io, UK_BLKREQ_READ, pblk[i], 1, bp);
+			if (unlikely(rc))
+				break;
+		}
+		rc2 = ext2fs_io_wait(&io);
+		if (unlikely(rc || rc2)) {
+			rc = rc ? rc : rc2;
+			goto out;
+		}
+
+		/* Stale bytes past the old end of file must read as zeros */
+		bstart = (__u64) first << fs->bshift;
+		if (write && size > bstart && size < end)
+			memset(buf + (size - bstart), 0,
+			       fs->bsize - (size & (fs->bsize - 1)));
+
+		rc = vfscore_uiomove(buf + boff, len, uio);
+		if (unlikely(rc))
+			goto out;
+		if (!write)
+			continue;
+
+		ext2fs_io_init(fs, &io);
+		for (i = 0; i < n; i++) {
+			rc = ext2fs_io_add(&io, UK_BLKREQ_WRITE, pblk[i], 1,
+					   buf + ((size_t) i << fs->bshift));
+			if (unlikely(rc))
+				break;
+		}
+		rc2 = ext2fs_io_wait(&io);
+		if (unlikely(rc || rc2)) {
+			rc = rc ? rc : rc2;
+			goto out;
+		}
+
+		uk_mutex_lock(&fs->lock);
+		if (end > size)
+			ext2fs_set_isize(&np->inode, end);
+		np->inode.i_mtime = np->inode.i_ctime = ext2fs_now();
+		rc = ext2fs_iwrite(fs, np->ino, &np->inode);
+		uk_mutex_unlock(&fs->lock);
+		if (unlikely(rc))
+			goto out;
+
+		if ((off_t) end > vp->v_size)
+			vp->v_size = end;
+	}
+
+out:
+	ext2fs_io_free(fs, buf);
+	return rc;
+}
@@ -0,0 +1,538 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ext2fs_io.c - block I/O and metadata block cache of the ext2 file system.
+ *
+ * Transfers are collected in batches. Adjacent transfers of a batch are
+ * merged into a single request up to the maximum request size of the device,
+ * and all requests of a batch are submitted before waiting for the first
+ * completion, so that the device sees multiple requests in flight. When the
+ * queue is full, the submitter waits for any completion and retries.
+ * Completions are signaled by queue interrupts if the driver supports them,
+ * and are polled for otherwise.
+ *
+ * Metadata blocks (super block, group descriptors, bitmaps, inode tables,
+ * indirect blocks, directories) are kept in a block cache of limited size.
+ * Unreferenced clean blocks are evicted in LRU order. Modified blocks stay
+ * in the cache until they are written back in a single batch on sync or
+ * when the cache only holds dirty blocks. File data does not go through the
+ * block cache, it is cached by the vfscore page cache.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/arch/atomic.h>
+
+#include "ext2fs.h"
+
+#define EXT2FS_QUEUE		0
+#define EXT2FS_BCACHE_MAX	CONFIG_LIBEXT2FS_BCACHE_SIZE
+
+/*
+ * Block device
+ */
+
+static void ext2fs_queue_event(struct uk_blkdev *bd, uint16_t queue_id,
+			       void *argp __unused)
+{
+	uk_blkdev_queue_finish_reqs(bd, queue_id);
+}
+
+int ext2fs_io_attach(struct ext2fs_mount *fs, unsigned int id)
+{
+	struct uk_blkdev_conf conf = { .nb_queues = 1 };
+	struct uk_blkdev_queue_info qinfo;
+	struct uk_blkdev_queue_conf qconf;
+	struct uk_blkdev *bd;
+	int rc;
+
+	bd = uk_blkdev_get(id);
+	if (!bd)
+		return ENODEV;
+
+	/* The callback of the queue belongs to us, so we need the device
+	 * for ourselves
+	 */
+	if (uk_blkdev_state_get(bd) != UK_BLKDEV_UNCONFIGURED) {
+		uk_pr_err("blkdev%u is already in use\n", id);
+		return EBUSY;
+	}
+
+	rc = uk_blkdev_configure(bd, &conf);
+	if (unlikely(rc < 0))
+		return -rc;
+
+	rc = uk_blkdev_queue_get_info(bd, EXT2FS_QUEUE, &qinfo);
+	if (unlikely(rc < 0))
+		goto err_unconfigure;
+
+	memset(&qconf, 0, sizeof(qconf));
+	qconf.a = uk_alloc_get_default();
+	qconf.callback = ext2fs_queue_event;
+#if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
+	qconf.s = uk_sched_current();
+#endif /* CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS */
+	rc = uk_blkdev_queue_configure(bd, EXT2FS_QUEUE, qinfo.nb_max,
+				       &qconf);
+	if (unlikely(rc < 0))
+		goto err_unconfigure;
+
+	rc = uk_blkdev_start(bd);
+	if (unlikely(rc < 0))
+		goto err_queue_unconfigure;
+
+	rc = uk_blkdev_queue_intr_enable(bd, EXT2FS_QUEUE);
+	if (rc == -ENOTSUP) {
+		fs->polled = 1;
+	} else if (unlikely(rc < 0)) {
+		uk_blkdev_stop(bd);
+		goto err_queue_unconfigure;
+	}
+
+	fs->bd = bd;
+	fs->ssize = uk_blkdev_ssize(bd);
+	fs->max_sectors = uk_blkdev_max_sec_per_req(bd);
+	fs->ioalign = MAX((size_t) uk_blkdev_ioalign(bd), sizeof(void *));
+	if (uk_blkdev_mode(bd) == O_RDONLY)
+		fs->rdonly = 1;
+	uk_mutex_init(&fs->io_lock);
+	uk_waitq_init(&fs->io_wq);
+	fs->io_completed = 0;
+
+	uk_pr_debug("blkdev%u: %"__PRIsctr" sectors of %"__PRIsz" bytes%s\n",
+		    id, uk_blkdev_sectors(bd), fs->ssize,
+		    fs->polled ? ", polled" : "");
+	return 0;
+
+err_queue_unconfigure:
+	uk_blkdev_queue_unconfigure(bd, EXT2FS_QUEUE);
+err_unconfigure:
+	uk_blkdev_unconfigure(bd);
+	return -rc;
+}
+
+void ext2fs_io_detach(struct ext2fs_mount *fs)
+{
+	uk_blkdev_stop(fs->bd);
+	uk_blkdev_queue_unconfigure(fs->bd, EXT2FS_QUEUE);
+	uk_blkdev_unconfigure(fs->bd);
+	fs->bd = NULL;
+}
+
+void *ext2fs_io_alloc(struct ext2fs_mount *fs, size_t size)
+{
+	return uk_memalign(uk_alloc_get_default(), fs->ioalign, size);
+}
+
+void ext2fs_io_free(struct ext2fs_mount *fs __unused, void *buf)
+{
+	uk_free(uk_alloc_get_default(), buf);
+}
+
+/*
+ * Request batches
+ */
+
+/* Waits until cond holds, which has to become true by a completion */
+#define ext2fs_io_wait_event(fs, cond)					\
+	do {								\
+		if (!(fs)->polled) {					\
+			uk_waitq_wait_event(&(fs)->io_wq, (cond));	\
+			break;						\
+		}							\
+		while (!(cond)) {					\
+			uk_mutex_lock(&(fs)->io_lock);			\
+			uk_blkdev_queue_finish_reqs((fs)->bd,		\
+						    EXT2FS_QUEUE);	\
+			uk_mutex_unlock(&(fs)->io_lock);		\
+			if (!(cond))					\
+				uk_sched_yield();			\
+		}							\
+	} while (0)
+
+static void ext2fs_io_done(struct uk_blkreq *req, void *cookie)
+{
+	struct ext2fs_io *io = (struct ext2fs_io *) cookie;
+	struct ext2fs_mount *fs = io->fs;
+
+	if (unlikely(req->result < 0))
+		io->error = EIO;
+	ukarch_inc(&fs->io_completed);
+
+	/* The batch may be gone as soon as its last request completed */
+	ukarch_dec(&io->pending);
+	uk_waitq_wake_up(&fs->io_wq);
+}
+
+void ext2fs_io_init(struct ext2fs_mount *fs, struct ext2fs_io *io)
+{
+	io->fs = fs;
+	io->nreqs = 0;
+	io->pending = 0;
+	io->error = 0;
+	io->open = 0;
+}
+
+/* Submits the open request of the batch */
+static int ext2fs_io_submit(struct ext2fs_io *io)
+{
+	struct ext2fs_mount *fs = io->fs;
+	struct uk_blkreq *req = &io->reqs[io->nreqs];
+	unsigned long completed;
+	int rc;
+
+	UK_ASSERT(io->open);
+	io->open = 0;
+
+	ukarch_inc(&io->pending);
+	for (;;) {
+		completed = ukarch_load_n(&fs->io_completed);
+
+		uk_mutex_lock(&fs->io_lock);
+		rc = uk_blkdev_queue_submit_one(fs->bd, EXT2FS_QUEUE, req);
+		uk_mutex_unlock(&fs->io_lock);
+		if (rc != -ENOSPC && !uk_blkdev_status_notready(rc))
+			break;
+
+		/* The queue is full, wait for a free slot */
+		ext2fs_io_wait_event(fs, ukarch_load_n(&fs->io_completed) !=
+					 completed);
+	}
+
+	if (unlikely(rc < 0)) {
+		ukarch_dec(&io->pending);
+
+		/* Devices without volatile write cache need no flush */
+		if (req->operation == UK_BLKREQ_FFLUSH && rc == -ENOTSUP)
+			return 0;
+
+		uk_pr_err("Failed to submit request for sector %"__PRIsctr
+			  ": %d\n", req->start_sector, rc);
+		io->error = EIO;
+		return EIO;
+	}
+
+	io->nreqs++;
+	return 0;
+}
+
+int ext2fs_io_add(struct ext2fs_io *io, enum uk_blkreq_op op, __u32 blkno,
+		  __u32 nblks, void *buf)
+{
+	struct ext2fs_mount *fs = io->fs;
+	__sector sector = (__sector) blkno * fs->blk_sectors;
+	__sector nsec = (__sector) nblks * fs->blk_sectors;
+	struct uk_blkreq *req;
+	__sector n;
+	int rc;
+
+	UK_ASSERT(((uintptr_t) buf & (fs->ioalign - 1)) == 0);
+
+	while (nsec > 0) {
+		if (io->open) {
+			req = &io->reqs[io->nreqs];
+			if (req->operation == op &&
+			    req->start_sector + req->nb_sectors == sector &&
+			    (char *) req->aio_buf +
+			    req->nb_sectors * fs->ssize == buf &&
+			    req->nb_sectors < fs->max_sectors) {
+				n = MIN(nsec, fs->max_sectors -
+					req->nb_sectors);
+				req->nb_sectors += n;
+				goto next;
+			}
+
+			rc = ext2fs_io_submit(io);
+			if (unlikely(rc))
+				return rc;
+		}
+
+		if (io->nreqs == ARRAY_SIZE(io->reqs)) {
+			rc = ext2fs_io_wait(io);
+			if (unlikely(rc))
+				return rc;
+		}
+
+		n = MIN(nsec, fs->max_sectors);
+		uk_blkreq_init(&io->reqs[io->nreqs], op, sector, n, buf,
+			       ext2fs_io_done, io);
+		io->open = 1;
+next:
+		sector += n;
+		nsec -= n;
+		buf = (char *) buf + n * fs->ssize;
+	}
+	return 0;
+}
+
+int ext2fs_io_wait(struct ext2fs_io *io)
+{
+	struct ext2fs_mount *fs = io->fs;
+
+	if (io->open)
+		ext2fs_io_submit(io);
+
+	ext2fs_io_wait_event(fs, ukarch_load_n(&io->pending) == 0);
+	io->nreqs = 0;
+	return io->error;
+}
+
+int ext2fs_io_rw(struct ext2fs_mount *fs, enum uk_blkreq_op op, __u32 blkno,
+		 __u32 nblks, void *buf)
+{
+	struct ext2fs_io io;
+	int rc;
+
+	ext2fs_io_init(fs, &io);
+	rc = ext2fs_io_add(&io, op, blkno, nblks, buf);
+	if (unlikely(rc)) {
+		ext2fs_io_wait(&io);
+		return rc;
+	}
+	return ext2fs_io_wait(&io);
+}
+
+int ext2fs_io_flush(struct ext2fs_mount *fs)
+{
+	struct ext2fs_io io;
+
+	ext2fs_io_init(fs, &io);
+	uk_blkreq_init(&io.reqs[0], UK_BLKREQ_FFLUSH, 0, 0, NULL,
+		       ext2fs_io_done, &io);
+	io.open = 1;
+	return ext2fs_io_wait(&io);
+}
+
+/*
+ * Block cache
+ */
+
+static inline struct uk_hlist_head *ext2fs_bhead(struct ext2fs_mount *fs,
+						 __u32 blkno)
+{
+	return &fs->bhash[blkno % EXT2FS_BHASH_SIZE];
+}
+
+void ext2fs_bcache_init(struct ext2fs_mount *fs)
+{
+	unsigned int i;
+
+	for (i = 0; i < EXT2FS_BHASH_SIZE; i++)
+		UK_INIT_HLIST_HEAD(&fs->bhash[i]);
+	UK_INIT_LIST_HEAD(&fs->blru);
+	UK_INIT_LIST_HEAD(&fs->bdirty);
+	fs->nbufs = 0;
+}
+
+static void ext2fs_bdestroy(struct ext2fs_mount *fs, struct ext2fs_buf *bp)
+{
+	uk_hlist_del_init(&bp->hash_link);
+	if (bp->ref == 0)
+		uk_list_del(&bp->lru_link);
+	if (bp->dirty)
+		uk_list_del(&bp->dirty_link);
+	ext2fs_io_free(fs, bp->data);
+	free(bp);
+	fs->nbufs--;
+}
+
+void ext2fs_bcache_destroy(struct ext2fs_mount *fs)
+{
+	struct uk_hlist_node *tmp;
+	struct ext2fs_buf *bp;
+	unsigned int i;
+
+	for (i = 0; i < EXT2FS_BHASH_SIZE; i++)
+		uk_hlist_for_each_entry_safe(bp, tmp, &fs->bhash[i],
+					     hash_link)
+			ext2fs_bdestroy(fs, bp);
+	UK_ASSERT(fs->nbufs == 0);
+}
+
+/* Evicts unreferenced buffers until a new one fits into the cache */
+static void ext2fs_bshrink(struct ext2fs_mount *fs)
+{
+	struct ext2fs_buf *bp, *tmp;
+	int synced = 0;
+
+again:
+	uk_list_for_each_entry_safe(bp, tmp, &fs->blru, lru_link) {
+		if (fs->nbufs < EXT2FS_BCACHE_MAX)
+			return;
+		if (!bp->dirty)
+			ext2fs_bdestroy(fs, bp);
+	}
+
+	/* Only dirty or referenced buffers left */
+	if (fs->nbufs >= EXT2FS_BCACHE_MAX && !synced &&
+	    !uk_list_empty(&fs->blru)) {
+		synced = 1;
+		if (ext2fs_bsync(fs) == 0)
+			goto again;
+	}
+}
+
+static struct ext2fs_buf *ext2fs_bfind(struct ext2fs_mount *fs, __u32 blkno)
+{
+	struct ext2fs_buf *bp;
+
+	uk_hlist_for_each_entry(bp, ext2fs_bhead(fs, blkno), hash_link) {
+		if (bp->blkno == blkno)
+			return bp;
+	}
+	return NULL;
+}
+
+static int ext2fs_bgetblk(struct ext2fs_mount *fs, __u32 blkno, int read,
+			  struct ext2fs_buf **bpp)
+{
+	struct ext2fs_buf *bp;
+	int rc;
+
+	bp = ext2fs_bfind(fs, blkno);
+	if (bp) {
+		if (bp->ref++ == 0)
+			uk_list_del(&bp->lru_link);
+		if (!read)
+			memset(bp->data, 0, fs->bsize);
+		*bpp = bp;
+		return 0;
+	}
+
+	if (fs->nbufs >= EXT2FS_BCACHE_MAX)
+		ext2fs_bshrink(fs);
+
+	bp = malloc(sizeof(*bp));
+	if (unlikely(!bp))
+		return ENOMEM;
+
+	bp->data = ext2fs_io_alloc(fs, fs->bsize);
+	if (unlikely(!bp->data)) {
+		free(bp);
+		return ENOMEM;
+	}
+
+	if (read) {
+		rc = ext2fs_io_rw(fs, UK_BLKREQ_READ, blkno, 1, bp->data);
+		if (unlikely(rc)) {
+			ext2fs_io_free(fs, bp->data);
+			free(bp);
+			return rc;
+		}
+	} else {
+		memset(bp->data, 0, fs->bsize);
+	}
+
+	bp->blkno = blkno;
+	bp->ref = 1;
+	bp->dirty = 0;
+	uk_hlist_add_head(&bp->hash_link, ext2fs_bhead(fs, blkno));
+	fs->nbufs++;
+
+	*bpp = bp;
+	return 0;
+}
+
+int ext2fs_bread(struct ext2fs_mount *fs, __u32 blkno,
+		 struct ext2fs_buf **bpp)
+{
+	return ext2fs_bgetblk(fs, blkno, 1, bpp);
+}
+
+int ext2fs_bget(struct ext2fs_mount *fs, __u32 blkno,
+		struct ext2fs_buf **bpp)
+{
+	return ext2fs_bgetblk(fs, blkno, 0, bpp);
+}
+
+void ext2fs_brelse(struct ext2fs_mount *fs, struct ext2fs_buf *bp)
+{
+	UK_ASSERT(bp->ref > 0);
+
+	if (--bp->ref > 0)
+		return;
+
+	/* Invalidated while referenced */
+	if (uk_hlist_unhashed(&bp->hash_link))
+		ext2fs_bdestroy(fs, bp);
+	else
+		uk_list_add_tail(&bp->lru_link, &fs->blru);
+}
+
+void ext2fs_bdirty(struct ext2fs_mount *fs, struct ext2fs_buf *bp)
+{
+	UK_ASSERT(bp->ref > 0);
+	UK_ASSERT(!fs->rdonly);
+
+	/* The block no longer belongs to an invalidated buffer */
+	if (uk_hlist_unhashed(&bp->hash_link))
+		return;
+
+	if (!bp->dirty) {
+		bp->dirty = 1;
+		uk_list_add_tail(&bp->dirty_link, &fs->bdirty);
+	}
+}
+
+void ext2fs_binval(struct ext2fs_mount *fs, __u32 blkno)
+{
+	struct ext2fs_buf *bp;
+
+	bp = ext2fs_bfind(fs, blkno);
+	if (!bp)
+		return;
+
+	/* The block may be reused for file data, which bypasses the cache.
+	 * A later write-back must not overwrite it.
+	 */
+	if (bp->dirty) {
+		uk_list_del(&bp->dirty_link);
+		bp->dirty = 0;
+	}
+	/* A referenced buffer is freed by its last release. Until then, it
+	 * must not be found by lookups that would return its stale data.
+	 */
+	if (bp->ref == 0)
+		ext2fs_bdestroy(fs, bp);
+	else
+		uk_hlist_del_init(&bp->hash_link);
+}
+
+int ext2fs_bsync(struct ext2fs_mount *fs)
+{
+	struct ext2fs_buf *bp, *tmp;
+	struct ext2fs_io io;
+	int rc = 0;
+
+	if (uk_list_empty(&fs->bdirty))
+		return 0;
+
+	ext2fs_io_init(fs, &io);
+	uk_list_for_each_entry(bp, &fs->bdirty, dirty_link) {
+		rc = ext2fs_io_add(&io, UK_BLKREQ_WRITE, bp->blkno, 1,
+				   bp->data);
+		if (unlikely(rc))
+			break;
+	}
+	if (ext2fs_io_wait(&io) || rc) {
+		uk_pr_err("Failed to write back metadata\n");
+		return EIO;
+	}
+
+	uk_list_for_each_entry_safe(bp, tmp, &fs->bdirty, dirty_link) {
+		uk_list_del(&bp->dirty_link);
+		bp->dirty = 0;
+	}
+	return 0;
+}
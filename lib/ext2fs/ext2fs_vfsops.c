@@ -0,0 +1,384 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ext2fs_vfsops.c - mounting of the ext2 file system.
+ *
+ * Mounting only reads the super block, the group descriptors and the root
+ * inode. Everything else is read on demand, so the time to mount and the
+ * memory used do not depend on the size of the file system.
+ */
+
+#define _BSD_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/statfs.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/print.h>
+#include <vfscore/mount.h>
+#include <vfscore/dentry.h>
+#include <vfscore/fs.h>
+
+#include "ext2fs.h"
+
+extern struct vnops ext2fs_vnops;
+
+static int ext2fs_mount(struct mount *mp, const char *dev, int flags,
+			const void *data);
+static int ext2fs_unmount(struct mount *mp, int flags);
+static int ext2fs_sync(struct mount *mp);
+static int ext2fs_statfs(struct mount *mp, struct statfs *sfp);
+
+#define ext2fs_vget	((vfsop_vget_t)vfscore_nullop)
+
+struct vfsops ext2fs_vfsops = {
+	.vfs_mount	= ext2fs_mount,
+	.vfs_unmount	= ext2fs_unmount,
+	.vfs_sync	= ext2fs_sync,
+	.vfs_vget	= ext2fs_vget,
+	.vfs_statfs	= ext2fs_statfs,
+	.vfs_vnops	= &ext2fs_vnops
+};
+
+static struct vfscore_fs_type ext2fs_fs = {
+	.vs_name	= "ext2",
+	.vs_init	= NULL,
+	.vs_op		= &ext2fs_vfsops
+};
+
+UK_FS_REGISTER(ext2fs_fs);
+
+__u32 ext2fs_now(void)
+{
+	return (__u32) (ukplat_wall_clock() / UKARCH_NSEC_PER_SEC);
+}
+
+/* Reads and checks the super block before the block size is known */
+static int ext2fs_probe(struct ext2fs_mount *fs, struct ext2_super_block *sb)
+{
+	size_t len = ALIGN_UP(EXT2_SUPERBLOCK_OFFSET + sizeof(*sb), fs->ssize);
+	__u32 unsupp;
+	void *buf;
+	int rc;
+
+	buf = ext2fs_io_alloc(fs, len);
+	if (unlikely(!buf))
+		return ENOMEM;
+
+	/* Blocks are sectors until the super block is read */
+	fs->blk_sectors = 1;
+	rc = ext2fs_io_rw(fs, UK_BLKREQ_READ, 0, len / fs->ssize, buf);
+	if (!rc)
+		memcpy(sb, (char *) buf + EXT2_SUPERBLOCK_OFFSET, sizeof(*sb));
+	ext2fs_io_free(fs, buf);
+	if (unlikely(rc))
+		return rc;
+
+	if (sb->s_magic != EXT2_SUPER_MAGIC) {
+		uk_pr_err("No ext2 file system found\n");
+		return EINVAL;
+	}
+	if (sb->s_log_block_size >
+	    EXT2_MAX_BLOCK_LOG_SIZE - EXT2_MIN_BLOCK_LOG_SIZE ||
+	    (1UL << (sb->s_log_block_size + EXT2_MIN_BLOCK_LOG_SIZE)) <
+	    fs->ssize) {
+		uk_pr_err("Unsupported block size\n");
+		return EINVAL;
+	}
+	if (sb->s_blocks_per_group == 0 || sb->s_inodes_per_group == 0 ||
+	    sb->s_first_data_block >= sb->s_blocks_count) {
+		uk_pr_err("Corrupted super block\n");
+		return EINVAL;
+	}
+
+	if (sb->s_rev_level > EXT2_GOOD_OLD_REV) {
+		unsupp = sb->s_feature_incompat & ~EXT2_FEATURE_INCOMPAT_SUPP;
+		if (unsupp) {
+			uk_pr_err("Unsupported features: 0x%"PRIx32"\n",
+				  unsupp);
+			return EINVAL;
+		}
+
+		unsupp = sb->s_feature_ro_compat & ~EXT2_FEATURE_RO_COMPAT_SUPP;
+		if (unsupp && !fs->rdonly) {
+			uk_pr_warn("Features 0x%"PRIx32" are read-only\n",
+				   unsupp);
+			fs->rdonly = 1;
+		}
+	}
+
+	if (!(sb->s_state & EXT2_VALID_FS))
+		uk_pr_warn("File system was not cleanly unmounted\n");
+	return 0;
+}
+
+/* Derives the geometry of the file system from the super block */
+static int ext2fs_setup(struct ext2fs_mount *fs,
+			const struct ext2_super_block *sb)
+{
+	__u64 nblks, span;
+	unsigned int level;
+
+	fs->bshift = sb->s_log_block_size + EXT2_MIN_BLOCK_LOG_SIZE;
+	fs->bsize = 1U << fs->bshift;
+	fs->blk_sectors = fs->bsize / fs->ssize;
+	fs->addr_shift = fs->bshift - 2;
+	fs->addr_per_block = 1U << fs->addr_shift;
+
+	if (sb->s_rev_level == EXT2_GOOD_OLD_REV) {
+		fs->inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+		fs->first_ino = EXT2_GOOD_OLD_FIRST_INO;
+		fs->filetype = 0;
+	} else {
+		fs->inode_size = sb->s_inode_size;
+		fs->first_ino = sb->s_first_ino;
+		fs->filetype = !!(sb->s_feature_incompat &
+				  EXT2_FEATURE_INCOMPAT_FILETYPE);
+	}
+	if (fs->inode_size < EXT2_GOOD_OLD_INODE_SIZE ||
+	    fs->inode_size > fs->bsize ||
+	    (fs->inode_size & (fs->inode_size - 1))) {
+		uk_pr_err("Unsupported inode size %"PRIu32"\n", fs->inode_size);
+		return EINVAL;
+	}
+	if (sb->s_blocks_per_group > fs->bsize * 8 ||
+	    sb->s_inodes_per_group > fs->bsize * 8 ||
+	    fs->first_ino <= EXT2_ROOT_INO) {
+		uk_pr_err("Corrupted super block\n");
+		return EINVAL;
+	}
+
+	fs->ngroups = DIV_ROUND_UP(sb->s_blocks_count - sb->s_first_data_block,
+				   sb->s_blocks_per_group);
+	fs->gd_per_block = fs->bsize / sizeof(struct ext2_group_desc);
+	fs->ngd_blocks = DIV_ROUND_UP(fs->ngroups, fs->gd_per_block);
+
+	/* Files are limited by the block map and by i_blocks */
+	nblks = EXT2_NDIR_BLOCKS;
+	for (level = 1; level <= 3; level++) {
+		span = 1ULL << (fs->addr_shift * level);
+		nblks += span;
+	}
+	nblks = MIN(nblks, (__u64) UINT32_MAX);
+	fs->max_size = MIN(nblks << fs->bshift, (__u64) UINT32_MAX << 9);
+	return 0;
+}
+
+static int ext2fs_load_groups(struct ext2fs_mount *fs)
+{
+	struct ext2_super_block *sb = fs->sb;
+	struct ext2_group_desc *gd;
+	__u32 i;
+	int rc;
+
+	fs->gd_bufs = calloc(fs->ngd_blocks, sizeof(*fs->gd_bufs));
+	if (unlikely(!fs->gd_bufs))
+		return ENOMEM;
+
+	for (i = 0; i < fs->ngd_blocks; i++) {
+		rc = ext2fs_bread(fs, sb->s_first_data_block + 1 + i,
+				  &fs->gd_bufs[i]);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	for (i = 0; i < fs->ngroups; i++) {
+		gd = ext2fs_gd(fs, i);
+		if (gd->bg_block_bitmap >= sb->s_blocks_count ||
+		    gd->bg_inode_bitmap >= sb->s_blocks_count ||
+		    gd->bg_inode_table >= sb->s_blocks_count) {
+			uk_pr_err("Corrupted group descriptor %"PRIu32"\n", i);
+			return EINVAL;
+		}
+	}
+	return 0;
+}
+
+static void ext2fs_release_groups(struct ext2fs_mount *fs)
+{
+	__u32 i;
+
+	if (!fs->gd_bufs)
+		return;
+	for (i = 0; i < fs->ngd_blocks && fs->gd_bufs[i]; i++)
+		ext2fs_brelse(fs, fs->gd_bufs[i]);
+	free(fs->gd_bufs);
+	fs->gd_bufs = NULL;
+}
+
+static void ext2fs_release(struct ext2fs_mount *fs)
+{
+	ext2fs_release_groups(fs);
+	if (fs->sb_buf)
+		ext2fs_brelse(fs, fs->sb_buf);
+	ext2fs_bcache_destroy(fs);
+	if (fs->bd)
+		ext2fs_io_detach(fs);
+	free(fs);
+}
+
+static int ext2fs_mount(struct mount *mp, const char *dev, int flags,
+			const void *data __unused)
+{
+	struct vnode *vp = mp->m_root->d_vnode;
+	struct ext2_super_block sb;
+	struct ext2fs_mount *fs;
+	struct ext2fs_node *np;
+	unsigned long id;
+	__u32 sb_blk;
+	char *end;
+	int rc;
+
+	if (!dev || *dev == '\0')
+		return ENODEV;
+	id = strtoul(dev, &end, 10);
+	if (*end != '\0')
+		return ENODEV;
+
+	fs = calloc(1, sizeof(*fs));
+	if (unlikely(!fs))
+		return ENOMEM;
+	uk_mutex_init(&fs->lock);
+	ext2fs_bcache_init(fs);
+	fs->rdonly = !!(flags & MNT_RDONLY);
+
+	rc = ext2fs_io_attach(fs, id);
+	if (unlikely(rc))
+		goto err;
+
+	rc = ext2fs_probe(fs, &sb);
+	if (rc)
+		goto err;
+	rc = ext2fs_setup(fs, &sb);
+	if (rc)
+		goto err;
+
+	/* The super block stays referenced in the cache while mounted */
+	sb_blk = EXT2_SUPERBLOCK_OFFSET >> fs->bshift;
+	rc = ext2fs_bread(fs, sb_blk, &fs->sb_buf);
+	if (unlikely(rc))
+		goto err;
+	fs->sb = (struct ext2_super_block *) ((char *) fs->sb_buf->data +
+		 (EXT2_SUPERBLOCK_OFFSET & (fs->bsize - 1)));
+
+	rc = ext2fs_load_groups(fs);
+	if (rc)
+		goto err;
+
+	np = malloc(sizeof(*np));
+	if (unlikely(!np)) {
+		rc = ENOMEM;
+		goto err;
+	}
+	np->ino = EXT2_ROOT_INO;
+	np->alloc_goal = 0;
+	rc = ext2fs_iread(fs, EXT2_ROOT_INO, &np->inode);
+	if (!rc && !S_ISDIR(np->inode.i_mode)) {
+		uk_pr_err("Root inode is not a directory\n");
+		rc = EINVAL;
+	}
+	if (rc) {
+		free(np);
+		goto err;
+	}
+
+	/* Mark the file system as in use until it is unmounted cleanly */
+	if (!fs->rdonly) {
+		fs->sb->s_state &= ~EXT2_VALID_FS;
+		fs->sb->s_mnt_count++;
+		fs->sb->s_mtime = ext2fs_now();
+		ext2fs_bdirty(fs, fs->sb_buf);
+		rc = ext2fs_bsync(fs);
+		if (unlikely(rc)) {
+			free(np);
+			goto err;
+		}
+	}
+
+	vp->v_data = np;
+	vp->v_mode = np->inode.i_mode & UK_ALLPERMS;
+	vp->v_size = ext2fs_isize(&np->inode);
+
+	mp->m_data = fs;
+	if (fs->rdonly)
+		mp->m_flags |= MNT_RDONLY;
+	mp->m_flags |= MNT_PAGECACHE;
+
+	uk_pr_info("Mounted ext2 file system from blkdev%lu: %"PRIu32
+		   " blocks of %"PRIu32" bytes%s\n", id, fs->sb->s_blocks_count,
+		   fs->bsize, fs->rdonly ? ", read-only" : "");
+	return 0;
+
+err:
+	ext2fs_release(fs);
+	return rc;
+}
+
+static int ext2fs_unmount(struct mount *mp, int flags __unused)
+{
+	struct ext2fs_mount *fs = EXT2FS_MP(mp);
+	int rc;
+
+	/* Releases the root vnode and with it its node */
+	vfscore_release_mp_dentries(mp);
+
+	uk_mutex_lock(&fs->lock);
+	if (!fs->rdonly) {
+		fs->sb->s_state |= EXT2_VALID_FS;
+		fs->sb->s_wtime = ext2fs_now();
+		ext2fs_bdirty(fs, fs->sb_buf);
+	}
+	rc = ext2fs_bsync(fs);
+	if (!rc && !fs->rdonly)
+		rc = ext2fs_io_flush(fs);
+	uk_mutex_unlock(&fs->lock);
+	if (unlikely(rc))
+		uk_pr_err("Failed to write back file system: %d\n", rc);
+
+	ext2fs_release(fs);
+	mp->m_data = NULL;
+	return 0;
+}
+
+static int ext2fs_sync(struct mount *mp)
+{
+	struct ext2fs_mount *fs = EXT2FS_MP(mp);
+	int rc;
+
+	if (fs->rdonly)
+		return 0;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_bsync(fs);
+	if (!rc)
+		rc = ext2fs_io_flush(fs);
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_statfs(struct mount *mp, struct statfs *sfp)
+{
+	struct ext2fs_mount *fs = EXT2FS_MP(mp);
+	struct ext2_super_block *sb = fs->sb;
+
+	uk_mutex_lock(&fs->lock);
+	sfp->f_type = EXT2_SUPER_MAGIC;
+	sfp->f_bsize = fs->bsize;
+	sfp->f_frsize = fs->bsize;
+	sfp->f_blocks = sb->s_blocks_count;
+	sfp->f_bfree = sb->s_free_blocks_count;
+	sfp->f_bavail = sb->s_free_blocks_count > sb->s_r_blocks_count ?
+			sb->s_free_blocks_count - sb->s_r_blocks_count : 0;
+	sfp->f_files = sb->s_inodes_count;
+	sfp->f_ffree = sb->s_free_inodes_count;
+	sfp->f_namelen = EXT2_NAME_LEN;
+	uk_mutex_unlock(&fs->lock);
+	return 0;
+}
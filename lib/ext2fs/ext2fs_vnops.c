@@ -0,0 +1,696 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ext2fs_vnops.c - vnode operations of the ext2 file system.
+ *
+ * The root directory is vnode 0 in vfscore, all other vnodes use the inode
+ * number. Inodes that are unlinked while in use are freed once their vnode
+ * becomes inactive.
+ */
+
+#define _BSD_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <uk/print.h>
+#include <vfscore/file.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+#include <vfscore/fs.h>
+
+#include "ext2fs.h"
+
+static inline __u64 ext2fs_vino(__u32 ino)
+{
+	return (ino == EXT2_ROOT_INO) ? 0 : ino;
+}
+
+static inline int ext2fs_rdonly(struct vnode *vp)
+{
+	return EXT2FS_VFS(vp)->rdonly;
+}
+
+/* Fast symlinks keep their target in i_block instead of a data block */
+static inline int ext2fs_fast_symlink(struct ext2fs_mount *fs,
+				      const struct ext2_inode *ip)
+{
+	return S_ISLNK(ip->i_mode) &&
+	       ip->i_blocks == (ip->i_file_acl ? fs->bsize >> 9 : 0);
+}
+
+static void ext2fs_vnode_setup(struct vnode *vp, struct ext2fs_node *np)
+{
+	vp->v_data = np;
+	vp->v_type = IFTOVT(np->inode.i_mode);
+	vp->v_mode = np->inode.i_mode & UK_ALLPERMS;
+	vp->v_size = ext2fs_isize(&np->inode);
+}
+
+/* Initializes a new inode in np without writing it */
+static int ext2fs_inode_new(struct ext2fs_mount *fs, struct ext2fs_node *dnp,
+			    mode_t mode, struct ext2fs_node *np)
+{
+	__u32 now = ext2fs_now();
+	int rc;
+
+	rc = ext2fs_ialloc(fs, dnp->ino, S_ISDIR(mode), &np->ino);
+	if (rc)
+		return rc;
+
+	memset(&np->inode, 0, sizeof(np->inode));
+	np->inode.i_mode = mode;
+	np->inode.i_links_count = 1;
+	np->inode.i_atime = np->inode.i_ctime = np->inode.i_mtime = now;
+	np->alloc_goal = 0;
+	return 0;
+}
+
+/* Writes a new inode and enters it into the directory, or frees it again */
+static int ext2fs_inode_link_new(struct ext2fs_mount *fs,
+				 struct ext2fs_node *dnp, const char *name,
+				 struct ext2fs_node *np)
+{
+	int rc;
+
+	rc = ext2fs_iwrite(fs, np->ino, &np->inode);
+	if (!rc)
+		rc = ext2fs_dir_add(fs, dnp, name, np->ino, np->inode.i_mode);
+	if (rc) {
+		if (!ext2fs_fast_symlink(fs, &np->inode))
+			ext2fs_truncate_blocks(fs, np, 0);
+		ext2fs_ifree(fs, np->ino, S_ISDIR(np->inode.i_mode));
+	}
+	return rc;
+}
+
+static int ext2fs_read(struct vnode *vp, struct vfscore_file *fp __unused,
+		       struct uio *uio, int ioflag)
+{
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	return ext2fs_rdwr(vp, uio, ioflag);
+}
+
+static int ext2fs_write(struct vnode *vp, struct uio *uio, int ioflag)
+{
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (ext2fs_rdonly(vp))
+		return EROFS;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	return ext2fs_rdwr(vp, uio, ioflag);
+}
+
+static int ext2fs_fsync(struct vnode *vp, struct vfscore_file *fp __unused)
+{
+	return VFS_SYNC(vp->v_mount);
+}
+
+static int ext2fs_readdir(struct vnode *vp, struct vfscore_file *fp,
+			  struct dirent *dir)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	off_t off = fp->f_offset;
+	__u32 ino;
+	__u8 type;
+	int rc;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_dir_next(fs, EXT2FS_NODE(vp), &off, &ino, &type,
+			     dir->d_name);
+	uk_mutex_unlock(&fs->lock);
+	if (rc)
+		return rc;
+
+	switch (type) {
+	case EXT2_FT_REG_FILE:
+		dir->d_type = DT_REG;
+		break;
+	case EXT2_FT_DIR:
+		dir->d_type = DT_DIR;
+		break;
+	case EXT2_FT_CHRDEV:
+		dir->d_type = DT_CHR;
+		break;
+	case EXT2_FT_BLKDEV:
+		dir->d_type = DT_BLK;
+		break;
+	case EXT2_FT_FIFO:
+		dir->d_type = DT_FIFO;
+		break;
+	case EXT2_FT_SOCK:
+		dir->d_type = DT_SOCK;
+		break;
+	case EXT2_FT_SYMLINK:
+		dir->d_type = DT_LNK;
+		break;
+	default:
+		dir->d_type = DT_UNKNOWN;
+		break;
+	}
+	dir->d_fileno = ino;
+	dir->d_off = off;
+	fp->f_offset = off;
+	return 0;
+}
+
+static int ext2fs_lookup(struct vnode *dvp, const char *name,
+			 struct vnode **vpp)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	struct ext2fs_node *np;
+	struct vnode *vp;
+	__u32 ino;
+	int rc;
+
+	*vpp = NULL;
+
+	if (*name == '\0')
+		return ENOENT;
+	if (strlen(name) > EXT2_NAME_LEN)
+		return ENAMETOOLONG;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_dir_lookup(fs, EXT2FS_NODE(dvp), name, &ino);
+	uk_mutex_unlock(&fs->lock);
+	if (rc)
+		return rc;
+
+	/* Getting the vnode may wait for its lock, whose holder may in turn
+	 * wait for the file system lock
+	 */
+	if (vfscore_vget(dvp->v_mount, ext2fs_vino(ino), &vp)) {
+		/* found in cache */
+		*vpp = vp;
+		return 0;
+	}
+	if (!vp)
+		return ENOMEM;
+
+	np = malloc(sizeof(*np));
+	if (!np) {
+		vput(vp);
+		return ENOMEM;
+	}
+	np->ino = ino;
+	np->alloc_goal = 0;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_iread(fs, ino, &np->inode);
+	uk_mutex_unlock(&fs->lock);
+	if (!rc && np->inode.i_links_count == 0) {
+		uk_pr_err("Entry %s refers to free inode %"PRIu32"\n",
+			  name, ino);
+		rc = EIO;
+	}
+	if (rc) {
+		free(np);
+		vput(vp);
+		return rc;
+	}
+
+	ext2fs_vnode_setup(vp, np);
+	*vpp = vp;
+	return 0;
+}
+
+static int ext2fs_create(struct vnode *dvp, const char *name, mode_t mode)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	struct ext2fs_node np;
+	int rc;
+
+	if (strlen(name) > EXT2_NAME_LEN)
+		return ENAMETOOLONG;
+	if (!S_ISREG(mode))
+		return EINVAL;
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_inode_new(fs, EXT2FS_NODE(dvp), mode, &np);
+	if (!rc)
+		rc = ext2fs_inode_link_new(fs, EXT2FS_NODE(dvp), name, &np);
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_mkdir(struct vnode *dvp, const char *name, mode_t mode)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	struct ext2fs_node *dnp = EXT2FS_NODE(dvp);
+	struct ext2fs_node np;
+	int rc;
+
+	if (strlen(name) > EXT2_NAME_LEN)
+		return ENAMETOOLONG;
+	if (!S_ISDIR(mode))
+		return EINVAL;
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	if (dnp->inode.i_links_count >= EXT2_LINK_MAX) {
+		rc = EMLINK;
+		goto out;
+	}
+
+	rc = ext2fs_inode_new(fs, dnp, mode, &np);
+	if (rc)
+		goto out;
+	np.inode.i_links_count = 2;
+	rc = ext2fs_dir_init(fs, &np, dnp->ino);
+	if (rc) {
+		ext2fs_truncate_blocks(fs, &np, 0);
+		ext2fs_ifree(fs, np.ino, 1);
+		goto out;
+	}
+	rc = ext2fs_inode_link_new(fs, dnp, name, &np);
+	if (rc)
+		goto out;
+
+	/* The ".." entry of the new directory */
+	dnp->inode.i_links_count++;
+	rc = ext2fs_iwrite(fs, dnp->ino, &dnp->inode);
+out:
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_remove(struct vnode *dvp, struct vnode *vp, const char *name)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	struct ext2fs_node *np = EXT2FS_NODE(vp);
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EPERM;
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_dir_remove(fs, EXT2FS_NODE(dvp), name);
+	if (!rc) {
+		np->inode.i_links_count--;
+		np->inode.i_ctime = ext2fs_now();
+		rc = ext2fs_iwrite(fs, np->ino, &np->inode);
+	}
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_rmdir(struct vnode *dvp, struct vnode *vp, const char *name)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	struct ext2fs_node *dnp = EXT2FS_NODE(dvp);
+	struct ext2fs_node *np = EXT2FS_NODE(vp);
+	int rc;
+
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_dir_empty(fs, np);
+	if (rc)
+		goto out;
+	rc = ext2fs_dir_remove(fs, dnp, name);
+	if (rc)
+		goto out;
+
+	np->inode.i_links_count = 0;
+	np->inode.i_ctime = ext2fs_now();
+	rc = ext2fs_iwrite(fs, np->ino, &np->inode);
+	if (rc)
+		goto out;
+	dnp->inode.i_links_count--;
+	rc = ext2fs_iwrite(fs, dnp->ino, &dnp->inode);
+out:
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_rename(struct vnode *dvp1, struct vnode *vp1,
+			 const char *name1, struct vnode *dvp2,
+			 struct vnode *vp2, const char *name2)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp1);
+	struct ext2fs_node *dnp1 = EXT2FS_NODE(dvp1);
+	struct ext2fs_node *dnp2 = EXT2FS_NODE(dvp2);
+	struct ext2fs_node *np1 = EXT2FS_NODE(vp1);
+	struct ext2fs_node *np2 = vp2 ? EXT2FS_NODE(vp2) : NULL;
+	int isdir = S_ISDIR(np1->inode.i_mode);
+	int rc;
+
+	if (strlen(name2) > EXT2_NAME_LEN)
+		return ENAMETOOLONG;
+	if (fs->rdonly)
+		return EROFS;
+	/* Both names refer to the same inode */
+	if (np1 == np2)
+		return 0;
+
+	uk_mutex_lock(&fs->lock);
+	if (isdir && dnp1 != dnp2 && !np2 &&
+	    dnp2->inode.i_links_count >= EXT2_LINK_MAX) {
+		rc = EMLINK;
+		goto out;
+	}
+
+	/* An existing target is replaced in place */
+	if (np2) {
+		if (S_ISDIR(np2->inode.i_mode)) {
+			rc = ext2fs_dir_empty(fs, np2);
+			if (rc)
+				goto out;
+		}
+		rc = ext2fs_dir_replace(fs, dnp2, name2, np1->ino,
+					np1->inode.i_mode);
+		if (rc)
+			goto out;
+
+		if (S_ISDIR(np2->inode.i_mode)) {
+			np2->inode.i_links_count = 0;
+			dnp2->inode.i_links_count--;
+		} else {
+			np2->inode.i_links_count--;
+		}
+		np2->inode.i_ctime = ext2fs_now();
+		rc = ext2fs_iwrite(fs, np2->ino, &np2->inode);
+	} else {
+		rc = ext2fs_dir_add(fs, dnp2, name2, np1->ino,
+				    np1->inode.i_mode);
+	}
+	if (rc)
+		goto out;
+
+	rc = ext2fs_dir_remove(fs, dnp1, name1);
+	if (rc)
+		goto out;
+
+	if (isdir && dnp1 != dnp2) {
+		rc = ext2fs_dir_set_parent(fs, np1, dnp2->ino);
+		if (rc)
+			goto out;
+		dnp1->inode.i_links_count--;
+		dnp2->inode.i_links_count++;
+		rc = ext2fs_iwrite(fs, dnp1->ino, &dnp1->inode);
+		if (!rc)
+			rc = ext2fs_iwrite(fs, dnp2->ino, &dnp2->inode);
+		if (rc)
+			goto out;
+	}
+
+	np1->inode.i_ctime = ext2fs_now();
+	rc = ext2fs_iwrite(fs, np1->ino, &np1->inode);
+out:
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_getattr(struct vnode *vp, struct vattr *attr)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	struct ext2_inode *ip = &EXT2FS_NODE(vp)->inode;
+
+	uk_mutex_lock(&fs->lock);
+	attr->va_type = vp->v_type;
+	attr->va_mode = ip->i_mode & UK_ALLPERMS;
+	attr->va_nlink = ip->i_links_count;
+	attr->va_uid = ip->i_uid;
+	attr->va_gid = ip->i_gid;
+	attr->va_nodeid = EXT2FS_NODE(vp)->ino;
+	attr->va_atime.tv_sec = ip->i_atime;
+	attr->va_atime.tv_nsec = 0;
+	attr->va_mtime.tv_sec = ip->i_mtime;
+	attr->va_mtime.tv_nsec = 0;
+	attr->va_ctime.tv_sec = ip->i_ctime;
+	attr->va_ctime.tv_nsec = 0;
+	attr->va_nblocks = ip->i_blocks;
+	attr->va_size = ext2fs_isize(ip);
+	uk_mutex_unlock(&fs->lock);
+	return 0;
+}
+
+static int ext2fs_setattr(struct vnode *vp, struct vattr *attr)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	struct ext2fs_node *np = EXT2FS_NODE(vp);
+	int rc;
+
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	if (attr->va_mask & AT_MODE)
+		np->inode.i_mode = (np->inode.i_mode & S_IFMT) |
+				   (attr->va_mode & UK_ALLPERMS);
+	if (attr->va_mask & AT_UID)
+		np->inode.i_uid = attr->va_uid;
+	if (attr->va_mask & AT_GID)
+		np->inode.i_gid = attr->va_gid;
+	if (attr->va_mask & AT_ATIME)
+		np->inode.i_atime = attr->va_atime.tv_sec;
+	if (attr->va_mask & AT_MTIME)
+		np->inode.i_mtime = attr->va_mtime.tv_sec;
+	np->inode.i_ctime = ext2fs_now();
+	rc = ext2fs_iwrite(fs, np->ino, &np->inode);
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_inactive(struct vnode *vp)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	struct ext2fs_node *np = EXT2FS_NODE(vp);
+
+	if (!np)
+		return 0;
+
+	/* The last user of an unlinked inode is gone */
+	if (np->inode.i_links_count == 0 && !fs->rdonly) {
+		uk_mutex_lock(&fs->lock);
+		if (!ext2fs_fast_symlink(fs, &np->inode))
+			ext2fs_truncate_blocks(fs, np, 0);
+		ext2fs_set_isize(&np->inode, 0);
+		np->inode.i_dtime = ext2fs_now();
+		if (ext2fs_iwrite(fs, np->ino, &np->inode) == 0)
+			ext2fs_ifree(fs, np->ino, S_ISDIR(np->inode.i_mode));
+		uk_mutex_unlock(&fs->lock);
+	}
+
+	free(np);
+	vp->v_data = NULL;
+	return 0;
+}
+
+static int ext2fs_truncate(struct vnode *vp, off_t length)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	int rc;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (fs->rdonly)
+		return EROFS;
+	if (length < 0)
+		return EINVAL;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_resize(fs, EXT2FS_NODE(vp), length);
+	if (!rc)
+		vp->v_size = length;
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_link(struct vnode *dvp, struct vnode *svp, const char *name)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	struct ext2fs_node *np = EXT2FS_NODE(svp);
+	int rc;
+
+	if (strlen(name) > EXT2_NAME_LEN)
+		return ENAMETOOLONG;
+	if (svp->v_type == VDIR)
+		return EPERM;
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	if (np->inode.i_links_count >= EXT2_LINK_MAX) {
+		rc = EMLINK;
+		goto out;
+	}
+	rc = ext2fs_dir_add(fs, EXT2FS_NODE(dvp), name, np->ino,
+			    np->inode.i_mode);
+	if (rc)
+		goto out;
+
+	np->inode.i_links_count++;
+	np->inode.i_ctime = ext2fs_now();
+	rc = ext2fs_iwrite(fs, np->ino, &np->inode);
+out:
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_symlink(struct vnode *dvp, const char *name,
+			  const char *link)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(dvp);
+	size_t len = strlen(link);
+	struct ext2fs_node np;
+	struct ext2fs_buf *bp;
+	__u32 blkno;
+	int rc;
+
+	if (strlen(name) > EXT2_NAME_LEN)
+		return ENAMETOOLONG;
+	if (len >= fs->bsize)
+		return ENAMETOOLONG;
+	if (fs->rdonly)
+		return EROFS;
+
+	uk_mutex_lock(&fs->lock);
+	rc = ext2fs_inode_new(fs, EXT2FS_NODE(dvp), S_IFLNK | UK_ALLPERMS, &np);
+	if (rc)
+		goto out;
+
+	/* The target is stored without the terminating null */
+	if (len < EXT2_FAST_SYMLINK_MAX) {
+		memcpy(np.inode.i_block, link, len);
+	} else {
+		rc = ext2fs_bmap(fs, &np, 0, 1, &blkno);
+		if (!rc)
+			rc = ext2fs_bget(fs, blkno, &bp);
+		if (rc) {
+			ext2fs_truncate_blocks(fs, &np, 0);
+			ext2fs_ifree(fs, np.ino, 0);
+			goto out;
+		}
+		memcpy(bp->data, link, len);
+		ext2fs_bdirty(fs, bp);
+		ext2fs_brelse(fs, bp);
+	}
+	ext2fs_set_isize(&np.inode, len);
+	rc = ext2fs_inode_link_new(fs, EXT2FS_NODE(dvp), name, &np);
+out:
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_readlink(struct vnode *vp, struct uio *uio)
+{
+	struct ext2fs_mount *fs = EXT2FS_VFS(vp);
+	struct ext2fs_node *np = EXT2FS_NODE(vp);
+	struct ext2fs_buf *bp = NULL;
+	__u64 size;
+	__u32 blkno;
+	size_t len;
+	char *data;
+	int rc;
+
+	if (vp->v_type != VLNK)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0)
+		return 0;
+
+	uk_mutex_lock(&fs->lock);
+	size = ext2fs_isize(&np->inode);
+	if (size >= fs->bsize) {
+		rc = EIO;
+		goto out;
+	}
+	if ((__u64) uio->uio_offset >= size) {
+		rc = 0;
+		goto out;
+	}
+	len = MIN((size_t) (size - uio->uio_offset), (size_t) uio->uio_resid);
+
+	if (ext2fs_fast_symlink(fs, &np->inode)) {
+		data = (char *) np->inode.i_block;
+	} else {
+		rc = ext2fs_bmap(fs, np, 0, 0, &blkno);
+		if (!rc && !blkno)
+			rc = EIO;
+		if (!rc)
+			rc = ext2fs_bread(fs, blkno, &bp);
+		if (rc)
+			goto out;
+		data = bp->data;
+	}
+	rc = vfscore_uiomove(data + uio->uio_offset, len, uio);
+	if (bp)
+		ext2fs_brelse(fs, bp);
+out:
+	uk_mutex_unlock(&fs->lock);
+	return rc;
+}
+
+static int ext2fs_fallocate(struct vnode *vp __unused, int mode __unused,
+			    off_t offset __unused, off_t len __unused)
+{
+	return EOPNOTSUPP;
+}
+
+#define ext2fs_open		((vnop_open_t)vfscore_vop_nullop)
+#define ext2fs_close		((vnop_close_t)vfscore_vop_nullop)
+#define ext2fs_seek		((vnop_seek_t)vfscore_vop_nullop)
+#define ext2fs_ioctl		((vnop_ioctl_t)vfscore_vop_einval)
+#define ext2fs_poll		((vnop_poll_t)vfscore_vop_einval)
+
+struct vnops ext2fs_vnops = {
+	.vop_open	= ext2fs_open,
+	.vop_close	= ext2fs_close,
+	.vop_read	= ext2fs_read,
+	.vop_write	= ext2fs_write,
+	.vop_seek	= ext2fs_seek,
+	.vop_ioctl	= ext2fs_ioctl,
+	.vop_fsync	= ext2fs_fsync,
+	.vop_readdir	= ext2fs_readdir,
+	.vop_lookup	= ext2fs_lookup,
+	.vop_create	= ext2fs_create,
+	.vop_remove	= ext2fs_remove,
+	.vop_rename	= ext2fs_rename,
+	.vop_mkdir	= ext2fs_mkdir,
+	.vop_rmdir	= ext2fs_rmdir,
+	.vop_getattr	= ext2fs_getattr,
+	.vop_setattr	= ext2fs_setattr,
+	.vop_inactive	= ext2fs_inactive,
+	.vop_truncate	= ext2fs_truncate,
+	.vop_link	= ext2fs_link,
+	.vop_cache	= NULL,
+	.vop_fallocate	= ext2fs_fallocate,
+	.vop_readlink	= ext2fs_readlink,
+	.vop_symlink	= ext2fs_symlink,
+	.vop_poll	= ext2fs_poll,
+	.vop_splice_read = NULL,
+	.vop_map	= NULL,
+	.vop_unmap	= NULL,
+	.vop_getpage	= NULL
+};
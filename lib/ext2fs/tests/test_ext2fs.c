@@ -0,0 +1,477 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/syscall.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+#include <uk/essentials.h>
+
+#include "../ext2fs.h"
+
+#define RAMDISK_SSIZE	512
+#define RAMDISK_SECTORS	2048
+
+/*
+ * Layout of the test image: 1 KiB blocks in a single group, the super block
+ * in block 1, followed by the group descriptors, the bitmaps, the inode
+ * table and the block of the root directory.
+ */
+#define IMG_BSIZE	1024
+#define IMG_BLOCKS	(RAMDISK_SECTORS * RAMDISK_SSIZE / IMG_BSIZE)
+#define IMG_INODES	128
+#define IMG_GDT		2
+#define IMG_BBITMAP	3
+#define IMG_IBITMAP	4
+#define IMG_ITABLE	5
+#define IMG_ROOTDIR	(IMG_ITABLE + IMG_INODES * \
+			 EXT2_GOOD_OLD_INODE_SIZE / IMG_BSIZE)
+#define IMG_FIRST_INO	11
+
+#define MNT		"/ext2test"
+#define TEST_FILE	MNT "/file"
+
+/*
+ * RAM disk that completes every request right when it is submitted
+ */
+struct uk_blkdev_queue {
+	int unused;
+};
+
+static struct uk_blkdev ramdisk;
+static struct uk_blkdev_queue ramdisk_queue;
+static __u8 ramdisk_data[RAMDISK_SECTORS * RAMDISK_SSIZE];
+
+static void ramdisk_get_info(struct uk_blkdev *dev __unused,
+			     struct uk_blkdev_info *dev_info)
+{
+	dev_info->max_queues = 1;
+}
+
+static int ramdisk_configure(struct uk_blkdev *dev __unused,
+			     const struct uk_blkdev_conf *conf __unused)
+{
+	return 0;
+}
+
+static int ramdisk_queue_get_info(struct uk_blkdev *dev __unused,
+				  uint16_t queue_id __unused,
+				  struct uk_blkdev_queue_info *q_info)
+{
+	q_info->nb_min = 1;
+	q_info->nb_max = 1;
+	return 0;
+}
+
+static struct uk_blkdev_queue *ramdisk_queue_configure(
+		struct uk_blkdev *dev __unused, uint16_t queue_id __unused,
+		uint16_t nb_desc __unused,
+		const struct uk_blkdev_queue_conf *queue_conf __unused)
+{
+	return &ramdisk_queue;
+}
+
+static int ramdisk_queue_unconfigure(struct uk_blkdev *dev __unused,
+				     struct uk_blkdev_queue *queue __unused)
+{
+	return 0;
+}
+
+/* Start, stop and unconfigure have nothing to do */
+static int ramdisk_nop(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int ramdisk_submit_one(struct uk_blkdev *dev,
+			      struct uk_blkdev_queue *queue __unused,
+			      struct uk_blkreq *req)
+{
+	__u8 *data = ramdisk_data + req->start_sector * RAMDISK_SSIZE;
+
+	if (req->operation != UK_BLKREQ_FFLUSH &&
+	    req->start_sector + req->nb_sectors > dev->capabilities.sectors)
+		return -EINVAL;
+
+	if (req->operation == UK_BLKREQ_READ)
+		memcpy(req->aio_buf, data, req->nb_sectors * RAMDISK_SSIZE);
+	else if (req->operation == UK_BLKREQ_WRITE)
+		memcpy(data, req->aio_buf, req->nb_sectors * RAMDISK_SSIZE);
+
+	req->result = 0;
+	uk_blkreq_finished(req);
+	if (req->cb)
+		req->cb(req, req->cb_cookie);
+	return UK_BLKDEV_STATUS_SUCCESS | UK_BLKDEV_STATUS_MORE;
+}
+
+static int ramdisk_finish_reqs(struct uk_blkdev *dev __unused,
+			       struct uk_blkdev_queue *queue __unused)
+{
+	return 0;
+}
+
+static const struct uk_blkdev_ops ramdisk_ops = {
+	.get_info = ramdisk_get_info,
+	.dev_configure = ramdisk_configure,
+	.queue_get_info = ramdisk_queue_get_info,
+	.queue_configure = ramdisk_queue_configure,
+	.dev_start = ramdisk_nop,
+	.dev_stop = ramdisk_nop,
+	.queue_unconfigure = ramdisk_queue_unconfigure,
+	.dev_unconfigure = ramdisk_nop,
+};
+
+static void *img_block(__u32 blkno)
+{
+	return ramdisk_data + blkno * IMG_BSIZE;
+}
+
+static void img_set_bits(__u8 *map, unsigned int from, unsigned int to)
+{
+	for (; from < to; from++)
+		map[from / 8] |= 1 << (from % 8);
+}
+
+/* Formats the device with an empty file system */
+static void img_mkfs(void)
+{
+	struct ext2_super_block *sb;
+	struct ext2_group_desc *gd;
+	struct ext2_dir_entry *de;
+	struct ext2_inode *root;
+	__u32 used_blocks = IMG_ROOTDIR;
+
+	memset(ramdisk_data, 0, sizeof(ramdisk_data));
+
+	sb = (struct ext2_super_block *) img_block(1);
+	sb->s_inodes_count = IMG_INODES;
+	sb->s_blocks_count = IMG_BLOCKS;
+	sb->s_free_blocks_count = IMG_BLOCKS - 1 - used_blocks;
+	sb->s_free_inodes_count = IMG_INODES - (IMG_FIRST_INO - 1);
+	sb->s_first_data_block = 1;
+	sb->s_blocks_per_group = IMG_BSIZE * 8;
+	sb->s_frags_per_group = IMG_BSIZE * 8;
+	sb->s_inodes_per_group = IMG_INODES;
+	sb->s_magic = EXT2_SUPER_MAGIC;
+	sb->s_state = EXT2_VALID_FS;
+	sb->s_rev_level = 1;
+	sb->s_first_ino = IMG_FIRST_INO;
+	sb->s_inode_size = EXT2_GOOD_OLD_INODE_SIZE;
+	sb->s_feature_incompat = EXT2_FEATURE_INCOMPAT_FILETYPE;
+
+	gd = (struct ext2_group_desc *) img_block(IMG_GDT);
+	gd->bg_block_bitmap = IMG_BBITMAP;
+	gd->bg_inode_bitmap = IMG_IBITMAP;
+	gd->bg_inode_table = IMG_ITABLE;
+	gd->bg_free_blocks_count = sb->s_free_blocks_count;
+	gd->bg_free_inodes_count = sb->s_free_inodes_count;
+	gd->bg_used_dirs_count = 1;
+
+	/* Bits past the end of the group are marked as in use */
+	img_set_bits(img_block(IMG_BBITMAP), 0, used_blocks);
+	img_set_bits(img_block(IMG_BBITMAP), IMG_BLOCKS - 1, IMG_BSIZE * 8);
+	img_set_bits(img_block(IMG_IBITMAP), 0, IMG_FIRST_INO - 1);
+	img_set_bits(img_block(IMG_IBITMAP), IMG_INODES, IMG_BSIZE * 8);
+
+	root = (struct ext2_inode *) ((__u8 *) img_block(IMG_ITABLE) +
+		(EXT2_ROOT_INO - 1) * EXT2_GOOD_OLD_INODE_SIZE);
+	root->i_mode = S_IFDIR | 0755;
+	root->i_size = IMG_BSIZE;
+	root->i_links_count = 2;
+	root->i_blocks = IMG_BSIZE / 512;
+	root->i_block[0] = IMG_ROOTDIR;
+
+	de = (struct ext2_dir_entry *) img_block(IMG_ROOTDIR);
+	de->inode = EXT2_ROOT_INO;
+	de->rec_len = EXT2_DIR_REC_LEN(1);
+	de->name_len = 1;
+	de->file_type = EXT2_FT_DIR;
+	memcpy(de->name, ".", 1);
+
+	de = (struct ext2_dir_entry *) ((__u8 *) de + de->rec_len);
+	de->inode = EXT2_ROOT_INO;
+	de->rec_len = IMG_BSIZE - EXT2_DIR_REC_LEN(1);
+	de->name_len = 2;
+	de->file_type = EXT2_FT_DIR;
+	memcpy(de->name, "..", 2);
+}
+
+/* Registers the device and mounts the image on it */
+static int img_mount(void)
+{
+	char dev[16];
+	int id, rc;
+
+	memset(&ramdisk, 0, sizeof(ramdisk));
+	ramdisk.submit_one = ramdisk_submit_one;
+	ramdisk.finish_reqs = ramdisk_finish_reqs;
+	ramdisk.dev_ops = &ramdisk_ops;
+	ramdisk.capabilities.sectors = RAMDISK_SECTORS;
+	ramdisk.capabilities.ssize = RAMDISK_SSIZE;
+	ramdisk.capabilities.mode = O_RDWR;
+	ramdisk.capabilities.max_sectors_per_req = RAMDISK_SECTORS;
+	ramdisk.capabilities.ioalign = sizeof(void *);
+
+	id = uk_blkdev_drv_register(&ramdisk, uk_alloc_get_default(),
+				    "ramdisk");
+	if (id < 0)
+		return id;
+
+	snprintf(dev, sizeof(dev), "%d", id);
+	rc = uk_syscall_r_mount((long) dev, (long) MNT, (long) "ext2", 0, 0);
+	if (rc < 0)
+		uk_blkdev_drv_unregister(&ramdisk);
+	return rc;
+}
+
+static int img_umount(void)
+{
+	int rc;
+
+	rc = uk_syscall_r_umount2((long) MNT, 0);
+	if (rc < 0)
+		return rc;
+	uk_blkdev_drv_unregister(&ramdisk);
+	return 0;
+}
+
+static int img_remount(void)
+{
+	int rc;
+
+	rc = img_umount();
+	if (rc < 0)
+		return rc;
+	return img_mount();
+}
+
+/* Returns whether the file holds the pattern of fill() in [off, off + len) */
+static int test_check(int fd, off_t off, size_t len, char c)
+{
+	char buf[256];
+	size_t i, n;
+
+	for (; len > 0; len -= n, off += n) {
+		n = MIN(sizeof(buf), len);
+		if (pread(fd, buf, n, off) != (ssize_t) n)
+			return 0;
+		for (i = 0; i < n; ++i)
+			if (buf[i] != (c ? (char) (c + (off + i) % 7) : 0))
+				return 0;
+	}
+	return 1;
+}
+
+static int test_fill(int fd, off_t off, size_t len, char c)
+{
+	char buf[256];
+	size_t i, n;
+
+	for (; len > 0; len -= n, off += n) {
+		n = MIN(sizeof(buf), len);
+		for (i = 0; i < n; ++i)
+			buf[i] = (char) (c + (off + i) % 7);
+		if (pwrite(fd, buf, n, off) != (ssize_t) n)
+			return -1;
+	}
+	return 0;
+}
+
+static int test_truncate(int fd, off_t len)
+{
+	return uk_syscall_r_ftruncate((long) fd, (long) len);
+}
+
+static off_t test_size(const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return -1;
+	return st.st_size;
+}
+
+static long test_free_blocks(void)
+{
+	struct statfs sfs;
+
+	if (statfs(MNT, &sfs) < 0)
+		return -1;
+	return (long) sfs.f_bfree;
+}
+
+UK_TESTCASE(ext2fs, write_read)
+{
+	int fd;
+
+	UK_TEST_ASSERT(img_mount() == 0);
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 0, 5000, 'a'));
+	UK_TEST_EXPECT(test_check(fd, 0, 5000, 'a'));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	/* The data must have reached the device */
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_size(TEST_FILE), 5000);
+	fd = open(TEST_FILE, O_RDWR);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT(test_check(fd, 0, 5000, 'a'));
+
+	/* Overwriting within the file keeps the rest */
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 1000, 2000, 'k'));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_ASSERT(img_remount() == 0);
+	fd = open(TEST_FILE, O_RDONLY);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT(test_check(fd, 0, 1000, 'a'));
+	UK_TEST_EXPECT(test_check(fd, 1000, 2000, 'k'));
+	UK_TEST_EXPECT(test_check(fd, 3000, 2000, 'a'));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_EXPECT_ZERO(unlink(TEST_FILE));
+	UK_TEST_EXPECT_ZERO(img_umount());
+}
+
+UK_TESTCASE(ext2fs, extend)
+{
+	off_t far = (EXT2_NDIR_BLOCKS + 20) * IMG_BSIZE + 100;
+	int fd;
+
+	UK_TEST_ASSERT(img_mount() == 0);
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 0, 100, 'a'));
+
+	/* Writing past the direct blocks needs an indirect block and leaves
+	 * a hole that reads as zeros
+	 */
+	UK_TEST_EXPECT_ZERO(test_fill(fd, far, 3000, 'b'));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_size(TEST_FILE), far + 3000);
+	fd = open(TEST_FILE, O_RDWR | O_APPEND);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT(test_check(fd, 0, 100, 'a'));
+	UK_TEST_EXPECT(test_check(fd, 100, far - 100, 0));
+	UK_TEST_EXPECT(test_check(fd, far, 3000, 'b'));
+
+	/* Appending continues at the end */
+	UK_TEST_EXPECT_SNUM_EQ(write(fd, "xyz", 3), 3);
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_size(TEST_FILE), far + 3003);
+
+	UK_TEST_EXPECT_ZERO(unlink(TEST_FILE));
+	UK_TEST_EXPECT_ZERO(img_umount());
+}
+
+UK_TESTCASE(ext2fs, truncate)
+{
+	long bfree;
+	int fd;
+
+	UK_TEST_ASSERT(img_mount() == 0);
+	bfree = test_free_blocks();
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 0, 40 * IMG_BSIZE, 'a'));
+	UK_TEST_EXPECT_ZERO(fsync(fd));
+	UK_TEST_EXPECT(test_free_blocks() < bfree);
+
+	/* Shrinking into a block frees the blocks behind it */
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, 2 * IMG_BSIZE + 10));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_size(TEST_FILE), 2 * IMG_BSIZE + 10);
+	UK_TEST_EXPECT_SNUM_EQ(test_free_blocks(), bfree - 3);
+
+	/* Growing again must not bring back old data */
+	fd = open(TEST_FILE, O_RDWR);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT(test_check(fd, 0, 2 * IMG_BSIZE + 10, 'a'));
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, 20 * IMG_BSIZE));
+	UK_TEST_EXPECT(test_check(fd, 2 * IMG_BSIZE + 10,
+				  18 * IMG_BSIZE - 10, 0));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_size(TEST_FILE), 20 * IMG_BSIZE);
+	fd = open(TEST_FILE, O_RDWR | O_TRUNC);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT_ZERO(close(fd));
+	UK_TEST_EXPECT_SNUM_EQ(test_size(TEST_FILE), 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_free_blocks(), bfree);
+
+	UK_TEST_EXPECT_ZERO(unlink(TEST_FILE));
+	UK_TEST_EXPECT_ZERO(img_umount());
+}
+
+UK_TESTCASE(ext2fs, unlink)
+{
+	struct statfs sfs;
+	long bfree, ffree;
+	int fd;
+
+	UK_TEST_ASSERT(img_mount() == 0);
+	UK_TEST_ASSERT(statfs(MNT, &sfs) == 0);
+	bfree = sfs.f_bfree;
+	ffree = sfs.f_ffree;
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_EXCL, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 0, 30 * IMG_BSIZE, 'a'));
+	UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_ZERO(unlink(TEST_FILE));
+	UK_TEST_EXPECT_SNUM_EQ(open(TEST_FILE, O_RDONLY), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, ENOENT);
+
+	/* The inode and all its blocks are free again, also on the device */
+	UK_TEST_ASSERT(img_remount() == 0);
+	UK_TEST_EXPECT_SNUM_EQ(open(TEST_FILE, O_RDONLY), -1);
+	UK_TEST_ASSERT(statfs(MNT, &sfs) == 0);
+	UK_TEST_EXPECT_SNUM_EQ(sfs.f_bfree, bfree);
+	UK_TEST_EXPECT_SNUM_EQ(sfs.f_ffree, ffree);
+
+	/* The name can be used again */
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_EXCL, 0644);
+	UK_TEST_EXPECT(fd >= 0);
+	if (fd >= 0)
+		UK_TEST_EXPECT_ZERO(close(fd));
+
+	UK_TEST_EXPECT_ZERO(unlink(TEST_FILE));
+	UK_TEST_EXPECT_ZERO(img_umount());
+}
+
+static int ext2fs_test_init(struct uk_testsuite *suite __unused)
+{
+	img_mkfs();
+	if (mkdir(MNT, 0755) < 0 && errno != EEXIST)
+		return -errno;
+	return 0;
+}
+
+uk_testsuite_register(ext2fs, ext2fs_test_init);
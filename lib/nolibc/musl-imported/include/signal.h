@@ -65,12 +65,24 @@ extern "C" {
 
 #define NSIG _NSIG
 
+union sigval {
+	int    sival_int;	/* Integer signal value */
+	void  *sival_ptr;	/* Pointer signal value */
+};
+
 typedef struct {
 	int          si_signo;    /* Signal number */
 	int          si_code;     /* Cause of the signal */
 	pid_t	       si_pid;	    /* Sending process ID */
+	int          si_timerid;  /* Timer ID (SI_TIMER) */
+	int          si_overrun;  /* Timer overrun count (SI_TIMER) */
+	union sigval si_value;    /* Signal value */
 } siginfo_t;
 
+#define SI_USER		0
+#define SI_QUEUE	(-1)
+#define SI_TIMER	(-2)
+
 struct sigaction {
 	union {
 		void (*sa_handler)(int);
@@ -119,18 +131,20 @@ int sigaddset(sigset_t *set, int signo);
 int sigdelset(sigset_t *set, int signo);
 int sigismember(const sigset_t *set, int signo);
 
-/* TODO: not used - defined just for newlib */
-union sigval {
-	int    sival_int;	/* Integer signal value */
-	void  *sival_ptr;	/* Pointer signal value */
-};
-
 struct sigevent {
 	int              sigev_notify;	/* Notification type */
 	int              sigev_signo;	/* Signal number */
 	union sigval     sigev_value;	/* Signal value */
+	/* Notification function and attributes for SIGEV_THREAD */
+	void (*sigev_notify_function)(union sigval);
+	void *sigev_notify_attributes;
 };
 
+#define SIGEV_SIGNAL	0
+#define SIGEV_NONE	1
+#define SIGEV_THREAD	2
+#define SIGEV_THREAD_ID	4
+
 /* TODO: not used - defined just for v8 */
 typedef struct sigaltstack {
 	void *ss_sp;
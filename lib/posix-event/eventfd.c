@@ -98,16 +98,7 @@ static unsigned int eventfd_events(struct eventfd *efd)
 
 static void eventfd_signal_eventpoll(struct eventfd *efd, unsigned int events)
 {
-	struct eventpoll_cb *ecb;
-	struct uk_list_head *itr;
-
-	uk_list_for_each(itr, &efd->ep_list) {
-		ecb = uk_list_entry(itr, struct eventpoll_cb, cb_link);
-
-		UK_ASSERT(ecb->unregister);
-
-		eventpoll_signal(ecb, events);
-	}
+	eventpoll_signal_list(&efd->ep_list, events);
 }
 
 static int eventfd_vfscore_close(struct vnode *vnode,
@@ -61,30 +61,104 @@
 #include <uk/plat/lcpu.h>
 #include <uk/plat/time.h>
 
+/* Number of futex hash buckets (log2) */
+#define FUTEX_HASH_ORDER	8
+#define FUTEX_HASH_SIZE		(1UL << FUTEX_HASH_ORDER)
+
+struct futex_bucket;
+
 /** @struct uk_futex
  *  @brief Futex structure.
  */
 struct uk_futex {
 	uint32_t *uaddr; /** The futex address. */
+	uint32_t bitset; /** The wake-up mask of the waiter. */
 	struct uk_thread *thread; /** The thread waiting on the futex. */
+	struct futex_bucket *bucket; /** The bucket the futex is queued on. */
 	struct uk_list_head list_node; /** The list containing all the futexes
-					 * on which the threads are waiting.
+					 * of the bucket on which threads are
+					 * waiting.
 					 */
 };
 
-static UK_LIST_HEAD(futex_list);
-static uk_spinlock futex_list_lock = UK_SPINLOCK_INITIALIZER();
+/** @struct futex_bucket
+ *  @brief Hash bucket of the futexes with the same address hash.
+ */
+struct futex_bucket {
+	uk_spinlock lock; /** Protects the waiters list. */
+	struct uk_list_head waiters; /** Queued futexes in FIFO order. */
+};
+
+static struct futex_bucket futex_buckets[FUTEX_HASH_SIZE];
+
+static struct futex_bucket *futex_hash(const uint32_t *uaddr)
+{
+	/* Fibonacci hashing of the (4-byte aligned) futex address */
+	__u64 h = (__u64) ((__uptr) uaddr >> 2) * 0x9e3779b97f4a7c15ULL;
+
+	return &futex_buckets[h >> (64 - FUTEX_HASH_ORDER)];
+}
+
+static void futex_bucket_lock(struct futex_bucket *b)
+{
+	uk_spin_lock(&b->lock);
+
+	/* Buckets are initialized on first use */
+	if (unlikely(!b->waiters.next))
+		UK_INIT_LIST_HEAD(&b->waiters);
+}
+
+static void futex_bucket_unlock(struct futex_bucket *b)
+{
+	uk_spin_unlock(&b->lock);
+}
+
+/* Lock two buckets in address order to avoid ABBA deadlocks */
+static void futex_bucket_lock2(struct futex_bucket *b1,
+			       struct futex_bucket *b2)
+{
+	if (b1 > b2) {
+		futex_bucket_lock(b2);
+		futex_bucket_lock(b1);
+	} else {
+		futex_bucket_lock(b1);
+		if (b1 != b2)
+			futex_bucket_lock(b2);
+	}
+}
+
+static void futex_bucket_unlock2(struct futex_bucket *b1,
+				 struct futex_bucket *b2)
+{
+	futex_bucket_unlock(b1);
+	if (b1 != b2)
+		futex_bucket_unlock(b2);
+}
+
+/* Dequeue a futex and wake up its thread. The bucket lock must be held. */
+static void futex_wake_one(struct uk_futex *f)
+{
+	/* The waiter detects a timeout by the futex still being queued */
+	uk_list_del_init(&f->list_node);
+
+	/* TODO: Replace with uk_thread_wakeup when the new
+	 * scheduler API is ready
+	 */
+	uk_thread_wake(f->thread);
+}
 
 /**
  * Prepare to wait on a futex.
  *
- * Get the futex value atomically and compare it with the expected value. Add
- * the thread to the wait list and then block it if the value is equal to the
- * expected one. If the futex was not removed from the list when the thread was
- * unblocked, then it means that it timed out.
+ * Get the futex value atomically and compare it with the expected value while
+ * holding the lock of the futex bucket. Add the thread to the wait list of the
+ * bucket and then block it if the value is equal to the expected one. If the
+ * futex was not removed from the list when the thread was unblocked, then it
+ * means that it timed out.
  *
  * @param uaddr		The futex userspace address
  * @param val		The expected value
+ * @param bitset	The wake-up mask, FUTEX_BITSET_MATCH_ANY for all
  * @param timeout	The deadline until the function will block at most.
  * 			If it is NULL, the thread will wait indefinitely.
  *
@@ -93,94 +167,103 @@ static uk_spinlock futex_list_lock = UK_SPINLOCK_INITIALIZER();
  *	<1: -EAGAIN (uaddr does not contain val) or -ETIMEDOUT (the futex timed
  *       out)
  */
-static int futex_wait(uint32_t *uaddr, uint32_t val, const __nsec *timeout)
+static int futex_wait(uint32_t *uaddr, uint32_t val, uint32_t bitset,
+		      const __nsec *timeout)
 {
 	unsigned long irqf;
-	struct uk_list_head *itr, *tmp;
-	struct uk_futex *f_tmp;
+	struct futex_bucket *b = futex_hash(uaddr);
 	struct uk_thread *current = uk_thread_current();
-	struct uk_futex f = {.uaddr = uaddr, .thread = current};
-
-	if (ukarch_load_n(uaddr) == val) {
-		irqf = ukplat_lcpu_save_irqf();
-		uk_spin_lock(&futex_list_lock);
+	struct uk_futex f = {
+		.uaddr = uaddr,
+		.bitset = bitset,
+		.thread = current,
+		.bucket = b,
+	};
+	int timedout;
 
-		/* Enqueue thread to wait list */
-		uk_list_add_tail(&f.list_node, &futex_list);
+	irqf = ukplat_lcpu_save_irqf();
+	futex_bucket_lock(b);
 
-		uk_spin_unlock(&futex_list_lock);
+	/* Futex word does not contain expected val */
+	if (ukarch_load_n(uaddr) != val) {
+		futex_bucket_unlock(b);
 		ukplat_lcpu_restore_irqf(irqf);
+		return -EAGAIN;
+	}
 
-		if (timeout)
-			/* Block at most until `timeout` nanosecs */
-			uk_thread_block_until(current, (__snsec)*timeout);
-		else
-			/* Block indefinitely */
-			uk_thread_block(current);
-
-		uk_sched_yield();
+	/* Enqueue thread to wait list */
+	uk_list_add_tail(&f.list_node, &b->waiters);
 
-		irqf = ukplat_lcpu_save_irqf();
-		uk_spin_lock(&futex_list_lock);
+	/* Block while holding the bucket lock so that a wake-up between
+	 * unlocking and blocking cannot get lost.
+	 */
+	if (timeout)
+		/* Block at most until `timeout` nanosecs */
+		uk_thread_block_until(current, (__snsec)*timeout);
+	else
+		/* Block indefinitely */
+		uk_thread_block(current);
+
+	futex_bucket_unlock(b);
+	ukplat_lcpu_restore_irqf(irqf);
 
-		/* If the futex is still in the wait list, then it timed out */
-		uk_list_for_each_safe(itr, tmp, &futex_list) {
-			f_tmp = uk_list_entry(itr, struct uk_futex, list_node);
+	uk_sched_yield();
 
-			if (f_tmp->uaddr == uaddr && f_tmp->thread == current) {
-				/* Remove the thread from the futex list */
-				uk_list_del(&f_tmp->list_node);
-				uk_spin_unlock(&futex_list_lock);
-				ukplat_lcpu_restore_irqf(irqf);
+	/* Lock the bucket that the futex is queued on now. A requeue might
+	 * have moved the futex to another bucket in the meantime.
+	 */
+	irqf = ukplat_lcpu_save_irqf();
+	for (;;) {
+		b = ukarch_load_n(&f.bucket);
+		futex_bucket_lock(b);
+		if (likely(b == f.bucket))
+			break;
+		futex_bucket_unlock(b);
+	}
 
-				return -ETIMEDOUT;
-			}
-		}
+	/* If the futex is still in the wait list, then it timed out */
+	timedout = !uk_list_empty(&f.list_node);
+	if (timedout)
+		uk_list_del(&f.list_node);
 
-		uk_spin_unlock(&futex_list_lock);
-		ukplat_lcpu_restore_irqf(irqf);
-
-		return 0;
-	}
+	futex_bucket_unlock(b);
+	ukplat_lcpu_restore_irqf(irqf);
 
-	/* Futex word does not contain expected val */
-	return -EAGAIN;
+	return timedout ? -ETIMEDOUT : 0;
 }
 
 /**
  * Wake up threads waiting on a futex.
  *
- * Find val threads in the wait list for the futex, remove the futexes from the
- * list and wake up the threads.
+ * Find val threads in the wait list of the futex bucket whose wake-up mask
+ * intersects with bitset, remove the futexes from the list and wake up the
+ * threads.
  *
- * @param uaddr	The futex userspace address
- * @param val	The number of threads waiting on the futex to be woken up
+ * @param uaddr		The futex userspace address
+ * @param val		The number of threads waiting on the futex to be woken
+ *			up
+ * @param bitset	The wake-up mask, FUTEX_BITSET_MATCH_ANY for all
  *
  * @return
  *	0: no threads were woken up;
  *	>0: the number of threads woken up
  */
-static int futex_wake(uint32_t *uaddr, uint32_t val)
+static int futex_wake(uint32_t *uaddr, uint32_t val, uint32_t bitset)
 {
 	unsigned long irqf;
+	struct futex_bucket *b = futex_hash(uaddr);
 	struct uk_list_head *itr, *tmp;
 	struct uk_futex *f;
 	uint32_t count = 0;
 
 	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+	futex_bucket_lock(b);
 
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
+	uk_list_for_each_safe(itr, tmp, &b->waiters) {
 		f = uk_list_entry(itr, struct uk_futex, list_node);
 
-		if (f->uaddr == uaddr) {
-			/* Remove the thread from the futex list */
-			uk_list_del(&f->list_node);
-
-			/* TODO: Replace with uk_thread_wakeup when the new
-			 * scheduler API is ready
-			 */
-			uk_thread_wake(f->thread);
+		if (f->uaddr == uaddr && (f->bitset & bitset)) {
+			futex_wake_one(f);
 
 			/* Wake at most val threads */
 			if (++count >= val)
@@ -188,7 +271,7 @@ static int futex_wake(uint32_t *uaddr, uint32_t val)
 		}
 	}
 
-	uk_spin_unlock(&futex_list_lock);
+	futex_bucket_unlock(b);
 	ukplat_lcpu_restore_irqf(irqf);
 
 	return (int) count;
@@ -208,53 +291,67 @@ static int futex_wake(uint32_t *uaddr, uint32_t val)
  * @param val		Number of waiters to wake
  * @param val2		Number of waiters to requeue (0-INT_MAX)
  * @param uaddr2	Target futex user address
+ * @param cmp		Compare uaddr with val3 before requeueing
  * @param val3		uaddr expected value
  *
  * @return
  *	>=0: on success, the number of tasks requeued or woken;
  *	<0: on error
  */
-static int futex_cmp_requeue(uint32_t *uaddr, uint32_t val, uint32_t val2,
-			     uint32_t *uaddr2, uint32_t val3)
+static int futex_requeue(uint32_t *uaddr, uint32_t val, uint32_t val2,
+			 uint32_t *uaddr2, bool cmp, uint32_t val3)
 {
 	unsigned long irqf;
+	struct futex_bucket *b1 = futex_hash(uaddr);
+	struct futex_bucket *b2 = futex_hash(uaddr2);
 	struct uk_list_head *itr, *tmp;
 	struct uk_futex *f;
-	int woken_uaddr1;
+	uint32_t woken_uaddr1 = 0;
 	uint32_t waiters_uaddr2 = 0;
+	int ret;
 
-	if (!((uint32_t)val3 == ukarch_load_n(uaddr)))
-		return -EAGAIN;
+	irqf = ukplat_lcpu_save_irqf();
+	futex_bucket_lock2(b1, b2);
 
-	/* Wake up val waiters on uaddr */
-	woken_uaddr1 = futex_wake(uaddr, val);
+	if (cmp && ukarch_load_n(uaddr) != val3) {
+		ret = -EAGAIN;
+		goto out;
+	}
 
-	if (!val2)
-		return woken_uaddr1;
+	uk_list_for_each_safe(itr, tmp, &b1->waiters) {
+		f = uk_list_entry(itr, struct uk_futex, list_node);
 
-	irqf = ukplat_lcpu_save_irqf();
-	uk_spin_lock(&futex_list_lock);
+		if (f->uaddr != uaddr)
+			continue;
 
-	/* Requeue val2 waiters on uaddr2 */
-	uk_list_for_each_safe(itr, tmp, &futex_list) {
-		f = uk_list_entry(itr, struct uk_futex, list_node);
+		/* Wake up val waiters on uaddr */
+		if (woken_uaddr1 < val) {
+			futex_wake_one(f);
+			woken_uaddr1++;
+			continue;
+		}
+
+		/* Requeue at most val2 threads */
+		if (waiters_uaddr2 >= val2)
+			break;
 
-		if (f->uaddr == uaddr) {
-			/* Requeue thread to uaddr2 */
+		/* Requeue thread to uaddr2 */
+		if (uaddr != uaddr2) {
 			uk_list_del(&f->list_node);
 			f->uaddr = uaddr2;
-			uk_list_add_tail(&f->list_node, &futex_list);
-
-			/* Requeue at most val2 threads */
-			if (++waiters_uaddr2 >= val2)
-				break;
+			ukarch_store_n(&f->bucket, b2);
+			uk_list_add_tail(&f->list_node, &b2->waiters);
 		}
+		waiters_uaddr2++;
 	}
 
-	uk_spin_unlock(&futex_list_lock);
+	ret = (int) (woken_uaddr1 + waiters_uaddr2);
+
+out:
+	futex_bucket_unlock2(b1, b2);
 	ukplat_lcpu_restore_irqf(irqf);
 
-	return woken_uaddr1 + waiters_uaddr2;
+	return ret;
 }
 
 /**
@@ -303,33 +400,40 @@ UK_LLSYSCALL_R_DEFINE(int, futex, uint32_t *, uaddr, int, futex_op,
 			timeout_ns = ukplat_monotonic_clock() +
 				     ukarch_time_sec_to_nsec(timeout->tv_sec) +
 				     timeout->tv_nsec;
-		return futex_wait(uaddr, val, timeout ? &timeout_ns : NULL);
+		return futex_wait(uaddr, val, FUTEX_BITSET_MATCH_ANY,
+				  timeout ? &timeout_ns : NULL);
 
 	case FUTEX_WAIT_BITSET:
-		/*
-		 * Special case implementation for cases where the val3/mask has
-		 * all bits set. Some applications do this to use the absolute
-		 * timeout mode. We return ENOSYS for all non-supported calls.
-		 */
-		if (val3 != UINT32_MAX)
-			return -ENOSYS;
+		/* The timeout of FUTEX_WAIT_BITSET is absolute */
+		if (!val3)
+			return -EINVAL;
 
 		if (timeout)
 			timeout_ns = ukarch_time_sec_to_nsec(timeout->tv_sec)
 				     + timeout->tv_nsec;
 
-		return futex_wait(uaddr, val, timeout ? &timeout_ns : NULL);
+		return futex_wait(uaddr, val, val3,
+				  timeout ? &timeout_ns : NULL);
 
 	case FUTEX_WAKE:
-		return futex_wake(uaddr, val);
+		return futex_wake(uaddr, val, FUTEX_BITSET_MATCH_ANY);
+
+	case FUTEX_WAKE_BITSET:
+		if (!val3)
+			return -EINVAL;
+
+		return futex_wake(uaddr, val, val3);
 
 	case FUTEX_FD:
-	case FUTEX_REQUEUE:
 		return -ENOSYS;
 
+	case FUTEX_REQUEUE:
+		return futex_requeue(uaddr, val, (unsigned long)timeout,
+				     uaddr2, false, 0);
+
 	case FUTEX_CMP_REQUEUE:
-		return futex_cmp_requeue(uaddr, val, (unsigned long)timeout,
-					 uaddr2, val3);
+		return futex_requeue(uaddr, val, (unsigned long)timeout,
+				     uaddr2, true, val3);
 
 	default:
 		return -ENOSYS;
@@ -379,7 +483,8 @@ static void pfutex_child_cleartid_term(struct uk_thread *child __unused)
 {
 	if (child_tid_clear_ref != NULL) {
 		*((pid_t *) child_tid_clear_ref) = 0;
-		futex_wake((uint32_t *) child_tid_clear_ref, 0);
+		futex_wake((uint32_t *) child_tid_clear_ref, 0,
+			   FUTEX_BITSET_MATCH_ANY);
 	}
 }
 UK_THREAD_INIT_PRIO(0x0, pfutex_child_cleartid_term, UK_PRIO_EARLIEST);
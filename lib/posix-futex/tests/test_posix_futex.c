@@ -40,6 +40,7 @@
 #include <linux/futex.h>
 #include <uk/syscall.h>
 #include <uk/sched.h>
+#include <uk/plat/time.h>
 
 #if defined(__X86_32__) || defined(__x86_64__)
 #define NR_FUTEX	202
@@ -52,6 +53,7 @@ struct test_args {
 	uint32_t val;
 	uint32_t nr_wake;
 	uint64_t nr_requeue;
+	uint32_t bitset;
 
 	uint32_t *futex_val;
 	uint32_t *requeue_futex_val;
@@ -150,6 +152,20 @@ static __noreturn void waker_func(void *arg)
 	uk_sched_thread_exit();
 }
 
+/**
+ * Wait with a wake-up mask and an absolute timeout, then increment a variable.
+ */
+static __noreturn void bitset_waiter_func(void *arg)
+{
+	struct test_args *args = (struct test_args *)arg;
+
+	args->rets[0] = futex(args->futex_val, FUTEX_WAIT_BITSET, args->val,
+			      args->timeout, NULL, args->bitset);
+	if (!args->rets[0])
+		args->var_to_change_vals[0] = ++(*args->var_to_change);
+	uk_sched_thread_exit();
+}
+
 /**
  * Wake up nr_wake threads and requeue nr_requeue threads.
  */
@@ -442,4 +458,72 @@ UK_TESTCASE(posix_futex_testsuite, test_cmp_requeue_two_waiters_one_waker)
 	UK_TEST_EXPECT_SNUM_EQ(var_to_change, 3);
 }
 
+UK_TESTCASE(posix_futex_testsuite, test_wait_bitset_invalid)
+{
+	uint32_t futex_val = 10;
+
+	int ret = futex(&futex_val, FUTEX_WAIT_BITSET, 10, NULL, NULL, 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(ret, -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+
+	ret = futex(&futex_val, FUTEX_WAKE_BITSET, 1, NULL, NULL, 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(ret, -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EINVAL);
+}
+
+UK_TESTCASE(posix_futex_testsuite, test_wake_bitset)
+{
+	uint32_t i;
+	uint32_t futex_val = 0;
+	uint32_t var_to_change = 0;
+	uint32_t num_threads = 2;
+	__nsec deadline = ukplat_monotonic_clock() + 1000000000;
+	struct timespec tm = {
+		.tv_sec = ukarch_time_nsec_to_sec(deadline),
+		.tv_nsec = ukarch_time_subsec(deadline),
+	};
+
+	struct uk_thread *threads[num_threads];
+	struct test_args args[num_threads];
+	uint32_t var_to_change_vals[num_threads][1];
+	int rets[num_threads][1];
+
+	/* Both waiters wait on the same futex with disjoint masks */
+	for (i = 0; i < num_threads; ++i)
+		args[i] = (struct test_args){
+			.futex_val = &futex_val,
+			.var_to_change = &var_to_change,
+			.var_to_change_vals = var_to_change_vals[i],
+			.rets = rets[i],
+			.val = 0,
+			.bitset = 1 << i,
+			.timeout = &tm,
+		};
+
+	threads[0] = uk_sched_thread_create(uk_sched_current(),
+			bitset_waiter_func, args + 0, "Waiter 1");
+	threads[1] = uk_sched_thread_create(uk_sched_current(),
+			bitset_waiter_func, args + 1, "Waiter 2");
+
+	/* Let the waiters block */
+	uk_sched_yield();
+
+	/* Only the second waiter matches the mask */
+	UK_TEST_EXPECT_SNUM_EQ(futex(&futex_val, FUTEX_WAKE_BITSET, 2, NULL,
+				     NULL, 0x2), 1);
+
+	for (i = 0; i < num_threads; ++i)
+		wait_thread(threads[i]);
+
+	/* Waiter 1 should have timed out */
+	UK_TEST_EXPECT_SNUM_EQ(rets[0][0], -1);
+
+	/* Waiter 2 should have been woken */
+	UK_TEST_EXPECT_SNUM_EQ(rets[1][0], 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(var_to_change, 1);
+}
+
 uk_testsuite_register(posix_futex_testsuite, NULL);
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/sched.h>
+#include <uk/wait.h>
+#include "ktimer.h"
+
+struct uk_mutex ktimer_mtx = UK_MUTEX_INITIALIZER(ktimer_mtx);
+
+/* Armed timers, ordered by expiration time */
+static struct uk_pheap ktimer_queue = UK_PHEAP_INITIALIZER;
+/* Timers with pending notifications */
+static UK_LIST_HEAD(ktimer_notify_list);
+
+static struct uk_thread *ktimer_thread;
+static struct uk_waitq ktimer_wq = __WAIT_QUEUE_INITIALIZER(ktimer_wq);
+/* Set when the earliest expiration changed while the timer thread sleeps */
+static int ktimer_kick;
+
+static int ktimer_less(const struct uk_pheap_node *a,
+		       const struct uk_pheap_node *b)
+{
+	return uk_pheap_entry(a, struct ktimer, node)->expires
+	       < uk_pheap_entry(b, struct ktimer, node)->expires;
+}
+
+static void ktimer_expire_all(__nsec now)
+{
+	struct uk_pheap_node *n;
+	struct ktimer *t;
+	__u64 count;
+
+	while ((n = uk_pheap_min(&ktimer_queue))) {
+		t = uk_pheap_entry(n, struct ktimer, node);
+		if (t->expires > now)
+			break;
+
+		uk_pheap_remove(&ktimer_queue, n, ktimer_less);
+
+		count = 1;
+		if (t->interval) {
+			/* Skip missed periods at once instead of expiring
+			 * the timer for each of them
+			 */
+			count += (now - t->expires) / t->interval;
+			t->expires += count * t->interval;
+			uk_pheap_insert(&ktimer_queue, n, ktimer_less);
+		} else {
+			t->expires = 0;
+		}
+
+		t->expire(t, count);
+	}
+}
+
+static __noreturn void ktimer_thread_fn(void *arg __unused)
+{
+	struct uk_mutex *mtx = &ktimer_mtx;
+	struct uk_pheap_node *n;
+	struct ktimer *t;
+	__nsec next;
+
+	ktimer_lock();
+	for (;;) {
+		ktimer_expire_all(ukplat_monotonic_clock());
+
+		while (!uk_list_empty(&ktimer_notify_list)) {
+			t = uk_list_first_entry(&ktimer_notify_list,
+						struct ktimer, notify_link);
+			uk_list_del_init(&t->notify_link);
+			t->notify(t);
+		}
+
+		n = uk_pheap_min(&ktimer_queue);
+		next = n ? uk_pheap_entry(n, struct ktimer, node)->expires : 0;
+
+		ktimer_kick = 0;
+		uk_waitq_wait_event_deadline_locked(&ktimer_wq, ktimer_kick,
+						    next, uk_mutex_lock,
+						    uk_mutex_unlock, mtx);
+	}
+}
+
+static int ktimer_start(void)
+{
+	ktimer_thread = uk_sched_thread_create(uk_sched_current(),
+					       ktimer_thread_fn, NULL,
+					       "ktimer");
+	if (unlikely(!ktimer_thread)) {
+		uk_pr_err("Failed to create timer thread\n");
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+int ktimer_arm(struct ktimer *t, __nsec expires, __nsec interval)
+{
+	int rc;
+
+	UK_ASSERT(t);
+	UK_ASSERT(uk_mutex_is_locked(&ktimer_mtx));
+
+	if (uk_pheap_linked(&ktimer_queue, &t->node))
+		uk_pheap_remove(&ktimer_queue, &t->node, ktimer_less);
+
+	t->expires = expires;
+	t->interval = expires ? interval : 0;
+	if (!expires)
+		return 0;
+
+	if (unlikely(!ktimer_thread)) {
+		rc = ktimer_start();
+		if (unlikely(rc)) {
+			t->expires = 0;
+			t->interval = 0;
+			return rc;
+		}
+	}
+
+	uk_pheap_insert(&ktimer_queue, &t->node, ktimer_less);
+
+	/* Let the timer thread sleep for a shorter time */
+	if (uk_pheap_min(&ktimer_queue) == &t->node) {
+		ktimer_kick = 1;
+		uk_waitq_wake_up(&ktimer_wq);
+	}
+
+	return 0;
+}
+
+void ktimer_fini(struct ktimer *t)
+{
+	UK_ASSERT(uk_mutex_is_locked(&ktimer_mtx));
+
+	ktimer_disarm(t);
+	uk_list_del_init(&t->notify_link);
+}
+
+void ktimer_notify(struct ktimer *t)
+{
+	UK_ASSERT(t->notify);
+	UK_ASSERT(uk_mutex_is_locked(&ktimer_mtx));
+
+	if (uk_list_empty(&t->notify_link))
+		uk_list_add_tail(&t->notify_link, &ktimer_notify_list);
+}
@@ -0,0 +1,194 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Kernel timers
+ *
+ * All POSIX interval timers, the real-time interval timer, and timerfds are
+ * kept in a single expiry queue that is ordered by expiration time. A timer
+ * thread sleeps until the earliest expiration and processes expired timers,
+ * so that arbitrarily many timers need a single sleeping thread only.
+ *
+ * All timer state is protected by a single (recursive) timer lock.
+ */
+
+#ifndef __POSIX_TIME_KTIMER_H__
+#define __POSIX_TIME_KTIMER_H__
+
+#include <errno.h>
+#include <time.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/list.h>
+#include <uk/pheap.h>
+#include <uk/mutex.h>
+
+struct ktimer;
+
+/**
+ * Called from the timer thread with the timer lock held when the timer
+ * expired. Must not block.
+ *
+ * @param t the expired timer
+ * @param count number of expirations since the last call (> 1 if the timer
+ *    thread could not keep up with a periodic timer)
+ */
+typedef void (*ktimer_expire_fn_t)(struct ktimer *t, __u64 count);
+
+/**
+ * Called from the timer thread for a timer that was queued with
+ * ktimer_notify(). It is entered with the timer lock held and may drop the
+ * lock temporarily (e.g., to run application code). The timer must not be
+ * touched anymore after dropping the lock as it may get released meanwhile.
+ */
+typedef void (*ktimer_notify_fn_t)(struct ktimer *t);
+
+struct ktimer {
+	struct uk_pheap_node node;
+	/* Absolute monotonic expiration time, 0 if the timer is disarmed */
+	__nsec expires;
+	/* Reload interval, 0 for one-shot timers */
+	__nsec interval;
+	ktimer_expire_fn_t expire;
+	ktimer_notify_fn_t notify;
+	struct uk_list_head notify_link;
+};
+
+extern struct uk_mutex ktimer_mtx;
+
+static inline void ktimer_lock(void)
+{
+	uk_mutex_lock(&ktimer_mtx);
+}
+
+static inline void ktimer_unlock(void)
+{
+	uk_mutex_unlock(&ktimer_mtx);
+}
+
+static inline void ktimer_init(struct ktimer *t, ktimer_expire_fn_t expire,
+			       ktimer_notify_fn_t notify)
+{
+	uk_pheap_node_init(&t->node);
+	t->expires = 0;
+	t->interval = 0;
+	t->expire = expire;
+	t->notify = notify;
+	UK_INIT_LIST_HEAD(&t->notify_link);
+}
+
+/**
+ * (Re-)arms a timer. Must be called with the timer lock held.
+ *
+ * @param t the timer
+ * @param expires absolute monotonic expiration time. 0 disarms the timer
+ * @param interval reload interval, 0 for a one-shot timer
+ *
+ * @return 0 on success, a negative errno value otherwise
+ */
+int ktimer_arm(struct ktimer *t, __nsec expires, __nsec interval);
+
+static inline void ktimer_disarm(struct ktimer *t)
+{
+	ktimer_arm(t, 0, 0);
+}
+
+/**
+ * Disarms a timer and drops a pending notification so that the timer can be
+ * released. Must be called with the timer lock held.
+ */
+void ktimer_fini(struct ktimer *t);
+
+/**
+ * Queues a notification for the timer. Must be called with the timer lock
+ * held, typically from the expire callback.
+ */
+void ktimer_notify(struct ktimer *t);
+
+/**
+ * Returns the time until the next expiration of the timer, 0 if it is
+ * disarmed. Must be called with the timer lock held.
+ */
+static inline __nsec ktimer_remaining(const struct ktimer *t)
+{
+	__nsec now;
+
+	if (!t->expires)
+		return 0;
+
+	/* An expired timer that was not processed yet is reported as about
+	 * to expire instead of disarmed
+	 */
+	now = ukplat_monotonic_clock();
+	return (t->expires > now) ? t->expires - now : 1;
+}
+
+/* Helpers for the conversion of POSIX time specifications */
+
+static inline int ktimer_clock_valid(clockid_t clockid)
+{
+	return clockid == CLOCK_REALTIME || clockid == CLOCK_MONOTONIC ||
+	       clockid == CLOCK_BOOTTIME;
+}
+
+static inline int ktimer_ts_valid(const struct timespec *ts)
+{
+	return ts->tv_sec >= 0 && ts->tv_nsec >= 0 &&
+	       ts->tv_nsec < (long) UKARCH_NSEC_PER_SEC;
+}
+
+static inline __nsec ktimer_ts_to_nsec(const struct timespec *ts)
+{
+	return ukarch_time_sec_to_nsec((__nsec) ts->tv_sec) +
+	       (__nsec) ts->tv_nsec;
+}
+
+static inline void ktimer_nsec_to_ts(__nsec nsec, struct timespec *ts)
+{
+	ts->tv_sec = ukarch_time_nsec_to_sec(nsec);
+	ts->tv_nsec = ukarch_time_subsec(nsec);
+}
+
+/**
+ * Converts a timer value to an absolute monotonic expiration time.
+ *
+ * @param clockid the clock that the value refers to
+ * @param value the timer value. A zero value disarms the timer
+ * @param abstime non-zero if the value is absolute time of the given clock
+ * @param[out] expires the monotonic expiration time, 0 to disarm
+ *
+ * @return 0 on success, a negative errno value otherwise
+ */
+static inline int ktimer_expires(clockid_t clockid,
+				 const struct timespec *value,
+				 int abstime, __nsec *expires)
+{
+	__nsec now, t;
+
+	if (unlikely(!ktimer_ts_valid(value)))
+		return -EINVAL;
+
+	t = ktimer_ts_to_nsec(value);
+	if (!t) {
+		*expires = 0;
+		return 0;
+	}
+
+	now = ukplat_monotonic_clock();
+	if (!abstime) {
+		t += now;
+	} else if (clockid == CLOCK_REALTIME) {
+		/* Wall-clock time that has already passed expires now */
+		t -= MIN(t, ukplat_wall_clock() - now);
+		t = MAX(t, now);
+	}
+
+	/* A past deadline must still arm the timer */
+	*expires = MAX(t, (__nsec) 1);
+	return 0;
+}
+
+#endif /* __POSIX_TIME_KTIMER_H__ */
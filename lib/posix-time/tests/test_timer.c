@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <uk/test.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/sched.h>
+#if CONFIG_LIBVFSCORE
+#include <sys/timerfd.h>
+#include <uk/alloc.h>
+#include <vfscore/eventpoll.h>
+#include <vfscore/file.h>
+#endif /* CONFIG_LIBVFSCORE */
+
+#define MSEC(ms)	ukarch_time_msec_to_nsec(ms)
+
+static int test_timer_create(clockid_t clockid, struct sigevent *sev,
+			     timer_t *timerid)
+{
+	return uk_syscall_r_timer_create((long) clockid, (long) sev,
+					 (long) timerid);
+}
+
+static int test_timer_settime(timer_t timerid, int flags, __nsec value,
+			      __nsec interval)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = ukarch_time_nsec_to_sec(value);
+	its.it_value.tv_nsec = ukarch_time_subsec(value);
+	its.it_interval.tv_sec = ukarch_time_nsec_to_sec(interval);
+	its.it_interval.tv_nsec = ukarch_time_subsec(interval);
+	return uk_syscall_r_timer_settime((long) timerid, (long) flags,
+					  (long) &its, (long) NULL);
+}
+
+static __nsec test_timer_remaining(timer_t timerid)
+{
+	struct itimerspec its;
+
+	if (uk_syscall_r_timer_gettime((long) timerid, (long) &its))
+		return (__nsec) -1;
+	return ukarch_time_sec_to_nsec(its.it_value.tv_sec) +
+	       its.it_value.tv_nsec;
+}
+
+UK_TESTCASE(posix_time_timer, sigev_none)
+{
+	struct sigevent sev = { .sigev_notify = SIGEV_NONE };
+	timer_t timerid;
+	__nsec rem;
+
+	UK_TEST_EXPECT_SNUM_EQ(test_timer_create(CLOCK_TAI, &sev, &timerid),
+			       -EINVAL);
+	UK_TEST_ASSERT(test_timer_create(CLOCK_MONOTONIC, &sev,
+					 &timerid) == 0);
+
+	/* A new timer is disarmed */
+	UK_TEST_EXPECT_ZERO(test_timer_remaining(timerid));
+
+	UK_TEST_EXPECT_ZERO(test_timer_settime(timerid, 0, MSEC(50), 0));
+	rem = test_timer_remaining(timerid);
+	UK_TEST_EXPECT(rem > 0 && rem <= MSEC(50));
+
+	/* A one-shot timer is disarmed after it expired */
+	uk_sched_thread_sleep(MSEC(60));
+	UK_TEST_EXPECT_ZERO(test_timer_remaining(timerid));
+
+	/* Absolute time in the past expires immediately */
+	UK_TEST_EXPECT_ZERO(test_timer_settime(timerid, TIMER_ABSTIME, 1, 0));
+	uk_sched_thread_sleep(MSEC(1));
+	UK_TEST_EXPECT_ZERO(test_timer_remaining(timerid));
+
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_timer_delete((long) timerid));
+	UK_TEST_EXPECT_SNUM_EQ(uk_syscall_r_timer_delete((long) timerid),
+			       -EINVAL);
+}
+
+static volatile int test_notified;
+
+static void test_notify(union sigval sv)
+{
+	test_notified += sv.sival_int;
+}
+
+UK_TESTCASE(posix_time_timer, sigev_thread_periodic)
+{
+	struct sigevent sev = {
+		.sigev_notify = SIGEV_THREAD,
+		.sigev_value.sival_int = 1,
+		.sigev_notify_function = test_notify,
+	};
+	timer_t timerid;
+
+	UK_TEST_ASSERT(test_timer_create(CLOCK_MONOTONIC, &sev,
+					 &timerid) == 0);
+
+	test_notified = 0;
+	UK_TEST_EXPECT_ZERO(test_timer_settime(timerid, 0, MSEC(10),
+					       MSEC(10)));
+	uk_sched_thread_sleep(MSEC(55));
+	UK_TEST_EXPECT(test_notified >= 3);
+
+	/* Disarming stops further notifications */
+	UK_TEST_EXPECT_ZERO(test_timer_settime(timerid, 0, 0, 0));
+	test_notified = 0;
+	uk_sched_thread_sleep(MSEC(25));
+	UK_TEST_EXPECT_ZERO(test_notified);
+
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_timer_delete((long) timerid));
+}
+
+#if CONFIG_LIBUKSIGNAL
+static volatile int test_alarms;
+
+static void test_sigalrm(int sig)
+{
+	if (sig == SIGALRM)
+		test_alarms++;
+}
+
+UK_TESTCASE(posix_time_timer, setitimer_sigalrm)
+{
+	struct sigaction act = { .sa_handler = test_sigalrm };
+	struct sigaction oldact;
+	struct itimerval itv = {
+		.it_value = { .tv_sec = 0, .tv_usec = 10000 },
+		.it_interval = { .tv_sec = 0, .tv_usec = 10000 },
+	};
+	struct itimerval cur;
+
+	UK_TEST_ASSERT(uk_syscall_r_rt_sigaction((long) SIGALRM, (long) &act,
+						 (long) &oldact,
+						 (long) sizeof(sigset_t)) == 0);
+
+	test_alarms = 0;
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_setitimer((long) ITIMER_REAL,
+						   (long) &itv, (long) NULL));
+	uk_sched_thread_sleep(MSEC(35));
+	UK_TEST_EXPECT(test_alarms >= 2);
+
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_getitimer((long) ITIMER_REAL,
+						   (long) &cur));
+	UK_TEST_EXPECT_SNUM_EQ(cur.it_interval.tv_usec, 10000);
+
+	itv.it_value.tv_usec = 0;
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_setitimer((long) ITIMER_REAL,
+						   (long) &itv, (long) NULL));
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_getitimer((long) ITIMER_REAL,
+						   (long) &cur));
+	UK_TEST_EXPECT_ZERO(cur.it_value.tv_sec + cur.it_value.tv_usec);
+
+	/* Only the real-time timer is supported */
+	UK_TEST_EXPECT_SNUM_EQ(uk_syscall_r_setitimer((long) ITIMER_VIRTUAL,
+						      (long) &itv, (long) NULL),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(uk_syscall_r_getitimer((long) ITIMER_VIRTUAL,
+						      (long) &cur),
+			       -EINVAL);
+
+	uk_syscall_r_rt_sigaction((long) SIGALRM, (long) &oldact, (long) NULL,
+				  (long) sizeof(sigset_t));
+}
+#endif /* CONFIG_LIBUKSIGNAL */
+
+#if CONFIG_LIBVFSCORE
+static int test_timerfd_settime(int fd, int flags, __nsec value,
+				__nsec interval)
+{
+	struct itimerspec its;
+
+	its.it_value.tv_sec = ukarch_time_nsec_to_sec(value);
+	its.it_value.tv_nsec = ukarch_time_subsec(value);
+	its.it_interval.tv_sec = ukarch_time_nsec_to_sec(interval);
+	its.it_interval.tv_nsec = ukarch_time_subsec(interval);
+	return uk_syscall_r_timerfd_settime((long) fd, (long) flags, (long) &its,
+					    (long) NULL);
+}
+
+UK_TESTCASE(posix_time_timer, timerfd_read)
+{
+	__u64 ticks;
+	int fd;
+
+	fd = uk_syscall_r_timerfd_create((long) CLOCK_MONOTONIC,
+					 (long) TFD_NONBLOCK);
+	UK_TEST_ASSERT(fd >= 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, EAGAIN);
+	UK_TEST_EXPECT_SNUM_EQ(write(fd, &ticks, sizeof(ticks)), -1);
+
+	/* Missed expirations of a periodic timer are accumulated */
+	UK_TEST_EXPECT_ZERO(test_timerfd_settime(fd, 0, MSEC(5), MSEC(5)));
+	uk_sched_thread_sleep(MSEC(27));
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)), sizeof(ticks));
+	UK_TEST_EXPECT(ticks >= 4);
+
+	/* Re-arming resets the expiration count */
+	UK_TEST_EXPECT_ZERO(test_timerfd_settime(fd, 0, MSEC(100), 0));
+	UK_TEST_EXPECT_SNUM_EQ(read(fd, &ticks, sizeof(ticks)), -1);
+
+	close(fd);
+}
+
+/* Benchmark: Many one-shot timerfds with distinct expiration times are
+ * multiplexed on a single eventpoll. We report the time from the expected
+ * expiration until a thread waiting on the eventpoll received the event.
+ */
+#define BENCH_TIMERS	512
+#define BENCH_SPACING	(MSEC(1) / 8)
+
+UK_TESTCASE(posix_time_timer, bench_timerfd_eventpoll)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct epoll_event ev, events[16];
+	struct vfscore_file *fp;
+	struct eventpoll *ep;
+	__nsec start, now, due, lat, lat_max = 0, lat_sum = 0;
+	unsigned int fired = 0;
+	int *fds;
+	int i, n, rc;
+
+	ep = uk_malloc(a, sizeof(*ep));
+	fds = uk_calloc(a, BENCH_TIMERS, sizeof(*fds));
+	UK_TEST_ASSERT(ep != NULL && fds != NULL);
+	eventpoll_init(ep, a);
+
+	for (i = 0; i < BENCH_TIMERS; ++i) {
+		fds[i] = uk_syscall_r_timerfd_create((long) CLOCK_MONOTONIC,
+						     (long) TFD_NONBLOCK);
+		if (fds[i] < 0)
+			break;
+
+		fp = vfscore_get_file(fds[i]);
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		rc = eventpoll_add(ep, fds[i], fp, &ev);
+		fdrop(fp);
+		if (rc)
+			break;
+	}
+	UK_TEST_EXPECT_SNUM_EQ(i, BENCH_TIMERS);
+	n = i;
+
+	/* Arm in reverse order to exercise the expiry queue ordering */
+	start = ukplat_monotonic_clock() + MSEC(10);
+	for (i = n - 1; i >= 0; --i)
+		test_timerfd_settime(fds[i], TFD_TIMER_ABSTIME,
+				     start + i * BENCH_SPACING, 0);
+
+	while (fired < (unsigned int) n) {
+		rc = eventpoll_wait(ep, events, ARRAY_SIZE(events), NULL);
+		now = ukplat_monotonic_clock();
+		for (i = 0; i < rc; ++i) {
+			due = start + events[i].data.u32 * BENCH_SPACING;
+			lat = (now > due) ? now - due : 0;
+			lat_sum += lat;
+			lat_max = MAX(lat_max, lat);
+			fired++;
+		}
+	}
+
+	uk_test_printf("%d timerfds on one eventpoll: avg latency %"__PRInsec
+		       " ns, max %"__PRInsec" ns\n", n,
+		       n ? lat_sum / n : 0, lat_max);
+
+	eventpoll_fini(ep);
+	for (i = 0; i < n; ++i)
+		close(fds[i]);
+	uk_free(a, fds);
+	uk_free(a, ep);
+}
+#endif /* CONFIG_LIBVFSCORE */
+
+uk_testsuite_register(posix_time_timer, NULL);
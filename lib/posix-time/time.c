@@ -211,11 +211,3 @@ UK_SYSCALL_R_DEFINE(int, times, struct tm *, buf)
 {
 	return -ENOTSUP;
 }
-
-UK_SYSCALL_R_DEFINE(int, setitimer, int, which,
-		    const struct itimerval *, new_value,
-		    struct itimerval *, old_value)
-{
-	UK_WARN_STUBBED();
-	return 0;
-}
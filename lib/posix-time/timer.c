@@ -31,11 +31,386 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <signal.h>
 #include <time.h>
+#include <sys/time.h>
+#include <uk/config.h>
 #include <uk/essentials.h>
 #include <uk/print.h>
 #include <uk/syscall.h>
 
+#if CONFIG_LIBPOSIX_TIME_TIMERS
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#if CONFIG_LIBUKSIGNAL
+#include <uk/signal.h>
+#endif /* CONFIG_LIBUKSIGNAL */
+#include "ktimer.h"
+
+struct posix_timer {
+	struct ktimer kt;
+	int id;
+	clockid_t clockid;
+	struct sigevent sev;
+	/* Expirations since the notification was queued, excluding the first */
+	__u64 overrun;
+	/* Overrun count of the last notification (see timer_getoverrun()) */
+	int overrun_last;
+};
+
+static struct posix_timer *posix_timers[CONFIG_LIBPOSIX_TIME_TIMER_MAX];
+
+/* Timer of setitimer(ITIMER_REAL, ...) */
+static struct posix_timer itimer_real = {
+	.id = -1,
+	.clockid = CLOCK_REALTIME,
+	.sev = {
+		.sigev_notify = SIGEV_SIGNAL,
+		.sigev_signo = SIGALRM,
+	},
+};
+
+static void posix_timer_expire(struct ktimer *kt, __u64 count)
+{
+	struct posix_timer *pt = __containerof(kt, struct posix_timer, kt);
+
+	if (pt->sev.sigev_notify == SIGEV_NONE)
+		return;
+
+	/* Like signals, notifications are not queued more than once. Further
+	 * expirations are accounted as overruns.
+	 */
+	if (!uk_list_empty(&kt->notify_link)) {
+		pt->overrun += count;
+		return;
+	}
+
+	pt->overrun = count - 1;
+	ktimer_notify(kt);
+}
+
+static void posix_timer_notify(struct ktimer *kt)
+{
+	struct posix_timer *pt = __containerof(kt, struct posix_timer, kt);
+	struct sigevent sev = pt->sev;
+	siginfo_t si = { 0 };
+
+	pt->overrun_last = (int) MIN(pt->overrun, (__u64) INT_MAX);
+	pt->overrun = 0;
+
+	si.si_signo = sev.sigev_signo;
+	si.si_code = SI_TIMER;
+	si.si_timerid = pt->id;
+	si.si_overrun = pt->overrun_last;
+	si.si_value = sev.sigev_value;
+
+	/* The timer may be deleted while we run application code */
+	ktimer_unlock();
+
+	if (sev.sigev_notify == SIGEV_THREAD) {
+		/* We do not spawn a thread per expiration but call the
+		 * function from the timer thread
+		 */
+		sev.sigev_notify_function(sev.sigev_value);
+	} else {
+#if CONFIG_LIBUKSIGNAL
+		uk_signal_raise(sev.sigev_signo, &si);
+#endif /* CONFIG_LIBUKSIGNAL */
+	}
+
+	ktimer_lock();
+}
+
+static int posix_timer_sev_check(const struct sigevent *sev)
+{
+	switch (sev->sigev_notify) {
+	case SIGEV_NONE:
+		return 0;
+	case SIGEV_SIGNAL:
+	case SIGEV_THREAD_ID:
+#if CONFIG_LIBUKSIGNAL
+		if (unlikely(sev->sigev_signo <= 0 || sev->sigev_signo >= NSIG))
+			return -EINVAL;
+		return 0;
+#else /* !CONFIG_LIBUKSIGNAL */
+		return -ENOTSUP;
+#endif /* !CONFIG_LIBUKSIGNAL */
+	case SIGEV_THREAD:
+		if (unlikely(!sev->sigev_notify_function))
+			return -EINVAL;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Must be called with the timer lock held */
+static struct posix_timer *posix_timer_get(timer_t timerid)
+{
+	__uptr id = (__uptr) timerid;
+
+	if (unlikely(id >= ARRAY_SIZE(posix_timers)))
+		return NULL;
+	return posix_timers[id];
+}
+
+static void posix_timer_get_value(struct posix_timer *pt,
+				  struct itimerspec *value)
+{
+	ktimer_nsec_to_ts(ktimer_remaining(&pt->kt), &value->it_value);
+	ktimer_nsec_to_ts(pt->kt.interval, &value->it_interval);
+}
+
+static int posix_timer_set_value(struct posix_timer *pt, int abstime,
+				 const struct itimerspec *new_value,
+				 struct itimerspec *old_value)
+{
+	__nsec expires;
+	int rc;
+
+	if (unlikely(!ktimer_ts_valid(&new_value->it_interval)))
+		return -EINVAL;
+	rc = ktimer_expires(pt->clockid, &new_value->it_value, abstime,
+			    &expires);
+	if (unlikely(rc))
+		return rc;
+
+	if (old_value)
+		posix_timer_get_value(pt, old_value);
+
+	return ktimer_arm(&pt->kt, expires,
+			  ktimer_ts_to_nsec(&new_value->it_interval));
+}
+
+UK_SYSCALL_R_DEFINE(int, timer_create, clockid_t, clockid,
+		    struct sigevent *__restrict, sevp,
+		    timer_t *__restrict, timerid)
+{
+	struct posix_timer *pt;
+	unsigned int id;
+	int rc;
+
+	if (unlikely(!timerid))
+		return -EFAULT;
+	if (unlikely(!ktimer_clock_valid(clockid)))
+		return -EINVAL;
+	if (sevp) {
+		rc = posix_timer_sev_check(sevp);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	pt = uk_zalloc(uk_alloc_get_default(), sizeof(*pt));
+	if (unlikely(!pt))
+		return -ENOMEM;
+
+	ktimer_init(&pt->kt, posix_timer_expire, posix_timer_notify);
+	pt->clockid = clockid;
+
+	ktimer_lock();
+	for (id = 0; id < ARRAY_SIZE(posix_timers); id++)
+		if (!posix_timers[id])
+			break;
+	if (unlikely(id == ARRAY_SIZE(posix_timers))) {
+		ktimer_unlock();
+		uk_free(uk_alloc_get_default(), pt);
+		return -EAGAIN;
+	}
+
+	pt->id = id;
+	if (sevp) {
+		pt->sev = *sevp;
+	} else {
+		/* Default: SIGALRM with the timer ID as value */
+		pt->sev.sigev_notify = SIGEV_SIGNAL;
+		pt->sev.sigev_signo = SIGALRM;
+		pt->sev.sigev_value.sival_int = id;
+#if !CONFIG_LIBUKSIGNAL
+		pt->sev.sigev_notify = SIGEV_NONE;
+#endif /* !CONFIG_LIBUKSIGNAL */
+	}
+
+	posix_timers[id] = pt;
+	ktimer_unlock();
+
+	*timerid = (timer_t) (__uptr) id;
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, timer_delete,
+		    timer_t, timerid)
+{
+	struct posix_timer *pt;
+
+	ktimer_lock();
+	pt = posix_timer_get(timerid);
+	if (unlikely(!pt)) {
+		ktimer_unlock();
+		return -EINVAL;
+	}
+
+	posix_timers[pt->id] = NULL;
+	ktimer_fini(&pt->kt);
+	ktimer_unlock();
+
+	uk_free(uk_alloc_get_default(), pt);
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, timer_settime,
+		    timer_t, timerid,
+		    int, flags,
+		    const struct itimerspec *__restrict, new_value,
+		    struct itimerspec *__restrict, old_value)
+{
+	struct posix_timer *pt;
+	int rc;
+
+	if (unlikely(!new_value))
+		return -EFAULT;
+	if (unlikely(flags & ~TIMER_ABSTIME))
+		return -EINVAL;
+
+	ktimer_lock();
+	pt = posix_timer_get(timerid);
+	if (unlikely(!pt)) {
+		ktimer_unlock();
+		return -EINVAL;
+	}
+
+	rc = posix_timer_set_value(pt, flags & TIMER_ABSTIME, new_value,
+				   old_value);
+	ktimer_unlock();
+
+	return rc;
+}
+
+UK_SYSCALL_R_DEFINE(int, timer_gettime,
+		    timer_t, timerid,
+		    struct itimerspec *, curr_value)
+{
+	struct posix_timer *pt;
+
+	if (unlikely(!curr_value))
+		return -EFAULT;
+
+	ktimer_lock();
+	pt = posix_timer_get(timerid);
+	if (unlikely(!pt)) {
+		ktimer_unlock();
+		return -EINVAL;
+	}
+
+	posix_timer_get_value(pt, curr_value);
+	ktimer_unlock();
+
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, timer_getoverrun,
+		    timer_t, timerid)
+{
+	struct posix_timer *pt;
+	int overrun;
+
+	ktimer_lock();
+	pt = posix_timer_get(timerid);
+	if (unlikely(!pt)) {
+		ktimer_unlock();
+		return -EINVAL;
+	}
+
+	overrun = pt->overrun_last;
+	ktimer_unlock();
+
+	return overrun;
+}
+
+static void itimer_to_spec(const struct itimerval *val, struct itimerspec *spec)
+{
+	spec->it_value.tv_sec = val->it_value.tv_sec;
+	spec->it_value.tv_nsec = val->it_value.tv_usec * 1000;
+	spec->it_interval.tv_sec = val->it_interval.tv_sec;
+	spec->it_interval.tv_nsec = val->it_interval.tv_usec * 1000;
+}
+
+static void itimer_from_spec(const struct itimerspec *spec,
+			     struct itimerval *val)
+{
+	/* Round up so that an armed timer is never reported as disarmed */
+	val->it_value.tv_sec = spec->it_value.tv_sec;
+	val->it_value.tv_usec = (spec->it_value.tv_nsec + 999) / 1000;
+	if (val->it_value.tv_usec == 1000000) {
+		val->it_value.tv_sec++;
+		val->it_value.tv_usec = 0;
+	}
+	val->it_interval.tv_sec = spec->it_interval.tv_sec;
+	val->it_interval.tv_usec = spec->it_interval.tv_nsec / 1000;
+}
+
+static void itimer_real_init(void)
+{
+	if (!itimer_real.kt.expire)
+		ktimer_init(&itimer_real.kt, posix_timer_expire,
+			    posix_timer_notify);
+}
+
+UK_SYSCALL_R_DEFINE(int, getitimer, int, which,
+		    struct itimerval *, curr_value)
+{
+	struct itimerspec spec;
+
+	if (unlikely(!curr_value))
+		return -EFAULT;
+	if (unlikely(which != ITIMER_REAL)) {
+		/* There is no accounting of CPU time */
+		return -EINVAL;
+	}
+
+	ktimer_lock();
+	itimer_real_init();
+	posix_timer_get_value(&itimer_real, &spec);
+	ktimer_unlock();
+
+	itimer_from_spec(&spec, curr_value);
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, setitimer, int, which,
+		    const struct itimerval *, new_value,
+		    struct itimerval *, old_value)
+{
+	struct itimerspec new_spec, old_spec;
+	int rc;
+
+	if (unlikely(!new_value))
+		return -EFAULT;
+	if (unlikely(which != ITIMER_REAL)) {
+		/* There is no accounting of CPU time */
+		return -EINVAL;
+	}
+	if (unlikely(new_value->it_value.tv_usec < 0 ||
+		     new_value->it_value.tv_usec >= 1000000 ||
+		     new_value->it_interval.tv_usec < 0 ||
+		     new_value->it_interval.tv_usec >= 1000000))
+		return -EINVAL;
+
+	itimer_to_spec(new_value, &new_spec);
+
+	ktimer_lock();
+	itimer_real_init();
+	rc = posix_timer_set_value(&itimer_real, 0, &new_spec, &old_spec);
+	ktimer_unlock();
+	if (unlikely(rc))
+		return rc;
+
+	if (old_value)
+		itimer_from_spec(&old_spec, old_value);
+	return 0;
+}
+
+#else /* !CONFIG_LIBPOSIX_TIME_TIMERS */
 
 UK_SYSCALL_R_DEFINE(int, timer_create, clockid_t, clockid,
 		    struct sigevent *__restrict, sevp,
@@ -76,3 +451,25 @@ UK_SYSCALL_R_DEFINE(int, timer_getoverrun,
 	UK_WARN_STUBBED();
 	return -ENOTSUP;
 }
+
+/* Interval timers are reported as disarmed */
+UK_SYSCALL_R_DEFINE(int, getitimer, int, which,
+		    struct itimerval *, curr_value)
+{
+	UK_WARN_STUBBED();
+	if (curr_value)
+		*curr_value = (struct itimerval){ 0 };
+	return 0;
+}
+
+UK_SYSCALL_R_DEFINE(int, setitimer, int, which,
+		    const struct itimerval *, new_value,
+		    struct itimerval *, old_value)
+{
+	UK_WARN_STUBBED();
+	if (old_value)
+		*old_value = (struct itimerval){ 0 };
+	return 0;
+}
+
+#endif /* !CONFIG_LIBPOSIX_TIME_TIMERS */
@@ -0,0 +1,375 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <vfscore/eventpoll.h>
+#include <vfscore/fs.h>
+#include <vfscore/file.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+#include <vfscore/mount.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/errptr.h>
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/wait.h>
+#include <uk/list.h>
+
+#include <sys/timerfd.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "ktimer.h"
+
+/* All state of a timerfd is protected by the timer lock */
+struct timerfd {
+	struct ktimer kt;
+	clockid_t clockid;
+	/** Expirations since the last read */
+	uint64_t ticks;
+	/** Wait queue for blocked readers (i.e., no expirations) */
+	struct uk_waitq wq;
+	/** List of registered eventpolls */
+	struct uk_list_head ep_list;
+};
+
+static uint64_t t_inode;
+
+static void timerfd_expire(struct ktimer *kt, __u64 count)
+{
+	struct timerfd *tfd = __containerof(kt, struct timerfd, kt);
+
+	if (!tfd->ticks) {
+		uk_waitq_wake_up(&tfd->wq);
+		eventpoll_signal_list(&tfd->ep_list, EPOLLIN);
+	}
+	tfd->ticks += count;
+}
+
+static struct timerfd *timerfd_get(int fd, struct vfscore_file **fpp)
+{
+	struct vfscore_file *fp;
+	struct vnode *vnode;
+
+	fp = vfscore_get_file(fd);
+	if (unlikely(!fp))
+		return ERR2PTR(-EBADF);
+
+	vnode = fp->f_dentry->d_vnode;
+	if (unlikely(vnode->v_type != VTIMER)) {
+		fdrop(fp);
+		return ERR2PTR(-EINVAL);
+	}
+
+	*fpp = fp;
+	return (struct timerfd *) vnode->v_data;
+}
+
+static int timerfd_vfscore_close(struct vnode *vnode,
+				 struct vfscore_file *fp __unused)
+{
+	struct timerfd *tfd;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VTIMER);
+
+	tfd = (struct timerfd *) vnode->v_data;
+
+	ktimer_lock();
+	ktimer_fini(&tfd->kt);
+	ktimer_unlock();
+
+	uk_free(uk_alloc_get_default(), tfd);
+
+	vnode->v_data = NULL;
+	return 0;
+}
+
+static int timerfd_vfscore_read(struct vnode *vnode,
+				struct vfscore_file *fp,
+				struct uio *buf, int ioflag __unused)
+{
+	struct timerfd *tfd = (struct timerfd *) vnode->v_data;
+	struct uk_mutex *mtx = &ktimer_mtx;
+	uint64_t *val;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VTIMER);
+
+	if (unlikely(buf->uio_iovcnt != 1))
+		return EINVAL;
+
+	if (unlikely(!buf->uio_iov[0].iov_base))
+		return EINVAL;
+
+	if (unlikely(buf->uio_iov[0].iov_len < sizeof(uint64_t)))
+		return EINVAL;
+
+	val = (uint64_t *) buf->uio_iov[0].iov_base;
+
+	ktimer_lock();
+
+	if (!tfd->ticks && (fp->f_flags & O_NONBLOCK)) {
+		ktimer_unlock();
+		return EAGAIN;
+	}
+
+	uk_waitq_wait_event_locked(&tfd->wq, tfd->ticks > 0,
+				   uk_mutex_lock, uk_mutex_unlock, mtx);
+
+	*val = tfd->ticks;
+	tfd->ticks = 0;
+
+	ktimer_unlock();
+
+	buf->uio_resid -= sizeof(uint64_t);
+	buf->uio_offset += sizeof(uint64_t);
+
+	return 0;
+}
+
+static void timerfd_unregister_eventpoll(struct eventpoll_cb *ecb)
+{
+	UK_ASSERT(ecb);
+
+	ktimer_lock();
+	UK_ASSERT(!uk_list_empty(&ecb->cb_link));
+	uk_list_del(&ecb->cb_link);
+
+	ecb->data = NULL;
+	ecb->unregister = NULL;
+	ktimer_unlock();
+}
+
+static int timerfd_vfscore_poll(struct vnode *vnode, unsigned int *revents,
+				struct eventpoll_cb *ecb)
+{
+	struct timerfd *tfd = (struct timerfd *) vnode->v_data;
+
+	UK_ASSERT(vnode->v_data);
+	UK_ASSERT(vnode->v_type == VTIMER);
+
+	ktimer_lock();
+
+	if (!ecb->unregister) {
+		UK_ASSERT(uk_list_empty(&ecb->cb_link));
+		UK_ASSERT(!ecb->data);
+
+		/* This is the first time we see this cb. Add it to the
+		 * eventpoll list and set the unregister callback so
+		 * we remove it when the eventpoll is freed.
+		 */
+		uk_list_add_tail(&ecb->cb_link, &tfd->ep_list);
+
+		ecb->data = tfd;
+		ecb->unregister = timerfd_unregister_eventpoll;
+	}
+
+	*revents = tfd->ticks ? EPOLLIN : 0;
+
+	ktimer_unlock();
+
+	return 0;
+}
+
+/* vnode operations */
+#define timerfd_vfscore_inactive ((vnop_inactive_t) vfscore_vop_einval)
+#define timerfd_vfscore_write ((vnop_write_t) vfscore_vop_einval)
+#define timerfd_vfscore_ioctl ((vnop_ioctl_t) vfscore_vop_einval)
+
+static struct vnops timerfd_vnops = {
+	.vop_close = timerfd_vfscore_close,
+	.vop_inactive = timerfd_vfscore_inactive,
+	.vop_read = timerfd_vfscore_read,
+	.vop_write = timerfd_vfscore_write,
+	.vop_poll = timerfd_vfscore_poll,
+	.vop_ioctl = timerfd_vfscore_ioctl
+};
+
+/* file system operations */
+#define timerfd_vget ((vfsop_vget_t) vfscore_nullop)
+
+static struct vfsops timerfd_vfsops = {
+	.vfs_vget = timerfd_vget,
+	.vfs_vnops = &timerfd_vnops
+};
+
+/* bogus mount point used by all timerfd fds */
+static struct mount timerfd_mount = {
+	.m_op = &timerfd_vfsops
+};
+
+UK_SYSCALL_R_DEFINE(int, timerfd_create, int, clockid, int, flags)
+{
+	struct uk_alloc *a = uk_alloc_get_default();
+	int vfs_fd, ret;
+	struct timerfd *tfd;
+	struct vfscore_file *vfs_file;
+	struct dentry *vfs_dentry;
+	struct vnode *vfs_vnode;
+	uint64_t ino;
+
+	if (unlikely(!ktimer_clock_valid(clockid)))
+		return -EINVAL;
+
+	if (unlikely(flags & ~(TFD_CLOEXEC | TFD_NONBLOCK)))
+		return -EINVAL;
+
+	/* Reserve a file descriptor number */
+	vfs_fd = vfscore_alloc_fd();
+	if (unlikely(vfs_fd < 0)) {
+		ret = -ENFILE;
+		goto ERR_EXIT;
+	}
+
+	/* Allocate file, vfs_file, and vnode */
+	tfd = uk_malloc(a, sizeof(struct timerfd));
+	if (unlikely(!tfd)) {
+		ret = -ENOMEM;
+		goto ERR_MALLOC_FILE;
+	}
+
+	vfs_file = uk_malloc(a, sizeof(struct vfscore_file));
+	if (unlikely(!vfs_file)) {
+		ret = -ENOMEM;
+		goto ERR_MALLOC_VFS_FILE;
+	}
+
+	ktimer_lock();
+	ino = t_inode++;
+	ktimer_unlock();
+
+	ret = vfscore_vget(&timerfd_mount, ino, &vfs_vnode);
+	UK_ASSERT(ret == 0); /* we should not find it in the cache */
+	if (unlikely(!vfs_vnode)) {
+		ret = -ENOMEM;
+		goto ERR_ALLOC_VNODE;
+	}
+
+	/* It doesn't matter that all the dentries have the same path since
+	 * we never look them up.
+	 */
+	vfs_dentry = dentry_alloc(NULL, vfs_vnode, "/");
+	if (unlikely(!vfs_dentry)) {
+		ret = -ENOMEM;
+		goto ERR_ALLOC_DENTRY;
+	}
+
+	/* Initialize data structures */
+	vfs_file->fd = vfs_fd;
+	vfs_file->f_flags = UK_FREAD;
+	vfs_file->f_count = 1;
+	vfs_file->f_data = tfd;
+	vfs_file->f_dentry = vfs_dentry;
+	vfs_file->f_vfs_flags = UK_VFSCORE_NOPOS;
+	vfs_file->f_offset = 0;
+
+	uk_mutex_init(&vfs_file->f_lock);
+	UK_INIT_LIST_HEAD(&vfs_file->f_ep);
+
+	vfs_vnode->v_data = tfd;
+	vfs_vnode->v_type = VTIMER;
+
+	ktimer_init(&tfd->kt, timerfd_expire, NULL);
+	tfd->clockid = clockid;
+	tfd->ticks = 0;
+	uk_waitq_init(&tfd->wq);
+	UK_INIT_LIST_HEAD(&tfd->ep_list);
+
+	/* Store within the vfs structure */
+	ret = vfscore_install_fd(vfs_fd, vfs_file);
+	if (unlikely(ret))
+		goto ERR_VFS_INSTALL;
+
+	/* Only the dentry should hold a reference; release ours */
+	vput(vfs_vnode);
+
+	if (flags & TFD_NONBLOCK) {
+		ret = fcntl(vfs_fd, F_SETFL, O_NONBLOCK);
+		/* Setting the O_NONBLOCK here must not fail */
+		UK_ASSERT(ret != -1);
+	}
+
+	return vfs_fd;
+
+ERR_VFS_INSTALL:
+	drele(vfs_dentry);
+ERR_ALLOC_DENTRY:
+	vput(vfs_vnode);
+ERR_ALLOC_VNODE:
+	uk_free(a, vfs_file);
+ERR_MALLOC_VFS_FILE:
+	uk_free(a, tfd);
+ERR_MALLOC_FILE:
+	vfscore_put_fd(vfs_fd);
+ERR_EXIT:
+	UK_ASSERT(ret < 0);
+	return ret;
+}
+
+UK_SYSCALL_R_DEFINE(int, timerfd_settime, int, fd, int, flags,
+		    const struct itimerspec *, new_value,
+		    struct itimerspec *, old_value)
+{
+	struct vfscore_file *fp;
+	struct timerfd *tfd;
+	__nsec expires;
+	int rc;
+
+	if (unlikely(!new_value))
+		return -EFAULT;
+	if (unlikely(flags & ~(TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET)))
+		return -EINVAL;
+	if (unlikely(!ktimer_ts_valid(&new_value->it_interval)))
+		return -EINVAL;
+
+	tfd = timerfd_get(fd, &fp);
+	if (unlikely(PTRISERR(tfd)))
+		return PTR2ERR(tfd);
+
+	/* The wall clock is never set, so there is nothing to cancel on */
+	rc = ktimer_expires(tfd->clockid, &new_value->it_value,
+			    flags & TFD_TIMER_ABSTIME, &expires);
+	if (unlikely(rc))
+		goto out;
+
+	ktimer_lock();
+	if (old_value) {
+		ktimer_nsec_to_ts(ktimer_remaining(&tfd->kt),
+				  &old_value->it_value);
+		ktimer_nsec_to_ts(tfd->kt.interval, &old_value->it_interval);
+	}
+
+	tfd->ticks = 0;
+	rc = ktimer_arm(&tfd->kt, expires,
+			ktimer_ts_to_nsec(&new_value->it_interval));
+	ktimer_unlock();
+
+out:
+	fdrop(fp);
+	return rc;
+}
+
+UK_SYSCALL_R_DEFINE(int, timerfd_gettime, int, fd,
+		    struct itimerspec *, curr_value)
+{
+	struct vfscore_file *fp;
+	struct timerfd *tfd;
+
+	if (unlikely(!curr_value))
+		return -EFAULT;
+
+	tfd = timerfd_get(fd, &fp);
+	if (unlikely(PTRISERR(tfd)))
+		return PTR2ERR(tfd);
+
+	ktimer_lock();
+	ktimer_nsec_to_ts(ktimer_remaining(&tfd->kt), &curr_value->it_value);
+	ktimer_nsec_to_ts(tfd->kt.interval, &curr_value->it_interval);
+	ktimer_unlock();
+
+	fdrop(fp);
+	return 0;
+}
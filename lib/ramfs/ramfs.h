@@ -58,10 +58,21 @@ struct ramfs_node {
 	size_t rn_namelen;
 	/* Size of the file */
 	size_t rn_size;
-	/* Buffer to the file data */
+	/*
+	 * Root of the radix tree of file data pages (regular files). Holes
+	 * in sparse files are not backed by pages.
+	 */
+	void *rn_pages;
+	/* Height of the radix tree, 0 if the tree is empty */
+	unsigned int rn_height;
+	/*
+	 * Last radix tree leaf that was looked up and the index of its first
+	 * page. Sequential accesses find the page without walking the tree.
+	 */
+	void *rn_hint;
+	unsigned long rn_hint_idx;
+	/* Target of the symbolic link (symbolic links) */
 	char *rn_buf;
-	/* Size of the allocated buffer */
-	size_t rn_bufsize;
 	/* Last change time */
 	struct timespec rn_ctime;
 	/* Last access time */
@@ -70,8 +81,10 @@ struct ramfs_node {
 	struct timespec rn_mtime;
 	/* Node access mode */
 	int rn_mode;
-	/* Whether the rn_buf was allocated in this ramfs_node */
-	bool rn_owns_buf;
+	/* Number of mapping references to the file pages */
+	unsigned int rn_mapcount;
+	/* Whether the node was removed while its pages were mapped */
+	bool rn_removed;
 };
 
 /**
@@ -95,6 +108,36 @@ struct ramfs_node *ramfs_allocate_node(const char *name, int type);
  */
 void ramfs_free_node(struct ramfs_node *node);
 
+/**
+ * Looks up the page that holds the file data at the given page index.
+ *
+ * @param np
+ *   Pointer to the ramfs_node of a regular file
+ * @param idx
+ *   Index of the page within the file
+ * @param alloc
+ *   Allocate a zeroed page if the index is a hole in the file
+ * @return
+ *   Pointer to the page, or NULL if the index is a hole and alloc is 0 or
+ *   if the page could not be allocated
+ */
+void *ramfs_page_get(struct ramfs_node *np, unsigned long idx, int alloc);
+
+/**
+ * Releases the pages of a file within a range of page indices.
+ *
+ * @param np
+ *   Pointer to the ramfs_node of a regular file
+ * @param first
+ *   Index of the first page to release
+ * @param last
+ *   Index of the last page to release (inclusive)
+ * @param keep
+ *   Zero the pages instead of freeing them (e.g., because they are mapped)
+ */
+void ramfs_pages_release(struct ramfs_node *np, unsigned long first,
+			 unsigned long last, int keep);
+
 /**
  * Transforms a vnode into a ramfs_node.
  *
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * ramfs_pages.c - page storage for file data of the RAM file system.
+ *
+ * The data of a regular file is kept in page-sized pages that are indexed
+ * by a radix tree. Each tree node is a page of RAMFS_RADIX_SLOTS pointers to
+ * either the nodes of the next lower level or, in the leaves, the data pages.
+ * The tree grows at the top when a page is added beyond the range covered
+ * by the current height, so that existing nodes are never moved. Missing
+ * pages represent holes that read as zeros.
+ *
+ * With paging, pages are taken from the frame allocator and accessed via the
+ * direct map. They are thus not part of any on-demand paged memory area and
+ * keep their physical address as long as they are allocated, which allows
+ * mapping them into address spaces.
+ */
+
+#include <string.h>
+#include <uk/config.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/arch/limits.h>
+#ifdef CONFIG_PAGING
+#include <uk/falloc.h>
+#include <uk/plat/io.h>
+#include <uk/plat/paging.h>
+#else /* CONFIG_PAGING */
+#include <uk/alloc.h>
+#endif /* !CONFIG_PAGING */
+#include <vfscore/vnode.h>
+
+#include "ramfs.h"
+
+#define RAMFS_RADIX_SHIFT	9
+#define RAMFS_RADIX_SLOTS	(1UL << RAMFS_RADIX_SHIFT)
+#define RAMFS_RADIX_MASK	(RAMFS_RADIX_SLOTS - 1)
+
+struct ramfs_radix {
+	void *slots[RAMFS_RADIX_SLOTS];
+};
+
+UK_CTASSERT(sizeof(struct ramfs_radix) <= PAGE_SIZE);
+
+static void *ramfs_page_alloc(void)
+{
+	void *page;
+#ifdef CONFIG_PAGING
+	struct uk_pagetable *pt = ukplat_pt_get_active();
+	__paddr_t paddr;
+	__vaddr_t vaddr;
+
+	paddr = uk_falloc(pt->fa, 1);
+	if (unlikely(paddr == __PADDR_INV))
+		return NULL;
+
+	vaddr = ukplat_page_kmap(pt, paddr, 1, 0);
+	if (unlikely(vaddr == __VADDR_INV)) {
+		uk_ffree(pt->fa, paddr, 1);
+		return NULL;
+	}
+	page = (void *) vaddr;
+#else /* CONFIG_PAGING */
+	page = uk_palloc(uk_alloc_get_default(), 1);
+	if (unlikely(!page))
+		return NULL;
+#endif /* !CONFIG_PAGING */
+
+	memset(page, 0, PAGE_SIZE);
+	return page;
+}
+
+static void ramfs_page_free(void *page)
+{
+#ifdef CONFIG_PAGING
+	struct uk_pagetable *pt = ukplat_pt_get_active();
+	__paddr_t paddr = ukplat_virt_to_phys(page);
+
+	ukplat_page_kunmap(pt, (__vaddr_t) page, 1, 0);
+	uk_ffree(pt->fa, paddr, 1);
+#else /* CONFIG_PAGING */
+	uk_pfree(uk_alloc_get_default(), page, 1);
+#endif /* !CONFIG_PAGING */
+}
+
+/* Returns whether a tree of the given height covers the page index */
+static inline int ramfs_radix_covers(unsigned int height, unsigned long idx)
+{
+	unsigned int shift = height * RAMFS_RADIX_SHIFT;
+
+	return shift >= sizeof(idx) * 8 || !(idx >> shift);
+}
+
+static int ramfs_radix_grow(struct ramfs_node *np, unsigned long idx)
+{
+	struct ramfs_radix *root;
+	unsigned int height = MAX(np->rn_height, 1U);
+
+	while (!ramfs_radix_covers(height, idx))
+		height++;
+
+	/* An empty tree just starts at the required height */
+	if (!np->rn_pages) {
+		np->rn_height = height;
+		return 0;
+	}
+
+	while (np->rn_height < height) {
+		root = ramfs_page_alloc();
+		if (unlikely(!root))
+			return -1;
+
+		root->slots[0] = np->rn_pages;
+		np->rn_pages = root;
+		np->rn_height++;
+	}
+	return 0;
+}
+
+void *ramfs_page_get(struct ramfs_node *np, unsigned long idx, int alloc)
+{
+	struct ramfs_radix *node = NULL;
+	unsigned int h;
+	void **slot;
+
+	UK_ASSERT(np->rn_type == VREG);
+
+	if (np->rn_hint && (idx & ~RAMFS_RADIX_MASK) == np->rn_hint_idx) {
+		node = np->rn_hint;
+		slot = &node->slots[idx & RAMFS_RADIX_MASK];
+		goto found;
+	}
+
+	if (!np->rn_pages || !ramfs_radix_covers(np->rn_height, idx)) {
+		if (!alloc)
+			return NULL;
+		if (unlikely(ramfs_radix_grow(np, idx)))
+			return NULL;
+	}
+
+	slot = &np->rn_pages;
+	for (h = np->rn_height; h > 0; h--) {
+		if (!*slot) {
+			if (!alloc)
+				return NULL;
+			*slot = ramfs_page_alloc();
+			if (unlikely(!*slot))
+				return NULL;
+		}
+
+		node = *slot;
+		slot = &node->slots[(idx >> ((h - 1) * RAMFS_RADIX_SHIFT)) &
+				    RAMFS_RADIX_MASK];
+	}
+
+	np->rn_hint = node;
+	np->rn_hint_idx = idx & ~RAMFS_RADIX_MASK;
+
+found:
+	if (!*slot && alloc)
+		*slot = ramfs_page_alloc();
+	return *slot;
+}
+
+/*
+ * Releases the pages in [first, last] below the node in slot, which covers
+ * the pages starting at base. Returns whether the slot is empty afterwards.
+ */
+static int ramfs_radix_release(void **slot, unsigned int height,
+			       unsigned long base, unsigned long first,
+			       unsigned long last, int keep)
+{
+	struct ramfs_radix *node = *slot;
+	unsigned long span, b, i;
+	int empty = 1;
+
+	if (!node)
+		return 1;
+
+	if (height == 0) {
+		/* Data page */
+		if (keep) {
+			memset(node, 0, PAGE_SIZE);
+			return 0;
+		}
+
+		ramfs_page_free(node);
+		*slot = NULL;
+		return 1;
+	}
+
+	span = 1UL << ((height - 1) * RAMFS_RADIX_SHIFT);
+	for (i = 0; i < RAMFS_RADIX_SLOTS; i++) {
+		b = base + i * span;
+		if (b > last || b + (span - 1) < first) {
+			if (node->slots[i])
+				empty = 0;
+			continue;
+		}
+
+		if (!ramfs_radix_release(&node->slots[i], height - 1, b,
+					 first, last, keep))
+			empty = 0;
+	}
+
+	if (empty) {
+		ramfs_page_free(node);
+		*slot = NULL;
+	}
+	return empty;
+}
+
+void ramfs_pages_release(struct ramfs_node *np, unsigned long first,
+			 unsigned long last, int keep)
+{
+	UK_ASSERT(np->rn_type == VREG);
+	UK_ASSERT(first <= last);
+
+	if (!np->rn_pages)
+		return;
+
+	/* Nodes in the range may get freed */
+	np->rn_hint = NULL;
+
+	ramfs_radix_release(&np->rn_pages, np->rn_height, 0, first, last,
+			    keep);
+	if (!np->rn_pages)
+		np->rn_height = 0;
+}
@@ -45,6 +45,8 @@
 #include <stdlib.h>
 
 #include <uk/page.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
 #include <vfscore/vnode.h>
 #include <vfscore/mount.h>
 #include <vfscore/uio.h>
@@ -58,6 +60,11 @@
 static struct uk_mutex ramfs_lock = UK_MUTEX_INITIALIZER(ramfs_lock);
 static uint64_t inode_count = 1; /* inode 0 is reserved to root */
 
+/* Source for reads from holes in sparse files, and backing of holes in
+ * mappings. It is page-aligned so that it can be mapped.
+ */
+static const char ramfs_zero_page[PAGE_SIZE] __align(PAGE_SIZE);
+
 static void
 set_times_to_now(struct timespec *time1, struct timespec *time2,
 		 struct timespec *time3)
@@ -101,7 +108,6 @@ ramfs_allocate_node(const char *name, int type)
 		np->rn_mode = S_IFREG|0777;
 
 	set_times_to_now(&(np->rn_ctime), &(np->rn_atime), &(np->rn_mtime));
-	np->rn_owns_buf = true;
 
 	return np;
 }
@@ -109,7 +115,17 @@ ramfs_allocate_node(const char *name, int type)
 void
 ramfs_free_node(struct ramfs_node *np)
 {
-	if (np->rn_buf != NULL && np->rn_owns_buf)
+	/* The pages of a removed file stay in place until its last mapping is
+	 * gone. ramfs_unmap() then frees the node.
+	 */
+	if (np->rn_mapcount > 0) {
+		np->rn_removed = true;
+		return;
+	}
+
+	if (np->rn_type == VREG)
+		ramfs_pages_release(np, 0, ULONG_MAX, 0);
+	if (np->rn_buf != NULL)
 		free(np->rn_buf);
 
 	free(np->rn_name);
@@ -289,7 +305,7 @@ ramfs_symlink(struct vnode *dvp, const char *name, const char *link)
 	len = strlen(link);
 
 	np->rn_buf = strndup(link, len);
-	np->rn_bufsize = np->rn_size = len;
+	np->rn_size = len;
 
 	return 0;
 }
@@ -334,40 +350,49 @@ ramfs_remove(struct vnode *dvp, struct vnode *vp,
 	return ramfs_remove_node(dvp->v_data, vp->v_data);
 }
 
+/*
+ * Zeroes the file data in [start, end) if the page is present. The range
+ * must be within a single page.
+ */
+static void
+ramfs_zero_range(struct ramfs_node *np, off_t start, off_t end)
+{
+	char *page;
+
+	if (start >= end)
+		return;
+
+	UK_ASSERT((start >> PAGE_SHIFT) == ((end - 1) >> PAGE_SHIFT));
+
+	page = ramfs_page_get(np, start >> PAGE_SHIFT, 0);
+	if (page)
+		memset(page + (start & (PAGE_SIZE - 1)), 0, end - start);
+}
+
 /* Truncate file */
 static int
 ramfs_truncate(struct vnode *vp, off_t length)
 {
 	struct ramfs_node *np;
-	void *new_buf;
-	size_t new_size;
+	off_t end;
 
 	uk_pr_debug("truncate %s length=%lld\n", RAMFS_NODE(vp)->rn_name,
 		 (long long) length);
 	np = vp->v_data;
 
-	if (length == 0) {
-		if (np->rn_buf != NULL) {
-			if (np->rn_owns_buf)
-				free(np->rn_buf);
-			np->rn_buf = NULL;
-			np->rn_bufsize = 0;
-		}
-	} else if ((size_t) length > np->rn_bufsize) {
-		/* TODO: this could use a page level allocator */
-		new_size = round_pgup(length);
-		new_buf = malloc(new_size);
-		if (!new_buf)
-			return EIO;
-		if (np->rn_size != 0) {
-			memcpy(new_buf, np->rn_buf, vp->v_size);
-			if (np->rn_owns_buf)
-				free(np->rn_buf);
-		}
-		np->rn_buf = (char *) new_buf;
-		np->rn_bufsize = new_size;
-		np->rn_owns_buf = true;
+	if ((size_t) length < np->rn_size) {
+		/* Pages beyond the end of the file are released and the tail
+		 * of the last page is zeroed, so that a later extension of
+		 * the file reads zeros. Mapped pages stay in place and are
+		 * zeroed instead.
+		 */
+		end = round_pgup(length);
+		ramfs_zero_range(np, length, end);
+		ramfs_pages_release(np, end >> PAGE_SHIFT, ULONG_MAX,
+				    np->rn_mapcount > 0);
 	}
+
+	/* Growing the file just creates a hole */
 	np->rn_size = length;
 	vp->v_size = length;
 	set_times_to_now(&(np->rn_mtime), &(np->rn_ctime), NULL);
@@ -395,6 +420,37 @@ ramfs_create(struct vnode *dvp, const char *name, mode_t mode)
 	return 0;
 }
 
+/*
+ * Moves data between the file pages and the uio. Holes read as zeros and get
+ * backed by new pages on write.
+ */
+static int
+ramfs_uiomove(struct ramfs_node *np, size_t len, struct uio *uio)
+{
+	size_t off, n;
+	char *page;
+	int error;
+
+	while (len > 0) {
+		off = uio->uio_offset & (PAGE_SIZE - 1);
+		n = MIN(len, PAGE_SIZE - off);
+
+		page = ramfs_page_get(np, uio->uio_offset >> PAGE_SHIFT,
+				      uio->uio_rw == UIO_WRITE);
+		if (!page) {
+			if (uio->uio_rw == UIO_WRITE)
+				return ENOSPC;
+			page = (char *) ramfs_zero_page;
+		}
+
+		error = vfscore_uiomove(page + off, n, uio);
+		if (error)
+			return error;
+		len -= n;
+	}
+	return 0;
+}
+
 static int
 ramfs_read(struct vnode *vp, struct vfscore_file *fp __unused,
 	   struct uio *uio, int ioflag __unused)
@@ -411,36 +467,95 @@ ramfs_read(struct vnode *vp, struct vfscore_file *fp __unused,
 	if (uio->uio_resid == 0)
 		return 0;
 
-	if (uio->uio_offset >= (off_t) vp->v_size)
+	if (uio->uio_offset >= (off_t) np->rn_size)
 		return 0;
 
-	if (vp->v_size - uio->uio_offset < uio->uio_resid)
-		len = vp->v_size - uio->uio_offset;
+	if ((off_t) np->rn_size - uio->uio_offset < uio->uio_resid)
+		len = np->rn_size - uio->uio_offset;
 	else
 		len = uio->uio_resid;
 
 	set_times_to_now(&(np->rn_atime), NULL, NULL);
 
-	return vfscore_uiomove(np->rn_buf + uio->uio_offset, len, uio);
+	return ramfs_uiomove(np, len, uio);
+}
+
+static int
+ramfs_splice_read(struct vnode *vp, struct vfscore_file *fp __unused,
+		  struct uio *uio)
+{
+	struct ramfs_node *np =  vp->v_data;
+	size_t len, off, n;
+	char *page;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return EINVAL;
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_resid == 0 || uio->uio_iovcnt == 0)
+		return 0;
+
+	if (uio->uio_offset >= (off_t) np->rn_size)
+		return 0;
+
+	if ((off_t) np->rn_size - uio->uio_offset < uio->uio_resid)
+		len = np->rn_size - uio->uio_offset;
+	else
+		len = uio->uio_resid;
+
+	set_times_to_now(&(np->rn_atime), NULL, NULL);
+
+	/* Hand out one iovec per page. Holes refer to the zero page. */
+	while (len > 0 && uio->uio_iovcnt > 0) {
+		off = uio->uio_offset & (PAGE_SIZE - 1);
+		n = MIN(len, PAGE_SIZE - off);
+
+		page = ramfs_page_get(np, uio->uio_offset >> PAGE_SHIFT, 0);
+		if (!page)
+			page = (char *) ramfs_zero_page;
+
+		uio->uio_iov->iov_base = page + off;
+		uio->uio_iov->iov_len = n;
+		uio->uio_iov++;
+		uio->uio_iovcnt--;
+		uio->uio_resid -= n;
+		uio->uio_offset += n;
+		len -= n;
+	}
+	return 0;
 }
 
 int
 ramfs_set_file_data(struct vnode *vp, const void *data, size_t size)
 {
 	struct ramfs_node *np =  vp->v_data;
+	unsigned long idx;
+	size_t n;
+	char *page;
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
 	if (vp->v_type != VREG)
 		return EINVAL;
-	if (np->rn_buf)
+	if (np->rn_size)
 		return EINVAL;
 
-	np->rn_buf = (char *) data;
-	np->rn_bufsize = size;
+	/* The data is copied as file data has to live in the file pages */
+	for (idx = 0; (idx << PAGE_SHIFT) < size; idx++) {
+		page = ramfs_page_get(np, idx, 1);
+		if (!page) {
+			ramfs_pages_release(np, 0, ULONG_MAX, 0);
+			return ENOSPC;
+		}
+
+		n = MIN(size - (idx << PAGE_SHIFT), PAGE_SIZE);
+		memcpy(page, (const char *) data + (idx << PAGE_SHIFT), n);
+	}
+
 	np->rn_size = size;
 	vp->v_size = size;
-	np->rn_owns_buf = false;
 
 	return 0;
 }
@@ -449,6 +564,8 @@ static int
 ramfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 {
 	struct ramfs_node *np =  vp->v_data;
+	ssize_t resid;
+	int error;
 
 	if (vp->v_type == VDIR)
 		return EISDIR;
@@ -464,33 +581,128 @@ ramfs_write(struct vnode *vp, struct uio *uio, int ioflag)
 	if (ioflag & IO_APPEND)
 		uio->uio_offset = np->rn_size;
 
-	if ((size_t) uio->uio_offset + uio->uio_resid > (size_t) vp->v_size) {
-		/* Expand the file size before writing to it */
-		off_t end_pos = uio->uio_offset + uio->uio_resid;
-
-		if (end_pos > (off_t) np->rn_bufsize) {
-			// XXX: this could use a page level allocator
-			size_t new_size = round_pgup(end_pos);
-			void *new_buf = calloc(1, new_size);
-
-			if (!new_buf)
-				return EIO;
-			if (np->rn_size != 0) {
-				memcpy(new_buf, np->rn_buf, vp->v_size);
-				if (np->rn_owns_buf)
-					free(np->rn_buf);
-			}
-			np->rn_buf = (char *) new_buf;
-			np->rn_bufsize = new_size;
+	/* Pages are allocated as the data is written. Writing beyond the end
+	 * of the file leaves a hole between the old end and the offset.
+	 */
+	resid = uio->uio_resid;
+	error = ramfs_uiomove(np, uio->uio_resid, uio);
+	if ((size_t) uio->uio_offset > np->rn_size) {
+		np->rn_size = uio->uio_offset;
+		vp->v_size = uio->uio_offset;
+	}
+
+	set_times_to_now(&(np->rn_mtime), &(np->rn_ctime), NULL);
+
+	/* Report a short write if we ran out of memory midway */
+	if (error == ENOSPC && uio->uio_resid < resid)
+		return 0;
+	return error;
+}
+
+static int
+ramfs_fallocate(struct vnode *vp, int mode, off_t offset, off_t len)
+{
+	struct ramfs_node *np = vp->v_data;
+	unsigned long idx, first, last;
+	off_t end;
+
+	if (vp->v_type == VDIR)
+		return EISDIR;
+	if (vp->v_type != VREG)
+		return ENODEV;
+	if (offset > LONG_MAX - len)
+		return EFBIG;
+
+	end = offset + len;
+
+	if (mode & FALLOC_FL_PUNCH_HOLE) {
+		if (mode & ~(FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE))
+			return EOPNOTSUPP;
+
+		/* Data beyond the end of the file is zero already */
+		end = MIN(end, (off_t) np->rn_size);
+		if (offset >= end)
+			return 0;
+
+		/* Release the pages in the range and zero partial pages */
+		first = round_pgup(offset) >> PAGE_SHIFT;
+		last = end >> PAGE_SHIFT;
+		if (first > last) {
+			ramfs_zero_range(np, offset, end);
+		} else {
+			ramfs_zero_range(np, offset, first << PAGE_SHIFT);
+			ramfs_zero_range(np, last << PAGE_SHIFT, end);
+			if (first < last)
+				ramfs_pages_release(np, first, last - 1,
+						    np->rn_mapcount > 0);
+		}
+	} else {
+		if (mode & ~FALLOC_FL_KEEP_SIZE)
+			return EOPNOTSUPP;
+
+		for (idx = offset >> PAGE_SHIFT;
+		     idx <= (unsigned long) (end - 1) >> PAGE_SHIFT; idx++) {
+			if (!ramfs_page_get(np, idx, 1))
+				return ENOSPC;
+		}
+
+		if (!(mode & FALLOC_FL_KEEP_SIZE) &&
+		    (size_t) end > np->rn_size) {
+			np->rn_size = end;
+			vp->v_size = end;
 		}
-		np->rn_size = end_pos;
-		vp->v_size = end_pos;
-		np->rn_owns_buf = true;
 	}
 
 	set_times_to_now(&(np->rn_mtime), &(np->rn_ctime), NULL);
-	return vfscore_uiomove(np->rn_buf + uio->uio_offset, uio->uio_resid,
-			       uio);
+	return 0;
+}
+
+static int
+ramfs_map(struct vnode *vp)
+{
+	struct ramfs_node *np = vp->v_data;
+
+	if (vp->v_type != VREG)
+		return EINVAL;
+
+	np->rn_mapcount++;
+	return 0;
+}
+
+static int
+ramfs_unmap(struct vnode *vp)
+{
+	struct ramfs_node *np = vp->v_data;
+
+	UK_ASSERT(np->rn_mapcount > 0);
+
+	if (--np->rn_mapcount > 0)
+		return 0;
+
+	if (np->rn_removed) {
+		ramfs_free_node(np);
+		return 0;
+	}
+
+	/* Pages beyond the end of the file were kept for the mappings only */
+	ramfs_pages_release(np, round_pgup(np->rn_size) >> PAGE_SHIFT,
+			    ULONG_MAX, 0);
+	return 0;
+}
+
+static int
+ramfs_getpage(struct vnode *vp, off_t off, void **page)
+{
+	struct ramfs_node *np = vp->v_data;
+
+	UK_ASSERT(np->rn_mapcount > 0);
+	UK_ASSERT(PAGE_ALIGNED(off));
+
+	/* Mappings are read-only, so holes need not be backed by memory */
+	*page = ramfs_page_get(np, off >> PAGE_SHIFT, 0);
+	if (!*page)
+		*page = (void *) ramfs_zero_page;
+	return 0;
 }
 
 static int
@@ -501,6 +713,10 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, const char *name1 __unused,
 	struct ramfs_node *np, *old_np;
 	int error;
 
+	/* Moving the data to a new node would pull it from under mappings */
+	if (dvp1 != dvp2 && RAMFS_NODE(vp1)->rn_mapcount > 0)
+		return EBUSY;
+
 	if (vp2) {
 		/* Remove destination file, first */
 		error = ramfs_remove_node(dvp2->v_data, vp2->v_data);
@@ -520,13 +736,15 @@ ramfs_rename(struct vnode *dvp1, struct vnode *vp1, const char *name1 __unused,
 		if (np == NULL)
 			return ENOMEM;
 
-		if (old_np->rn_buf) {
-			/* Copy file data */
-			np->rn_buf = old_np->rn_buf;
-			np->rn_size = old_np->rn_size;
-			np->rn_bufsize = old_np->rn_bufsize;
-			old_np->rn_buf = NULL;
-		}
+		/* Move the file data */
+		np->rn_pages = old_np->rn_pages;
+		np->rn_height = old_np->rn_height;
+		np->rn_buf = old_np->rn_buf;
+		np->rn_size = old_np->rn_size;
+		old_np->rn_pages = NULL;
+		old_np->rn_height = 0;
+		old_np->rn_hint = NULL;
+		old_np->rn_buf = NULL;
 		/* Remove source file */
 		ramfs_remove_node(dvp1->v_data, vp1->v_data);
 	}
@@ -644,7 +862,6 @@ ramfs_setattr(struct vnode *vnode, struct vattr *attr)
 #define ramfs_fsync     ((vnop_fsync_t)vfscore_vop_nullop)
 #define ramfs_inactive  ((vnop_inactive_t)vfscore_vop_nullop)
 #define ramfs_link      ((vnop_link_t)vfscore_vop_eperm)
-#define ramfs_fallocate ((vnop_fallocate_t)vfscore_vop_nullop)
 #define ramfs_poll      ((vnop_poll_t)vfscore_vop_einval)
 
 /*
@@ -675,4 +892,8 @@ struct vnops ramfs_vnops = {
 		ramfs_readlink,         /* read link */
 		ramfs_symlink,          /* symbolic link */
 		ramfs_poll,             /* poll */
+		ramfs_splice_read,      /* splice read */
+		ramfs_map,              /* map */
+		ramfs_unmap,            /* unmap */
+		ramfs_getpage,          /* get page */
 };
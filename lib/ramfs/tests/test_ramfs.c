@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <uk/test.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/arch/limits.h>
+#include <uk/plat/time.h>
+#if CONFIG_LIBUKVMEM
+#include <uk/vmem.h>
+#include <uk/vma_types.h>
+#endif /* CONFIG_LIBUKVMEM */
+
+#define TEST_FILE	"/ramfs_test"
+#define BENCH_PAGES	4096
+
+/* Returns whether the file holds the byte c in [off, off + len) */
+static int test_check(int fd, off_t off, size_t len, char c)
+{
+	char buf[256];
+	size_t i, n;
+
+	for (; len > 0; len -= n, off += n) {
+		n = MIN(sizeof(buf), len);
+		if (pread(fd, buf, n, off) != (ssize_t) n)
+			return 0;
+		for (i = 0; i < n; ++i)
+			if (buf[i] != c)
+				return 0;
+	}
+	return 1;
+}
+
+static int test_fill(int fd, off_t off, size_t len, char c)
+{
+	char buf[256];
+	size_t n;
+
+	memset(buf, c, sizeof(buf));
+	for (; len > 0; len -= n, off += n) {
+		n = MIN(sizeof(buf), len);
+		if (pwrite(fd, buf, n, off) != (ssize_t) n)
+			return -1;
+	}
+	return 0;
+}
+
+static int test_truncate(int fd, off_t len)
+{
+	return uk_syscall_r_ftruncate((long) fd, (long) len);
+}
+
+UK_TESTCASE(ramfs, sparse)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+
+	/* Writing far beyond the end leaves a hole that reads as zeros */
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 64 * 1024 * 1024 + 100, 10, 'a'));
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 64 * 1024 * 1024 + 110);
+	UK_TEST_EXPECT(test_check(fd, 0, PAGE_SIZE, 0));
+	UK_TEST_EXPECT(test_check(fd, 64 * 1024 * 1024, 100, 0));
+	UK_TEST_EXPECT(test_check(fd, 64 * 1024 * 1024 + 100, 10, 'a'));
+
+	/* Shrinking and growing again must not bring back old data */
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, 64 * 1024 * 1024 + 105));
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, 64 * 1024 * 1024 + 200));
+	UK_TEST_EXPECT(test_check(fd, 64 * 1024 * 1024 + 100, 5, 'a'));
+	UK_TEST_EXPECT(test_check(fd, 64 * 1024 * 1024 + 105, 95, 0));
+
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, 0));
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, PAGE_SIZE));
+	UK_TEST_EXPECT(test_check(fd, 0, PAGE_SIZE, 0));
+
+	close(fd);
+	unlink(TEST_FILE);
+}
+
+UK_TESTCASE(ramfs, punch_hole)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_ASSERT(test_fill(fd, 0, 4 * PAGE_SIZE, 'b') == 0);
+
+	/* Hole punching needs KEEP_SIZE, like on Linux */
+	UK_TEST_EXPECT_SNUM_EQ(fallocate(fd, FALLOC_FL_PUNCH_HOLE, 0,
+					 PAGE_SIZE), -1);
+
+	/* The hole covers a partial page at both ends and two full pages */
+	UK_TEST_EXPECT_ZERO(fallocate(fd, FALLOC_FL_PUNCH_HOLE |
+				      FALLOC_FL_KEEP_SIZE, 100,
+				      3 * PAGE_SIZE));
+	UK_TEST_EXPECT(test_check(fd, 0, 100, 'b'));
+	UK_TEST_EXPECT(test_check(fd, 100, 3 * PAGE_SIZE, 0));
+	UK_TEST_EXPECT(test_check(fd, 3 * PAGE_SIZE + 100, PAGE_SIZE - 100,
+				  'b'));
+
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 4 * PAGE_SIZE);
+
+	/* Allocation extends the file unless KEEP_SIZE is given */
+	UK_TEST_EXPECT_ZERO(fallocate(fd, FALLOC_FL_KEEP_SIZE, 0,
+				      8 * PAGE_SIZE));
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 4 * PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(fallocate(fd, 0, 0, 6 * PAGE_SIZE + 1));
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 6 * PAGE_SIZE + 1);
+	UK_TEST_EXPECT(test_check(fd, 4 * PAGE_SIZE, 2 * PAGE_SIZE + 1, 0));
+
+	close(fd);
+	unlink(TEST_FILE);
+}
+
+#if CONFIG_LIBUKVMEM
+UK_TESTCASE(ramfs, mmap_shared)
+{
+	struct uk_vas *vas = uk_vas_get_active();
+	__vaddr_t va = __VADDR_ANY;
+	volatile char *p;
+	int fd, rc;
+
+	UK_TEST_ASSERT(vas != NULL);
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_ASSERT(test_fill(fd, 0, 2 * PAGE_SIZE + 10, 'c') == 0);
+
+	rc = uk_vma_map_file(vas, &va, 4 * PAGE_SIZE, PAGE_ATTR_PROT_READ,
+			     UK_VMA_FILE_SHARED, fd, 0);
+	UK_TEST_ASSERT(rc == 0);
+	p = (volatile char *) va;
+
+	UK_TEST_EXPECT_SNUM_EQ(p[0], 'c');
+	UK_TEST_EXPECT_SNUM_EQ(p[2 * PAGE_SIZE + 9], 'c');
+	UK_TEST_EXPECT_SNUM_EQ(p[2 * PAGE_SIZE + 10], 0);
+
+	/* The mapping refers to the file pages, so it sees later writes */
+	UK_TEST_EXPECT_ZERO(test_fill(fd, PAGE_SIZE, 1, 'd'));
+	UK_TEST_EXPECT_SNUM_EQ(p[PAGE_SIZE], 'd');
+
+	/* Mapped pages are zeroed instead of freed */
+	UK_TEST_EXPECT_ZERO(fallocate(fd, FALLOC_FL_PUNCH_HOLE |
+				      FALLOC_FL_KEEP_SIZE, 0, PAGE_SIZE));
+	UK_TEST_EXPECT_SNUM_EQ(p[0], 0);
+	UK_TEST_EXPECT_ZERO(test_truncate(fd, 10));
+	UK_TEST_EXPECT_SNUM_EQ(p[PAGE_SIZE], 0);
+
+	UK_TEST_EXPECT_ZERO(uk_vma_unmap(vas, va, 4 * PAGE_SIZE, 0));
+
+	/* A removed file stays valid until its last mapping is gone */
+	va = __VADDR_ANY;
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 0, 10, 'e'));
+	rc = uk_vma_map_file(vas, &va, PAGE_SIZE, PAGE_ATTR_PROT_READ,
+			     UK_VMA_FILE_SHARED, fd, 0);
+	UK_TEST_ASSERT(rc == 0);
+	close(fd);
+	UK_TEST_EXPECT_ZERO(unlink(TEST_FILE));
+	UK_TEST_EXPECT_SNUM_EQ(*(volatile char *) va, 'e');
+	UK_TEST_EXPECT_ZERO(uk_vma_unmap(vas, va, PAGE_SIZE, 0));
+}
+
+UK_TESTCASE(ramfs, mmap_shared_hole)
+{
+	struct uk_vas *vas = uk_vas_get_active();
+	__vaddr_t va = __VADDR_ANY;
+	volatile char *p;
+	struct stat st;
+	int fd, rc;
+
+	UK_TEST_ASSERT(vas != NULL);
+
+	fd = open(TEST_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_ASSERT(test_fill(fd, 0, 10, 'a') == 0);
+	UK_TEST_ASSERT(test_fill(fd, 2 * PAGE_SIZE, 10, 'b') == 0);
+
+	/* The hole and the range past the end read as zeros */
+	rc = uk_vma_map_file(vas, &va, 4 * PAGE_SIZE, PAGE_ATTR_PROT_READ,
+			     UK_VMA_FILE_SHARED, fd, 0);
+	UK_TEST_ASSERT(rc == 0);
+	p = (volatile char *) va;
+
+	UK_TEST_EXPECT_SNUM_EQ(p[0], 'a');
+	UK_TEST_EXPECT_SNUM_EQ(p[PAGE_SIZE], 0);
+	UK_TEST_EXPECT_SNUM_EQ(p[2 * PAGE_SIZE], 'b');
+	UK_TEST_EXPECT_SNUM_EQ(p[3 * PAGE_SIZE], 0);
+
+	/* Written pages still show up in the mapping */
+	UK_TEST_EXPECT_ZERO(test_fill(fd, 2 * PAGE_SIZE, 1, 'c'));
+	UK_TEST_EXPECT_SNUM_EQ(p[2 * PAGE_SIZE], 'c');
+
+	UK_TEST_EXPECT_ZERO(uk_vma_unmap(vas, va, 4 * PAGE_SIZE, 0));
+
+	/* Mapping did not extend the file or fill the hole */
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 2 * PAGE_SIZE + 10);
+	UK_TEST_EXPECT(test_check(fd, PAGE_SIZE, PAGE_SIZE, 0));
+
+	close(fd);
+	unlink(TEST_FILE);
+}
+#endif /* CONFIG_LIBUKVMEM */
+
+/* Benchmark: Appending page by page. With page-backed storage the cost per
+ * append must not grow with the file size.
+ */
+UK_TESTCASE(ramfs, bench_append)
+{
+	static char buf[PAGE_SIZE];
+	__nsec start, first = 0, last;
+	int fd, i;
+
+	fd = open(TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	UK_TEST_ASSERT(fd >= 0);
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_PAGES; ++i) {
+		if (write(fd, buf, sizeof(buf)) != sizeof(buf))
+			break;
+		if (i == BENCH_PAGES / 8 - 1)
+			first = ukplat_monotonic_clock() - start;
+	}
+	last = ukplat_monotonic_clock() - start - first;
+	UK_TEST_EXPECT_SNUM_EQ(i, BENCH_PAGES);
+
+	uk_test_printf("append %d pages: first 1/8 %"__PRInsec
+		       " ns, remaining 7/8 %"__PRInsec" ns\n",
+		       BENCH_PAGES, first, last);
+
+	close(fd);
+	unlink(TEST_FILE);
+}
+
+uk_testsuite_register(ramfs, NULL);
@@ -244,6 +244,44 @@ int uk_9p_clunk(struct uk_9pdev *dev, struct uk_9pfid *fid);
 int64_t uk_9p_read(struct uk_9pdev *dev, struct uk_9pfid *fid,
 		uint64_t offset, uint32_t count, char *buf);
 
+/**
+ * Sends a read request like uk_9p_read(), but does not wait for the reply.
+ * Several requests can be outstanding at the same time, e.g., to read
+ * consecutive parts of a file.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to read from.
+ * @param offset
+ *   Offset at which to start reading.
+ * @param count
+ *   Maximum number of bytes to read. On return, the number of bytes that
+ *   were requested, which is limited by the transport of this 9P device.
+ * @param buf
+ *   Buffer to read into. It must stay valid until uk_9p_read_wait().
+ * @return
+ *   - (!ERRPTR): The request, to be passed to uk_9p_read_wait().
+ *   - ERRPTR: An error occurred.
+ */
+struct uk_9preq *uk_9p_read_async(struct uk_9pdev *dev,
+		struct uk_9pfid *fid, uint64_t offset, uint32_t *count,
+		char *buf);
+
+/**
+ * Waits for the reply to a request of uk_9p_read_async() and removes the
+ * request.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param req
+ *   The request returned by uk_9p_read_async().
+ * @return
+ *   - (>= 0): Amount of bytes read.
+ *   - (< 0): An error occurred.
+ */
+int64_t uk_9p_read_wait(struct uk_9pdev *dev, struct uk_9preq *req);
+
 /**
  * Writes count bytes from buf to the fid, starting from the given offset.
  *
@@ -264,6 +302,43 @@ int64_t uk_9p_read(struct uk_9pdev *dev, struct uk_9pfid *fid,
 int64_t uk_9p_write(struct uk_9pdev *dev, struct uk_9pfid *fid,
 		uint64_t offset, uint32_t count, const char *buf);
 
+/**
+ * Sends a write request like uk_9p_write(), but does not wait for the
+ * reply.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param fid
+ *   9P fid to write to.
+ * @param offset
+ *   Offset at which to start writing.
+ * @param count
+ *   Maximum number of bytes to write. On return, the number of bytes that
+ *   were sent, which is limited by the transport of this 9P device.
+ * @param buf
+ *   Data to be written. It must stay valid until uk_9p_write_wait().
+ * @return
+ *   - (!ERRPTR): The request, to be passed to uk_9p_write_wait().
+ *   - ERRPTR: An error occurred.
+ */
+struct uk_9preq *uk_9p_write_async(struct uk_9pdev *dev,
+		struct uk_9pfid *fid, uint64_t offset, uint32_t *count,
+		const char *buf);
+
+/**
+ * Waits for the reply to a request of uk_9p_write_async() and removes the
+ * request.
+ *
+ * @param dev
+ *   The Unikraft 9P Device.
+ * @param req
+ *   The request returned by uk_9p_write_async().
+ * @return
+ *   - (>= 0): Amount of bytes written.
+ *   - (< 0): An error occurred.
+ */
+int64_t uk_9p_write_wait(struct uk_9pdev *dev, struct uk_9preq *req);
+
 /**
  * Stats the given fid and places the data into the given stat structure.
  *
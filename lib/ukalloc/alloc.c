@@ -70,6 +70,27 @@ int uk_alloc_register(struct uk_alloc *a)
 	return 0;
 }
 
+int uk_alloc_set_default(struct uk_alloc *a)
+{
+	struct uk_alloc *this = _uk_alloc_head;
+
+	UK_ASSERT(a);
+
+	if (a == _uk_alloc_head)
+		return 0;
+
+	/* Unlink the allocator and put it in front of the list */
+	while (this && this->next != a)
+		this = this->next;
+	if (unlikely(!this))
+		return -ENOENT;
+
+	this->next = a->next;
+	a->next = _uk_alloc_head;
+	_uk_alloc_head = a;
+	return 0;
+}
+
 #ifdef CONFIG_HAVE_MEMTAG
 #define __align_metadata_ifpages __align(MEMTAG_GRANULE)
 #else
@@ -47,6 +47,18 @@ extern "C" {
 
 int uk_alloc_register(struct uk_alloc *a);
 
+/**
+ * Makes an already registered allocator the default allocator that is
+ * returned by uk_alloc_get_default(). This is used by allocators that are
+ * stacked on top of another allocator (e.g., ukallocslab).
+ *
+ * @param a
+ *  Registered allocator.
+ * @return
+ *  0 on success, -ENOENT if the allocator is not registered.
+ */
+int uk_alloc_set_default(struct uk_alloc *a);
+
 /**
  * Compatibility functions that can be used by allocator implementations to
  * fill out callback functions in `struct uk_alloc` when just a subset of the
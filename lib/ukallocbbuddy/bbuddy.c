@@ -49,6 +49,8 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/page.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/spinlock.h>
 
 typedef struct chunk_head_st chunk_head_t;
 typedef struct chunk_tail_st chunk_tail_t;
@@ -76,11 +78,33 @@ struct uk_bbpalloc_memr {
 	unsigned long *mm_alloc_bitmap;
 };
 
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+/* Per-LCPU caches of free chunks for the orders 0 to MAGAZINE_ORDERS - 1.
+ * A magazine is only accessed by its LCPU with interrupts disabled. It is
+ * refilled from or flushed to the buddy lists in batches of MAGAZINE_BATCH
+ * chunks so that bursts of page allocations and releases do not need to
+ * take the allocator lock and update the allocation bitmap.
+ */
+#define MAGAZINE_ORDERS	4
+#define MAGAZINE_SIZE	CONFIG_LIBUKALLOCBBUDDY_MAGAZINE_SIZE
+#define MAGAZINE_BATCH	(MAGAZINE_SIZE / 2)
+
+struct bbuddy_magazine {
+	unsigned int count;
+	void *chunk[MAGAZINE_SIZE];
+};
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+
 struct uk_bbpalloc {
+	__spinlock lock;
 	unsigned long nr_free_pages;
 	chunk_head_t *free_head[FREELIST_SIZE];
 	chunk_head_t free_tail[FREELIST_SIZE];
 	struct uk_bbpalloc_memr *memr_head;
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	UKPLAT_PER_LCPU_ARRAY_DEFINE(struct bbuddy_magazine, mag,
+				     MAGAZINE_ORDERS);
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
 };
 
 /*********************
@@ -234,26 +258,22 @@ static inline unsigned long num_pages_to_order(unsigned long num_pages)
 
 /*********************
  * BINARY BUDDY PAGE ALLOCATOR
+ *  The functions operating on the buddy lists have to be called with the
+ *  allocator lock held.
  */
-static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
+static void *bbuddy_alloc_chunk(struct uk_bbpalloc *b, size_t order)
 {
-	struct uk_bbpalloc *b;
 	size_t i;
 	chunk_head_t *alloc_ch, *spare_ch;
 	chunk_tail_t *spare_ct;
 
-	UK_ASSERT(a != NULL);
-	b = (struct uk_bbpalloc *)&a->priv;
-
-	size_t order = (size_t)num_pages_to_order(num_pages);
-
 	/* Find smallest order which can satisfy the request. */
 	for (i = order; i < FREELIST_SIZE; i++) {
 		if (!FREELIST_EMPTY(b->free_head[i]))
 			break;
 	}
 	if (i == FREELIST_SIZE)
-		goto no_memory;
+		return NULL;
 
 	/* Unlink a chunk. */
 	alloc_ch = b->free_head[i];
@@ -281,35 +301,15 @@ static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
 	}
 	map_alloc(b, (uintptr_t)alloc_ch, 1UL << order);
 
-	uk_alloc_stats_count_palloc(a, (void *) alloc_ch, num_pages);
 	return ((void *)alloc_ch);
-
-no_memory:
-	uk_pr_warn("%"__PRIuptr": Cannot handle palloc request of order %"__PRIsz": Out of memory\n",
-		   (uintptr_t)a, order);
-
-	uk_alloc_stats_count_penomem(a, num_pages);
-	errno = ENOMEM;
-	return NULL;
 }
 
-static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
+static void bbuddy_free_chunk(struct uk_bbpalloc *b, void *obj, size_t order)
 {
-	struct uk_bbpalloc *b;
 	chunk_head_t *freed_ch, *to_merge_ch;
 	chunk_tail_t *freed_ct;
 	unsigned long mask;
 
-	UK_ASSERT(a != NULL);
-
-	uk_alloc_stats_count_pfree(a, obj, num_pages);
-	b = (struct uk_bbpalloc *)&a->priv;
-
-	size_t order = (size_t)num_pages_to_order(num_pages);
-
-	/* if the object is not page aligned it was clearly not from us */
-	UK_ASSERT((((uintptr_t)obj) & (__PAGE_SIZE - 1)) == 0);
-
 	/* First free the chunk */
 	map_free(b, (uintptr_t)obj, 1UL << order);
 
@@ -357,6 +357,176 @@ static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
 	b->free_head[order] = freed_ch;
 }
 
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+static void bbuddy_mag_refill(struct uk_bbpalloc *b,
+			      struct bbuddy_magazine *m, size_t order)
+{
+	void *chunk;
+
+	UK_ASSERT(m->count == 0);
+
+	ukarch_spin_lock(&b->lock);
+	while (m->count < MAGAZINE_BATCH) {
+		chunk = bbuddy_alloc_chunk(b, order);
+		if (unlikely(!chunk))
+			break;
+		m->chunk[m->count++] = chunk;
+	}
+	ukarch_spin_unlock(&b->lock);
+}
+
+static void bbuddy_mag_flush(struct uk_bbpalloc *b,
+			     struct bbuddy_magazine *m, size_t order,
+			     unsigned int count)
+{
+	UK_ASSERT(count <= m->count);
+
+	ukarch_spin_lock(&b->lock);
+	while (count--)
+		bbuddy_free_chunk(b, m->chunk[--m->count], order);
+	ukarch_spin_unlock(&b->lock);
+}
+
+/* Return all chunks cached by the magazines of the current LCPU to the
+ * buddy lists so that they can be merged into bigger chunks again.
+ */
+static int bbuddy_mag_drain(struct uk_bbpalloc *b)
+{
+	struct bbuddy_magazine *m;
+	int drained = 0;
+	size_t order;
+
+	for (order = 0; order < MAGAZINE_ORDERS; order++) {
+		m = &ukplat_per_lcpu_array_current(b->mag, order);
+		if (m->count) {
+			bbuddy_mag_flush(b, m, order, m->count);
+			drained = 1;
+		}
+	}
+
+	return drained;
+}
+
+/* Number of pages that are cached by the magazines of the current LCPU.
+ * Only these can be drained by an allocation on this LCPU. The magazines
+ * of remote LCPUs are private to them and are not counted as available.
+ */
+static unsigned long bbuddy_mag_pages(struct uk_bbpalloc *b)
+{
+	unsigned long pages = 0;
+	unsigned long flags;
+	size_t order;
+
+	flags = ukplat_lcpu_save_irqf();
+	for (order = 0; order < MAGAZINE_ORDERS; order++)
+		pages += (unsigned long) ukplat_per_lcpu_array_current(b->mag,
+						order).count << order;
+	ukplat_lcpu_restore_irqf(flags);
+
+	return pages;
+}
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+
+static void *bbuddy_palloc(struct uk_alloc *a, unsigned long num_pages)
+{
+	struct uk_bbpalloc *b;
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	struct bbuddy_magazine *m;
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+	unsigned long flags;
+	void *chunk;
+
+	UK_ASSERT(a != NULL);
+	b = (struct uk_bbpalloc *)&a->priv;
+
+	size_t order = (size_t)num_pages_to_order(num_pages);
+
+	flags = ukplat_lcpu_save_irqf();
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	if (order < MAGAZINE_ORDERS) {
+		m = &ukplat_per_lcpu_array_current(b->mag, order);
+		if (unlikely(m->count == 0))
+			bbuddy_mag_refill(b, m, order);
+
+		if (likely(m->count > 0)) {
+			chunk = m->chunk[--m->count];
+			ukplat_lcpu_restore_irqf(flags);
+			goto out;
+		}
+	}
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+
+	ukarch_spin_lock(&b->lock);
+	chunk = bbuddy_alloc_chunk(b, order);
+	ukarch_spin_unlock(&b->lock);
+
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	/* Chunks in our magazines may prevent the buddy lists from
+	 * providing a bigger chunk. Drain them and try once more.
+	 */
+	if (unlikely(!chunk) && bbuddy_mag_drain(b)) {
+		ukarch_spin_lock(&b->lock);
+		chunk = bbuddy_alloc_chunk(b, order);
+		ukarch_spin_unlock(&b->lock);
+	}
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+	ukplat_lcpu_restore_irqf(flags);
+
+	if (unlikely(!chunk))
+		goto no_memory;
+
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+out:
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+	uk_alloc_stats_count_palloc(a, chunk, num_pages);
+	return chunk;
+
+no_memory:
+	uk_pr_warn("%"__PRIuptr": Cannot handle palloc request of order %"__PRIsz": Out of memory\n",
+		   (uintptr_t)a, order);
+
+	uk_alloc_stats_count_penomem(a, num_pages);
+	errno = ENOMEM;
+	return NULL;
+}
+
+static void bbuddy_pfree(struct uk_alloc *a, void *obj, unsigned long num_pages)
+{
+	struct uk_bbpalloc *b;
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	struct bbuddy_magazine *m;
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+	unsigned long flags;
+
+	UK_ASSERT(a != NULL);
+
+	uk_alloc_stats_count_pfree(a, obj, num_pages);
+	b = (struct uk_bbpalloc *)&a->priv;
+
+	size_t order = (size_t)num_pages_to_order(num_pages);
+
+	/* if the object is not page aligned it was clearly not from us */
+	UK_ASSERT((((uintptr_t)obj) & (__PAGE_SIZE - 1)) == 0);
+
+	flags = ukplat_lcpu_save_irqf();
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	if (order < MAGAZINE_ORDERS) {
+		m = &ukplat_per_lcpu_array_current(b->mag, order);
+		if (unlikely(m->count == MAGAZINE_SIZE))
+			bbuddy_mag_flush(b, m, order, MAGAZINE_BATCH);
+
+		m->chunk[m->count++] = obj;
+		ukplat_lcpu_restore_irqf(flags);
+		return;
+	}
+#endif /* CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
+
+	ukarch_spin_lock(&b->lock);
+	bbuddy_free_chunk(b, obj, order);
+	ukarch_spin_unlock(&b->lock);
+	ukplat_lcpu_restore_irqf(flags);
+}
+
 static long bbuddy_pmaxalloc(struct uk_alloc *a)
 {
 	struct uk_bbpalloc *b;
@@ -384,7 +554,11 @@ static long bbuddy_pavailmem(struct uk_alloc *a)
 	UK_ASSERT(a != NULL);
 	b = (struct uk_bbpalloc *)&a->priv;
 
+#if CONFIG_LIBUKALLOCBBUDDY_MAGAZINES
+	return (long) (b->nr_free_pages + bbuddy_mag_pages(b));
+#else /* !CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
 	return (long) b->nr_free_pages;
+#endif /* !CONFIG_LIBUKALLOCBBUDDY_MAGAZINES */
 }
 
 static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
@@ -396,6 +570,7 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 	chunk_head_t *ch;
 	chunk_tail_t *ct;
 	uintptr_t min, max, range;
+	unsigned long flags;
 
 	UK_ASSERT(a != NULL);
 	UK_ASSERT(base != NULL);
@@ -447,14 +622,17 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 	 * Initialize region's bitmap
 	 */
 	memr->first_page = min;
-	/* add to list */
-	memr->next = b->memr_head;
-	b->memr_head = memr;
 
 	/* All allocated by default. */
 	memset(memr->mm_alloc_bitmap, (unsigned char) ~0,
 			memr->mm_alloc_bitmap_size);
 
+	ukplat_spin_lock_irqsave(&b->lock, flags);
+
+	/* add to list */
+	memr->next = b->memr_head;
+	b->memr_head = memr;
+
 	/* free up the memory we've been given to play with */
 	map_free(b, min, memr->nr_pages);
 
@@ -486,6 +664,7 @@ static int bbuddy_addmem(struct uk_alloc *a, void *base, size_t len)
 		count++;
 	}
 
+	ukplat_spin_unlock_irqrestore(&b->lock, flags);
 	return 0;
 }
 
@@ -524,6 +703,7 @@ struct uk_alloc *uk_allocbbuddy_init(void *base, size_t len)
 		b->free_tail[i].next = NULL;
 	}
 	b->memr_head = NULL;
+	ukarch_spin_init(&b->lock);
 
 	/* initialize and register allocator interface */
 	uk_alloc_init_palloc(a, bbuddy_palloc, bbuddy_pfree,
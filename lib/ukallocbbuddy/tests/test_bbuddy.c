@@ -0,0 +1,237 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/allocbbuddy.h>
+#include <uk/arch/limits.h>
+#include <uk/essentials.h>
+#if CONFIG_HAVE_SMP
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/time.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
+#endif /* CONFIG_HAVE_SMP */
+
+#define HEAP_PAGES	1024
+
+static struct uk_alloc *bbuddy;
+
+UK_TESTCASE(ukallocbbuddy, orders)
+{
+	unsigned long num_pages;
+	long avail;
+	void *ptr;
+
+	avail = uk_alloc_pavailmem(bbuddy);
+
+	for (num_pages = 1; num_pages <= 32; num_pages <<= 1) {
+		ptr = uk_palloc(bbuddy, num_pages);
+		UK_TEST_EXPECT_NOT_NULL(ptr);
+		UK_TEST_EXPECT_ZERO((__uptr) ptr
+				    & (num_pages * __PAGE_SIZE - 1));
+		memset(ptr, 0xa5, num_pages * __PAGE_SIZE);
+		uk_pfree(bbuddy, ptr, num_pages);
+	}
+
+	/* Chunks cached in our magazines still count as available */
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_pavailmem(bbuddy), avail);
+}
+
+UK_TESTCASE(ukallocbbuddy, split)
+{
+	static const unsigned long orders[] = { 0, 3, 1, 0, 2, 5, 0, 1 };
+	void *ptr[ARRAY_SIZE(orders)];
+	__uptr start[ARRAY_SIZE(orders)], end[ARRAY_SIZE(orders)];
+	unsigned int i, j;
+	__sz len;
+	long avail;
+
+	/* Chunks of mixed orders are split off bigger free chunks. Each one
+	 * must be aligned to its size and must not overlap the others.
+	 */
+	avail = uk_alloc_pavailmem(bbuddy);
+	for (i = 0; i < ARRAY_SIZE(orders); ++i) {
+		ptr[i] = uk_palloc(bbuddy, 1UL << orders[i]);
+		UK_TEST_ASSERT(ptr[i] != NULL);
+		len = __PAGE_SIZE << orders[i];
+		start[i] = (__uptr) ptr[i];
+		end[i] = start[i] + len;
+		UK_TEST_EXPECT_ZERO(start[i] & (len - 1));
+	}
+
+	for (i = 0; i < ARRAY_SIZE(orders); ++i)
+		for (j = i + 1; j < ARRAY_SIZE(orders); ++j)
+			UK_TEST_EXPECT(end[i] <= start[j] ||
+				       end[j] <= start[i]);
+
+	for (i = ARRAY_SIZE(orders); i-- > 0;)
+		uk_pfree(bbuddy, ptr[i], 1UL << orders[i]);
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_pavailmem(bbuddy), avail);
+}
+
+UK_TESTCASE(ukallocbbuddy, exhaust)
+{
+	void *head = NULL, *ptr;
+	long avail, count = 0;
+
+	/* Allocate every single page, chaining them through their first
+	 * word, and give them back. This cycles chunks through the buddy
+	 * lists and the magazines until memory is exhausted.
+	 */
+	avail = uk_alloc_pavailmem(bbuddy);
+	while ((ptr = uk_palloc(bbuddy, 1))) {
+		*(void **) ptr = head;
+		head = ptr;
+		count++;
+	}
+	UK_TEST_EXPECT_SNUM_EQ(count, avail);
+	UK_TEST_EXPECT_ZERO(uk_alloc_pavailmem(bbuddy));
+
+	while (head) {
+		ptr = head;
+		head = *(void **) ptr;
+		uk_pfree(bbuddy, ptr, 1);
+	}
+	UK_TEST_EXPECT_SNUM_EQ(uk_alloc_pavailmem(bbuddy), avail);
+
+	/* Cached single pages must not prevent bigger allocations */
+	ptr = uk_palloc(bbuddy, 64);
+	UK_TEST_EXPECT_NOT_NULL(ptr);
+	if (ptr)
+		uk_pfree(bbuddy, ptr, 64);
+}
+
+/* Sets up the allocator under test on a heap of its own, taken from the
+ * default allocator, so that the cases know how much memory it manages.
+ */
+static int bbuddy_heap_init(struct uk_testsuite *suite __unused)
+{
+	void *heap;
+
+	if (bbuddy)
+		return 0;
+
+	heap = uk_palloc(uk_alloc_get_default(), HEAP_PAGES);
+	if (!heap)
+		return -ENOMEM;
+	bbuddy = uk_allocbbuddy_init(heap, HEAP_PAGES * __PAGE_SIZE);
+	return bbuddy ? 0 : -ENOMEM;
+}
+
+uk_testsuite_register(ukallocbbuddy, bbuddy_heap_init);
+
+#if CONFIG_HAVE_SMP
+#define STACK_PAGES	4
+#define SCALE_ROUNDS	10000
+#define SCALE_BATCH	16
+
+/* Page throughput with 1 to ukplat_lcpu_count() LCPUs that allocate and
+ * free batches of single pages at the same time. This is kept apart from
+ * the functional cases above, it only reports numbers.
+ */
+struct scale_arg {
+	unsigned int ready;
+	unsigned int go;
+	unsigned int done;
+};
+
+static void scale_pages(void)
+{
+	void *ptr[SCALE_BATCH];
+	int r, i;
+
+	for (r = 0; r < SCALE_ROUNDS; ++r) {
+		for (i = 0; i < SCALE_BATCH; ++i)
+			ptr[i] = uk_palloc(bbuddy, 1);
+		for (i = 0; i < SCALE_BATCH; ++i)
+			if (ptr[i])
+				uk_pfree(bbuddy, ptr[i], 1);
+	}
+}
+
+static void scale_remote(struct __regs *regs __unused, void *user)
+{
+	struct scale_arg *arg = (struct scale_arg *) user;
+
+	ukarch_inc(&arg->ready);
+	while (!ukarch_load_n(&arg->go))
+		ukarch_spinwait();
+
+	scale_pages();
+	ukarch_inc(&arg->done);
+}
+
+static int scale_start_lcpus(void)
+{
+	void *sp[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int i;
+	void *stack;
+	int rc;
+
+	for (i = 0; i < ukplat_lcpu_count() - 1; ++i) {
+		stack = uk_palloc(uk_alloc_get_default(), STACK_PAGES);
+		if (!stack)
+			return -ENOMEM;
+		sp[i] = (__u8 *) stack + STACK_PAGES * __PAGE_SIZE;
+	}
+
+	rc = ukplat_lcpu_start(NULL, NULL, sp, NULL, 0);
+	if (rc)
+		return rc;
+
+	/* Functions are only run on LCPUs that are online */
+	return ukplat_lcpu_wait(NULL, NULL, 0);
+}
+
+UK_TESTCASE(ukallocbbuddy_scaling, pages_per_sec)
+{
+	static struct scale_arg arg;
+	struct ukplat_lcpu_func fn = { .fn = scale_remote, .user = &arg };
+	__lcpuidx idx[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int ncpus, num, i, n;
+	__nsec start, t;
+	__u64 pages;
+	int rc;
+
+	rc = scale_start_lcpus();
+	UK_TEST_ASSERT(rc == 0);
+
+	for (ncpus = 1; ncpus <= ukplat_lcpu_count(); ++ncpus) {
+		memset(&arg, 0, sizeof(arg));
+		num = ncpus - 1;
+		for (i = 0, n = 0; n < num; ++i)
+			if (i != ukplat_lcpu_idx())
+				idx[n++] = i;
+
+		if (num) {
+			rc = ukplat_lcpu_run(idx, &n, &fn, 0);
+			UK_TEST_ASSERT(rc == 0);
+		}
+
+		while (ukarch_load_n(&arg.ready) < num)
+			ukarch_spinwait();
+
+		start = ukplat_monotonic_clock();
+		ukarch_store_n(&arg.go, 1);
+		scale_pages();
+		while (ukarch_load_n(&arg.done) < num)
+			ukarch_spinwait();
+		t = ukplat_monotonic_clock() - start;
+
+		pages = (__u64) ncpus * SCALE_ROUNDS * SCALE_BATCH;
+		if (t)
+			pages = pages * UKARCH_NSEC_PER_SEC / t;
+		uk_test_printf("%u lcpu(s): %"__PRIu64" pages/s\n", ncpus,
+			       pages);
+	}
+}
+
+uk_testsuite_register(ukallocbbuddy_scaling, bbuddy_heap_init);
+#endif /* CONFIG_HAVE_SMP */
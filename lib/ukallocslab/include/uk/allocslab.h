@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __LIBUKALLOCSLAB_H__
+#define __LIBUKALLOCSLAB_H__
+
+#include <uk/alloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Creates a size-class slab allocator on top of a parent allocator.
+ * Small allocations are served from slabs that are made of pages taken
+ * from the parent with uk_palloc(). Bigger allocations as well as
+ * page allocations are forwarded to the parent.
+ * The returned allocator is registered with ukalloc.
+ *
+ * @param parent
+ *  Allocator that provides the pages (e.g., ukallocbbuddy).
+ * @return
+ *  - (NULL): If the allocator metadata could not be allocated.
+ *  - pointer to uk_alloc interface of the slab allocator.
+ */
+struct uk_alloc *uk_allocslab_init(struct uk_alloc *parent);
+
+/**
+ * Returns the number of bytes that are usable in an allocation
+ * that was returned by a slab allocator.
+ *
+ * @param a
+ *  Slab allocator that handed out the allocation.
+ * @param ptr
+ *  Pointer returned by uk_malloc() and friends.
+ * @return
+ *  Usable size of the allocation in bytes, 0 if ptr is NULL.
+ */
+__sz uk_allocslab_usable_size(struct uk_alloc *a, const void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBUKALLOCSLAB_H__ */
@@ -0,0 +1,539 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/* ukallocslab is a size-class slab allocator that is stacked on top of a
+ * page allocator (e.g., ukallocbbuddy or ukallocregion).
+ *
+ * Small requests are rounded up to one of a fixed set of size classes. Each
+ * size class owns a set of slabs. A slab is SLAB_PAGES pages that were taken
+ * from the parent with uk_palloc() and that are aligned to the size of the
+ * slab. The slab header is placed at the start of the slab so that the slab
+ * of any object can be found by aligning the object address down to the slab
+ * size. Objects that start on a page boundary can only be found in the second
+ * page of a slab, so the preceding page holds the header for them as well.
+ *
+ * Requests that do not fit into the biggest size class (or that need an
+ * alignment bigger than the one of the size classes) are satisfied with
+ * whole pages from the parent. Such allocations carry a header that starts
+ * with the same field as the slab header (`sc`), which is NULL for them.
+ * The header is either at the start of a page that is aligned like a slab
+ * or, for page-aligned pointers, in the preceding page:
+ *
+ *      slab page                         large allocation
+ *   +-------------------+             +-------------------+
+ *   | struct slab       |             | struct large_hdr  |
+ *   |  sc = size class  |             |  sc = NULL        |
+ *   +-------------------+             +-------------------+
+ *   | OBJECT 1          |             |  // padding //    |
+ *   +-------------------+             +===================+ <- ptr
+ *   | OBJECT 2          |             |                   |
+ *   +-------------------+             |  user data        |
+ *   | ...               |             |                   |
+ *   v                   v             v                   v
+ *
+ * For allocations with an alignment of a page or more, and for those whose
+ * first page is not aligned like a slab, the returned pointer is page-aligned
+ * and the large header is stored at the start of the page preceding it.
+ *
+ * Allocation and release of slab objects is O(1): each slab keeps a LIFO
+ * list of released objects and a bump pointer to the part of the page that
+ * was never handed out, so that a fresh slab does not need to be pre-formatted.
+ * Slabs with free objects are kept on a per-class `partial` list, full slabs
+ * are not tracked at all. Completely free slabs are returned to the parent,
+ * except for a few (CONFIG_LIBUKALLOCSLAB_KEEP_EMPTY) that are kept as cache.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <uk/essentials.h>
+#include <uk/alloc_impl.h>
+#include <uk/allocslab.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
+#include <uk/list.h>
+#include <uk/print.h>
+
+/* Alignment of slab objects in all classes but the smallest one */
+#define SLAB_ALIGN		16
+
+/* Two pages per slab let objects of up to half a page share a slab */
+#define SLAB_PAGES		2
+#define SLAB_SIZE		(SLAB_PAGES * __PAGE_SIZE)
+
+struct slab_class {
+	__sz obj_len;
+	unsigned int obj_count;		/* objects per slab */
+
+	struct uk_list_head partial;	/* slabs with used and free objects */
+	struct uk_list_head empty;	/* completely free slabs */
+	unsigned int empty_count;
+};
+
+struct slab {
+	struct slab_class *sc;		/* must be the first field */
+
+	struct uk_list_head list;
+	void *free_obj;			/* LIFO list of released objects */
+	void *unused;			/* objects that were never handed out */
+	unsigned int inuse;
+	void *base;			/* pages taken from the parent */
+};
+
+struct large_hdr {
+	struct slab_class *sc;		/* always NULL, must be first field */
+
+	void *base;
+	unsigned long num_pages;
+};
+
+/* LARGE_HDR_LEN is a power of two that is big enough for the header */
+#define LARGE_HDR_LEN		32
+
+UK_CTASSERT(__offsetof(struct slab, sc) == 0);
+UK_CTASSERT(__offsetof(struct large_hdr, sc) == 0);
+UK_CTASSERT(sizeof(struct large_hdr) <= LARGE_HDR_LEN);
+
+#define SLAB_HDR_LEN		ALIGN_UP(sizeof(struct slab), SLAB_ALIGN)
+#define SLAB_OBJ_AREA		(SLAB_SIZE - SLAB_HDR_LEN)
+
+/* Biggest object size such that `n` objects fit into one slab */
+#define SLAB_FIT(n)		ALIGN_DOWN(SLAB_OBJ_AREA / (n), SLAB_ALIGN)
+
+static const __sz slab_class_len[] = {
+	8, 16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256, 320, 384, 448, 512,
+	640, 768, 1024, SLAB_FIT(6), SLAB_FIT(5), SLAB_FIT(4), SLAB_FIT(3),
+	SLAB_FIT(2)
+};
+
+
+#define SLAB_NR_CLASSES		ARRAY_SIZE(slab_class_len)
+#define SLAB_MAX_LEN		SLAB_FIT(2)
+
+/* Half a page must not take a whole page from the parent */
+UK_CTASSERT(SLAB_FIT(3) >= __PAGE_SIZE / 2);
+
+/* Lookup table from (size + 7) / 8 to size class index */
+#define SLAB_IDX_LEN		((SLAB_MAX_LEN + 7) / 8 + 1)
+
+struct uk_allocslab {
+	struct uk_alloc self;
+
+	struct uk_alloc *parent;
+	__u8 class_idx[SLAB_IDX_LEN];
+	struct slab_class classes[SLAB_NR_CLASSES];
+};
+
+static inline struct uk_allocslab *ukalloc2slab(struct uk_alloc *a)
+{
+	UK_ASSERT(a);
+	return __containerof(a, struct uk_allocslab, self);
+}
+
+static inline struct slab_class *size2class(struct uk_allocslab *s, __sz size)
+{
+	UK_ASSERT(size <= SLAB_MAX_LEN);
+
+	return &s->classes[s->class_idx[(size + 7) >> 3]];
+}
+
+/* Returns either a `struct slab` or a `struct large_hdr` */
+static inline struct slab *ptr2slab(const void *ptr)
+{
+	if (PAGE_ALIGNED((__uptr) ptr))
+		return (struct slab *) ((__uptr) ptr - __PAGE_SIZE);
+
+	return (struct slab *) ALIGN_DOWN((__uptr) ptr, SLAB_SIZE);
+}
+
+static struct slab *slab_create(struct uk_allocslab *s,
+				struct slab_class *sc)
+{
+	struct slab *slab;
+	void *base;
+
+	/* Buddy allocators return naturally aligned chunks. For other
+	 * parents, take enough pages to align the slab ourselves.
+	 */
+	base = uk_palloc(s->parent, SLAB_PAGES);
+	if (unlikely(!base))
+		return NULL;
+
+	if (unlikely(!IS_ALIGNED((__uptr) base, SLAB_SIZE))) {
+		uk_pfree(s->parent, base, SLAB_PAGES);
+		base = uk_palloc(s->parent, 2 * SLAB_PAGES - 1);
+		if (unlikely(!base))
+			return NULL;
+	}
+
+	slab = (struct slab *) ALIGN_UP((__uptr) base, SLAB_SIZE);
+	slab->base     = base;
+	slab->sc       = sc;
+	slab->free_obj = NULL;
+	slab->unused   = (void *) ((__uptr) slab + SLAB_HDR_LEN);
+	slab->inuse    = 0;
+	return slab;
+}
+
+static void *slab_class_alloc(struct uk_allocslab *s, struct slab_class *sc)
+{
+	struct slab *slab;
+	void *obj;
+
+	if (likely(!uk_list_empty(&sc->partial))) {
+		slab = uk_list_first_entry(&sc->partial, struct slab, list);
+	} else if (!uk_list_empty(&sc->empty)) {
+		slab = uk_list_first_entry(&sc->empty, struct slab, list);
+		uk_list_del(&slab->list);
+		sc->empty_count--;
+		uk_list_add(&slab->list, &sc->partial);
+	} else {
+		slab = slab_create(s, sc);
+		if (unlikely(!slab))
+			return NULL;
+		uk_list_add(&slab->list, &sc->partial);
+	}
+
+	UK_ASSERT(slab->inuse < sc->obj_count);
+
+	if (slab->free_obj) {
+		obj = slab->free_obj;
+		slab->free_obj = *((void **) obj);
+	} else {
+		obj = slab->unused;
+		slab->unused = (void *) ((__uptr) obj + sc->obj_len);
+	}
+
+	/* Full slabs are not tracked. They come back to the partial list
+	 * as soon as one of their objects is released.
+	 */
+	if (++slab->inuse == sc->obj_count)
+		uk_list_del(&slab->list);
+
+	return obj;
+}
+
+static void slab_class_free(struct uk_allocslab *s, struct slab *slab,
+			    void *obj)
+{
+	struct slab_class *sc = slab->sc;
+
+	UK_ASSERT(slab->inuse > 0);
+	UK_ASSERT(((__uptr) obj - ((__uptr) slab + SLAB_HDR_LEN))
+		  % sc->obj_len == 0);
+
+	*((void **) obj) = slab->free_obj;
+	slab->free_obj = obj;
+
+	if (slab->inuse-- == sc->obj_count) {
+		/* The slab was full before */
+		uk_list_add(&slab->list, &sc->partial);
+	}
+
+	if (slab->inuse == 0) {
+		uk_list_del(&slab->list);
+		if (sc->empty_count < CONFIG_LIBUKALLOCSLAB_KEEP_EMPTY) {
+			uk_list_add(&slab->list, &sc->empty);
+			sc->empty_count++;
+		} else {
+			uk_pfree(s->parent, slab->base,
+				 (slab->base == slab) ? SLAB_PAGES
+						      : 2 * SLAB_PAGES - 1);
+		}
+	}
+}
+
+static void *large_alloc(struct uk_allocslab *s, __sz align, __sz size)
+{
+	struct large_hdr *hdr;
+	unsigned long num_pages;
+	__uptr base, intptr;
+	__sz realsize;
+
+	if (align < __PAGE_SIZE) {
+		/* The header is stored at the start of the first page */
+		align = MAX(align, (__sz) LARGE_HDR_LEN);
+		realsize = LARGE_HDR_LEN + align + size;
+	} else {
+		/* The returned pointer is page-aligned so that the header
+		 * is stored in the preceding page.
+		 */
+		realsize = align + size;
+	}
+
+	/* check for overflow */
+	if (unlikely(realsize < size))
+		return NULL;
+
+	num_pages = PAGE_ALIGN_UP(realsize) >> __PAGE_SHIFT;
+	base = (__uptr) uk_palloc(s->parent, num_pages);
+	if (unlikely(!base))
+		return NULL;
+
+	/* ptr2slab() looks for the header of a pointer within the first
+	 * page only if that page is aligned like a slab. Otherwise, return
+	 * a page-aligned pointer with the header in the first page.
+	 */
+	if (align < __PAGE_SIZE && !IS_ALIGNED(base, SLAB_SIZE)) {
+		uk_pfree(s->parent, (void *) base, num_pages);
+
+		align = __PAGE_SIZE;
+		realsize = __PAGE_SIZE + size;
+		if (unlikely(realsize < size))
+			return NULL;
+
+		num_pages = PAGE_ALIGN_UP(realsize) >> __PAGE_SHIFT;
+		base = (__uptr) uk_palloc(s->parent, num_pages);
+		if (unlikely(!base))
+			return NULL;
+	}
+
+	if (align < __PAGE_SIZE)
+		intptr = ALIGN_UP(base + LARGE_HDR_LEN, align);
+	else
+		intptr = ALIGN_UP(base + __PAGE_SIZE, align);
+
+	hdr = (struct large_hdr *) ptr2slab((void *) intptr);
+	UK_ASSERT((__uptr) hdr >= base);
+
+	hdr->sc        = NULL;
+	hdr->base      = (void *) base;
+	hdr->num_pages = num_pages;
+	return (void *) intptr;
+}
+
+static inline __sz large_len(struct large_hdr *hdr, const void *ptr)
+{
+	return (__uptr) hdr->base + (hdr->num_pages << __PAGE_SHIFT)
+		- (__uptr) ptr;
+}
+
+__sz uk_allocslab_usable_size(struct uk_alloc *a __maybe_unused,
+			      const void *ptr)
+{
+	struct slab *slab;
+
+	UK_ASSERT(a);
+
+	if (!ptr)
+		return 0;
+
+	slab = ptr2slab(ptr);
+	if (slab->sc)
+		return slab->sc->obj_len;
+
+	return large_len((struct large_hdr *) slab, ptr);
+}
+
+static void *slab_do_alloc(struct uk_allocslab *s, __sz align, __sz size,
+			   __sz *alen)
+{
+	struct slab_class *sc;
+	void *obj;
+
+	if (likely(size <= SLAB_MAX_LEN && align <= SLAB_ALIGN)) {
+		/* All classes but the smallest are multiples of SLAB_ALIGN */
+		if (align > sizeof(void *))
+			size = ALIGN_UP(size, SLAB_ALIGN);
+
+		sc = size2class(s, size);
+		obj = slab_class_alloc(s, sc);
+		*alen = sc->obj_len;
+	} else {
+		obj = large_alloc(s, align, size);
+		*alen = (obj) ? large_len((struct large_hdr *) ptr2slab(obj),
+					  obj)
+			      : size;
+	}
+
+	return obj;
+}
+
+static void *slab_malloc(struct uk_alloc *a, __sz size)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	__sz alen;
+	void *obj;
+
+	obj = slab_do_alloc(s, sizeof(void *), size, &alen);
+	if (unlikely(!obj)) {
+		uk_alloc_stats_count_enomem(a, size);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	uk_alloc_stats_count_alloc(a, obj, alen);
+	return obj;
+}
+
+static int slab_posix_memalign(struct uk_alloc *a, void **memptr,
+			       __sz align, __sz size)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	__sz alen;
+	void *obj;
+
+	if (((align - 1) & align) != 0
+	    || (align % sizeof(void *)) != 0)
+		return EINVAL;
+
+	/* Leave memptr untouched. See comment in uk_posix_memalign_ifpages. */
+	if (!size)
+		return EINVAL;
+
+	obj = slab_do_alloc(s, align, size, &alen);
+	if (unlikely(!obj)) {
+		uk_alloc_stats_count_enomem(a, size);
+		return ENOMEM;
+	}
+
+	uk_alloc_stats_count_alloc(a, obj, alen);
+	*memptr = obj;
+	return 0;
+}
+
+static void slab_free(struct uk_alloc *a, void *ptr)
+{
+	struct uk_allocslab *s = ukalloc2slab(a);
+	struct large_hdr *hdr;
+	struct slab *slab;
+
+	if (!ptr)
+		return;
+
+	slab = ptr2slab(ptr);
+	if (slab->sc) {
+		uk_alloc_stats_count_free(a, ptr, slab->sc->obj_len);
+		slab_class_free(s, slab, ptr);
+		return;
+	}
+
+	hdr = (struct large_hdr *) slab;
+	UK_ASSERT(hdr->base != NULL);
+	UK_ASSERT(hdr->num_pages != 0);
+
+	uk_alloc_stats_count_free(a, ptr, large_len(hdr, ptr));
+	uk_pfree(s->parent, hdr->base, hdr->num_pages);
+}
+
+static void *slab_realloc(struct uk_alloc *a, void *ptr, __sz size)
+{
+	__sz alen;
+	void *retptr;
+
+	if (!ptr)
+		return slab_malloc(a, size);
+
+	if (!size) {
+		slab_free(a, ptr);
+		return NULL;
+	}
+
+	/* Keep the allocation if it is big enough and shrinking would not
+	 * move it to a smaller size class.
+	 */
+	alen = uk_allocslab_usable_size(a, ptr);
+	if (size <= alen && (alen > SLAB_MAX_LEN || size > alen / 2))
+		return ptr;
+
+	retptr = slab_malloc(a, size);
+	if (!retptr)
+		return NULL;
+
+	memcpy(retptr, ptr, MIN(size, alen));
+
+	slab_free(a, ptr);
+	return retptr;
+}
+
+/* Page allocations are directly forwarded to the parent */
+static void *slab_palloc(struct uk_alloc *a, unsigned long num_pages)
+{
+	return uk_palloc(ukalloc2slab(a)->parent, num_pages);
+}
+
+static void slab_pfree(struct uk_alloc *a, void *ptr, unsigned long num_pages)
+{
+	uk_pfree(ukalloc2slab(a)->parent, ptr, num_pages);
+}
+
+static __ssz slab_availmem(struct uk_alloc *a)
+{
+	return uk_alloc_availmem(ukalloc2slab(a)->parent);
+}
+
+static __ssz slab_maxalloc(struct uk_alloc *a)
+{
+	return uk_alloc_maxalloc(ukalloc2slab(a)->parent);
+}
+
+static long slab_pavailmem(struct uk_alloc *a)
+{
+	return uk_alloc_pavailmem(ukalloc2slab(a)->parent);
+}
+
+static long slab_pmaxalloc(struct uk_alloc *a)
+{
+	return uk_alloc_pmaxalloc(ukalloc2slab(a)->parent);
+}
+
+static int slab_addmem(struct uk_alloc *a, void *base, __sz len)
+{
+	return uk_alloc_addmem(ukalloc2slab(a)->parent, base, len);
+}
+
+struct uk_alloc *uk_allocslab_init(struct uk_alloc *parent)
+{
+	struct uk_allocslab *s;
+	struct uk_alloc *a;
+	unsigned int i, c;
+	unsigned long num_pages;
+
+	UK_ASSERT(parent);
+
+	num_pages = PAGE_ALIGN_UP(sizeof(*s)) >> __PAGE_SHIFT;
+	s = uk_palloc(parent, num_pages);
+	if (!s)
+		return NULL;
+
+	memset(s, 0, sizeof(*s));
+	s->parent = parent;
+	a = &s->self;
+
+	for (c = 0; c < SLAB_NR_CLASSES; ++c) {
+		UK_ASSERT(c == 0 || slab_class_len[c] > slab_class_len[c - 1]);
+		UK_ASSERT(c == 0 || slab_class_len[c] % SLAB_ALIGN == 0);
+
+		s->classes[c].obj_len   = slab_class_len[c];
+		s->classes[c].obj_count = SLAB_OBJ_AREA / slab_class_len[c];
+		UK_INIT_LIST_HEAD(&s->classes[c].partial);
+		UK_INIT_LIST_HEAD(&s->classes[c].empty);
+	}
+
+	/* Pre-compute the size to class mapping so that a lookup is just a
+	 * single table access. Size 0 is served by the smallest class.
+	 */
+	for (i = 0, c = 0; i < SLAB_IDX_LEN; ++i) {
+		while (slab_class_len[c] < (i << 3))
+			c++;
+		s->class_idx[i] = c;
+	}
+
+	uk_alloc_init_malloc(a, slab_malloc, uk_calloc_compat, slab_realloc,
+			     slab_free, slab_posix_memalign, uk_memalign_compat,
+			     slab_maxalloc, slab_availmem, slab_addmem);
+
+	/* Page allocations do not need to go through the large object path */
+	a->palloc    = slab_palloc;
+	a->pfree     = slab_pfree;
+	a->pavailmem = slab_pavailmem;
+	a->pmaxalloc = slab_pmaxalloc;
+
+	uk_pr_info("Initialize slab allocator on %p: %u size classes (%"__PRIsz
+		   " - %"__PRIsz" B)\n", parent, (unsigned int) SLAB_NR_CLASSES,
+		   slab_class_len[0], (__sz) SLAB_MAX_LEN);
+	return a;
+}
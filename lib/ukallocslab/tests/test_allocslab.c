@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/test.h>
+#include <uk/alloc_impl.h>
+#include <uk/allocslab.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/time.h>
+#include <uk/essentials.h>
+
+static struct uk_alloc *slab;
+
+UK_TESTCASE(ukallocslab, size_classes)
+{
+	__sz size;
+	void *ptr;
+
+	for (size = 1; size <= 2 * __PAGE_SIZE; size += 7) {
+		ptr = uk_malloc(slab, size);
+		UK_TEST_EXPECT_NOT_NULL(ptr);
+		UK_TEST_EXPECT_SNUM_GE(uk_allocslab_usable_size(slab, ptr),
+				       size);
+		if (size > sizeof(void *))
+			UK_TEST_EXPECT_ZERO((__uptr) ptr & 15);
+		memset(ptr, 0xa5, size);
+		uk_free(slab, ptr);
+	}
+}
+
+UK_TESTCASE(ukallocslab, reuse)
+{
+	void *keep, *ptr;
+
+	keep = uk_malloc(slab, 48);
+	ptr = uk_malloc(slab, 48);
+	UK_TEST_ASSERT(keep != NULL && ptr != NULL);
+
+	/* Objects of a class share the slab page after its header */
+	UK_TEST_EXPECT((__uptr) keep + 48 <= (__uptr) ptr ||
+		       (__uptr) ptr + 48 <= (__uptr) keep);
+	UK_TEST_EXPECT_SNUM_EQ(PAGE_ALIGN_DOWN((__uptr) keep),
+			       PAGE_ALIGN_DOWN((__uptr) ptr));
+	UK_TEST_EXPECT((__uptr) ptr & (__PAGE_SIZE - 1));
+
+	/* Released objects are handed out again first */
+	uk_free(slab, ptr);
+	UK_TEST_EXPECT_PTR_EQ(uk_malloc(slab, 48), ptr);
+
+	uk_free(slab, ptr);
+	uk_free(slab, keep);
+}
+
+UK_TESTCASE(ukallocslab, half_page)
+{
+	void *ptr[3];
+	int i;
+
+	/* Several half-page objects share a slab instead of taking a
+	 * page each from the parent
+	 */
+	for (i = 0; i < 3; ++i) {
+		ptr[i] = uk_malloc(slab, __PAGE_SIZE / 2);
+		UK_TEST_ASSERT(ptr[i] != NULL);
+		UK_TEST_EXPECT_SNUM_LT(uk_allocslab_usable_size(slab, ptr[i]),
+				       __PAGE_SIZE - 64);
+		memset(ptr[i], 0x3c, __PAGE_SIZE / 2);
+	}
+
+	for (i = 0; i < 3; ++i)
+		uk_free(slab, ptr[i]);
+}
+
+UK_TESTCASE(ukallocslab, memalign)
+{
+	__sz align;
+	void *ptr;
+	int rc;
+
+	for (align = sizeof(void *); align <= 4 * __PAGE_SIZE; align <<= 1) {
+		rc = uk_posix_memalign(slab, &ptr, align, 24);
+		UK_TEST_EXPECT_ZERO(rc);
+		UK_TEST_EXPECT_ZERO((__uptr) ptr & (align - 1));
+		memset(ptr, 0x5a, 24);
+		uk_free(slab, ptr);
+	}
+
+	rc = uk_posix_memalign(slab, &ptr, 24, 24);
+	UK_TEST_EXPECT_SNUM_EQ(rc, EINVAL);
+}
+
+UK_TESTCASE(ukallocslab, realloc)
+{
+	__u8 *ptr;
+	__sz i;
+
+	ptr = uk_malloc(slab, 16);
+	UK_TEST_ASSERT(ptr != NULL);
+	for (i = 0; i < 16; ++i)
+		ptr[i] = i;
+
+	ptr = uk_realloc(slab, ptr, 3000);
+	UK_TEST_ASSERT(ptr != NULL);
+	for (i = 0; i < 16; ++i)
+		UK_TEST_EXPECT_SNUM_EQ(ptr[i], i);
+
+	ptr = uk_realloc(slab, ptr, 8);
+	UK_TEST_ASSERT(ptr != NULL);
+	for (i = 0; i < 8; ++i)
+		UK_TEST_EXPECT_SNUM_EQ(ptr[i], i);
+
+	UK_TEST_EXPECT_NULL(uk_realloc(slab, ptr, 0));
+}
+
+#if CONFIG_LIBUKALLOC_IFSTATS
+UK_TESTCASE(ukallocslab, stats)
+{
+	struct uk_alloc_stats before, after;
+	void *ptr;
+
+	uk_alloc_stats_get(slab, &before);
+	ptr = uk_malloc(slab, 100);
+	UK_TEST_ASSERT(ptr != NULL);
+	uk_alloc_stats_get(slab, &after);
+
+	UK_TEST_EXPECT_SNUM_EQ(after.tot_nb_allocs, before.tot_nb_allocs + 1);
+	UK_TEST_EXPECT_SNUM_EQ(after.cur_nb_allocs, before.cur_nb_allocs + 1);
+	UK_TEST_EXPECT_SNUM_EQ(after.cur_mem_use, before.cur_mem_use
+			       + (__ssz) uk_allocslab_usable_size(slab, ptr));
+
+	uk_free(slab, ptr);
+	uk_alloc_stats_get(slab, &after);
+	UK_TEST_EXPECT_SNUM_EQ(after.tot_nb_frees, before.tot_nb_frees + 1);
+	UK_TEST_EXPECT_SNUM_EQ(after.cur_mem_use, before.cur_mem_use);
+}
+#endif /* CONFIG_LIBUKALLOC_IFSTATS */
+
+#if CONFIG_LIBUKALLOCSLAB_TEST_BENCH
+#define BENCH_ROUNDS	10000
+#define BENCH_BATCH	64
+
+/* Microbenchmark: Allocates and frees batches of small objects with the
+ * slab allocator and with the ifpages path of the underlying page allocator.
+ */
+static __nsec bench_batch(struct uk_alloc *a, __sz size,
+			  void *(*do_malloc)(struct uk_alloc *, __sz),
+			  void (*do_free)(struct uk_alloc *, void *))
+{
+	void *ptr[BENCH_BATCH];
+	__nsec start;
+	int r, i;
+
+	start = ukplat_monotonic_clock();
+	for (r = 0; r < BENCH_ROUNDS; ++r) {
+		for (i = 0; i < BENCH_BATCH; ++i)
+			ptr[i] = do_malloc(a, size);
+		for (i = 0; i < BENCH_BATCH; ++i)
+			do_free(a, ptr[i]);
+	}
+	return ukplat_monotonic_clock() - start;
+}
+
+UK_TESTCASE(ukallocslab, bench_vs_ifpages)
+{
+	static const __sz sizes[] = { 8, 32, 128, 512, 2000 };
+	struct uk_alloc *p = uk_alloc_get_default();
+	__nsec t_slab, t_pages;
+	__u64 ops = (__u64) BENCH_ROUNDS * BENCH_BATCH;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(sizes); ++i) {
+		t_slab  = bench_batch(slab, sizes[i], uk_malloc, uk_free);
+		t_pages = bench_batch(p, sizes[i], uk_malloc_ifpages,
+				      uk_free_ifpages);
+
+		uk_test_printf("%4"__PRIsz" B: slab %"__PRInsec
+			       " ns/op, ifpages %"__PRInsec" ns/op\n", sizes[i],
+			       t_slab / ops, t_pages / ops);
+	}
+}
+#endif /* CONFIG_LIBUKALLOCSLAB_TEST_BENCH */
+
+/* The slab allocator under test is stacked on the default allocator, the
+ * same one whose ifpages path the optional benchmark compares against.
+ */
+static int ukallocslab_test_init(struct uk_testsuite *suite __unused)
+{
+	slab = uk_allocslab_init(uk_alloc_get_default());
+	return slab ? 0 : -ENOMEM;
+}
+
+uk_testsuite_register(ukallocslab, ukallocslab_test_init);
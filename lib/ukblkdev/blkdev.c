@@ -42,8 +42,13 @@
 #include <uk/print.h>
 #include <uk/ctors.h>
 #include <uk/arch/atomic.h>
+#include <uk/plat/lcpu.h>
 #include <uk/blkdev.h>
 
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+#include "iosched.h"
+#endif
+
 struct uk_blkdev_list uk_blkdev_list =
 UK_TAILQ_HEAD_INITIALIZER(uk_blkdev_list);
 
@@ -70,6 +75,40 @@ static struct uk_blkdev_data *_alloc_data(struct uk_alloc *a,
 	return data;
 }
 
+/* Generic batch submission for drivers that only implement submit_one */
+static int _submit_batch_one(struct uk_blkdev *dev,
+		struct uk_blkdev_queue *queue,
+		struct uk_blkreq **reqs, uint16_t *cnt)
+{
+	int status = 0x0;
+	uint16_t i;
+	int rc = 0;
+
+	for (i = 0; i < *cnt; i++) {
+		rc = dev->submit_one(dev, queue, reqs[i]);
+		if (unlikely(rc < 0)) {
+			if (i == 0) {
+				*cnt = 0;
+				return rc;
+			}
+			break;
+		}
+		if (!(rc & UK_BLKDEV_STATUS_SUCCESS))
+			break;
+		if (!(rc & UK_BLKDEV_STATUS_MORE)) {
+			i++;
+			break;
+		}
+	}
+
+	*cnt = i;
+	if (i)
+		status |= UK_BLKDEV_STATUS_SUCCESS;
+	if (rc > 0)
+		status |= rc & UK_BLKDEV_STATUS_MORE;
+	return status;
+}
+
 int uk_blkdev_drv_register(struct uk_blkdev *dev, struct uk_alloc *a,
 		const char *drv_name)
 {
@@ -95,6 +134,9 @@ int uk_blkdev_drv_register(struct uk_blkdev *dev, struct uk_alloc *a,
 	if (!dev->_data)
 		return -ENOMEM;
 
+	if (!dev->submit_batch)
+		dev->submit_batch = _submit_batch_one;
+
 	UK_TAILQ_INSERT_TAIL(&uk_blkdev_list, dev, _list);
 	uk_pr_info("Registered blkdev%"PRIu16": %p (%s)\n",
 			blkdev_count, dev, drv_name);
@@ -195,6 +237,7 @@ int uk_blkdev_configure(struct uk_blkdev *dev,
 		uk_pr_info("blkdev%"PRIu16": Configured interface\n",
 				dev->_data->id);
 		dev->_data->state = UK_BLKDEV_CONFIGURED;
+		dev->_data->nb_queues = conf->nb_queues;
 	} else
 		uk_pr_err("blkdev%"PRIu16": Failed to configure interface %d\n",
 				dev->_data->id, rc);
@@ -337,6 +380,17 @@ int uk_blkdev_queue_configure(struct uk_blkdev *dev, uint16_t queue_id,
 	if (err)
 		goto err_out;
 
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	if (queue_conf->iosched) {
+		dev->_data->iosched[queue_id] =
+			uk_blkdev_iosched_alloc(dev, queue_conf->a);
+		if (!dev->_data->iosched[queue_id]) {
+			err = -ENOMEM;
+			goto err_destroy_handler;
+		}
+	}
+#endif
+
 	dev->_queue[queue_id] = dev->dev_ops->queue_configure(dev, queue_id,
 			nb_desc,
 			queue_conf);
@@ -352,6 +406,12 @@ int uk_blkdev_queue_configure(struct uk_blkdev *dev, uint16_t queue_id,
 	return 0;
 
 err_destroy_handler:
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	if (dev->_data->iosched[queue_id]) {
+		uk_blkdev_iosched_free(dev->_data->iosched[queue_id]);
+		dev->_data->iosched[queue_id] = NULL;
+	}
+#endif
 	_destroy_event_handler(&dev->_data->queue_handler[queue_id]);
 err_out:
 	return err;
@@ -380,6 +440,19 @@ int uk_blkdev_start(struct uk_blkdev *dev)
 	return rc;
 }
 
+/* Checks the request against the optional capabilities of the device */
+static inline int _req_supported(struct uk_blkdev *dev,
+		const struct uk_blkreq *req)
+{
+	if (req->sg && !dev->capabilities.max_segments)
+		return 0;
+	if (req->operation == UK_BLKREQ_DISCARD)
+		return dev->capabilities.max_discard_sectors != 0;
+	if (req->operation == UK_BLKREQ_WRITE_ZEROES)
+		return dev->capabilities.max_write_zeroes_sectors != 0;
+	return 1;
+}
+
 int uk_blkdev_queue_submit_one(struct uk_blkdev *dev,
 		uint16_t queue_id,
 		struct uk_blkreq *req)
@@ -392,9 +465,49 @@ int uk_blkdev_queue_submit_one(struct uk_blkdev *dev,
 	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
 	UK_ASSERT(req != NULL);
 
+	if (unlikely(!_req_supported(dev, req)))
+		return -ENOTSUP;
+
 	return dev->submit_one(dev, dev->_queue[queue_id], req);
 }
 
+int uk_blkdev_queue_submit_batch(struct uk_blkdev *dev,
+		uint16_t queue_id,
+		struct uk_blkreq **reqs, uint16_t *cnt)
+{
+	uint16_t i;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(dev->submit_batch);
+	UK_ASSERT(queue_id < CONFIG_LIBUKBLKDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_BLKDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_queue[queue_id]));
+	UK_ASSERT(reqs && cnt);
+
+	for (i = 0; i < *cnt; i++)
+		if (unlikely(!_req_supported(dev, reqs[i])))
+			return -ENOTSUP;
+
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	if (dev->_data->iosched[queue_id])
+		return uk_blkdev_iosched_submit(dev, dev->_queue[queue_id],
+				dev->_data->iosched[queue_id], reqs, cnt);
+#endif
+
+	return dev->submit_batch(dev, dev->_queue[queue_id], reqs, cnt);
+}
+
+uint16_t uk_blkdev_lcpu_queue(struct uk_blkdev *dev)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->_data);
+	UK_ASSERT(dev->_data->state >= UK_BLKDEV_CONFIGURED);
+	UK_ASSERT(dev->_data->nb_queues > 0);
+
+	return ukplat_lcpu_idx() % dev->_data->nb_queues;
+}
+
 int uk_blkdev_queue_finish_reqs(struct uk_blkdev *dev,
 		uint16_t queue_id)
 {
@@ -508,6 +621,12 @@ int uk_blkdev_queue_unconfigure(struct uk_blkdev *dev, uint16_t queue_id)
 		uk_pr_err("Failed to unconfigure blkdev%"PRIu16"-q%"PRIu16": %d\n",
 				dev->_data->id, queue_id, rc);
 	else {
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+		if (dev->_data->iosched[queue_id]) {
+			uk_blkdev_iosched_free(dev->_data->iosched[queue_id]);
+			dev->_data->iosched[queue_id] = NULL;
+		}
+#endif
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 		if (dev->_data->queue_handler[queue_id].callback)
 			_destroy_event_handler(
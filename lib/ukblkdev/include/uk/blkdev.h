@@ -258,6 +258,29 @@ static inline const struct uk_blkdev_cap *uk_blkdev_capabilities(
 
 #define uk_blkdev_ioalign(blkdev) \
 	(uk_blkdev_capabilities(blkdev)->ioalign)
+
+#define uk_blkdev_max_segments(blkdev) \
+	(uk_blkdev_capabilities(blkdev)->max_segments)
+
+#define uk_blkdev_max_discard_sectors(blkdev) \
+	(uk_blkdev_capabilities(blkdev)->max_discard_sectors)
+
+#define uk_blkdev_max_write_zeroes_sectors(blkdev) \
+	(uk_blkdev_capabilities(blkdev)->max_write_zeroes_sectors)
+
+/**
+ * Get the queue that requests issued on the current logical CPU should be
+ * submitted to. When the device is configured with one queue per logical
+ * CPU, each CPU gets a queue of its own and submissions do not contend with
+ * other CPUs. With fewer queues, the CPUs share them round-robin.
+ *
+ * @param dev
+ *	The Unikraft Block Device in configured or running state.
+ * @return
+ *	Queue id in the range [0, nb_queue - 1] previously supplied to
+ *	uk_blkdev_configure().
+ */
+uint16_t uk_blkdev_lcpu_queue(struct uk_blkdev *dev);
 /**
  * Enable interrupts for a queue.
  *
@@ -333,11 +356,49 @@ static inline int uk_blkdev_queue_intr_disable(struct uk_blkdev *dev,
  *		one descriptor available for a subsequent transmission.
  *		If the flag is unset means that the queue is full.
  *		This may only be set together with UK_BLKDEV_STATUS_SUCCESS.
+ *	- (-ENOTSUP): `req` is a scatter-gather, discard or write zeroes
+ *	request and the device does not support them.
  *	- (<0): Negative value with error code from driver, no request was sent.
  */
 int uk_blkdev_queue_submit_one(struct uk_blkdev *dev, uint16_t queue_id,
 		struct uk_blkreq *req);
 
+/**
+ * Make multiple aio requests to the device. Drivers notify the device only
+ * once for the whole batch.
+ * If the I/O scheduler is enabled for the queue, the requests are sorted by
+ * start sector and adjacent requests are merged into bigger ones before they
+ * are handed to the driver. Sorting never moves a request across a flush
+ * request. There is no completion order among the requests of a batch, so
+ * callers must not submit overlapping writes in the same batch.
+ *
+ * @param dev
+ *	The Unikraft Block Device
+ * @param queue_id
+ *	The index of the queue to submit to.
+ *	The value must be in the range [0, nb_queue - 1] previously supplied
+ *	to uk_blkdev_configure().
+ * @param reqs
+ *	Array of requests. The I/O scheduler may reorder the array.
+ *	`reqs` has never to be `NULL`.
+ * @param cnt
+ *	On input, the number of requests in `reqs`. On return, the number of
+ *	requests that were put to the queue. These are always the first ones
+ *	of the (possibly reordered) array, the remaining ones were not touched.
+ *	`cnt` has never to be `NULL`.
+ * @return
+ *	- (>=0): Positive value with status flags
+ *		- UK_BLKDEV_STATUS_SUCCESS: At least one request was put to
+ *		the queue.
+ *		- UK_BLKDEV_STATUS_MORE: Indicates there is still at least
+ *		one descriptor available for a subsequent request.
+ *	- (-ENOTSUP): One of the requests is not supported by the device
+ *	(see uk_blkdev_queue_submit_one()), no request was sent.
+ *	- (<0): Negative value with error code from driver, no request was sent.
+ */
+int uk_blkdev_queue_submit_batch(struct uk_blkdev *dev, uint16_t queue_id,
+		struct uk_blkreq **reqs, uint16_t *cnt);
+
 /**
  * Tests for status flags returned by `uk_blkdev_submit_one`
  * When the function returned an error code or one of the selected flags is
@@ -472,6 +533,20 @@ int uk_blkdev_sync_io(struct uk_blkdev *dev,
 	uk_blkdev_sync_io(blkdev, queue_id, UK_BLKREQ_READ, sector, \
 			  nb_sectors, buf)			    \
 
+#define uk_blkdev_sync_discard(blkdev,\
+		queue_id,	\
+		sector,		\
+		nb_sectors)	\
+	uk_blkdev_sync_io(blkdev, queue_id, UK_BLKREQ_DISCARD, sector, \
+			  nb_sectors, NULL)			       \
+
+#define uk_blkdev_sync_write_zeroes(blkdev,\
+		queue_id,	\
+		sector,		\
+		nb_sectors)	\
+	uk_blkdev_sync_io(blkdev, queue_id, UK_BLKREQ_WRITE_ZEROES, sector, \
+			  nb_sectors, NULL)				    \
+
 #endif /* CONFIG_LIBUKBLKDEV_SYNC_IO_BLOCKED_WAITING */
 
 /**
@@ -140,6 +140,10 @@ struct uk_blkdev_queue_conf {
 	uk_blkdev_queue_event_t callback;
 	/* Argument pointer for callback*/
 	void *callback_cookie;
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	/* Sort and merge the requests of submitted batches */
+	int iosched;
+#endif
 
 #if CONFIG_LIBUKBLKDEV_DISPATCHERTHREADS
 	/* Scheduler for dispatcher. */
@@ -194,6 +198,14 @@ typedef int (*uk_blkdev_queue_intr_disable_t)(struct uk_blkdev *dev,
 /** Driver callback type to submit a request to Unikraft block device. */
 typedef int (*uk_blkdev_queue_submit_one_t)(struct uk_blkdev *dev,
 		struct uk_blkdev_queue *queue, struct uk_blkreq *req);
+/**
+ * Driver callback type to submit multiple requests to Unikraft block device.
+ * `cnt` holds the number of requests in `reqs` on entry and the number of
+ * submitted requests on return.
+ */
+typedef int (*uk_blkdev_queue_submit_batch_t)(struct uk_blkdev *dev,
+		struct uk_blkdev_queue *queue, struct uk_blkreq **reqs,
+		uint16_t *cnt);
 /**
  * Driver callback type to finish
  * a bunch of requests to Unikraft block device.
@@ -238,6 +250,14 @@ struct uk_blkdev_cap {
 	__sector max_sectors_per_req;
 	/* Alignment (number of bytes) for data used in future requests */
 	uint16_t ioalign;
+	/* Max nb of data segments of a scatter-gather request, 0 if
+	 * scatter-gather requests are not supported
+	 */
+	uint16_t max_segments;
+	/* Max nb of sectors of a discard request, 0 if not supported */
+	__sector max_discard_sectors;
+	/* Max nb of sectors of a write zeroes request, 0 if not supported */
+	__sector max_write_zeroes_sectors;
 };
 
 /**
@@ -266,6 +286,14 @@ struct uk_blkdev_event_handler {
 #endif
 };
 
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+/**
+ * @internal
+ * Per-queue state of the request scheduler (internal to libukblkdev)
+ */
+struct uk_blkdev_iosched;
+#endif
+
 /**
  * @internal
  * libukblkdev internal data associated with each block device.
@@ -282,11 +310,19 @@ struct uk_blkdev_data {
 	const char *drv_name;
 	/* Allocator */
 	struct uk_alloc *a;
+	/* Nb of queues supplied to uk_blkdev_configure() */
+	uint16_t nb_queues;
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	/* I/O scheduler of each queue, NULL if disabled */
+	struct uk_blkdev_iosched *iosched[CONFIG_LIBUKBLKDEV_MAXNBQUEUES];
+#endif
 };
 
 struct uk_blkdev {
 	/* Pointer to submit request function */
 	uk_blkdev_queue_submit_one_t submit_one;
+	/* Pointer to submit multiple requests function (optional) */
+	uk_blkdev_queue_submit_batch_t submit_batch;
 	/* Pointer to handle_responses function */
 	uk_blkdev_queue_finish_reqs_t finish_reqs;
 	/* Pointer to API-internal state data. */
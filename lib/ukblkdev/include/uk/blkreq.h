@@ -51,6 +51,7 @@ typedef __sz __sector;
 #define __PRIsctr __PRIsz
 
 struct uk_blkreq;
+struct uk_sglist;
 
 /**
  *	Operation status
@@ -69,7 +70,11 @@ enum uk_blkreq_op {
 	/* Write operation */
 	UK_BLKREQ_WRITE,
 	/* Flush the volatile write cache */
-	UK_BLKREQ_FFLUSH = 4
+	UK_BLKREQ_FFLUSH = 4,
+	/* Discard the sectors, their content becomes undefined */
+	UK_BLKREQ_DISCARD = 11,
+	/* Write zeroes to the sectors without transferring data */
+	UK_BLKREQ_WRITE_ZEROES = 13
 };
 
 /**
@@ -93,8 +98,10 @@ struct uk_blkreq {
 	__sector				start_sector;
 	/* Size in number of sectors */
 	__sector				nb_sectors;
-	/* Pointer to data */
+	/* Pointer to data (unused by discard and write zeroes) */
 	void					*aio_buf;
+	/* Data segments, replace aio_buf if set (see uk_blkreq_init_sg) */
+	struct uk_sglist			*sg;
 	/* Request callback and its parameters */
 	uk_blkreq_event_t			cb;
 	void					*cb_cookie;
@@ -133,11 +140,42 @@ static inline void uk_blkreq_init(struct uk_blkreq *req,
 	req->start_sector = start;
 	req->nb_sectors = nb_sectors;
 	req->aio_buf = aio_buf;
+	req->sg = NULL;
 	ukarch_store_n(&req->state.counter, UK_BLKREQ_UNFINISHED);
 	req->cb = cb;
 	req->cb_cookie = cb_cookie;
 }
 
+/**
+ * Initializes a request structure for vectored I/O. The data of the request
+ * is described by a scatter-gather list whose total length has to be
+ * `nb_sectors` times the sector size of the device. The list must stay valid
+ * until the request finished. Requests of this kind are only accepted by
+ * devices that report a non-zero `max_segments` capability.
+ *
+ * @param req
+ *	The request structure
+ * @param op
+ *	The operation (UK_BLKREQ_READ or UK_BLKREQ_WRITE)
+ * @param start
+ *	The start sector
+ * @param nb_sectors
+ *	Number of sectors
+ * @param sg
+ *	Scatter-gather list with the data segments
+ * @param cb
+ *	Request callback
+ * @param cb_cookie
+ *	Request callback parameters
+ **/
+static inline void uk_blkreq_init_sg(struct uk_blkreq *req,
+		enum uk_blkreq_op op, __sector start, __sector nb_sectors,
+		struct uk_sglist *sg, uk_blkreq_event_t cb, void *cb_cookie)
+{
+	uk_blkreq_init(req, op, start, nb_sectors, NULL, cb, cb_cookie);
+	req->sg = sg;
+}
+
 /**
  * Checks if request is finished.
  *
@@ -0,0 +1,315 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Request scheduler for batches of block requests.
+ *
+ * A batch is sorted by start sector; flush requests act as barriers that no
+ * request is moved across. Runs of read or write requests to adjacent sectors
+ * are then merged into a single request that is handed to the driver. The
+ * data of a merged request is either one contiguous buffer, if the buffers of
+ * the original requests follow each other in memory, or a scatter-gather list
+ * of their buffers. On completion of a merged request, the result is
+ * forwarded to each of the original requests.
+ *
+ * Merged requests come from a fixed pool per queue, because they are released
+ * from the completion path which may run in interrupt context. If the pool is
+ * exhausted, requests are submitted unmerged.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/sglist.h>
+#include <uk/plat/spinlock.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+
+#include "iosched.h"
+
+/* Number of requests handed to the driver with one call */
+#define IOSCHED_DISPATCH	16
+
+struct uk_blkdev_iosched_req {
+	/* Request that is handed to the driver */
+	struct uk_blkreq req;
+	/* Original requests in sector order */
+	struct uk_blkreq *child[CONFIG_LIBUKBLKDEV_IOSCHED_MAXMERGE];
+	uint16_t nb_child;
+	/* Data segments if the buffers are not contiguous */
+	struct uk_sglist sg;
+	struct uk_blkdev_iosched *s;
+	struct uk_blkdev_iosched_req *next;
+};
+
+struct uk_blkdev_iosched {
+	__spinlock lock;
+	/* Unused merged requests */
+	struct uk_blkdev_iosched_req *free;
+	struct uk_alloc *a;
+	/* Max nb of data segments of a merged request */
+	uint16_t max_segs;
+	struct uk_blkdev_iosched_req reqs[CONFIG_LIBUKBLKDEV_IOSCHED_NBREQS];
+	/* Followed by the segments of all merged requests */
+};
+
+static struct uk_blkdev_iosched_req *_mreq_get(struct uk_blkdev_iosched *s)
+{
+	struct uk_blkdev_iosched_req *m;
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&s->lock, flags);
+	m = s->free;
+	if (m)
+		s->free = m->next;
+	ukplat_spin_unlock_irqrestore(&s->lock, flags);
+	return m;
+}
+
+static void _mreq_put(struct uk_blkdev_iosched *s,
+		      struct uk_blkdev_iosched_req *m)
+{
+	unsigned long flags;
+
+	ukplat_spin_lock_irqsave(&s->lock, flags);
+	m->next = s->free;
+	s->free = m;
+	ukplat_spin_unlock_irqrestore(&s->lock, flags);
+}
+
+struct uk_blkdev_iosched *uk_blkdev_iosched_alloc(struct uk_blkdev *dev,
+						  struct uk_alloc *a)
+{
+	struct uk_blkdev_iosched *s;
+	struct uk_sglist_seg *segs;
+	uint16_t max_segs;
+	int i;
+
+	max_segs = MIN(dev->capabilities.max_segments,
+		       CONFIG_LIBUKBLKDEV_IOSCHED_MAXSEGS);
+
+	s = uk_calloc(a, 1, sizeof(*s) + CONFIG_LIBUKBLKDEV_IOSCHED_NBREQS *
+		      max_segs * sizeof(*segs));
+	if (!s)
+		return NULL;
+
+	ukarch_spin_init(&s->lock);
+	s->a = a;
+	s->max_segs = max_segs;
+	segs = (struct uk_sglist_seg *) (s + 1);
+	for (i = CONFIG_LIBUKBLKDEV_IOSCHED_NBREQS - 1; i >= 0; i--) {
+		s->reqs[i].s = s;
+		uk_sglist_init(&s->reqs[i].sg, max_segs,
+			       &segs[i * max_segs]);
+		s->reqs[i].next = s->free;
+		s->free = &s->reqs[i];
+	}
+	return s;
+}
+
+void uk_blkdev_iosched_free(struct uk_blkdev_iosched *s)
+{
+	uk_free(s->a, s);
+}
+
+static void _mreq_done(struct uk_blkreq *req, void *cookie)
+{
+	struct uk_blkdev_iosched_req *m =
+		(struct uk_blkdev_iosched_req *) cookie;
+	struct uk_blkreq *child[CONFIG_LIBUKBLKDEV_IOSCHED_MAXMERGE];
+	uint16_t nb_child = m->nb_child;
+	uint16_t i;
+
+	/* The callbacks may submit new requests that want to reuse m */
+	memcpy(child, m->child, nb_child * sizeof(*child));
+	_mreq_put(m->s, m);
+
+	for (i = 0; i < nb_child; i++) {
+		child[i]->result = req->result;
+		uk_blkreq_finished(child[i]);
+		if (child[i]->cb)
+			child[i]->cb(child[i], child[i]->cb_cookie);
+	}
+}
+
+static inline int _is_rw(const struct uk_blkreq *req)
+{
+	return req->operation == UK_BLKREQ_READ ||
+	       req->operation == UK_BLKREQ_WRITE;
+}
+
+static inline int _adjacent(const struct uk_blkreq *prev,
+			    const struct uk_blkreq *req)
+{
+	return req->operation == prev->operation &&
+	       prev->start_sector + prev->nb_sectors == req->start_sector;
+}
+
+static int _sg_append(struct uk_sglist *sg, struct uk_blkreq *req, __sz len)
+{
+	if (!req->sg)
+		return uk_sglist_append(sg, req->aio_buf, len);
+
+	/* Avoid the error message of uk_sglist_append_sglist() */
+	if (sg->sg_nseg + req->sg->sg_nseg > sg->sg_maxseg)
+		return -EFBIG;
+	return uk_sglist_append_sglist(sg, req->sg, 0, len);
+}
+
+/* Insertion sort by start sector, stable and only within runs of read and
+ * write requests
+ */
+static void _sort(struct uk_blkreq **reqs, uint16_t cnt)
+{
+	struct uk_blkreq *req;
+	uint16_t i, j;
+
+	for (i = 1; i < cnt; i++) {
+		req = reqs[i];
+		if (!_is_rw(req))
+			continue;
+		for (j = i; j > 0 && _is_rw(reqs[j - 1]) &&
+		     reqs[j - 1]->start_sector > req->start_sector; j--)
+			reqs[j] = reqs[j - 1];
+		reqs[j] = req;
+	}
+}
+
+/* Merges reqs[*pos] with the following requests to adjacent sectors.
+ * Returns the request for the driver and advances *pos past the requests
+ * that it covers.
+ */
+static struct uk_blkreq *_merge(struct uk_blkdev *dev,
+				struct uk_blkdev_iosched *s,
+				struct uk_blkreq **reqs, uint16_t cnt,
+				uint16_t *pos)
+{
+	struct uk_blkreq *first = reqs[*pos];
+	struct uk_blkreq *prev, *req;
+	struct uk_blkdev_iosched_req *m;
+	__sz ssize = dev->capabilities.ssize;
+	__sector max_sectors = dev->capabilities.max_sectors_per_req;
+	__sector nb_sectors = first->nb_sectors;
+	uint16_t i = *pos + 1;
+	int contig = !first->sg;
+
+	*pos = i;
+	if (i == cnt || !_is_rw(first) || !_adjacent(first, reqs[i]) ||
+	    nb_sectors + reqs[i]->nb_sectors > max_sectors)
+		return first;
+
+	m = _mreq_get(s);
+	if (!m)
+		return first;
+
+	uk_sglist_reset(&m->sg);
+	if (!contig && (!s->max_segs ||
+			_sg_append(&m->sg, first, nb_sectors * ssize))) {
+		_mreq_put(s, m);
+		return first;
+	}
+
+	m->child[0] = first;
+	m->nb_child = 1;
+	for (prev = first;
+	     i < cnt && m->nb_child < CONFIG_LIBUKBLKDEV_IOSCHED_MAXMERGE;
+	     prev = req, i++) {
+		req = reqs[i];
+		if (!_adjacent(prev, req) ||
+		    nb_sectors + req->nb_sectors > max_sectors)
+			break;
+
+		if (!contig || req->sg || (char *) prev->aio_buf +
+		    prev->nb_sectors * ssize != req->aio_buf) {
+			if (!s->max_segs)
+				break;
+			/* Switch to a segment list for the data so far */
+			if (contig && uk_sglist_append(&m->sg, first->aio_buf,
+						       nb_sectors * ssize))
+				break;
+			contig = 0;
+			if (_sg_append(&m->sg, req, req->nb_sectors * ssize))
+				break;
+		}
+
+		m->child[m->nb_child++] = req;
+		nb_sectors += req->nb_sectors;
+	}
+
+	if (m->nb_child == 1) {
+		_mreq_put(s, m);
+		return first;
+	}
+
+	if (contig)
+		uk_blkreq_init(&m->req, first->operation, first->start_sector,
+			       nb_sectors, first->aio_buf, _mreq_done, m);
+	else
+		uk_blkreq_init_sg(&m->req, first->operation,
+				  first->start_sector, nb_sectors, &m->sg,
+				  _mreq_done, m);
+	*pos = i;
+	return &m->req;
+}
+
+/* Returns merged requests that were not accepted by the driver */
+static void _release(struct uk_blkdev_iosched *s, struct uk_blkreq **reqs,
+		     uint16_t cnt)
+{
+	uint16_t i;
+
+	for (i = 0; i < cnt; i++) {
+		if (reqs[i]->cb == _mreq_done)
+			_mreq_put(s, (struct uk_blkdev_iosched_req *)
+				  reqs[i]->cb_cookie);
+	}
+}
+
+int uk_blkdev_iosched_submit(struct uk_blkdev *dev,
+			     struct uk_blkdev_queue *queue,
+			     struct uk_blkdev_iosched *s,
+			     struct uk_blkreq **reqs, uint16_t *cnt)
+{
+	struct uk_blkreq *out[IOSCHED_DISPATCH];
+	/* Index of the first request in reqs that out[i] covers */
+	uint16_t first[IOSCHED_DISPATCH + 1];
+	uint16_t done = 0, nb_out, i, n;
+	int status = 0x0;
+	int rc = 0;
+
+	_sort(reqs, *cnt);
+
+	while (done < *cnt) {
+		i = done;
+		for (nb_out = 0; nb_out < IOSCHED_DISPATCH && i < *cnt;
+		     nb_out++) {
+			first[nb_out] = i;
+			out[nb_out] = _merge(dev, s, reqs, *cnt, &i);
+		}
+		first[nb_out] = i;
+
+		n = nb_out;
+		rc = dev->submit_batch(dev, queue, out, &n);
+		if (unlikely(rc < 0))
+			n = 0;
+		_release(s, &out[n], nb_out - n);
+		done = first[n];
+
+		if (rc < 0 || n < nb_out || !(rc & UK_BLKDEV_STATUS_MORE))
+			break;
+	}
+
+	*cnt = done;
+	if (rc < 0 && done == 0)
+		return rc;
+	if (done)
+		status |= UK_BLKDEV_STATUS_SUCCESS;
+	if (rc > 0)
+		status |= rc & UK_BLKDEV_STATUS_MORE;
+	return status;
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+/* Request scheduler of libukblkdev (internal) */
+#ifndef __UKBLKDEV_IOSCHED_H__
+#define __UKBLKDEV_IOSCHED_H__
+
+#include <uk/blkdev.h>
+
+/**
+ * Allocates the scheduler state of a queue. The capabilities of the device
+ * have to be known already.
+ *
+ * @return
+ *	The scheduler state or NULL if out of memory
+ */
+struct uk_blkdev_iosched *uk_blkdev_iosched_alloc(struct uk_blkdev *dev,
+						  struct uk_alloc *a);
+
+/**
+ * Frees the scheduler state of a queue. No merged request may be in flight.
+ */
+void uk_blkdev_iosched_free(struct uk_blkdev_iosched *s);
+
+/**
+ * Sorts and merges a batch of requests and submits the result to the driver.
+ * Arguments and return value are the ones of uk_blkdev_queue_submit_batch().
+ */
+int uk_blkdev_iosched_submit(struct uk_blkdev *dev,
+			     struct uk_blkdev_queue *queue,
+			     struct uk_blkdev_iosched *s,
+			     struct uk_blkreq **reqs, uint16_t *cnt);
+
+#endif /* __UKBLKDEV_IOSCHED_H__ */
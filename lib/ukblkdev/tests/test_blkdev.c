@@ -0,0 +1,864 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/blkdev.h>
+#include <uk/blkdev_driver.h>
+#include <uk/essentials.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/time.h>
+#if CONFIG_HAVE_SMP
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/plat/lcpu.h>
+#endif /* CONFIG_HAVE_SMP */
+#if CONFIG_LIBUKSGLIST
+#include <uk/sglist.h>
+#include <uk/plat/io.h>
+#endif /* CONFIG_LIBUKSGLIST */
+
+#define RAMBLK_SSIZE	512
+#define RAMBLK_SECTORS	256
+#define RAMBLK_QSIZE	32
+#define RAMBLK_MAXSECS	64
+#define RAMBLK_MAXSEGS	8
+#define RAMBLK_NBQUEUES	CONFIG_LIBUKBLKDEV_MAXNBQUEUES
+
+#define NB_REQS		8
+
+/*
+ * RAM-backed block device that queues requests on submission and completes
+ * them when the queue is polled. It records the requests that reach the
+ * driver, so that the tests can tell how they were merged.
+ */
+struct uk_blkdev_queue {
+	struct uk_blkreq *pending[RAMBLK_QSIZE];
+	unsigned int nb_pending;
+	/* Requests seen by the driver */
+	struct uk_blkreq seen[2 * RAMBLK_QSIZE];
+	unsigned int nb_seen;
+};
+
+static struct uk_blkdev ramblk;
+static struct uk_blkdev_queue ramblk_queues[RAMBLK_NBQUEUES];
+static uint16_t ramblk_nb_queues;
+static __u8 ramblk_data[RAMBLK_SECTORS * RAMBLK_SSIZE];
+
+static void ramblk_get_info(struct uk_blkdev *dev __unused,
+			    struct uk_blkdev_info *dev_info)
+{
+	dev_info->max_queues = RAMBLK_NBQUEUES;
+}
+
+static int ramblk_configure(struct uk_blkdev *dev __unused,
+			    const struct uk_blkdev_conf *conf __unused)
+{
+	return 0;
+}
+
+static int ramblk_queue_get_info(struct uk_blkdev *dev __unused,
+				 uint16_t queue_id __unused,
+				 struct uk_blkdev_queue_info *q_info)
+{
+	q_info->nb_min = RAMBLK_QSIZE;
+	q_info->nb_max = RAMBLK_QSIZE;
+	q_info->nb_is_power_of_two = 1;
+	return 0;
+}
+
+static struct uk_blkdev_queue *ramblk_queue_configure(
+		struct uk_blkdev *dev __unused, uint16_t queue_id,
+		uint16_t nb_desc __unused,
+		const struct uk_blkdev_queue_conf *queue_conf __unused)
+{
+	memset(&ramblk_queues[queue_id], 0, sizeof(ramblk_queues[queue_id]));
+	return &ramblk_queues[queue_id];
+}
+
+static int ramblk_start(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int ramblk_stop(struct uk_blkdev *dev __unused)
+{
+	uint16_t i;
+
+	for (i = 0; i < ramblk_nb_queues; i++)
+		if (ramblk_queues[i].nb_pending)
+			return -EBUSY;
+	return 0;
+}
+
+static int ramblk_queue_unconfigure(struct uk_blkdev *dev __unused,
+				    struct uk_blkdev_queue *queue __unused)
+{
+	return 0;
+}
+
+static int ramblk_unconfigure(struct uk_blkdev *dev __unused)
+{
+	return 0;
+}
+
+static int ramblk_submit_one(struct uk_blkdev *dev,
+			     struct uk_blkdev_queue *queue,
+			     struct uk_blkreq *req)
+{
+	if (queue->nb_pending == RAMBLK_QSIZE)
+		return -ENOSPC;
+	if (req->operation != UK_BLKREQ_FFLUSH &&
+	    (req->start_sector + req->nb_sectors > dev->capabilities.sectors
+	     || req->nb_sectors > dev->capabilities.max_sectors_per_req))
+		return -EINVAL;
+
+	if (queue->nb_seen < ARRAY_SIZE(queue->seen))
+		queue->seen[queue->nb_seen++] = *req;
+	queue->pending[queue->nb_pending++] = req;
+
+	return UK_BLKDEV_STATUS_SUCCESS |
+	       ((queue->nb_pending < RAMBLK_QSIZE) ? UK_BLKDEV_STATUS_MORE : 0);
+}
+
+static int ramblk_finish_reqs(struct uk_blkdev *dev __unused,
+			      struct uk_blkdev_queue *queue)
+{
+	struct uk_blkreq *req;
+	unsigned int i;
+	__u8 *data;
+
+	for (i = 0; i < queue->nb_pending; i++) {
+		req = queue->pending[i];
+		data = ramblk_data + req->start_sector * RAMBLK_SSIZE;
+
+		/* Scatter-gather requests are only recorded, their segments
+		 * hold physical addresses
+		 */
+		if (req->operation == UK_BLKREQ_READ && !req->sg)
+			memcpy(req->aio_buf, data,
+			       req->nb_sectors * RAMBLK_SSIZE);
+		else if (req->operation == UK_BLKREQ_WRITE && !req->sg)
+			memcpy(data, req->aio_buf,
+			       req->nb_sectors * RAMBLK_SSIZE);
+		else if (req->operation == UK_BLKREQ_WRITE_ZEROES)
+			memset(data, 0, req->nb_sectors * RAMBLK_SSIZE);
+
+		req->result = 0;
+		uk_blkreq_finished(req);
+		if (req->cb)
+			req->cb(req, req->cb_cookie);
+	}
+	queue->nb_pending = 0;
+	return 0;
+}
+
+static const struct uk_blkdev_ops ramblk_ops = {
+	.get_info = ramblk_get_info,
+	.dev_configure = ramblk_configure,
+	.queue_get_info = ramblk_queue_get_info,
+	.queue_configure = ramblk_queue_configure,
+	.dev_start = ramblk_start,
+	.dev_stop = ramblk_stop,
+	.queue_unconfigure = ramblk_queue_unconfigure,
+	.dev_unconfigure = ramblk_unconfigure,
+};
+
+static int ramblk_open_queues(uint16_t nb_queues, int iosched __maybe_unused)
+{
+	struct uk_blkdev_conf conf = { .nb_queues = nb_queues };
+	struct uk_blkdev_queue_conf qconf;
+	uint16_t i;
+	int rc;
+
+	memset(&ramblk, 0, sizeof(ramblk));
+	ramblk.submit_one = ramblk_submit_one;
+	ramblk.finish_reqs = ramblk_finish_reqs;
+	ramblk.dev_ops = &ramblk_ops;
+	ramblk.capabilities.sectors = RAMBLK_SECTORS;
+	ramblk.capabilities.ssize = RAMBLK_SSIZE;
+	ramblk.capabilities.mode = O_RDWR;
+	ramblk.capabilities.max_sectors_per_req = RAMBLK_MAXSECS;
+	ramblk.capabilities.ioalign = sizeof(void *);
+	ramblk.capabilities.max_discard_sectors = RAMBLK_MAXSECS;
+	ramblk.capabilities.max_write_zeroes_sectors = RAMBLK_MAXSECS;
+#if CONFIG_LIBUKSGLIST
+	ramblk.capabilities.max_segments = RAMBLK_MAXSEGS;
+#endif /* CONFIG_LIBUKSGLIST */
+
+	rc = uk_blkdev_drv_register(&ramblk, uk_alloc_get_default(), "ramblk");
+	if (rc < 0)
+		return rc;
+
+	rc = uk_blkdev_configure(&ramblk, &conf);
+	if (rc < 0)
+		goto err_unregister;
+
+	memset(&qconf, 0, sizeof(qconf));
+	qconf.a = uk_alloc_get_default();
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	qconf.iosched = iosched;
+#endif /* CONFIG_LIBUKBLKDEV_IOSCHED */
+	for (i = 0; i < nb_queues; i++) {
+		rc = uk_blkdev_queue_configure(&ramblk, i, RAMBLK_QSIZE,
+					       &qconf);
+		if (rc < 0)
+			goto err_queue_unconfigure;
+	}
+	ramblk_nb_queues = nb_queues;
+
+	rc = uk_blkdev_start(&ramblk);
+	if (rc < 0)
+		goto err_queue_unconfigure;
+	return 0;
+
+err_queue_unconfigure:
+	while (i--)
+		uk_blkdev_queue_unconfigure(&ramblk, i);
+	uk_blkdev_unconfigure(&ramblk);
+err_unregister:
+	uk_blkdev_drv_unregister(&ramblk);
+	return rc;
+}
+
+static int ramblk_open(int iosched)
+{
+	return ramblk_open_queues(1, iosched);
+}
+
+static void ramblk_close(void)
+{
+	uint16_t i;
+
+	for (i = 0; i < ramblk_nb_queues; i++)
+		uk_blkdev_queue_finish_reqs(&ramblk, i);
+	uk_blkdev_stop(&ramblk);
+	for (i = 0; i < ramblk_nb_queues; i++)
+		uk_blkdev_queue_unconfigure(&ramblk, i);
+	uk_blkdev_unconfigure(&ramblk);
+	uk_blkdev_drv_unregister(&ramblk);
+}
+
+static unsigned int nb_done;
+
+static void count_done(struct uk_blkreq *req __unused, void *cookie __unused)
+{
+	nb_done++;
+}
+
+UK_TESTCASE(ukblkdev, batch_generic)
+{
+	static __u8 buf[NB_REQS * RAMBLK_SSIZE];
+	struct uk_blkreq reqs[NB_REQS], *batch[NB_REQS];
+	uint16_t cnt = NB_REQS;
+	int rc, i;
+
+	UK_TEST_ASSERT(ramblk_open(0) == 0);
+
+	/* Every other sector, so that nothing could be merged */
+	memset(ramblk_data, 0, sizeof(ramblk_data));
+	for (i = 0; i < NB_REQS; i++) {
+		memset(&buf[i * RAMBLK_SSIZE], i + 1, RAMBLK_SSIZE);
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_WRITE, 2 * i, 1,
+			       &buf[i * RAMBLK_SSIZE], count_done, NULL);
+		batch[i] = &reqs[i];
+	}
+
+	nb_done = 0;
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_more(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, NB_REQS);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].nb_seen, NB_REQS);
+
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+	UK_TEST_EXPECT_SNUM_EQ(nb_done, NB_REQS);
+	for (i = 0; i < NB_REQS; i++) {
+		UK_TEST_EXPECT(uk_blkreq_is_done(&reqs[i]));
+		UK_TEST_EXPECT_SNUM_EQ(ramblk_data[2 * i * RAMBLK_SSIZE], i + 1);
+		UK_TEST_EXPECT_ZERO(ramblk_data[(2 * i + 1) * RAMBLK_SSIZE]);
+	}
+
+	ramblk_close();
+}
+
+UK_TESTCASE(ukblkdev, batch_queue_full)
+{
+	static __u8 buf[RAMBLK_SSIZE];
+	struct uk_blkreq reqs[RAMBLK_QSIZE + 4], *batch[RAMBLK_QSIZE + 4];
+	uint16_t cnt = ARRAY_SIZE(batch);
+	int rc, i;
+
+	UK_TEST_ASSERT(ramblk_open(0) == 0);
+
+	for (i = 0; i < (int) ARRAY_SIZE(reqs); i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, 2 * i, 1, buf,
+			       NULL, NULL);
+		batch[i] = &reqs[i];
+	}
+
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	UK_TEST_EXPECT(!uk_blkdev_status_more(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, RAMBLK_QSIZE);
+
+	/* Nothing fits before the queue is drained */
+	cnt = ARRAY_SIZE(batch) - RAMBLK_QSIZE;
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, &batch[RAMBLK_QSIZE],
+					  &cnt);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -ENOSPC);
+	UK_TEST_EXPECT_ZERO(cnt);
+
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+	cnt = ARRAY_SIZE(batch) - RAMBLK_QSIZE;
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, &batch[RAMBLK_QSIZE],
+					  &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_more(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, ARRAY_SIZE(batch) - RAMBLK_QSIZE);
+
+	ramblk_close();
+}
+
+UK_TESTCASE(ukblkdev, discard_write_zeroes)
+{
+	static __u8 buf[4 * RAMBLK_SSIZE];
+	static __u8 zero[2 * RAMBLK_SSIZE];
+	struct uk_blkreq req;
+	int rc;
+
+	UK_TEST_ASSERT(ramblk_open(0) == 0);
+
+	memset(buf, 0xa5, sizeof(buf));
+	memcpy(&ramblk_data[60 * RAMBLK_SSIZE], buf, sizeof(buf));
+
+	uk_blkreq_init(&req, UK_BLKREQ_WRITE_ZEROES, 61, 2, NULL, NULL, NULL);
+	rc = uk_blkdev_queue_submit_one(&ramblk, 0, &req);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+	UK_TEST_EXPECT(uk_blkreq_is_done(&req));
+	UK_TEST_EXPECT_BYTES_EQ(&ramblk_data[61 * RAMBLK_SSIZE], zero,
+				sizeof(zero));
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_data[60 * RAMBLK_SSIZE], 0xa5);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_data[63 * RAMBLK_SSIZE], 0xa5);
+
+	uk_blkreq_init(&req, UK_BLKREQ_DISCARD, 60, 4, NULL, NULL, NULL);
+	rc = uk_blkdev_queue_submit_one(&ramblk, 0, &req);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+	UK_TEST_EXPECT(uk_blkreq_is_done(&req));
+
+	/* Devices without support never see the requests */
+	ramblk.capabilities.max_discard_sectors = 0;
+	ramblk.capabilities.max_write_zeroes_sectors = 0;
+	rc = uk_blkdev_queue_submit_one(&ramblk, 0, &req);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -ENOTSUP);
+	req.operation = UK_BLKREQ_WRITE_ZEROES;
+	rc = uk_blkdev_queue_submit_one(&ramblk, 0, &req);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -ENOTSUP);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].nb_seen, 2);
+
+	ramblk_close();
+}
+
+#if CONFIG_HAVE_SMP
+#define STACK_PAGES	4
+
+struct lcpu_queue_arg {
+	uint16_t queue[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int done;
+};
+
+static void lcpu_queue_remote(struct __regs *regs __unused, void *user)
+{
+	struct lcpu_queue_arg *arg = (struct lcpu_queue_arg *) user;
+
+	arg->queue[ukplat_lcpu_idx()] = uk_blkdev_lcpu_queue(&ramblk);
+	ukarch_inc(&arg->done);
+}
+
+static int lcpu_queue_start_lcpus(void)
+{
+	void *sp[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int i;
+	void *stack;
+	int rc;
+
+	for (i = 0; i < ukplat_lcpu_count() - 1; ++i) {
+		stack = uk_palloc(uk_alloc_get_default(), STACK_PAGES);
+		if (!stack)
+			return -ENOMEM;
+		sp[i] = (__u8 *) stack + STACK_PAGES * __PAGE_SIZE;
+	}
+
+	/* LCPUs that another test already started are kept running */
+	rc = ukplat_lcpu_start(NULL, NULL, sp, NULL, 0);
+	if (rc)
+		return rc;
+
+	return ukplat_lcpu_wait(NULL, NULL, 0);
+}
+#endif /* CONFIG_HAVE_SMP */
+
+UK_TESTCASE(ukblkdev, lcpu_queue)
+{
+	static __u8 buf[RAMBLK_SSIZE];
+	struct uk_blkreq req;
+	uint16_t q, i;
+	int rc;
+#if CONFIG_HAVE_SMP
+	static struct lcpu_queue_arg arg;
+	struct ukplat_lcpu_func fn = { .fn = lcpu_queue_remote, .user = &arg };
+	__lcpuidx idx[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int n, num, l;
+#endif /* CONFIG_HAVE_SMP */
+
+	/* With a single queue, all CPUs share it */
+	UK_TEST_ASSERT(ramblk_open(0) == 0);
+	UK_TEST_EXPECT_SNUM_EQ(uk_blkdev_lcpu_queue(&ramblk), 0);
+	ramblk_close();
+
+	UK_TEST_ASSERT(ramblk_open_queues(RAMBLK_NBQUEUES, 0) == 0);
+
+	/* Requests of this CPU go to its queue only */
+	q = uk_blkdev_lcpu_queue(&ramblk);
+	UK_TEST_EXPECT_SNUM_EQ(q, ukplat_lcpu_idx() % RAMBLK_NBQUEUES);
+	uk_blkreq_init(&req, UK_BLKREQ_READ, 0, 1, buf, NULL, NULL);
+	rc = uk_blkdev_queue_submit_one(&ramblk, q, &req);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	for (i = 0; i < RAMBLK_NBQUEUES; i++)
+		UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[i].nb_seen,
+				       (i == q) ? 1 : 0);
+
+#if CONFIG_HAVE_SMP
+	/* Consecutive CPUs are spread round-robin over the queues */
+	rc = lcpu_queue_start_lcpus();
+	UK_TEST_ASSERT(rc == 0);
+
+	memset(&arg, 0, sizeof(arg));
+	num = ukplat_lcpu_count() - 1;
+	for (l = 0, n = 0; n < num; ++l)
+		if (l != ukplat_lcpu_idx())
+			idx[n++] = l;
+
+	if (num) {
+		rc = ukplat_lcpu_run(idx, &n, &fn, 0);
+		UK_TEST_ASSERT(rc == 0);
+	}
+	while (ukarch_load_n(&arg.done) < num)
+		ukarch_spinwait();
+
+	arg.queue[ukplat_lcpu_idx()] = q;
+	for (l = 0; l < ukplat_lcpu_count(); ++l)
+		UK_TEST_EXPECT_SNUM_EQ(arg.queue[l], l % RAMBLK_NBQUEUES);
+#endif /* CONFIG_HAVE_SMP */
+
+	ramblk_close();
+}
+
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+UK_TESTCASE(ukblkdev, iosched_merge_contiguous)
+{
+	/* Sectors in submission order */
+	static const int order[NB_REQS] = { 5, 2, 7, 0, 3, 1, 6, 4 };
+	static __u8 buf[NB_REQS * RAMBLK_SSIZE];
+	struct uk_blkreq reqs[NB_REQS], *batch[NB_REQS];
+	uint16_t cnt = NB_REQS;
+	int rc, i;
+
+	UK_TEST_ASSERT(ramblk_open(1) == 0);
+
+	memset(ramblk_data, 0, sizeof(ramblk_data));
+	for (i = 0; i < NB_REQS; i++) {
+		memset(&buf[order[i] * RAMBLK_SSIZE], order[i] + 1,
+		       RAMBLK_SSIZE);
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_WRITE, 16 + order[i], 1,
+			       &buf[order[i] * RAMBLK_SSIZE], count_done,
+			       NULL);
+		batch[i] = &reqs[i];
+	}
+
+	nb_done = 0;
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, NB_REQS);
+
+	/* The array is sorted and the driver sees a single request */
+	for (i = 1; i < NB_REQS; i++)
+		UK_TEST_EXPECT_SNUM_LT(batch[i - 1]->start_sector,
+				       batch[i]->start_sector);
+	UK_TEST_ASSERT(ramblk_queues[0].nb_seen == 1);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[0].start_sector, 16);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[0].nb_sectors, NB_REQS);
+	UK_TEST_EXPECT_PTR_EQ(ramblk_queues[0].seen[0].aio_buf, buf);
+	UK_TEST_EXPECT_NULL(ramblk_queues[0].seen[0].sg);
+
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+	UK_TEST_EXPECT_SNUM_EQ(nb_done, NB_REQS);
+	for (i = 0; i < NB_REQS; i++) {
+		UK_TEST_EXPECT(uk_blkreq_is_done(&reqs[i]));
+		UK_TEST_EXPECT_ZERO(reqs[i].result);
+	}
+	UK_TEST_EXPECT_BYTES_EQ(&ramblk_data[16 * RAMBLK_SSIZE], buf,
+				sizeof(buf));
+
+	ramblk_close();
+}
+
+UK_TESTCASE(ukblkdev, iosched_flush_barrier)
+{
+	static __u8 buf[4][RAMBLK_SSIZE];
+	struct uk_blkreq reqs[5], *batch[5];
+	uint16_t cnt = 5;
+	int rc;
+
+	UK_TEST_ASSERT(ramblk_open(1) == 0);
+
+	/* w11 w10 | flush | w9 w12: w9 must not move before the flush */
+	uk_blkreq_init(&reqs[0], UK_BLKREQ_WRITE, 11, 1, buf[1], NULL, NULL);
+	uk_blkreq_init(&reqs[1], UK_BLKREQ_WRITE, 10, 1, buf[0], NULL, NULL);
+	uk_blkreq_init(&reqs[2], UK_BLKREQ_FFLUSH, 0, 0, NULL, NULL, NULL);
+	uk_blkreq_init(&reqs[3], UK_BLKREQ_WRITE, 9, 1, buf[2], NULL, NULL);
+	uk_blkreq_init(&reqs[4], UK_BLKREQ_WRITE, 12, 1, buf[3], NULL, NULL);
+	for (rc = 0; rc < 5; rc++)
+		batch[rc] = &reqs[rc];
+
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, 5);
+
+	UK_TEST_ASSERT(ramblk_queues[0].nb_seen == 4);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[0].start_sector, 10);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[0].nb_sectors, 2);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[1].operation,
+			       UK_BLKREQ_FFLUSH);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[2].start_sector, 9);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[3].start_sector, 12);
+
+	ramblk_close();
+}
+
+UK_TESTCASE(ukblkdev, iosched_max_sectors)
+{
+	static __u8 buf[(RAMBLK_MAXSECS + 8) * RAMBLK_SSIZE];
+	struct uk_blkreq reqs[(RAMBLK_MAXSECS + 8) / 8];
+	struct uk_blkreq *batch[ARRAY_SIZE(reqs)];
+	uint16_t cnt = ARRAY_SIZE(reqs);
+	unsigned int i;
+	int rc;
+
+	UK_TEST_ASSERT(ramblk_open(1) == 0);
+
+	for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, 8 * i, 8,
+			       &buf[8 * i * RAMBLK_SSIZE], NULL, NULL);
+		batch[i] = &reqs[i];
+	}
+
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, ARRAY_SIZE(reqs));
+
+	/* Merging stops at the limit of the device */
+	UK_TEST_ASSERT(ramblk_queues[0].nb_seen == 2);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[0].nb_sectors,
+			       RAMBLK_MAXSECS);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[1].start_sector,
+			       RAMBLK_MAXSECS);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[1].nb_sectors, 8);
+
+	ramblk_close();
+}
+
+UK_TESTCASE(ukblkdev, iosched_merge_sg)
+{
+	static __u8 buf[3][2 * RAMBLK_SSIZE] __align(RAMBLK_SSIZE);
+	struct uk_blkreq reqs[3], *batch[3];
+	struct uk_sglist *sg;
+	uint16_t cnt = 3;
+	int rc, i;
+
+	UK_TEST_ASSERT(ramblk_open(1) == 0);
+
+	/* Adjacent sectors, but the buffers have gaps in between */
+	for (i = 0; i < 3; i++) {
+		uk_blkreq_init(&reqs[i], UK_BLKREQ_READ, 40 + i, 1, buf[i],
+			       count_done, NULL);
+		batch[i] = &reqs[i];
+	}
+
+	nb_done = 0;
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	UK_TEST_EXPECT_SNUM_EQ(cnt, 3);
+
+	UK_TEST_ASSERT(ramblk_queues[0].nb_seen == 1);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].seen[0].nb_sectors, 3);
+	sg = ramblk_queues[0].seen[0].sg;
+	UK_TEST_ASSERT(sg != NULL);
+	UK_TEST_EXPECT_SNUM_EQ(uk_sglist_length(sg), 3 * RAMBLK_SSIZE);
+	UK_TEST_EXPECT_SNUM_EQ(sg->sg_segs[0].ss_paddr,
+			       ukplat_virt_to_phys(buf[0]));
+
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+	UK_TEST_EXPECT_SNUM_EQ(nb_done, 3);
+
+	ramblk_close();
+}
+#endif /* CONFIG_LIBUKBLKDEV_IOSCHED */
+
+#if CONFIG_LIBUKSGLIST
+UK_TESTCASE(ukblkdev, sg_unsupported)
+{
+	static __u8 buf[RAMBLK_SSIZE];
+	struct uk_sglist_seg seg;
+	struct uk_sglist sg;
+	struct uk_blkreq req, *batch[1] = { &req };
+	uint16_t cnt = 1;
+	int rc;
+
+	UK_TEST_ASSERT(ramblk_open(0) == 0);
+
+	uk_sglist_init(&sg, 1, &seg);
+	UK_TEST_ASSERT(uk_sglist_append(&sg, buf, sizeof(buf)) == 0);
+	uk_blkreq_init_sg(&req, UK_BLKREQ_READ, 0, 1, &sg, NULL, NULL);
+
+	rc = uk_blkdev_queue_submit_one(&ramblk, 0, &req);
+	UK_TEST_EXPECT(uk_blkdev_status_successful(rc));
+	uk_blkdev_queue_finish_reqs(&ramblk, 0);
+
+	ramblk.capabilities.max_segments = 0;
+	rc = uk_blkdev_queue_submit_one(&ramblk, 0, &req);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -ENOTSUP);
+	rc = uk_blkdev_queue_submit_batch(&ramblk, 0, batch, &cnt);
+	UK_TEST_EXPECT_SNUM_EQ(rc, -ENOTSUP);
+	UK_TEST_EXPECT_SNUM_EQ(ramblk_queues[0].nb_seen, 1);
+
+	ramblk_close();
+}
+#endif /* CONFIG_LIBUKSGLIST */
+
+/*
+ * Benchmark in the style of fio: keeps a fixed number of requests in flight
+ * on the first block device that is not in use and reports IOPS and
+ * throughput for sequential and random patterns. The queue is polled.
+ */
+#define BENCH_NSEC	ukarch_time_msec_to_nsec(500)
+#define BENCH_MAXQD	32
+#define BENCH_SPAN	(1UL << 30)
+
+struct bench_job {
+	const char *name;
+	enum uk_blkreq_op op;
+	int random;
+	__sz bs;
+	uint16_t qd;
+};
+
+static const struct bench_job bench_jobs[] = {
+	{ "seqread",   UK_BLKREQ_READ,  0,   4096,  1 },
+	{ "seqread",   UK_BLKREQ_READ,  0,   4096, 32 },
+	{ "seqread",   UK_BLKREQ_READ,  0, 131072,  8 },
+	{ "randread",  UK_BLKREQ_READ,  1,   4096,  1 },
+	{ "randread",  UK_BLKREQ_READ,  1,   4096, 32 },
+#if CONFIG_LIBUKBLKDEV_TEST_BENCH_WRITE
+	{ "seqwrite",  UK_BLKREQ_WRITE, 0,   4096, 32 },
+	{ "randwrite", UK_BLKREQ_WRITE, 1,   4096, 32 },
+#endif /* CONFIG_LIBUKBLKDEV_TEST_BENCH_WRITE */
+};
+
+struct bench_slot {
+	struct uk_blkreq req;
+	int busy;
+};
+
+static unsigned long bench_completed;
+static unsigned long bench_errors;
+
+static void bench_done(struct uk_blkreq *req, void *cookie)
+{
+	struct bench_slot *slot = (struct bench_slot *) cookie;
+
+	if (unlikely(req->result < 0))
+		bench_errors++;
+	slot->busy = 0;
+	bench_completed++;
+}
+
+static struct uk_blkdev *bench_dev_get(void)
+{
+	struct uk_blkdev *dev;
+	unsigned int i;
+
+	for (i = 0; i < uk_blkdev_count(); i++) {
+		dev = uk_blkdev_get(i);
+		if (dev && uk_blkdev_state_get(dev) == UK_BLKDEV_UNCONFIGURED)
+			return dev;
+	}
+	return NULL;
+}
+
+static int bench_open(struct uk_blkdev *dev, int iosched __maybe_unused)
+{
+	struct uk_blkdev_conf conf = { .nb_queues = 1 };
+	struct uk_blkdev_queue_info qinfo;
+	struct uk_blkdev_queue_conf qconf;
+	int rc;
+
+	rc = uk_blkdev_configure(dev, &conf);
+	if (rc < 0)
+		return rc;
+
+	rc = uk_blkdev_queue_get_info(dev, 0, &qinfo);
+	if (rc < 0)
+		goto err_unconfigure;
+
+	memset(&qconf, 0, sizeof(qconf));
+	qconf.a = uk_alloc_get_default();
+#if CONFIG_LIBUKBLKDEV_IOSCHED
+	qconf.iosched = iosched;
+#endif /* CONFIG_LIBUKBLKDEV_IOSCHED */
+	rc = uk_blkdev_queue_configure(dev, 0, qinfo.nb_max, &qconf);
+	if (rc < 0)
+		goto err_unconfigure;
+
+	rc = uk_blkdev_start(dev);
+	if (rc < 0)
+		goto err_queue_unconfigure;
+	return 0;
+
+err_queue_unconfigure:
+	uk_blkdev_queue_unconfigure(dev, 0);
+err_unconfigure:
+	uk_blkdev_unconfigure(dev);
+	return rc;
+}
+
+static void bench_close(struct uk_blkdev *dev)
+{
+	uk_blkdev_stop(dev);
+	uk_blkdev_queue_unconfigure(dev, 0);
+	uk_blkdev_unconfigure(dev);
+}
+
+static void bench_run(struct uk_blkdev *dev, const struct bench_job *job,
+		      struct bench_slot *slots, __u8 *buf)
+{
+	struct uk_blkreq *batch[BENCH_MAXQD];
+	__sector bs = job->bs / uk_blkdev_ssize(dev);
+	__sector span = MIN(uk_blkdev_sectors(dev),
+			    BENCH_SPAN / uk_blkdev_ssize(dev)) / bs;
+	__sector next = 0;
+	__u32 rnd = 0x2545f491;
+	__nsec start, now;
+	unsigned long submitted = 0;
+	uint16_t i, cnt;
+	int rc;
+
+	if (span == 0 || bs * uk_blkdev_ssize(dev) != job->bs ||
+	    bs > uk_blkdev_max_sec_per_req(dev))
+		return;
+
+	bench_completed = 0;
+	bench_errors = 0;
+	start = ukplat_monotonic_clock();
+	do {
+		/* Refill all free slots with one batch */
+		for (i = 0, cnt = 0; i < job->qd; i++) {
+			if (slots[i].busy)
+				continue;
+			if (job->random) {
+				rnd ^= rnd << 13;
+				rnd ^= rnd >> 17;
+				rnd ^= rnd << 5;
+				next = rnd % span;
+			} else {
+				next = (next + 1) % span;
+			}
+			uk_blkreq_init(&slots[i].req, job->op, next * bs, bs,
+				       buf + i * job->bs, bench_done,
+				       &slots[i]);
+			batch[cnt++] = &slots[i].req;
+		}
+		if (cnt) {
+			rc = uk_blkdev_queue_submit_batch(dev, 0, batch, &cnt);
+			if (unlikely(rc < 0 && rc != -ENOSPC)) {
+				uk_test_printf("%s: submit failed: %d\n",
+					       job->name, rc);
+				break;
+			}
+			for (i = 0; i < cnt; i++)
+				((struct bench_slot *)
+				 batch[i]->cb_cookie)->busy = 1;
+			submitted += cnt;
+		}
+
+		uk_blkdev_queue_finish_reqs(dev, 0);
+		now = ukplat_monotonic_clock();
+	} while (now - start < BENCH_NSEC);
+
+	/* Drain */
+	while (bench_completed != submitted)
+		uk_blkdev_queue_finish_reqs(dev, 0);
+	now = ukplat_monotonic_clock() - start;
+
+	uk_test_printf("%-9s bs=%6"__PRIsz" qd=%2"PRIu16": %8"__PRIu64" IOPS, %5"__PRIu64" MiB/s%s\n",
+		       job->name, job->bs, job->qd,
+		       (__u64) (bench_completed * UKARCH_NSEC_PER_SEC / now),
+		       (__u64) (((bench_completed * job->bs >> 10) *
+				 UKARCH_NSEC_PER_SEC / now) >> 10),
+		       bench_errors ? " (errors)" : "");
+}
+
+UK_TESTCASE(ukblkdev, bench_device)
+{
+	struct bench_slot *slots;
+	struct uk_blkdev *dev;
+	__sz bufsize;
+	unsigned int i;
+	int iosched;
+	__u8 *buf;
+
+	dev = bench_dev_get();
+	if (!dev) {
+		uk_test_printf("No unused block device, skipping benchmark\n");
+		return;
+	}
+
+	bufsize = 0;
+	for (i = 0; i < ARRAY_SIZE(bench_jobs); i++)
+		bufsize = MAX(bufsize, bench_jobs[i].bs * bench_jobs[i].qd);
+	buf = uk_memalign(uk_alloc_get_default(), __PAGE_SIZE, bufsize);
+	slots = uk_calloc(uk_alloc_get_default(), BENCH_MAXQD,
+			  sizeof(*slots));
+	UK_TEST_ASSERT(buf && slots);
+
+	for (iosched = 0; iosched <= 1; iosched++) {
+#if !CONFIG_LIBUKBLKDEV_IOSCHED
+		if (iosched)
+			break;
+#endif /* !CONFIG_LIBUKBLKDEV_IOSCHED */
+		UK_TEST_ASSERT(bench_open(dev, iosched) == 0);
+		uk_test_printf("blkdev%"PRIu16" (%s)%s:\n",
+			       uk_blkdev_id_get(dev),
+			       uk_blkdev_drv_name_get(dev),
+			       iosched ? " with I/O scheduler" : "");
+		for (i = 0; i < ARRAY_SIZE(bench_jobs); i++) {
+			if (bench_jobs[i].op == UK_BLKREQ_WRITE &&
+			    uk_blkdev_mode(dev) == O_RDONLY)
+				continue;
+			bench_run(dev, &bench_jobs[i], slots, buf);
+		}
+		bench_close(dev);
+	}
+
+	uk_free(uk_alloc_get_default(), slots);
+	uk_free(uk_alloc_get_default(), buf);
+}
+
+uk_testsuite_register(ukblkdev, NULL);
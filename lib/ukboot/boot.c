@@ -63,6 +63,10 @@
 #include <uk/tinyalloc.h>
 #define uk_alloc_init uk_tinyalloc_init
 #endif
+#if CONFIG_LIBUKBOOT_INITSLAB
+#include <uk/allocslab.h>
+#include <uk/alloc_impl.h>
+#endif /* CONFIG_LIBUKBOOT_INITSLAB */
 #if CONFIG_LIBUKSCHED
 #include <uk/sched.h>
 #endif /* CONFIG_LIBUKSCHED */
@@ -290,11 +294,20 @@ void ukplat_entry(int argc, char *argv[])
 	a = heap_init();
 	if (unlikely(!a))
 		UK_CRASH("Failed to initialize memory allocator\n");
-	else {
-		rc = ukplat_memallocator_set(a);
-		if (unlikely(rc != 0))
-			UK_CRASH("Could not set the platform memory allocator\n");
-	}
+
+#if CONFIG_LIBUKBOOT_INITSLAB
+	a = uk_allocslab_init(a);
+	if (unlikely(!a))
+		UK_CRASH("Failed to initialize slab allocator\n");
+
+	rc = uk_alloc_set_default(a);
+	if (unlikely(rc != 0))
+		UK_CRASH("Could not set the slab allocator as default\n");
+#endif /* CONFIG_LIBUKBOOT_INITSLAB */
+
+	rc = ukplat_memallocator_set(a);
+	if (unlikely(rc != 0))
+		UK_CRASH("Could not set the platform memory allocator\n");
 
 	/* Allocate a TLS for this execution context */
 	tls = uk_memalign(a,
@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UKARCH_TICKETLOCK_H__
+#define __UKARCH_TICKETLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <uk/arch/lcpu.h>
+
+#ifdef CONFIG_HAVE_SMP
+#include <uk/arch/atomic.h>
+
+/* Unless you know what you are doing, use struct uk_spinlock instead. */
+typedef struct __ticketlock __ticketlock;
+
+struct __align(4) __ticketlock {
+	__u16	current; /* currently served */
+	__u16	next;	 /* next available ticket */
+} __packed;
+
+/* Initialize a ticketlock to unlocked state */
+#define UKARCH_TICKETLOCK_INITIALIZER() { 0 }
+
+static inline void ukarch_ticket_init(struct __ticketlock *lock)
+{
+	lock->next = 0;
+	lock->current = 0;
+}
+
+static inline void ukarch_ticket_lock(struct __ticketlock *lock)
+{
+	register __u32 r = 0x10000;
+
+	__asm__ __volatile__(
+		"	lock; xaddl %0, (%1)\n"   /* draw ticket, r = old value */
+		"	movl	%0, %%edx\n"
+		"	shrl	$16, %%edx\n"     /* edx = our ticket */
+		"1:	cmpw	%%dx, %w0\n"      /* is it our ticket? */
+		"	je	2f\n"             /* if yes, lock acquired */
+		"	pause\n"                  /* hint spinning */
+		"	movw	(%1), %w0\n"      /* reload current */
+		"	jmp	1b\n"
+		"2:"                              /* critical section */
+		: "+&r" (r)
+		: "r" (lock)
+		: "edx", "memory", "cc");
+}
+
+static inline void ukarch_ticket_unlock(struct __ticketlock *lock)
+{
+	/* Only the owner writes `current`; stores are not reordered with
+	 * earlier loads and stores on x86, so a plain increment releases.
+	 */
+	__asm__ __volatile__(
+		"	addw	$1, %0\n"
+		: "+m" (lock->current)
+		:
+		: "memory", "cc");
+}
+
+static inline int ukarch_ticket_trylock(struct __ticketlock *lock)
+{
+	register __u32 r, n;
+	int ok = 0;
+
+	__asm__ __volatile__(
+		"	movl	(%3), %%eax\n"     /* read current/next */
+		"	movl	%%eax, %1\n"
+		"	roll	$16, %1\n"
+		"	cmpl	%%eax, %1\n"       /* current == next ? */
+		"	jne	1f\n"              /* bail out if locked */
+		"	leal	0x10000(%%eax), %1\n" /* increment next */
+		"	lock; cmpxchgl %1, (%3)\n" /* try to update next */
+		"	sete	%b2\n"
+		"1:\n"
+		: "=&a" (r), "=&r" (n), "+&q" (ok)
+		: "r" (lock)
+		: "memory", "cc");
+	(void)r;
+	return ok;
+}
+
+static inline int ukarch_ticket_is_locked(struct __ticketlock *lock)
+{
+	return !(UK_READ_ONCE(lock->next) == UK_READ_ONCE(lock->current));
+}
+
+#else /* CONFIG_HAVE_SMP */
+
+typedef struct __ticketlock {
+	/* empty */
+} __ticketlock;
+
+#define UKARCH_TICKETLOCK_INITIALIZER()	{}
+#define ukarch_ticket_init(lock)		(void)(lock)
+#define ukarch_ticket_lock(lock)		\
+	do { barrier(); (void)(lock); } while (0)
+#define ukarch_ticket_unlock(lock)	\
+	do { barrier(); (void)(lock); } while (0)
+#define ukarch_ticket_trylock(lock)	({ barrier(); (void)(lock); 1; })
+#define ukarch_ticket_is_locked(lock)	({ barrier(); (void)(lock); 0; })
+
+#endif /* CONFIG_HAVE_SMP */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UKARCH_TICKETLOCK_H__ */
@@ -37,7 +37,10 @@
 
 #if CONFIG_LIBUKLOCK_MUTEX
 #include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/arch/atomic.h>
 #include <uk/plat/lcpu.h>
+#include <uk/spinlock.h>
 #include <uk/thread.h>
 #include <uk/wait.h>
 #include <uk/wait_types.h>
@@ -53,15 +56,31 @@ extern "C" {
 #endif
 
 /*
- * Mutex that relies on a scheduler
- * uses wait queues for threads
+ * Recursive mutex built around an atomic owner word. Locking an unlocked
+ * mutex and unlocking a mutex without waiters are a single compare-and-swap.
+ * A contended locker spins while the owner is running on another lcpu and
+ * sleeps on the wait queue otherwise. A waiter that starves makes the next
+ * unlock hand the mutex over to the first waiter instead of releasing it.
  */
 struct uk_mutex {
+	/* Owner thread and UK_MUTEX_F_* flags, 0 if unlocked */
+	__uptr owner;
+	/* Recursion depth, only modified by the owner */
 	int lock_count;
-	struct uk_thread *owner;
+	/* Protects the wait queue */
+	uk_spinlock wait_lock;
 	struct uk_waitq wait;
 };
 
+/* There are threads on the wait queue, unlock must wake one */
+#define UK_MUTEX_F_WAITERS	0x1UL
+/* A waiter starves, unlock must hand the mutex over to a waiter */
+#define UK_MUTEX_F_HANDOFF	0x2UL
+#define UK_MUTEX_F_MASK		(UK_MUTEX_F_WAITERS | UK_MUTEX_F_HANDOFF)
+
+#define uk_mutex_owner(m) \
+	((struct uk_thread *) (ukarch_load_n(&(m)->owner) & ~UK_MUTEX_F_MASK))
+
 /*
  * Mutex statistics for ukstore.
  */
@@ -90,105 +109,103 @@ extern __spinlock              _uk_mutex_metrics_lock;
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
 #define	UK_MUTEX_INITIALIZER(name)				\
-	{ 0, NULL, __WAIT_QUEUE_INITIALIZER((name).wait) }
+	{ 0, 0, UK_SPINLOCK_INITIALIZER(),			\
+	  __WAIT_QUEUE_INITIALIZER((name).wait) }
 
 void uk_mutex_init(struct uk_mutex *m);
 void uk_mutex_get_metrics(struct uk_mutex_metrics *dst);
 
+/* Contended paths (see mutex.c) */
+void _uk_mutex_lock_slow(struct uk_mutex *m, struct uk_thread *current);
+void _uk_mutex_unlock_slow(struct uk_mutex *m);
+
 static inline void uk_mutex_lock(struct uk_mutex *m)
 {
 	struct uk_thread *current;
-	unsigned long irqf;
 
 	UK_ASSERT(m);
 
 	current = uk_thread_current();
+	UK_ASSERT(current);
+	UK_ASSERT(!((__uptr) current & UK_MUTEX_F_MASK));
+
+	if (likely(ukarch_compare_exchange_sync(&m->owner, 0,
+						(__uptr) current)
+		   == (__uptr) current))
+		m->lock_count = 1;
+	else if (uk_mutex_owner(m) == current)
+		m->lock_count++;
+	else
+		_uk_mutex_lock_slow(m, current);
 
-	for (;;) {
-		uk_waitq_wait_event(&m->wait,
-			m->lock_count == 0 || m->owner == current);
-		irqf = ukplat_lcpu_save_irqf();
-		if (m->lock_count == 0 || m->owner == current)
-			break;
-		ukplat_lcpu_restore_irqf(irqf);
-	}
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
-	m->lock_count++;
-	m->owner = current;
-
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 	_uk_mutex_metrics.active_locked   += (m->lock_count == 1);
 	_uk_mutex_metrics.active_unlocked -= (m->lock_count == 1);
 	_uk_mutex_metrics.total_locks++;
-
 	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-	ukplat_lcpu_restore_irqf(irqf);
 }
 
 static inline int uk_mutex_trylock(struct uk_mutex *m)
 {
 	struct uk_thread *current;
-	unsigned long irqf;
 	int ret = 0;
 
 	UK_ASSERT(m);
 
 	current = uk_thread_current();
 
-	irqf = ukplat_lcpu_save_irqf();
-	if (m->lock_count == 0 || m->owner == current) {
+	if (ukarch_compare_exchange_sync(&m->owner, 0, (__uptr) current)
+	    == (__uptr) current) {
+		ret = 1;
+		m->lock_count = 1;
+	} else if (uk_mutex_owner(m) == current) {
 		ret = 1;
 		m->lock_count++;
-		m->owner = current;
 	}
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
+	ukarch_spin_lock(&_uk_mutex_metrics_lock);
 	_uk_mutex_metrics.active_locked += (ret == 1) && (m->lock_count == 1);
-	_uk_mutex_metrics.active_unlocked += (ret == 1) && (m->lock_count == 1);
+	_uk_mutex_metrics.active_unlocked -= (ret == 1) && (m->lock_count == 1);
 	_uk_mutex_metrics.total_ok_trylocks += ret;
 	_uk_mutex_metrics.total_failed_trylocks += !ret;
+	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
-	ukplat_lcpu_restore_irqf(irqf);
 	return ret;
 }
 
 static inline int uk_mutex_is_locked(struct uk_mutex *m)
 {
-	return m->lock_count > 0;
+	return uk_mutex_owner(m) != NULL;
 }
 
 static inline void uk_mutex_unlock(struct uk_mutex *m)
 {
-	unsigned long irqf;
+	__uptr current;
+	int released;
 
 	UK_ASSERT(m);
-
-	irqf = ukplat_lcpu_save_irqf();
-
-#ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	ukarch_spin_lock(&_uk_mutex_metrics_lock);
-#endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
 	UK_ASSERT(m->lock_count > 0);
-	if (--m->lock_count == 0) {
-		m->owner = NULL;
-		uk_waitq_wake_up(&m->wait);
+
+	released = (--m->lock_count == 0);
+	if (released) {
+		/* Fails if there are waiters or if we are not the owner */
+		current = (__uptr) uk_thread_current();
+		if (unlikely(ukarch_compare_exchange_sync(&m->owner, current,
+							  0) != 0))
+			_uk_mutex_unlock_slow(m);
 	}
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
-	_uk_mutex_metrics.active_locked   -= (m->lock_count == 0);
-	_uk_mutex_metrics.active_unlocked += (m->lock_count == 0);
+	ukarch_spin_lock(&_uk_mutex_metrics_lock);
+	_uk_mutex_metrics.active_locked   -= released;
+	_uk_mutex_metrics.active_unlocked += released;
 	_uk_mutex_metrics.total_unlocks++;
-
 	ukarch_spin_unlock(&_uk_mutex_metrics_lock);
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
-
-	ukplat_lcpu_restore_irqf(irqf);
 }
 
 #define uk_waitq_wait_event_mutex(wq, condition, mutex) \
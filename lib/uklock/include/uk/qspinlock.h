@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Queued spinlock
+ *
+ * A 32-bit lock word holds a locked byte and the tail of a queue of waiting
+ * lcpus. The uncontended case is a single compare-and-swap. Contending lcpus
+ * append a per-lcpu queue node (MCS lock) and each spins on its own node
+ * only, so that waiters are served in FIFO order and an unlock touches at
+ * most one other cache line. Only the head of the queue spins on the lock
+ * word itself.
+ */
+
+#ifndef __UK_QSPINLOCK_H__
+#define __UK_QSPINLOCK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <uk/essentials.h>
+#include <uk/arch/lcpu.h>
+
+#ifdef CONFIG_HAVE_SMP
+#include <uk/arch/atomic.h>
+
+/* Unless you know what you are doing, use struct uk_spinlock instead. */
+typedef struct __qspinlock __qspinlock;
+
+struct __align(4) __qspinlock {
+	union {
+		__u32 val;
+		struct {
+			__u8	locked;	/* held by an lcpu */
+			__u8	pad;
+			__u16	tail;	/* last waiter: (lcpu + 1) << 2 | node */
+		};
+	};
+};
+
+#define UK_QSPINLOCK_LOCKED		0x1U
+
+/* Initialize a queued spinlock to unlocked state */
+#define UK_QSPINLOCK_INITIALIZER()	{ { 0 } }
+
+/* Slow path when the lock is held or has waiters, see qspinlock.c */
+void _uk_qspin_lock_slow(struct __qspinlock *lock);
+
+static inline void uk_qspin_init(struct __qspinlock *lock)
+{
+	lock->val = 0;
+}
+
+static inline void uk_qspin_lock(struct __qspinlock *lock)
+{
+	if (likely(ukarch_compare_exchange_sync(&lock->val, 0,
+						UK_QSPINLOCK_LOCKED)
+		   == UK_QSPINLOCK_LOCKED))
+		return;
+	_uk_qspin_lock_slow(lock);
+}
+
+static inline void uk_qspin_unlock(struct __qspinlock *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+static inline int uk_qspin_trylock(struct __qspinlock *lock)
+{
+	if (UK_READ_ONCE(lock->val))
+		return 0;
+	return ukarch_compare_exchange_sync(&lock->val, 0,
+					    UK_QSPINLOCK_LOCKED)
+	       == UK_QSPINLOCK_LOCKED;
+}
+
+static inline int uk_qspin_is_locked(struct __qspinlock *lock)
+{
+	return UK_READ_ONCE(lock->val) != 0;
+}
+
+#else /* CONFIG_HAVE_SMP */
+
+typedef struct __qspinlock {
+	/* empty */
+} __qspinlock;
+
+#define UK_QSPINLOCK_INITIALIZER()	{}
+#define uk_qspin_init(lock)		(void)(lock)
+#define uk_qspin_lock(lock)		\
+	do { barrier(); (void)(lock); } while (0)
+#define uk_qspin_unlock(lock)		\
+	do { barrier(); (void)(lock); } while (0)
+#define uk_qspin_trylock(lock)		({ barrier(); (void)(lock); 1; })
+#define uk_qspin_is_locked(lock)	({ barrier(); (void)(lock); 0; })
+
+#endif /* CONFIG_HAVE_SMP */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_QSPINLOCK_H__ */
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Read-copy-update
+ *
+ * Readers access shared data without taking locks, between
+ * uk_rcu_read_lock() and uk_rcu_read_unlock(). A read-side critical section
+ * must not block or yield. Updaters publish new data with
+ * uk_rcu_assign_pointer() and free old data only after a grace period, i.e.,
+ * once every reader that could still see it has left its critical section.
+ *
+ * A grace period has passed for an lcpu once it did a context switch, or
+ * once it was seen outside of a critical section. Threads switch only
+ * voluntarily, so a context switch is a quiescent state.
+ */
+
+#ifndef __UK_RCU_H__
+#define __UK_RCU_H__
+
+#include <uk/config.h>
+
+#if CONFIG_LIBUKLOCK_RCU
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/plat/lcpu.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct uk_rcu_head {
+	struct uk_rcu_head *next;
+	void (*func)(struct uk_rcu_head *head);
+};
+
+#ifdef CONFIG_HAVE_SMP
+struct __align(CACHE_LINE_SIZE) uk_rcu_lcpu {
+	/* Nesting depth of read-side critical sections */
+	unsigned long nesting;
+	/* Incremented on each context switch */
+	unsigned long qs;
+};
+
+extern UKPLAT_PER_LCPU_DEFINE(struct uk_rcu_lcpu, uk_rcu_lcpu);
+
+static inline void uk_rcu_read_lock(void)
+{
+	ukarch_inc(&ukplat_per_lcpu_current(uk_rcu_lcpu).nesting);
+}
+
+static inline void uk_rcu_read_unlock(void)
+{
+	ukarch_dec(&ukplat_per_lcpu_current(uk_rcu_lcpu).nesting);
+}
+
+/* Reports a quiescent state of the current lcpu, called by the scheduler
+ * on every context switch
+ */
+static inline void uk_rcu_qs(void)
+{
+	struct uk_rcu_lcpu *l = &ukplat_per_lcpu_current(uk_rcu_lcpu);
+
+	ukarch_store_n(&l->qs, l->qs + 1);
+}
+#else /* !CONFIG_HAVE_SMP */
+/* With a single lcpu, no reader runs while an updater runs */
+#define uk_rcu_read_lock()	barrier()
+#define uk_rcu_read_unlock()	barrier()
+#define uk_rcu_qs()		do { } while (0)
+#endif /* !CONFIG_HAVE_SMP */
+
+/**
+ * Waits until all read-side critical sections that started before the call
+ * have finished. May block, and must not be called from a read-side
+ * critical section.
+ */
+void uk_rcu_synchronize(void);
+
+/**
+ * Calls `func` with `head` after a grace period. Does not wait for the
+ * grace period. With SMP, callbacks run in batches in a kernel thread and
+ * may block. Without SMP, `func` is called right away.
+ */
+void uk_rcu_call(struct uk_rcu_head *head,
+		 void (*func)(struct uk_rcu_head *head));
+
+/**
+ * Publishes `v` through the pointer `p`. Stores that initialized the data
+ * that `v` points to are visible before `v` itself.
+ */
+#define uk_rcu_assign_pointer(p, v)				\
+	__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+/**
+ * Reads a pointer that is published with uk_rcu_assign_pointer() in a
+ * read-side critical section.
+ */
+#define uk_rcu_dereference(p)					\
+	__atomic_load_n(&(p), __ATOMIC_CONSUME)
+
+/*
+ * Hash lists that are updated under a lock and traversed by readers
+ * without it
+ */
+static inline void
+uk_hlist_add_head_rcu(struct uk_hlist_node *n, struct uk_hlist_head *h)
+{
+	struct uk_hlist_node *first = h->first;
+
+	n->next = first;
+	n->pprev = &h->first;
+	uk_rcu_assign_pointer(h->first, n);
+	if (first)
+		first->pprev = &n->next;
+}
+
+/* Unlinks `n` unless it is unhashed already. Readers that are at `n` can
+ * still continue from it, so `n->next` is left as it is.
+ */
+static inline void
+uk_hlist_del_init_rcu(struct uk_hlist_node *n)
+{
+	if (uk_hlist_unhashed(n))
+		return;
+
+	UK_WRITE_ONCE(*n->pprev, n->next);
+	if (n->next)
+		n->next->pprev = n->pprev;
+	n->pprev = NULL;
+}
+
+#define __uk_hlist_entry_rcu(ptr, type, member)			\
+	({								\
+		struct uk_hlist_node *__n = uk_rcu_dereference(ptr);	\
+									\
+		__n ? uk_hlist_entry(__n, type, member) : NULL;		\
+	})
+
+#define uk_hlist_for_each_entry_rcu(pos, head, member)			\
+	for (pos = __uk_hlist_entry_rcu((head)->first,			\
+					__typeof__(*(pos)), member);	\
+	     pos;							\
+	     pos = __uk_hlist_entry_rcu((pos)->member.next,		\
+					__typeof__(*(pos)), member))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_LIBUKLOCK_RCU */
+
+#endif /* __UK_RCU_H__ */
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_RWLOCK_H__
+#define __UK_RWLOCK_H__
+
+#include <uk/config.h>
+
+#if CONFIG_LIBUKLOCK_RWLOCK
+#include <uk/assert.h>
+#include <uk/spinlock.h>
+#include <uk/arch/atomic.h>
+#include <uk/wait_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Reader-writer lock that relies on a scheduler
+ *
+ * Any number of readers or a single writer can hold the lock. Writers are
+ * preferred: once a writer waits, new readers have to wait until no writer
+ * is left. The lock is not recursive.
+ */
+struct uk_rwlock {
+	/* Number of readers holding the lock */
+	int nr_readers;
+	/* Number of writers waiting for the lock */
+	int nr_writers_waiting;
+	/* Set while a writer holds the lock */
+	int writer;
+	uk_spinlock sl;
+	struct uk_waitq shared;
+	struct uk_waitq exclusive;
+};
+
+#define UK_RWLOCK_INITIALIZER(name)				\
+	{ 0, 0, 0, UK_SPINLOCK_INITIALIZER(),			\
+	  __WAIT_QUEUE_INITIALIZER((name).shared),		\
+	  __WAIT_QUEUE_INITIALIZER((name).exclusive) }
+
+void uk_rwlock_init(struct uk_rwlock *rwl);
+
+/**
+ * Acquires the lock for reading. Blocks while a writer holds or waits for
+ * the lock.
+ */
+void uk_rwlock_rlock(struct uk_rwlock *rwl);
+
+/**
+ * Releases the lock after reading.
+ */
+void uk_rwlock_runlock(struct uk_rwlock *rwl);
+
+/**
+ * Acquires the lock for writing. Blocks while readers or another writer
+ * hold the lock.
+ */
+void uk_rwlock_wlock(struct uk_rwlock *rwl);
+
+/**
+ * Releases the lock after writing.
+ */
+void uk_rwlock_wunlock(struct uk_rwlock *rwl);
+
+/**
+ * Tries to acquire the lock for reading without blocking.
+ *
+ * @return 1 if the lock was acquired, 0 otherwise
+ */
+int uk_rwlock_tryrlock(struct uk_rwlock *rwl);
+
+/**
+ * Tries to acquire the lock for writing without blocking.
+ *
+ * @return 1 if the lock was acquired, 0 otherwise
+ */
+int uk_rwlock_trywlock(struct uk_rwlock *rwl);
+
+static inline int uk_rwlock_is_wlocked(struct uk_rwlock *rwl)
+{
+	UK_ASSERT(rwl);
+	return UK_READ_ONCE(rwl->writer);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_LIBUKLOCK_RWLOCK */
+
+#endif /* __UK_RWLOCK_H__ */
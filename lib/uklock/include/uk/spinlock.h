@@ -39,7 +39,43 @@ extern "C" {
 
 /* See uk/arch/spinlock.h for the interface documentation */
 
-#ifndef CONFIG_LIBUKLOCK_TICKETLOCK
+#if CONFIG_LIBUKLOCK_TICKETLOCK
+
+#ifndef uk_spinlock
+
+#ifdef CONFIG_ARCH_ARM_64
+#include <uk/arch/arm64/ticketlock.h>
+#endif
+#ifdef CONFIG_ARCH_X86_64
+#include <uk/arch/x86_64/ticketlock.h>
+#endif
+
+#define uk_spinlock __ticketlock
+
+#define UK_SPINLOCK_INITIALIZER()  UKARCH_TICKETLOCK_INITIALIZER()
+#define uk_spin_init(lock)         ukarch_ticket_init(lock)
+#define __uk_spin_lock(lock)       ukarch_ticket_lock(lock)
+#define uk_spin_unlock(lock)       ukarch_ticket_unlock(lock)
+#define uk_spin_trylock(lock)      ukarch_ticket_trylock(lock)
+#define uk_spin_is_locked(lock)    ukarch_ticket_is_locked(lock)
+#endif /* uk_spinlock */
+
+#elif CONFIG_LIBUKLOCK_QSPINLOCK
+
+#ifndef uk_spinlock
+#include <uk/qspinlock.h>
+
+#define uk_spinlock __qspinlock
+
+#define UK_SPINLOCK_INITIALIZER()  UK_QSPINLOCK_INITIALIZER()
+#define uk_spin_init(lock)         uk_qspin_init(lock)
+#define __uk_spin_lock(lock)       uk_qspin_lock(lock)
+#define uk_spin_unlock(lock)       uk_qspin_unlock(lock)
+#define uk_spin_trylock(lock)      uk_qspin_trylock(lock)
+#define uk_spin_is_locked(lock)    uk_qspin_is_locked(lock)
+#endif /* uk_spinlock */
+
+#else	/* CONFIG_LIBUKLOCK_SPINLOCK */
 
 #ifndef uk_spinlock
 #include <uk/arch/spinlock.h>
@@ -48,31 +84,67 @@ extern "C" {
 
 #define UK_SPINLOCK_INITIALIZER()  UKARCH_SPINLOCK_INITIALIZER()
 #define uk_spin_init(lock)         ukarch_spin_init(lock)
-#define uk_spin_lock(lock)         ukarch_spin_lock(lock)
+#define __uk_spin_lock(lock)       ukarch_spin_lock(lock)
 #define uk_spin_unlock(lock)       ukarch_spin_unlock(lock)
 #define uk_spin_trylock(lock)      ukarch_spin_trylock(lock)
 #define uk_spin_is_locked(lock)    ukarch_spin_is_locked(lock)
 #endif /* uk_spinlock */
 
-#else	/* CONFIG_LIBUKLOCK_TICKETLOCK */
+#endif	/* CONFIG_LIBUKLOCK_SPINLOCK */
 
-#ifndef uk_spinlock
+#if CONFIG_LIBUKLOCK_SPINLOCK_STATS
+#include <uk/essentials.h>
 
-#ifdef CONFIG_ARCH_ARM_64
-#include <uk/arch/arm64/ticketlock.h>
-#endif
+/* Contention statistics of a call site of uk_spin_lock() */
+struct uk_spinlock_site {
+	const char *file;
+	unsigned int line;
+	int registered;
+	/* Number of acquisitions that found the lock busy */
+	__u64 contended;
+	/* Cycles spent spinning in total and at most in one acquisition */
+	__u64 cycles;
+	__u64 max_cycles;
+	struct uk_spinlock_site *next;
+};
 
-#define uk_spinlock __ticketlock
+void _uk_spin_lock_contended(uk_spinlock *lock,
+			     struct uk_spinlock_site *site);
 
-#define UK_SPINLOCK_INITIALIZER()  UKARCH_TICKETLOCK_INITIALIZER()
-#define uk_spin_init(lock)         ukarch_ticket_init(lock)
-#define uk_spin_lock(lock)         ukarch_ticket_lock(lock)
-#define uk_spin_unlock(lock)       ukarch_ticket_unlock(lock)
-#define uk_spin_trylock(lock)      ukarch_ticket_trylock(lock)
-#define uk_spin_is_locked(lock)    ukarch_ticket_is_locked(lock)
-#endif /* uk_spinlock */
+/**
+ * Calls `fn` for each call site of uk_spin_lock() that has seen contention
+ * since boot.
+ */
+void uk_spinlock_stats_foreach(void (*fn)(const struct uk_spinlock_site *site,
+					  void *arg),
+			       void *arg);
+
+/**
+ * Prints the statistics of all contended call sites to the kernel console.
+ */
+void uk_spinlock_stats_print(void);
+
+/**
+ * Clears the statistics of all call sites.
+ */
+void uk_spinlock_stats_reset(void);
 
-#endif	/* CONFIG_LIBUKLOCK_TICKETLOCK */
+#ifndef uk_spin_lock
+#define uk_spin_lock(lock)						\
+	do {								\
+		static struct uk_spinlock_site __uk_spin_site = {	\
+			.file = __FILE__,				\
+			.line = __LINE__,				\
+		};							\
+		if (unlikely(!uk_spin_trylock(lock)))			\
+			_uk_spin_lock_contended(lock, &__uk_spin_site);	\
+	} while (0)
+#endif /* uk_spin_lock */
+#else /* !CONFIG_LIBUKLOCK_SPINLOCK_STATS */
+#ifndef uk_spin_lock
+#define uk_spin_lock(lock)         __uk_spin_lock(lock)
+#endif /* uk_spin_lock */
+#endif /* !CONFIG_LIBUKLOCK_SPINLOCK_STATS */
 
 #ifdef __cplusplus
 }
@@ -1,4 +1,7 @@
 #include <uk/mutex.h>
+#include <uk/sched.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/time.h>
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 #include <uk/init.h>
@@ -8,10 +11,14 @@ struct uk_mutex_metrics _uk_mutex_metrics = { 0 };
 __spinlock              _uk_mutex_metrics_lock;
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 
+/* A waiter that did not get the mutex for this long requests a handoff */
+#define MUTEX_STARVATION_NSEC	ukarch_time_msec_to_nsec(1)
+
 void uk_mutex_init(struct uk_mutex *m)
 {
+	m->owner = 0;
 	m->lock_count = 0;
-	m->owner = NULL;
+	uk_spin_init(&m->wait_lock);
 	uk_waitq_init(&m->wait);
 
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
@@ -21,6 +28,153 @@ void uk_mutex_init(struct uk_mutex *m)
 #endif /* CONFIG_LIBUKLOCK_MUTEX_METRICS */
 }
 
+/* Returns 1 if the thread is currently running on another lcpu */
+static inline int mutex_owner_running(struct uk_thread *owner __maybe_unused)
+{
+#if CONFIG_HAVE_SMP
+	__lcpuidx self = ukplat_lcpu_idx();
+	__lcpuidx i;
+
+	for (i = 0; i < ukplat_lcpu_count(); i++) {
+		if (i != self && UK_ACCESS_ONCE(ukplat_per_lcpu(
+				__uk_sched_thread_current, i)) == owner)
+			return 1;
+	}
+#endif /* CONFIG_HAVE_SMP */
+	return 0;
+}
+
+/* Spins while the mutex is owned by a running thread. Spinning is pointless
+ * if the owner is not running, because it cannot release the mutex before it
+ * is scheduled again. Returns the last observed owner word.
+ */
+static __uptr mutex_spin(struct uk_mutex *m)
+{
+	unsigned int spins = 0;
+	__uptr owner;
+
+	while ((owner = ukarch_load_n(&m->owner)) & ~UK_MUTEX_F_MASK) {
+		if (spins++ >= CONFIG_LIBUKLOCK_MUTEX_SPIN ||
+		    !mutex_owner_running((struct uk_thread *)
+					 (owner & ~UK_MUTEX_F_MASK)))
+			break;
+		ukarch_spinwait();
+	}
+	return owner;
+}
+
+/* Returns 1 if the owner word was `old` and is now `new`. The value that
+ * ukarch_compare_exchange_sync() returns is ambiguous if `new == old`.
+ */
+static inline int mutex_cas(struct uk_mutex *m, __uptr old, __uptr new)
+{
+	return __atomic_compare_exchange_n(&m->owner, &old, new, 0,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void _uk_mutex_lock_slow(struct uk_mutex *m, struct uk_thread *current)
+{
+	struct uk_waitq_entry wait;
+	unsigned long irqf;
+	__snsec since = 0;
+	__uptr owner, flags;
+
+	uk_waitq_entry_init(&wait, current);
+
+	for (;;) {
+		owner = mutex_spin(m);
+		if (!(owner & ~UK_MUTEX_F_MASK)) {
+			/* Unlocked, take it but keep the waiters flag */
+			if (mutex_cas(m, owner, owner | (__uptr) current))
+				break;
+			continue;
+		}
+
+		irqf = ukplat_lcpu_save_irqf();
+		uk_spin_lock(&m->wait_lock);
+
+		/* The owner can only release the mutex with the slow path
+		 * once the waiters flag is set, which needs the wait lock.
+		 * Hence, we are guaranteed to be woken up, but only if the
+		 * owner word is still exactly the one we observed: The flags
+		 * may be set already, so that the exchange does not change it.
+		 */
+		flags = UK_MUTEX_F_WAITERS;
+		if (since && ukplat_monotonic_clock() - since >
+		    MUTEX_STARVATION_NSEC)
+			flags |= UK_MUTEX_F_HANDOFF;
+		if (!(owner & ~UK_MUTEX_F_MASK) ||
+		    !mutex_cas(m, owner, owner | flags)) {
+			uk_spin_unlock(&m->wait_lock);
+			ukplat_lcpu_restore_irqf(irqf);
+			continue;
+		}
+		if (!since)
+			since = ukplat_monotonic_clock();
+
+		/* A starving waiter goes first, so that it gets the handoff */
+		if (flags & UK_MUTEX_F_HANDOFF) {
+			UK_STAILQ_INSERT_HEAD(&m->wait, &wait, thread_list);
+			wait.waiting = 1;
+		} else {
+			uk_waitq_add(&m->wait, &wait);
+		}
+		uk_thread_set_blocked(current);
+		uk_sched_thread_blocked(current);
+
+		uk_spin_unlock(&m->wait_lock);
+		ukplat_lcpu_restore_irqf(irqf);
+
+		uk_sched_yield();
+
+		/* Unlock removed us from the queue unless the wakeup came
+		 * from somewhere else
+		 */
+		irqf = ukplat_lcpu_save_irqf();
+		uk_spin_lock(&m->wait_lock);
+		uk_waitq_remove(&m->wait, &wait);
+		uk_spin_unlock(&m->wait_lock);
+		ukplat_lcpu_restore_irqf(irqf);
+
+		if (uk_mutex_owner(m) == current)
+			break; /* Handed over to us */
+	}
+
+	m->lock_count = 1;
+}
+
+void _uk_mutex_unlock_slow(struct uk_mutex *m)
+{
+	struct uk_waitq_entry *wait;
+	unsigned long irqf;
+	__uptr owner;
+
+	irqf = ukplat_lcpu_save_irqf();
+	uk_spin_lock(&m->wait_lock);
+
+	/* The owner word cannot change while we hold the wait lock */
+	owner = ukarch_load_n(&m->owner);
+	wait = UK_STAILQ_FIRST(&m->wait);
+	if (wait) {
+		UK_STAILQ_REMOVE_HEAD(&m->wait, thread_list);
+		wait->waiting = 0;
+	}
+
+	if (wait && (owner & UK_MUTEX_F_HANDOFF))
+		owner = (__uptr) wait->thread;
+	else
+		owner = 0;
+	if (!uk_waitq_empty(&m->wait))
+		owner |= UK_MUTEX_F_WAITERS;
+	ukarch_store_n(&m->owner, owner);
+
+	if (wait)
+		uk_thread_wake(wait->thread);
+
+	uk_spin_unlock(&m->wait_lock);
+	ukplat_lcpu_restore_irqf(irqf);
+}
+
 #ifdef CONFIG_LIBUKLOCK_MUTEX_METRICS
 /**
  * Initializes the mutex metric counters and its spinlock.
@@ -0,0 +1,107 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/qspinlock.h>
+#include <uk/plat/lcpu.h>
+
+#ifdef CONFIG_HAVE_SMP
+/* Queue nodes per lcpu. An lcpu only needs a further node if an interrupt
+ * handler contends for a lock while the interrupted code is queued already.
+ */
+#define QSPINLOCK_NODES		4
+#define QSPINLOCK_NODE_BITS	2
+
+UK_CTASSERT(CONFIG_UKPLAT_LCPU_MAXCOUNT <
+	    (1 << (16 - QSPINLOCK_NODE_BITS)));
+
+struct qspinlock_node {
+	struct qspinlock_node *next;
+	int locked;
+	/* Nodes in use on this lcpu, only valid in the first node */
+	int count;
+};
+
+static UKPLAT_PER_LCPU_ARRAY_DEFINE(struct qspinlock_node, qspinlock_nodes,
+				    QSPINLOCK_NODES);
+
+static inline __u16 qspinlock_tail(__lcpuidx lcpu, int idx)
+{
+	return ((lcpu + 1) << QSPINLOCK_NODE_BITS) | idx;
+}
+
+static inline struct qspinlock_node *qspinlock_tail_node(__u16 tail)
+{
+	return &ukplat_per_lcpu_array(qspinlock_nodes,
+				      (tail >> QSPINLOCK_NODE_BITS) - 1,
+				      tail & (QSPINLOCK_NODES - 1));
+}
+
+void _uk_qspin_lock_slow(struct __qspinlock *lock)
+{
+	struct qspinlock_node *first, *node, *next;
+	__lcpuidx lcpu = ukplat_lcpu_idx();
+	__u16 tail, prev;
+	__u32 val;
+	int idx;
+
+	/* Nodes are used in a stack-like way because a nested acquisition
+	 * from an interrupt handler completes before we continue here.
+	 */
+	first = &ukplat_per_lcpu_array(qspinlock_nodes, lcpu, 0);
+	idx = first->count++;
+	UK_ASSERT(idx < QSPINLOCK_NODES);
+	barrier();
+
+	node = first + idx;
+	node->next = NULL;
+	node->locked = 0;
+	tail = qspinlock_tail(lcpu, idx);
+
+	/* Publish ourselves as the new tail and link behind the old one */
+	prev = ukarch_exchange_n(&lock->tail, tail);
+	if (prev) {
+		UK_WRITE_ONCE(qspinlock_tail_node(prev)->next, node);
+		while (!__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE))
+			ukarch_spinwait();
+	}
+
+	/* We are at the head of the queue, wait for the owner to leave */
+	for (;;) {
+		val = ukarch_load_n(&lock->val);
+		if (val & UK_QSPINLOCK_LOCKED) {
+			ukarch_spinwait();
+			continue;
+		}
+
+		/* Nobody queued behind us: take the lock and clear the tail */
+		if ((val >> 16) == tail) {
+			if (ukarch_compare_exchange_sync(&lock->val, val,
+							 UK_QSPINLOCK_LOCKED)
+			    == UK_QSPINLOCK_LOCKED)
+				goto out;
+			continue;
+		}
+		break;
+	}
+
+	/* With a non-empty queue, no one else takes the lock with a
+	 * compare-and-swap from zero. We can just set the locked byte.
+	 */
+	ukarch_store_n(&lock->locked, 1);
+
+	/* Make the next waiter the head. It may still be linking itself. */
+	while (!(next = UK_READ_ONCE(node->next)))
+		ukarch_spinwait();
+	__atomic_store_n(&next->locked, 1, __ATOMIC_RELEASE);
+
+out:
+	barrier();
+	first->count--;
+}
+#endif /* CONFIG_HAVE_SMP */
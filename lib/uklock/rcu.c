@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/rcu.h>
+
+#ifdef CONFIG_HAVE_SMP
+#include <uk/sched.h>
+#include <uk/spinlock.h>
+#include <uk/wait.h>
+
+UKPLAT_PER_LCPU_DEFINE(struct uk_rcu_lcpu, uk_rcu_lcpu);
+
+/* Callbacks waiting for a grace period, in reverse order of uk_rcu_call() */
+static struct uk_rcu_head *rcu_pending;
+static uk_spinlock rcu_lock = UK_SPINLOCK_INITIALIZER();
+static struct uk_waitq rcu_wq = __WAIT_QUEUE_INITIALIZER(rcu_wq);
+static struct uk_thread *rcu_thread;
+static int rcu_thread_starting;
+
+void uk_rcu_synchronize(void)
+{
+	__lcpuidx self = ukplat_lcpu_idx();
+	__lcpuidx i, count = ukplat_lcpu_count();
+	struct uk_rcu_lcpu *l;
+	unsigned long qs;
+
+	UK_ASSERT(!ukplat_per_lcpu(uk_rcu_lcpu, self).nesting);
+
+	/* Order the updates of the caller before reading the reader state */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	for (i = 0; i < count; i++) {
+		if (i == self)
+			continue;
+
+		l = &ukplat_per_lcpu(uk_rcu_lcpu, i);
+		qs = ukarch_load_n(&l->qs);
+		while (ukarch_load_n(&l->nesting) &&
+		       ukarch_load_n(&l->qs) == qs)
+			uk_sched_yield();
+	}
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void rcu_invoke(struct uk_rcu_head *head)
+{
+	struct uk_rcu_head *next;
+
+	for (; head; head = next) {
+		next = head->next;
+		head->func(head);
+	}
+}
+
+static __noreturn void rcu_thread_fn(void *arg __unused)
+{
+	uk_spinlock *sl = &rcu_lock;
+	struct uk_rcu_head *head;
+
+	for (;;) {
+		uk_spin_lock(sl);
+		uk_waitq_wait_event_locked(&rcu_wq, rcu_pending != NULL,
+					   uk_spin_lock, uk_spin_unlock, sl);
+		/* Everything queued so far shares one grace period */
+		head = rcu_pending;
+		rcu_pending = NULL;
+		uk_spin_unlock(sl);
+
+		uk_rcu_synchronize();
+		rcu_invoke(head);
+	}
+}
+
+void uk_rcu_call(struct uk_rcu_head *head,
+		 void (*func)(struct uk_rcu_head *head))
+{
+	struct uk_thread *t;
+
+	UK_ASSERT(head);
+	UK_ASSERT(func);
+
+	head->func = func;
+	uk_spin_lock(&rcu_lock);
+	head->next = rcu_pending;
+	rcu_pending = head;
+	uk_waitq_wake_up(&rcu_wq);
+	uk_spin_unlock(&rcu_lock);
+
+	if (likely(UK_READ_ONCE(rcu_thread)))
+		return;
+
+	/* The first caller starts the thread that runs the callbacks */
+	if (ukarch_exchange_n(&rcu_thread_starting, 1))
+		return;
+
+	t = uk_sched_thread_create(uk_sched_current(), rcu_thread_fn, NULL,
+				   "rcu");
+	if (unlikely(!t)) {
+		uk_pr_err("Failed to create RCU thread\n");
+		ukarch_store_n(&rcu_thread_starting, 0);
+		return;
+	}
+	UK_WRITE_ONCE(rcu_thread, t);
+}
+
+#else /* !CONFIG_HAVE_SMP */
+
+void uk_rcu_synchronize(void)
+{
+	barrier();
+}
+
+void uk_rcu_call(struct uk_rcu_head *head,
+		 void (*func)(struct uk_rcu_head *head))
+{
+	UK_ASSERT(head);
+	UK_ASSERT(func);
+
+	/* There is no reader on another lcpu, so the grace period is over */
+	func(head);
+}
+
+#endif /* !CONFIG_HAVE_SMP */
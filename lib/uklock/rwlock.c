@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/rwlock.h>
+#include <uk/wait.h>
+
+void uk_rwlock_init(struct uk_rwlock *rwl)
+{
+	UK_ASSERT(rwl);
+
+	rwl->nr_readers = 0;
+	rwl->nr_writers_waiting = 0;
+	rwl->writer = 0;
+	uk_spin_init(&rwl->sl);
+	uk_waitq_init(&rwl->shared);
+	uk_waitq_init(&rwl->exclusive);
+}
+
+void uk_rwlock_rlock(struct uk_rwlock *rwl)
+{
+	uk_spinlock *sl = &rwl->sl;
+
+	UK_ASSERT(rwl);
+
+	uk_spin_lock(sl);
+	uk_waitq_wait_event_locked(&rwl->shared,
+				   !rwl->writer && !rwl->nr_writers_waiting,
+				   uk_spin_lock, uk_spin_unlock, sl);
+	rwl->nr_readers++;
+	uk_spin_unlock(sl);
+}
+
+void uk_rwlock_runlock(struct uk_rwlock *rwl)
+{
+	UK_ASSERT(rwl);
+
+	uk_spin_lock(&rwl->sl);
+	UK_ASSERT(rwl->nr_readers > 0);
+	if (--rwl->nr_readers == 0 && rwl->nr_writers_waiting)
+		uk_waitq_wake_up_one(&rwl->exclusive);
+	uk_spin_unlock(&rwl->sl);
+}
+
+void uk_rwlock_wlock(struct uk_rwlock *rwl)
+{
+	uk_spinlock *sl = &rwl->sl;
+
+	UK_ASSERT(rwl);
+
+	uk_spin_lock(sl);
+	rwl->nr_writers_waiting++;
+	uk_waitq_wait_event_locked(&rwl->exclusive,
+				   !rwl->writer && !rwl->nr_readers,
+				   uk_spin_lock, uk_spin_unlock, sl);
+	rwl->nr_writers_waiting--;
+	rwl->writer = 1;
+	uk_spin_unlock(sl);
+}
+
+void uk_rwlock_wunlock(struct uk_rwlock *rwl)
+{
+	UK_ASSERT(rwl);
+
+	uk_spin_lock(&rwl->sl);
+	UK_ASSERT(rwl->writer);
+	rwl->writer = 0;
+	if (rwl->nr_writers_waiting)
+		uk_waitq_wake_up_one(&rwl->exclusive);
+	else
+		uk_waitq_wake_up(&rwl->shared);
+	uk_spin_unlock(&rwl->sl);
+}
+
+int uk_rwlock_tryrlock(struct uk_rwlock *rwl)
+{
+	int ret = 0;
+
+	UK_ASSERT(rwl);
+
+	uk_spin_lock(&rwl->sl);
+	if (!rwl->writer && !rwl->nr_writers_waiting) {
+		rwl->nr_readers++;
+		ret = 1;
+	}
+	uk_spin_unlock(&rwl->sl);
+	return ret;
+}
+
+int uk_rwlock_trywlock(struct uk_rwlock *rwl)
+{
+	int ret = 0;
+
+	UK_ASSERT(rwl);
+
+	uk_spin_lock(&rwl->sl);
+	if (!rwl->writer && !rwl->nr_readers) {
+		rwl->writer = 1;
+		ret = 1;
+	}
+	uk_spin_unlock(&rwl->sl);
+	return ret;
+}
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stddef.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <uk/spinlock.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+
+/* Call sites that have seen contention, in reverse order of the first one */
+static struct uk_spinlock_site *spinlock_sites;
+
+static inline __u64 spin_cycles(void)
+{
+#if CONFIG_ARCH_X86_64
+	__u32 lo, hi;
+
+	__asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((__u64) hi << 32) | lo;
+#elif CONFIG_ARCH_ARM_64
+	return SYSREG_READ64(cntvct_el0);
+#else
+	return 0;
+#endif
+}
+
+static void spinlock_site_register(struct uk_spinlock_site *site)
+{
+	struct uk_spinlock_site *head;
+
+	if (ukarch_exchange_n(&site->registered, 1))
+		return;
+
+	do {
+		head = ukarch_load_n(&spinlock_sites);
+		site->next = head;
+	} while (ukarch_compare_exchange_sync(&spinlock_sites, head, site)
+		 != site);
+}
+
+void _uk_spin_lock_contended(uk_spinlock *lock,
+			     struct uk_spinlock_site *site)
+{
+	__u64 start, cycles, max;
+
+	start = spin_cycles();
+	__uk_spin_lock(lock);
+	cycles = spin_cycles() - start;
+
+	if (unlikely(!UK_READ_ONCE(site->registered)))
+		spinlock_site_register(site);
+
+	ukarch_inc(&site->contended);
+	ukarch_fetch_add(&site->cycles, cycles);
+	do {
+		max = ukarch_load_n(&site->max_cycles);
+		if (cycles <= max)
+			break;
+	} while (ukarch_compare_exchange_sync(&site->max_cycles, max, cycles)
+		 != cycles);
+}
+
+void uk_spinlock_stats_foreach(void (*fn)(const struct uk_spinlock_site *site,
+					  void *arg),
+			       void *arg)
+{
+	struct uk_spinlock_site *site;
+
+	UK_ASSERT(fn);
+
+	for (site = ukarch_load_n(&spinlock_sites); site; site = site->next)
+		fn(site, arg);
+}
+
+static void spinlock_site_print(const struct uk_spinlock_site *site,
+				void *arg __unused)
+{
+	__u64 contended = UK_READ_ONCE(site->contended);
+
+	if (!contended)
+		return;
+	uk_pr_info("%s:%u: contended %"__PRIu64", spin cycles %"__PRIu64
+		   " (avg %"__PRIu64", max %"__PRIu64")\n",
+		   site->file, site->line, contended,
+		   UK_READ_ONCE(site->cycles),
+		   UK_READ_ONCE(site->cycles) / contended,
+		   UK_READ_ONCE(site->max_cycles));
+}
+
+void uk_spinlock_stats_print(void)
+{
+	uk_pr_info("Spinlock contention statistics:\n");
+	uk_spinlock_stats_foreach(spinlock_site_print, NULL);
+}
+
+static void spinlock_site_reset(const struct uk_spinlock_site *site,
+				void *arg __unused)
+{
+	struct uk_spinlock_site *s = (struct uk_spinlock_site *) site;
+
+	ukarch_store_n(&s->contended, 0);
+	ukarch_store_n(&s->cycles, 0);
+	ukarch_store_n(&s->max_cycles, 0);
+}
+
+void uk_spinlock_stats_reset(void)
+{
+	uk_spinlock_stats_foreach(spinlock_site_reset, NULL);
+}
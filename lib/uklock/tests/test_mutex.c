@@ -0,0 +1,247 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/mutex.h>
+#include <uk/sched.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+
+#define NB_THREADS	4
+#define NB_ITERATIONS	200
+
+static struct uk_mutex mutex = UK_MUTEX_INITIALIZER(mutex);
+static unsigned long counter;
+static unsigned int nb_finished;
+
+static struct uk_thread *start_thread(uk_thread_fn1_t fn, void *arg)
+{
+	struct uk_thread *t;
+
+	t = uk_sched_thread_create(uk_sched_current(), fn, arg,
+				   "test_mutex");
+	return t;
+}
+
+/* Waits until `nb` threads started with start_thread() finished */
+static void wait_threads(unsigned int nb)
+{
+	while (ukarch_load_n(&nb_finished) < nb)
+		uk_sched_yield();
+	nb_finished = 0;
+}
+
+UK_TESTCASE(uklock_mutex, lock_unlock)
+{
+	struct uk_mutex m;
+
+	uk_mutex_init(&m);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&m));
+
+	uk_mutex_lock(&m);
+	UK_TEST_EXPECT(uk_mutex_is_locked(&m));
+	UK_TEST_EXPECT_PTR_EQ(uk_mutex_owner(&m), uk_thread_current());
+
+	uk_mutex_unlock(&m);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&m));
+	UK_TEST_EXPECT_ZERO(m.owner);
+}
+
+UK_TESTCASE(uklock_mutex, recursive)
+{
+	struct uk_mutex m;
+
+	uk_mutex_init(&m);
+	uk_mutex_lock(&m);
+	uk_mutex_lock(&m);
+	UK_TEST_EXPECT_SNUM_EQ(uk_mutex_trylock(&m), 1);
+	UK_TEST_EXPECT_SNUM_EQ(m.lock_count, 3);
+
+	uk_mutex_unlock(&m);
+	uk_mutex_unlock(&m);
+	UK_TEST_EXPECT(uk_mutex_is_locked(&m));
+	uk_mutex_unlock(&m);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&m));
+}
+
+static __noreturn void trylock_thread(void *arg)
+{
+	int *ret = (int *) arg;
+
+	*ret = uk_mutex_trylock(&mutex);
+	if (*ret)
+		uk_mutex_unlock(&mutex);
+	ukarch_inc(&nb_finished);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_mutex, trylock_owned)
+{
+	int ret = -1;
+
+	uk_mutex_lock(&mutex);
+	UK_TEST_ASSERT(start_thread(trylock_thread, &ret) != NULL);
+	wait_threads(1);
+	UK_TEST_EXPECT_ZERO(ret);
+	uk_mutex_unlock(&mutex);
+
+	UK_TEST_ASSERT(start_thread(trylock_thread, &ret) != NULL);
+	wait_threads(1);
+	UK_TEST_EXPECT_SNUM_EQ(ret, 1);
+	UK_TEST_EXPECT_ZERO(uk_mutex_is_locked(&mutex));
+}
+
+/* Yields inside the critical section so that the other threads find the
+ * mutex locked and have to sleep
+ */
+static __noreturn void contend_thread(void *arg __unused)
+{
+	unsigned long val;
+	int i;
+
+	for (i = 0; i < NB_ITERATIONS; i++) {
+		uk_mutex_lock(&mutex);
+		val = counter;
+		uk_sched_yield();
+		counter = val + 1;
+		uk_mutex_unlock(&mutex);
+	}
+	ukarch_inc(&nb_finished);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_mutex, contended)
+{
+	int i;
+
+	counter = 0;
+	for (i = 0; i < NB_THREADS; i++)
+		UK_TEST_ASSERT(start_thread(contend_thread, NULL) != NULL);
+	wait_threads(NB_THREADS);
+
+	UK_TEST_EXPECT_SNUM_EQ(counter, NB_THREADS * NB_ITERATIONS);
+	UK_TEST_EXPECT_ZERO(mutex.owner);
+	UK_TEST_EXPECT(uk_waitq_empty(&mutex.wait));
+}
+
+static __noreturn void starve_thread(void *arg)
+{
+	__nsec *deadline = (__nsec *) arg;
+
+	while (ukplat_monotonic_clock() < *deadline) {
+		uk_mutex_lock(&mutex);
+		counter++;
+		uk_mutex_unlock(&mutex);
+	}
+	ukarch_inc(&nb_finished);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_mutex, handoff)
+{
+	__nsec deadline;
+	unsigned long own = 0;
+
+	/* We relock right after every unlock, before the woken waiter gets
+	 * to run. Only the handoff lets the waiter in.
+	 */
+	counter = 0;
+	deadline = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(20);
+	UK_TEST_ASSERT(start_thread(starve_thread, &deadline) != NULL);
+	while (ukplat_monotonic_clock() < deadline) {
+		uk_mutex_lock(&mutex);
+		own++;
+		uk_sched_yield();
+		uk_mutex_unlock(&mutex);
+	}
+	wait_threads(1);
+
+	UK_TEST_EXPECT_SNUM_GT(own, 0);
+	UK_TEST_EXPECT_SNUM_GT(counter, 0);
+	UK_TEST_EXPECT_ZERO(mutex.owner);
+}
+
+/* Alternates between relocking right away and yielding with the mutex held,
+ * so that woken waiters race with the fast path while other waiters queue
+ * against an owner word that has the waiters and handoff flags set already
+ */
+static __noreturn void mixed_thread(void *arg)
+{
+	__nsec *deadline = (__nsec *) arg;
+	unsigned long i;
+
+	for (i = 0; ukplat_monotonic_clock() < *deadline; i++) {
+		uk_mutex_lock(&mutex);
+		counter++;
+		if (i & 1)
+			uk_sched_yield();
+		uk_mutex_unlock(&mutex);
+		if (i % 3 == 0)
+			uk_sched_yield();
+	}
+	ukarch_inc(&nb_finished);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_mutex, handoff_contended)
+{
+	__nsec deadline;
+	int i;
+
+	/* A lost wakeup leaves a thread asleep and this test hanging */
+	counter = 0;
+	deadline = ukplat_monotonic_clock() + ukarch_time_msec_to_nsec(50);
+	for (i = 0; i < 2 * NB_THREADS; i++)
+		UK_TEST_ASSERT(start_thread(mixed_thread, &deadline) != NULL);
+	wait_threads(2 * NB_THREADS);
+
+	UK_TEST_EXPECT_SNUM_GT(counter, 0);
+	UK_TEST_EXPECT_ZERO(mutex.owner);
+	UK_TEST_EXPECT(uk_waitq_empty(&mutex.wait));
+}
+
+/* Microbenchmark: uncontended lock/unlock pairs, and lock/unlock pairs with
+ * several threads that yield inside the critical section
+ */
+#define BENCH_ROUNDS	1000000
+
+UK_TESTCASE(uklock_mutex, bench)
+{
+	struct uk_mutex m;
+	__nsec start, t;
+	int i;
+
+	uk_mutex_init(&m);
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		uk_mutex_lock(&m);
+		uk_mutex_unlock(&m);
+	}
+	t = ukplat_monotonic_clock() - start;
+	uk_test_printf("uncontended lock/unlock: %"__PRInsec" ns/op\n",
+		       t / BENCH_ROUNDS);
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		if (uk_mutex_trylock(&m))
+			uk_mutex_unlock(&m);
+	}
+	t = ukplat_monotonic_clock() - start;
+	uk_test_printf("uncontended trylock/unlock: %"__PRInsec" ns/op\n",
+		       t / BENCH_ROUNDS);
+
+	counter = 0;
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < NB_THREADS; i++)
+		UK_TEST_ASSERT(start_thread(contend_thread, NULL) != NULL);
+	wait_threads(NB_THREADS);
+	t = ukplat_monotonic_clock() - start;
+	uk_test_printf("contended lock/unlock (%d threads): %"__PRInsec
+		       " ns/op\n", NB_THREADS,
+		       t / (NB_THREADS * NB_ITERATIONS));
+}
+
+uk_testsuite_register(uklock_mutex, NULL);
@@ -0,0 +1,78 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/rcu.h>
+#include <uk/sched.h>
+
+struct item {
+	int key;
+	int freed;
+	struct uk_hlist_node link;
+	struct uk_rcu_head rcu;
+};
+
+static UK_HLIST_HEAD(items);
+
+static void item_free(struct uk_rcu_head *head)
+{
+	struct item *it = __containerof(head, struct item, rcu);
+
+	it->freed = 1;
+}
+
+static struct item *item_find(int key)
+{
+	struct item *it;
+
+	uk_rcu_read_lock();
+	uk_hlist_for_each_entry_rcu(it, &items, link) {
+		if (it->key == key) {
+			uk_rcu_read_unlock();
+			return it;
+		}
+	}
+	uk_rcu_read_unlock();
+	return NULL;
+}
+
+UK_TESTCASE(uklock_rcu, hlist)
+{
+	struct item a = { .key = 1 }, b = { .key = 2 };
+
+	uk_hlist_add_head_rcu(&a.link, &items);
+	uk_hlist_add_head_rcu(&b.link, &items);
+	UK_TEST_EXPECT_PTR_EQ(item_find(1), &a);
+	UK_TEST_EXPECT_PTR_EQ(item_find(2), &b);
+
+	uk_hlist_del_init_rcu(&b.link);
+	UK_TEST_EXPECT(uk_hlist_unhashed(&b.link));
+	UK_TEST_EXPECT_NULL(item_find(2));
+	UK_TEST_EXPECT_PTR_EQ(item_find(1), &a);
+
+	/* Deleting twice is harmless */
+	uk_hlist_del_init_rcu(&b.link);
+	uk_hlist_del_init_rcu(&a.link);
+	UK_TEST_EXPECT(uk_hlist_empty(&items));
+}
+
+UK_TESTCASE(uklock_rcu, call)
+{
+	struct item a = { .key = 1 };
+	unsigned int i;
+
+	uk_hlist_add_head_rcu(&a.link, &items);
+	uk_hlist_del_init_rcu(&a.link);
+	uk_rcu_call(&a.rcu, item_free);
+
+	for (i = 0; i < 1000 && !UK_READ_ONCE(a.freed); i++)
+		uk_sched_yield();
+	UK_TEST_EXPECT(a.freed);
+
+	uk_rcu_synchronize();
+}
+
+uk_testsuite_register(uklock_rcu, NULL);
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <uk/test.h>
+#include <uk/rwlock.h>
+#include <uk/sched.h>
+
+#define NB_THREADS	4
+#define NB_ITERATIONS	100
+
+static struct uk_rwlock rwl = UK_RWLOCK_INITIALIZER(rwl);
+static unsigned long counter;
+static unsigned int nb_finished;
+
+static void wait_threads(unsigned int nb)
+{
+	while (ukarch_load_n(&nb_finished) < nb)
+		uk_sched_yield();
+	nb_finished = 0;
+}
+
+UK_TESTCASE(uklock_rwlock, shared_exclusive)
+{
+	struct uk_rwlock l;
+
+	uk_rwlock_init(&l);
+
+	uk_rwlock_rlock(&l);
+	UK_TEST_EXPECT(uk_rwlock_tryrlock(&l));
+	UK_TEST_EXPECT_ZERO(uk_rwlock_trywlock(&l));
+	uk_rwlock_runlock(&l);
+	uk_rwlock_runlock(&l);
+
+	uk_rwlock_wlock(&l);
+	UK_TEST_EXPECT(uk_rwlock_is_wlocked(&l));
+	UK_TEST_EXPECT_ZERO(uk_rwlock_tryrlock(&l));
+	UK_TEST_EXPECT_ZERO(uk_rwlock_trywlock(&l));
+	uk_rwlock_wunlock(&l);
+
+	UK_TEST_EXPECT_ZERO(uk_rwlock_is_wlocked(&l));
+	UK_TEST_EXPECT(uk_rwlock_trywlock(&l));
+	uk_rwlock_wunlock(&l);
+}
+
+static __noreturn void writer_thread(void *arg __unused)
+{
+	uk_rwlock_wlock(&rwl);
+	counter++;
+	uk_rwlock_wunlock(&rwl);
+	ukarch_inc(&nb_finished);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_rwlock, writer_preference)
+{
+	counter = 0;
+	uk_rwlock_rlock(&rwl);
+	UK_TEST_ASSERT(uk_sched_thread_create(uk_sched_current(),
+					      writer_thread, NULL,
+					      "test_rwlock") != NULL);
+
+	/* Let the writer queue up behind us */
+	while (!UK_READ_ONCE(rwl.nr_writers_waiting))
+		uk_sched_yield();
+	UK_TEST_EXPECT_ZERO(uk_rwlock_tryrlock(&rwl));
+	uk_rwlock_runlock(&rwl);
+
+	wait_threads(1);
+	UK_TEST_EXPECT_SNUM_EQ(counter, 1);
+	UK_TEST_EXPECT(uk_rwlock_tryrlock(&rwl));
+	uk_rwlock_runlock(&rwl);
+}
+
+/* Readers and writers yield while they hold the lock */
+static __noreturn void contend_thread(void *arg)
+{
+	unsigned long val;
+	int i;
+
+	for (i = 0; i < NB_ITERATIONS; i++) {
+		if (arg) {
+			uk_rwlock_wlock(&rwl);
+			val = counter;
+			uk_sched_yield();
+			counter = val + 1;
+			uk_rwlock_wunlock(&rwl);
+		} else {
+			uk_rwlock_rlock(&rwl);
+			val = counter;
+			uk_sched_yield();
+			UK_ASSERT(val == counter);
+			uk_rwlock_runlock(&rwl);
+		}
+	}
+	ukarch_inc(&nb_finished);
+	uk_sched_thread_exit();
+}
+
+UK_TESTCASE(uklock_rwlock, contended)
+{
+	long i;
+
+	counter = 0;
+	for (i = 0; i < NB_THREADS; i++)
+		UK_TEST_ASSERT(uk_sched_thread_create(uk_sched_current(),
+						      contend_thread,
+						      (void *) (i & 1),
+						      "test_rwlock") != NULL);
+	wait_threads(NB_THREADS);
+
+	UK_TEST_EXPECT_SNUM_EQ(counter, NB_THREADS / 2 * NB_ITERATIONS);
+	UK_TEST_EXPECT_ZERO(rwl.nr_readers);
+	UK_TEST_EXPECT_ZERO(rwl.writer);
+}
+
+uk_testsuite_register(uklock_rwlock, NULL);
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/test.h>
+#include <uk/spinlock.h>
+#include <uk/plat/time.h>
+#if CONFIG_HAVE_SMP
+#include <uk/alloc.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/limits.h>
+#include <uk/plat/lcpu.h>
+#endif /* CONFIG_HAVE_SMP */
+
+static uk_spinlock lock = UK_SPINLOCK_INITIALIZER();
+
+UK_TESTCASE(uklock_spinlock, lock_unlock)
+{
+	uk_spinlock l;
+
+	uk_spin_init(&l);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&l));
+
+	uk_spin_lock(&l);
+#ifdef CONFIG_HAVE_SMP
+	UK_TEST_EXPECT(uk_spin_is_locked(&l));
+	UK_TEST_EXPECT_ZERO(uk_spin_trylock(&l));
+#endif /* CONFIG_HAVE_SMP */
+	uk_spin_unlock(&l);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&l));
+
+	UK_TEST_EXPECT(uk_spin_trylock(&l));
+	uk_spin_unlock(&l);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&l));
+}
+
+/* Locks that are nested and released in a different order */
+UK_TESTCASE(uklock_spinlock, nested)
+{
+	uk_spinlock l;
+
+	uk_spin_init(&l);
+	uk_spin_lock(&lock);
+	uk_spin_lock(&l);
+	uk_spin_unlock(&lock);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&lock));
+	uk_spin_lock(&lock);
+	uk_spin_unlock(&l);
+	uk_spin_unlock(&lock);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&l));
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&lock));
+}
+
+#if CONFIG_HAVE_SMP
+#define CONTEND_ROUNDS	100000
+#define STACK_PAGES	4
+
+/* Every LCPU increments a shared counter under the lock. The counter is
+ * updated non-atomically, so lost updates show up in the total.
+ */
+struct contend_arg {
+	uk_spinlock lock;
+	unsigned long count;
+	unsigned long mine[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	/* Counters of all LCPUs when the first one was done */
+	unsigned long snap[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	int snapped;
+	unsigned int ready;
+	unsigned int go;
+	unsigned int done;
+};
+
+static void contend(struct contend_arg *arg)
+{
+	__lcpuidx me = ukplat_lcpu_idx();
+	int r;
+
+	for (r = 0; r < CONTEND_ROUNDS; r++) {
+		uk_spin_lock(&arg->lock);
+		arg->count++;
+		if (++arg->mine[me] == CONTEND_ROUNDS && !arg->snapped) {
+			memcpy(arg->snap, arg->mine, sizeof(arg->snap));
+			arg->snapped = 1;
+		}
+		uk_spin_unlock(&arg->lock);
+	}
+}
+
+static void contend_remote(struct __regs *regs __unused, void *user)
+{
+	struct contend_arg *arg = (struct contend_arg *) user;
+
+	ukarch_inc(&arg->ready);
+	while (!ukarch_load_n(&arg->go))
+		ukarch_spinwait();
+
+	contend(arg);
+	ukarch_inc(&arg->done);
+}
+
+static int contend_start_lcpus(void)
+{
+	static int started;
+	void *sp[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int i;
+	void *stack;
+	int rc;
+
+	if (started)
+		return 0;
+
+	for (i = 0; i < ukplat_lcpu_count() - 1; ++i) {
+		stack = uk_palloc(uk_alloc_get_default(), STACK_PAGES);
+		if (!stack)
+			return -ENOMEM;
+		sp[i] = (__u8 *) stack + STACK_PAGES * __PAGE_SIZE;
+	}
+
+	rc = ukplat_lcpu_start(NULL, NULL, sp, NULL, 0);
+	if (rc)
+		return rc;
+	started = 1;
+
+	/* Functions are only run on LCPUs that are online */
+	return ukplat_lcpu_wait(NULL, NULL, 0);
+}
+
+UK_TESTCASE(uklock_spinlock, contended)
+{
+	static struct contend_arg arg;
+	struct ukplat_lcpu_func fn = { .fn = contend_remote, .user = &arg };
+	__lcpuidx idx[CONFIG_UKPLAT_LCPU_MAXCOUNT];
+	unsigned int i, n, num;
+	int rc;
+
+	rc = contend_start_lcpus();
+	UK_TEST_ASSERT(rc == 0);
+
+	memset(&arg, 0, sizeof(arg));
+	uk_spin_init(&arg.lock);
+	num = ukplat_lcpu_count() - 1;
+	for (i = 0, n = 0; n < num; ++i)
+		if (i != ukplat_lcpu_idx())
+			idx[n++] = i;
+
+	if (num) {
+		rc = ukplat_lcpu_run(idx, &n, &fn, 0);
+		UK_TEST_ASSERT(rc == 0);
+	}
+
+	while (ukarch_load_n(&arg.ready) < num)
+		ukarch_spinwait();
+	ukarch_store_n(&arg.go, 1);
+	contend(&arg);
+	while (ukarch_load_n(&arg.done) < num)
+		ukarch_spinwait();
+
+	UK_TEST_EXPECT_SNUM_EQ(arg.count,
+			       (unsigned long) (num + 1) * CONTEND_ROUNDS);
+	UK_TEST_EXPECT_ZERO(uk_spin_is_locked(&arg.lock));
+
+#if CONFIG_LIBUKLOCK_TICKETLOCK || CONFIG_LIBUKLOCK_QSPINLOCK
+	/* Locks are granted in FIFO order, so no LCPU can fall far behind
+	 * while the others keep taking the lock
+	 */
+	for (i = 0; i < ukplat_lcpu_count(); ++i)
+		UK_TEST_EXPECT_SNUM_GE(arg.snap[i], CONTEND_ROUNDS / 4);
+#endif /* CONFIG_LIBUKLOCK_TICKETLOCK || CONFIG_LIBUKLOCK_QSPINLOCK */
+}
+#endif /* CONFIG_HAVE_SMP */
+
+/* Microbenchmark: uncontended lock/unlock pairs */
+#define BENCH_ROUNDS	1000000
+
+UK_TESTCASE(uklock_spinlock, bench)
+{
+	__nsec start, t;
+	int i;
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		uk_spin_lock(&lock);
+		uk_spin_unlock(&lock);
+	}
+	t = ukplat_monotonic_clock() - start;
+	uk_test_printf("uncontended lock/unlock: %"__PRInsec" ns/op\n",
+		       t / BENCH_ROUNDS);
+}
+
+uk_testsuite_register(uklock_spinlock, NULL);
@@ -123,6 +123,20 @@ typedef void (*uk_netbuf_dtor_t)(struct uk_netbuf *);
 #define UK_NETBUF_F_PARTIAL_CSUM_BIT 1
 #define UK_NETBUF_F_PARTIAL_CSUM     (1 << UK_NETBUF_F_PARTIAL_CSUM_BIT)
 
+/* Indicates that the netbuf chain holds a TCP packet over IPv4 or IPv6 that is
+ * larger than the MTU (generic segmentation offload). On transmit, the device
+ * splits the packet into segments of `gso_size` payload bytes each, which
+ * requires that UK_NETBUF_F_PARTIAL_CSUM is set as well. On receive, it
+ * indicates a packet that was coalesced from segments of `gso_size` bytes.
+ * The protocol headers have to be contained in the first netbuf of the chain.
+ */
+#define UK_NETBUF_F_GSO_TCPV4_BIT    2
+#define UK_NETBUF_F_GSO_TCPV4        (1 << UK_NETBUF_F_GSO_TCPV4_BIT)
+#define UK_NETBUF_F_GSO_TCPV6_BIT    3
+#define UK_NETBUF_F_GSO_TCPV6        (1 << UK_NETBUF_F_GSO_TCPV6_BIT)
+#define UK_NETBUF_F_GSO_MASK         (UK_NETBUF_F_GSO_TCPV4 \
+				      | UK_NETBUF_F_GSO_TCPV6)
+
 struct uk_netbuf {
 	struct uk_netbuf *next;
 	struct uk_netbuf *prev;
@@ -146,6 +160,9 @@ struct uk_netbuf {
 				 * Number of bytes starting from `csum_start`
 				 * pointing to the checksum field
 				 */
+	uint16_t gso_size;     /**< Used if one of UK_NETBUF_F_GSO_* is set;
+				 * Maximum segment payload size
+				 */
 
 	uk_netbuf_dtor_t dtor; /**< Destructor callback */
 	struct uk_alloc *_a;   /**< @internal Allocator for free'ing */
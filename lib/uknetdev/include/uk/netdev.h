@@ -180,6 +180,10 @@ const void *uk_netdev_einfo_get(struct uk_netdev *dev,
 
 /**
  * Configures an Unikraft network device.
+ * If multiple receive queues are configured, received packets are distributed
+ * over them. With `conf->rss.hash_types` set, this happens according to the
+ * given RSS hash and indirection table (requires UK_NETDEV_F_RSS), otherwise
+ * according to a device-specific policy.
  *
  * @param dev
  *   The Unikraft Network Device in unconfigured state.
@@ -188,6 +192,7 @@ const void *uk_netdev_einfo_get(struct uk_netdev *dev,
  *   network device.
  * @return
  *   - (0): Success, device is in configured state.
+ *   - (-ENOTSUP): Requested RSS or LRO configuration is not supported.
  *   - (<0): Error code returned by the driver.
  */
 int uk_netdev_configure(struct uk_netdev *dev,
@@ -523,6 +528,87 @@ static inline int uk_netdev_tx_one(struct uk_netdev *dev, uint16_t queue_id,
 	return dev->tx_one(dev, dev->_tx_queue[queue_id], pkt);
 }
 
+/**
+ * Receive up to `*cnt` packets and re-program used receive descriptors once
+ * for the whole burst. The same rules regarding queue interrupts and the
+ * receive buffer allocator apply as for uk_netdev_rx_one().
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param queue_id
+ *   The index of the receive queue to receive from.
+ *   The value must be in the range [0, nb_rx_queue - 1] previously supplied
+ *   to uk_netdev_configure().
+ * @param pkt
+ *   Array of netbuf pointers which will point to the received packets after
+ *   the function call. `pkt` has never to be `NULL`.
+ * @param cnt
+ *   On input, the number of entries in `pkt`. On return, the number of
+ *   received packets which are placed to pkt[0]...pkt[*cnt - 1].
+ *   `cnt` has never to be `NULL`.
+ * @return
+ *   - (>=0): Positive value with status flags
+ *     - UK_NETDEV_STATUS_SUCCESS: At least one packet was received.
+ *     - UK_NETDEV_STATUS_MORE: Indicates that more received packets are
+ *        available on the receive queue. When interrupts are used, they are
+ *        disabled until this flag is unset by a subsequent call.
+ *     - UK_NETDEV_STATUS_UNDERRUN: Informs that some available slots of the
+ *        receive queue could not be programmed with a receive buffer.
+ *   - (<0): Negative value with error code from driver, no packet is returned.
+ */
+static inline int uk_netdev_rx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				     struct uk_netbuf **pkt, uint16_t *cnt)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->rx_burst);
+	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_NETDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_rx_queue[queue_id]));
+	UK_ASSERT(pkt && cnt);
+
+	return dev->rx_burst(dev, dev->_rx_queue[queue_id], pkt, cnt);
+}
+
+/**
+ * Transmit up to `*cnt` packets. Drivers notify the device only once for the
+ * whole burst.
+ *
+ * @param dev
+ *   The Unikraft Network Device.
+ * @param queue_id
+ *   The index of the transmit queue to send on.
+ *   The value must be in the range [0, nb_tx_queue - 1] previously supplied
+ *   to uk_netdev_configure().
+ * @param pkt
+ *   Array of netbufs to send. Packets are free'd by the driver after sending
+ *   was successfully finished by the device. The same headroom requirements
+ *   apply as for uk_netdev_tx_one(). `pkt` has never to be `NULL`.
+ * @param cnt
+ *   On input, the number of packets in `pkt`. On return, the number of
+ *   packets that were put to the transmit queue. These are always the first
+ *   ones of the array; the caller keeps the ownership of the remaining ones.
+ *   `cnt` has never to be `NULL`.
+ * @return
+ *   - (>=0): Positive value with status flags
+ *     - UK_NETDEV_STATUS_SUCCESS: At least one packet was put to the transmit
+ *        queue.
+ *     - UK_NETDEV_STATUS_MORE: Indicates there is still at least one
+ *        descriptor available for a subsequent transmission.
+ *   - (<0): Negative value with error code from driver, no packet was sent.
+ */
+static inline int uk_netdev_tx_burst(struct uk_netdev *dev, uint16_t queue_id,
+				     struct uk_netbuf **pkt, uint16_t *cnt)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(dev->tx_burst);
+	UK_ASSERT(queue_id < CONFIG_LIBUKNETDEV_MAXNBQUEUES);
+	UK_ASSERT(dev->_data->state == UK_NETDEV_RUNNING);
+	UK_ASSERT(!PTRISERR(dev->_tx_queue[queue_id]));
+	UK_ASSERT(pkt && cnt);
+
+	return dev->tx_burst(dev, dev->_tx_queue[queue_id], pkt, cnt);
+}
+
 /**
  * Tests for status flags returned by `uk_netdev_rx_one` or `uk_netdev_tx_one`.
  * When the functions returned an error code or one of the selected flags is
@@ -138,12 +138,55 @@ struct uk_hwaddr {
 #define UK_NETDEV_F_PARTIAL_CSUM_BIT	2
 #define UK_NETDEV_F_PARTIAL_CSUM	(1UL << UK_NETDEV_F_PARTIAL_CSUM_BIT)
 
+/* Indicates that the device can steer received packets to receive queues
+ * based on a hash over packet headers (RSS), see struct uk_netdev_rss_conf
+ */
+#define UK_NETDEV_F_RSS_BIT		3
+#define UK_NETDEV_F_RSS			(1UL << UK_NETDEV_F_RSS_BIT)
+
+/* Indicates that the device segments TCP packets that are marked with
+ * UK_NETBUF_F_GSO_TCPV4 or UK_NETBUF_F_GSO_TCPV6, respectively. Such packets
+ * can be up to UK_NETDEV_TSO_MAXLEN bytes long.
+ */
+#define UK_NETDEV_F_TSO4_BIT		4
+#define UK_NETDEV_F_TSO4		(1UL << UK_NETDEV_F_TSO4_BIT)
+#define UK_NETDEV_F_TSO6_BIT		5
+#define UK_NETDEV_F_TSO6		(1UL << UK_NETDEV_F_TSO6_BIT)
+
+/* Indicates that the device can coalesce received TCP segments into large
+ * packets (LRO). When enabled with uk_netdev_conf, such packets are delivered
+ * as netbuf chains marked with UK_NETBUF_F_GSO_TCPV4 or UK_NETBUF_F_GSO_TCPV6.
+ */
+#define UK_NETDEV_F_LRO_BIT		6
+#define UK_NETDEV_F_LRO			(1UL << UK_NETDEV_F_LRO_BIT)
+
+/* Maximum length of a frame with segmentation offload, without FCS */
+#define UK_NETDEV_TSO_MAXLEN		(UK_ETH_HDR_UNTAGGED_LEN + UINT16_MAX)
+
 #define uk_netdev_rxintr_supported(feature)	\
 	(feature & (UK_NETDEV_F_RXQ_INTR))
 #define uk_netdev_txintr_supported(feature)	\
 	(feature & (UK_NETDEV_F_TXQ_INTR))
 #define uk_netdev_partial_csum_supported(feature)	\
 	(feature & (UK_NETDEV_F_PARTIAL_CSUM))
+#define uk_netdev_rss_supported(feature)	\
+	(feature & (UK_NETDEV_F_RSS))
+#define uk_netdev_tso4_supported(feature)	\
+	(feature & (UK_NETDEV_F_TSO4))
+#define uk_netdev_tso6_supported(feature)	\
+	(feature & (UK_NETDEV_F_TSO6))
+#define uk_netdev_lro_supported(feature)	\
+	(feature & (UK_NETDEV_F_LRO))
+
+/**
+ * Packet header fields that RSS hashes can be computed over.
+ */
+#define UK_NETDEV_RSS_HASH_IPV4		(1UL << 0) /* Src/dst IPv4 address */
+#define UK_NETDEV_RSS_HASH_TCPV4	(1UL << 1) /* ...and TCP ports */
+#define UK_NETDEV_RSS_HASH_UDPV4	(1UL << 2) /* ...and UDP ports */
+#define UK_NETDEV_RSS_HASH_IPV6		(1UL << 3) /* Src/dst IPv6 address */
+#define UK_NETDEV_RSS_HASH_TCPV6	(1UL << 4) /* ...and TCP ports */
+#define UK_NETDEV_RSS_HASH_UDPV6	(1UL << 5) /* ...and UDP ports */
 
 /**
  * A structure used to describe network device capabilities.
@@ -157,6 +200,9 @@ struct uk_netdev_info {
 	uint16_t nb_encap_rx;  /**< Number of bytes required as headroom for rx. */
 	uint16_t ioalign;  /**< Alignment in bytes for packet data buffers */
 	uint32_t features; /**< bitmap of the features supported */
+	uint32_t rss_hash_types; /**< Supported UK_NETDEV_RSS_HASH_* */
+	uint16_t rss_key_size;   /**< Maximum RSS hash key length in bytes */
+	uint16_t rss_reta_size;  /**< Maximum RSS indirection table entries */
 };
 
 /**
@@ -172,9 +218,36 @@ struct uk_netdev_queue_info {
 /**
  * A structure used to configure a network device.
  */
+/**
+ * A structure used to configure hash-based receive steering (RSS). A hash is
+ * computed over the header fields selected by `hash_types` of each received
+ * packet. Its low bits index into the indirection table which selects the
+ * receive queue for the packet. Packets without any of the selected headers
+ * are delivered to receive queue 0.
+ */
+struct uk_netdev_rss_conf {
+	uint32_t hash_types;   /**< UK_NETDEV_RSS_HASH_*, 0 disables RSS */
+	const uint8_t *key;    /**< Hash key, NULL selects a default key */
+	uint16_t key_len;      /**< Length of key in bytes */
+	const uint16_t *reta;  /**< Indirection table with receive queue ids,
+				 *   NULL spreads over all receive queues
+				 */
+	uint16_t reta_size;    /**< Entries in reta, must be a power of 2 */
+};
+
+/**
+ * A structure used to configure a network device. Unused fields must be
+ * zero-initialized.
+ */
 struct uk_netdev_conf {
 	uint16_t nb_rx_queues;
 	uint16_t nb_tx_queues;
+	struct uk_netdev_rss_conf rss; /**< Receive steering, requires
+					 *   UK_NETDEV_F_RSS if enabled
+					 */
+	int lro;                       /**< Receive coalesced TCP packets,
+					 *   requires UK_NETDEV_F_LRO
+					 */
 };
 
 /**
@@ -267,6 +340,12 @@ typedef uint16_t (*uk_netdev_alloc_rxpkts)(void *argp,
 					   struct uk_netbuf *pkts[],
 					   uint16_t count);
 
+/**
+ * Value of `uk_netdev_rxqueue_conf.lcpu` for queues that have no
+ * interrupt affinity preference.
+ */
+#define UK_NETDEV_LCPU_ANY (-1)
+
 /**
  * A structure used to configure an Unikraft network device RX queue.
  */
@@ -278,6 +357,13 @@ struct uk_netdev_rxqueue_conf {
 
 	uk_netdev_alloc_rxpkts alloc_rxpkts; /**< Allocator for rx netbufs */
 	void *alloc_rxpkts_argp;             /**< Argument for alloc_rxpkts */
+
+	int lcpu;                         /**< Logical CPU index that queue
+					    *   interrupts should be delivered
+					    *   to, or UK_NETDEV_LCPU_ANY for
+					    *   no preference. Note that 0
+					    *   selects the first LCPU.
+					    */
 #ifdef CONFIG_LIBUKNETDEV_DISPATCHERTHREADS
 	struct uk_sched *s;               /**< Scheduler for dispatcher. */
 #endif
@@ -385,6 +471,22 @@ typedef int (*uk_netdev_tx_one_t)(struct uk_netdev *dev,
 				  struct uk_netdev_tx_queue *queue,
 				  struct uk_netbuf *pkt);
 
+/** Driver callback type to retrieve multiple packets from a RX queue.
+ *  `cnt` holds the size of `pkt` on entry and the number of received
+ *  packets on return.
+ */
+typedef int (*uk_netdev_rx_burst_t)(struct uk_netdev *dev,
+				    struct uk_netdev_rx_queue *queue,
+				    struct uk_netbuf **pkt, uint16_t *cnt);
+
+/** Driver callback type to submit multiple packets to a TX queue.
+ *  `cnt` holds the number of packets in `pkt` on entry and the number of
+ *  submitted packets on return.
+ */
+typedef int (*uk_netdev_tx_burst_t)(struct uk_netdev *dev,
+				    struct uk_netdev_tx_queue *queue,
+				    struct uk_netbuf **pkt, uint16_t *cnt);
+
 /**
  * A structure containing the functions exported by a driver.
  */
@@ -461,10 +563,12 @@ struct uk_netdev_einfo {
  * NETDEV
  * A structure used to interact with a network device.
  *
- * Function callbacks (tx_one, rx_one, ops) are registered by the driver before
- * registering the netdev. They change during device life time. Packet RX/TX
- * functions are added directly to this structure for performance reasons.
- * It prevents another indirection to ops.
+ * Function callbacks (tx_one, rx_one, tx_burst, rx_burst, ops) are registered
+ * by the driver before registering the netdev. They change during device life
+ * time. Packet RX/TX functions are added directly to this structure for
+ * performance reasons. It prevents another indirection to ops.
+ * Drivers that do not provide burst functions get generic ones that loop over
+ * tx_one and rx_one.
  */
 struct uk_netdev {
 	/** Packet transmission. */
@@ -473,6 +577,12 @@ struct uk_netdev {
 	/** Packet reception. */
 	uk_netdev_rx_one_t          rx_one; /* by driver */
 
+	/** Burst packet transmission. */
+	uk_netdev_tx_burst_t        tx_burst; /* by driver (optional) */
+
+	/** Burst packet reception. */
+	uk_netdev_rx_burst_t        rx_burst; /* by driver (optional) */
+
 	/** Pointer to API-internal state data. */
 	struct uk_netdev_data       *_data;
 
@@ -132,6 +132,70 @@ static struct uk_netdev_einfo *_alloc_einfo(struct uk_alloc *a)
 	return _einfo;
 }
 
+/* Generic burst functions for drivers that only implement rx_one/tx_one */
+static int _rx_burst_one(struct uk_netdev *dev,
+			 struct uk_netdev_rx_queue *queue,
+			 struct uk_netbuf **pkt, uint16_t *cnt)
+{
+	int status = 0x0;
+	uint16_t i;
+	int rc = 0;
+
+	for (i = 0; i < *cnt; i++) {
+		rc = dev->rx_one(dev, queue, &pkt[i]);
+		if (unlikely(rc < 0)) {
+			if (i == 0)
+				return rc;
+			break;
+		}
+		status |= rc & UK_NETDEV_STATUS_UNDERRUN;
+		if (!(rc & UK_NETDEV_STATUS_SUCCESS))
+			break;
+		if (!(rc & UK_NETDEV_STATUS_MORE)) {
+			i++;
+			break;
+		}
+	}
+
+	*cnt = i;
+	if (i)
+		status |= UK_NETDEV_STATUS_SUCCESS;
+	if (rc > 0)
+		status |= rc & UK_NETDEV_STATUS_MORE;
+	return status;
+}
+
+static int _tx_burst_one(struct uk_netdev *dev,
+			 struct uk_netdev_tx_queue *queue,
+			 struct uk_netbuf **pkt, uint16_t *cnt)
+{
+	int status = 0x0;
+	uint16_t i;
+	int rc = 0;
+
+	for (i = 0; i < *cnt; i++) {
+		rc = dev->tx_one(dev, queue, pkt[i]);
+		if (unlikely(rc < 0)) {
+			if (i == 0)
+				return rc;
+			break;
+		}
+		if (!(rc & UK_NETDEV_STATUS_SUCCESS))
+			break;
+		if (!(rc & UK_NETDEV_STATUS_MORE)) {
+			i++;
+			break;
+		}
+	}
+
+	*cnt = i;
+	if (i)
+		status |= UK_NETDEV_STATUS_SUCCESS;
+	if (rc > 0)
+		status |= rc & UK_NETDEV_STATUS_MORE;
+	return status;
+}
+
 int uk_netdev_drv_register(struct uk_netdev *dev, struct uk_alloc *a,
 			   const char *drv_name)
 {
@@ -154,6 +218,10 @@ int uk_netdev_drv_register(struct uk_netdev *dev, struct uk_alloc *a,
 		      && !dev->ops->rxq_intr_disable));
 	UK_ASSERT(dev->rx_one);
 	UK_ASSERT(dev->tx_one);
+	if (!dev->rx_burst)
+		dev->rx_burst = _rx_burst_one;
+	if (!dev->tx_burst)
+		dev->tx_burst = _tx_burst_one;
 
 	dev->_data = _alloc_data(a, netdev_count,  drv_name);
 	if (!dev->_data)
@@ -318,6 +386,30 @@ int uk_netdev_txq_info_get(struct uk_netdev *dev, uint16_t queue_id,
 	return dev->ops->txq_info_get(dev, queue_id, queue_info);
 }
 
+static int _rss_conf_check(const struct uk_netdev_rss_conf *rss,
+			   const struct uk_netdev_info *dev_info,
+			   uint16_t nb_rx_queues)
+{
+	uint16_t i;
+
+	if (!uk_netdev_rss_supported(dev_info->features))
+		return -ENOTSUP;
+	if (rss->hash_types & ~dev_info->rss_hash_types)
+		return -ENOTSUP;
+	if (rss->key && rss->key_len > dev_info->rss_key_size)
+		return -EINVAL;
+	if (rss->reta) {
+		if (!rss->reta_size
+		    || rss->reta_size > dev_info->rss_reta_size
+		    || (rss->reta_size & (rss->reta_size - 1)))
+			return -EINVAL;
+		for (i = 0; i < rss->reta_size; ++i)
+			if (rss->reta[i] >= nb_rx_queues)
+				return -EINVAL;
+	}
+	return 0;
+}
+
 int uk_netdev_configure(struct uk_netdev *dev,
 			const struct uk_netdev_conf *dev_conf)
 {
@@ -338,6 +430,14 @@ int uk_netdev_configure(struct uk_netdev *dev,
 		return -EINVAL;
 	if (dev_conf->nb_tx_queues > dev_info.max_tx_queues)
 		return -EINVAL;
+	if (dev_conf->lro && !uk_netdev_lro_supported(dev_info.features))
+		return -ENOTSUP;
+	if (dev_conf->rss.hash_types) {
+		ret = _rss_conf_check(&dev_conf->rss, &dev_info,
+				      dev_conf->nb_rx_queues);
+		if (ret < 0)
+			return ret;
+	}
 
 	ret = dev->ops->configure(dev, dev_conf);
 	if (ret >= 0) {
@@ -43,6 +43,9 @@
 #define __UK_SCHED_IMPL_H__
 
 #include <uk/sched.h>
+#if CONFIG_LIBUKLOCK_RCU
+#include <uk/rcu.h>
+#endif /* CONFIG_LIBUKLOCK_RCU */
 
 #ifdef __cplusplus
 extern "C" {
@@ -90,6 +93,11 @@ void uk_sched_thread_switch(struct uk_thread *next)
 
 	UK_ASSERT(prev);
 
+#if CONFIG_LIBUKLOCK_RCU
+	/* Threads leave RCU read-side critical sections before switching */
+	uk_rcu_qs();
+#endif /* CONFIG_LIBUKLOCK_RCU */
+
 	ukplat_per_lcpu_current(__uk_sched_thread_current) = next;
 
 	prev->tlsp = ukplat_tlsp_get();
@@ -38,6 +38,7 @@
 #include <uk/plat/tls.h>
 #include <uk/wait_types.h>
 #include <uk/list.h>
+#include <uk/pheap.h>
 #include <uk/prio.h>
 #include <uk/essentials.h>
 
@@ -63,6 +64,7 @@ struct uk_thread {
 	UK_TAILQ_ENTRY(struct uk_thread) queue;
 	uint32_t flags;
 	__snsec wakeup_time;
+	struct uk_pheap_node wakeup_node; /**< Sleep queue link (scheduler) */
 	struct uk_sched *sched;
 
 	struct {
@@ -170,6 +170,31 @@ void uk_waitq_wake_up(struct uk_waitq *wq)
 	ukplat_lcpu_restore_irqf(flags);
 }
 
+/**
+ * Wake up the first thread in the wait queue that is not already runnable.
+ *
+ * @return 1 if a thread has been woken up, 0 otherwise
+ */
+static inline
+int uk_waitq_wake_up_one(struct uk_waitq *wq)
+{
+	unsigned long flags;
+	struct uk_waitq_entry *curr;
+	int woken = 0;
+
+	flags = ukplat_lcpu_save_irqf();
+	UK_STAILQ_FOREACH(curr, wq, thread_list) {
+		if (!uk_thread_is_runnable(curr->thread)) {
+			uk_thread_wake(curr->thread);
+			woken = 1;
+			break;
+		}
+	}
+	ukplat_lcpu_restore_irqf(flags);
+
+	return woken;
+}
+
 #ifdef __cplusplus
 }
 #endif
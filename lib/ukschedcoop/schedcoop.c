@@ -36,11 +36,12 @@
 #include <uk/sched_impl.h>
 #include <uk/schedcoop.h>
 #include <uk/essentials.h>
+#include <uk/pheap.h>
 
 struct schedcoop {
 	struct uk_sched sched;
 	struct uk_thread_list run_queue;
-	struct uk_thread_list sleep_queue;
+	struct uk_pheap sleep_queue;	/* Ordered by wakeup time */
 
 	struct uk_thread idle;
 	__nsec idle_return_time;
@@ -53,10 +54,31 @@ static inline struct schedcoop *uksched2schedcoop(struct uk_sched *s)
 	return __containerof(s, struct schedcoop, sched);
 }
 
+static int sleep_queue_less(const struct uk_pheap_node *a,
+			    const struct uk_pheap_node *b)
+{
+	return uk_pheap_entry(a, struct uk_thread, wakeup_node)->wakeup_time
+	       < uk_pheap_entry(b, struct uk_thread, wakeup_node)->wakeup_time;
+}
+
+static inline struct uk_thread *sleep_queue_first(struct schedcoop *c)
+{
+	struct uk_pheap_node *n = uk_pheap_min(&c->sleep_queue);
+
+	return n ? uk_pheap_entry(n, struct uk_thread, wakeup_node) : NULL;
+}
+
+static inline void sleep_queue_remove(struct schedcoop *c, struct uk_thread *t)
+{
+	if (uk_pheap_linked(&c->sleep_queue, &t->wakeup_node))
+		uk_pheap_remove(&c->sleep_queue, &t->wakeup_node,
+				sleep_queue_less);
+}
+
 static void schedcoop_schedule(struct uk_sched *s)
 {
 	struct schedcoop *c = uksched2schedcoop(s);
-	struct uk_thread *prev, *next, *thread, *tmp;
+	struct uk_thread *prev, *next, *thread;
 	__snsec now, min_wakeup_time;
 	unsigned long flags;
 
@@ -71,21 +93,19 @@ static void schedcoop_schedule(struct uk_sched *s)
 		UK_CRASH("Must not call %s from a callback\n", __func__);
 #endif
 
-	/* Examine all sleeping threads.
-	 * Wake up expired ones and find the time when the next timeout expires.
+	/* Wake up expired threads. The sleep queue is a min-heap ordered by
+	 * wakeup time, so its first entry is always the next timeout.
 	 */
 	now = ukplat_monotonic_clock();
 	min_wakeup_time = 0;
 
-	UK_TAILQ_FOREACH_SAFE(thread, &c->sleep_queue,
-			      queue, tmp) {
-		if (likely(thread->wakeup_time)) {
-			if (thread->wakeup_time <= now)
-				uk_thread_wake(thread);
-			else if (!min_wakeup_time
-				 || thread->wakeup_time < min_wakeup_time)
-				min_wakeup_time = thread->wakeup_time;
+	while ((thread = sleep_queue_first(c))) {
+		if (thread->wakeup_time > now) {
+			min_wakeup_time = thread->wakeup_time;
+			break;
 		}
+		uk_pheap_pop(&c->sleep_queue, sleep_queue_less);
+		uk_thread_wake(thread);
 	}
 
 	next = UK_TAILQ_FIRST(&c->run_queue);
@@ -156,6 +176,9 @@ static void schedcoop_thread_remove(struct uk_sched *s, struct uk_thread *t)
 	if (t != uk_thread_current()
 	    && uk_thread_is_runnable(t))
 		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
+
+	/* Remove from sleep_queue */
+	sleep_queue_remove(c, t);
 }
 
 static void schedcoop_thread_blocked(struct uk_sched *s, struct uk_thread *t)
@@ -167,7 +190,8 @@ static void schedcoop_thread_blocked(struct uk_sched *s, struct uk_thread *t)
 	if (t != uk_thread_current())
 		UK_TAILQ_REMOVE(&c->run_queue, t, queue);
 	if (t->wakeup_time > 0)
-		UK_TAILQ_INSERT_TAIL(&c->sleep_queue, t, queue);
+		uk_pheap_insert(&c->sleep_queue, &t->wakeup_node,
+				sleep_queue_less);
 }
 
 static void schedcoop_thread_woken(struct uk_sched *s, struct uk_thread *t)
@@ -176,8 +200,7 @@ static void schedcoop_thread_woken(struct uk_sched *s, struct uk_thread *t)
 
 	UK_ASSERT(ukplat_lcpu_irqs_disabled());
 
-	if (t->wakeup_time > 0)
-		UK_TAILQ_REMOVE(&c->sleep_queue, t, queue);
+	sleep_queue_remove(c, t);
 	if (uk_thread_is_queueable(t) && uk_thread_is_runnable(t)) {
 		UK_TAILQ_INSERT_TAIL(&c->run_queue, t, queue);
 		uk_thread_clear_queueable(t);
@@ -258,7 +281,7 @@ struct uk_sched *uk_schedcoop_create(struct uk_alloc *a)
 		goto err_out;
 
 	UK_TAILQ_INIT(&c->run_queue);
-	UK_TAILQ_INIT(&c->sleep_queue);
+	uk_pheap_init(&c->sleep_queue);
 
 	/* Create idle thread */
 	rc = uk_thread_init_fn1(&c->idle,
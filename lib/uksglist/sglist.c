@@ -233,7 +233,7 @@ int uk_sglist_append_sglist(struct uk_sglist *sg,
 		return -EINVAL;
 	SGLIST_SAVE(sg, save);
 	error = -EINVAL;
-	ss = &sg->sg_segs[sg->sg_nseg - 1];
+	ss = (sg->sg_nseg > 0) ? &sg->sg_segs[sg->sg_nseg - 1] : NULL;
 	for (i = 0; i < source->sg_nseg; i++) {
 		if (offset >= source->sg_segs[i].ss_len) {
 			offset -= source->sg_segs[i].ss_len;
@@ -242,8 +242,17 @@ int uk_sglist_append_sglist(struct uk_sglist *sg,
 		seglen = source->sg_segs[i].ss_len - offset;
 		if (seglen > length)
 			seglen = length;
-		error = _sglist_append_range(sg, &ss,
-		    source->sg_segs[i].ss_paddr + offset, seglen);
+		if (sg->sg_nseg == 0) {
+			/* There is no previous segment to coalesce with */
+			ss = sg->sg_segs;
+			ss->ss_paddr = source->sg_segs[i].ss_paddr + offset;
+			ss->ss_len = seglen;
+			sg->sg_nseg = 1;
+			error = 0;
+		} else {
+			error = _sglist_append_range(sg, &ss,
+			    source->sg_segs[i].ss_paddr + offset, seglen);
+		}
 		if (error)
 			break;
 		offset = 0;
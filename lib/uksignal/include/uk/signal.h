@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __UK_SIGNAL_RAISE_H__
+#define __UK_SIGNAL_RAISE_H__
+
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Delivers a signal to the application. There is no asynchronous
+ * interruption of threads: an installed handler runs synchronously in the
+ * context of the calling thread. The default action terminates the
+ * unikernel unless it is to ignore the signal.
+ *
+ * @param sig the signal number
+ * @param si optional signal information that is passed to SA_SIGINFO
+ *    handlers. If NULL, SI_USER information is generated
+ *
+ * @return 0 on success, a negative errno value otherwise
+ */
+int uk_signal_raise(int sig, siginfo_t *si);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UK_SIGNAL_RAISE_H__ */
@@ -41,6 +41,10 @@
 #include <uk/config.h>
 #include <uk/essentials.h>
 #include <uk/syscall.h>
+#include <uk/print.h>
+#include <uk/signal.h>
+#include <uk/arch/spinlock.h>
+#include <uk/plat/bootstrap.h>
 #ifndef __NEED_struct_timespec
 #define __NEED_struct_timespec
 #endif
@@ -53,16 +57,85 @@ UK_SYSCALL_R_DEFINE(int, sigaltstack, const stack_t *, ss,
 	return 0;
 }
 
+/* Installed signal actions. There are no processes, so they are global. */
+static struct sigaction sigactions[NSIG];
+static __spinlock sigactions_lock = UKARCH_SPINLOCK_INITIALIZER();
+
 UK_SYSCALL_R_DEFINE(int, rt_sigaction, int, signum,
-		    const struct sigaction *__unused, act,
+		    const struct sigaction *, act,
 		    struct sigaction *, oldact,
 		    size_t __unused, sigsetsize)
 {
-	if (unlikely(signum == SIGKILL || signum == SIGSTOP))
+	if (unlikely(signum <= 0 || signum >= NSIG))
+		return -EINVAL;
+	if (unlikely(act && (signum == SIGKILL || signum == SIGSTOP)))
 		return -EINVAL;
 
+	ukarch_spin_lock(&sigactions_lock);
 	if (oldact)
-		*oldact = (struct sigaction){0};
+		*oldact = sigactions[signum];
+	if (act)
+		sigactions[signum] = *act;
+	ukarch_spin_unlock(&sigactions_lock);
+
+	return 0;
+}
+
+/* Signals whose default action is not to terminate */
+static int sig_dfl_ignored(int sig)
+{
+	switch (sig) {
+	case SIGCHLD:
+	case SIGCONT:
+	case SIGURG:
+	case SIGWINCH:
+	/* There is no job control, so stopping is ignored as well */
+	case SIGSTOP:
+	case SIGTSTP:
+	case SIGTTIN:
+	case SIGTTOU:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+int uk_signal_raise(int sig, siginfo_t *si)
+{
+	struct sigaction act;
+	siginfo_t usi;
+
+	if (unlikely(sig <= 0 || sig >= NSIG))
+		return -EINVAL;
+
+	ukarch_spin_lock(&sigactions_lock);
+	act = sigactions[sig];
+	if (act.sa_flags & SA_RESETHAND)
+		sigactions[sig] = (struct sigaction){0};
+	ukarch_spin_unlock(&sigactions_lock);
+
+	/* The disposition applies whether or not SA_SIGINFO is set */
+	if (act.sa_handler == SIG_IGN)
+		return 0;
+
+	if (act.sa_handler == SIG_DFL) {
+		if (sig_dfl_ignored(sig))
+			return 0;
+		uk_pr_crit("Terminated by signal %d\n", sig);
+		ukplat_terminate(UKPLAT_CRASH);
+	}
+
+	if (act.sa_flags & SA_SIGINFO) {
+		if (!si) {
+			usi = (siginfo_t){0};
+			usi.si_signo = sig;
+			usi.si_code = SI_USER;
+			si = &usi;
+		}
+		act.sa_sigaction(sig, si, NULL);
+	} else {
+		act.sa_handler(sig);
+	}
 
 	return 0;
 }
@@ -161,9 +234,12 @@ int sigwait(const sigset_t *set, int *sig)
 
 UK_SYSCALL_R_DEFINE(int, tkill,
 		    int __unused, tid,
-		    int __unused, sig)
+		    int, sig)
 {
-	return 0;
+	if (!sig)
+		return 0;
+
+	return uk_signal_raise(sig, NULL);
 }
 
 #if UK_LIBC_SYSCALLS
@@ -175,12 +251,14 @@ int raise(int sig)
 
 UK_SYSCALL_R_DEFINE(int, kill,
 		    pid_t, pid,
-		    int __unused, sig)
+		    int, sig)
 {
 	if (unlikely(pid != 0))
 		return -ESRCH;
+	if (!sig)
+		return 0;
 
-	return 0;
+	return uk_signal_raise(sig, NULL);
 }
 
 #if UK_LIBC_SYSCALLS
@@ -210,11 +210,15 @@ static inline int uk_vma_map_dma(struct uk_vas *vas, __vaddr_t *vaddr,
  * lifetime of the mapping.
  *
  * Note that the current file mapping implementation only allows private
- * mappings and will return -ENOTSUP for shared mappings. Accordingly,
- * modifications are not synched back to the file. Similarly, changes to the
- * file via regular read() and write() operations are not visible in the
- * mapping. Instead, the whole file contents is loaded into memory when the
- * mapping is established.
+ * mappings and read-only shared mappings and will return -ENOTSUP for
+ * writable shared mappings. Accordingly, modifications are not synched back
+ * to the file. For private mappings, changes to the file via regular read()
+ * and write() operations are not visible in the mapping. Instead, the whole
+ * file contents is loaded into memory when the mapping is established.
+ *
+ * If the file system keeps the file data in pages (see vop_getpage), shared
+ * mappings map the file pages directly. They do not copy the file contents
+ * and reflect later changes to the file.
  */
 extern const struct uk_vma_ops uk_vma_file_ops;
 
@@ -229,6 +233,9 @@ struct uk_vma_file {
 
 	/** Start offset describing what position in the file is mapped */
 	__off offset;
+
+	/** Whether the file pages are mapped instead of copies of them */
+	int direct;
 };
 
 struct uk_vma_file_args {
@@ -38,6 +38,7 @@
 #include <uk/arch/types.h>
 #include <uk/arch/paging.h>
 #include <uk/list.h>
+#include <uk/rbtree.h>
 #include <uk/alloc.h>
 #ifdef CONFIG_HAVE_PAGING
 #include <uk/plat/paging.h>
@@ -68,6 +69,11 @@ struct uk_vas {
 	/** List of VMAs, sorted by address */
 	struct uk_list_head vma_list;
 
+	/** Tree of VMAs, sorted by address and augmented with the largest gap
+	 * between VMAs in each subtree for fast lookup and placement
+	 */
+	struct uk_rb_tree vma_tree;
+
 	/** VAS flags */
 #define UK_VAS_FLAG_NO_PAGING		0x1 /* On-demand paging disabled */
 	unsigned long flags;
@@ -114,6 +120,14 @@ struct uk_vma {
 	const struct uk_vma_ops *ops;
 
 	struct uk_list_head vma_list;
+	struct uk_rb_node vma_node;
+
+	/** Size of the unmapped address range between the previous VMA (or
+	 * address 0) and the start of this VMA
+	 */
+	__sz gap;
+	/** Largest gap of all VMAs in the subtree of this VMA */
+	__sz max_gap;
 
 	/** Page attributes for pages in the VMA (see PAGE_ATTR_*) */
 	unsigned long attr;
@@ -18,9 +18,14 @@
 #include <uk/plat/paging.h>
 #include <uk/nofault.h>
 #include <uk/arch/limits.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+#include <uk/essentials.h>
 
 #define MAPPING_BASE CONFIG_LIBUKVMEM_DEFAULT_BASE
 
+#define FAULT_AROUND_SIZE (CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES * PAGE_SIZE)
+
 /* Just define some shorter aliases */
 #undef PROT_R
 #define PROT_R PAGE_ATTR_PROT_READ
@@ -413,9 +418,16 @@ UK_TESTCASE(ukvmem, test_vma_anon)
 	len = probe_rw(va2 + 0x1000, 0x1000);
 	UK_TEST_EXPECT_ZERO(len);
 
-	/* First page should still be inaccessible */
+	/* First page should still be inaccessible, unless it is in the
+	 * fault-around window of the second one
+	 */
 	len = probe_r_nopage(va2, 0x1000);
-	UK_TEST_EXPECT_ZERO(len);
+	if (ALIGN_DOWN(va2, FAULT_AROUND_SIZE) ==
+	    ALIGN_DOWN(va2 + 0x1000, FAULT_AROUND_SIZE)) {
+		UK_TEST_EXPECT_SNUM_EQ(len, 0x1000);
+	} else {
+		UK_TEST_EXPECT_ZERO(len);
+	}
 
 	/* We change protections for the second VMA range */
 	rc = uk_vma_set_attr(vas, va2, 0x2000, PROT_RW, 0);
@@ -448,7 +460,79 @@ UK_TESTCASE(ukvmem, test_vma_anon)
 	vas_clean(vas);
 }
 
+/**
+ * Tests that a fault in anonymous memory also pages-in the neighbouring pages
+ * in the fault-around window, but not beyond.
+ */
+UK_TESTCASE(ukvmem, test_vma_anon_fault_around)
+{
+	struct uk_vas *vas = vas_init();
+	__vaddr_t va, wstart, wend;
+	int rc;
+	__sz len;
+
+	va = __VADDR_ANY;
+	rc = uk_vma_map_anon(vas, &va, 4 * FAULT_AROUND_SIZE, PROT_RW, 0,
+			     NULL);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	len = probe_rw(va + FAULT_AROUND_SIZE + PAGE_SIZE, sizeof(long));
+	UK_TEST_EXPECT_SNUM_EQ(len, sizeof(long));
+
+	wstart = ALIGN_DOWN(va + FAULT_AROUND_SIZE + PAGE_SIZE,
+			    FAULT_AROUND_SIZE);
+	wend   = wstart + FAULT_AROUND_SIZE;
+
+	len = probe_r_nopage(wstart, FAULT_AROUND_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, FAULT_AROUND_SIZE);
+	UK_TEST_EXPECT(is_zero(wstart, FAULT_AROUND_SIZE));
+
+	len = probe_r_nopage(wstart - PAGE_SIZE, PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(len);
+
+	len = probe_r_nopage(wend, PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(len);
+
+	vas_clean(vas);
+}
+
 #ifdef PAGE_LARGE_SHIFT
+#ifdef CONFIG_LIBUKVMEM_ANON_LARGE_PAGES
+/**
+ * Tests that anonymous memory is opportunistically backed by large pages if
+ * the large page is fully covered by the VMA.
+ */
+UK_TESTCASE(ukvmem, test_vma_anon_large_fault)
+{
+	struct uk_vas *vas = vas_init();
+	__vaddr_t va, lva;
+	unsigned int lvl;
+	int rc;
+	__sz len;
+
+	va = __VADDR_ANY;
+	rc = uk_vma_map_anon(vas, &va, 3 * PAGE_LARGE_SIZE, PROT_RW, 0, NULL);
+	UK_TEST_EXPECT_ZERO(rc);
+
+	lva = PAGE_LARGE_ALIGN_UP(va);
+
+	len = probe_rw(lva + PAGE_SIZE, sizeof(long));
+	UK_TEST_EXPECT_SNUM_EQ(len, sizeof(long));
+
+	lvl = PAGE_LEVEL;
+	rc = ukplat_pt_walk(vas->pt, lva, &lvl, NULL, NULL);
+	vmem_bug_on(rc != 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(lvl, PAGE_LARGE_LEVEL);
+
+	len = probe_r_nopage(lva, PAGE_LARGE_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(len, PAGE_LARGE_SIZE);
+	UK_TEST_EXPECT(is_zero(lva, PAGE_LARGE_SIZE));
+
+	vas_clean(vas);
+}
+#endif /* CONFIG_LIBUKVMEM_ANON_LARGE_PAGES */
+
 /**
  * Tests if we can create anonymous mappings with large pages.
  */
@@ -839,4 +923,114 @@ UK_TESTCASE(ukvmem, test_vma_replace)
 	vas_clean(vas);
 }
 
+/**
+ * Stress test and benchmark for the VMA index. Creates many VMAs separated by
+ * holes, checks lookups and first-fit placement against a linear scan of the
+ * VMA list, and reports the average lookup and placement times.
+ */
+#define VMEM_STRESS_VMAS	4096
+#define VMEM_STRESS_LOOKUPS	65536
+
+static __vaddr_t vmem_ref_first_fit(struct uk_vas *vas, __vaddr_t base,
+				    __sz len)
+{
+	__vaddr_t va = base;
+	struct uk_vma *vma;
+
+	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
+		if (va + len <= vma->start)
+			return va;
+
+		va = MAX(vma->end, base);
+	}
+
+	return va;
+}
+
+static const struct uk_vma *vmem_ref_find(struct uk_vas *vas, __vaddr_t va)
+{
+	struct uk_vma *vma;
+
+	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
+		if (va >= vma->start && va < vma->end)
+			return vma;
+	}
+
+	return __NULL;
+}
+
+UK_TESTCASE(ukvmem, test_vma_stress)
+{
+	struct uk_vas *vas = vas_init();
+	__vaddr_t base = vas->vma_base;
+	__vaddr_t va, ref;
+	__nsec t, t_find, t_fit;
+	unsigned long seed = 1;
+	unsigned int i, bad;
+	int rc;
+
+	/* VMA i covers page 2i. The odd pages remain holes */
+	for (i = 0; i < VMEM_STRESS_VMAS; i++) {
+		va = base + 2 * i * PAGE_SIZE;
+		rc = uk_vma_reserve(vas, &va, PAGE_SIZE);
+		if (unlikely(rc))
+			break;
+	}
+	UK_TEST_EXPECT_SNUM_EQ(i, VMEM_STRESS_VMAS);
+
+	bad = 0;
+	for (i = 0; i < VMEM_STRESS_LOOKUPS; i++) {
+		seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+		va = base + (seed >> 33) % (2 * VMEM_STRESS_VMAS * PAGE_SIZE);
+		if (uk_vma_find(vas, va) != vmem_ref_find(vas, va))
+			bad++;
+	}
+	UK_TEST_EXPECT_ZERO(bad);
+
+	t_find = ukplat_monotonic_clock();
+	for (i = 0; i < VMEM_STRESS_LOOKUPS; i++) {
+		seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+		va = base + (seed >> 33) % (2 * VMEM_STRESS_VMAS * PAGE_SIZE);
+		uk_vma_find(vas, va);
+	}
+	t_find = ukplat_monotonic_clock() - t_find;
+
+	/* Remove every fourth VMA to open holes of three pages */
+	for (i = 1; i < VMEM_STRESS_VMAS; i += 4) {
+		rc = uk_vma_unmap(vas, base + 2 * i * PAGE_SIZE, PAGE_SIZE, 0);
+		UK_TEST_EXPECT_ZERO(rc);
+	}
+
+	/* Fill the holes from the bottom and check against the reference */
+	bad = 0;
+	t_fit = 0;
+	for (i = 1; i < VMEM_STRESS_VMAS; i += 4) {
+		ref = vmem_ref_first_fit(vas, base, 3 * PAGE_SIZE);
+
+		/* Use different attributes to prevent merging */
+		va = __VADDR_ANY;
+		t = ukplat_monotonic_clock();
+		rc = uk_vma_map(vas, &va, 3 * PAGE_SIZE, PROT_R, 0, __NULL,
+				&uk_vma_rsvd_ops, __NULL);
+		t_fit += ukplat_monotonic_clock() - t;
+		if (unlikely(rc || va != ref))
+			bad++;
+	}
+	UK_TEST_EXPECT_ZERO(bad);
+
+	/* All holes are used now, so larger VMAs go after the last one */
+	ref = vmem_ref_first_fit(vas, base, 4 * PAGE_SIZE);
+	va = __VADDR_ANY;
+	rc = uk_vma_reserve(vas, &va, 4 * PAGE_SIZE);
+	UK_TEST_EXPECT_ZERO(rc);
+	UK_TEST_EXPECT_SNUM_EQ(va, ref);
+
+	uk_test_printf("%d VMAs: find %"__PRInsec" ns, first fit %"__PRInsec
+		       " ns (avg)\n", VMEM_STRESS_VMAS,
+		       t_find / VMEM_STRESS_LOOKUPS,
+		       t_fit / (VMEM_STRESS_VMAS / 4));
+
+	vas_clean(vas);
+}
+
 uk_testsuite_register(ukvmem, NULL);
@@ -20,7 +20,9 @@
 #include <vfscore/file.h>
 #include <vfscore/vnode.h>
 #include <vfscore/uio.h>
+#include <vfscore/pagecache.h>
 #include <uk/isr/string.h>
+#include <uk/plat/io.h>
 
 #ifdef CONFIG_LIBUKVMEM_FILE_BASE
 static __vaddr_t vma_op_file_get_base(struct uk_vas *vas __unused,
@@ -37,6 +39,8 @@ int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 {
 	struct uk_vma_file_args *args = (struct uk_vma_file_args *)data;
 	struct uk_vma_file *vma_file;
+	unsigned int order = UK_VMA_MAP_SIZE_TO_ORDER(*flags);
+	struct vnode *vp;
 
 	UK_ASSERT(data);
 	UK_ASSERT(args->fd >= 0);
@@ -46,15 +50,19 @@ int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 	/* Writable shared mappings are not supported.
 	 * Read-only shared mappings are partially supported.
 	 *
-	 * We treat read-only shared mappings as private. Note that any writes
-	 * to the underlying file while the mapping is established will not be
-	 * reflected in memory.
+	 * If the file system supports it, read-only shared mappings map the
+	 * file pages directly (see below), so they reflect later writes to
+	 * the pages that the file has at mapping time. Otherwise, we treat
+	 * them as private. Note that any writes to the underlying file while
+	 * such a mapping is established will not be reflected in memory.
 	 */
 	if ((*flags & UK_VMA_FILE_SHARED) && (attr & PAGE_ATTR_PROT_WRITE))
 		return -ENOTSUP;
 
 	/* Since we cannot do ISR-safe file accesses in the fault handler,
-	 * we enforce full load at mapping time for now.
+	 * we enforce full load at mapping time for now. For direct mappings,
+	 * this allocates nothing: Holes and the range past the end of the
+	 * file are backed by a page of zeros.
 	 *
 	 * TODO: Remove this restriction if possible.
 	 */
@@ -70,6 +78,19 @@ int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 		return -EBADF;
 	}
 	vma_file->offset = args->offset;
+	vma_file->direct = 0;
+
+	/* Shared mappings are read-only, so we can map the file pages
+	 * directly if the file system supports it. This needs base pages
+	 * because the file pages are not physically contiguous.
+	 */
+	vp = vma_file->f->f_dentry->d_vnode;
+	if ((*flags & UK_VMA_FILE_SHARED) && vp->v_op->vop_map &&
+	    (order == 0 || order == PAGE_SHIFT)) {
+		vn_lock(vp);
+		vma_file->direct = (VOP_MAP(vp) == 0);
+		vn_unlock(vp);
+	}
 
 	/* Use the file name as VMA name. Since the memory management of the
 	 * string is tied to the file object, we do not need to care about
@@ -86,8 +107,16 @@ int vma_op_file_new(struct uk_vas *vas, __vaddr_t vaddr __unused,
 static void vma_op_file_destroy(struct uk_vma *vma)
 {
 	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+	struct vnode *vp;
 
 	UK_ASSERT(vma_file->f);
+
+	if (vma_file->direct) {
+		vp = vma_file->f->f_dentry->d_vnode;
+		vn_lock(vp);
+		VOP_UNMAP(vp);
+		vn_unlock(vp);
+	}
 	fdrop(vma_file->f);
 }
 
@@ -109,7 +138,7 @@ static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
 	int rc;
 
 	vn_lock(vp);
-	rc = VOP_READ(vp, fp, &uio, 0);
+	rc = vfscore_pcache_read(vp, fp, &uio, 0);
 	vn_unlock(vp);
 
 	if (unlikely(rc))
@@ -121,6 +150,32 @@ static int vma_file_read(struct vfscore_file *fp, __vaddr_t buf, __sz len,
 	return 0;
 }
 
+static int vma_file_fault_direct(struct uk_vma_file *vma_file,
+				 struct uk_vm_fault *fault)
+{
+	struct vnode *vp = vma_file->f->f_dentry->d_vnode;
+	void *page;
+	__off off;
+	int rc;
+
+	/* The file pages are not physically contiguous. Returning -ENOMEM
+	 * makes the caller retry with base pages.
+	 */
+	if (fault->len != PAGE_SIZE)
+		return -ENOMEM;
+
+	off = (fault->vbase - vma_file->base.start) + vma_file->offset;
+
+	vn_lock(vp);
+	rc = VOP_GETPAGE(vp, off, &page);
+	vn_unlock(vp);
+	if (unlikely(rc))
+		return -rc;
+
+	fault->paddr = ukplat_virt_to_phys(page);
+	return 0;
+}
+
 static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 {
 	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
@@ -136,6 +191,9 @@ static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 	UK_ASSERT(fault->len == PAGE_Lx_SIZE(fault->level));
 	UK_ASSERT(fault->type & UK_VMA_FAULT_NONPRESENT);
 
+	if (vma_file->direct)
+		return vma_file_fault_direct(vma_file, fault);
+
 	rc = pt->fa->falloc(pt->fa, &paddr, pages, FALLOC_FLAG_ALIGNED);
 	if (unlikely(rc))
 		return rc;
@@ -168,12 +226,27 @@ static int vma_op_file_fault(struct uk_vma *vma, struct uk_vm_fault *fault)
 	return 0;
 }
 
+static int vma_op_file_unmap(struct uk_vma *vma, __vaddr_t vaddr, __sz len)
+{
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+
+	/* The frames of directly mapped pages belong to the file */
+	if (vma_file->direct)
+		return ukplat_page_unmap(vma->vas->pt, vaddr, len / PAGE_SIZE,
+					 PAGE_FLAG_KEEP_FRAMES);
+
+	/* Default handler */
+	return vma_op_unmap(vma, vaddr, len);
+}
+
 static int vma_op_file_split(struct uk_vma *vma, __vaddr_t vaddr,
 			     struct uk_vma **new_vma)
 {
 	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
 	struct uk_vma_file *v;
+	struct vnode *vp;
 	__off off;
+	int rc;
 
 	v = uk_malloc(vma->vas->a, sizeof(struct uk_vma_file));
 	if (unlikely(!v))
@@ -184,10 +257,23 @@ static int vma_op_file_split(struct uk_vma *vma, __vaddr_t vaddr,
 
 	UK_ASSERT(vma_file->offset <= __OFF_MAX - off);
 	v->offset = vma_file->offset + off;
+	v->direct = vma_file->direct;
 
 	fhold(vma_file->f);
 	v->f = vma_file->f;
 
+	if (v->direct) {
+		vp = v->f->f_dentry->d_vnode;
+		vn_lock(vp);
+		rc = VOP_MAP(vp);
+		vn_unlock(vp);
+		if (unlikely(rc)) {
+			fdrop(v->f);
+			uk_free(vma->vas->a, v);
+			return -rc;
+		}
+	}
+
 	UK_ASSERT(new_vma);
 	*new_vma = &v->base;
 
@@ -212,6 +298,10 @@ static int vma_op_file_merge(struct uk_vma *vma, struct uk_vma *next)
 	if (next_file->offset != vma_file->offset + off)
 		return -EPERM;
 
+	/* ...and both either map the file pages or copies */
+	if (next_file->direct != vma_file->direct)
+		return -EPERM;
+
 	/* We call fdrop() in the destructor */
 
 	return 0;
@@ -227,11 +317,25 @@ static int vma_op_file_set_attr(struct uk_vma *vma, unsigned long attr)
 	return vma_op_set_attr(vma, attr);
 }
 
-/* We only support private mappings. Changes are not carried through to the
- * underlying file. So we can just use the default unmap handler that unmaps
- * the memory and forgets about it. Private file mappings can also change their
- * protections without checking for the permissions on the underlying file. We
- * can thus also use the default attribute setter.
+static int vma_op_file_advise(struct uk_vma *vma, __vaddr_t vaddr, __sz len,
+			      unsigned long advice)
+{
+	struct uk_vma_file *vma_file = (struct uk_vma_file *)vma;
+
+	/* Dropping directly mapped pages must not free the file pages */
+	if (vma_file->direct && !(advice & UK_VMA_ADV_WILLNEED) &&
+	    (advice & UK_VMA_ADV_DONTNEED))
+		return vma_op_file_unmap(vma, vaddr, len);
+
+	/* Default handler */
+	return vma_op_advise(vma, vaddr, len, advice);
+}
+
+/* We only support private and read-only shared mappings. Changes are not
+ * carried through to the underlying file. So we can just unmap the memory and
+ * forget about it. Only directly mapped file pages must not be freed. Private
+ * file mappings can also change their protections without checking for the
+ * permissions on the underlying file.
  */
 const struct uk_vma_ops uk_vma_file_ops = {
 #ifdef CONFIG_LIBUKVMEM_FILE_BASE
@@ -242,9 +346,9 @@ const struct uk_vma_ops uk_vma_file_ops = {
 	.new		= vma_op_file_new,
 	.destroy	= vma_op_file_destroy,
 	.fault		= vma_op_file_fault,
-	.unmap		= vma_op_unmap,		/* default */
+	.unmap		= vma_op_file_unmap,
 	.split		= vma_op_file_split,
 	.merge		= vma_op_file_merge,
 	.set_attr	= vma_op_file_set_attr,
-	.advise		= vma_op_advise,	/* default */
+	.advise		= vma_op_file_advise,
 };
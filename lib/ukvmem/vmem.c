@@ -14,11 +14,15 @@
 #include <uk/arch/paging.h>
 #ifdef CONFIG_HAVE_PAGING
 #include <uk/plat/paging.h>
+#include <uk/falloc.h>
 #endif /* CONFIG_HAVE_PAGING */
 #include <uk/alloc.h>
 #include <uk/assert.h>
 #include <uk/list.h>
+#include <uk/rbtree.h>
 #include <uk/config.h>
+#include <uk/vma_types.h>
+#include <uk/isr/string.h>
 
 /*
  * Pointer to currently active virtual address space.
@@ -68,6 +72,7 @@ int uk_vas_init(struct uk_vas *vas, struct uk_pagetable *pt __maybe_unused,
 	vas->flags = 0;
 
 	UK_INIT_LIST_HEAD(&vas->vma_list);
+	uk_rb_init(&vas->vma_tree);
 
 	return 0;
 }
@@ -82,6 +87,7 @@ void uk_vas_destroy(struct uk_vas *vas)
 	}
 
 	UK_ASSERT(uk_list_empty(&vas->vma_list));
+	UK_ASSERT(uk_rb_empty(&vas->vma_tree));
 
 	if (vmem_active_vas == vas)
 		vmem_active_vas = __NULL;
@@ -97,29 +103,132 @@ static void vmem_vma_destroy(struct uk_vma *vma)
 	uk_free(vma->vas->a, vma);
 }
 
-static void vmem_vma_unlink_and_free(struct uk_vma *vma)
+/*
+ * VMA tree
+ *
+ * In addition to the sorted list, the VMAs of an address space are kept in a
+ * red-black tree sorted by address. Each VMA records the gap to its
+ * predecessor and the tree is augmented with the largest gap in each subtree.
+ * This allows to find the VMA for an address and the first gap that fits a
+ * new VMA in O(log n).
+ */
+static inline struct uk_vma *vmem_vma_next(struct uk_vma *vma)
+{
+	return (vma->vma_list.next == &vma->vas->vma_list) ?
+		__NULL : uk_list_next_entry(vma, vma_list);
+}
+
+static inline __sz vmem_vma_subtree_gap(const struct uk_rb_node *n)
+{
+	return (n) ? uk_rb_entry(n, struct uk_vma, vma_node)->max_gap : 0;
+}
+
+static void vmem_vma_augment(struct uk_rb_node *n)
+{
+	struct uk_vma *vma = uk_rb_entry(n, struct uk_vma, vma_node);
+
+	vma->max_gap = MAX(vma->gap, MAX(vmem_vma_subtree_gap(n->left),
+					 vmem_vma_subtree_gap(n->right)));
+}
+
+static inline __sz vmem_vma_calc_gap(struct uk_vma *vma)
+{
+	const struct uk_vma *prev = uk_vma_prev(vma);
+
+	return vma->start - ((prev) ? prev->end : 0);
+}
+
+/* Must be called when the start of the VMA or the end of its predecessor
+ * changed, or when a VMA has been inserted or removed in front of it.
+ */
+static void vmem_vma_update_gap(struct uk_vma *vma)
 {
+	if (!vma)
+		return;
+
+	vma->gap = vmem_vma_calc_gap(vma);
+	uk_rb_augment_propagate(&vma->vma_node, vmem_vma_augment);
+}
+
+static void vmem_vma_unlink(struct uk_vma *vma)
+{
+	struct uk_vma *next;
+
 	UK_ASSERT(vma);
 	UK_ASSERT(!uk_list_empty(&vma->vma_list));
 
+	next = vmem_vma_next(vma);
+
+	uk_rb_erase(&vma->vas->vma_tree, &vma->vma_node, vmem_vma_augment);
 	uk_list_del(&vma->vma_list);
+
+	vmem_vma_update_gap(next);
+}
+
+/* Unlinks the VMAs from start to end (inclusive) from the address space. The
+ * VMAs stay linked with each other so that they can still be traversed.
+ */
+static void vmem_vma_unlink_vmas(struct uk_vma *start, struct uk_vma *end)
+{
+	struct uk_rb_tree *tree = &start->vas->vma_tree;
+	struct uk_vma *vma = start, *next;
+
+	UK_ASSERT(start);
+	UK_ASSERT(end);
+
+	next = vmem_vma_next(end);
+
+	while (vma != end) {
+		uk_rb_erase(tree, &vma->vma_node, vmem_vma_augment);
+		vma = uk_list_next_entry(vma, vma_list);
+	}
+
+	uk_rb_erase(tree, &end->vma_node, vmem_vma_augment);
+
+	start->vma_list.prev->next = end->vma_list.next;
+	end->vma_list.next->prev   = start->vma_list.prev;
+
+	vmem_vma_update_gap(next);
+}
+
+static void vmem_vma_unlink_and_free(struct uk_vma *vma)
+{
+	vmem_vma_unlink(vma);
 	vmem_vma_destroy(vma);
 }
 
+/* Returns the VMA with the lowest address that ends above vaddr */
+static struct uk_vma *vmem_vma_lower_bound(struct uk_vas *vas,
+					   __vaddr_t vaddr)
+{
+	struct uk_rb_node *n = vas->vma_tree.root;
+	struct uk_vma *vma, *found = __NULL;
+
+	while (n) {
+		vma = uk_rb_entry(n, struct uk_vma, vma_node);
+		if (vma->end > vaddr) {
+			found = vma;
+			n = n->left;
+		} else {
+			n = n->right;
+		}
+	}
+
+	return found;
+}
+
 static struct uk_vma *vmem_vma_find(struct uk_vas *vas, __vaddr_t vaddr,
 				    __sz len)
 {
 	struct uk_vma *vma;
-	__vaddr_t vstart = vaddr;
 	__vaddr_t vend = vaddr + MAX(len, (__sz)1);
 
 	UK_ASSERT(vas);
 	UK_ASSERT(vaddr <= __VADDR_MAX - len);
 
-	uk_list_for_each_entry(vma, &vas->vma_list, vma_list) {
-		if ((vend > vma->start) && (vstart < vma->end))
-			return vma;
-	}
+	vma = vmem_vma_lower_bound(vas, vaddr);
+	if (vma && vend > vma->start)
+		return vma;
 
 	return __NULL;
 }
@@ -227,26 +336,37 @@ static int vmem_vma_find_range(struct uk_vas *vas, __vaddr_t *vaddr, __sz *len,
 
 static void vmem_vma_insert(struct uk_vas *vas, struct uk_vma *vma)
 {
-	struct uk_list_head *prev;
-	struct uk_vma *cur;
+	struct uk_rb_node **link = &vas->vma_tree.root;
+	struct uk_rb_node *parent = __NULL;
+	struct uk_vma *cur, *next = __NULL;
 
 	UK_ASSERT(vas);
 	UK_ASSERT(uk_list_empty(&vma->vma_list));
 	UK_ASSERT(!vmem_vma_find(vas, vma->start, vma->end - vma->start));
 
-	prev = &vas->vma_list;
-	uk_list_for_each_entry(cur, &vas->vma_list, vma_list) {
-		if (vma->start < cur->end) {
+	while (*link) {
+		parent = *link;
+		cur = uk_rb_entry(parent, struct uk_vma, vma_node);
+		if (vma->start < cur->start) {
 			UK_ASSERT(vma->end <= cur->start);
 
-			uk_list_add(&vma->vma_list, prev);
-			return;
+			next = cur;
+			link = &parent->left;
+		} else {
+			link = &parent->right;
 		}
-
-		prev = &cur->vma_list;
 	}
 
-	uk_list_add_tail(&vma->vma_list, &vas->vma_list);
+	if (next)
+		uk_list_add_tail(&vma->vma_list, &next->vma_list);
+	else
+		uk_list_add_tail(&vma->vma_list, &vas->vma_list);
+
+	vma->gap = vmem_vma_calc_gap(vma);
+	uk_rb_insert(&vas->vma_tree, &vma->vma_node, parent, link,
+		     vmem_vma_augment);
+
+	vmem_vma_update_gap(next);
 }
 
 static inline int vmem_vma_can_merge(struct uk_vma *vma, struct uk_vma *next)
@@ -352,7 +472,7 @@ static int vmem_vma_split(struct uk_vma *vma, __vaddr_t vaddr,
 
 	vma->end	= vaddr;
 
-	uk_list_add(&v->vma_list, &vma->vma_list);
+	vmem_vma_insert(vma->vas, v);
 
 	*new_vma = v;
 	return 0;
@@ -511,28 +631,85 @@ int uk_vma_unmap(struct uk_vas *vas, __vaddr_t vaddr, __sz len,
 		return rc;
 	}
 
-	/* Unlink all VMAs starting from vma_start to vma_end */
-	vma_start->vma_list.prev->next = vma_end->vma_list.next;
-	vma_end->vma_list.next->prev   = vma_start->vma_list.prev;
-
+	vmem_vma_unlink_vmas(vma_start, vma_end);
 	vmem_vma_unmap_and_free_vmas(vma_start, vma_end);
 
 	return 0;
 }
 
+/* Returns the leftmost VMA in the subtree whose gap is at least len. The
+ * subtree must contain such a VMA.
+ */
+static struct uk_vma *vmem_vma_leftmost_gap(struct uk_rb_node *n, __sz len)
+{
+	struct uk_vma *vma;
+
+	UK_ASSERT(vmem_vma_subtree_gap(n) >= len);
+
+	for (;;) {
+		if (vmem_vma_subtree_gap(n->left) >= len) {
+			n = n->left;
+			continue;
+		}
+
+		vma = uk_rb_entry(n, struct uk_vma, vma_node);
+		if (vma->gap >= len)
+			return vma;
+
+		n = n->right;
+		UK_ASSERT(n);
+	}
+}
+
+/* Returns the first VMA following the given VMA whose gap is at least len,
+ * or __NULL if there is none
+ */
+static struct uk_vma *vmem_vma_next_gap(struct uk_vma *vma, __sz len)
+{
+	struct uk_rb_node *n = &vma->vma_node;
+	struct uk_rb_node *p;
+
+	if (vmem_vma_subtree_gap(n->right) >= len)
+		return vmem_vma_leftmost_gap(n->right, len);
+
+	/* Walk up. Every ancestor that we reach from its left subtree follows
+	 * the VMA, as does its right subtree.
+	 */
+	while ((p = n->parent)) {
+		if (n == p->left) {
+			vma = uk_rb_entry(p, struct uk_vma, vma_node);
+			if (vma->gap >= len)
+				return vma;
+
+			if (vmem_vma_subtree_gap(p->right) >= len)
+				return vmem_vma_leftmost_gap(p->right, len);
+		}
+
+		n = p;
+	}
+
+	return __NULL;
+}
+
 static __vaddr_t vmem_first_fit(struct uk_vas *vas, __vaddr_t base, __sz align,
 				__sz len)
 {
 	__vaddr_t vaddr = base;
-	struct uk_vma *cur;
+	struct uk_vma *cur, *last;
 
 	UK_ASSERT(vas);
+	UK_ASSERT(len > 0);
 
 	/* Since we are scanning the VAS for an empty address range, we need
 	 * to be careful not to overflow. Checks are thus always active and not
 	 * just asserts.
+	 *
+	 * We start with the gap in front of the first VMA that ends above the
+	 * base. Only the part of it above the base is usable. Afterwards, we
+	 * only visit gaps that are large enough without alignment.
 	 */
-	uk_list_for_each_entry(cur, &vas->vma_list, vma_list) {
+	cur = vmem_vma_lower_bound(vas, base);
+	while (cur) {
 		if (unlikely(vaddr > __VADDR_MAX - align))
 			return __VADDR_INV;
 
@@ -544,9 +721,16 @@ static __vaddr_t vmem_first_fit(struct uk_vas *vas, __vaddr_t base, __sz align,
 		if (vaddr + len <= cur->start)
 			return vaddr;
 
-		vaddr = MAX(cur->end, base);
+		cur = vmem_vma_next_gap(cur, len);
+		if (cur)
+			vaddr = cur->start - cur->gap;
 	}
 
+	last = uk_rb_entry_safe(uk_rb_last(&vas->vma_tree), struct uk_vma,
+				vma_node);
+	if (last)
+		vaddr = MAX(last->end, base);
+
 	if (unlikely(vaddr > __VADDR_MAX - align))
 		return __VADDR_INV;
 
@@ -689,10 +873,7 @@ int uk_vma_map(struct uk_vas *vas, __vaddr_t *vaddr, __sz len,
 	if (vma_start) {
 		UK_ASSERT(vma_end);
 
-		/* Unlink all VMAs starting from vma_start to vma_end */
-		vma_start->vma_list.prev->next = vma_end->vma_list.next;
-		vma_end->vma_list.next->prev   = vma_start->vma_list.prev;
-
+		vmem_vma_unlink_vmas(vma_start, vma_end);
 		vmem_vma_unmap_and_free_vmas(vma_start, vma_end);
 	}
 
@@ -990,27 +1171,42 @@ struct mapx_pagefault_ctx {
 };
 
 static int vmem_mapx_pagefault(struct uk_pagetable *pt __unused,
-			       __vaddr_t vaddr, __vaddr_t pt_vaddr __unused,
+			       __vaddr_t vaddr, __vaddr_t pt_vaddr,
 			       unsigned int level, __pte_t *pte, void *user)
 {
 	struct mapx_pagefault_ctx *ctx = (struct mapx_pagefault_ctx *)user;
+	/* Pages other than the faulting one are paged-in due to fault-around */
+	int around = (ctx->vaddr < vaddr ||
+		      ctx->vaddr - vaddr >= PAGE_Lx_SIZE(level));
 	struct uk_vm_fault fault = {
 		.vaddr = ctx->vaddr,
 		.vbase = vaddr,
 		.len   = PAGE_Lx_SIZE(level),
 		.paddr = PT_Lx_PTE_PADDR(*pte, level),
-		.type  = ctx->type,
+		.type  = ctx->type | ((around) ? UK_VMA_FAULT_SOFT : 0),
 		.pte   = *pte,
 		.level = level,
 		.regs  = ctx->regs,
 	};
+	__pte_t opte;
 	int rc;
 
 	UK_ASSERT(ctx->vma->ops);
 	UK_ASSERT(ctx->vma->ops->fault);
 
+	if (around) {
+		rc = ukarch_pte_read(pt_vaddr, level, PT_Lx_IDX(vaddr, level),
+				     &opte);
+		if (unlikely(rc) || PT_Lx_PTE_PRESENT(opte, level))
+			return UKPLAT_PAGE_MAPX_ESKIP;
+	}
+
 	rc = ctx->vma->ops->fault(ctx->vma, &fault);
 	if (unlikely(rc)) {
+		/* Fault-around is best effort and must not fail the fault */
+		if (around)
+			return UKPLAT_PAGE_MAPX_ESKIP;
+
 		if (rc == -ENOMEM)
 			return UKPLAT_PAGE_MAPX_ETOOBIG;
 
@@ -1024,9 +1220,105 @@ static int vmem_mapx_pagefault(struct uk_pagetable *pt __unused,
 	return 0;
 }
 
+#if CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES & (CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES - 1)
+#error "CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES must be a power of 2"
+#endif
+
+#define VMEM_FAULT_AROUND_SIZE						\
+	((__sz)CONFIG_LIBUKVMEM_FAULT_AROUND_PAGES * PAGE_SIZE)
+
+/* Pages-in the faulting base page. For anonymous memory, this also pages-in
+ * the pages in the fault-around window that are not present yet.
+ */
+static int vmem_pagefault_around(struct uk_pagetable *pt, struct uk_vma *vma,
+				 __vaddr_t vaddr, struct ukplat_page_mapx *mapx)
+{
+	__sz wsize = (vma->ops == &uk_vma_anon_ops) ?
+		     VMEM_FAULT_AROUND_SIZE : PAGE_SIZE;
+	__vaddr_t wstart = ALIGN_DOWN(vaddr, wsize);
+	__vaddr_t vbase, vend;
+
+	vbase = MAX(wstart, vma->start);
+	vend  = (vma->end - wstart > wsize) ? wstart + wsize : vma->end;
+
+	UK_ASSERT(vaddr >= vbase && vaddr < vend);
+
+	return ukplat_page_mapx(pt, vbase, 0, (vend - vbase) >> PAGE_SHIFT,
+				vma->attr, PAGE_FLAG_SIZE(PAGE_LEVEL) |
+				PAGE_FLAG_FORCE_SIZE, mapx);
+}
+
+#if defined(CONFIG_LIBUKVMEM_ANON_LARGE_PAGES) && defined(PAGE_LARGE_LEVEL)
+static inline int vmem_vma_large_pages(struct uk_vma *vma)
+{
+	return (vma->ops == &uk_vma_anon_ops) && (vma->page_lvl < 0);
+}
+
+/* Replaces the base pages in the large page around vaddr with a large page if
+ * all of them are present. We do this synchronously on the fault that pages-in
+ * the last missing base page.
+ */
+static void vmem_vma_collapse(struct uk_vma *vma, __vaddr_t vaddr)
+{
+	struct uk_pagetable *pt = vma->vas->pt;
+	__vaddr_t vbase = PAGE_LARGE_ALIGN_DOWN(vaddr);
+	unsigned int lvl = PAGE_LEVEL;
+	__paddr_t paddr = __PADDR_ANY;
+	__vaddr_t pt_vaddr, kvaddr;
+	unsigned int i;
+	__pte_t pte;
+	int rc;
+
+	UK_ASSERT(vma->vas == uk_vas_get_active());
+
+	if (vbase < vma->start || vma->end - vbase < PAGE_LARGE_SIZE)
+		return;
+
+	rc = ukplat_pt_walk(pt, vbase, &lvl, &pt_vaddr, &pte);
+	if (unlikely(rc) || lvl != PAGE_LEVEL)
+		return;
+
+	for (i = 0; i < PT_Lx_PTES(PAGE_LEVEL); i++) {
+		rc = ukarch_pte_read(pt_vaddr, PAGE_LEVEL, i, &pte);
+		if (unlikely(rc) || !PT_Lx_PTE_PRESENT(pte, PAGE_LEVEL))
+			return;
+	}
+
+	rc = pt->fa->falloc(pt->fa, &paddr, PAGE_LARGE_SIZE / PAGE_SIZE,
+			    FALLOC_FLAG_ALIGNED);
+	if (unlikely(rc))
+		return;
+
+	kvaddr = ukplat_page_kmap(pt, paddr, 1,
+				 PAGE_FLAG_SIZE(PAGE_LARGE_LEVEL));
+	if (unlikely(kvaddr == __VADDR_INV)) {
+		pt->fa->ffree(pt->fa, paddr, PAGE_LARGE_SIZE / PAGE_SIZE);
+		return;
+	}
+
+	memcpy_isr((void *)kvaddr, (void *)vbase, PAGE_LARGE_SIZE);
+	ukplat_page_kunmap(pt, kvaddr, 1, PAGE_FLAG_SIZE(PAGE_LARGE_LEVEL));
+
+	/* This releases the base pages and the page table */
+	rc = ukplat_page_unmap(pt, vbase, PT_Lx_PTES(PAGE_LEVEL),
+			       PAGE_FLAG_SIZE(PAGE_LEVEL));
+	if (unlikely(rc))
+		UK_CRASH("Failed to unmap address range 0x%" __PRIvaddr
+			 "-0x%" __PRIvaddr ": %d", vbase,
+			 vbase + PAGE_LARGE_SIZE, rc);
+
+	rc = ukplat_page_map(pt, vbase, paddr, 1, vma->attr,
+			     PAGE_FLAG_SIZE(PAGE_LARGE_LEVEL) |
+			     PAGE_FLAG_FORCE_SIZE);
+	if (unlikely(rc))
+		UK_CRASH("Failed to map large page at 0x%" __PRIvaddr ": %d",
+			 vbase, rc);
+}
+#endif /* CONFIG_LIBUKVMEM_ANON_LARGE_PAGES && PAGE_LARGE_LEVEL */
+
 int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 {
-	const unsigned int demand_lvl =
+	unsigned int demand_lvl =
 		PAGE_SHIFT_Lx(CONFIG_LIBUKVMEM_DEMAND_PAGE_IN_SIZE);
 	struct uk_vas *vas;
 	struct uk_pagetable *pt;
@@ -1070,6 +1362,11 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 	UK_ASSERT(ctx.vma->vas->pt);
 	pt = ctx.vma->vas->pt;
 
+#if defined(CONFIG_LIBUKVMEM_ANON_LARGE_PAGES) && defined(PAGE_LARGE_LEVEL)
+	if (vmem_vma_large_pages(ctx.vma))
+		demand_lvl = MAX(demand_lvl, (unsigned int)PAGE_LARGE_LEVEL);
+#endif /* CONFIG_LIBUKVMEM_ANON_LARGE_PAGES && PAGE_LARGE_LEVEL */
+
 	/* Find the page level at which we want to page-in. If the VMA does not
 	 * enforce a specific page size and the configuration allows to page-in
 	 * large pages, we first check up to which level we find page tables.
@@ -1092,15 +1389,33 @@ int vmem_pagefault(__vaddr_t vaddr, unsigned int type, struct __regs *regs)
 		flags = 0;
 	}
 
-	vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+	if (lvl > PAGE_LEVEL) {
+		vbase = PAGE_Lx_ALIGN_DOWN(vaddr, lvl);
+
+		UK_ASSERT(vbase >= ctx.vma->start &&
+			  vbase < ctx.vma->end);
+		UK_ASSERT(vbase <= __VADDR_MAX - PAGE_Lx_SIZE(lvl));
+		UK_ASSERT(vbase + PAGE_Lx_SIZE(lvl) >= ctx.vma->start &&
+			  vbase + PAGE_Lx_SIZE(lvl) <= ctx.vma->end);
+
+		rc = ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
+				      PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+
+		/* Large pages for VMAs without a page size preference are
+		 * opportunistic. Fall back to base pages if there is not
+		 * enough contiguous physical memory.
+		 */
+		if (rc != -ENOMEM || ctx.vma->page_lvl >= 0)
+			return rc;
+	}
+
+	rc = vmem_pagefault_around(pt, ctx.vma, vaddr, &mapx);
 
-	UK_ASSERT(vbase >= ctx.vma->start &&
-		  vbase < ctx.vma->end);
-	UK_ASSERT(vbase <= __VADDR_MAX - PAGE_Lx_SIZE(lvl));
-	UK_ASSERT(vbase + PAGE_Lx_SIZE(lvl) >= ctx.vma->start &&
-		  vbase + PAGE_Lx_SIZE(lvl) <= ctx.vma->end);
+#if defined(CONFIG_LIBUKVMEM_ANON_LARGE_PAGES) && defined(PAGE_LARGE_LEVEL)
+	if (rc == 0 && vmem_vma_large_pages(ctx.vma))
+		vmem_vma_collapse(ctx.vma, vaddr);
+#endif /* CONFIG_LIBUKVMEM_ANON_LARGE_PAGES && PAGE_LARGE_LEVEL */
 
-	return ukplat_page_mapx(pt, vbase, 0, 1, ctx.vma->attr,
-				PAGE_FLAG_SIZE(lvl) | flags, &mapx);
+	return rc;
 }
 #endif /* CONFIG_HAVE_PAGING */
@@ -38,37 +38,56 @@
 #include <uk/list.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
+#include <vfscore/pagecache.h>
 #include <uk/mutex.h>
+#include <uk/rwlock.h>
+#include <uk/rcu.h>
+#include "htable.h"
 #include "vfs.h"
 
-#define DENTRY_BUCKETS 32
+/*
+ * The hash table is changed under the write lock. Lookups traverse it
+ * without locks within an RCU read-side critical section, so dentries are
+ * freed only after a grace period.
+ */
+static struct vfscore_htable dentry_table;
+static struct uk_rwlock dentry_hash_lock =
+	UK_RWLOCK_INITIALIZER(dentry_hash_lock);
 
-static struct uk_hlist_head dentry_hash_table[DENTRY_BUCKETS];
-static UK_HLIST_HEAD(fake);
-static struct uk_mutex dentry_hash_lock = UK_MUTEX_INITIALIZER(dentry_hash_lock);
+/*
+ * Dentries that are not referenced anymore stay in the hash table, so that
+ * looking up the same path again does not go to the file system. They are
+ * kept on the LRU list, most recently used first, and reclaimed when there
+ * are more than CONFIG_LIBVFSCORE_DENTRY_CACHE of them, when memory runs
+ * out, or when their file system is unmounted.
+ *
+ * An unused dentry has a reference count of 0. A lookup can take it back
+ * into use, unless the reclaimer set the count to -1 before.
+ */
+static UK_LIST_HEAD(dentry_lru);
+static unsigned long dentry_nr_unused;
+static struct uk_mutex dentry_lru_lock = UK_MUTEX_INITIALIZER(dentry_lru_lock);
+
+static void dentry_put(struct dentry *dp, struct uk_list_head *victims);
 
 /*
  * Get the hash value from the mount point and path name.
- * XXX: replace with a better hash for 64-bit pointers.
  */
-static unsigned int
+static unsigned long
 dentry_hash(struct mount *mp, const char *path)
 {
-	unsigned int val = 0;
-
-	if (path) {
-		while (*path) {
-			val = ((val << 5) + val) + *path++;
-		}
-	}
-	return (val ^ (unsigned long) mp) & (DENTRY_BUCKETS - 1);
+	return vfscore_hash_str(path, vfscore_hash_ptr(mp));
 }
 
+static unsigned long
+dentry_node_hash(struct uk_hlist_node *n)
+{
+	return uk_hlist_entry(n, struct dentry, d_link)->d_hash;
+}
 
-struct dentry *
-dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
+static struct dentry *
+dentry_new(const char *path)
 {
-	struct mount *mp = vp->v_mount;
 	struct dentry *dp = (struct dentry*)calloc(sizeof(*dp), 1);
 
 	if (!dp) {
@@ -80,13 +99,31 @@ dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
 		free(dp);
 		return NULL;
 	}
+	return dp;
+}
+
+struct dentry *
+dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
+{
+	struct mount *mp = vp->v_mount;
+	struct dentry *dp = dentry_new(path);
+
+	if (!dp) {
+		// Make room by dropping the unused dentries, then retry.
+		dentry_reclaim(NULL);
+		dp = dentry_new(path);
+		if (!dp)
+			return NULL;
+	}
 
 	vref(vp);
 
 	dp->d_refcnt = 1;
 	dp->d_vnode = vp;
 	dp->d_mount = mp;
+	dp->d_hash = dentry_hash(mp, path);
 	UK_INIT_LIST_HEAD(&dp->d_child_list);
+	UK_INIT_LIST_HEAD(&dp->d_lru);
 
 	if (parent_dp) {
 		dref(parent_dp);
@@ -100,30 +137,121 @@ dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path)
 
 	vn_add_name(vp, dp);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_add_head(&dp->d_link,
-			  &dentry_hash_table[dentry_hash(mp, path)]);
-	uk_mutex_unlock(&dentry_hash_lock);
+	uk_rwlock_wlock(&dentry_hash_lock);
+	vfscore_htable_add(&dentry_table, &dp->d_link, dp->d_hash);
+	uk_rwlock_wunlock(&dentry_hash_lock);
 	return dp;
 };
 
+/*
+ * Take a reference unless the dentry is being reclaimed.
+ * Returns the previous reference count, or -1.
+ */
+static int
+dentry_tryref(struct dentry *dp)
+{
+	int refcnt;
+
+	do {
+		refcnt = ukarch_load_n(&dp->d_refcnt);
+		if (refcnt < 0)
+			return -1;
+	} while (ukarch_compare_exchange_sync(&dp->d_refcnt, refcnt,
+					      refcnt + 1) != refcnt + 1);
+	return refcnt;
+}
+
+/*
+ * Take a dentry that dentry_tryref() revived off the LRU list, unless the
+ * reclaimer did so already.
+ */
+static void
+dentry_lru_del(struct dentry *dp)
+{
+	uk_mutex_lock(&dentry_lru_lock);
+	if (!uk_list_empty(&dp->d_lru)) {
+		uk_list_del_init(&dp->d_lru);
+		dentry_nr_unused--;
+	}
+	uk_mutex_unlock(&dentry_lru_lock);
+}
+
+static struct dentry *
+dentry_find(struct uk_hlist_head *head, unsigned long hash,
+	    struct mount *mp, const char *path, int *refcnt)
+{
+	struct dentry *dp;
+
+	if (!head)
+		return NULL;
+
+	uk_hlist_for_each_entry_rcu(dp, head, d_link) {
+		if (dp->d_hash != hash || dp->d_mount != mp)
+			continue;
+		if (strncmp(uk_rcu_dereference(dp->d_path), path, PATH_MAX))
+			continue;
+
+		*refcnt = dentry_tryref(dp);
+		if (*refcnt >= 0)
+			return dp;
+	}
+	return NULL;
+}
+
+/*
+ * Search the buckets that are being migrated as well as the current ones
+ */
+static struct dentry *
+dentry_find_all(unsigned long hash, struct mount *mp, const char *path,
+		int *refcnt)
+{
+	struct vfscore_htable_buckets *cur, *old;
+	struct dentry *dp;
+
+	cur = uk_rcu_dereference(dentry_table.cur);
+	old = uk_rcu_dereference(dentry_table.old);
+
+	dp = dentry_find(vfscore_htable_head(cur, hash), hash, mp, path,
+			 refcnt);
+	if (!dp)
+		dp = dentry_find(vfscore_htable_head(old, hash), hash, mp,
+				 path, refcnt);
+	return dp;
+}
+
 struct dentry *
 dentry_lookup(struct mount *mp, char *path)
 {
+	unsigned long hash = dentry_hash(mp, path);
 	struct dentry *dp;
+	int refcnt;
 
-	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_for_each_entry(dp, &dentry_hash_table[dentry_hash(mp, path)], d_link) {
-		if (dp->d_mount == mp && !strncmp(dp->d_path, path, PATH_MAX)) {
-			dp->d_refcnt++;
-			uk_mutex_unlock(&dentry_hash_lock);
-			return dp;
-		}
+	uk_rcu_read_lock();
+	dp = dentry_find_all(hash, mp, path, &refcnt);
+	uk_rcu_read_unlock();
+
+	/*
+	 * A dentry that is moved to another bucket at the same time can
+	 * take the lock-free traversal along with it. Make sure with the
+	 * lock before reporting a miss.
+	 */
+	if (!dp) {
+		uk_rwlock_rlock(&dentry_hash_lock);
+		dp = dentry_find_all(hash, mp, path, &refcnt);
+		uk_rwlock_runlock(&dentry_hash_lock);
 	}
-	uk_mutex_unlock(&dentry_hash_lock);
-	return NULL;                /* not found */
+
+	if (dp && refcnt == 0)
+		dentry_lru_del(dp);
+	return dp;
 }
 
+/*
+ * Remove the descendants of a dentry from the hashtable, their paths are
+ * outdated.
+ *
+ * Locking: dentry_hash_lock must be held for writing.
+ */
 static void dentry_children_remove(struct dentry *dp)
 {
 	struct dentry *entry = NULL;
@@ -131,8 +259,8 @@ static void dentry_children_remove(struct dentry *dp)
 	uk_mutex_lock(&dp->d_lock);
 	uk_list_for_each_entry(entry, &dp->d_child_list, d_child_link) {
 		UK_ASSERT(entry);
-		UK_ASSERT(entry->d_refcnt > 0);
-		uk_hlist_del(&entry->d_link);
+		vfscore_htable_del(&dentry_table, &entry->d_link);
+		dentry_children_remove(entry);
 	}
 	uk_mutex_unlock(&dp->d_lock);
 
@@ -166,24 +294,26 @@ dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path)
 		uk_mutex_unlock(&parent_dp->d_lock);
 	}
 
-	uk_mutex_lock(&dentry_hash_lock);
-	// Remove all dp's child dentries from the hashtable.
+	uk_rwlock_wlock(&dentry_hash_lock);
+	// Remove all dp's descendant dentries from the hashtable.
 	dentry_children_remove(dp);
 	// Remove dp with outdated hash info from the hashtable.
-	uk_hlist_del(&dp->d_link);
+	vfscore_htable_del(&dentry_table, &dp->d_link);
 	// Update dp.
-	dp->d_path = new_path;
+	uk_rcu_assign_pointer(dp->d_path, new_path);
+	dp->d_hash = dentry_hash(dp->d_mount, path);
 
 	dp->d_parent = parent_dp;
 	// Insert dp updated hash info into the hashtable.
-	uk_hlist_add_head(&dp->d_link,
-			  &dentry_hash_table[dentry_hash(dp->d_mount, path)]);
-	uk_mutex_unlock(&dentry_hash_lock);
+	vfscore_htable_add(&dentry_table, &dp->d_link, dp->d_hash);
+	uk_rwlock_wunlock(&dentry_hash_lock);
 
 	if (old_pdp) {
 		drele(old_pdp);
 	}
 
+	// Lock-free lookups may still compare against the old path.
+	uk_rcu_synchronize();
 	free(old_path);
 	return 0;
 }
@@ -191,11 +321,9 @@ dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path)
 void
 dentry_remove(struct dentry *dp)
 {
-	uk_mutex_lock(&dentry_hash_lock);
-	uk_hlist_del(&dp->d_link);
-	/* put it on a fake list for drele() to work*/
-	uk_hlist_add_head(&dp->d_link, &fake);
-	uk_mutex_unlock(&dentry_hash_lock);
+	uk_rwlock_wlock(&dentry_hash_lock);
+	vfscore_htable_del(&dentry_table, &dp->d_link);
+	uk_rwlock_wunlock(&dentry_hash_lock);
 }
 
 void
@@ -204,26 +332,31 @@ dref(struct dentry *dp)
 	UK_ASSERT(dp);
 	UK_ASSERT(dp->d_refcnt > 0);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	dp->d_refcnt++;
-	uk_mutex_unlock(&dentry_hash_lock);
+	ukarch_inc(&dp->d_refcnt);
 }
 
-void
-drele(struct dentry *dp)
+static void
+dentry_free(struct uk_rcu_head *head)
 {
-	UK_ASSERT(dp);
-	UK_ASSERT(dp->d_refcnt > 0);
+	struct dentry *dp = __containerof(head, struct dentry, d_rcu);
 
-	uk_mutex_lock(&dentry_hash_lock);
-	if (--dp->d_refcnt) {
-		uk_mutex_unlock(&dentry_hash_lock);
-		return;
-	}
-	uk_hlist_del(&dp->d_link);
-	vn_del_name(dp->d_vnode, dp);
+	free(dp->d_path);
+	free(dp);
+}
 
-	uk_mutex_unlock(&dentry_hash_lock);
+/*
+ * Release a dentry with a reference count of -1. Its parent may become
+ * unused in turn, and is added to `victims` if it cannot be cached.
+ */
+static void
+dentry_kill(struct dentry *dp, struct uk_list_head *victims)
+{
+	UK_ASSERT(dp->d_refcnt == -1);
+
+	uk_rwlock_wlock(&dentry_hash_lock);
+	vfscore_htable_del(&dentry_table, &dp->d_link);
+	vn_del_name(dp->d_vnode, dp);
+	uk_rwlock_wunlock(&dentry_hash_lock);
 
 	if (dp->d_parent) {
 		uk_mutex_lock(&dp->d_parent->d_lock);
@@ -231,21 +364,161 @@ drele(struct dentry *dp)
 		uk_list_del(&dp->d_child_link);
 		uk_mutex_unlock(&dp->d_parent->d_lock);
 
-		drele(dp->d_parent);
+		dentry_put(dp->d_parent, victims);
 	}
 
 	vrele(dp->d_vnode);
 
-	free(dp->d_path);
-	free(dp);
+	uk_rcu_call(&dp->d_rcu, dentry_free);
 }
 
-void
-dentry_init(void)
+/*
+ * Release the dentries on `victims`, and the parents that go with them.
+ * This is a loop rather than a recursion, so that the stack does not grow
+ * with the depth of the path.
+ */
+static void
+dentry_kill_all(struct uk_list_head *victims)
 {
-	int i;
+	struct dentry *dp;
+
+	while (!uk_list_empty(victims)) {
+		dp = uk_list_first_entry(victims, struct dentry, d_lru);
+		uk_list_del_init(&dp->d_lru);
+		dentry_kill(dp, victims);
+	}
+}
+
+/*
+ * Take up to `nr` unused dentries of `mp`, or of any mount point if `mp` is
+ * NULL, off the LRU list and move them to `victims`, least recently used
+ * first. Returns the number of dentries that were taken.
+ *
+ * Locking: dentry_lru_lock must be held.
+ */
+static unsigned long
+dentry_lru_isolate(struct mount *mp, unsigned long nr,
+		   struct uk_list_head *victims)
+{
+	struct dentry *dp, *tmp;
+	unsigned long n = 0;
+
+	uk_list_for_each_entry_safe_reverse(dp, tmp, &dentry_lru, d_lru) {
+		if (n == nr)
+			break;
+		if (mp && dp->d_mount != mp)
+			continue;
+
+		uk_list_del_init(&dp->d_lru);
+		dentry_nr_unused--;
+
+		// A lookup took it back into use; it is not unused anymore.
+		if (ukarch_compare_exchange_sync(&dp->d_refcnt, 0, -1) != -1)
+			continue;
 
-	for (i = 0; i < DENTRY_BUCKETS; i++) {
-		UK_INIT_HLIST_HEAD(&dentry_hash_table[i]);
+		uk_list_add_tail(&dp->d_lru, victims);
+		n++;
 	}
+	return n;
+}
+
+/*
+ * Drop the last reference. Returns 0 if somebody else took a reference in
+ * the meantime.
+ */
+static int
+dentry_put_last(struct dentry *dp, struct uk_list_head *victims)
+{
+	int refcnt;
+
+	/*
+	 * Only dentries that lookups can find are worth keeping: Mount roots
+	 * and the dentries of anonymous files have no parent. Unused dentries
+	 * keep their vnode, so files with dirty cached data are released to
+	 * write it back.
+	 */
+	if (CONFIG_LIBVFSCORE_DENTRY_CACHE > 0 && dp->d_parent &&
+	    !uk_hlist_unhashed(&dp->d_link) &&
+	    !vfscore_pcache_dirty(dp->d_vnode))
+		refcnt = 0;
+	else
+		refcnt = -1;
+
+	uk_mutex_lock(&dentry_lru_lock);
+	if (ukarch_compare_exchange_sync(&dp->d_refcnt, 1, refcnt) != refcnt) {
+		uk_mutex_unlock(&dentry_lru_lock);
+		return 0;
+	}
+
+	UK_ASSERT(uk_list_empty(&dp->d_lru));
+	if (refcnt < 0) {
+		uk_mutex_unlock(&dentry_lru_lock);
+		uk_list_add_tail(&dp->d_lru, victims);
+		return 1;
+	}
+
+	uk_list_add(&dp->d_lru, &dentry_lru);
+	dentry_nr_unused++;
+	if (dentry_nr_unused > CONFIG_LIBVFSCORE_DENTRY_CACHE)
+		dentry_lru_isolate(NULL, dentry_nr_unused -
+				   CONFIG_LIBVFSCORE_DENTRY_CACHE, victims);
+	uk_mutex_unlock(&dentry_lru_lock);
+	return 1;
+}
+
+static void
+dentry_put(struct dentry *dp, struct uk_list_head *victims)
+{
+	int refcnt;
+
+	UK_ASSERT(dp);
+
+	for (;;) {
+		refcnt = ukarch_load_n(&dp->d_refcnt);
+		UK_ASSERT(refcnt > 0);
+
+		if (refcnt == 1) {
+			if (dentry_put_last(dp, victims))
+				return;
+		} else if (ukarch_compare_exchange_sync(&dp->d_refcnt, refcnt,
+							refcnt - 1) ==
+			   refcnt - 1) {
+			return;
+		}
+	}
+}
+
+void
+drele(struct dentry *dp)
+{
+	UK_LIST_HEAD(victims);
+
+	dentry_put(dp, &victims);
+	dentry_kill_all(&victims);
+}
+
+/*
+ * Release the unused dentries of a mount point, e.g., before it is
+ * unmounted, or all of them if `mp` is NULL.
+ */
+void
+dentry_reclaim(struct mount *mp)
+{
+	UK_LIST_HEAD(victims);
+	unsigned long n;
+
+	// Releasing a dentry can make its parent unused
+	do {
+		uk_mutex_lock(&dentry_lru_lock);
+		n = dentry_lru_isolate(mp, ULONG_MAX, &victims);
+		uk_mutex_unlock(&dentry_lru_lock);
+
+		dentry_kill_all(&victims);
+	} while (n);
+}
+
+void
+dentry_init(void)
+{
+	vfscore_htable_init(&dentry_table, dentry_node_hash);
 }
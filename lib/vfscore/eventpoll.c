@@ -35,6 +35,7 @@
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
 #include <uk/essentials.h>
+#include <uk/plat/spinlock.h>
 #include <uk/plat/time.h>
 #include <uk/print.h>
 #include <uk/list.h>
@@ -45,6 +46,10 @@
 
 #define EPERR_SET (EPOLLERR | EPOLLHUP | EPOLLNVAL)
 
+/* Events that can be combined with EPOLLEXCLUSIVE */
+#define EPEXCL_SET (EPOLLIN | EPOLLOUT | EPOLLWAKEUP | EPOLLET | \
+		    EPOLLEXCLUSIVE | EPERR_SET)
+
 UK_TRACEPOINT(trace_ep_wait, "%p %p", void *, void *);
 UK_TRACEPOINT(trace_ep_wakeup, "%p %p %u", void *, void *, unsigned int);
 
@@ -81,18 +86,30 @@ void eventpoll_fini(struct eventpoll *ep)
 	}
 
 	UK_ASSERT(uk_list_empty(&ep->fd_list));
+
+	if (ep->fd_htable != ep->fd_htable_init) {
+		UK_ASSERT(ep->a);
+		uk_free(ep->a, ep->fd_htable);
+		ep->fd_htable = ep->fd_htable_init;
+	}
+}
+
+/* fds are small and densely allocated integers, so the lower bits of the fd
+ * are a good hash
+ */
+static inline struct uk_hlist_head *efd_bucket(struct eventpoll *ep, int fd)
+{
+	return &ep->fd_htable[(unsigned int)fd &
+			      ((1U << ep->fd_htable_order) - 1)];
 }
 
 static struct eventpoll_fd *efd_find(struct eventpoll *ep, int fd)
 {
 	struct eventpoll_fd *efd;
-	struct uk_list_head *itr;
 
 	UK_ASSERT(ep);
 
-	uk_list_for_each(itr, &ep->fd_list) {
-		efd = uk_list_entry(itr, struct eventpoll_fd, fd_link);
-
+	uk_hlist_for_each_entry(efd, efd_bucket(ep, fd), fd_hlink) {
 		if (efd->fd == fd)
 			return efd;
 	}
@@ -100,6 +117,59 @@ static struct eventpoll_fd *efd_find(struct eventpoll *ep, int fd)
 	return NULL;
 }
 
+/* Double the size of the fd hash table if the load factor exceeds 1. If we
+ * cannot allocate a bigger table we continue with the current one.
+ */
+static void efd_htable_grow(struct eventpoll *ep)
+{
+	struct uk_hlist_head *htable;
+	struct eventpoll_fd *efd;
+	struct uk_list_head *itr;
+	unsigned int order, i;
+
+	if (ep->fd_count <= (1U << ep->fd_htable_order) || !ep->a)
+		return;
+
+	order = ep->fd_htable_order + 1;
+	htable = uk_malloc(ep->a, sizeof(*htable) << order);
+	if (unlikely(!htable))
+		return;
+
+	for (i = 0; i < (1U << order); i++)
+		UK_INIT_HLIST_HEAD(&htable[i]);
+
+	if (ep->fd_htable != ep->fd_htable_init)
+		uk_free(ep->a, ep->fd_htable);
+
+	ep->fd_htable = htable;
+	ep->fd_htable_order = order;
+
+	uk_list_for_each(itr, &ep->fd_list) {
+		efd = uk_list_entry(itr, struct eventpoll_fd, fd_link);
+		uk_hlist_add_head(&efd->fd_hlink, efd_bucket(ep, efd->fd));
+	}
+}
+
+/* Push an fd with pending events to the triggered list. Returns non-zero if
+ * waiters should be woken up.
+ */
+static int efd_trigger(struct eventpoll *ep, struct eventpoll_fd *efd,
+		       unsigned int revents)
+{
+	unsigned long flags;
+
+	if (!revents)
+		return 0;
+
+	ukplat_spin_lock_irqsave(&ep->tr_lock, flags);
+	efd->revents |= revents;
+	if (uk_list_empty(&efd->tr_link))
+		uk_list_add_tail(&efd->tr_link, &ep->tr_list);
+	ukplat_spin_unlock_irqrestore(&ep->tr_lock, flags);
+
+	return 1;
+}
+
 static int efd_poll(struct eventpoll_fd *efd, unsigned int *revents)
 {
 	struct vnode *vnode;
@@ -143,6 +213,9 @@ void eventpoll_add_unsafe(struct eventpoll *ep, struct eventpoll_fd *efd)
 
 	uk_list_add_tail(&efd->f_link, &efd->vfs_file->f_ep);
 	uk_list_add_tail(&efd->fd_link, &ep->fd_list);
+	uk_hlist_add_head(&efd->fd_hlink, efd_bucket(ep, efd->fd));
+	ep->fd_count++;
+	efd_htable_grow(ep);
 
 	trace_efd_add(ep, efd->fd, efd->vfs_file->f_dentry->d_vnode->v_type);
 }
@@ -160,6 +233,10 @@ int eventpoll_add(struct eventpoll *ep, int fd, struct vfscore_file *fp,
 	if (unlikely(!event))
 		return -EINVAL;
 
+	if (unlikely((event->events & EPOLLEXCLUSIVE) &&
+		     (event->events & ~EPEXCL_SET)))
+		return -EINVAL;
+
 	/* Allocate and initialize a new eventpoll fd
 	 *
 	 * TODO:
@@ -201,13 +278,8 @@ int eventpoll_add(struct eventpoll *ep, int fd, struct vfscore_file *fp,
 	eventpoll_add_unsafe(ep, efd);
 
 	/* We also have to wake up any waiters if the fd is already ready */
-	if (revents & efd->event.events) {
-		trace_efd_signal(ep, efd->fd, revents,
-				 revents & efd->event.events);
-
-		if (uk_list_empty(&efd->tr_link))
-			uk_list_add_tail(&efd->tr_link, &ep->tr_list);
-
+	if (efd_trigger(ep, efd, revents)) {
+		trace_efd_signal(ep, efd->fd, revents, revents);
 		uk_waitq_wake_up(&ep->wq);
 	}
 
@@ -230,6 +302,10 @@ int eventpoll_mod(struct eventpoll *ep, int fd, const struct epoll_event *event)
 	if (unlikely(!event))
 		return -EINVAL;
 
+	/* EPOLLEXCLUSIVE can only be set with EPOLL_CTL_ADD */
+	if (unlikely(event->events & EPOLLEXCLUSIVE))
+		return -EINVAL;
+
 	uk_mutex_lock(&ep->fd_lock);
 
 	efd = efd_find(ep, fd);
@@ -238,6 +314,11 @@ int eventpoll_mod(struct eventpoll *ep, int fd, const struct epoll_event *event)
 		goto EXIT;
 	}
 
+	if (unlikely(efd->event.events & EPOLLEXCLUSIVE)) {
+		ret = -EINVAL;
+		goto EXIT;
+	}
+
 	efd->event = *event;
 
 	/* We need to poll the fd here to check if the new configuration
@@ -248,13 +329,8 @@ int eventpoll_mod(struct eventpoll *ep, int fd, const struct epoll_event *event)
 	if (unlikely(ret))
 		goto EXIT;
 
-	if (revents & efd->event.events) {
-		trace_efd_signal(ep, efd->fd, revents,
-				 revents & efd->event.events);
-
-		if (uk_list_empty(&efd->tr_link))
-			uk_list_add_tail(&efd->tr_link, &ep->tr_list);
-
+	if (efd_trigger(ep, efd, revents)) {
+		trace_efd_signal(ep, efd->fd, revents, revents);
 		uk_waitq_wake_up(&ep->wq);
 	}
 
@@ -265,6 +341,8 @@ EXIT:
 
 void eventpoll_del_unsafe(struct eventpoll_fd *efd)
 {
+	unsigned long flags;
+
 	UK_ASSERT(efd);
 	UK_ASSERT(efd->ep);
 	UK_ASSERT(!uk_list_empty(&efd->fd_link));
@@ -274,8 +352,13 @@ void eventpoll_del_unsafe(struct eventpoll_fd *efd)
 		efd->cb.unregister(&efd->cb);
 
 	uk_list_del(&efd->f_link);
-	uk_list_del(&efd->tr_link);
 	uk_list_del(&efd->fd_link);
+	uk_hlist_del(&efd->fd_hlink);
+	efd->ep->fd_count--;
+
+	ukplat_spin_lock_irqsave(&efd->ep->tr_lock, flags);
+	uk_list_del(&efd->tr_link);
+	ukplat_spin_unlock_irqrestore(&efd->ep->tr_lock, flags);
 
 	trace_efd_del(efd->ep, efd->fd);
 
@@ -351,8 +434,9 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 		   int maxevents, const __nsec *timeout)
 {
 	struct eventpoll_fd *efd;
-	struct uk_list_head *itr, *tmp;
-	unsigned int revents = 0;
+	struct uk_list_head ready;
+	unsigned int revents = 0, pending;
+	unsigned long flags;
 	__nsec deadline;
 	int timedout;
 	int ret, n = 0;
@@ -366,49 +450,70 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 	for (;;) {
 		UK_ASSERT(n == 0);
 
-		/* Find triggered fds and poll their state. We have to redo
-		 * the poll although the fd is already in the triggered list
-		 * because the condition could have changed in the meantime.
-		 * For instance, if the fd is level-triggered, we keep it
-		 * in the triggered list because we don't know if the caller
-		 * will actually perform the available operations (e.g., read
-		 * _all_ pending data). So we poll the fd again to determine if
-		 * the state has changed. If the fd is not actually ready, we
-		 * remove it from the list. It is then added to the list again
-		 * in two cases:
-		 *   1) the fd is ready during eventpoll_mod
-		 *   2) the driver signals an event
+		/* Take over the triggered list so that drivers can keep on
+		 * signaling while we process the fds. Only fds in the
+		 * triggered list are looked at, so the costs of a wait do not
+		 * depend on the number of monitored fds.
 		 */
-		uk_list_for_each_safe(itr, tmp, &ep->tr_list) {
-			efd = uk_list_entry(itr, struct eventpoll_fd, tr_link);
-
-			if (n == maxevents)
-				break;
-
-			ret = efd_poll(efd, &revents);
-			if (unlikely(ret))
-				revents = EPOLLERR;
-
-			if (revents) {
-				UK_ASSERT(events);
-
-				events[n].events = (uint32_t)revents;
-				events[n].data = efd->event.data;
-				n++;
-
-				/* If the fd is edge-triggered we remove the fd
-				 * from the triggered list
+		UK_INIT_LIST_HEAD(&ready);
+		ukplat_spin_lock_irqsave(&ep->tr_lock, flags);
+		uk_list_splice_init(&ep->tr_list, &ready);
+		ukplat_spin_unlock_irqrestore(&ep->tr_lock, flags);
+
+		while (n < maxevents && !uk_list_empty(&ready)) {
+			efd = uk_list_entry(ready.next, struct eventpoll_fd,
+					    tr_link);
+
+			ukplat_spin_lock_irqsave(&ep->tr_lock, flags);
+			uk_list_del_init(&efd->tr_link);
+			pending = efd->revents;
+			efd->revents = 0;
+			ukplat_spin_unlock_irqrestore(&ep->tr_lock, flags);
+
+			if (efd->event.events & EPOLLET) {
+				/* For edge-triggered fds, we report the events
+				 * that the driver pushed since the last report.
+				 * New edges put the fd into the list again.
 				 */
-				if (efd->event.events & EPOLLET)
-					uk_list_del_init(&efd->tr_link);
+				revents = pending &
+					  ((unsigned int)efd->event.events |
+					   EPERR_SET);
 			} else {
-				/* The fd is not actually ready so remove it
-				 * from the triggered list
+				/* Level-triggered fds stay in the triggered
+				 * list as long as they are ready because we
+				 * don't know if the caller will actually
+				 * perform the available operations (e.g.,
+				 * read _all_ pending data). So we poll the fd
+				 * again to determine if the state has changed.
+				 * If the fd is not actually ready, it drops
+				 * out of the list. It is then added to the
+				 * list again in two cases:
+				 *   1) the fd is ready during eventpoll_mod
+				 *   2) the driver signals an event
 				 */
-				uk_list_del_init(&efd->tr_link);
+				ret = efd_poll(efd, &revents);
+				if (unlikely(ret))
+					revents = EPOLLERR;
 			}
+
+			if (!revents)
+				continue;
+
+			UK_ASSERT(events);
+
+			events[n].events = (uint32_t)revents;
+			events[n].data = efd->event.data;
+			n++;
+
+			if (!(efd->event.events & EPOLLET))
+				efd_trigger(ep, efd, revents);
 		}
 
+		/* Return unprocessed fds to the front of the list */
+		ukplat_spin_lock_irqsave(&ep->tr_lock, flags);
+		uk_list_splice(&ready, &ep->tr_list);
+		ukplat_spin_unlock_irqrestore(&ep->tr_lock, flags);
+
 		if (n > 0)
 			break;
 
@@ -430,7 +535,11 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 	return n;
 }
 
-void eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents)
+/* Queues the events on the eventpoll of the context block. Returns the
+ * eventpoll if waiters need to be woken up, NULL otherwise.
+ */
+static struct eventpoll *ecb_trigger(struct eventpoll_cb *ecb,
+				     unsigned int revents)
 {
 	struct eventpoll *ep;
 	struct eventpoll_fd *efd;
@@ -444,16 +553,59 @@ void eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents)
 
 	filtered = revents & ((unsigned int)efd->event.events | EPERR_SET);
 
-	uk_mutex_lock(&ep->fd_lock);
-
 	trace_efd_signal(ep, efd->fd, revents, filtered);
 
-	if (filtered) {
-		if (uk_list_empty(&efd->tr_link))
-			uk_list_add_tail(&efd->tr_link, &ep->tr_list);
+	return efd_trigger(ep, efd, filtered) ? ep : NULL;
+}
 
-		uk_waitq_wake_up(&ep->wq);
-	}
+static inline int ecb_exclusive(struct eventpoll_cb *ecb)
+{
+	struct eventpoll_fd *efd;
 
-	uk_mutex_unlock(&ep->fd_lock);
+	efd = __containerof(ecb, struct eventpoll_fd, cb);
+	return !!(efd->event.events & EPOLLEXCLUSIVE);
+}
+
+int eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents)
+{
+	struct eventpoll *ep;
+
+	ep = ecb_trigger(ecb, revents);
+	if (!ep)
+		return 0;
+
+	if (ecb_exclusive(ecb))
+		return uk_waitq_wake_up_one(&ep->wq);
+
+	uk_waitq_wake_up(&ep->wq);
+	return 0;
+}
+
+void eventpoll_signal_list(struct uk_list_head *cb_list, unsigned int revents)
+{
+	struct eventpoll_cb *ecb;
+	struct eventpoll *ep;
+	struct uk_list_head *itr;
+	int exclusive_woken = 0;
+
+	UK_ASSERT(cb_list);
+
+	uk_list_for_each(itr, cb_list) {
+		ecb = uk_list_entry(itr, struct eventpoll_cb, cb_link);
+
+		UK_ASSERT(ecb->unregister);
+
+		/* The events are queued on every eventpoll, so that a later
+		 * epoll_wait() finds them. EPOLLEXCLUSIVE only limits the
+		 * number of waiters that are woken up.
+		 */
+		ep = ecb_trigger(ecb, revents);
+		if (!ep)
+			continue;
+
+		if (!ecb_exclusive(ecb))
+			uk_waitq_wake_up(&ep->wq);
+		else if (!exclusive_woken)
+			exclusive_woken = uk_waitq_wake_up_one(&ep->wq);
+	}
 }
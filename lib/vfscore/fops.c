@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <vfscore/file.h>
+#include <vfscore/pagecache.h>
 #include "vfs.h"
 
 #include <uk/assert.h>
@@ -71,7 +72,7 @@ int vfs_read(struct vfscore_file *fp, struct uio *uio, int flags)
 	if ((flags & FOF_OFFSET) == 0)
 		uio->uio_offset = fp->f_offset;
 
-	error = VOP_READ(vp, fp, uio, 0);
+	error = vfscore_pcache_read(vp, fp, uio, 0);
 	if (!error) {
 		count = bytes - uio->uio_resid;
 		if (((flags & FOF_OFFSET) == 0) &&
@@ -104,7 +105,7 @@ int vfs_write(struct vfscore_file *fp, struct uio *uio, int flags)
 	if ((flags & FOF_OFFSET) == 0)
 		uio->uio_offset = fp->f_offset;
 
-	error = VOP_WRITE(vp, uio, ioflags);
+	error = vfscore_pcache_write(vp, fp, uio, ioflags);
 	if (!error) {
 		count = bytes - uio->uio_resid;
 		if (!(flags & FOF_OFFSET) &&
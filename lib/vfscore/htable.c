@@ -0,0 +1,145 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <stdlib.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include "htable.h"
+
+/* Buckets of the old array that are moved with every update */
+#define HTABLE_MIGRATE_STEP	8
+
+void vfscore_htable_init(struct vfscore_htable *ht,
+			 unsigned long (*hash)(struct uk_hlist_node *n))
+{
+	unsigned long i;
+
+	UK_ASSERT(ht);
+	UK_ASSERT(hash);
+
+	ht->min.mask = ARRAY_SIZE(ht->min_head) - 1;
+	ht->min.head = ht->min_head;
+	for (i = 0; i < ARRAY_SIZE(ht->min_head); i++)
+		UK_INIT_HLIST_HEAD(&ht->min_head[i]);
+
+	ht->cur = &ht->min;
+	ht->old = NULL;
+	ht->migrated = 0;
+	ht->nr = 0;
+	ht->hash = hash;
+}
+
+static struct vfscore_htable_buckets *
+htable_alloc(struct vfscore_htable *ht, unsigned long size)
+{
+	struct vfscore_htable_buckets *b;
+	unsigned long i;
+
+	/* The initial buckets are unused when the table shrinks back to
+	 * them: Resizes do not overlap, so they are neither `cur` nor `old`
+	 */
+	if (size == ARRAY_SIZE(ht->min_head))
+		return &ht->min;
+
+	b = malloc(sizeof(*b) + size * sizeof(*b->head));
+	if (unlikely(!b))
+		return NULL;
+
+	b->mask = size - 1;
+	b->head = (struct uk_hlist_head *) (b + 1);
+	for (i = 0; i < size; i++)
+		UK_INIT_HLIST_HEAD(&b->head[i]);
+	return b;
+}
+
+static void htable_free(struct uk_rcu_head *head)
+{
+	free(__containerof(head, struct vfscore_htable_buckets, rcu));
+}
+
+/* Moves the entries of the next few buckets of `old` to `cur` */
+static void htable_migrate(struct vfscore_htable *ht)
+{
+	struct vfscore_htable_buckets *old = ht->old;
+	struct uk_hlist_head *h;
+	struct uk_hlist_node *n;
+	unsigned long hash;
+	unsigned int i;
+
+	for (i = 0; i < HTABLE_MIGRATE_STEP && ht->migrated <= old->mask;
+	     i++, ht->migrated++) {
+		h = &old->head[ht->migrated];
+		while ((n = h->first)) {
+			hash = ht->hash(n);
+			uk_hlist_del_init_rcu(n);
+			uk_hlist_add_head_rcu(n, vfscore_htable_head(ht->cur,
+								     hash));
+		}
+	}
+
+	if (ht->migrated <= old->mask)
+		return;
+
+	/* Lookups without the lock may still walk the old buckets */
+	uk_rcu_assign_pointer(ht->old, NULL);
+	if (old != &ht->min)
+		uk_rcu_call(&old->rcu, htable_free);
+}
+
+/* Starts a resize if the load factor leaves [1/8, 1], or continues one */
+static void htable_update(struct vfscore_htable *ht)
+{
+	struct vfscore_htable_buckets *b;
+	unsigned long size;
+
+	if (!ht->old) {
+		size = vfscore_htable_size(ht->cur);
+		if (ht->nr > size &&
+		    size < (1UL << VFSCORE_HTABLE_MAX_ORDER))
+			size <<= 1;
+		else if (ht->nr < size / 8 &&
+			 size > (1UL << VFSCORE_HTABLE_MIN_ORDER))
+			size >>= 1;
+		else
+			return;
+
+		/* Without memory, the current buckets have to do */
+		b = htable_alloc(ht, size);
+		if (unlikely(!b))
+			return;
+
+		ht->migrated = 0;
+		uk_rcu_assign_pointer(ht->old, ht->cur);
+		uk_rcu_assign_pointer(ht->cur, b);
+	}
+
+	htable_migrate(ht);
+}
+
+void vfscore_htable_add(struct vfscore_htable *ht, struct uk_hlist_node *n,
+			unsigned long hash)
+{
+	UK_ASSERT(ht);
+	UK_ASSERT(n);
+
+	ht->nr++;
+	htable_update(ht);
+	uk_hlist_add_head_rcu(n, vfscore_htable_head(ht->cur, hash));
+}
+
+void vfscore_htable_del(struct vfscore_htable *ht, struct uk_hlist_node *n)
+{
+	UK_ASSERT(ht);
+	UK_ASSERT(n);
+
+	if (uk_hlist_unhashed(n))
+		return;
+
+	uk_hlist_del_init_rcu(n);
+	UK_ASSERT(ht->nr > 0);
+	ht->nr--;
+	htable_update(ht);
+}
@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Hash tables that grow and shrink with the number of entries
+ *
+ * A resize allocates a new bucket array and moves the entries over from the
+ * old one a few buckets at a time, with every following insertion and
+ * removal. Until this is done, an entry may be in either array, so lookups
+ * search both. Updates must be serialized by the user of the table.
+ *
+ * Lookups may run without the lock in an RCU read-side critical section.
+ * Such a lookup can miss an entry that is moved at the same time, and has
+ * to be repeated under the lock before it reports a miss.
+ */
+
+#ifndef __VFSCORE_HTABLE_H__
+#define __VFSCORE_HTABLE_H__
+
+#include <stdint.h>
+#include <uk/list.h>
+#include <uk/rcu.h>
+
+/* Tables never have fewer buckets than this */
+#define VFSCORE_HTABLE_MIN_ORDER	5
+#define VFSCORE_HTABLE_MAX_ORDER	20
+
+struct vfscore_htable_buckets {
+	unsigned long mask;		/* number of buckets - 1 */
+	struct uk_hlist_head *head;
+	struct uk_rcu_head rcu;
+};
+
+struct vfscore_htable {
+	struct vfscore_htable_buckets *cur;
+	/* Buckets that are being moved to `cur`, or NULL */
+	struct vfscore_htable_buckets *old;
+	/* Buckets of `old` that are empty already */
+	unsigned long migrated;
+	unsigned long nr;		/* number of entries */
+	/* Returns the hash of an entry */
+	unsigned long (*hash)(struct uk_hlist_node *n);
+	/* Initial buckets, so that no allocation is needed before the
+	 * table grows the first time
+	 */
+	struct vfscore_htable_buckets min;
+	struct uk_hlist_head min_head[1UL << VFSCORE_HTABLE_MIN_ORDER];
+};
+
+void vfscore_htable_init(struct vfscore_htable *ht,
+			 unsigned long (*hash)(struct uk_hlist_node *n));
+
+/* Inserts `n` with the given hash. May start or continue a resize. */
+void vfscore_htable_add(struct vfscore_htable *ht, struct uk_hlist_node *n,
+			unsigned long hash);
+
+/* Removes `n` unless it is unhashed already */
+void vfscore_htable_del(struct vfscore_htable *ht, struct uk_hlist_node *n);
+
+/* Returns the bucket of `hash` in `b`, or NULL if `b` is NULL */
+static inline struct uk_hlist_head *
+vfscore_htable_head(struct vfscore_htable_buckets *b, unsigned long hash)
+{
+	return b ? &b->head[hash & b->mask] : NULL;
+}
+
+#define vfscore_htable_size(b)	((b) ? (b)->mask + 1 : 0)
+
+/* Finalizer of MurmurHash3, spreads every input bit over the whole word */
+static inline unsigned long vfscore_hash_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (unsigned long) h;
+}
+
+static inline unsigned long vfscore_hash_ptr(const void *p)
+{
+	return vfscore_hash_mix((uintptr_t) p);
+}
+
+/* FNV-1a of a string, mixed with `seed` */
+static inline unsigned long vfscore_hash_str(const char *s, uint64_t seed)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+
+	while (*s) {
+		h ^= (unsigned char) *s++;
+		h *= 0x100000001b3ULL;
+	}
+	return vfscore_hash_mix(h);
+}
+
+#endif /* __VFSCORE_HTABLE_H__ */
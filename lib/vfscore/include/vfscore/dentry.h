@@ -36,12 +36,14 @@
 
 #include <uk/mutex.h>
 #include <uk/list.h>
+#include <uk/rcu.h>
 
 struct vnode;
 
 struct dentry {
 	struct uk_hlist_node d_link;	/* link for hash list */
-	int		d_refcnt;	/* reference count */
+	unsigned long	d_hash;		/* hash of mount point and path */
+	int		d_refcnt;	/* reference count, 0 if unused */
 	char		*d_path;	/* pointer to path in fs */
 	struct vnode	*d_vnode;
 	struct mount	*d_mount;
@@ -50,12 +52,15 @@ struct dentry {
 	struct uk_mutex	d_lock;
 	struct uk_list_head d_child_list;
 	struct uk_list_head d_child_link;
+	struct uk_list_head d_lru;	/* link for list of unused dentries */
+	struct uk_rcu_head d_rcu;	/* deferred free */
 };
 
 struct dentry *dentry_alloc(struct dentry *parent_dp, struct vnode *vp, const char *path);
 struct dentry *dentry_lookup(struct mount *mp, char *path);
 int dentry_move(struct dentry *dp, struct dentry *parent_dp, char *path);
 void dentry_remove(struct dentry *dp);
+void dentry_reclaim(struct mount *mp);
 void dref(struct dentry *dp);
 void drele(struct dentry *dp);
 
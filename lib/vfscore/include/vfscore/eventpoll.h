@@ -112,12 +112,20 @@ struct eventpoll_fd {
 	/* Used to link into monitored fd list */
 	struct uk_list_head fd_link;
 
+	/* Used to link into the fd hash table of the eventpoll */
+	struct uk_hlist_node fd_hlink;
+
 	/* Used to link into triggered list which is scanned by
 	 * eventpoll_wait() to find pending events. Being in the list, does not
 	 * guarantee that events are still pending.
 	 */
 	struct uk_list_head tr_link;
 
+	/* Events signaled by the driver since the last eventpoll_wait() that
+	 * reported this fd. Protected by the tr_lock of the eventpoll.
+	 */
+	unsigned int revents;
+
 	/* Used to link into the file's epoll list so we are informed when
 	 * the file is closed.
 	 */
@@ -141,31 +149,41 @@ static inline void eventpoll_fd_init(struct eventpoll_fd *efd,
 
 	efd->ep = NULL;
 	efd->event = *event;
+	efd->revents = 0;
 
 	efd->cb.unregister = NULL;
 	efd->cb.data = NULL;
 	UK_INIT_LIST_HEAD(&efd->cb.cb_link);
 
 	UK_INIT_LIST_HEAD(&efd->fd_link);
+	UK_INIT_HLIST_NODE(&efd->fd_hlink);
 	UK_INIT_LIST_HEAD(&efd->tr_link);
 	UK_INIT_LIST_HEAD(&efd->f_link);
 }
 
+/* Number of fd hash buckets that are embedded into the eventpoll. The table
+ * grows with the number of monitored fds if the eventpoll has an allocator.
+ */
+#define EVENTPOLL_FD_HTABLE_INIT_ORDER	4
+
 /** Eventpoll main structure */
 struct eventpoll {
-	/* Lock to serialize operations on the fd and tr lists.
-	 * TODO: The single lock will be a bottleneck at some point if
-	 * we have many fds watched, signaled, and waited for. Add a separate
-	 * lock for the triggered list. We might also get into trouble if
-	 * a thread is blocked in eventpoll_signal() and eventpoll_signal()
-	 * is called from an IRQ handler. So the tr list should be protected
-	 * with a reader-writer spinlock.
-	 */
+	/* Lock to serialize operations on the fd list and hash table */
 	struct uk_mutex fd_lock;
 
 	/* List of monitored fds */
 	struct uk_list_head fd_list;
 
+	/* Hash table of monitored fds indexed by fd number */
+	struct uk_hlist_head *fd_htable;
+	unsigned int fd_htable_order;
+	unsigned int fd_count;
+
+	/* Lock for the triggered list and the pending events of the fds.
+	 * Drivers push fds into the list from eventpoll_signal().
+	 */
+	__spinlock tr_lock;
+
 	/* List of triggered fds */
 	struct uk_list_head tr_list;
 
@@ -174,10 +192,14 @@ struct eventpoll {
 
 	/* Optional allocator to use for add/del operations */
 	struct uk_alloc *a;
+
+	struct uk_hlist_head fd_htable_init[1 << EVENTPOLL_FD_HTABLE_INIT_ORDER];
 };
 
 static inline void eventpoll_init(struct eventpoll *ep, struct uk_alloc *a)
 {
+	unsigned int i;
+
 	UK_ASSERT(ep);
 
 	/* The allocator is optional (can be NULL) if only add/del_unsafe()
@@ -187,6 +209,14 @@ static inline void eventpoll_init(struct eventpoll *ep, struct uk_alloc *a)
 
 	uk_mutex_init(&ep->fd_lock);
 	UK_INIT_LIST_HEAD(&ep->fd_list);
+
+	for (i = 0; i < ARRAY_SIZE(ep->fd_htable_init); i++)
+		UK_INIT_HLIST_HEAD(&ep->fd_htable_init[i]);
+	ep->fd_htable = ep->fd_htable_init;
+	ep->fd_htable_order = EVENTPOLL_FD_HTABLE_INIT_ORDER;
+	ep->fd_count = 0;
+
+	ukarch_spin_init(&ep->tr_lock);
 	UK_INIT_LIST_HEAD(&ep->tr_list);
 	uk_waitq_init(&ep->wq);
 }
@@ -292,15 +322,29 @@ int eventpoll_wait(struct eventpoll *ep, struct epoll_event *events,
 /**
  * Signal events for an eventpoll file description. This function is called by
  * VFS drivers to inform the eventpoll about changes in the respective file's
- * state (e.g., new data to read)
- *
- * NOTE: The function must not be called from within an IRQ context due to the
- *   way we perform locking internally at the moment.
+ * state (e.g., new data to read). The file description is pushed to the
+ * triggered list of its eventpoll and waiters are woken up. If the file
+ * description has been added with EPOLLEXCLUSIVE only a single waiter is
+ * woken up.
  *
  * @param ecb the eventpoll context block supplied in the poll call
  * @param revents a bitmask specifying all the active epoll events for this file
+ *
+ * @return 1 if the file description is in exclusive mode and a waiter has been
+ *   woken up, 0 otherwise
+ */
+int eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents);
+
+/**
+ * Signal events for all eventpoll context blocks in a driver's signal list
+ * that are linked with their cb_link field. The events are queued for all
+ * file descriptions. Among those that have been added with EPOLLEXCLUSIVE,
+ * only the first one that finds a waiter wakes it up.
+ *
+ * @param cb_list list of eventpoll context blocks
+ * @param revents a bitmask specifying all the active epoll events for the file
  */
-void eventpoll_signal(struct eventpoll_cb *ecb, unsigned int revents);
+void eventpoll_signal_list(struct uk_list_head *cb_list, unsigned int revents);
 
 /**
  * @internal Called by VFS to inform the eventpoll API that a file description
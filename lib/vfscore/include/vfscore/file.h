@@ -38,6 +38,7 @@
 #include <sys/types.h>
 #include <vfscore/dentry.h>
 #include <uk/list.h>
+#include <uk/config.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -61,6 +62,13 @@ struct vfscore_file {
 	struct uk_mutex f_lock;
 
 	struct uk_list_head f_ep;	/* List of eventpoll_fd's */
+
+#if CONFIG_LIBVFSCORE_PAGECACHE
+	/* Readahead state of the page cache */
+	off_t		f_ra_next;	/* offset of sequential access */
+	unsigned int	f_ra_window;	/* readahead window in pages */
+	int		f_ra_advice;	/* POSIX_FADV_* */
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 };
 
 #define FD_LOCK(fp)       uk_mutex_lock(&(fp->f_lock))
@@ -123,6 +123,11 @@ struct mount {
 #define	MNT_ROOTFS	0x00004000	/* identifies the root filesystem */
 #endif
 
+/*
+ * Internal flags that are set by the file system in its mount operation
+ */
+#define MNT_PAGECACHE	0x00010000	/* regular files use the page cache */
+
 /*
  * Mask of flags that are visible to statfs()
  */
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * Page cache
+ *
+ * Caches the data of regular files on mounts that have MNT_PAGECACHE set.
+ * Pages are indexed per file by mount and inode number, so that the data
+ * survives closing and re-opening the file. Clean pages are evicted in CLOCK
+ * order when the configured cache size is reached. Dirty pages are written
+ * back on fsync() and when the last reference to the vnode is dropped.
+ *
+ * The file system must keep `v_size` of its vnodes up-to-date as the cache
+ * uses it as the file size. Except for vfscore_pcache_release(), all
+ * functions must be called with the vnode lock held.
+ */
+
+#ifndef __VFSCORE_PAGECACHE_H__
+#define __VFSCORE_PAGECACHE_H__
+
+#include <uk/config.h>
+#include <uk/essentials.h>
+#include <vfscore/file.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if CONFIG_LIBVFSCORE_PAGECACHE
+
+/**
+ * Returns whether the data of the vnode goes through the page cache.
+ */
+static inline int vfscore_pcache_enabled(struct vnode *vp)
+{
+	return vp->v_type == VREG && (vp->v_mount->m_flags & MNT_PAGECACHE);
+}
+
+/**
+ * Reads from a file via the page cache. Same interface as VOP_READ.
+ */
+int vfscore_pcache_read(struct vnode *vp, struct vfscore_file *fp,
+			struct uio *uio, int ioflag);
+
+/**
+ * Writes to a file via the page cache. Same interface as VOP_WRITE, the file
+ * is used to read pages that are only partially overwritten.
+ */
+int vfscore_pcache_write(struct vnode *vp, struct vfscore_file *fp,
+			 struct uio *uio, int ioflag);
+
+/**
+ * Writes back all dirty pages of a file.
+ *
+ * @return 0 on success, a positive errno value otherwise
+ */
+int vfscore_pcache_sync(struct vnode *vp);
+
+/**
+ * Returns whether the file has cached data that is not written back yet.
+ */
+int vfscore_pcache_dirty(struct vnode *vp);
+
+/**
+ * Drops the cached data beyond the new file size after a successful
+ * VOP_TRUNCATE.
+ */
+void vfscore_pcache_truncate(struct vnode *vp, off_t length);
+
+/**
+ * Writes back and drops the pages that overlap [off, off + len).
+ *
+ * @return 0 on success, a positive errno value otherwise
+ */
+int vfscore_pcache_invalidate(struct vnode *vp, off_t off, off_t len);
+
+/**
+ * Marks the file as removed so that its data is discarded instead of written
+ * back when the vnode is released.
+ */
+void vfscore_pcache_remove(struct vnode *vp);
+
+/**
+ * Called when the last reference to a vnode is dropped, before
+ * VOP_INACTIVE. Writes back dirty pages and keeps the clean ones.
+ */
+void vfscore_pcache_release(struct vnode *vp);
+
+/**
+ * Drops all cached data of a mount. Must be called before the mount is
+ * released, when no vnodes of it are in use anymore.
+ */
+void vfscore_pcache_unmount(struct mount *mp);
+
+/**
+ * Applies POSIX_FADV_* access advice to a file.
+ *
+ * @return 0 on success, a positive errno value otherwise
+ */
+int vfscore_pcache_advise(struct vfscore_file *fp, off_t off, off_t len,
+			  int advice);
+
+/**
+ * Initializes the hash table of the cache. Called once from vfscore_init().
+ */
+void vfscore_pcache_init(void);
+
+#else /* CONFIG_LIBVFSCORE_PAGECACHE */
+
+static inline int vfscore_pcache_enabled(struct vnode *vp __unused)
+{
+	return 0;
+}
+
+static inline int vfscore_pcache_read(struct vnode *vp,
+				      struct vfscore_file *fp,
+				      struct uio *uio, int ioflag)
+{
+	return VOP_READ(vp, fp, uio, ioflag);
+}
+
+static inline int vfscore_pcache_write(struct vnode *vp,
+				       struct vfscore_file *fp __unused,
+				       struct uio *uio, int ioflag)
+{
+	return VOP_WRITE(vp, uio, ioflag);
+}
+
+static inline int vfscore_pcache_sync(struct vnode *vp __unused)
+{
+	return 0;
+}
+
+static inline int vfscore_pcache_dirty(struct vnode *vp __unused)
+{
+	return 0;
+}
+
+static inline void vfscore_pcache_truncate(struct vnode *vp __unused,
+					   off_t length __unused)
+{
+}
+
+static inline int vfscore_pcache_invalidate(struct vnode *vp __unused,
+					    off_t off __unused,
+					    off_t len __unused)
+{
+	return 0;
+}
+
+static inline void vfscore_pcache_remove(struct vnode *vp __unused)
+{
+}
+
+static inline void vfscore_pcache_release(struct vnode *vp __unused)
+{
+}
+
+static inline void vfscore_pcache_unmount(struct mount *mp __unused)
+{
+}
+
+static inline int vfscore_pcache_advise(struct vfscore_file *fp __unused,
+					off_t off __unused, off_t len __unused,
+					int advice __unused)
+{
+	return 0;
+}
+
+static inline void vfscore_pcache_init(void)
+{
+}
+
+#endif /* !CONFIG_LIBVFSCORE_PAGECACHE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VFSCORE_PAGECACHE_H__ */
@@ -47,6 +47,7 @@ struct vfsops;
 struct vnops;
 struct vnode;
 struct vfscore_file;
+struct vfscore_pcnode;
 
 struct eventpoll_cb;
 
@@ -62,6 +63,7 @@ enum vtype {
 	VLNK,	    /* symbolic link */
 	VSOCK,	    /* socks */
 	VFIFO,	    /* FIFO */
+	VTIMER,	    /* timerfd */
 #ifdef CONFIG_LIBPOSIX_EVENT
 	VEPOLL,	    /* epoll */
 	VEVENT,	    /* eventfd */
@@ -75,7 +77,7 @@ enum vtype {
  */
 struct vnode {
 	uint64_t	v_ino;		/* inode number */
-	struct uk_list_head v_link;	/* link for hash list */
+	struct uk_hlist_node v_link;	/* link for hash list */
 	struct mount	*v_mount;	/* mounted vfs pointer */
 	struct vnops	*v_op;		/* vnode operations */
 	int		v_refcnt;	/* reference count */
@@ -86,6 +88,9 @@ struct vnode {
 	struct uk_mutex	v_lock;		/* lock for this vnode */
 	struct uk_list_head v_names;	/* directory entries pointing at this */
 	void		*v_data;	/* private data for fs */
+#if CONFIG_LIBVFSCORE_PAGECACHE
+	struct vfscore_pcnode *v_pcache; /* cached pages, see pagecache.h */
+#endif /* CONFIG_LIBVFSCORE_PAGECACHE */
 };
 
 /* flags for vnode */
@@ -181,6 +186,31 @@ typedef int (*vnop_readlink_t)  (struct vnode *, struct uio *);
 typedef int (*vnop_symlink_t)   (struct vnode *, const char *, const char *);
 typedef int (*vnop_poll_t)	(struct vnode *, unsigned int *,
 				 struct eventpoll_cb *);
+/*
+ * Like read, but instead of copying file data into the iovecs of the uio,
+ * point the iovecs at the file data. The uio describes an array of
+ * uio_iovcnt empty iovecs which are consumed (i.e., uio_iov is advanced
+ * and uio_iovcnt decreased) as they are filled. The references remain
+ * valid only as long as the vnode stays locked. Optional; file systems
+ * that do not keep file data in memory leave this NULL.
+ */
+typedef int (*vnop_splice_read_t)(struct vnode *, struct vfscore_file *,
+				  struct uio *);
+/*
+ * Optional operations for file systems that keep file data in page-sized,
+ * page-aligned memory, so that the pages can be mapped into an address space
+ * directly instead of copying the file data. vop_map takes a mapping
+ * reference that keeps all pages of the file in place until it is dropped
+ * with vop_unmap. Truncation and hole punching zero mapped pages instead of
+ * releasing them. vop_getpage returns the page that holds the file data at
+ * the given page-aligned offset. For holes and offsets past the end of the
+ * file, it returns a shared page of zeros that must not be written, instead
+ * of allocating a page. It may only be called while holding a mapping
+ * reference.
+ */
+typedef int (*vnop_map_t)	(struct vnode *);
+typedef int (*vnop_unmap_t)	(struct vnode *);
+typedef int (*vnop_getpage_t)	(struct vnode *, off_t, void **);
 
 /*
  * vnode operations
@@ -210,6 +240,10 @@ struct vnops {
 	vnop_readlink_t		vop_readlink;
 	vnop_symlink_t		vop_symlink;
 	vnop_poll_t		vop_poll;
+	vnop_splice_read_t	vop_splice_read;
+	vnop_map_t		vop_map;
+	vnop_unmap_t		vop_unmap;
+	vnop_getpage_t		vop_getpage;
 };
 
 /*
@@ -240,6 +274,10 @@ struct vnops {
 #define VOP_READLINK(VP, U)        ((VP)->v_op->vop_readlink)(VP, U)
 #define VOP_SYMLINK(DVP, NP, OP)   ((DVP)->v_op->vop_symlink)(DVP, NP, OP)
 #define VOP_POLL(VP, EP, ECP)	   ((VP)->v_op->vop_poll)(VP, EP, ECP)
+#define VOP_SPLICE_READ(VP, FP, U) ((VP)->v_op->vop_splice_read)(VP, FP, U)
+#define VOP_MAP(VP)		   ((VP)->v_op->vop_map)(VP)
+#define VOP_UNMAP(VP)		   ((VP)->v_op->vop_unmap)(VP)
+#define VOP_GETPAGE(VP, OFF, PP)   ((VP)->v_op->vop_getpage)(VP, OFF, PP)
 
 int vfscore_vop_nullop();
 int vfscore_vop_einval();
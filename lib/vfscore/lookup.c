@@ -154,6 +154,7 @@ namei(const char *path, struct dentry **dpp)
 		dref(ddp);
 
 		node[0] = '\0';
+		dvp = NULL;
 
 		while (*p != '\0') {
 			/*
@@ -180,9 +181,19 @@ namei(const char *path, struct dentry **dpp)
 			 */
 			strlcat(node, "/", sizeof(node));
 			strlcat(node, name, sizeof(node));
-			dvp = ddp->d_vnode;
-			vn_lock(dvp);
+
+			/*
+			 * Cached dentries are found without locking the
+			 * directory, so lookups in the same directory do not
+			 * serialize.
+			 */
 			dp = dentry_lookup(mp, node);
+			if (dp == NULL) {
+				dvp = ddp->d_vnode;
+				vn_lock(dvp);
+				/* Somebody may have added it in the meantime. */
+				dp = dentry_lookup(mp, node);
+			}
 			if (dp == NULL) {
 				/* Find a vnode in this directory. */
 				error = VOP_LOOKUP(dvp, name, &vp);
@@ -201,7 +212,9 @@ namei(const char *path, struct dentry **dpp)
 					return ENOMEM;
 				}
 			}
-			vn_unlock(dvp);
+			if (dvp)
+				vn_unlock(dvp);
+			dvp = NULL;
 			drele(ddp);
 			ddp = dp;
 
@@ -286,9 +299,12 @@ namei_last_nofollow(char *path, struct dentry *ddp, struct dentry **dpp)
 		node[l] = '\0';
 	}
 
-	dvp = ddp->d_vnode;
-	vn_lock(dvp);
 	dp = dentry_lookup(mp, node);
+	if (dp == NULL) {
+		dvp = ddp->d_vnode;
+		vn_lock(dvp);
+		dp = dentry_lookup(mp, node);
+	}
 	if (dp == NULL) {
 		error = VOP_LOOKUP(dvp, name, &vp);
 		if (error != 0) {
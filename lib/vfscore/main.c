@@ -49,6 +49,7 @@
 #include <vfscore/file.h>
 #include <vfscore/mount.h>
 #include <vfscore/fs.h>
+#include <vfscore/pagecache.h>
 #include <uk/print.h>
 #include <uk/errptr.h>
 #include <uk/ctors.h>
@@ -2608,92 +2609,255 @@ UK_SYSCALL_R_DEFINE(int, lchown, const char*, path, uid_t, owner, gid_t, group)
 }
 
 
-#if 0
-ssize_t sendfile(int out_fd, int in_fd, off_t *_offset, size_t count)
+#ifndef SPLICE_F_MOVE
+#define SPLICE_F_MOVE		1
+#define SPLICE_F_NONBLOCK	2
+#define SPLICE_F_MORE		4
+#define SPLICE_F_GIFT		8
+#endif /* !SPLICE_F_MOVE */
+
+/**
+ * Return:
+ * = 0, Success and the nr of bytes transferred is returned in bytes parameter.
+ * < 0, error code.
+ */
+static ssize_t do_splice(struct vfscore_file *in_fp, off_t *in_off,
+			 struct vfscore_file *out_fp, off_t *out_off,
+			 size_t len, ssize_t *bytes)
 {
-	struct vfscore_file *in_fp;
-	struct vfscore_file *out_fp;
-	fileref in_f{fileref_from_fd(in_fd)};
-	fileref out_f{fileref_from_fd(out_fd)};
+	size_t cnt;
+	int error;
 
-	if (!in_f || !out_f) {
-		return libc_error(EBADF);
-	}
+	if ((in_off && *in_off < 0) || (out_off && *out_off < 0))
+		return -EINVAL;
 
-	in_fp = in_f.get();
-	out_fp = out_f.get();
+	error = sys_splice(in_fp, in_off ? *in_off : -1,
+			   out_fp, out_off ? *out_off : -1, len, &cnt);
+	if (has_error(error, cnt))
+		return -error;
 
-	if (!in_fp->f_dentry) {
-		return libc_error(EBADF);
-	}
+	if (in_off)
+		*in_off += cnt;
+	if (out_off)
+		*out_off += cnt;
+	*bytes = cnt;
+	return 0;
+}
 
-	if (!(in_fp->f_flags & UK_FREAD))
-		return libc_error(EBADF);
+UK_TRACEPOINT(trace_vfs_sendfile, "%d %d %p 0x%x", int, int, off_t *, size_t);
+UK_TRACEPOINT(trace_vfs_sendfile_ret, "0x%x", ssize_t);
+UK_TRACEPOINT(trace_vfs_sendfile_err, "%d", int);
 
-	if (out_fp->f_type & DTYPE_VNODE) {
-		if (!out_fp->f_dentry)
-			return libc_error(EBADF);
-		else if (!(out_fp->f_flags & UK_FWRITE))
-			return libc_error(EBADF);
+UK_SYSCALL_R_DEFINE(ssize_t, sendfile, int, out_fd, int, in_fd,
+		    off_t *, offset, size_t, count)
+{
+	struct vfscore_file *in_fp, *out_fp;
+	ssize_t bytes;
+	int error;
+
+	trace_vfs_sendfile(out_fd, in_fd, offset, count);
+	error = fget(in_fd, &in_fp);
+	if (error) {
+		error = -error;
+		goto out_error;
+	}
+	error = fget(out_fd, &out_fp);
+	if (error) {
+		error = -error;
+		goto out_error_fdrop_in;
+	}
+
+	/* The source has to be a seekable file */
+	if ((in_fp->f_vfs_flags & UK_VFSCORE_NOPOS) ||
+	    in_fp->f_dentry->d_vnode->v_type == VDIR) {
+		error = -EINVAL;
+		goto out_error_fdrop;
+	}
+	if (out_fp->f_flags & O_APPEND) {
+		error = -EINVAL;
+		goto out_error_fdrop;
 	}
 
-	off_t offset ;
+	error = do_splice(in_fp, offset, out_fp, NULL, count, &bytes);
 
-	if (_offset != nullptr) {
-		offset = *_offset;
-	} else {
-		/* if _offset is nullptr, we need to read from the present position of in_fd */
-		offset = lseek(in_fd, 0, SEEK_CUR);
+out_error_fdrop:
+	fdrop(out_fp);
+out_error_fdrop_in:
+	fdrop(in_fp);
+
+	if (error < 0)
+		goto out_error;
+
+	trace_vfs_sendfile_ret(bytes);
+	return bytes;
+
+out_error:
+	trace_vfs_sendfile_err(error);
+	return error;
+}
+
+#ifdef sendfile64
+#undef sendfile64
+#endif
+
+LFS64(sendfile);
+
+UK_TRACEPOINT(trace_vfs_splice, "%d %p %d %p 0x%x 0x%x", int, off_t *, int,
+	      off_t *, size_t, unsigned int);
+UK_TRACEPOINT(trace_vfs_splice_ret, "0x%x", ssize_t);
+UK_TRACEPOINT(trace_vfs_splice_err, "%d", int);
+
+UK_SYSCALL_R_DEFINE(ssize_t, splice, int, fd_in, off_t *, off_in,
+		    int, fd_out, off_t *, off_out, size_t, len,
+		    unsigned int, flags)
+{
+	struct vfscore_file *in_fp, *out_fp;
+	int in_pipe, out_pipe;
+	ssize_t bytes;
+	int error;
+
+	trace_vfs_splice(fd_in, off_in, fd_out, off_out, len, flags);
+	if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK |
+		      SPLICE_F_MORE | SPLICE_F_GIFT)) {
+		error = -EINVAL;
+		goto out_error;
 	}
 
-	// Constrain count to the extent of the file...
-	struct stat st;
-	if (fstat(in_fd, &st) < 0) {
-		return -1;
-	} else {
-		if (offset >= st.st_size) {
-			return 0;
-		} else if ((offset + count) >= st.st_size) {
-			count = st.st_size - offset;
-			if (count == 0) {
-				return 0;
-			}
-		}
+	error = fget(fd_in, &in_fp);
+	if (error) {
+		error = -error;
+		goto out_error;
+	}
+	error = fget(fd_out, &out_fp);
+	if (error) {
+		error = -error;
+		goto out_error_fdrop_in;
+	}
+
+	/* Like on Linux, one of the ends has to be a pipe and pipes do not
+	 * take offsets.
+	 */
+	in_pipe = in_fp->f_dentry->d_vnode->v_type == VFIFO;
+	out_pipe = out_fp->f_dentry->d_vnode->v_type == VFIFO;
+	if ((!in_pipe && !out_pipe) || in_fp == out_fp) {
+		error = -EINVAL;
+		goto out_error_fdrop;
+	}
+	if ((in_pipe && off_in) || (out_pipe && off_out)) {
+		error = -ESPIPE;
+		goto out_error_fdrop;
+	}
+	if ((off_in && (in_fp->f_vfs_flags & UK_VFSCORE_NOPOS)) ||
+	    (off_out && (out_fp->f_vfs_flags & UK_VFSCORE_NOPOS))) {
+		error = -ESPIPE;
+		goto out_error_fdrop;
+	}
+	if (out_fp->f_flags & O_APPEND) {
+		error = -EINVAL;
+		goto out_error_fdrop;
 	}
 
-	size_t bytes_to_mmap = count + (offset % mmu::page_size);
-	off_t offset_for_mmap =  align_down(offset, (off_t)mmu::page_size);
+	error = do_splice(in_fp, off_in, out_fp, off_out, len, &bytes);
 
-	char *src = static_cast<char *>(mmap(nullptr, bytes_to_mmap, PROT_READ, MAP_SHARED, in_fd, offset_for_mmap));
+out_error_fdrop:
+	fdrop(out_fp);
+out_error_fdrop_in:
+	fdrop(in_fp);
 
-	if (src == MAP_FAILED) {
-		return -1;
+	if (error < 0)
+		goto out_error;
+
+	trace_vfs_splice_ret(bytes);
+	return bytes;
+
+out_error:
+	trace_vfs_splice_err(error);
+	return error;
+}
+
+UK_TRACEPOINT(trace_vfs_copy_file_range, "%d %p %d %p 0x%x 0x%x", int,
+	      off_t *, int, off_t *, size_t, unsigned int);
+UK_TRACEPOINT(trace_vfs_copy_file_range_ret, "0x%x", ssize_t);
+UK_TRACEPOINT(trace_vfs_copy_file_range_err, "%d", int);
+
+UK_SYSCALL_R_DEFINE(ssize_t, copy_file_range, int, fd_in, off_t *, off_in,
+		    int, fd_out, off_t *, off_out, size_t, len,
+		    unsigned int, flags)
+{
+	struct vfscore_file *in_fp, *out_fp;
+	struct vnode *in_vp, *out_vp;
+	off_t in_pos, out_pos;
+	ssize_t bytes;
+	int error;
+
+	trace_vfs_copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
+	if (flags) {
+		error = -EINVAL;
+		goto out_error;
 	}
 
-	int ret = write(out_fd, src + (offset % PAGESIZE), count);
+	error = fget(fd_in, &in_fp);
+	if (error) {
+		error = -error;
+		goto out_error;
+	}
+	error = fget(fd_out, &out_fp);
+	if (error) {
+		error = -error;
+		goto out_error_fdrop_in;
+	}
 
-	if (ret < 0) {
-		return libc_error(errno);
-	} else if(_offset == nullptr) {
-		lseek(in_fd, ret, SEEK_CUR);
-	} else {
-		*_offset += ret;
+	in_vp = in_fp->f_dentry->d_vnode;
+	out_vp = out_fp->f_dentry->d_vnode;
+	if (in_vp->v_type == VDIR || out_vp->v_type == VDIR) {
+		error = -EISDIR;
+		goto out_error_fdrop;
+	}
+	if (in_vp->v_type != VREG || out_vp->v_type != VREG) {
+		error = -EINVAL;
+		goto out_error_fdrop;
+	}
+	if (out_fp->f_flags & O_APPEND) {
+		error = -EBADF;
+		goto out_error_fdrop;
 	}
 
-	assert(munmap(src, count) == 0);
+	/* Ranges within the same file must not overlap */
+	if (in_vp == out_vp) {
+		in_pos = off_in ? *off_in : in_fp->f_offset;
+		out_pos = off_out ? *off_out : out_fp->f_offset;
+		if (in_pos < out_pos + (off_t)len &&
+		    out_pos < in_pos + (off_t)len) {
+			error = -EINVAL;
+			goto out_error_fdrop;
+		}
+	}
 
-	return ret;
-}
+	error = do_splice(in_fp, off_in, out_fp, off_out, len, &bytes);
 
-#undef sendfile64
+out_error_fdrop:
+	fdrop(out_fp);
+out_error_fdrop_in:
+	fdrop(in_fp);
 
-LFS64(sendfile);
-#endif
+	if (error < 0)
+		goto out_error;
+
+	trace_vfs_copy_file_range_ret(bytes);
+	return bytes;
+
+out_error:
+	trace_vfs_copy_file_range_err(error);
+	return error;
+}
 
 #if UK_LIBC_SYSCALLS
-int posix_fadvise(int fd __unused, off_t offset __unused, off_t len __unused,
-		int advice)
+int posix_fadvise(int fd, off_t offset, off_t len, int advice)
 {
+	struct vfscore_file *fp;
+	struct vnode *vp;
+	int error;
+
 	switch (advice) {
 	case POSIX_FADV_NORMAL:
 	case POSIX_FADV_SEQUENTIAL:
@@ -2701,10 +2865,26 @@ int posix_fadvise(int fd __unused, off_t offset __unused, off_t len __unused,
 	case POSIX_FADV_NOREUSE:
 	case POSIX_FADV_WILLNEED:
 	case POSIX_FADV_DONTNEED:
-		return 0;
+		break;
 	default:
 		return EINVAL;
 	}
+
+	if (offset < 0 || len < 0)
+		return EINVAL;
+
+	fp = vfscore_get_file(fd);
+	if (!fp)
+		return EBADF;
+
+	vp = fp->f_dentry->d_vnode;
+	if (vp->v_type == VFIFO || vp->v_type == VSOCK)
+		error = ESPIPE;
+	else
+		error = vfscore_pcache_advise(fp, offset, len, advice);
+
+	fdrop(fp);
+	return error;
 }
 
 #ifdef posix_fadvise64
@@ -2740,6 +2920,7 @@ static void vfscore_init(void)
 
 	vnode_init();
 	lookup_init();
+	vfscore_pcache_init();
 }
 
 UK_CTOR_PRIO(vfscore_init, 1);
@@ -52,6 +52,7 @@
 #include <vfscore/prex.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
+#include <vfscore/pagecache.h>
 #include <uk/syscall.h>
 
 /*
@@ -168,7 +169,8 @@ UK_SYSCALL_R_DEFINE(int, mount, const char*, dev, const char*, dir,
 	}
 	mp->m_count = 0;
 	mp->m_op = fs->vs_op;
-	mp->m_flags = flags;
+	/* Only the file system decides about caching */
+	mp->m_flags = flags & ~MNT_PAGECACHE;
 	mp->m_dev = device;
 	mp->m_data = NULL;
 	strlcpy(mp->m_path, dir, sizeof(mp->m_path));
@@ -291,9 +293,13 @@ found:
 		goto out;
 	}
 
+	/* Cached dentries keep vnodes of the file system */
+	dentry_reclaim(mp);
+
 	if ((error = VFS_UNMOUNT(mp, flags)) != 0)
 		goto out;
 	uk_list_del_init(&mp->mnt_list);
+	vfscore_pcache_unmount(mp);
 
 #ifdef HAVE_BUFFERS
 	/* Flush all buffers */
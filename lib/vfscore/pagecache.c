@@ -0,0 +1,920 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+/*
+ * pagecache.c - page cache for regular files
+ *
+ * The cached pages of a file are kept in a cache node, which is found via a
+ * hash table by mount and inode number and is attached to the vnode while
+ * the vnode is alive. The pages of a node are ordered by page index in a
+ * red-black tree. All pages are additionally kept in a single CLOCK list:
+ * The head of the list is the clock hand. Pages that were referenced since
+ * the last pass get a second chance and are moved to the tail.
+ *
+ * The page cache lock protects the hash table, the trees, the CLOCK list, as
+ * well as the flags and pin counts of the pages. The contents of a page are
+ * protected by the vnode lock of the file. A page is pinned while its
+ * contents are accessed without holding the page cache lock, which keeps
+ * it from being evicted. Dirty pages are never evicted, so that eviction
+ * never has to do I/O on another file. As dirty pages are written back
+ * when the vnode is released, nodes without vnode only hold clean pages.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <uk/config.h>
+#include <uk/alloc.h>
+#include <uk/assert.h>
+#include <uk/essentials.h>
+#include <uk/list.h>
+#include <uk/mutex.h>
+#include <uk/print.h>
+#include <uk/rbtree.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
+#include <vfscore/fs.h>
+#include <vfscore/file.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+#include <vfscore/uio.h>
+#include <vfscore/pagecache.h>
+#include "htable.h"
+
+#define PCACHE_MAX_PAGES						\
+	(((unsigned long) CONFIG_LIBVFSCORE_PAGECACHE_SIZE * 1024UL) /	\
+	 PAGE_SIZE)
+#define PCACHE_RA_MAX		CONFIG_LIBVFSCORE_PAGECACHE_READAHEAD
+#define PCACHE_RA_MIN		MIN(4, PCACHE_RA_MAX)
+
+/* Maximum number of pages that are transferred with a single operation */
+#define PCACHE_BATCH		64
+
+#define PCPAGE_DIRTY		0x1
+#define PCPAGE_REF		0x2
+
+struct vfscore_pcpage {
+	struct uk_rb_node node;		/* in the tree of the cache node */
+	struct uk_list_head clock_link;	/* in the CLOCK list */
+	struct vfscore_pcnode *pn;
+	unsigned long idx;		/* page index in the file */
+	unsigned int pin;
+	unsigned int flags;
+	void *data;
+};
+
+struct vfscore_pcnode {
+	struct uk_hlist_node link;	/* in the hash table */
+	struct mount *mp;
+	uint64_t ino;
+	struct vnode *vp;		/* attached vnode, NULL if released */
+	off_t size;			/* file size when the vnode was released */
+	int removed;
+	struct uk_rb_tree pages;
+	unsigned long npages;
+	unsigned long ndirty;
+};
+
+static struct uk_mutex pcache_lock = UK_MUTEX_INITIALIZER(pcache_lock);
+static struct vfscore_htable pcache_table;
+static UK_LIST_HEAD(pcache_clock);
+static unsigned long pcache_npages;
+
+static unsigned long pcache_hash(struct mount *mp, uint64_t ino)
+{
+	return vfscore_hash_mix(ino ^ vfscore_hash_ptr(mp));
+}
+
+static unsigned long pcache_node_hash(struct uk_hlist_node *n)
+{
+	struct vfscore_pcnode *pn = uk_hlist_entry(n, struct vfscore_pcnode,
+						   link);
+
+	return pcache_hash(pn->mp, pn->ino);
+}
+
+static struct vfscore_pcnode *pcache_node_find(struct uk_hlist_head *head,
+					       struct mount *mp, uint64_t ino)
+{
+	struct vfscore_pcnode *pn;
+
+	if (!head)
+		return NULL;
+
+	uk_hlist_for_each_entry(pn, head, link) {
+		if (pn->mp == mp && pn->ino == ino)
+			return pn;
+	}
+	return NULL;
+}
+
+static inline off_t pcache_off(unsigned long idx)
+{
+	return (off_t) idx << PAGE_SHIFT;
+}
+
+/* Returns the index of the last page that covers [off, off + len) */
+static inline unsigned long pcache_last(off_t off, off_t len)
+{
+	if (len <= 0 || len > __OFF_MAX - off)
+		return ULONG_MAX;
+	return (unsigned long) ((off + len - 1) >> PAGE_SHIFT);
+}
+
+/* Returns the first page with an index of at least idx */
+static struct vfscore_pcpage *pcache_page_ceil(struct vfscore_pcnode *pn,
+					       unsigned long idx)
+{
+	struct uk_rb_node *n = pn->pages.root;
+	struct vfscore_pcpage *pg, *best = NULL;
+
+	while (n) {
+		pg = uk_rb_entry(n, struct vfscore_pcpage, node);
+		if (pg->idx == idx)
+			return pg;
+		if (pg->idx > idx) {
+			best = pg;
+			n = n->left;
+		} else {
+			n = n->right;
+		}
+	}
+	return best;
+}
+
+static struct vfscore_pcpage *pcache_page_find(struct vfscore_pcnode *pn,
+					       unsigned long idx)
+{
+	struct vfscore_pcpage *pg = pcache_page_ceil(pn, idx);
+
+	return (pg && pg->idx == idx) ? pg : NULL;
+}
+
+static void pcache_page_insert(struct vfscore_pcnode *pn,
+			       struct vfscore_pcpage *pg)
+{
+	struct uk_rb_node **link = &pn->pages.root;
+	struct uk_rb_node *parent = NULL;
+	struct vfscore_pcpage *cur;
+
+	while (*link) {
+		parent = *link;
+		cur = uk_rb_entry(parent, struct vfscore_pcpage, node);
+		UK_ASSERT(cur->idx != pg->idx);
+		link = (pg->idx < cur->idx) ? &parent->left : &parent->right;
+	}
+
+	pg->pn = pn;
+	uk_rb_insert(&pn->pages, &pg->node, parent, link, NULL);
+	uk_list_add_tail(&pg->clock_link, &pcache_clock);
+	pn->npages++;
+}
+
+static void pcache_page_unlink(struct vfscore_pcpage *pg)
+{
+	struct vfscore_pcnode *pn = pg->pn;
+
+	UK_ASSERT(!pg->pin);
+
+	uk_rb_erase(&pn->pages, &pg->node, NULL);
+	uk_list_del(&pg->clock_link);
+	if (pg->flags & PCPAGE_DIRTY)
+		pn->ndirty--;
+	pn->npages--;
+	pg->pn = NULL;
+}
+
+static void pcache_page_free(struct vfscore_pcpage *pg)
+{
+	UK_ASSERT(!pg->pn);
+
+	uk_pfree(uk_alloc_get_default(), pg->data, 1);
+	free(pg);
+	pcache_npages--;
+}
+
+/* Frees a cache node that has neither a vnode nor pages anymore */
+static void pcache_node_put(struct vfscore_pcnode *pn)
+{
+	if (pn->vp || pn->npages)
+		return;
+
+	vfscore_htable_del(&pcache_table, &pn->link);
+	free(pn);
+}
+
+/* Drops the pages in [first, last], discarding dirty data */
+static void pcache_node_drop(struct vfscore_pcnode *pn, unsigned long first,
+			     unsigned long last)
+{
+	struct vfscore_pcpage *pg;
+	struct uk_rb_node *next;
+
+	pg = pcache_page_ceil(pn, first);
+	while (pg && pg->idx <= last) {
+		next = uk_rb_next(&pg->node);
+		pcache_page_unlink(pg);
+		pcache_page_free(pg);
+		pg = uk_rb_entry_safe(next, struct vfscore_pcpage, node);
+	}
+}
+
+/* Evicts the next clean page in CLOCK order and returns it for reuse */
+static struct vfscore_pcpage *pcache_evict(void)
+{
+	struct vfscore_pcpage *pg;
+	struct vfscore_pcnode *pn;
+	unsigned long n;
+
+	for (n = 2 * pcache_npages; n > 0; n--) {
+		pg = uk_list_first_entry(&pcache_clock, struct vfscore_pcpage,
+					 clock_link);
+		if (pg->pin || (pg->flags & (PCPAGE_DIRTY | PCPAGE_REF))) {
+			pg->flags &= ~PCPAGE_REF;
+			uk_list_move_tail(&pg->clock_link, &pcache_clock);
+			continue;
+		}
+
+		pn = pg->pn;
+		pcache_page_unlink(pg);
+		pcache_node_put(pn);
+		return pg;
+	}
+	return NULL;
+}
+
+/* Returns a new page that is not linked to a node yet, or NULL */
+static struct vfscore_pcpage *pcache_page_alloc(void)
+{
+	struct vfscore_pcpage *pg;
+
+	if (pcache_npages < PCACHE_MAX_PAGES) {
+		pg = malloc(sizeof(*pg));
+		if (likely(pg)) {
+			pg->data = uk_palloc(uk_alloc_get_default(), 1);
+			if (likely(pg->data)) {
+				pcache_npages++;
+				goto out;
+			}
+			free(pg);
+		}
+	}
+
+	/* Over budget or out of memory: reuse an evicted page */
+	pg = pcache_evict();
+	if (unlikely(!pg))
+		return NULL;
+out:
+	pg->pin = 1;
+	pg->flags = 0;
+	return pg;
+}
+
+/* Returns the cache node of a vnode, attaching the node if necessary */
+static struct vfscore_pcnode *pcache_node_get(struct vnode *vp)
+{
+	unsigned long hash = pcache_hash(vp->v_mount, vp->v_ino);
+	struct vfscore_pcnode *pn;
+
+	if (vp->v_pcache)
+		return vp->v_pcache;
+
+	/* The node is in the old buckets if they are not migrated yet */
+	pn = pcache_node_find(vfscore_htable_head(pcache_table.cur, hash),
+			      vp->v_mount, vp->v_ino);
+	if (!pn)
+		pn = pcache_node_find(vfscore_htable_head(pcache_table.old,
+							  hash),
+				      vp->v_mount, vp->v_ino);
+	if (pn) {
+		UK_ASSERT(!pn->vp);
+		UK_ASSERT(!pn->ndirty);
+
+		/* The file was changed while it was not in use */
+		if (pn->size != vp->v_size)
+			pcache_node_drop(pn, 0, ULONG_MAX);
+		goto attach;
+	}
+
+	pn = calloc(1, sizeof(*pn));
+	if (unlikely(!pn))
+		return NULL;
+
+	pn->mp = vp->v_mount;
+	pn->ino = vp->v_ino;
+	uk_rb_init(&pn->pages);
+	vfscore_htable_add(&pcache_table, &pn->link, hash);
+
+attach:
+	pn->vp = vp;
+	vp->v_pcache = pn;
+	return pn;
+}
+
+/* Returns the cached page with the given index pinned, or NULL */
+static struct vfscore_pcpage *pcache_page_get(struct vfscore_pcnode *pn,
+					      unsigned long idx)
+{
+	struct vfscore_pcpage *pg;
+
+	uk_mutex_lock(&pcache_lock);
+	pg = pcache_page_find(pn, idx);
+	if (pg) {
+		pg->pin++;
+		pg->flags |= PCPAGE_REF;
+	}
+	uk_mutex_unlock(&pcache_lock);
+	return pg;
+}
+
+static void pcache_page_put(struct vfscore_pcpage *pg, int dirty)
+{
+	uk_mutex_lock(&pcache_lock);
+	UK_ASSERT(pg->pin > 0);
+	pg->pin--;
+	if (dirty && !(pg->flags & PCPAGE_DIRTY)) {
+		pg->flags |= PCPAGE_DIRTY;
+		pg->pn->ndirty++;
+	}
+	uk_mutex_unlock(&pcache_lock);
+}
+
+/* Adds a zeroed page, e.g., for a page that is completely overwritten */
+static struct vfscore_pcpage *pcache_page_new(struct vfscore_pcnode *pn,
+					      unsigned long idx)
+{
+	struct vfscore_pcpage *pg;
+
+	uk_mutex_lock(&pcache_lock);
+	UK_ASSERT(!pcache_page_find(pn, idx));
+	pg = pcache_page_alloc();
+	if (likely(pg)) {
+		pg->idx = idx;
+		pg->flags = PCPAGE_REF;
+		pcache_page_insert(pn, pg);
+	}
+	uk_mutex_unlock(&pcache_lock);
+
+	if (likely(pg))
+		memset(pg->data, 0, PAGE_SIZE);
+	return pg;
+}
+
+/*
+ * Reads up to n pages starting at idx, which is not cached, with a single
+ * VOP_READ. Stops at the first page that is cached or beyond the end of the
+ * file. On success, the page at idx is returned pinned in pgp.
+ */
+static int pcache_fill(struct vnode *vp, struct vfscore_file *fp,
+		       struct vfscore_pcnode *pn, unsigned long idx,
+		       unsigned long n, struct vfscore_pcpage **pgp)
+{
+	struct vfscore_pcpage *pages[PCACHE_BATCH];
+	struct iovec iov[PCACHE_BATCH];
+	struct uio uio;
+	unsigned long i, cnt, end;
+	size_t done, off;
+	int error;
+
+	end = (unsigned long) ((vp->v_size + PAGE_SIZE - 1) >> PAGE_SHIFT);
+	n = MIN(n, (unsigned long) PCACHE_BATCH);
+	if (end > idx)
+		n = MIN(n, end - idx);
+	else
+		n = 1;
+
+	uk_mutex_lock(&pcache_lock);
+	for (cnt = 0; cnt < n; cnt++) {
+		if (cnt > 0 && pcache_page_find(pn, idx + cnt))
+			break;
+
+		pages[cnt] = pcache_page_alloc();
+		if (unlikely(!pages[cnt]))
+			break;
+
+		pages[cnt]->idx = idx + cnt;
+		pcache_page_insert(pn, pages[cnt]);
+	}
+	uk_mutex_unlock(&pcache_lock);
+
+	if (unlikely(!cnt))
+		return ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		iov[i].iov_base = pages[i]->data;
+		iov[i].iov_len = PAGE_SIZE;
+	}
+
+	uio.uio_iov = iov;
+	uio.uio_iovcnt = (int) cnt;
+	uio.uio_offset = pcache_off(idx);
+	uio.uio_resid = cnt * PAGE_SIZE;
+	uio.uio_rw = UIO_READ;
+	error = VOP_READ(vp, fp, &uio, 0);
+	done = cnt * PAGE_SIZE - uio.uio_resid;
+
+	/* Data beyond the end of the file reads as zeros */
+	for (i = 0; i < cnt; i++) {
+		off = (done > i * PAGE_SIZE) ? done - i * PAGE_SIZE : 0;
+		if (off < PAGE_SIZE)
+			memset((char *) pages[i]->data + off, 0,
+			       PAGE_SIZE - off);
+	}
+
+	uk_mutex_lock(&pcache_lock);
+	for (i = 0; i < cnt; i++) {
+		if (i == 0 && !error)
+			continue;
+
+		pages[i]->pin--;
+		if (error) {
+			pcache_page_unlink(pages[i]);
+			pcache_page_free(pages[i]);
+		}
+	}
+	uk_mutex_unlock(&pcache_lock);
+
+	if (!error) {
+		pages[0]->flags |= PCPAGE_REF;
+		*pgp = pages[0];
+	}
+	return error;
+}
+
+/* Writes back the dirty pages in [first, last] */
+static int pcache_writeback(struct vnode *vp, struct vfscore_pcnode *pn,
+			    unsigned long first, unsigned long last)
+{
+	struct vfscore_pcpage *pages[PCACHE_BATCH];
+	struct iovec iov[PCACHE_BATCH];
+	struct vfscore_pcpage *pg;
+	struct uio uio;
+	unsigned long i, cnt;
+	size_t len;
+	off_t off;
+	int error;
+
+	while (first <= last) {
+		/* Collect a run of consecutive dirty pages */
+		uk_mutex_lock(&pcache_lock);
+		cnt = 0;
+		if (pn->ndirty) {
+			pg = pcache_page_ceil(pn, first);
+			while (pg && !(pg->flags & PCPAGE_DIRTY))
+				pg = uk_rb_entry_safe(uk_rb_next(&pg->node),
+						      struct vfscore_pcpage,
+						      node);
+			while (pg && pg->idx <= last &&
+			       (pg->flags & PCPAGE_DIRTY) &&
+			       (!cnt || pg->idx == pages[cnt - 1]->idx + 1) &&
+			       cnt < PCACHE_BATCH) {
+				pg->flags &= ~PCPAGE_DIRTY;
+				pg->pin++;
+				pn->ndirty--;
+				pages[cnt++] = pg;
+				pg = uk_rb_entry_safe(uk_rb_next(&pg->node),
+						      struct vfscore_pcpage,
+						      node);
+			}
+		}
+		uk_mutex_unlock(&pcache_lock);
+
+		if (!cnt)
+			return 0;
+
+		/* Pages beyond the end of the file are never written */
+		off = pcache_off(pages[0]->idx);
+		len = 0;
+		uio.uio_iovcnt = 0;
+		for (i = 0; i < cnt && off + (off_t) len < vp->v_size; i++) {
+			iov[i].iov_base = pages[i]->data;
+			iov[i].iov_len = MIN((size_t) PAGE_SIZE,
+					     (size_t) (vp->v_size - off) - len);
+			len += iov[i].iov_len;
+			uio.uio_iovcnt++;
+		}
+
+		error = 0;
+		if (len) {
+			uio.uio_iov = iov;
+			uio.uio_offset = off;
+			uio.uio_resid = len;
+			uio.uio_rw = UIO_WRITE;
+			error = VOP_WRITE(vp, &uio, 0);
+			if (!error && uio.uio_resid)
+				error = EIO;
+		}
+
+		uk_mutex_lock(&pcache_lock);
+		for (i = 0; i < cnt; i++) {
+			pages[i]->pin--;
+			if (error && !(pages[i]->flags & PCPAGE_DIRTY)) {
+				pages[i]->flags |= PCPAGE_DIRTY;
+				pn->ndirty++;
+			}
+		}
+		uk_mutex_unlock(&pcache_lock);
+
+		if (unlikely(error))
+			return error;
+		if (pages[cnt - 1]->idx == ULONG_MAX)
+			break;
+		first = pages[cnt - 1]->idx + 1;
+	}
+	return 0;
+}
+
+/* Returns the number of pages to read ahead on a miss */
+static unsigned long pcache_readahead(struct vfscore_file *fp, int seq)
+{
+	switch (fp->f_ra_advice) {
+	case POSIX_FADV_RANDOM:
+		return 0;
+	case POSIX_FADV_SEQUENTIAL:
+		return PCACHE_RA_MAX;
+	default:
+		break;
+	}
+
+	if (!seq) {
+		fp->f_ra_window = 0;
+		return 0;
+	}
+
+	/* Every sequential miss doubles the window */
+	if (fp->f_ra_window)
+		fp->f_ra_window = MIN(2 * fp->f_ra_window,
+				      (unsigned int) PCACHE_RA_MAX);
+	else
+		fp->f_ra_window = PCACHE_RA_MIN;
+	return fp->f_ra_window;
+}
+
+int vfscore_pcache_read(struct vnode *vp, struct vfscore_file *fp,
+			struct uio *uio, int ioflag)
+{
+	struct vfscore_pcnode *pn;
+	struct vfscore_pcpage *pg;
+	unsigned long idx, last;
+	size_t pgoff, n;
+	int seq, error = 0;
+
+	if (!vfscore_pcache_enabled(vp))
+		return VOP_READ(vp, fp, uio, ioflag);
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (uio->uio_offset >= vp->v_size || !uio->uio_resid)
+		return 0;
+
+	uk_mutex_lock(&pcache_lock);
+	pn = pcache_node_get(vp);
+	uk_mutex_unlock(&pcache_lock);
+	if (unlikely(!pn))
+		return VOP_READ(vp, fp, uio, ioflag);
+
+	seq = (uio->uio_offset == fp->f_ra_next);
+	while (uio->uio_resid > 0 && uio->uio_offset < vp->v_size) {
+		idx = (unsigned long) (uio->uio_offset >> PAGE_SHIFT);
+		pgoff = (size_t) (uio->uio_offset & (PAGE_SIZE - 1));
+		n = MIN(PAGE_SIZE - pgoff, (size_t) uio->uio_resid);
+		n = MIN(n, (size_t) (vp->v_size - uio->uio_offset));
+
+		pg = pcache_page_get(pn, idx);
+		if (!pg) {
+			last = pcache_last(uio->uio_offset, uio->uio_resid);
+			error = pcache_fill(vp, fp, pn, idx,
+					    last - idx + 1 +
+					    pcache_readahead(fp, seq), &pg);
+			if (unlikely(error == ENOMEM)) {
+				/* Read the rest from the file system */
+				error = pcache_writeback(vp, pn, 0, ULONG_MAX);
+				if (!error)
+					error = VOP_READ(vp, fp, uio, ioflag);
+				break;
+			}
+			if (unlikely(error))
+				break;
+		}
+
+		error = vfscore_uiomove((char *) pg->data + pgoff, (int) n,
+					uio);
+		pcache_page_put(pg, 0);
+		if (unlikely(error))
+			break;
+	}
+
+	fp->f_ra_next = uio->uio_offset;
+	return error;
+}
+
+int vfscore_pcache_write(struct vnode *vp, struct vfscore_file *fp,
+			 struct uio *uio, int ioflag)
+{
+	struct vfscore_pcnode *pn;
+	struct vfscore_pcpage *pg;
+	unsigned long idx, first;
+	size_t pgoff, n;
+	int error = 0;
+
+	if (!vfscore_pcache_enabled(vp))
+		return VOP_WRITE(vp, uio, ioflag);
+
+	if (uio->uio_offset < 0)
+		return EINVAL;
+	if (!uio->uio_resid)
+		return 0;
+
+	uk_mutex_lock(&pcache_lock);
+	pn = pcache_node_get(vp);
+	uk_mutex_unlock(&pcache_lock);
+	if (unlikely(!pn))
+		return VOP_WRITE(vp, uio, ioflag);
+
+	if (ioflag & IO_APPEND)
+		uio->uio_offset = vp->v_size;
+	if (uio->uio_offset > __OFF_MAX - uio->uio_resid)
+		return EFBIG;
+
+	first = (unsigned long) (uio->uio_offset >> PAGE_SHIFT);
+	while (uio->uio_resid > 0) {
+		idx = (unsigned long) (uio->uio_offset >> PAGE_SHIFT);
+		pgoff = (size_t) (uio->uio_offset & (PAGE_SIZE - 1));
+		n = MIN(PAGE_SIZE - pgoff, (size_t) uio->uio_resid);
+
+		pg = pcache_page_get(pn, idx);
+		if (!pg) {
+			/* Only partially written pages with file data have to
+			 * be read first. This needs read access to the file.
+			 */
+			if (n == PAGE_SIZE || pcache_off(idx) >= vp->v_size)
+				pg = pcache_page_new(pn, idx);
+			else if (fp->f_flags & UK_FREAD)
+				pcache_fill(vp, fp, pn, idx, 1, &pg);
+		}
+
+		if (unlikely(!pg)) {
+			/* Write the rest through to the file system */
+			error = vfscore_pcache_invalidate(vp, uio->uio_offset,
+							  uio->uio_resid);
+			if (!error)
+				error = VOP_WRITE(vp, uio, ioflag);
+			return error;
+		}
+
+		error = vfscore_uiomove((char *) pg->data + pgoff, (int) n,
+					uio);
+		pcache_page_put(pg, 1);
+		if (unlikely(error))
+			break;
+
+		if (uio->uio_offset > vp->v_size)
+			vp->v_size = uio->uio_offset;
+	}
+
+	if (!error && (ioflag & IO_SYNC))
+		error = pcache_writeback(vp, pn, first,
+					 pcache_last(pcache_off(first),
+						     uio->uio_offset -
+						     pcache_off(first)));
+	return error;
+}
+
+int vfscore_pcache_sync(struct vnode *vp)
+{
+	if (!vp->v_pcache)
+		return 0;
+
+	return pcache_writeback(vp, vp->v_pcache, 0, ULONG_MAX);
+}
+
+int vfscore_pcache_dirty(struct vnode *vp)
+{
+	int dirty;
+
+	if (!vp->v_pcache)
+		return 0;
+
+	uk_mutex_lock(&pcache_lock);
+	dirty = vp->v_pcache->ndirty > 0;
+	uk_mutex_unlock(&pcache_lock);
+	return dirty;
+}
+
+void vfscore_pcache_truncate(struct vnode *vp, off_t length)
+{
+	struct vfscore_pcnode *pn;
+	struct vfscore_pcpage *pg;
+	size_t pgoff;
+
+	if (!vfscore_pcache_enabled(vp))
+		return;
+
+	uk_mutex_lock(&pcache_lock);
+	pn = pcache_node_get(vp);
+	if (unlikely(!pn))
+		goto out;
+
+	pcache_node_drop(pn, (unsigned long) ((length + PAGE_SIZE - 1) >>
+					      PAGE_SHIFT), ULONG_MAX);
+
+	/* The tail of the last page must read as zeros if the file grows */
+	pgoff = (size_t) (length & (PAGE_SIZE - 1));
+	if (pgoff) {
+		pg = pcache_page_find(pn, (unsigned long) (length >>
+							   PAGE_SHIFT));
+		if (pg)
+			memset((char *) pg->data + pgoff, 0,
+			       PAGE_SIZE - pgoff);
+	}
+out:
+	uk_mutex_unlock(&pcache_lock);
+}
+
+int vfscore_pcache_invalidate(struct vnode *vp, off_t off, off_t len)
+{
+	struct vfscore_pcnode *pn;
+	unsigned long first, last;
+	int error;
+
+	if (!vfscore_pcache_enabled(vp) || len <= 0)
+		return 0;
+
+	uk_mutex_lock(&pcache_lock);
+	pn = pcache_node_get(vp);
+	uk_mutex_unlock(&pcache_lock);
+	if (unlikely(!pn))
+		return 0;
+
+	first = (unsigned long) (off >> PAGE_SHIFT);
+	last = pcache_last(off, len);
+	error = pcache_writeback(vp, pn, first, last);
+	if (unlikely(error))
+		return error;
+
+	uk_mutex_lock(&pcache_lock);
+	pcache_node_drop(pn, first, last);
+	uk_mutex_unlock(&pcache_lock);
+	return 0;
+}
+
+void vfscore_pcache_remove(struct vnode *vp)
+{
+	struct vfscore_pcnode *pn;
+
+	if (!vfscore_pcache_enabled(vp))
+		return;
+
+	uk_mutex_lock(&pcache_lock);
+	pn = pcache_node_get(vp);
+	if (likely(pn))
+		pn->removed = 1;
+	uk_mutex_unlock(&pcache_lock);
+}
+
+void vfscore_pcache_release(struct vnode *vp)
+{
+	struct vfscore_pcnode *pn = vp->v_pcache;
+	int error = 0;
+
+	if (!pn)
+		return;
+
+	/* Nobody else can use the vnode anymore, so no lock is needed */
+	if (!pn->removed) {
+		error = pcache_writeback(vp, pn, 0, ULONG_MAX);
+		if (unlikely(error))
+			uk_pr_err("Failed to write back cached data of inode %"
+				  PRIu64": %d\n", vp->v_ino, error);
+	}
+
+	uk_mutex_lock(&pcache_lock);
+	if (pn->removed || error)
+		pcache_node_drop(pn, 0, ULONG_MAX);
+
+	UK_ASSERT(!pn->ndirty);
+	pn->size = vp->v_size;
+	pn->vp = NULL;
+	vp->v_pcache = NULL;
+	pcache_node_put(pn);
+	uk_mutex_unlock(&pcache_lock);
+}
+
+/* Moves the unused nodes of `mp` in the buckets of `b` to `victims` */
+static void pcache_unmount_isolate(struct vfscore_htable_buckets *b,
+				   struct mount *mp,
+				   struct uk_hlist_head *victims)
+{
+	struct vfscore_pcnode *pn;
+	struct uk_hlist_node *tmp;
+	unsigned long i;
+
+	for (i = 0; i < vfscore_htable_size(b); i++) {
+		uk_hlist_for_each_entry_safe(pn, tmp, &b->head[i], link) {
+			if (pn->mp != mp || pn->vp)
+				continue;
+
+			uk_hlist_del(&pn->link);
+			uk_hlist_add_head(&pn->link, victims);
+		}
+	}
+}
+
+void vfscore_pcache_unmount(struct mount *mp)
+{
+	UK_HLIST_HEAD(victims);
+	struct vfscore_pcnode *pn;
+	struct uk_hlist_node *tmp;
+
+	/* Freeing nodes may resize the table, so collect them first */
+	uk_mutex_lock(&pcache_lock);
+	pcache_unmount_isolate(pcache_table.cur, mp, &victims);
+	pcache_unmount_isolate(pcache_table.old, mp, &victims);
+	uk_hlist_for_each_entry_safe(pn, tmp, &victims, link) {
+		pcache_node_drop(pn, 0, ULONG_MAX);
+		pcache_node_put(pn);
+	}
+	uk_mutex_unlock(&pcache_lock);
+}
+
+void vfscore_pcache_init(void)
+{
+	vfscore_htable_init(&pcache_table, pcache_node_hash);
+}
+
+/* Brings the pages in [first, last] into the cache */
+static void pcache_prefetch(struct vnode *vp, struct vfscore_file *fp,
+			    unsigned long first, unsigned long last)
+{
+	struct vfscore_pcnode *pn;
+	struct vfscore_pcpage *pg;
+	unsigned long idx;
+
+	uk_mutex_lock(&pcache_lock);
+	pn = pcache_node_get(vp);
+	uk_mutex_unlock(&pcache_lock);
+	if (unlikely(!pn))
+		return;
+
+	for (idx = first; idx <= last; idx++) {
+		pg = pcache_page_get(pn, idx);
+		if (!pg && pcache_fill(vp, fp, pn, idx, last - idx + 1, &pg))
+			break;
+
+		pcache_page_put(pg, 0);
+	}
+}
+
+int vfscore_pcache_advise(struct vfscore_file *fp, off_t off, off_t len,
+			  int advice)
+{
+	struct vnode *vp = fp->f_dentry->d_vnode;
+	unsigned long first, last, end;
+	int error = 0;
+
+	switch (advice) {
+	case POSIX_FADV_NORMAL:
+	case POSIX_FADV_SEQUENTIAL:
+	case POSIX_FADV_RANDOM:
+		vn_lock(vp);
+		fp->f_ra_advice = advice;
+		fp->f_ra_window = 0;
+		vn_unlock(vp);
+		return 0;
+	case POSIX_FADV_WILLNEED:
+	case POSIX_FADV_DONTNEED:
+		break;
+	default:
+		return 0;
+	}
+
+	if (!vfscore_pcache_enabled(vp))
+		return 0;
+
+	vn_lock(vp);
+	if (advice == POSIX_FADV_DONTNEED) {
+		/* A length of zero means until the end of the file */
+		error = vfscore_pcache_invalidate(vp, off,
+						  len ? len : __OFF_MAX - off);
+		goto out;
+	}
+
+	if (off >= vp->v_size)
+		goto out;
+
+	/* Never prefetch more than half of the cache */
+	first = (unsigned long) (off >> PAGE_SHIFT);
+	end = (unsigned long) ((vp->v_size - 1) >> PAGE_SHIFT);
+	last = len ? MIN(pcache_last(off, len), end) : end;
+	last = MIN(last, first + PCACHE_MAX_PAGES / 2);
+	pcache_prefetch(vp, fp, first, last);
+out:
+	vn_unlock(vp);
+	return error;
+}
@@ -262,19 +262,10 @@ void pipe_file_free(struct pipe_file *pipe_file)
 static void
 pipe_file_event(struct pipe_file *pipe_file, unsigned int event)
 {
-	struct eventpoll_cb *ecb;
-	struct uk_list_head *itr;
-
 	UK_ASSERT(pipe_file);
 
 	uk_mutex_lock(&pipe_file->evp_lock);
-	uk_list_for_each(itr, &pipe_file->evp_list) {
-		ecb = uk_list_entry(itr, struct eventpoll_cb, cb_link);
-
-		UK_ASSERT(ecb->unregister);
-
-		eventpoll_signal(ecb, event);
-	}
+	eventpoll_signal_list(&pipe_file->evp_list, event);
 	uk_mutex_unlock(&pipe_file->evp_lock);
 }
 
@@ -199,6 +199,10 @@ static struct vnops stdio_vnops = {
 	stdio_readlink,		/* read link */
 	stdio_symlink,		/* symbolic link */
 	stdio_poll,		/* poll */
+	(vnop_splice_read_t) NULL, /* splice read */
+	(vnop_map_t) NULL,	/* map */
+	(vnop_unmap_t) NULL,	/* unmap */
+	(vnop_getpage_t) NULL,	/* get page */
 };
 
 static struct vnode stdio_vnode = {
@@ -46,6 +46,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <uk/essentials.h>
 #if CONFIG_LIBPOSIX_PROCESS_CLONE
 #include <uk/process.h>
 #endif /* CONFIG_LIBPOSIX_PROCESS_CLONE */
@@ -54,6 +55,7 @@
 #include <vfscore/prex.h>
 #include <vfscore/vnode.h>
 #include <vfscore/file.h>
+#include <vfscore/pagecache.h>
 
 #include "vfs.h"
 #include <vfscore/fs.h>
@@ -216,6 +218,7 @@ sys_open(char *path, int flags, mode_t mode, struct vfscore_file **fpp)
 		error = VOP_TRUNCATE(vp, 0);
 		if (error)
 			goto out_fp_free_unlock;
+		vfscore_pcache_truncate(vp, 0);
 	}
 
 	error = VOP_OPEN(vp, fp);
@@ -342,6 +345,181 @@ sys_write(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 	return error;
 }
 
+/* Maximum number of bytes and of file data references that are transferred
+ * in one step of sys_splice()
+ */
+#define SPLICE_CHUNK	(64 * 1024)
+#define SPLICE_IOVMAX	16
+
+static int
+splice_mapped(struct vfscore_file *in_fp, off_t in_off,
+	      struct vfscore_file *out_fp, off_t out_off,
+	      size_t len, size_t *count)
+{
+	struct vnode *in_vp = in_fp->f_dentry->d_vnode;
+	struct vnode *out_vp = out_fp->f_dentry->d_vnode;
+	struct iovec iov[SPLICE_IOVMAX];
+	struct uio uio;
+	size_t mapped;
+	int error;
+
+	/* The references into the source are only stable as long as we hold
+	 * its vnode lock, including during the write. If the destination is a
+	 * regular file, we take both locks in address order so that we do not
+	 * deadlock against a transfer in the opposite direction. vfs_write()
+	 * then takes the destination lock recursively. Sockets and pipes
+	 * do not lock other vnodes, so we leave their locking to vfs_write().
+	 */
+	if (out_vp->v_type == VREG && out_vp < in_vp)
+		vn_lock(out_vp);
+	vn_lock(in_vp);
+	if (out_vp->v_type == VREG && out_vp > in_vp)
+		vn_lock(out_vp);
+
+	uio.uio_iov = iov;
+	uio.uio_iovcnt = SPLICE_IOVMAX;
+	uio.uio_offset = (in_off == -1) ? in_fp->f_offset : in_off;
+	uio.uio_resid = len;
+	uio.uio_rw = UIO_READ;
+	error = VOP_SPLICE_READ(in_vp, in_fp, &uio);
+	mapped = len - uio.uio_resid;
+	*count = 0;
+	if (error || mapped == 0)
+		goto out;
+
+	uio.uio_iovcnt = SPLICE_IOVMAX - uio.uio_iovcnt;
+	uio.uio_iov = iov;
+	uio.uio_offset = out_off;
+	uio.uio_resid = mapped;
+	uio.uio_rw = UIO_WRITE;
+	error = vfs_write(out_fp, &uio, (out_off == -1) ? 0 : FOF_OFFSET);
+	*count = mapped - uio.uio_resid;
+
+	if (in_off == -1 && !(in_fp->f_vfs_flags & UK_VFSCORE_NOPOS))
+		in_fp->f_offset += *count;
+out:
+	if (out_vp->v_type == VREG && out_vp != in_vp)
+		vn_unlock(out_vp);
+	vn_unlock(in_vp);
+	return error;
+}
+
+static int
+splice_copy(struct vfscore_file *in_fp, off_t in_off,
+	    struct vfscore_file *out_fp, off_t out_off,
+	    void *buf, size_t len, size_t *count)
+{
+	struct iovec iov;
+	struct uio uio;
+	size_t done, n;
+	int error;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_offset = in_off;
+	uio.uio_resid = len;
+	uio.uio_rw = UIO_READ;
+	error = vfs_read(in_fp, &uio, (in_off == -1) ? 0 : FOF_OFFSET);
+	n = len - uio.uio_resid;
+	*count = 0;
+	if (error || n == 0)
+		return error;
+
+	/* Data read from a non-seekable source cannot be put back, so we
+	 * keep writing until it is consumed or the destination fails.
+	 */
+	done = 0;
+	do {
+		iov.iov_base = (char *)buf + done;
+		iov.iov_len = n - done;
+		uio.uio_iov = &iov;
+		uio.uio_iovcnt = 1;
+		uio.uio_offset = (out_off == -1) ? -1 : out_off + (off_t)done;
+		uio.uio_resid = n - done;
+		uio.uio_rw = UIO_WRITE;
+		error = vfs_write(out_fp, &uio,
+				  (out_off == -1) ? 0 : FOF_OFFSET);
+		done += (n - done) - uio.uio_resid;
+	} while (!error && done < n &&
+		 (in_fp->f_vfs_flags & UK_VFSCORE_NOPOS));
+
+	/* Rewind the source to the first byte that was not written */
+	if (done < n && in_off == -1 &&
+	    !(in_fp->f_vfs_flags & UK_VFSCORE_NOPOS)) {
+		vn_lock(in_fp->f_dentry->d_vnode);
+		in_fp->f_offset -= n - done;
+		vn_unlock(in_fp->f_dentry->d_vnode);
+	}
+
+	*count = done;
+	return error;
+}
+
+int
+sys_splice(struct vfscore_file *in_fp, off_t in_off,
+	   struct vfscore_file *out_fp, off_t out_off,
+	   size_t len, size_t *count)
+{
+	struct vnode *in_vp, *out_vp;
+	void *buf = NULL;
+	size_t chunk, n;
+	int mapped;
+	int error = 0;
+
+	if ((in_fp->f_flags & UK_FREAD) == 0)
+		return EBADF;
+	if ((out_fp->f_flags & UK_FWRITE) == 0)
+		return EBADF;
+
+	in_vp = in_fp->f_dentry->d_vnode;
+	out_vp = out_fp->f_dentry->d_vnode;
+
+	/* Writing into the vnode that we reference could move its data. The
+	 * data of cached files may not have reached the file system yet.
+	 */
+	mapped = in_vp->v_op->vop_splice_read && in_vp != out_vp &&
+		 !vfscore_pcache_enabled(in_vp);
+
+	if (len > IOSIZE_MAX)
+		len = IOSIZE_MAX;
+
+	*count = 0;
+	while (len > 0) {
+		chunk = MIN(len, (size_t)SPLICE_CHUNK);
+
+		if (mapped) {
+			error = splice_mapped(in_fp, in_off, out_fp, out_off,
+					      chunk, &n);
+		} else {
+			if (!buf) {
+				buf = malloc(chunk);
+				if (!buf) {
+					error = ENOMEM;
+					break;
+				}
+			}
+			error = splice_copy(in_fp, in_off, out_fp, out_off,
+					    buf, chunk, &n);
+		}
+
+		*count += n;
+		len -= n;
+		if (in_off != -1)
+			in_off += n;
+		if (out_off != -1)
+			out_off += n;
+
+		/* Stop at the end of the source or on a short write */
+		if (error || n < chunk)
+			break;
+	}
+
+	free(buf);
+	return error;
+}
+
 int
 sys_lseek(struct vfscore_file *fp, off_t off, int type, off_t *origin)
 {
@@ -439,7 +617,9 @@ sys_fsync(struct vfscore_file *fp)
 
 	vp = fp->f_dentry->d_vnode;
 	vn_lock(vp);
-	error = VOP_FSYNC(vp, fp);
+	error = vfscore_pcache_sync(vp);
+	if (!error)
+		error = VOP_FSYNC(vp, fp);
 	vn_unlock(vp);
 	return error;
 }
@@ -857,6 +1037,9 @@ sys_rename(char *src, char *dest)
 	if (error)
 		goto err3;
 
+	if (vp2 && vp2 != vp1)
+		vfscore_pcache_remove(vp2);
+
 	error = dentry_move(dp1, ddp2, dname);
 
 	if (dp2)
@@ -1031,6 +1214,8 @@ sys_unlink(char *path)
 	}
 	error = VOP_REMOVE(ddp->d_vnode, vp, name);
 	vn_unlock(ddp->d_vnode);
+	if (!error)
+		vfscore_pcache_remove(vp);
 
 	vn_unlock(vp);
 	dentry_remove(dp);
@@ -1170,6 +1355,8 @@ sys_truncate(char *path, off_t length)
 
 	vn_lock(dp->d_vnode);
 	error = VOP_TRUNCATE(dp->d_vnode, length);
+	if (!error)
+		vfscore_pcache_truncate(dp->d_vnode, length);
 	vn_unlock(dp->d_vnode);
 
 	drele(dp);
@@ -1188,6 +1375,8 @@ sys_ftruncate(struct vfscore_file *fp, off_t length)
 	vp = fp->f_dentry->d_vnode;
 	vn_lock(vp);
 	error = VOP_TRUNCATE(vp, length);
+	if (!error)
+		vfscore_pcache_truncate(vp, length);
 	vn_unlock(vp);
 
 	return error;
@@ -1528,7 +1717,14 @@ sys_fallocate(struct vfscore_file *fp, int mode, off_t offset, off_t len)
 		goto ret;
 	}
 
-	error = VOP_FALLOCATE(vp, mode, offset, len);
+	/* The file system must see all data and must not find stale pages
+	 * in the cache afterwards
+	 */
+	error = vfscore_pcache_sync(vp);
+	if (!error)
+		error = vfscore_pcache_invalidate(vp, offset, len);
+	if (!error)
+		error = VOP_FALLOCATE(vp, mode, offset, len);
 ret:
 	vn_unlock(vp);
 	return error;
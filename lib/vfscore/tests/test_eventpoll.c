@@ -0,0 +1,286 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <uk/test.h>
+#include <uk/alloc.h>
+#include <uk/essentials.h>
+#include <uk/sched.h>
+#include <uk/thread.h>
+#include <uk/arch/atomic.h>
+#include <uk/plat/time.h>
+#include <vfscore/eventpoll.h>
+#include <vfscore/file.h>
+#include <vfscore/dentry.h>
+#include <vfscore/vnode.h>
+
+/* A dummy file whose state is controlled by the test. The driver side keeps
+ * the context blocks of all eventpoll fds in a table indexed by fd so that
+ * the test can signal events for arbitrary fds.
+ */
+static unsigned int test_revents;
+static struct eventpoll_cb **test_cbs;
+static unsigned int test_cbs_len;
+
+static void test_unregister(struct eventpoll_cb *ecb)
+{
+	ecb->unregister = NULL;
+}
+
+static int test_poll(struct vnode *vnode __unused, unsigned int *revents,
+		     struct eventpoll_cb *ecb)
+{
+	struct eventpoll_fd *efd = __containerof(ecb, struct eventpoll_fd, cb);
+
+	if (!ecb->unregister) {
+		ecb->unregister = test_unregister;
+		if ((unsigned int)efd->fd < test_cbs_len)
+			test_cbs[efd->fd] = ecb;
+	}
+
+	*revents = test_revents;
+	return 0;
+}
+
+static struct vnops test_vnops = {
+	.vop_poll = test_poll,
+};
+
+static struct vnode test_vnode = {
+	.v_op = &test_vnops,
+};
+
+static struct dentry test_dentry = {
+	.d_vnode = &test_vnode,
+};
+
+static struct vfscore_file test_file = {
+	.f_dentry = &test_dentry,
+	.f_ep = UK_LIST_HEAD_INIT(test_file.f_ep),
+};
+
+UK_TESTCASE(vfscore_eventpoll, ctl)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct eventpoll ep;
+	int fd;
+
+	test_revents = 0;
+	eventpoll_init(&ep, uk_alloc_get_default());
+
+	/* Enough fds to grow the hash table a few times */
+	for (fd = 0; fd < 256; ++fd) {
+		ev.data.u32 = fd;
+		UK_TEST_EXPECT_ZERO(eventpoll_add(&ep, fd, &test_file, &ev));
+	}
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_add(&ep, 42, &test_file, &ev),
+			       -EEXIST);
+
+	for (fd = 0; fd < 256; fd += 2)
+		UK_TEST_EXPECT_ZERO(eventpoll_del(&ep, fd));
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_del(&ep, 42), -ENOENT);
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_mod(&ep, 42, &ev), -ENOENT);
+	UK_TEST_EXPECT_ZERO(eventpoll_mod(&ep, 43, &ev));
+
+	/* EPOLLEXCLUSIVE is only allowed on add and with some events */
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_mod(&ep, 43, &ev), -EINVAL);
+	UK_TEST_EXPECT_ZERO(eventpoll_add(&ep, 42, &test_file, &ev));
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_mod(&ep, 42, &ev), -EINVAL);
+	ev.events = EPOLLIN | EPOLLEXCLUSIVE | EPOLLONESHOT;
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_add(&ep, 44, &test_file, &ev),
+			       -EINVAL);
+
+	eventpoll_fini(&ep);
+	UK_TEST_EXPECT(uk_list_empty(&test_file.f_ep));
+}
+
+UK_TESTCASE(vfscore_eventpoll, ready_list)
+{
+	struct eventpoll_cb *cbs[4];
+	struct epoll_event ev, events[4];
+	struct eventpoll ep;
+	__nsec timeout = 0;
+	int fd;
+
+	test_cbs = cbs;
+	test_cbs_len = ARRAY_SIZE(cbs);
+	test_revents = 0;
+	eventpoll_init(&ep, uk_alloc_get_default());
+
+	/* fd 0 and 1 are level-triggered, fd 2 and 3 edge-triggered */
+	for (fd = 0; fd < 4; ++fd) {
+		ev.events = EPOLLIN | ((fd >= 2) ? EPOLLET : 0);
+		ev.data.u32 = fd;
+		UK_TEST_EXPECT_ZERO(eventpoll_add(&ep, fd, &test_file, &ev));
+	}
+
+	UK_TEST_EXPECT_ZERO(eventpoll_wait(&ep, events, 4, &timeout));
+
+	test_revents = EPOLLIN;
+	eventpoll_signal(cbs[1], EPOLLIN);
+	eventpoll_signal(cbs[3], EPOLLIN | EPOLLOUT);
+
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_wait(&ep, events, 4, &timeout), 2);
+	UK_TEST_EXPECT_SNUM_EQ(events[0].data.u32, 1);
+	UK_TEST_EXPECT_SNUM_EQ(events[1].data.u32, 3);
+	UK_TEST_EXPECT_SNUM_EQ(events[1].events, EPOLLIN);
+
+	/* Only the level-triggered fd is still reported */
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_wait(&ep, events, 4, &timeout), 1);
+	UK_TEST_EXPECT_SNUM_EQ(events[0].data.u32, 1);
+
+	/* ...until it is not ready anymore */
+	test_revents = 0;
+	UK_TEST_EXPECT_ZERO(eventpoll_wait(&ep, events, 4, &timeout));
+
+	eventpoll_fini(&ep);
+	test_cbs = NULL;
+	test_cbs_len = 0;
+}
+
+static int exclusive_nevents = -1;
+
+static __noreturn void exclusive_waiter(void *arg)
+{
+	struct epoll_event events[1];
+
+	ukarch_store_n(&exclusive_nevents,
+		       eventpoll_wait((struct eventpoll *) arg, events, 1,
+				      NULL));
+	uk_sched_thread_exit();
+}
+
+/* Two eventpolls watch the same driver list with EPOLLEXCLUSIVE. Only the
+ * waiter of the first one is woken up, but both must see the event.
+ */
+UK_TESTCASE(vfscore_eventpoll, exclusive_list)
+{
+	struct epoll_event ev = { .events = EPOLLIN | EPOLLEXCLUSIVE };
+	struct epoll_event events[1];
+	struct eventpoll_cb *cbs[2];
+	struct uk_list_head list;
+	struct eventpoll ep[2];
+	struct uk_thread *t;
+	__nsec timeout = 0;
+	int fd;
+
+	test_cbs = cbs;
+	test_cbs_len = ARRAY_SIZE(cbs);
+	test_revents = 0;
+	UK_INIT_LIST_HEAD(&list);
+	for (fd = 0; fd < 2; ++fd) {
+		eventpoll_init(&ep[fd], uk_alloc_get_default());
+		ev.data.u32 = fd;
+		UK_TEST_EXPECT_ZERO(eventpoll_add(&ep[fd], fd, &test_file,
+						  &ev));
+		uk_list_add_tail(&cbs[fd]->cb_link, &list);
+	}
+
+	t = uk_sched_thread_create(uk_sched_current(), exclusive_waiter,
+				   &ep[0], "test_eventpoll");
+	UK_TEST_ASSERT(t != NULL);
+	while (uk_thread_is_runnable(t))
+		uk_sched_yield();
+
+	test_revents = EPOLLIN;
+	eventpoll_signal_list(&list, EPOLLIN);
+	UK_TEST_EXPECT_SNUM_EQ(eventpoll_wait(&ep[1], events, 1, &timeout), 1);
+
+	while (ukarch_load_n(&exclusive_nevents) < 0)
+		uk_sched_yield();
+	UK_TEST_EXPECT_SNUM_EQ(exclusive_nevents, 1);
+
+	for (fd = 0; fd < 2; ++fd) {
+		uk_list_del(&cbs[fd]->cb_link);
+		eventpoll_fini(&ep[fd]);
+	}
+	test_cbs = NULL;
+	test_cbs_len = 0;
+}
+
+/* Benchmark: Control operations and waits on eventpolls with many fds. A
+ * single fd is signaled for each wait so that the costs of both should be
+ * independent of the number of monitored fds.
+ */
+#define BENCH_WAITS	10000
+
+UK_TESTCASE(vfscore_eventpoll, bench_scalability)
+{
+	static const unsigned int nfds[] = { 1000, 10000, 100000 };
+	struct uk_alloc *a = uk_alloc_get_default();
+	struct epoll_event ev, events[16];
+	struct eventpoll *ep;
+	__nsec timeout = 0;
+	__nsec t_add, t_mod, t_wait, t_del;
+	unsigned int i, fd, n;
+	int rc;
+
+	ep = uk_malloc(a, sizeof(*ep));
+	UK_TEST_ASSERT(ep != NULL);
+	test_revents = 0;
+
+	for (i = 0; i < ARRAY_SIZE(nfds); ++i) {
+		n = nfds[i];
+		test_cbs = uk_calloc(a, n, sizeof(*test_cbs));
+		if (!test_cbs) {
+			uk_test_printf("%u fds: Out of memory\n", n);
+			break;
+		}
+		test_cbs_len = n;
+
+		eventpoll_init(ep, a);
+		ev.events = EPOLLIN | EPOLLET;
+
+		t_add = ukplat_monotonic_clock();
+		for (fd = 0; fd < n; ++fd) {
+			ev.data.u32 = fd;
+			rc = eventpoll_add(ep, fd, &test_file, &ev);
+			if (unlikely(rc))
+				break;
+		}
+		t_add = ukplat_monotonic_clock() - t_add;
+		UK_TEST_EXPECT_ZERO(rc);
+		n = fd;
+
+		t_mod = ukplat_monotonic_clock();
+		for (fd = 0; fd < n; ++fd) {
+			ev.data.u32 = fd;
+			eventpoll_mod(ep, fd, &ev);
+		}
+		t_mod = ukplat_monotonic_clock() - t_mod;
+
+		t_wait = ukplat_monotonic_clock();
+		for (fd = 0; n && fd < BENCH_WAITS; ++fd) {
+			eventpoll_signal(test_cbs[(fd * 7919) % n], EPOLLIN);
+			eventpoll_wait(ep, events, ARRAY_SIZE(events),
+				       &timeout);
+		}
+		t_wait = ukplat_monotonic_clock() - t_wait;
+
+		t_del = ukplat_monotonic_clock();
+		for (fd = 0; fd < n; ++fd)
+			eventpoll_del(ep, fd);
+		t_del = ukplat_monotonic_clock() - t_del;
+
+		eventpoll_fini(ep);
+		uk_free(a, test_cbs);
+		test_cbs = NULL;
+		test_cbs_len = 0;
+
+		if (n == 0)
+			break;
+
+		uk_test_printf("%6u fds: add %"__PRInsec" ns, mod %"__PRInsec
+			       " ns, signal+wait %"__PRInsec" ns, del %"
+			       __PRInsec" ns\n", n, t_add / n, t_mod / n,
+			       t_wait / BENCH_WAITS, t_del / n);
+	}
+
+	uk_free(a, ep);
+}
+
+uk_testsuite_register(vfscore_eventpoll, NULL);
@@ -0,0 +1,228 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <uk/test.h>
+#include <uk/essentials.h>
+#include <uk/plat/time.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+
+#define TEST_MNT	"/lookup"
+#define TEST_FILES	8192
+#define BENCH_FILES	2048
+#define BENCH_ROUNDS	8
+
+/*
+ * A file system with a flat directory of files named f0, f1, ..., that
+ * counts the lookups that reach it and the vnodes that are alive.
+ */
+static unsigned int lkt_lookups;
+static unsigned int lkt_vnodes;
+
+static int lkt_lookup(struct vnode *dvp, const char *name,
+		      struct vnode **vpp)
+{
+	struct vnode *vp;
+	unsigned long n;
+	char *end;
+
+	lkt_lookups++;
+	if (name[0] != 'f')
+		return ENOENT;
+
+	n = strtoul(name + 1, &end, 10);
+	if (*end || n >= TEST_FILES)
+		return ENOENT;
+
+	if (!vfscore_vget(dvp->v_mount, n + 1, &vp)) {
+		if (!vp)
+			return ENOMEM;
+
+		vp->v_type = VREG;
+		vp->v_mode = S_IFREG | 0444;
+		lkt_vnodes++;
+	}
+
+	*vpp = vp;
+	return 0;
+}
+
+static int lkt_getattr(struct vnode *vp, struct vattr *attr)
+{
+	attr->va_type = vp->v_type;
+	attr->va_mode = vp->v_mode & ~S_IFMT;
+	attr->va_nodeid = vp->v_ino;
+	attr->va_size = 0;
+	return 0;
+}
+
+static int lkt_inactive(struct vnode *vp)
+{
+	/* The root vnode is not created by lkt_lookup() */
+	if (vp->v_ino)
+		lkt_vnodes--;
+	return 0;
+}
+
+static int lkt_unmount(struct mount *mp, int flags __unused)
+{
+	vfscore_release_mp_dentries(mp);
+	return 0;
+}
+
+static struct vnops lkt_vnops = {
+	.vop_open = (vnop_open_t) vfscore_vop_nullop,
+	.vop_close = (vnop_close_t) vfscore_vop_nullop,
+	.vop_seek = (vnop_seek_t) vfscore_vop_nullop,
+	.vop_ioctl = (vnop_ioctl_t) vfscore_vop_einval,
+	.vop_fsync = (vnop_fsync_t) vfscore_vop_nullop,
+	.vop_lookup = lkt_lookup,
+	.vop_getattr = lkt_getattr,
+	.vop_inactive = lkt_inactive,
+};
+
+static struct vfsops lkt_vfsops = {
+	.vfs_mount = (vfsop_mount_t) vfscore_nullop,
+	.vfs_unmount = lkt_unmount,
+	.vfs_sync = (vfsop_sync_t) vfscore_nullop,
+	.vfs_vget = (vfsop_vget_t) vfscore_nullop,
+	.vfs_statfs = (vfsop_statfs_t) vfscore_nullop,
+	.vfs_vnops = &lkt_vnops,
+};
+
+static struct vfscore_fs_type lkt_fs = {
+	.vs_name = "lookuptest",
+	.vs_init = NULL,
+	.vs_op = &lkt_vfsops,
+};
+
+UK_FS_REGISTER(lkt_fs);
+
+static int test_mount(void)
+{
+	lkt_lookups = 0;
+	lkt_vnodes = 0;
+
+	if (mkdir(TEST_MNT, 0755) && errno != EEXIST)
+		return -1;
+	return mount("", TEST_MNT, "lookuptest", 0, NULL);
+}
+
+static void test_umount(void)
+{
+	umount2(TEST_MNT, 0);
+	rmdir(TEST_MNT);
+}
+
+/* Returns 1 if the file f<n> is found */
+static int test_stat(unsigned long n)
+{
+	char path[32];
+	struct stat st;
+
+	snprintf(path, sizeof(path), TEST_MNT "/f%lu", n);
+	if (stat(path, &st))
+		return 0;
+	return st.st_ino == n + 1;
+}
+
+UK_TESTCASE(vfscore_lookup, dentry_cache)
+{
+	struct stat st;
+
+	UK_TEST_ASSERT(test_mount() == 0);
+
+	UK_TEST_EXPECT(test_stat(0));
+	UK_TEST_EXPECT_SNUM_EQ(lkt_lookups, 1);
+
+	/* The unused dentry is found again without the file system */
+	lkt_lookups = 0;
+	UK_TEST_EXPECT(test_stat(0));
+#if CONFIG_LIBVFSCORE_DENTRY_CACHE > 0
+	UK_TEST_EXPECT_SNUM_EQ(lkt_lookups, 0);
+	UK_TEST_EXPECT_SNUM_EQ(lkt_vnodes, 1);
+#endif /* CONFIG_LIBVFSCORE_DENTRY_CACHE > 0 */
+
+	/* Misses are not cached */
+	lkt_lookups = 0;
+	UK_TEST_EXPECT_SNUM_EQ(stat(TEST_MNT "/g0", &st), -1);
+	UK_TEST_EXPECT_SNUM_EQ(errno, ENOENT);
+	UK_TEST_EXPECT_SNUM_EQ(stat(TEST_MNT "/g0", &st), -1);
+	UK_TEST_EXPECT_SNUM_EQ(lkt_lookups, 2);
+
+	/* Unmounting releases the unused dentries and their vnodes */
+	test_umount();
+	UK_TEST_EXPECT_SNUM_EQ(lkt_vnodes, 0);
+}
+
+UK_TESTCASE(vfscore_lookup, reclaim)
+{
+	unsigned long i;
+	int found = 1;
+
+	UK_TEST_ASSERT(test_mount() == 0);
+
+	/* The hash tables grow along */
+	for (i = 0; i < TEST_FILES; i++)
+		found &= test_stat(i);
+	UK_TEST_EXPECT(found);
+
+	/* Only the most recently used dentries are kept */
+	UK_TEST_EXPECT_SNUM_LE(lkt_vnodes, CONFIG_LIBVFSCORE_DENTRY_CACHE);
+
+	lkt_lookups = 0;
+	UK_TEST_EXPECT(test_stat(TEST_FILES - 1));
+#if CONFIG_LIBVFSCORE_DENTRY_CACHE > 0
+	UK_TEST_EXPECT_SNUM_EQ(lkt_lookups, 0);
+#endif /* CONFIG_LIBVFSCORE_DENTRY_CACHE > 0 */
+
+#if CONFIG_LIBVFSCORE_DENTRY_CACHE < TEST_FILES
+	UK_TEST_EXPECT(test_stat(0));
+	UK_TEST_EXPECT_SNUM_EQ(lkt_lookups, 1);
+#endif /* CONFIG_LIBVFSCORE_DENTRY_CACHE < TEST_FILES */
+
+	/* The hash tables shrink again */
+	test_umount();
+	UK_TEST_EXPECT_SNUM_EQ(lkt_vnodes, 0);
+}
+
+/* Benchmark: Path lookups that go to the file system and cached ones */
+UK_TESTCASE(vfscore_lookup, bench_stat)
+{
+	__nsec start, cold, warm;
+	unsigned long i, j;
+
+	UK_TEST_ASSERT(test_mount() == 0);
+
+	start = ukplat_monotonic_clock();
+	for (i = 0; i < BENCH_FILES; i++)
+		test_stat(i);
+	cold = ukplat_monotonic_clock() - start;
+
+	lkt_lookups = 0;
+	start = ukplat_monotonic_clock();
+	for (j = 0; j < BENCH_ROUNDS; j++)
+		for (i = 0; i < BENCH_FILES; i++)
+			test_stat(i);
+	warm = ukplat_monotonic_clock() - start;
+
+	uk_test_printf("stat() of %d files: %"__PRInsec" ns/op (fs lookup),"
+		       " %"__PRInsec" ns/op (%u fs lookups in %d rounds)\n",
+		       BENCH_FILES, cold / BENCH_FILES,
+		       warm / (BENCH_ROUNDS * BENCH_FILES), lkt_lookups,
+		       BENCH_ROUNDS);
+
+	test_umount();
+}
+
+uk_testsuite_register(vfscore_lookup, NULL);
@@ -0,0 +1,338 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+#include <uk/test.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/arch/limits.h>
+#include <uk/arch/paging.h>
+#include <uk/plat/time.h>
+#include <vfscore/mount.h>
+#include <vfscore/vnode.h>
+#include <vfscore/uio.h>
+
+#define TEST_MNT	"/pcache"
+#define TEST_FILE	TEST_MNT "/file"
+#define TEST_PAGES	64
+#define BENCH_ROUNDS	16
+
+/*
+ * A file system with a single file that counts the operations on it, so
+ * that the tests can tell which accesses are served from the cache.
+ */
+static char pct_data[2 * TEST_PAGES * PAGE_SIZE];
+static off_t pct_size;
+static unsigned int pct_reads;
+static unsigned int pct_writes;
+
+static int pct_read(struct vnode *vp __unused, struct vfscore_file *fp __unused,
+		    struct uio *uio, int ioflag __unused)
+{
+	size_t len;
+
+	pct_reads++;
+	if (uio->uio_offset >= pct_size)
+		return 0;
+
+	len = MIN((size_t) uio->uio_resid, (size_t) (pct_size -
+						     uio->uio_offset));
+	return vfscore_uiomove(pct_data + uio->uio_offset, (int) len, uio);
+}
+
+static int pct_write(struct vnode *vp, struct uio *uio, int ioflag __unused)
+{
+	int error;
+
+	pct_writes++;
+	if (uio->uio_offset + uio->uio_resid > (off_t) sizeof(pct_data))
+		return EFBIG;
+
+	error = vfscore_uiomove(pct_data + uio->uio_offset,
+				(int) uio->uio_resid, uio);
+	if (uio->uio_offset > pct_size)
+		pct_size = vp->v_size = uio->uio_offset;
+	return error;
+}
+
+static int pct_truncate(struct vnode *vp, off_t length)
+{
+	if (length > (off_t) sizeof(pct_data))
+		return EFBIG;
+
+	if (length > pct_size)
+		memset(pct_data + pct_size, 0, length - pct_size);
+	pct_size = vp->v_size = length;
+	return 0;
+}
+
+static int pct_getattr(struct vnode *vp, struct vattr *attr)
+{
+	attr->va_type = vp->v_type;
+	attr->va_mode = vp->v_mode & ~S_IFMT;
+	attr->va_nodeid = vp->v_ino;
+	attr->va_size = (vp->v_type == VREG) ? pct_size : 0;
+	return 0;
+}
+
+static int pct_lookup(struct vnode *dvp, const char *name,
+		      struct vnode **vpp)
+{
+	struct vnode *vp;
+
+	if (strcmp(name, "file"))
+		return ENOENT;
+
+	if (!vfscore_vget(dvp->v_mount, 1, &vp)) {
+		if (!vp)
+			return ENOMEM;
+
+		vp->v_type = VREG;
+		vp->v_mode = S_IFREG | 0666;
+		vp->v_size = pct_size;
+	}
+
+	*vpp = vp;
+	return 0;
+}
+
+static int pct_mount(struct mount *mp, const char *dev __unused,
+		     int flags __unused, const void *data __unused)
+{
+	mp->m_flags |= MNT_PAGECACHE;
+	return 0;
+}
+
+static int pct_unmount(struct mount *mp, int flags __unused)
+{
+	vfscore_release_mp_dentries(mp);
+	return 0;
+}
+
+static struct vnops pct_vnops = {
+	.vop_open = (vnop_open_t) vfscore_vop_nullop,
+	.vop_close = (vnop_close_t) vfscore_vop_nullop,
+	.vop_read = pct_read,
+	.vop_write = pct_write,
+	.vop_seek = (vnop_seek_t) vfscore_vop_nullop,
+	.vop_ioctl = (vnop_ioctl_t) vfscore_vop_einval,
+	.vop_fsync = (vnop_fsync_t) vfscore_vop_nullop,
+	.vop_lookup = pct_lookup,
+	.vop_getattr = pct_getattr,
+	.vop_inactive = (vnop_inactive_t) vfscore_vop_nullop,
+	.vop_truncate = pct_truncate,
+};
+
+static struct vfsops pct_vfsops = {
+	.vfs_mount = pct_mount,
+	.vfs_unmount = pct_unmount,
+	.vfs_sync = (vfsop_sync_t) vfscore_nullop,
+	.vfs_vget = (vfsop_vget_t) vfscore_nullop,
+	.vfs_statfs = (vfsop_statfs_t) vfscore_nullop,
+	.vfs_vnops = &pct_vnops,
+};
+
+static struct vfscore_fs_type pct_fs = {
+	.vs_name = "pcachetest",
+	.vs_init = NULL,
+	.vs_op = &pct_vfsops,
+};
+
+UK_FS_REGISTER(pct_fs);
+
+/* Mounts the test file system with a file of the given number of pages */
+static int test_mount(unsigned int pages)
+{
+	unsigned int i;
+
+	for (i = 0; i < pages * PAGE_SIZE; i++)
+		pct_data[i] = (char) (i % 251);
+	pct_size = pages * PAGE_SIZE;
+	pct_reads = 0;
+	pct_writes = 0;
+
+	if (mkdir(TEST_MNT, 0755) && errno != EEXIST)
+		return -1;
+	return mount("", TEST_MNT, "pcachetest", 0, NULL);
+}
+
+static void test_umount(void)
+{
+	umount2(TEST_MNT, 0);
+	rmdir(TEST_MNT);
+}
+
+static int test_read_page(int fd, unsigned long idx)
+{
+	char buf[PAGE_SIZE];
+	size_t i;
+
+	if (pread(fd, buf, sizeof(buf), idx * PAGE_SIZE) != sizeof(buf))
+		return 0;
+	for (i = 0; i < sizeof(buf); i++)
+		if (buf[i] != (char) ((idx * PAGE_SIZE + i) % 251))
+			return 0;
+	return 1;
+}
+
+UK_TESTCASE(vfscore_pagecache, read_hit)
+{
+	int fd;
+
+	UK_TEST_ASSERT(test_mount(TEST_PAGES) == 0);
+
+	fd = open(TEST_FILE, O_RDONLY);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT(test_read_page(fd, 0));
+	UK_TEST_EXPECT_SNUM_GT(pct_reads, 0);
+
+	/* Repeated reads do not reach the file system */
+	pct_reads = 0;
+	UK_TEST_EXPECT(test_read_page(fd, 0));
+	UK_TEST_EXPECT_SNUM_EQ(pct_reads, 0);
+
+	/* The cached data outlives the file description */
+	close(fd);
+	fd = open(TEST_FILE, O_RDONLY);
+	UK_TEST_ASSERT(fd >= 0);
+	UK_TEST_EXPECT(test_read_page(fd, 0));
+	UK_TEST_EXPECT_SNUM_EQ(pct_reads, 0);
+
+	close(fd);
+	test_umount();
+}
+
+UK_TESTCASE(vfscore_pagecache, readahead)
+{
+	unsigned long i;
+	int fd;
+
+	UK_TEST_ASSERT(test_mount(TEST_PAGES) == 0);
+
+	fd = open(TEST_FILE, O_RDONLY);
+	UK_TEST_ASSERT(fd >= 0);
+
+	/* Sequential reads fetch growing windows ahead */
+	for (i = 0; i < TEST_PAGES; i++)
+		UK_TEST_EXPECT(test_read_page(fd, i));
+	UK_TEST_EXPECT_SNUM_LE(pct_reads, TEST_PAGES / 8);
+
+	/* Random access fetches only what is needed */
+	UK_TEST_EXPECT_ZERO(posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED));
+	UK_TEST_EXPECT_ZERO(posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM));
+	pct_reads = 0;
+	for (i = 0; i < TEST_PAGES; i += 8)
+		UK_TEST_EXPECT(test_read_page(fd, i));
+	UK_TEST_EXPECT_SNUM_EQ(pct_reads, TEST_PAGES / 8);
+
+	/* WILLNEED brings the whole file into the cache */
+	UK_TEST_EXPECT_ZERO(posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED));
+	pct_reads = 0;
+	for (i = 0; i < TEST_PAGES; i++)
+		UK_TEST_EXPECT(test_read_page(fd, i));
+	UK_TEST_EXPECT_SNUM_EQ(pct_reads, 0);
+
+	UK_TEST_EXPECT_SNUM_EQ(posix_fadvise(fd, 0, 0, 42), EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(posix_fadvise(-1, 0, 0, POSIX_FADV_NORMAL),
+			       EBADF);
+
+	close(fd);
+	test_umount();
+}
+
+UK_TESTCASE(vfscore_pagecache, writeback)
+{
+	char buf[2 * PAGE_SIZE];
+	struct stat st;
+	int fd;
+
+	UK_TEST_ASSERT(test_mount(2) == 0);
+
+	fd = open(TEST_FILE, O_RDWR);
+	UK_TEST_ASSERT(fd >= 0);
+
+	/* Writes stay in the cache until fsync() */
+	memset(buf, 'a', sizeof(buf));
+	UK_TEST_EXPECT_SNUM_EQ(pwrite(fd, buf, sizeof(buf), PAGE_SIZE + 1),
+			       sizeof(buf));
+	UK_TEST_EXPECT_SNUM_EQ(pct_writes, 0);
+	UK_TEST_EXPECT_SNUM_EQ(pct_size, 2 * PAGE_SIZE);
+
+	UK_TEST_EXPECT_ZERO(fstat(fd, &st));
+	UK_TEST_EXPECT_SNUM_EQ(st.st_size, 3 * PAGE_SIZE + 1);
+
+	memset(buf, 0, sizeof(buf));
+	UK_TEST_EXPECT_SNUM_EQ(pread(fd, buf, 2, PAGE_SIZE), 2);
+	UK_TEST_EXPECT_SNUM_EQ(buf[0], (char) (PAGE_SIZE % 251));
+	UK_TEST_EXPECT_SNUM_EQ(buf[1], 'a');
+
+	UK_TEST_EXPECT_ZERO(fsync(fd));
+	UK_TEST_EXPECT_SNUM_GT(pct_writes, 0);
+	UK_TEST_EXPECT_SNUM_EQ(pct_size, 3 * PAGE_SIZE + 1);
+	UK_TEST_EXPECT_SNUM_EQ(pct_data[PAGE_SIZE], (char) (PAGE_SIZE % 251));
+	UK_TEST_EXPECT_SNUM_EQ(pct_data[3 * PAGE_SIZE], 'a');
+
+	/* Truncated data is not written back and reads as zeros */
+	UK_TEST_EXPECT_SNUM_EQ(pwrite(fd, "b", 1, 100), 1);
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_ftruncate((long) fd, 50));
+	UK_TEST_EXPECT_ZERO(uk_syscall_r_ftruncate((long) fd, 200));
+	UK_TEST_EXPECT_SNUM_EQ(pread(fd, buf, 1, 100), 1);
+	UK_TEST_EXPECT_SNUM_EQ(buf[0], 0);
+
+	/* Releasing the file writes back dirty pages */
+	UK_TEST_EXPECT_SNUM_EQ(pwrite(fd, "c", 1, 10), 1);
+	pct_writes = 0;
+	close(fd);
+	test_umount();
+	UK_TEST_EXPECT_SNUM_GT(pct_writes, 0);
+	UK_TEST_EXPECT_SNUM_EQ(pct_data[10], 'c');
+	UK_TEST_EXPECT_SNUM_EQ(pct_data[100], 0);
+}
+
+/* Benchmark: Re-reading a file with and without the cache */
+UK_TESTCASE(vfscore_pagecache, bench_reread)
+{
+	static char buf[TEST_PAGES * PAGE_SIZE];
+	__nsec start, cold = 0, warm = 0;
+	unsigned int cold_reads, i;
+	int fd;
+
+	UK_TEST_ASSERT(test_mount(TEST_PAGES) == 0);
+
+	fd = open(TEST_FILE, O_RDONLY);
+	UK_TEST_ASSERT(fd >= 0);
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		start = ukplat_monotonic_clock();
+		pread(fd, buf, sizeof(buf), 0);
+		cold += ukplat_monotonic_clock() - start;
+	}
+	cold_reads = pct_reads;
+
+	pct_reads = 0;
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		start = ukplat_monotonic_clock();
+		pread(fd, buf, sizeof(buf), 0);
+		warm += ukplat_monotonic_clock() - start;
+	}
+	UK_TEST_EXPECT_SNUM_EQ(pct_reads, 0);
+
+	uk_test_printf("re-read %d pages: cold %"__PRInsec" ns (%u fs reads),"
+		       " cached %"__PRInsec" ns\n", TEST_PAGES,
+		       cold / BENCH_ROUNDS, cold_reads / BENCH_ROUNDS,
+		       warm / BENCH_ROUNDS);
+
+	close(fd);
+	test_umount();
+}
+
+uk_testsuite_register(vfscore_pagecache, NULL);
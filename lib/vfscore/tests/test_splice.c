@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <uk/test.h>
+#include <uk/syscall.h>
+#include <uk/essentials.h>
+#include <uk/arch/time.h>
+#include <uk/plat/time.h>
+
+#define TEST_SRC	"/splice_src"
+#define TEST_DST	"/splice_dst"
+#define TEST_SIZE	(256 * 1024 + 123)
+#define BENCH_SIZE	(4 * 1024 * 1024)
+#define BENCH_BUFSIZE	(64 * 1024)
+#define BENCH_ROUNDS	16
+
+/* Creates a file of the given size filled with a recognizable pattern */
+static int test_mkfile(const char *path, size_t size)
+{
+	char buf[256];
+	size_t i, n;
+	ssize_t rc;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return fd;
+
+	for (i = 0; i < size; i += n) {
+		for (n = 0; n < sizeof(buf); ++n)
+			buf[n] = (char)((i + n) % 251);
+		n = MIN(sizeof(buf), size - i);
+		rc = write(fd, buf, n);
+		if (rc != (ssize_t)n) {
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+}
+
+/* Checks that the file holds the pattern at src_off of test_mkfile() */
+static int test_checkfile(int fd, off_t off, size_t size, off_t src_off)
+{
+	char buf[256];
+	size_t i, j, n;
+
+	for (i = 0; i < size; i += n) {
+		n = MIN(sizeof(buf), size - i);
+		if (pread(fd, buf, n, off + i) != (ssize_t)n)
+			return -1;
+		for (j = 0; j < n; ++j)
+			if (buf[j] != (char)((src_off + i + j) % 251))
+				return -1;
+	}
+	return 0;
+}
+
+static ssize_t test_sendfile(int out_fd, int in_fd, off_t *offset,
+			     size_t count)
+{
+	return uk_syscall_r_sendfile((long) out_fd, (long) in_fd,
+				     (long) offset, (long) count);
+}
+
+static ssize_t test_splice(int fd_in, off_t *off_in, int fd_out,
+			   off_t *off_out, size_t len, unsigned int flags)
+{
+	return uk_syscall_r_splice((long) fd_in, (long) off_in, (long) fd_out,
+				   (long) off_out, (long) len, (long) flags);
+}
+
+static ssize_t test_copy_file_range(int fd_in, off_t *off_in, int fd_out,
+				    off_t *off_out, size_t len,
+				    unsigned int flags)
+{
+	return uk_syscall_r_copy_file_range((long) fd_in, (long) off_in,
+					    (long) fd_out, (long) off_out,
+					    (long) len, (long) flags);
+}
+
+UK_TESTCASE(vfscore_splice, sendfile)
+{
+	int in_fd, out_fd;
+	off_t off;
+
+	in_fd = test_mkfile(TEST_SRC, TEST_SIZE);
+	if (in_fd < 0) {
+		uk_test_printf("No writable root file system, skipping\n");
+		return;
+	}
+	out_fd = open(TEST_DST, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(out_fd >= 0);
+
+	/* With an explicit offset, the file offset stays untouched */
+	off = 1000;
+	UK_TEST_EXPECT_SNUM_EQ(test_sendfile(out_fd, in_fd, &off, TEST_SIZE),
+			       TEST_SIZE - 1000);
+	UK_TEST_EXPECT_SNUM_EQ(off, TEST_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(lseek(in_fd, 0, SEEK_CUR), TEST_SIZE);
+	UK_TEST_EXPECT_ZERO(test_sendfile(out_fd, in_fd, &off, 1));
+
+	/* Without one, it is used and advanced */
+	UK_TEST_EXPECT_SNUM_EQ(lseek(in_fd, 0, SEEK_SET), 0);
+	UK_TEST_EXPECT_SNUM_EQ(test_sendfile(out_fd, in_fd, NULL, 1000), 1000);
+	UK_TEST_EXPECT_SNUM_EQ(lseek(in_fd, 0, SEEK_CUR), 1000);
+	UK_TEST_EXPECT_SNUM_EQ(lseek(out_fd, 0, SEEK_CUR), TEST_SIZE);
+
+	/* The destination now holds [1000, TEST_SIZE) followed by [0, 1000) */
+	UK_TEST_EXPECT_ZERO(test_checkfile(out_fd, 0, TEST_SIZE - 1000, 1000));
+	UK_TEST_EXPECT_ZERO(test_checkfile(out_fd, TEST_SIZE - 1000, 1000, 0));
+
+	UK_TEST_EXPECT_SNUM_EQ(test_sendfile(-1, in_fd, NULL, 1), -EBADF);
+
+	close(out_fd);
+	close(in_fd);
+	unlink(TEST_DST);
+	unlink(TEST_SRC);
+}
+
+UK_TESTCASE(vfscore_splice, copy_file_range)
+{
+	off_t off_in, off_out;
+	int in_fd, out_fd;
+
+	in_fd = test_mkfile(TEST_SRC, TEST_SIZE);
+	if (in_fd < 0)
+		return;
+	out_fd = open(TEST_DST, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(out_fd >= 0);
+
+	off_in = 0;
+	off_out = 0;
+	UK_TEST_EXPECT_SNUM_EQ(test_copy_file_range(in_fd, &off_in, out_fd,
+						    &off_out, 10, 1),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(test_copy_file_range(in_fd, &off_in, in_fd,
+						    &off_out, 10, 0),
+			       -EINVAL);
+
+	UK_TEST_EXPECT_SNUM_EQ(test_copy_file_range(in_fd, &off_in, out_fd,
+						    &off_out, TEST_SIZE, 0),
+			       TEST_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(off_in, TEST_SIZE);
+	UK_TEST_EXPECT_SNUM_EQ(off_out, TEST_SIZE);
+	UK_TEST_EXPECT_ZERO(test_checkfile(out_fd, 0, TEST_SIZE, 0));
+
+	/* Non-overlapping ranges in the same file */
+	off_in = 0;
+	off_out = TEST_SIZE;
+	UK_TEST_EXPECT_SNUM_EQ(test_copy_file_range(out_fd, &off_in, out_fd,
+						    &off_out, 251 * 4, 0),
+			       251 * 4);
+	UK_TEST_EXPECT_ZERO(test_checkfile(out_fd, TEST_SIZE, 251 * 4, 0));
+
+	close(out_fd);
+	close(in_fd);
+	unlink(TEST_DST);
+	unlink(TEST_SRC);
+}
+
+UK_TESTCASE(vfscore_splice, splice_pipe)
+{
+	int in_fd, out_fd, pipefd[2];
+	off_t off;
+
+	in_fd = test_mkfile(TEST_SRC, TEST_SIZE);
+	if (in_fd < 0)
+		return;
+	out_fd = open(TEST_DST, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(out_fd >= 0);
+	UK_TEST_ASSERT(uk_syscall_r_pipe((long) pipefd) == 0);
+
+	/* One end has to be a pipe and pipes do not take offsets */
+	off = 0;
+	UK_TEST_EXPECT_SNUM_EQ(test_splice(in_fd, &off, out_fd, NULL, 10, 0),
+			       -EINVAL);
+	UK_TEST_EXPECT_SNUM_EQ(test_splice(in_fd, &off, pipefd[1], &off, 10,
+					   0),
+			       -ESPIPE);
+
+	/* File -> pipe -> file, in pieces that fit into the pipe */
+	off = 0;
+	while (off < TEST_SIZE) {
+		ssize_t n, m;
+
+		n = test_splice(in_fd, &off, pipefd[1], NULL, 4096, 0);
+		UK_TEST_ASSERT(n > 0);
+		m = test_splice(pipefd[0], NULL, out_fd, NULL, n, 0);
+		UK_TEST_ASSERT(m == n);
+	}
+	UK_TEST_EXPECT_SNUM_EQ(lseek(out_fd, 0, SEEK_CUR), TEST_SIZE);
+	UK_TEST_EXPECT_ZERO(test_checkfile(out_fd, 0, TEST_SIZE, 0));
+
+	close(pipefd[0]);
+	close(pipefd[1]);
+	close(out_fd);
+	close(in_fd);
+	unlink(TEST_DST);
+	unlink(TEST_SRC);
+}
+
+/* Benchmark: Copies a file with sendfile() and with a read()/write() loop
+ * through a user buffer and reports the throughput of both.
+ */
+static __u64 bench_mibps(__nsec t)
+{
+	__u64 bytes = (__u64) BENCH_SIZE * BENCH_ROUNDS;
+
+	if (!t)
+		return 0;
+	return bytes * UKARCH_NSEC_PER_SEC / t / (1024 * 1024);
+}
+
+UK_TESTCASE(vfscore_splice, bench_vs_read_write)
+{
+	__nsec t_sendfile, t_rw;
+	int in_fd, out_fd, r;
+	ssize_t n;
+	char *buf;
+	off_t off;
+
+	in_fd = test_mkfile(TEST_SRC, BENCH_SIZE);
+	if (in_fd < 0)
+		return;
+	out_fd = open(TEST_DST, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	UK_TEST_ASSERT(out_fd >= 0);
+	buf = malloc(BENCH_BUFSIZE);
+	UK_TEST_ASSERT(buf != NULL);
+
+	t_sendfile = ukplat_monotonic_clock();
+	for (r = 0; r < BENCH_ROUNDS; ++r) {
+		lseek(out_fd, 0, SEEK_SET);
+		off = 0;
+		while (off < BENCH_SIZE)
+			if (test_sendfile(out_fd, in_fd, &off,
+					  BENCH_SIZE - off) <= 0)
+				break;
+	}
+	t_sendfile = ukplat_monotonic_clock() - t_sendfile;
+	UK_TEST_EXPECT_SNUM_EQ(off, BENCH_SIZE);
+
+	t_rw = ukplat_monotonic_clock();
+	for (r = 0; r < BENCH_ROUNDS; ++r) {
+		lseek(out_fd, 0, SEEK_SET);
+		lseek(in_fd, 0, SEEK_SET);
+		while ((n = read(in_fd, buf, BENCH_BUFSIZE)) > 0)
+			if (write(out_fd, buf, n) != n)
+				break;
+	}
+	t_rw = ukplat_monotonic_clock() - t_rw;
+	UK_TEST_EXPECT_ZERO(test_checkfile(out_fd, 0, BENCH_SIZE, 0));
+
+	uk_test_printf("sendfile: %"__PRIu64" MiB/s, read/write: %"__PRIu64
+		       " MiB/s\n", bench_mibps(t_sendfile), bench_mibps(t_rw));
+
+	free(buf);
+	close(out_fd);
+	close(in_fd);
+	unlink(TEST_DST);
+	unlink(TEST_SRC);
+}
+
+uk_testsuite_register(vfscore_splice, NULL);
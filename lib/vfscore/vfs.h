@@ -164,6 +164,33 @@ int sys_read(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 int sys_write(struct vfscore_file *fp, const struct iovec *iov, size_t niov,
 		off_t offset, size_t *count);
 
+/**
+ * Transfers up to len bytes from the file in_fp to the file out_fp without
+ * going through a user-provided buffer. If the source file system supports
+ * it, the data is handed to the destination directly from the file system
+ * storage (see VOP_SPLICE_READ). Otherwise, it is bounced through an
+ * internal buffer.
+ *
+ * @param in_fp
+ *	Pointer to the vfscore_file structure to read from
+ * @param in_off
+ *	Offset to start reading at, or -1 to use and advance the file offset
+ * @param out_fp
+ *	Pointer to the vfscore_file structure to write to
+ * @param out_off
+ *	Offset to start writing at, or -1 to use and advance the file offset
+ * @param len
+ *	Maximum number of bytes to transfer
+ * @param[out] count
+ *	Number of bytes transferred
+ * @return
+ *	- (0):  Completed successfully
+ *	- (>0): Positive value with error code
+ */
+int sys_splice(struct vfscore_file *in_fp, off_t in_off,
+	       struct vfscore_file *out_fp, off_t out_off,
+	       size_t len, size_t *count);
+
 /**
  * Repositions read/write file cursor.
  *
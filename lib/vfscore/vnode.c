@@ -47,6 +47,8 @@
 #include <vfscore/prex.h>
 #include <vfscore/dentry.h>
 #include <vfscore/vnode.h>
+#include <vfscore/pagecache.h>
+#include "htable.h"
 #include "vfs.h"
 
 #define __UK_S_BLKSIZE 512
@@ -55,9 +57,9 @@ enum vtype iftovt_tab[16] = {
 	VNON, VFIFO, VCHR, VNON, VDIR, VNON, VBLK, VNON,
 	VREG, VNON, VLNK, VNON, VSOCK, VNON, VNON, VBAD,
 };
-int vttoif_tab[10] = {
+int vttoif_tab[11] = {
 	0, S_IFREG, S_IFDIR, S_IFBLK, S_IFCHR, S_IFLNK,
-	S_IFSOCK, S_IFIFO, S_IFMT, S_IFMT
+	S_IFSOCK, S_IFIFO, S_IFMT, S_IFMT, S_IFMT
 };
 
 /*
@@ -73,14 +75,12 @@ int vttoif_tab[10] = {
  * vrele      -1        *
  */
 
-#define VNODE_BUCKETS 32		/* size of vnode hash table */
-
 /*
  * vnode table.
  * All active (opened) vnodes are stored on this hash table.
- * They can be accessed by its path name.
+ * They can be accessed by its mount point and inode number.
  */
-static struct uk_list_head vnode_table[VNODE_BUCKETS];
+static struct vfscore_htable vnode_table;
 
 /*
  * Global lock to access all vnodes and vnode table.
@@ -97,12 +97,33 @@ static struct uk_mutex vnode_lock = UK_MUTEX_INITIALIZER(vnode_lock);
 
 
 /*
- * Get the hash value from the mount point and path name.
- * XXX(hch): replace with a better hash for 64-bit pointers.
+ * Get the hash value from the mount point and inode number.
  */
-static unsigned int vn_hash(struct mount *mp, uint64_t ino)
+static unsigned long vn_hash(struct mount *mp, uint64_t ino)
 {
-	return (ino ^ (unsigned long)mp) & (VNODE_BUCKETS - 1);
+	return vfscore_hash_mix(ino ^ vfscore_hash_ptr(mp));
+}
+
+static unsigned long vn_node_hash(struct uk_hlist_node *n)
+{
+	struct vnode *vp = uk_hlist_entry(n, struct vnode, v_link);
+
+	return vn_hash(vp->v_mount, vp->v_ino);
+}
+
+static struct vnode *
+vn_find(struct uk_hlist_head *head, struct mount *mp, uint64_t ino)
+{
+	struct vnode *vp;
+
+	if (!head)
+		return NULL;
+
+	uk_hlist_for_each_entry(vp, head, v_link) {
+		if (vp->v_mount == mp && vp->v_ino == ino)
+			return vp;
+	}
+	return NULL;
 }
 
 /*
@@ -114,17 +135,22 @@ static unsigned int vn_hash(struct mount *mp, uint64_t ino)
 struct vnode *
 vn_lookup(struct mount *mp, uint64_t ino)
 {
+	unsigned long hash = vn_hash(mp, ino);
 	struct vnode *vp;
 
 	UK_ASSERT(VNODE_OWNED());
-	uk_list_for_each_entry(vp, &vnode_table[vn_hash(mp, ino)], v_link) {
-		if (vp->v_mount == mp && vp->v_ino == ino) {
-			vp->v_refcnt++;
-			uk_mutex_lock(&vp->v_lock);
-			return vp;
-		}
-	}
-	return NULL;		/* not found */
+
+	/* The vnode is in the old buckets if they are not migrated yet */
+	vp = vn_find(vfscore_htable_head(vnode_table.cur, hash), mp, ino);
+	if (!vp)
+		vp = vn_find(vfscore_htable_head(vnode_table.old, hash),
+			     mp, ino);
+	if (!vp)
+		return NULL;	/* not found */
+
+	vp->v_refcnt++;
+	uk_mutex_lock(&vp->v_lock);
+	return vp;
 }
 
 #ifdef DEBUG_VFS
@@ -214,7 +240,7 @@ vfscore_vget(struct mount *mp, uint64_t ino, struct vnode **vpp)
 	vfs_busy(vp->v_mount);
 	uk_mutex_lock(&vp->v_lock);
 
-	uk_list_add(&vp->v_link, &vnode_table[vn_hash(mp, ino)]);
+	vfscore_htable_add(&vnode_table, &vp->v_link, vn_hash(mp, ino));
 	VNODE_UNLOCK();
 
 	*vpp = vp;
@@ -239,9 +265,11 @@ vput(struct vnode *vp)
 		vn_unlock(vp);
 		return;
 	}
-	uk_list_del(&vp->v_link);
+	vfscore_htable_del(&vnode_table, &vp->v_link);
 	VNODE_UNLOCK();
 
+	vfscore_pcache_release(vp);
+
 	/*
 	 * Deallocate fs specific vnode data
 	 */
@@ -286,9 +314,11 @@ vrele(struct vnode *vp)
 		VNODE_UNLOCK();
 		return;
 	}
-	uk_list_del(&vp->v_link);
+	vfscore_htable_del(&vnode_table, &vp->v_link);
 	VNODE_UNLOCK();
 
+	vfscore_pcache_release(vp);
+
 	/*
 	 * Deallocate fs specific vnode data
 	 */
@@ -325,6 +355,9 @@ vn_stat(struct vnode *vp, struct stat *st)
 
 	st->st_ino = (ino_t)vap->va_nodeid;
 	st->st_size = vap->va_size;
+	/* Cached writes may not have reached the file system yet */
+	if (vfscore_pcache_enabled(vp))
+		st->st_size = vp->v_size;
 	mode = vap->va_mode;
 	switch (vp->v_type) {
 	case VREG:
@@ -443,14 +476,30 @@ vn_access(struct vnode *vp, int flags)
 /*
  * Dump all all vnode.
  */
-void
-vnode_dump(void)
+static void
+vnode_dump_bucket(struct uk_hlist_head *head, char type[][6])
 {
-	int i;
 	struct vnode *vp;
 	struct mount *mp;
+
+	uk_hlist_for_each_entry(vp, head, v_link) {
+		mp = vp->v_mount;
+
+		uk_pr_debug(" %016lx %016lx %s %6d %s%s\n",
+			    (unsigned long) vp,
+			    (unsigned long) mp, type[vp->v_type],
+			    vp->v_refcnt,
+			    (strlen(mp->m_path) == 1) ? "\0" : mp->m_path,
+			    vn_path(vp));
+	}
+}
+
+void
+vnode_dump(void)
+{
+	unsigned long i;
 	char type[][6] = { "VNON ", "VREG ", "VDIR ", "VBLK ", "VCHR ",
-			   "VLNK ", "VSOCK", "VFIFO",
+			   "VLNK ", "VSOCK", "VFIFO", "VTIMR",
 #ifdef CONFIG_LIBPOSIX_EVENT
 			   "VEPLL", "VEVNT",
 #endif /* CONFIG_LIBPOSIX_EVENT */
@@ -462,19 +511,10 @@ vnode_dump(void)
 	uk_pr_debug(" vnode            mount            type  refcnt path\n");
 	uk_pr_debug(" ---------------- ---------------- ----- ------ ------------------------------\n");
 
-	for (i = 0; i < VNODE_BUCKETS; i++) {
-		uk_list_for_each_entry(vp, &vnode_table[i], v_link) {
-			mp = vp->v_mount;
-
-
-			uk_pr_debug(" %016lx %016lx %s %6d %s%s\n",
-				    (unsigned long) vp,
-				    (unsigned long) mp, type[vp->v_type],
-				    vp->v_refcnt,
-				    (strlen(mp->m_path) == 1) ? "\0" : mp->m_path,
-				    vn_path(vp));
-		}
-	}
+	for (i = 0; i < vfscore_htable_size(vnode_table.cur); i++)
+		vnode_dump_bucket(&vnode_table.cur->head[i], type);
+	for (i = 0; i < vfscore_htable_size(vnode_table.old); i++)
+		vnode_dump_bucket(&vnode_table.old->head[i], type);
 	uk_pr_debug("\n");
 	VNODE_UNLOCK();
 }
@@ -511,10 +551,7 @@ vfscore_vop_erofs()
 void
 vnode_init(void)
 {
-	int i;
-
-	for (i = 0; i < VNODE_BUCKETS; i++)
-		UK_INIT_LIST_HEAD(&vnode_table[i]);
+	vfscore_htable_init(&vnode_table, vn_node_hash);
 }
 
 void vn_add_name(struct vnode *vp __unused, struct dentry *dp)
@@ -51,6 +51,7 @@
  */
 
 #include <string.h>
+#include <errno.h>
 #include <uk/print.h>
 #include <uk/plat/common/cpu.h>
 #include <pci/pci_bus.h>
@@ -61,6 +62,60 @@
 #define DEVFN(dev, fn)   ((dev << PCI_FN_BIT_NBR) | fn)
 #define SIZE_PER_PCI_DEV 0x20	/* legacy pci device size, no msi */
 
+int pci_config_read(struct pci_device *dev, unsigned int off,
+		    unsigned int len, __u32 *val)
+{
+	UK_ASSERT(dev);
+	UK_ASSERT(val);
+
+	if (unlikely(len != 1 && len != 2 && len != 4))
+		return -EINVAL;
+
+	*val = 0;
+	if (pci_generic_config_read(dev->addr.bus,
+				    DEVFN(dev->addr.devid, dev->addr.function),
+				    off, len, val))
+		return -EIO;
+	return 0;
+}
+
+int pci_config_write(struct pci_device *dev, unsigned int off,
+		     unsigned int len, __u32 val)
+{
+	UK_ASSERT(dev);
+
+	if (unlikely(len != 1 && len != 2 && len != 4))
+		return -EINVAL;
+
+	if (pci_generic_config_write(dev->addr.bus,
+				     DEVFN(dev->addr.devid, dev->addr.function),
+				     off, len, val))
+		return -EIO;
+	return 0;
+}
+
+/* TODO: MSIs need a GICv3 ITS or GICv2m frame, which we do not support yet */
+int pci_msi_irq_alloc(void)
+{
+	return -ENOTSUP;
+}
+
+void pci_msi_irq_free(unsigned long irq __unused)
+{
+}
+
+int arch_pci_msi_compose(unsigned long irq __unused,
+			 unsigned int lcpu_idx __unused,
+			 __u64 *addr __unused, __u32 *data __unused)
+{
+	return -ENOTSUP;
+}
+
+void *arch_pci_mmio_map(__paddr_t paddr __unused, __sz len __unused)
+{
+	return NULL;
+}
+
 static int arch_pci_driver_add_device(struct pci_driver *drv,
 					struct pci_address *addr,
 					struct pci_device_id *devid,
@@ -89,13 +89,16 @@ uint32_t generic_timer_get_frequency(int fdt_timer)
 	return fdt32_to_cpu(fdt_freq[0]);
 }
 
-unsigned long sched_have_pending_events;
+UKPLAT_PER_LCPU_DEFINE(unsigned long, sched_have_pending_events);
 
 void time_block_until(__nsec until)
 {
+	unsigned long *pending =
+		&ukplat_per_lcpu_current(sched_have_pending_events);
+
 	while (ukplat_monotonic_clock() < until) {
 		generic_timer_cpu_block_until(until);
-		if (__uk_test_and_clear_bit(0, &sched_have_pending_events))
+		if (__uk_test_and_clear_bit(0, pending))
 			break;
 	}
 }
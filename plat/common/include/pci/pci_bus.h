@@ -66,6 +66,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <uk/arch/types.h>
 #include <uk/bus.h>
 #include <uk/alloc.h>
 #include <uk/ctors.h>
@@ -156,6 +157,11 @@ struct pci_device {
 
 	unsigned long base;
 	unsigned long irq;
+
+	/* MSI-X state, initialized by pci_msix_init() */
+	int msix_cap;		/**< Offset of the capability, 0 if none */
+	__u16 msix_size;	/**< Number of table entries */
+	void *msix_table;	/**< Mapped MSI-X table */
 };
 
 
@@ -295,6 +301,122 @@ static struct pci_bus_handler ph __unused;
 #define PCI_MIN_GNT		0x3e	/* 8 bits */
 #define PCI_MAX_LAT		0x3f	/* 8 bits */
 
+#define  PCI_STATUS_CAP_LIST	0x10	/* Support Capability List */
+
+#define  PCI_BASE_ADDRESS_SPACE_IO	0x01
+#define  PCI_BASE_ADDRESS_MEM_TYPE_MASK	0x06
+#define  PCI_BASE_ADDRESS_MEM_TYPE_64	0x04	/* 64 bit address */
+#define  PCI_BASE_ADDRESS_MEM_MASK	(~0x0fUL)
+
+/* Capability lists */
+#define PCI_CAP_LIST_ID		0	/* Capability ID */
+#define PCI_CAP_LIST_NEXT	1	/* Next capability in the list */
+#define PCI_CAP_ID_MSIX		0x11	/* MSI-X */
+
+/* MSI-X registers (relative to the capability) */
+#define PCI_MSIX_FLAGS		2	/* Message Control, 16 bits */
+#define  PCI_MSIX_FLAGS_QSIZE	0x07ff	/* Table size - 1 */
+#define  PCI_MSIX_FLAGS_MASKALL	0x4000	/* Mask all vectors */
+#define  PCI_MSIX_FLAGS_ENABLE	0x8000	/* MSI-X enable */
+#define PCI_MSIX_TABLE		4	/* Table offset and BIR, 32 bits */
+#define  PCI_MSIX_TABLE_BIR	0x00000007
+#define  PCI_MSIX_TABLE_OFFSET	0xfffffff8
+
+/* MSI-X table entries */
+#define PCI_MSIX_ENTRY_SIZE		16
+#define PCI_MSIX_ENTRY_LOWER_ADDR	0
+#define PCI_MSIX_ENTRY_UPPER_ADDR	4
+#define PCI_MSIX_ENTRY_DATA		8
+#define PCI_MSIX_ENTRY_VECTOR_CTRL	12
+#define  PCI_MSIX_ENTRY_CTRL_MASKBIT	0x1
+
 struct pci_driver *pci_find_driver(struct pci_device_id *id);
 
+/**
+ * Reads from the configuration space of a device.
+ *
+ * @param dev the PCI device
+ * @param off offset into the configuration space, aligned to len
+ * @param len access width in bytes (1, 2, or 4)
+ * @param val returns the value read
+ * @return 0 on success, a negative errno otherwise
+ */
+int pci_config_read(struct pci_device *dev, unsigned int off,
+		    unsigned int len, __u32 *val);
+
+/**
+ * Writes to the configuration space of a device.
+ *
+ * @param dev the PCI device
+ * @param off offset into the configuration space, aligned to len
+ * @param len access width in bytes (1, 2, or 4)
+ * @param val the value to write
+ * @return 0 on success, a negative errno otherwise
+ */
+int pci_config_write(struct pci_device *dev, unsigned int off,
+		     unsigned int len, __u32 val);
+
+/**
+ * Looks up a capability in the capability list of a device.
+ *
+ * @param dev the PCI device
+ * @param cap_id the ID of the capability (PCI_CAP_ID_*)
+ * @return the configuration space offset of the capability, or -ENOENT
+ */
+int pci_find_capability(struct pci_device *dev, __u8 cap_id);
+
+/**
+ * Allocates an IRQ for a message-signaled interrupt. The interrupt handler is
+ * registered with ukplat_irq_register() as usual.
+ *
+ * @return the IRQ number on success, or a negative errno. -ENOTSUP is
+ *    returned if the platform does not support MSIs.
+ */
+int pci_msi_irq_alloc(void);
+
+/**
+ * Releases an IRQ obtained with pci_msi_irq_alloc(). Any handler must not
+ * have been registered for the IRQ.
+ */
+void pci_msi_irq_free(unsigned long irq);
+
+/**
+ * Prepares the use of MSI-X for a device: Maps the MSI-X table and masks all
+ * vectors. MSI-X itself is not enabled yet.
+ *
+ * @param dev the PCI device
+ * @return the number of MSI-X vectors of the device on success, or a
+ *    negative errno. -ENOTSUP is returned if the device or the platform
+ *    does not support MSI-X.
+ */
+int pci_msix_init(struct pci_device *dev);
+
+/**
+ * Routes an MSI-X vector to an IRQ on the given logical CPU and unmasks it.
+ * This can be called at any time to change the target CPU of a vector.
+ *
+ * @param dev the PCI device, set up with pci_msix_init()
+ * @param entry the index of the MSI-X vector
+ * @param irq an IRQ obtained with pci_msi_irq_alloc()
+ * @param lcpu_idx the index of the logical CPU that receives the interrupt
+ * @return 0 on success, a negative errno otherwise
+ */
+int pci_msix_vector_set(struct pci_device *dev, unsigned int entry,
+			unsigned long irq, unsigned int lcpu_idx);
+
+/**
+ * Masks an MSI-X vector.
+ */
+void pci_msix_vector_mask(struct pci_device *dev, unsigned int entry);
+
+/**
+ * Enables MSI-X for a device and disables legacy INTx interrupts.
+ */
+void pci_msix_enable(struct pci_device *dev);
+
+/**
+ * Disables MSI-X for a device and re-enables legacy INTx interrupts.
+ */
+void pci_msix_disable(struct pci_device *dev);
+
 #endif /* __UKPLAT_COMMON_PCI_BUS_H__ */
@@ -77,6 +77,13 @@
 #define APIC_SVR_VECTOR_MASK		0x00000000000000ffUL
 #define APIC_SVR_EOI_BROADCAST		(1 << 12)
 
+/* APIC local vector table (LVT) timer register */
+#define APIC_LVT_TIMER_VECTOR_MASK	0x00000000000000ffUL
+#define APIC_LVT_TIMER_MASKED		(1 << 16)
+#define APIC_LVT_TIMER_ONESHOT		(0 << 17)
+#define APIC_LVT_TIMER_PERIODIC		(1 << 17)
+#define APIC_LVT_TIMER_TSC_DEADLINE	(2 << 17)
+
 /* APIC error status registers (ESR) */
 #define APIC_ESR_SEND_CHECKSUM		(1 << 0) /* only Pentium and P6 */
 #define APIC_ESR_RECV_CHECKSUM		(1 << 1) /* only Pentium and P6 */
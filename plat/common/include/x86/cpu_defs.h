@@ -101,6 +101,8 @@
 #define X86_MSR_SYSCALL_MASK	0xc0000084
 /* page attribute table configuration */
 #define X86_MSR_PAT		0x277
+/* local APIC timer deadline in TSC-deadline mode */
+#define X86_MSR_TSC_DEADLINE	0x6e0
 
 /* MSR EFER bits */
 #define X86_EFER_SCE		(1 << 0)
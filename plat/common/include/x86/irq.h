@@ -90,6 +90,10 @@ static inline int irqs_disabled(void)
 #define local_irq_enable()       __sti()
 #define local_irq_enable_halt()  __sti_hlt()
 
-#define __MAX_IRQ	16
+/* IRQs below __MAX_PIC_IRQ are routed through the legacy PIC. The remaining
+ * ones are message-signaled interrupts that are delivered by the local APIC.
+ */
+#define __MAX_PIC_IRQ	16
+#define __MAX_IRQ	48
 
 #endif /* __PLAT_CMN_X86_IRQ_H__ */
@@ -52,11 +52,19 @@
  */
 
 #include <string.h>
+#include <errno.h>
 #include <uk/print.h>
 #include <uk/plat/common/cpu.h>
 #include <pci/pci_bus.h>
 
 extern int arch_pci_probe(struct uk_alloc *pha);
+extern void *arch_pci_mmio_map(__paddr_t paddr, __sz len);
+extern int arch_pci_msi_compose(unsigned long irq, unsigned int lcpu_idx,
+				__u64 *addr, __u32 *data);
+
+/* Guard against malformed (i.e., cyclic) capability lists */
+#define PCI_CAP_MAX_COUNT	48
+#define PCI_CAP_MIN_OFFSET	0x40
 
 static inline int pci_device_id_match(const struct pci_device_id *id0,
 					const struct pci_device_id *id1)
@@ -123,6 +131,208 @@ struct pci_driver *pci_find_driver(struct pci_device_id *id)
 	return NULL; /* no driver found */
 }
 
+int pci_find_capability(struct pci_device *dev, __u8 cap_id)
+{
+	__u32 status, pos, id;
+	int ttl = PCI_CAP_MAX_COUNT;
+
+	UK_ASSERT(dev);
+
+	if (pci_config_read(dev, PCI_STATUS_OFFSET, 2, &status) ||
+	    !(status & PCI_STATUS_CAP_LIST))
+		return -ENOENT;
+
+	if (pci_config_read(dev, PCI_CAPABILITIES_PTR, 1, &pos))
+		return -ENOENT;
+
+	while (ttl-- && pos >= PCI_CAP_MIN_OFFSET) {
+		pos &= ~0x3;
+		if (pci_config_read(dev, pos + PCI_CAP_LIST_ID, 1, &id))
+			break;
+		if (id == 0xff)
+			break;
+		if (id == cap_id)
+			return (int) pos;
+		if (pci_config_read(dev, pos + PCI_CAP_LIST_NEXT, 1, &pos))
+			break;
+	}
+
+	return -ENOENT;
+}
+
+/* Returns the physical address of a memory BAR */
+static int pci_bar_paddr(struct pci_device *dev, unsigned int bar,
+			 __paddr_t *paddr)
+{
+	__u32 lo, hi = 0;
+	int rc;
+
+	if (unlikely(bar > 5))
+		return -EINVAL;
+
+	rc = pci_config_read(dev, PCI_BASE_ADDRESS_0 + bar * 4, 4, &lo);
+	if (unlikely(rc))
+		return rc;
+
+	if (lo & PCI_BASE_ADDRESS_SPACE_IO)
+		return -EINVAL;
+
+	if ((lo & PCI_BASE_ADDRESS_MEM_TYPE_MASK) ==
+	    PCI_BASE_ADDRESS_MEM_TYPE_64) {
+		if (unlikely(bar == 5))
+			return -EINVAL;
+		rc = pci_config_read(dev, PCI_BASE_ADDRESS_0 + (bar + 1) * 4,
+				     4, &hi);
+		if (unlikely(rc))
+			return rc;
+	}
+
+	*paddr = ((__paddr_t) hi << 32) | (lo & PCI_BASE_ADDRESS_MEM_MASK);
+	return (*paddr) ? 0 : -ENODEV;
+}
+
+static inline volatile __u32 *pci_msix_entry(struct pci_device *dev,
+					     unsigned int entry,
+					     unsigned int reg)
+{
+	UK_ASSERT(dev->msix_table);
+	UK_ASSERT(entry < dev->msix_size);
+
+	return (volatile __u32 *) ((__u8 *) dev->msix_table +
+				   entry * PCI_MSIX_ENTRY_SIZE + reg);
+}
+
+int pci_msix_init(struct pci_device *dev)
+{
+	__u32 ctrl, table, cmd;
+	__paddr_t paddr;
+	unsigned int i;
+	int cap, rc;
+
+	UK_ASSERT(dev);
+
+	if (dev->msix_table)
+		return dev->msix_size;
+
+	cap = pci_find_capability(dev, PCI_CAP_ID_MSIX);
+	if (cap < 0)
+		return -ENOTSUP;
+
+	rc = pci_config_read(dev, cap + PCI_MSIX_FLAGS, 2, &ctrl);
+	if (unlikely(rc))
+		return rc;
+	rc = pci_config_read(dev, cap + PCI_MSIX_TABLE, 4, &table);
+	if (unlikely(rc))
+		return rc;
+
+	rc = pci_bar_paddr(dev, table & PCI_MSIX_TABLE_BIR, &paddr);
+	if (unlikely(rc)) {
+		uk_pr_err("PCI %02x:%02x.%02x: Invalid MSI-X table BAR: %d\n",
+			  (int) dev->addr.bus, (int) dev->addr.devid,
+			  (int) dev->addr.function, rc);
+		return rc;
+	}
+
+	dev->msix_size = (ctrl & PCI_MSIX_FLAGS_QSIZE) + 1;
+	dev->msix_table = arch_pci_mmio_map(paddr +
+					    (table & PCI_MSIX_TABLE_OFFSET),
+					    dev->msix_size *
+					    PCI_MSIX_ENTRY_SIZE);
+	if (unlikely(!dev->msix_table)) {
+		dev->msix_size = 0;
+		return -ENOTSUP;
+	}
+	dev->msix_cap = cap;
+
+	/* The table is accessed through the memory space of the device */
+	rc = pci_config_read(dev, PCI_COMMAND, 2, &cmd);
+	if (unlikely(rc))
+		return rc;
+	cmd |= PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+	pci_config_write(dev, PCI_COMMAND, 2, cmd);
+
+	for (i = 0; i < dev->msix_size; i++)
+		pci_msix_vector_mask(dev, i);
+
+	uk_pr_debug("PCI %02x:%02x.%02x: %u MSI-X vectors, table @ %p\n",
+		    (int) dev->addr.bus, (int) dev->addr.devid,
+		    (int) dev->addr.function, dev->msix_size,
+		    dev->msix_table);
+
+	return dev->msix_size;
+}
+
+void pci_msix_vector_mask(struct pci_device *dev, unsigned int entry)
+{
+	volatile __u32 *ctrl;
+
+	ctrl = pci_msix_entry(dev, entry, PCI_MSIX_ENTRY_VECTOR_CTRL);
+	*ctrl |= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+}
+
+int pci_msix_vector_set(struct pci_device *dev, unsigned int entry,
+			unsigned long irq, unsigned int lcpu_idx)
+{
+	volatile __u32 *ctrl;
+	__u64 addr;
+	__u32 data;
+	int rc;
+
+	UK_ASSERT(dev);
+
+	if (unlikely(entry >= dev->msix_size))
+		return -EINVAL;
+
+	rc = arch_pci_msi_compose(irq, lcpu_idx, &addr, &data);
+	if (unlikely(rc))
+		return rc;
+
+	/* The entry must be masked while it is modified */
+	pci_msix_vector_mask(dev, entry);
+
+	*pci_msix_entry(dev, entry, PCI_MSIX_ENTRY_LOWER_ADDR) = (__u32) addr;
+	*pci_msix_entry(dev, entry, PCI_MSIX_ENTRY_UPPER_ADDR) =
+		(__u32) (addr >> 32);
+	*pci_msix_entry(dev, entry, PCI_MSIX_ENTRY_DATA) = data;
+
+	ctrl = pci_msix_entry(dev, entry, PCI_MSIX_ENTRY_VECTOR_CTRL);
+	*ctrl &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
+
+	return 0;
+}
+
+static void pci_msix_control(struct pci_device *dev, int enable)
+{
+	__u32 ctrl, cmd;
+
+	UK_ASSERT(dev && dev->msix_cap);
+
+	pci_config_read(dev, dev->msix_cap + PCI_MSIX_FLAGS, 2, &ctrl);
+	ctrl &= ~PCI_MSIX_FLAGS_MASKALL;
+	if (enable)
+		ctrl |= PCI_MSIX_FLAGS_ENABLE;
+	else
+		ctrl &= ~PCI_MSIX_FLAGS_ENABLE;
+	pci_config_write(dev, dev->msix_cap + PCI_MSIX_FLAGS, 2, ctrl);
+
+	pci_config_read(dev, PCI_COMMAND, 2, &cmd);
+	if (enable)
+		cmd |= PCI_COMMAND_INTX_DISABLE;
+	else
+		cmd &= ~PCI_COMMAND_INTX_DISABLE;
+	pci_config_write(dev, PCI_COMMAND, 2, cmd);
+}
+
+void pci_msix_enable(struct pci_device *dev)
+{
+	pci_msix_control(dev, 1);
+}
+
+void pci_msix_disable(struct pci_device *dev)
+{
+	pci_msix_control(dev, 0);
+}
+
 static int pci_probe(void)
 {
 	return arch_pci_probe(ph.a);
@@ -52,9 +52,19 @@
  */
 
 #include <string.h>
+#include <errno.h>
 #include <uk/print.h>
+#include <uk/plat/lcpu.h>
 #include <uk/plat/common/cpu.h>
+#include <uk/plat/common/lcpu.h>
 #include <pci/pci_bus.h>
+#include <kvm/intctrl.h>
+#ifdef CONFIG_HAVE_PAGING
+#include <uk/plat/paging.h>
+#endif /* CONFIG_HAVE_PAGING */
+
+/* The boot page table maps the first 4 GiB 1:1 */
+#define PCI_MMIO_IDENTITY_LIMIT		0x100000000UL
 
 #define PCI_CONF_READ(type, ret, a, s)					\
 	do {								\
@@ -65,6 +75,117 @@
 		*(ret) = (type) _conf_data;				\
 	} while (0)
 
+static inline __u32 pci_config_addr(struct pci_device *dev, unsigned int off)
+{
+	return (PCI_ENABLE_BIT)
+		| (dev->addr.bus << PCI_BUS_SHIFT)
+		| (dev->addr.devid << PCI_DEVICE_SHIFT)
+		| (dev->addr.function << PCI_FUNCTION_SHIFT)
+		| (off & ~0x3);
+}
+
+static inline int pci_config_check(unsigned int off, unsigned int len)
+{
+	if (unlikely(len != 1 && len != 2 && len != 4))
+		return -EINVAL;
+	if (unlikely((off & (len - 1)) || off + len > 0x100))
+		return -EINVAL;
+	return 0;
+}
+
+int pci_config_read(struct pci_device *dev, unsigned int off,
+		    unsigned int len, __u32 *val)
+{
+	unsigned long flags;
+	__u32 data;
+	int rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(val);
+
+	rc = pci_config_check(off, len);
+	if (unlikely(rc))
+		return rc;
+
+	flags = ukplat_lcpu_save_irqf();
+	outl(PCI_CONFIG_ADDR, pci_config_addr(dev, off));
+	data = inl(PCI_CONFIG_DATA);
+	ukplat_lcpu_restore_irqf(flags);
+
+	data >>= (off & 0x3) * 8;
+	*val = (len == 4) ? data : data & ((1U << (len * 8)) - 1);
+	return 0;
+}
+
+int pci_config_write(struct pci_device *dev, unsigned int off,
+		     unsigned int len, __u32 val)
+{
+	unsigned long flags;
+	int rc;
+
+	UK_ASSERT(dev);
+
+	rc = pci_config_check(off, len);
+	if (unlikely(rc))
+		return rc;
+
+	flags = ukplat_lcpu_save_irqf();
+	outl(PCI_CONFIG_ADDR, pci_config_addr(dev, off));
+	switch (len) {
+	case 1:
+		outb(PCI_CONFIG_DATA + (off & 0x3), (__u8) val);
+		break;
+	case 2:
+		outw(PCI_CONFIG_DATA + (off & 0x2), (__u16) val);
+		break;
+	default:
+		outl(PCI_CONFIG_DATA, val);
+		break;
+	}
+	ukplat_lcpu_restore_irqf(flags);
+	return 0;
+}
+
+int pci_msi_irq_alloc(void)
+{
+	return intctrl_msi_alloc();
+}
+
+void pci_msi_irq_free(unsigned long irq)
+{
+	intctrl_msi_free(irq);
+}
+
+int arch_pci_msi_compose(unsigned long irq, unsigned int lcpu_idx,
+			 __u64 *addr, __u32 *data)
+{
+	if (unlikely(lcpu_idx >= ukplat_lcpu_count()))
+		return -EINVAL;
+
+	return intctrl_msi_compose(irq, lcpu_get(lcpu_idx)->id, addr, data);
+}
+
+void *arch_pci_mmio_map(__paddr_t paddr, __sz len)
+{
+#ifdef CONFIG_HAVE_PAGING
+	__paddr_t pbase = PAGE_ALIGN_DOWN(paddr);
+	__vaddr_t vaddr;
+
+	vaddr = ukplat_page_kmap(ukplat_pt_get_active(), pbase,
+				 DIV_ROUND_UP(paddr + len - pbase, PAGE_SIZE),
+				 0);
+	if (unlikely(vaddr == __VADDR_INV))
+		return NULL;
+
+	return (void *) (vaddr + (paddr - pbase));
+#else /* !CONFIG_HAVE_PAGING */
+	if (unlikely(paddr + len > PCI_MMIO_IDENTITY_LIMIT))
+		return NULL;
+
+	return (void *) paddr;
+#endif /* !CONFIG_HAVE_PAGING */
+}
+
 static inline int pci_driver_add_device(struct pci_driver *drv,
 					struct pci_address *addr,
 					struct pci_device_id *devid)
@@ -93,7 +214,8 @@ static inline int pci_driver_add_device(struct pci_driver *drv,
 
 	config_addr = (PCI_ENABLE_BIT)
 			| (addr->bus << PCI_BUS_SHIFT)
-			| (addr->devid << PCI_DEVICE_SHIFT);
+			| (addr->devid << PCI_DEVICE_SHIFT)
+			| (addr->function << PCI_FUNCTION_SHIFT);
 	PCI_CONF_READ(uint16_t, &dev->base, config_addr, IOBAR);
 	PCI_CONF_READ(uint8_t, &dev->irq, config_addr, IRQ);
 
@@ -114,6 +114,9 @@ struct virtio_config_ops {
 				      struct uk_alloc *a);
 	void (*vq_release)(struct virtio_dev *vdev, struct virtqueue *vq,
 				struct uk_alloc *a);
+	/** Route the interrupts of a virtqueue to a logical CPU (optional) */
+	int (*vq_affinity_set)(struct virtio_dev *vdev, struct virtqueue *vq,
+			       unsigned int lcpu_idx);
 };
 
 /**
@@ -227,7 +230,7 @@ static inline __u64 virtio_feature_get(struct virtio_dev *vdev)
  * @param feature
  *	A bit map of the feature negotiated.
  */
-static inline void virtio_feature_set(struct virtio_dev *vdev, __u32 feature)
+static inline void virtio_feature_set(struct virtio_dev *vdev, __u64 feature)
 {
 	UK_ASSERT(vdev);
 
@@ -345,6 +348,35 @@ static inline void virtio_vqueue_release(struct virtio_dev *vdev,
 		vdev->cops->vq_release(vdev, vq, a);
 }
 
+/**
+ * A helper function to route the interrupts of a virtqueue to a specific
+ * logical CPU.
+ * @param vdev
+ *	Reference to the virtio device.
+ * @param vq
+ *	Reference to the virtqueue.
+ * @param lcpu_idx
+ *	The index of the logical CPU.
+ * @return int
+ *	0 on success.
+ *	-ENOTSUP if the transport cannot route interrupts per virtqueue.
+ *	< 0 on other errors.
+ */
+static inline int virtio_vqueue_affinity_set(struct virtio_dev *vdev,
+					     struct virtqueue *vq,
+					     unsigned int lcpu_idx)
+{
+	int rc = -ENOTSUP;
+
+	UK_ASSERT(vdev);
+	UK_ASSERT(vq);
+
+	if (vdev->cops->vq_affinity_set)
+		rc = vdev->cops->vq_affinity_set(vdev, vq, lcpu_idx);
+
+	return rc;
+}
+
 static inline void virtio_dev_drv_up(struct virtio_dev *vdev)
 {
 	virtio_dev_status_update(vdev, VIRTIO_CONFIG_STATUS_DRIVER_OK);
@@ -71,6 +71,7 @@
 					 */
 #define VIRTIO_NET_F_CTRL_MAC_ADDR 23	/* Set MAC address */
 
+#define VIRTIO_NET_F_RSS	60	/* Supports RSS RX steering */
 #define VIRTIO_NET_F_SPEED_DUPLEX 63	/* Device set linkspeed and duplex */
 
 #ifndef VIRTIO_NET_NO_LEGACY
@@ -103,8 +104,25 @@ struct virtio_net_config {
 	 * Any other value stands for unknown.
 	 */
 	__u8 duplex;
+	/* Maximum size of the RSS key (if VIRTIO_NET_F_RSS) */
+	__u8 rss_max_key_size;
+	/* Maximum number of RSS indirection table entries */
+	__u16 rss_max_indirection_table_length;
+	/* Bitmap of supported VIRTIO_NET_RSS_HASH_TYPE_* */
+	__u32 supported_hash_types;
 } __packed;
 
+/* Hash types that can be used for RSS (see VIRTIO_NET_F_RSS) */
+#define VIRTIO_NET_RSS_HASH_TYPE_IPv4		(1 << 0)
+#define VIRTIO_NET_RSS_HASH_TYPE_TCPv4		(1 << 1)
+#define VIRTIO_NET_RSS_HASH_TYPE_UDPv4		(1 << 2)
+#define VIRTIO_NET_RSS_HASH_TYPE_IPv6		(1 << 3)
+#define VIRTIO_NET_RSS_HASH_TYPE_TCPv6		(1 << 4)
+#define VIRTIO_NET_RSS_HASH_TYPE_UDPv6		(1 << 5)
+#define VIRTIO_NET_RSS_HASH_TYPE_IP_EX		(1 << 6)
+#define VIRTIO_NET_RSS_HASH_TYPE_TCP_EX		(1 << 7)
+#define VIRTIO_NET_RSS_HASH_TYPE_UDP_EX		(1 << 8)
+
 /* This header comes first in the scatter-gather list.
  * For legacy virtio, if VIRTIO_F_ANY_LAYOUT is not negotiated, it must
  * be the first element of the scatter-gather list.  If you don't
@@ -239,6 +257,25 @@ struct virtio_net_ctrl_mq {
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET        0
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN        1
  #define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MAX        0x8000
+ #define VIRTIO_NET_CTRL_MQ_RSS_CONFIG          1
+
+/*
+ * The command VIRTIO_NET_CTRL_MQ_RSS_CONFIG (with VIRTIO_NET_F_RSS) configures
+ * hash-based steering of received packets to receive queues. The command data
+ * has a variable layout: struct virtio_net_rss_config is followed by
+ * (indirection_table_mask + 1) 16-bit receive queue indices, then by
+ * struct virtio_net_rss_key and finally by hash_key_length bytes of the key.
+ */
+struct virtio_net_rss_config {
+	__virtio_le32 hash_types;
+	__virtio_le16 indirection_table_mask;
+	__virtio_le16 unclassified_queue;
+} __packed;
+
+struct virtio_net_rss_key {
+	__virtio_le16 max_tx_vq;
+	__u8 hash_key_length;
+} __packed;
 
 /*
  * Control network offloads
@@ -63,8 +63,16 @@ extern "C" {
 #define VIRTIO_PCI_ISR_HAS_INTR         0x1  /* interrupt is for this device */
 #define VIRTIO_PCI_ISR_CONFIG           0x2  /* config change bit */
 
-/* TODO Revisit when adding MSI support. */
+/*
+ * MSI-X vector registers. They are only present while MSI-X is enabled for
+ * the device and move the device-specific configuration accordingly.
+ */
+#define VIRTIO_MSI_CONFIG_VECTOR        20   /* 16-bit r/w */
+#define VIRTIO_MSI_QUEUE_VECTOR         22   /* 16-bit r/w */
+#define VIRTIO_MSI_NO_VECTOR            0xffff
+
 #define VIRTIO_PCI_CONFIG_OFF           20
+#define VIRTIO_PCI_CONFIG_OFF_MSIX      24
 #define VIRTIO_PCI_VRING_ALIGN          4096
 
 #ifdef __cplusplus
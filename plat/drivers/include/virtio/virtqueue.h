@@ -192,6 +192,33 @@ int virtqueue_buffer_enqueue(struct virtqueue *vq, void *cookie,
 			     struct uk_sglist *sg, __u16 read_bufs,
 			     __u16 write_bufs);
 
+/**
+ * Enqueue a descriptor chain as an indirect descriptor table, so that it
+ * occupies a single descriptor of the ring. The device must have negotiated
+ * VIRTIO_F_INDIRECT_DESC.
+ * @param vq
+ *	Reference to the virtual queue
+ * @param cookie
+ *	Reference to the cookie to reconstruct the buffer.
+ * @param sg
+ *	Reference to the scatter gather list
+ * @param read_bufs
+ *	The number of read buffer.
+ * @param write_bufs
+ *	The number of write buffer.
+ * @param table
+ *	Table of at least `read_bufs + write_bufs` descriptors that is filled
+ *	in with the chain. It must be physically contiguous and stay untouched
+ *	until the buffer is dequeued.
+ *
+ * @return
+ *	Same as virtqueue_buffer_enqueue()
+ */
+int virtqueue_buffer_enqueue_indirect(struct virtqueue *vq, void *cookie,
+				      struct uk_sglist *sg, __u16 read_bufs,
+				      __u16 write_bufs,
+				      struct vring_desc *table);
+
 /**
  * Allocate a virtqueue.
  * @param queue_id
@@ -265,6 +292,23 @@ void virtqueue_intr_disable(struct virtqueue *vq);
  */
 int virtqueue_intr_enable(struct virtqueue *vq);
 
+/**
+ * Start a batch of enqueue operations. Buffers that are enqueued during a
+ * batch are not made visible to the host until the batch is ended, so that
+ * the available ring index is updated only once for all of them.
+ * @param vq
+ *      Reference to the virtqueue.
+ */
+void virtqueue_batch_begin(struct virtqueue *vq);
+
+/**
+ * End a batch of enqueue operations and make the enqueued buffers visible to
+ * the host. The host still needs to be notified with virtqueue_host_notify().
+ * @param vq
+ *      Reference to the virtqueue.
+ */
+void virtqueue_batch_end(struct virtqueue *vq);
+
 /**
  * Notify the host of an event.
  * @param vq
@@ -169,6 +169,12 @@ static int tap_netdev_xmit(struct uk_netdev *dev,
 static int tap_netdev_recv(struct uk_netdev *dev,
 			   struct uk_netdev_rx_queue *queue,
 			   struct uk_netbuf **pkt);
+static int tap_netdev_xmit_burst(struct uk_netdev *dev,
+				 struct uk_netdev_tx_queue *queue,
+				 struct uk_netbuf **pkt, __u16 *cnt);
+static int tap_netdev_recv_burst(struct uk_netdev *dev,
+				 struct uk_netdev_rx_queue *queue,
+				 struct uk_netbuf **pkt, __u16 *cnt);
 static struct uk_netdev_rx_queue *tap_netdev_rxq_setup(struct uk_netdev *dev,
 					__u16 queue_id, __u16 nb_desc,
 					struct uk_netdev_rxqueue_conf *conf);
@@ -306,6 +312,58 @@ err_exit:
 	goto exit;
 }
 
+static int tap_netdev_recv_burst(struct uk_netdev *dev,
+				 struct uk_netdev_rx_queue *queue,
+				 struct uk_netbuf **pkt, __u16 *cnt)
+{
+	int rc = 0;
+	int status = 0x0;
+	__u16 nb_pkts, i, j;
+	struct tap_net_dev *tdev __maybe_unused;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue && pkt && cnt);
+
+	tdev = to_tapnetdev(dev);
+
+	if (!queue->alloc_rxpkts)
+		return -EINVAL;
+
+	/**
+	 * Allocate the packets for the whole burst at once. Netbufs that do
+	 * not receive a packet are released again.
+	 */
+	nb_pkts = queue->alloc_rxpkts(queue->alloc_rxpkts_argp, pkt, *cnt);
+	if (nb_pkts < *cnt)
+		status |= UK_NETDEV_STATUS_UNDERRUN;
+
+	for (i = 0; i < nb_pkts; i++) {
+		rc = tap_read(queue->fd, pkt[i]->data, pkt[i]->len);
+		if (rc <= 0)
+			break;
+		uk_pr_debug(DRIVER_NAME": Recv pkt size: %d\n", rc);
+		pkt[i]->len = rc;
+	}
+
+	for (j = i; j < nb_pkts; j++) {
+		uk_netbuf_free(pkt[j]);
+		pkt[j] = NULL;
+	}
+
+	*cnt = i;
+	if (rc < 0 && rc != -EWOULDBLOCK && rc != -EAGAIN) {
+		uk_pr_err(DRIVER_NAME": Failed(%d) to read the packet\n", rc);
+		if (i == 0)
+			return rc;
+	}
+
+	if (i)
+		status |= UK_NETDEV_STATUS_SUCCESS | UK_NETDEV_STATUS_MORE;
+	else if (nb_pkts == 0)
+		status |= UK_NETDEV_STATUS_MORE;
+	return status;
+}
+
 static int tap_netdev_xmit(struct uk_netdev *dev,
 			   struct uk_netdev_tx_queue *queue,
 			   struct uk_netbuf *pkt)
@@ -331,6 +389,36 @@ static int tap_netdev_xmit(struct uk_netdev *dev,
 	return rc;
 }
 
+static int tap_netdev_xmit_burst(struct uk_netdev *dev,
+				 struct uk_netdev_tx_queue *queue,
+				 struct uk_netbuf **pkt, __u16 *cnt)
+{
+	int rc = 0;
+	__u16 i;
+	struct tap_net_dev *tdev __unused;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue && pkt && cnt);
+
+	tdev = to_tapnetdev(dev);
+
+	for (i = 0; i < *cnt; i++) {
+		rc = tap_write(queue->fd, pkt[i]->data, pkt[i]->len);
+		if (rc <= 0)
+			break;
+		uk_pr_debug(DRIVER_NAME": Send packet of size %d\n", rc);
+		uk_netbuf_free(pkt[i]);
+	}
+
+	*cnt = i;
+	if (i == 0 && rc < 0 && rc != -EWOULDBLOCK && rc != -EAGAIN)
+		return rc;
+	if (i)
+		return UK_NETDEV_STATUS_SUCCESS |
+		       ((rc > 0) ? UK_NETDEV_STATUS_MORE : 0x0);
+	return UK_NETDEV_STATUS_UNDERRUN;
+}
+
 static int tap_netdev_txq_info_get(struct uk_netdev *dev __unused,
 				   __u16 queue_id __unused,
 				   struct uk_netdev_queue_info *qinfo)
@@ -775,6 +863,8 @@ static int tap_dev_init(int id)
 	}
 	tdev->ndev.rx_one = tap_netdev_recv;
 	tdev->ndev.tx_one = tap_netdev_xmit;
+	tdev->ndev.rx_burst = tap_netdev_recv_burst;
+	tdev->ndev.tx_burst = tap_netdev_xmit_burst;
 	tdev->ndev.ops = &tap_netdev_ops;
 	tdev->tid = id;
 	/**
@@ -27,9 +27,12 @@
 #include <stdbool.h>
 #include <virtio/virtio_bus.h>
 #include <virtio/virtio_ids.h>
+#include <virtio/virtqueue.h>
 #include <uk/blkdev.h>
 #include <virtio/virtio_blk.h>
 #include <uk/sglist.h>
+#include <uk/arch/atomic.h>
+#include <uk/plat/spinlock.h>
 #include <uk/blkdev_driver.h>
 
 #define DRIVER_NAME		"virtio-blk"
@@ -49,7 +52,10 @@
  *	Multi-queue,
  *	Maximum size of a segment for requests,
  *	Maximum number of segments per request,
- *	Flush
+ *	Flush,
+ *	Discard,
+ *	Write zeroes,
+ *	Indirect descriptors
  **/
 #define VIRTIO_BLK_DRV_FEATURES(features)				\
 	do {								\
@@ -60,6 +66,9 @@
 		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_MQ);		\
 		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_SIZE_MAX);	\
 		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_FLUSH);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_DISCARD);	\
+		VIRTIO_FEATURE_SET(features, VIRTIO_BLK_F_WRITE_ZEROES); \
+		VIRTIO_FEATURE_SET(features, VIRTIO_F_INDIRECT_DESC);	\
 	} while (0)
 
 static struct uk_alloc *a;
@@ -86,6 +95,12 @@ struct virtio_blk_device {
 	__u32 max_size_segment;
 	/* If it is set then flush request is allowed */
 	__u8 writeback;
+	/* Alignment of discard requests in sectors, 0 if there is none */
+	__u32 discard_alignment;
+	/* If it is set then write zeroes requests may deallocate sectors */
+	__u8 write_zeroes_unmap;
+	/* If it is set then requests are enqueued as indirect tables */
+	__u8 indirect;
 };
 
 struct uk_blkdev_queue {
@@ -107,20 +122,64 @@ struct uk_blkdev_queue {
 	/* The scatter list and its associated fragments */
 	struct uk_sglist sg;
 	struct uk_sglist_seg *sgsegs;
-	/* List of virtio_blkdev_requests to be freed outside of interrupt
-	 * handler
+	/* Serializes submission and completion, which may run in interrupt
+	 * context on another CPU. Protects the virtqueue, `sg` and `free`.
 	 */
-	/* TODO: Replace with Linux llist-style list for SMP support */
-	struct uk_list_head free_list;
+	__spinlock lock;
+	/* Pool of requests, one per descriptor of the virtqueue */
+	struct virtio_blkdev_request *reqs;
+	/* Free requests of the pool */
+	struct virtio_blkdev_request *free;
+	/* Requests released by the completion path. They are pushed without
+	 * taking the lock and moved to `free` all at once (Linux llist-style).
+	 */
+	struct virtio_blkdev_request *released;
+	/* Indirect descriptor tables of the requests, NULL if not used */
+	struct vring_desc *indirect;
+	/* Nb of descriptors of one indirect table */
+	uint16_t indirect_nb_desc;
 };
 
 struct virtio_blkdev_request {
 	struct uk_blkreq *req;
-	struct uk_list_head free_list_head;
+	/* Next request in `free` or `released` of the queue */
+	struct virtio_blkdev_request *next;
+	/* Indirect descriptor table, NULL if not used */
+	struct vring_desc *indirect;
 	struct virtio_blk_outhdr virtio_blk_outhdr;
+	/* Sectors of a discard or write zeroes request */
+	struct virtio_blk_discard_write_zeroes range;
 	uint8_t status;
 };
 
+/* Must be called with the queue lock held */
+static struct virtio_blkdev_request *virtio_blkdev_request_get(
+		struct uk_blkdev_queue *queue)
+{
+	struct virtio_blkdev_request *virtio_blk_req;
+
+	if (!queue->free)
+		queue->free = ukarch_exchange_n(&queue->released, NULL);
+
+	virtio_blk_req = queue->free;
+	if (virtio_blk_req)
+		queue->free = virtio_blk_req->next;
+	return virtio_blk_req;
+}
+
+/* May be called without the queue lock */
+static void virtio_blkdev_request_release(struct uk_blkdev_queue *queue,
+		struct virtio_blkdev_request *virtio_blk_req)
+{
+	struct virtio_blkdev_request *head;
+
+	do {
+		head = ukarch_load_n(&queue->released);
+		virtio_blk_req->next = head;
+	} while (ukarch_compare_exchange_sync(&queue->released, head,
+					      virtio_blk_req) != virtio_blk_req);
+}
+
 static int virtio_blkdev_request_set_sglist(struct uk_blkdev_queue *queue,
 		struct virtio_blkdev_request *virtio_blk_req,
 		__sector sector_size,
@@ -156,7 +215,29 @@ static int virtio_blkdev_request_set_sglist(struct uk_blkdev_queue *queue,
 	/* Append to sglist chunks of `segment_max_size` size
 	 * Only for read / write operations
 	 **/
-	if (have_data)
+	if (have_data && req->sg) {
+		/* Vectored request, the segments are taken as they are */
+		if (unlikely(uk_sglist_length(req->sg) != data_size)) {
+			uk_pr_err("Data segments do not match request size\n");
+			rc = -EINVAL;
+			goto out;
+		}
+		rc = uk_sglist_append_sglist(&queue->sg, req->sg, 0,
+				data_size);
+		if (unlikely(rc != 0)) {
+			uk_pr_err("Failed to append to sg list %d\n", rc);
+			goto out;
+		}
+	} else if (req->operation == UK_BLKREQ_DISCARD ||
+		   req->operation == UK_BLKREQ_WRITE_ZEROES) {
+		/* The device reads the sector range instead of data */
+		rc = uk_sglist_append(&queue->sg, &virtio_blk_req->range,
+				sizeof(struct virtio_blk_discard_write_zeroes));
+		if (unlikely(rc != 0)) {
+			uk_pr_err("Failed to append to sg list %d\n", rc);
+			goto out;
+		}
+	} else if (have_data)
 		for (idx = 0; idx < data_size; idx += segment_max_size) {
 			segment_size = data_size - idx;
 			segment_size = (segment_size > segment_max_size) ?
@@ -201,7 +282,7 @@ static int virtio_blkdev_request_write(struct uk_blkdev_queue *queue,
 			cap->mode == O_RDONLY)
 		return -EPERM;
 
-	if (req->aio_buf == NULL)
+	if (req->aio_buf == NULL && req->sg == NULL)
 		return -EINVAL;
 
 	if (req->nb_sectors == 0)
@@ -267,25 +348,71 @@ out:
 	return rc;
 }
 
-static void virtio_blkdev_queue_cleanup_requests(struct uk_blkdev_queue *queue)
+static int virtio_blkdev_request_discard(struct uk_blkdev_queue *queue,
+		struct virtio_blkdev_request *virtio_blk_req,
+		__u16 *read_segs, __u16 *write_segs)
 {
-	struct virtio_blkdev_request *request, *request_tmp;
+	struct virtio_blk_device *vbdev;
+	struct uk_blkdev_cap *cap;
+	struct uk_blkreq *req;
+	__sector max_sectors;
+	int rc = 0;
 
-	UK_LIST_HEAD(list);
+	UK_ASSERT(queue);
+	UK_ASSERT(virtio_blk_req);
 
-	/* Move all entries to local list, while ensuring no interrupt fiddles
-	 * with the list pointers.
-	 */
-	ukplat_lcpu_disable_irq();
-	uk_list_splice_init(&queue->free_list, &list);
-	ukplat_lcpu_enable_irq();
+	vbdev = queue->vbd;
+	cap = &vbdev->blkdev.capabilities;
+	req = virtio_blk_req->req;
+	max_sectors = (req->operation == UK_BLKREQ_DISCARD) ?
+			cap->max_discard_sectors :
+			cap->max_write_zeroes_sectors;
+	if (!max_sectors)
+		return -ENOTSUP;
+
+	if (cap->mode == O_RDONLY)
+		return -EPERM;
+
+	if (req->nb_sectors == 0)
+		return -EINVAL;
 
-	/* Free all old requests */
-	uk_list_for_each_entry_safe(request, request_tmp, &list,
-				    free_list_head) {
-		uk_list_del(&request->free_list_head);
-		uk_free(a, request);
+	if (req->start_sector + req->nb_sectors > cap->sectors)
+		return -EINVAL;
+
+	if (req->nb_sectors > max_sectors)
+		return -EINVAL;
+
+	if (req->operation == UK_BLKREQ_DISCARD && vbdev->discard_alignment &&
+	    (req->start_sector % vbdev->discard_alignment ||
+	     req->nb_sectors % vbdev->discard_alignment))
+		return -EINVAL;
+
+	/* The sectors are given by the range, not by the header */
+	virtio_blk_req->virtio_blk_outhdr.sector = 0;
+	virtio_blk_req->range.sector = req->start_sector;
+	virtio_blk_req->range.num_sectors = req->nb_sectors;
+	virtio_blk_req->range.flags = 0;
+
+	rc = virtio_blkdev_request_set_sglist(queue, virtio_blk_req, 0, false);
+	if (rc) {
+		uk_pr_err("Failed to set sglist %d\n", rc);
+		goto out;
+	}
+
+	*read_segs = 2;
+	*write_segs = 1;
+	if (req->operation == UK_BLKREQ_DISCARD) {
+		virtio_blk_req->virtio_blk_outhdr.type = VIRTIO_BLK_T_DISCARD;
+	} else {
+		if (vbdev->write_zeroes_unmap)
+			virtio_blk_req->range.flags =
+				VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP;
+		virtio_blk_req->virtio_blk_outhdr.type =
+				VIRTIO_BLK_T_WRITE_ZEROES;
 	}
+
+out:
+	return rc;
 }
 
 static int virtio_blkdev_queue_enqueue(struct uk_blkdev_queue *queue,
@@ -304,11 +431,12 @@ static int virtio_blkdev_queue_enqueue(struct uk_blkdev_queue *queue,
 		return -ENOSPC;
 	}
 
-	virtio_blkdev_queue_cleanup_requests(queue);
-
-	virtio_blk_req = uk_malloc(a, sizeof(*virtio_blk_req));
-	if (!virtio_blk_req)
-		return -ENOMEM;
+	virtio_blk_req = virtio_blkdev_request_get(queue);
+	if (unlikely(!virtio_blk_req)) {
+		/* All requests are still on their way back from completion */
+		uk_pr_debug("No free request\n");
+		return -ENOSPC;
+	}
 
 	virtio_blk_req->req = req;
 	virtio_blk_req->virtio_blk_outhdr.sector = req->start_sector;
@@ -319,16 +447,32 @@ static int virtio_blkdev_queue_enqueue(struct uk_blkdev_queue *queue,
 	else if (req->operation == UK_BLKREQ_FFLUSH)
 		rc = virtio_blkdev_request_flush(queue, virtio_blk_req,
 				&read_segs, &write_segs);
+	else if (req->operation == UK_BLKREQ_DISCARD ||
+			req->operation == UK_BLKREQ_WRITE_ZEROES)
+		rc = virtio_blkdev_request_discard(queue, virtio_blk_req,
+				&read_segs, &write_segs);
 	else
-		return -EINVAL;
+		rc = -EINVAL;
 
 	if (rc)
-		goto out;
+		goto err_put;
 
-	rc = virtqueue_buffer_enqueue(queue->vq, virtio_blk_req, &queue->sg,
-				      read_segs, write_segs);
+	if (virtio_blk_req->indirect &&
+	    read_segs + write_segs <= queue->indirect_nb_desc)
+		rc = virtqueue_buffer_enqueue_indirect(queue->vq,
+				virtio_blk_req, &queue->sg, read_segs,
+				write_segs, virtio_blk_req->indirect);
+	else
+		rc = virtqueue_buffer_enqueue(queue->vq, virtio_blk_req,
+				&queue->sg, read_segs, write_segs);
+	if (unlikely(rc < 0))
+		goto err_put;
 
-out:
+	return rc;
+
+err_put:
+	virtio_blk_req->next = queue->free;
+	queue->free = virtio_blk_req;
 	return rc;
 }
 
@@ -336,6 +480,7 @@ static int virtio_blkdev_submit_request(struct uk_blkdev *dev,
 		struct uk_blkdev_queue *queue,
 		struct uk_blkreq *req)
 {
+	unsigned long flags;
 	int rc = 0;
 	int status = 0x0;
 
@@ -343,7 +488,9 @@ static int virtio_blkdev_submit_request(struct uk_blkdev *dev,
 	UK_ASSERT(queue);
 	UK_ASSERT(dev);
 
+	ukplat_spin_lock_irqsave(&queue->lock, flags);
 	rc = virtio_blkdev_queue_enqueue(queue, req);
+	ukplat_spin_unlock_irqrestore(&queue->lock, flags);
 	if (likely(rc >= 0)) {
 		uk_pr_debug("Success and more descriptors available\n");
 		status |= UK_BLKDEV_STATUS_SUCCESS;
@@ -371,18 +518,68 @@ err:
 	return rc;
 }
 
+static int virtio_blkdev_submit_batch(struct uk_blkdev *dev,
+		struct uk_blkdev_queue *queue,
+		struct uk_blkreq **reqs, uint16_t *cnt)
+{
+	unsigned long flags;
+	int status = 0x0;
+	uint16_t i;
+	int rc = 0;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(queue);
+	UK_ASSERT(reqs && cnt);
+
+	/* Publish all requests with one update of the available ring */
+	ukplat_spin_lock_irqsave(&queue->lock, flags);
+	virtqueue_batch_begin(queue->vq);
+	for (i = 0; i < *cnt; i++) {
+		rc = virtio_blkdev_queue_enqueue(queue, reqs[i]);
+		if (unlikely(rc < 0))
+			break;
+		if (rc == 0) {
+			/* No descriptors left */
+			i++;
+			break;
+		}
+	}
+	virtqueue_batch_end(queue->vq);
+	ukplat_spin_unlock_irqrestore(&queue->lock, flags);
+
+	if (unlikely(i == 0 && rc < 0)) {
+		if (rc != -ENOSPC)
+			uk_pr_err("Failed to enqueue descriptors into the ring: %d\n",
+				  rc);
+		*cnt = 0;
+		return rc;
+	}
+
+	*cnt = i;
+	if (i) {
+		status |= UK_BLKDEV_STATUS_SUCCESS;
+		virtqueue_host_notify(queue->vq);
+	}
+	if (rc > 0)
+		status |= UK_BLKDEV_STATUS_MORE;
+	return status;
+}
+
 static int virtio_blkdev_queue_dequeue(struct uk_blkdev_queue *queue,
 		struct uk_blkreq **req)
 {
 	int ret = 0;
 	__u32 len;
 	struct virtio_blkdev_request *response_req;
+	unsigned long flags;
 
 	UK_ASSERT(req);
 	*req = NULL;
 
+	ukplat_spin_lock_irqsave(&queue->lock, flags);
 	ret = virtqueue_buffer_dequeue(queue->vq, (void **) &response_req,
 			&len);
+	ukplat_spin_unlock_irqrestore(&queue->lock, flags);
 	if (ret < 0) {
 		uk_pr_info("No data available in the queue\n");
 		return 0;
@@ -399,7 +596,7 @@ static int virtio_blkdev_queue_dequeue(struct uk_blkdev_queue *queue,
 	(*req)->result = -response_req->status;
 
 out:
-	uk_list_add(&response_req->free_list_head, &queue->free_list);
+	virtio_blkdev_request_release(queue, response_req);
 	return ret;
 }
 
@@ -496,6 +693,58 @@ static int virtio_blkdev_queue_intr_disable(struct uk_blkdev *dev,
 	return 0;
 }
 
+/**
+ * Allocates one request per descriptor of the virtqueue and, if indirect
+ * descriptors are used, their descriptor tables.
+ */
+static int virtio_blkdev_requests_alloc(struct uk_blkdev_queue *queue)
+{
+	struct virtio_blkdev_request *virtio_blk_req;
+	uint16_t nb_reqs, nb_desc = 0, i;
+
+	nb_reqs = virtqueue_vring_get_num(queue->vq);
+	queue->reqs = uk_calloc(queue->a, nb_reqs, sizeof(*queue->reqs));
+	if (unlikely(!queue->reqs))
+		return -ENOMEM;
+
+	queue->indirect = NULL;
+	if (queue->vbd->indirect) {
+		/* A table never crosses a page, so that it is physically
+		 * contiguous
+		 */
+		for (nb_desc = 1; nb_desc < queue->vbd->max_segments;)
+			nb_desc <<= 1;
+		nb_desc = MIN(nb_desc,
+			      __PAGE_SIZE / sizeof(struct vring_desc));
+		queue->indirect = uk_memalign(queue->a, __PAGE_SIZE,
+				nb_reqs * nb_desc * sizeof(struct vring_desc));
+		if (unlikely(!queue->indirect))
+			uk_pr_warn("Failed to allocate indirect descriptors, using direct ones\n");
+		else
+			queue->indirect_nb_desc = nb_desc;
+	}
+
+	queue->free = NULL;
+	queue->released = NULL;
+	for (i = nb_reqs; i > 0; i--) {
+		virtio_blk_req = &queue->reqs[i - 1];
+		if (queue->indirect)
+			virtio_blk_req->indirect =
+				&queue->indirect[(i - 1) * nb_desc];
+		virtio_blk_req->next = queue->free;
+		queue->free = virtio_blk_req;
+	}
+
+	return 0;
+}
+
+static void virtio_blkdev_requests_free(struct uk_blkdev_queue *queue)
+{
+	if (queue->indirect)
+		uk_free(queue->a, queue->indirect);
+	uk_free(queue->a, queue->reqs);
+}
+
 /**
  * This function setup the vring infrastructure.
  */
@@ -523,7 +772,7 @@ static int virtio_blkdev_vqueue_setup(struct uk_blkdev_queue *queue,
 	}
 
 	vq = virtio_vqueue_setup(queue->vbd->vdev, queue->lqueue_id, nr_desc,
-			virtio_blkdev_recv_done, a);
+			virtio_blkdev_recv_done, queue->a);
 	if (unlikely(PTRISERR(vq))) {
 		uk_pr_err("Failed to set up virtqueue %"__PRIu16"\n",
 			  queue->lqueue_id);
@@ -571,7 +820,7 @@ static struct uk_blkdev_queue *virtio_blkdev_queue_setup(struct uk_blkdev *dev,
 	queue->vbd = vbdev;
 	queue->nb_desc = nb_desc;
 	queue->lqueue_id = queue_id;
-	UK_INIT_LIST_HEAD(&queue->free_list);
+	ukarch_spin_init(&queue->lock);
 
 	/* Setup the virtqueue with the descriptor */
 	rc = virtio_blkdev_vqueue_setup(queue, nb_desc);
@@ -581,8 +830,17 @@ static struct uk_blkdev_queue *virtio_blkdev_queue_setup(struct uk_blkdev *dev,
 		goto setup_err;
 	}
 
+	rc = virtio_blkdev_requests_alloc(queue);
+	if (rc < 0) {
+		uk_pr_err("Failed to allocate requests of queue %"__PRIu16": %d\n",
+			  queue_id, rc);
+		goto reqs_err;
+	}
+
 exit:
 	return queue;
+reqs_err:
+	virtio_vqueue_release(vbdev->vdev, queue->vq, queue->a);
 setup_err:
 	uk_free(queue->a, queue->sgsegs);
 err_exit:
@@ -599,7 +857,7 @@ static int virtio_blkdev_queue_release(struct uk_blkdev *dev,
 	UK_ASSERT(dev != NULL);
 	vbdev = to_virtioblkdev(dev);
 
-	virtio_blkdev_queue_cleanup_requests(queue);
+	virtio_blkdev_requests_free(queue);
 	uk_free(queue->a, queue->sgsegs);
 	virtio_vqueue_release(vbdev->vdev, queue->vq, queue->a);
 
@@ -657,11 +915,11 @@ static int virtio_blkdev_queues_alloc(struct virtio_blk_device *vbdev,
 	}
 
 	/**
-	 * TODO:
-	 * The virtio device management data structure are allocated using the
-	 * allocator from the blkdev configuration. In the future it might be
-	 * wiser to move it to the allocator of each individual queue. This
-	 * would better considering NUMA support.
+	 * Only the queue management structures are allocated here. The
+	 * request pools, descriptor tables and virtqueues come from the
+	 * allocator of each individual queue (see
+	 * virtio_blkdev_queue_setup()), so that a queue dedicated to a CPU
+	 * can use memory close to it.
 	 */
 	vbdev->qs = uk_calloc(a, conf->nb_queues, sizeof(*vbdev->qs));
 	if (unlikely(vbdev->qs == NULL)) {
@@ -776,6 +1034,10 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 	__u16 num_queues;
 	__u32 max_segments;
 	__u32 max_size_segment;
+	__u32 max_discard_sectors = 0;
+	__u32 discard_alignment = 0;
+	__u32 max_write_zeroes_sectors = 0;
+	__u8 write_zeroes_unmap = 0;
 	int rc = 0;
 
 	UK_ASSERT(vbdev);
@@ -825,6 +1087,10 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 	} else
 		num_queues = 1;
 
+	/* Treat a device without queues like one without multi-queue */
+	if (unlikely(num_queues == 0))
+		num_queues = 1;
+
 	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BLK_F_SEG_MAX)) {
 		rc = virtio_config_get(vbdev->vdev,
 			__offsetof(struct virtio_blk_config, seg_max),
@@ -855,6 +1121,59 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 	} else
 		max_size_segment = __PAGE_SIZE;
 
+	/* We send a single range with each discard or write zeroes request */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BLK_F_DISCARD)) {
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   max_discard_sectors),
+			&max_discard_sectors,
+			sizeof(max_discard_sectors),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get max discard sectors %d\n",
+					rc);
+			goto exit;
+		}
+
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   discard_sector_alignment),
+			&discard_alignment,
+			sizeof(discard_alignment),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get discard alignment %d\n",
+					rc);
+			goto exit;
+		}
+	}
+
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_BLK_F_WRITE_ZEROES)) {
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   max_write_zeroes_sectors),
+			&max_write_zeroes_sectors,
+			sizeof(max_write_zeroes_sectors),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get max write zeroes sectors %d\n",
+					rc);
+			goto exit;
+		}
+
+		rc = virtio_config_get(vbdev->vdev,
+			__offsetof(struct virtio_blk_config,
+				   write_zeroes_may_unmap),
+			&write_zeroes_unmap,
+			sizeof(write_zeroes_unmap),
+			1);
+		if (unlikely(rc)) {
+			uk_pr_err("Failed to get write zeroes unmap %d\n",
+					rc);
+			goto exit;
+		}
+	}
+
 	cap->ssize = ssize;
 	cap->sectors = sectors;
 	cap->ioalign = sizeof(void *);
@@ -862,12 +1181,19 @@ static int virtio_blkdev_feature_negotiate(struct virtio_blk_device *vbdev)
 			host_features, VIRTIO_BLK_F_RO)) ? O_RDONLY : O_RDWR;
 	cap->max_sectors_per_req =
 			max_size_segment / ssize * (max_segments - 2);
+	cap->max_segments = max_segments - 2;
+	cap->max_discard_sectors = max_discard_sectors;
+	cap->max_write_zeroes_sectors = max_write_zeroes_sectors;
 
 	vbdev->max_vqueue_pairs = num_queues;
 	vbdev->max_segments = max_segments;
 	vbdev->max_size_segment = max_size_segment;
 	vbdev->writeback = VIRTIO_FEATURE_HAS(host_features,
 				VIRTIO_BLK_F_FLUSH);
+	vbdev->discard_alignment = discard_alignment;
+	vbdev->write_zeroes_unmap = write_zeroes_unmap;
+	vbdev->indirect = VIRTIO_FEATURE_HAS(host_features,
+				VIRTIO_F_INDIRECT_DESC);
 
 	/**
 	 * Mask out features supported by both driver and device.
@@ -914,6 +1240,7 @@ static int virtio_blk_add_dev(struct virtio_dev *vdev)
 	vbdev->vdev = vdev;
 	vbdev->blkdev.finish_reqs = virtio_blkdev_complete_reqs;
 	vbdev->blkdev.submit_one = virtio_blkdev_submit_request;
+	vbdev->blkdev.submit_batch = virtio_blkdev_submit_batch;
 	vbdev->blkdev.dev_ops = &virtio_blkdev_ops;
 
 	rc = uk_blkdev_drv_register(&vbdev->blkdev, a, drv_name);
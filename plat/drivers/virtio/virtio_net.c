@@ -33,6 +33,10 @@
 #include <uk/sglist.h>
 #include <uk/arch/types.h>
 #include <uk/arch/limits.h>
+#include <uk/arch/lcpu.h>
+#include <uk/arch/time.h>
+#include <uk/plat/lcpu.h>
+#include <uk/plat/time.h>
 #include <uk/netbuf.h>
 #include <uk/netdev.h>
 #include <uk/netdev_core.h>
@@ -61,9 +65,32 @@
 #define  VTNET_INTR_USR_EN_MASK   (2)
 
 /**
- * Define max possible fragments for the network packets.
+ * Control virtqueue commands consist of a header, up to four data buffers and
+ * the acknowledgement.
  */
-#define NET_MAX_FRAGMENTS    ((__U16_MAX >> __PAGE_SHIFT) + 2)
+#define VTNET_CTRL_MAX_DATA	4
+#define VTNET_CTRL_SEGS		(VTNET_CTRL_MAX_DATA + 2)
+/**
+ * Time to wait for the device to complete a control virtqueue command.
+ */
+#define VTNET_CTRL_TIMEOUT	ukarch_time_msec_to_nsec(1000)
+
+/**
+ * Size of the Toeplitz key that is used for RSS if the user does not provide
+ * one, and the limit for user keys.
+ */
+#define VTNET_RSS_KEY_SIZE	40
+
+/**
+ * Define max possible fragments for the network packets. A 64 KiB TSO packet
+ * that is made of MTU-sized netbufs needs to fit.
+ */
+#define NET_MAX_FRAGMENTS    ((__U16_MAX / UK_ETH_PAYLOAD_MAXLEN) + 2)
+
+/**
+ * Max length of a transmitted packet with segmentation offload
+ */
+#define VIRTIO_GSO_BUFFER_LEN ((UK_NETDEV_TSO_MAXLEN) + (VIRTIO_HDR_LEN))
 
 #define to_virtionetdev(ndev) \
 	__containerof(ndev, struct virtio_net_device, netdev)
@@ -100,6 +127,10 @@ struct uk_netdev_tx_queue {
 	uint16_t nb_desc;
 	/* The flag to interrupt on the transmit queue */
 	uint8_t intr_enabled;
+	/* Size of the virtio-net header */
+	uint8_t hdr_len;
+	/* UK_NETBUF_F_GSO_* flags that the device handles */
+	uint8_t gso_flags;
 	/* Reference to the uk_netdev */
 	struct uk_netdev *ndev;
 	/* The scatter list and its associated fragements */
@@ -123,6 +154,10 @@ struct uk_netdev_rx_queue {
 	uint16_t nb_desc;
 	/* The flag to interrupt on the transmit queue */
 	uint8_t intr_enabled;
+	/* Size of the virtio-net header */
+	uint8_t hdr_len;
+	/* Packets may span multiple buffers (VIRTIO_NET_F_MRG_RXBUF) */
+	uint8_t mrg_rxbuf;
 	/* User-provided receive buffer allocation function */
 	uk_netdev_alloc_rxpkts alloc_rxpkts;
 	void *alloc_rxpkts_argp;
@@ -133,6 +168,14 @@ struct uk_netdev_rx_queue {
 	struct uk_sglist_seg sgsegs[NET_MAX_FRAGMENTS];
 };
 
+/**
+ * @internal A data buffer of a control virtqueue command.
+ */
+struct virtio_net_ctrl_data {
+	void *buf;
+	__sz len;
+};
+
 struct virtio_net_device {
 	/* Virtio Device */
 	struct virtio_dev *vdev;
@@ -141,6 +184,27 @@ struct virtio_net_device {
 	struct uk_netdev netdev;
 	/* Count of the number of the virtqueues */
 	__u16 max_vqueue_pairs;
+	/* Number of configured queue pairs */
+	__u16 nb_queue_pairs;
+	/* Control virtqueue (VIRTIO_NET_F_CTRL_VQ) and command buffers */
+	struct virtqueue *cvq;
+	struct uk_sglist cvq_sg;
+	struct uk_sglist_seg cvq_sgsegs[VTNET_CTRL_SEGS];
+	struct virtio_net_ctrl_hdr cvq_hdr;
+	virtio_net_ctrl_ack cvq_ack;
+	struct virtio_net_ctrl_mq cvq_mq;
+	__u64 cvq_offloads;
+	/* Receive coalesced packets if the device supports it */
+	__u8 lro;
+	/* RSS capabilities of the device (VIRTIO_NET_F_RSS) */
+	__u32 rss_hash_types_supported;
+	__u16 rss_max_reta_size;
+	__u8 rss_max_key_size;
+	/* RSS configuration, applied on start if hash types are set */
+	struct virtio_net_rss_config rss;
+	__u16 *rss_reta;
+	struct virtio_net_rss_key rss_key;
+	__u8 rss_key_data[VTNET_RSS_KEY_SIZE];
 	/* List of the Rx/Tx queue */
 	__u16    rx_vqueue_cnt;
 	struct   uk_netdev_rx_queue *rxqs;
@@ -152,6 +216,8 @@ struct virtio_net_device {
 	__u16 max_mtu;
 	/* The mtu */
 	__u16 mtu;
+	/* Size of the virtio-net header */
+	__u8 hdr_len;
 	/* The hw address of the netdevice */
 	struct uk_hwaddr hw_addr;
 	/*  Netdev state */
@@ -195,6 +261,12 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 static int virtio_netdev_recv(struct uk_netdev *dev,
 			      struct uk_netdev_rx_queue *queue,
 			      struct uk_netbuf **pkt);
+static int virtio_netdev_xmit_burst(struct uk_netdev *dev,
+				    struct uk_netdev_tx_queue *queue,
+				    struct uk_netbuf **pkt, __u16 *cnt);
+static int virtio_netdev_recv_burst(struct uk_netdev *dev,
+				    struct uk_netdev_rx_queue *queue,
+				    struct uk_netbuf **pkt, __u16 *cnt);
 static const struct uk_hwaddr *virtio_net_mac_get(struct uk_netdev *n);
 static __u16 virtio_net_mtu_get(struct uk_netdev *n);
 static unsigned virtio_net_promisc_get(struct uk_netdev *n);
@@ -273,18 +345,22 @@ static int virtio_netdev_rx_fillup(struct uk_netdev_rx_queue *rxq,
 	__u16 req;
 	__u16 cnt = 0;
 	__u16 filled = 0;
+	__u16 bufdesc;
 
 	/**
-	 * Fixed amount of memory is allocated to each received buffer. In
-	 * our case since we don't support jumbo frame or LRO yet we require
-	 * that the buffer feed to the ring descriptor is atleast
-	 * ethernet MTU + virtio net header.
-	 * Because we using 2 descriptor for a single netbuf, our effective
-	 * queue size is just the half.
+	 * Fixed amount of memory is allocated to each received buffer.
+	 * Without mergeable receive buffers, we require that the buffer feed
+	 * to the ring descriptor is atleast ethernet MTU + virtio net header
+	 * and we use 2 descriptors for a single netbuf, so our effective
+	 * queue size is just the half. With mergeable receive buffers, a
+	 * netbuf takes a single descriptor and the device spreads packets
+	 * that do not fit over multiple netbufs.
 	 */
-	nb_desc = ALIGN_DOWN(nb_desc, 2);
+	bufdesc = rxq->mrg_rxbuf ? 1 : 2;
+	nb_desc = ALIGN_DOWN(nb_desc, bufdesc);
+	virtqueue_batch_begin(rxq->vq);
 	while (filled < nb_desc) {
-		req = MIN(nb_desc / 2, RX_FILLUP_BATCHLEN);
+		req = MIN((nb_desc - filled) / bufdesc, RX_FILLUP_BATCHLEN);
 		cnt = rxq->alloc_rxpkts(rxq->alloc_rxpkts_argp, netbuf, req);
 		for (i = 0; i < cnt; i++) {
 			uk_pr_debug("Enqueue netbuf %"PRIu16"/%"PRIu16" (%p) to virtqueue %p...\n",
@@ -303,7 +379,7 @@ static int virtio_netdev_rx_fillup(struct uk_netdev_rx_queue *rxq,
 				status |= UK_NETDEV_STATUS_UNDERRUN;
 				goto out;
 			}
-			filled += 2;
+			filled += bufdesc;
 		}
 
 		if (unlikely(cnt < req)) {
@@ -315,8 +391,9 @@ static int virtio_netdev_rx_fillup(struct uk_netdev_rx_queue *rxq,
 	}
 
 out:
+	virtqueue_batch_end(rxq->vq);
 	uk_pr_debug("Programmed %"PRIu16" receive netbufs to receive virtqueue %p (status %x)\n",
-		    filled / 2, rxq, status);
+		    filled / bufdesc, rxq, status);
 
 	/**
 	 * Notify the host, when we submit new descriptor(s).
@@ -327,33 +404,43 @@ out:
 	return status;
 }
 
-static int virtio_netdev_xmit(struct uk_netdev *dev,
-			      struct uk_netdev_tx_queue *queue,
-			      struct uk_netbuf *pkt)
+/**
+ * Adds a packet to the transmit virtqueue without notifying the host.
+ * Returns the number of available descriptors, -EAGAIN if the virtqueue is
+ * full, or another negative error code. The packet is left unchanged on
+ * errors.
+ */
+static int virtio_netdev_xmit_enqueue(struct uk_netdev_tx_queue *queue,
+				      struct uk_netbuf *pkt)
 {
-	struct virtio_net_device *vndev __unused;
 	struct virtio_net_hdr *vhdr;
 	struct virtio_net_hdr_padded *padded_hdr;
 	int16_t header_sz = sizeof(*padded_hdr);
 	int rc = 0;
-	int status = 0x0;
 	size_t total_len = 0;
+	size_t max_len = VIRTIO_PKT_BUFFER_LEN;
 	__u8  *buf_start;
 	size_t buf_len;
-
-	UK_ASSERT(dev);
-	UK_ASSERT(pkt && queue);
-
-	vndev = to_virtionetdev(dev);
-	/**
-	 * We are reclaiming the free descriptors from buffers. The function is
-	 * not protected by means of locks. We need to be careful if there are
-	 * multiple context through which we free the tx descriptors.
-	 */
-	virtio_netdev_xmit_free(queue);
+	__u16 l4_off;
 
 	buf_start = pkt->data;
 	buf_len = pkt->len;
+
+	if (pkt->flags & UK_NETBUF_F_GSO_MASK) {
+		/* Segmentation requires checksum offloading and the TCP
+		 * header in the first netbuf
+		 */
+		if (unlikely(((pkt->flags & UK_NETBUF_F_GSO_MASK)
+			      & ~queue->gso_flags)
+			     || !(pkt->flags & UK_NETBUF_F_PARTIAL_CSUM)
+			     || !pkt->gso_size
+			     || (size_t)pkt->csum_start + 13 >= buf_len)) {
+			uk_pr_err("Unsupported segmentation offload request\n");
+			return -ENOTSUP;
+		}
+		max_len = VIRTIO_GSO_BUFFER_LEN;
+	}
+
 	/**
 	 * Use the preallocated header space for the virtio header.
 	 */
@@ -378,7 +465,7 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 	 *       to `uk_sglist_append_netbuf()`. However, a netbuf
 	 *       chain can only once have set the PARTIAL_CSUM flag.
 	 */
-	memset(vhdr, 0, sizeof(*vhdr));
+	memset(vhdr, 0, queue->hdr_len);
 	if (pkt->flags & UK_NETBUF_F_PARTIAL_CSUM) {
 		vhdr->flags       |= VIRTIO_NET_HDR_F_NEEDS_CSUM;
 		/* `csum_start` is without header size */
@@ -386,6 +473,17 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 		vhdr->csum_offset  = pkt->csum_offset;
 	}
 	vhdr->gso_type = VIRTIO_NET_HDR_GSO_NONE;
+	if (pkt->flags & UK_NETBUF_F_GSO_MASK) {
+		vhdr->gso_type = (pkt->flags & UK_NETBUF_F_GSO_TCPV4)
+				 ? VIRTIO_NET_HDR_GSO_TCPV4
+				 : VIRTIO_NET_HDR_GSO_TCPV6;
+		vhdr->gso_size = pkt->gso_size;
+		/* Headers span up to the end of the TCP header, whose length
+		 * is found in the upper nibble of byte 12 of the TCP header
+		 */
+		l4_off = vhdr->csum_start;
+		vhdr->hdr_len = l4_off + ((buf_start[l4_off + 12] >> 4) << 2);
+	}
 
 	/**
 	 * Prepare the sglist and enqueue the buffer to the virtio-ring.
@@ -400,7 +498,7 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 	 * 1 for the virtio header and the other for the actual network packet.
 	 */
 	/* Appending the data to the list. */
-	rc = uk_sglist_append(&queue->sg, vhdr, sizeof(*vhdr));
+	rc = uk_sglist_append(&queue->sg, vhdr, queue->hdr_len);
 	if (unlikely(rc != 0)) {
 		uk_pr_err("Failed to append to the sg list\n");
 		goto err_remove_vhdr;
@@ -419,9 +517,9 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 	}
 
 	total_len = uk_sglist_length(&queue->sg);
-	if (unlikely(total_len > VIRTIO_PKT_BUFFER_LEN)) {
-		uk_pr_err("Packet size too big: %lu, max:%u\n",
-			  total_len, VIRTIO_PKT_BUFFER_LEN);
+	if (unlikely(total_len > max_len)) {
+		uk_pr_err("Packet size too big: %lu, max:%lu\n",
+			  total_len, max_len);
 		rc = -ENOTSUP;
 		goto err_remove_vhdr;
 	}
@@ -431,6 +529,45 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 	 */
 	rc = virtqueue_buffer_enqueue(queue->vq, pkt, &queue->sg,
 				      queue->sg.sg_nseg, 0);
+	if (likely(rc >= 0))
+		return rc;
+
+	if (rc == -ENOSPC) {
+		uk_pr_debug("No more descriptor available\n");
+		rc = -EAGAIN;
+	} else {
+		uk_pr_err("Failed to enqueue descriptors into the ring: %d\n",
+			  rc);
+	}
+
+err_remove_vhdr:
+	/**
+	 * Remove header before exiting because we could not send
+	 */
+	uk_netbuf_header(pkt, -header_sz);
+err_exit:
+	UK_ASSERT(rc < 0);
+	return rc;
+}
+
+static int virtio_netdev_xmit(struct uk_netdev *dev,
+			      struct uk_netdev_tx_queue *queue,
+			      struct uk_netbuf *pkt)
+{
+	int status = 0x0;
+	int rc;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(pkt && queue);
+
+	/**
+	 * We are reclaiming the free descriptors from buffers. The function is
+	 * not protected by means of locks. We need to be careful if there are
+	 * multiple context through which we free the tx descriptors.
+	 */
+	virtio_netdev_xmit_free(queue);
+
+	rc = virtio_netdev_xmit_enqueue(queue, pkt);
 	if (likely(rc >= 0)) {
 		status |= UK_NETDEV_STATUS_SUCCESS;
 		/**
@@ -442,24 +579,49 @@ static int virtio_netdev_xmit(struct uk_netdev *dev,
 		 * return UK_NETDEV_STATUS_MORE.
 		 */
 		status |= likely(rc > 0) ? UK_NETDEV_STATUS_MORE : 0x0;
-	} else if (rc == -ENOSPC) {
-		uk_pr_debug("No more descriptor available\n");
-		/**
-		 * Remove header before exiting because we could not send
-		 */
-		uk_netbuf_header(pkt, -header_sz);
-	} else {
-		uk_pr_err("Failed to enqueue descriptors into the ring: %d\n",
-			  rc);
-		goto err_remove_vhdr;
+	} else if (rc != -EAGAIN) {
+		return rc;
 	}
 	return status;
+}
 
-err_remove_vhdr:
-	uk_netbuf_header(pkt, -header_sz);
-err_exit:
-	UK_ASSERT(rc < 0);
-	return rc;
+static int virtio_netdev_xmit_burst(struct uk_netdev *dev,
+				    struct uk_netdev_tx_queue *queue,
+				    struct uk_netbuf **pkt, __u16 *cnt)
+{
+	int status = 0x0;
+	int rc = 0;
+	__u16 i;
+
+	UK_ASSERT(dev);
+	UK_ASSERT(pkt && cnt && queue);
+
+	virtio_netdev_xmit_free(queue);
+
+	/**
+	 * Publish all packets of the burst with a single update of the
+	 * available ring and notify the host only once.
+	 */
+	virtqueue_batch_begin(queue->vq);
+	for (i = 0; i < *cnt; i++) {
+		rc = virtio_netdev_xmit_enqueue(queue, pkt[i]);
+		if (unlikely(rc <= 0)) {
+			if (rc == 0)
+				i++;
+			break;
+		}
+	}
+	virtqueue_batch_end(queue->vq);
+
+	*cnt = i;
+	if (i) {
+		virtqueue_host_notify(queue->vq);
+		status |= UK_NETDEV_STATUS_SUCCESS;
+		status |= (rc > 0) ? UK_NETDEV_STATUS_MORE : 0x0;
+	} else if (rc != -EAGAIN) {
+		return rc;
+	}
+	return status;
 }
 
 static int virtio_netdev_rxq_enqueue(struct uk_netdev_rx_queue *rxq,
@@ -477,6 +639,24 @@ static int virtio_netdev_rxq_enqueue(struct uk_netdev_rx_queue *rxq,
 		return -ENOSPC;
 	}
 
+	/**
+	 * With mergeable receive buffers, the device places the header and
+	 * the packet data back-to-back into a single descriptor. We reserve
+	 * the header space in front of the netbuf data so that packet data
+	 * stays at its original position.
+	 */
+	if (rxq->mrg_rxbuf) {
+		rc = uk_netbuf_header(netbuf, rxq->hdr_len);
+		if (unlikely(rc != 1)) {
+			uk_pr_err("Failed to allocate space to prepend virtio header\n");
+			return -EINVAL;
+		}
+		sg = &rxq->sg;
+		uk_sglist_reset(sg);
+		uk_sglist_append(sg, netbuf->data, netbuf->len);
+		return virtqueue_buffer_enqueue(rxq->vq, netbuf, sg, 0, 1);
+	}
+
 	/**
 	 * Saving the buffer information before reserving the header space.
 	 */
@@ -506,6 +686,91 @@ static int virtio_netdev_rxq_enqueue(struct uk_netdev_rx_queue *rxq,
 	return rc;
 }
 
+/**
+ * Copies the offload information of a virtio-net header to a received netbuf.
+ * `csum_start` is returned relative to the start of the virtio-net header,
+ * uk_netbuf_header() adjusts it when the header gets removed.
+ */
+static void virtio_netdev_rx_offload(struct uk_netbuf *buf,
+				     const struct virtio_net_hdr *vhdr,
+				     __u16 hdr_space)
+{
+	buf->flags  = ((vhdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
+		       ? UK_NETBUF_F_DATA_VALID   : 0x0);
+	if (vhdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+		buf->flags |= UK_NETBUF_F_PARTIAL_CSUM;
+		buf->csum_offset = vhdr->csum_offset;
+		buf->csum_start  = vhdr->csum_start + hdr_space;
+	}
+
+	switch (vhdr->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+	case VIRTIO_NET_HDR_GSO_TCPV4:
+		buf->flags |= UK_NETBUF_F_GSO_TCPV4;
+		buf->gso_size = vhdr->gso_size;
+		break;
+	case VIRTIO_NET_HDR_GSO_TCPV6:
+		buf->flags |= UK_NETBUF_F_GSO_TCPV6;
+		buf->gso_size = vhdr->gso_size;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Dequeues a packet that may span multiple buffers and returns it as netbuf
+ * chain. The device marks all buffers of a packet as used at once, so the
+ * remaining buffers are available as soon as the first one is.
+ */
+static int virtio_netdev_rxq_dequeue_mrg(struct uk_netdev_rx_queue *rxq,
+					 struct uk_netbuf **netbuf)
+{
+	struct virtio_net_hdr_mrg_rxbuf *vhdr;
+	struct uk_netbuf *buf = NULL, *seg, *tail;
+	__u16 nb_bufs;
+	__u32 len;
+	int ret;
+	int rc __maybe_unused;
+
+	ret = virtqueue_buffer_dequeue(rxq->vq, (void **) &buf, &len);
+	if (ret < 0) {
+		uk_pr_debug("No data available in the queue\n");
+		*netbuf = NULL;
+		return rxq->nb_desc;
+	}
+	if (unlikely(len < (__u32) rxq->hdr_len + UK_ETH_HDR_UNTAGGED_LEN
+		     || len > buf->len)) {
+		uk_pr_err("Received invalid packet size: %"__PRIu32"\n", len);
+		uk_netbuf_free(buf);
+		return -EINVAL;
+	}
+
+	vhdr = (struct virtio_net_hdr_mrg_rxbuf *) buf->data;
+	nb_bufs = vhdr->num_buffers;
+	virtio_netdev_rx_offload(buf, &vhdr->hdr, rxq->hdr_len);
+
+	buf->len = len;
+	rc = uk_netbuf_header(buf, -((int16_t) rxq->hdr_len));
+	UK_ASSERT(rc == 1);
+
+	for (tail = buf; nb_bufs > 1; nb_bufs--, tail = seg) {
+		ret = virtqueue_buffer_dequeue(rxq->vq, (void **) &seg, &len);
+		if (unlikely(ret < 0 || len > seg->len)) {
+			uk_pr_err("Received incomplete packet\n");
+			if (ret >= 0)
+				uk_netbuf_free(seg);
+			uk_netbuf_free(buf);
+			return -EINVAL;
+		}
+		/* Continuation buffers hold data from the descriptor start */
+		seg->len = len;
+		uk_netbuf_connect(tail, seg);
+	}
+	*netbuf = buf;
+
+	return ret;
+}
+
 static int virtio_netdev_rxq_dequeue(struct uk_netdev_rx_queue *rxq,
 				     struct uk_netbuf **netbuf)
 {
@@ -517,6 +782,9 @@ static int virtio_netdev_rxq_dequeue(struct uk_netdev_rx_queue *rxq,
 
 	UK_ASSERT(netbuf);
 
+	if (rxq->mrg_rxbuf)
+		return virtio_netdev_rxq_dequeue_mrg(rxq, netbuf);
+
 	ret = virtqueue_buffer_dequeue(rxq->vq, (void **) &buf, &len);
 	if (ret < 0) {
 		uk_pr_debug("No data available in the queue\n");
@@ -533,17 +801,8 @@ static int virtio_netdev_rxq_dequeue(struct uk_netdev_rx_queue *rxq,
 	 * Copy virtio header flags to netbuf
 	 */
 	vhdr = (struct virtio_net_hdr *) buf->data;
-	buf->flags  = ((vhdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
-		       ? UK_NETBUF_F_DATA_VALID   : 0x0);
-	if (vhdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
-		buf->flags |= UK_NETBUF_F_PARTIAL_CSUM;
-		buf->csum_offset = vhdr->csum_offset;
-		/* NOTE: csum_start is without virtio header
-		 *       (uk_netbuf_header() will remove it again)
-		 */
-		buf->csum_start  = vhdr->csum_start
-			+ ((uint16_t)sizeof(struct virtio_net_hdr_padded));
-	}
+	virtio_netdev_rx_offload(buf, vhdr,
+				 sizeof(struct virtio_net_hdr_padded));
 
 	/**
 	 * Removing the virtio header from the buffer and adjusting length.
@@ -627,6 +886,66 @@ err_exit:
 	return rc;
 }
 
+static int virtio_netdev_recv_burst(struct uk_netdev *dev __unused,
+				    struct uk_netdev_rx_queue *queue,
+				    struct uk_netbuf **pkt, __u16 *cnt)
+{
+	int status = 0x0;
+	int used = -1;
+	int rc = 0;
+	__u16 i = 0, first;
+
+	UK_ASSERT(dev && queue);
+	UK_ASSERT(pkt && cnt);
+
+	/* Queue interrupts have to be off when calling receive */
+	UK_ASSERT(!(queue->intr_enabled & VTNET_INTR_EN));
+
+again:
+	for (first = i; i < *cnt; i++) {
+		rc = virtio_netdev_rxq_dequeue(queue, &pkt[i]);
+		if (unlikely(rc < 0)) {
+			uk_pr_err("Failed to dequeue the packet: %d\n", rc);
+			if (i == 0)
+				return rc;
+			break;
+		}
+		if (!pkt[i])
+			break;
+		used = rc;
+	}
+
+	/* Re-program the consumed descriptors once for the whole burst */
+	if (i > first)
+		status |= virtio_netdev_rx_fillup(queue,
+						  (queue->nb_desc - used), 1);
+
+	/* Enable interrupt only when user had previously enabled it */
+	if (queue->intr_enabled & VTNET_INTR_USR_EN_MASK) {
+		rc = virtqueue_intr_enable(queue->vq);
+		if (rc == 1) {
+			/**
+			 * Packets arrived after reading the queue and before
+			 * enabling the interrupt
+			 */
+			if (i < *cnt)
+				goto again;
+			status |= UK_NETDEV_STATUS_MORE;
+		}
+	} else if (i > 0) {
+		/**
+		 * For polling case, we report always there are further
+		 * packets unless the queue is empty.
+		 */
+		status |= UK_NETDEV_STATUS_MORE;
+	}
+
+	*cnt = i;
+	if (i)
+		status |= UK_NETDEV_STATUS_SUCCESS;
+	return status;
+}
+
 static struct uk_netdev_rx_queue *virtio_netdev_rx_queue_setup(
 				struct uk_netdev *n, uint16_t queue_id,
 				uint16_t nb_desc,
@@ -641,7 +960,7 @@ static struct uk_netdev_rx_queue *virtio_netdev_rx_queue_setup(
 	UK_ASSERT(conf->alloc_rxpkts);
 
 	vndev = to_virtionetdev(n);
-	if (queue_id >= vndev->max_vqueue_pairs) {
+	if (queue_id >= vndev->nb_queue_pairs) {
 		uk_pr_err("Invalid virtqueue identifier: %"__PRIu16"\n",
 			  queue_id);
 		rc = -EINVAL;
@@ -659,6 +978,21 @@ static struct uk_netdev_rx_queue *virtio_netdev_rx_queue_setup(
 	rxq->alloc_rxpkts = conf->alloc_rxpkts;
 	rxq->alloc_rxpkts_argp = conf->alloc_rxpkts_argp;
 
+	/* Route the queue interrupts to the requested lcpu, if possible */
+	if (conf->lcpu != UK_NETDEV_LCPU_ANY) {
+		if (conf->lcpu < 0 ||
+		    (unsigned int)conf->lcpu >= ukplat_lcpu_count()) {
+			uk_pr_warn("Invalid lcpu %d for receive queue %"__PRIu16": Ignored\n",
+				   conf->lcpu, queue_id);
+		} else {
+			rc = virtio_vqueue_affinity_set(vndev->vdev, rxq->vq,
+							conf->lcpu);
+			if (rc < 0)
+				uk_pr_debug("Cannot route interrupts of receive queue %"__PRIu16" to lcpu %d: %d\n",
+					    queue_id, conf->lcpu, rc);
+		}
+	}
+
 	/* Allocate receive buffers for this queue */
 	virtio_netdev_rx_fillup(rxq, rxq->nb_desc, 0);
 
@@ -693,13 +1027,12 @@ static int virtio_netdev_vqueue_setup(struct virtio_net_device *vndev,
 	uint16_t max_desc, hwvq_id;
 	struct virtqueue *vq;
 
+	id = queue_id;
 	if (queue_type == VNET_RX) {
-		id = vndev->rx_vqueue_cnt;
 		callback = virtio_netdev_recv_done;
 		max_desc = vndev->rxqs[id].max_nb_desc;
 		hwvq_id = vndev->rxqs[id].hwvq_id;
 	} else {
-		id = vndev->tx_vqueue_cnt;
 		/* We don't support the callback from the txqueue yet */
 		callback = NULL;
 		max_desc = vndev->txqs[id].max_nb_desc;
@@ -730,12 +1063,24 @@ static int virtio_netdev_vqueue_setup(struct virtio_net_device *vndev,
 
 	if (queue_type == VNET_RX) {
 		vq->priv = &vndev->rxqs[id];
+		vndev->rxqs[id].hdr_len = vndev->hdr_len;
+		vndev->rxqs[id].mrg_rxbuf =
+			VIRTIO_FEATURE_HAS(vndev->vdev->features,
+					   VIRTIO_NET_F_MRG_RXBUF);
 		vndev->rxqs[id].ndev = &vndev->netdev;
 		vndev->rxqs[id].vq = vq;
 		vndev->rxqs[id].nb_desc = nr_desc;
 		vndev->rxqs[id].lqueue_id = queue_id;
 		vndev->rx_vqueue_cnt++;
 	} else {
+		vndev->txqs[id].hdr_len = vndev->hdr_len;
+		vndev->txqs[id].gso_flags =
+			(VIRTIO_FEATURE_HAS(vndev->vdev->features,
+					    VIRTIO_NET_F_HOST_TSO4)
+			 ? UK_NETBUF_F_GSO_TCPV4 : 0)
+			| (VIRTIO_FEATURE_HAS(vndev->vdev->features,
+					      VIRTIO_NET_F_HOST_TSO6)
+			   ? UK_NETBUF_F_GSO_TCPV6 : 0);
 		vndev->txqs[id].vq = vq;
 		vndev->txqs[id].ndev = &vndev->netdev;
 		vndev->txqs[id].nb_desc = nr_desc;
@@ -756,7 +1101,7 @@ static struct uk_netdev_tx_queue *virtio_netdev_tx_queue_setup(
 
 	UK_ASSERT(n);
 	vndev = to_virtionetdev(n);
-	if (queue_id >= vndev->max_vqueue_pairs) {
+	if (queue_id >= vndev->nb_queue_pairs) {
 		uk_pr_err("Invalid virtqueue identifier: %"__PRIu16"\n",
 			  queue_id);
 		rc = -EINVAL;
@@ -790,7 +1135,7 @@ static int virtio_netdev_rxq_info_get(struct uk_netdev *dev,
 	UK_ASSERT(dev);
 	UK_ASSERT(qinfo);
 	vndev = to_virtionetdev(dev);
-	if (unlikely(queue_id >= vndev->max_vqueue_pairs)) {
+	if (unlikely(queue_id >= vndev->nb_queue_pairs)) {
 		uk_pr_err("Invalid virtqueue id: %"__PRIu16"\n", queue_id);
 		rc = -EINVAL;
 		goto exit;
@@ -817,7 +1162,7 @@ static int virtio_netdev_txq_info_get(struct uk_netdev *dev,
 	UK_ASSERT(qinfo);
 
 	vndev = to_virtionetdev(dev);
-	if (unlikely(queue_id >= vndev->max_vqueue_pairs)) {
+	if (unlikely(queue_id >= vndev->nb_queue_pairs)) {
 		uk_pr_err("Invalid queue_id %"__PRIu16"\n", queue_id);
 		rc = -EINVAL;
 		goto exit;
@@ -922,6 +1267,61 @@ static int virtio_netdev_feature_negotiate(struct uk_netdev *n)
 		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_GUEST_CSUM);
 	}
 
+	/**
+	 * Control virtqueue, multiqueue and receive side scaling
+	 * NOTE: Multiple queue pairs and RSS are configured with commands on
+	 *       the control virtqueue so both depend on it.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_CTRL_VQ)) {
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_CTRL_VQ);
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_MQ))
+			VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_MQ);
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_RSS))
+			VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_RSS);
+	} else {
+		uk_pr_debug("%p: Host does not offer control virtqueue: Multiqueue disabled.\n",
+			    n);
+	}
+
+	/**
+	 * Mergeable receive buffers
+	 * NOTE: Packets that do not fit into a single receive buffer are
+	 *       spread over multiple ones and returned as netbuf chain.
+	 */
+	if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_MRG_RXBUF))
+		VIRTIO_FEATURE_SET(drv_features, VIRTIO_NET_F_MRG_RXBUF);
+
+	/**
+	 * Segmentation offloading
+	 * NOTE: Segmentation requires the corresponding checksum offload.
+	 *       We only accept coalesced packets with mergeable receive
+	 *       buffers so that we do not need to post 64 KiB buffers. Since
+	 *       users have to opt in, we also need to be able to turn them off
+	 *       again with VIRTIO_NET_CTRL_GUEST_OFFLOADS.
+	 */
+	if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_CSUM)) {
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_HOST_TSO4))
+			VIRTIO_FEATURE_SET(drv_features,
+					   VIRTIO_NET_F_HOST_TSO4);
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_HOST_TSO6))
+			VIRTIO_FEATURE_SET(drv_features,
+					   VIRTIO_NET_F_HOST_TSO6);
+	}
+	if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_GUEST_CSUM)
+	    && VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_MRG_RXBUF)
+	    && VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_CTRL_VQ)
+	    && VIRTIO_FEATURE_HAS(host_features,
+				  VIRTIO_NET_F_CTRL_GUEST_OFFLOADS)) {
+		VIRTIO_FEATURE_SET(drv_features,
+				   VIRTIO_NET_F_CTRL_GUEST_OFFLOADS);
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_GUEST_TSO4))
+			VIRTIO_FEATURE_SET(drv_features,
+					   VIRTIO_NET_F_GUEST_TSO4);
+		if (VIRTIO_FEATURE_HAS(host_features, VIRTIO_NET_F_GUEST_TSO6))
+			VIRTIO_FEATURE_SET(drv_features,
+					   VIRTIO_NET_F_GUEST_TSO6);
+	}
+
 	/**
 	 * Announce our enabled driver features back to the backend device
 	 */
@@ -955,6 +1355,46 @@ static int virtio_netdev_feature_negotiate(struct uk_netdev *n)
 		vndev->max_mtu = vndev->mtu = UK_ETH_PAYLOAD_MAXLEN;
 	}
 
+	vndev->hdr_len = VIRTIO_FEATURE_HAS(drv_features,
+					    VIRTIO_NET_F_MRG_RXBUF)
+			 ? sizeof(struct virtio_net_hdr_mrg_rxbuf)
+			 : sizeof(struct virtio_net_hdr);
+
+	vndev->max_vqueue_pairs = 1;
+	if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_MQ)) {
+		virtio_config_get(vndev->vdev,
+				  __offsetof(struct virtio_net_config,
+					     max_virtqueue_pairs),
+				  &vndev->max_vqueue_pairs,
+				  sizeof(vndev->max_vqueue_pairs), 1);
+		vndev->max_vqueue_pairs = MAX(vndev->max_vqueue_pairs,
+					      VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN);
+		vndev->max_vqueue_pairs = MIN(vndev->max_vqueue_pairs,
+					      VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MAX);
+	}
+
+	if (VIRTIO_FEATURE_HAS(drv_features, VIRTIO_NET_F_RSS)) {
+		virtio_config_get(vndev->vdev,
+				  __offsetof(struct virtio_net_config,
+					     rss_max_key_size),
+				  &vndev->rss_max_key_size,
+				  sizeof(vndev->rss_max_key_size), 1);
+		virtio_config_get(vndev->vdev,
+				  __offsetof(struct virtio_net_config,
+					     rss_max_indirection_table_length),
+				  &vndev->rss_max_reta_size,
+				  sizeof(vndev->rss_max_reta_size), 1);
+		virtio_config_get(vndev->vdev,
+				  __offsetof(struct virtio_net_config,
+					     supported_hash_types),
+				  &vndev->rss_hash_types_supported,
+				  sizeof(vndev->rss_hash_types_supported), 1);
+		vndev->rss_max_key_size = MIN(vndev->rss_max_key_size,
+					      VTNET_RSS_KEY_SIZE);
+	}
+	uk_pr_debug("%p: %"__PRIu16" queue pair(s) available\n",
+		    n, vndev->max_vqueue_pairs);
+
 	return 0;
 
 err_negotiate_feature:
@@ -962,21 +1402,61 @@ err_negotiate_feature:
 	return rc;
 }
 
+/**
+ * Releases the control virtqueue and the queue management data of a failed
+ * configuration, so that the device can be configured again.
+ */
+static void virtio_netdev_rxtx_free(struct virtio_net_device *vndev)
+{
+	if (vndev->cvq) {
+		virtio_vqueue_release(vndev->vdev, vndev->cvq, a);
+		vndev->cvq = NULL;
+	}
+	uk_free(a, vndev->rss_reta);
+	vndev->rss_reta = NULL;
+	vndev->rss.hash_types = 0;
+
+	uk_free(a, vndev->rxqs);
+	uk_free(a, vndev->txqs);
+	vndev->rxqs = NULL;
+	vndev->txqs = NULL;
+}
+
 static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 				    const struct uk_netdev_conf *conf)
 {
 	int rc = 0;
 	int i = 0;
 	int vq_avail = 0;
-	int total_vqs = conf->nb_rx_queues + conf->nb_tx_queues;
-	__u16 qdesc_size[total_vqs];
+	int total_vqs;
+	__u16 cvq_id;
+	__u16 *qdesc_size;
 
-	if (conf->nb_rx_queues != 1 || conf->nb_tx_queues != 1) {
+	if (conf->nb_rx_queues != conf->nb_tx_queues
+	    || conf->nb_rx_queues == 0
+	    || conf->nb_rx_queues > vndev->max_vqueue_pairs) {
 		uk_pr_err("Queue combination not supported: %"__PRIu16"/%"__PRIu16" rx/tx\n",
 			  conf->nb_rx_queues, conf->nb_tx_queues);
 
 		return -ENOTSUP;
 	}
+	vndev->nb_queue_pairs = conf->nb_rx_queues;
+
+	/**
+	 * The virtqueue are organized as:
+	 * Virtqueue-rx0
+	 * Virtqueue-tx0
+	 * Virtqueue-rx1
+	 * Virtqueue-tx1
+	 * ...
+	 * Virtqueue-ctrlq
+	 * The control virtqueue follows the maximum number of queue pairs
+	 * that the device offers, independent of how many we use.
+	 */
+	cvq_id = 2 * vndev->max_vqueue_pairs;
+	total_vqs = VIRTIO_FEATURE_HAS(vndev->vdev->features,
+				       VIRTIO_NET_F_CTRL_VQ)
+		    ? cvq_id + 1 : 2 * vndev->nb_queue_pairs;
 
 	/**
 	 * TODO:
@@ -985,9 +1465,10 @@ static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 	 * wiser to move it to the allocator of each individual queue. This
 	 * would better considering NUMA support.
 	 */
-	vndev->rxqs = uk_malloc(a, sizeof(*vndev->rxqs) * conf->nb_rx_queues);
-	vndev->txqs = uk_malloc(a, sizeof(*vndev->txqs) * conf->nb_tx_queues);
-	if (unlikely(!vndev->rxqs || !vndev->txqs)) {
+	vndev->rxqs = uk_calloc(a, conf->nb_rx_queues, sizeof(*vndev->rxqs));
+	vndev->txqs = uk_calloc(a, conf->nb_tx_queues, sizeof(*vndev->txqs));
+	qdesc_size = uk_calloc(a, total_vqs, sizeof(*qdesc_size));
+	if (unlikely(!vndev->rxqs || !vndev->txqs || !qdesc_size)) {
 		uk_pr_err("Failed to allocate memory for queue management\n");
 		rc = -ENOMEM;
 		goto err_free_txrx;
@@ -1001,16 +1482,7 @@ static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 		goto err_free_txrx;
 	}
 
-	/**
-	 * The virtqueue are organized as:
-	 * Virtqueue-rx0
-	 * Virtqueue-tx0
-	 * Virtqueue-rx1
-	 * Virtqueue-tx1
-	 * ...
-	 * Virtqueue-ctrlq
-	 */
-	for (i = 0; i < vndev->max_vqueue_pairs; i++) {
+	for (i = 0; i < vndev->nb_queue_pairs; i++) {
 		/**
 		 * Initialize the received queue with the information received
 		 * from the device.
@@ -1033,17 +1505,105 @@ static int virtio_netdev_rxtx_alloc(struct virtio_net_device *vndev,
 				sizeof(vndev->txqs[i].sgsegs[0])),
 			       &vndev->txqs[i].sgsegs[0]);
 	}
+
+	if (total_vqs > cvq_id) {
+		/* Commands are polled for completion, no callback needed */
+		vndev->cvq = virtio_vqueue_setup(vndev->vdev, cvq_id,
+						 qdesc_size[cvq_id], NULL, a);
+		if (unlikely(PTRISERR(vndev->cvq))) {
+			rc = PTR2ERR(vndev->cvq);
+			uk_pr_err("Failed to set up control virtqueue: %d\n",
+				  rc);
+			vndev->cvq = NULL;
+			goto err_free_txrx;
+		}
+		virtqueue_intr_disable(vndev->cvq);
+		uk_sglist_init(&vndev->cvq_sg, ARRAY_SIZE(vndev->cvq_sgsegs),
+			       &vndev->cvq_sgsegs[0]);
+	}
+	uk_free(a, qdesc_size);
 exit:
 	return rc;
 
 err_free_txrx:
-	if (!vndev->rxqs)
-		uk_free(a, vndev->rxqs);
-	if (!vndev->txqs)
-		uk_free(a, vndev->txqs);
+	uk_free(a, qdesc_size);
+	virtio_netdev_rxtx_free(vndev);
 	goto exit;
 }
 
+/**
+ * Stores the RSS configuration in the device-specific format so that it can
+ * be sent to the device on start. Without a user-provided indirection table,
+ * packets are spread evenly over all receive queues.
+ */
+static int virtio_netdev_rss_prepare(struct virtio_net_device *vndev,
+				     const struct uk_netdev_conf *conf)
+{
+	/* Default Toeplitz key as used by many NICs */
+	static const __u8 rss_default_key[VTNET_RSS_KEY_SIZE] = {
+		0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+		0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+		0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+		0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+		0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+	};
+	const struct uk_netdev_rss_conf *rss = &conf->rss;
+	__u16 reta_size;
+	__u16 i;
+
+	UK_ASSERT(rss->hash_types);
+	if (!VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_RSS))
+		return -ENOTSUP;
+
+	if (rss->reta) {
+		reta_size = rss->reta_size;
+	} else {
+		/* Largest power of 2 that the device supports, but at most
+		 * 128 entries
+		 */
+		reta_size = 1;
+		while (reta_size * 2 <= vndev->rss_max_reta_size
+		       && reta_size < 128)
+			reta_size *= 2;
+	}
+
+	/* The table of an earlier, failed configuration is replaced */
+	uk_free(a, vndev->rss_reta);
+	vndev->rss_reta = uk_malloc(a, reta_size * sizeof(*vndev->rss_reta));
+	if (unlikely(!vndev->rss_reta))
+		return -ENOMEM;
+	for (i = 0; i < reta_size; i++)
+		vndev->rss_reta[i] = rss->reta ? rss->reta[i]
+					       : i % vndev->nb_queue_pairs;
+
+	vndev->rss.hash_types = 0;
+	if (rss->hash_types & UK_NETDEV_RSS_HASH_IPV4)
+		vndev->rss.hash_types |= VIRTIO_NET_RSS_HASH_TYPE_IPv4;
+	if (rss->hash_types & UK_NETDEV_RSS_HASH_TCPV4)
+		vndev->rss.hash_types |= VIRTIO_NET_RSS_HASH_TYPE_TCPv4;
+	if (rss->hash_types & UK_NETDEV_RSS_HASH_UDPV4)
+		vndev->rss.hash_types |= VIRTIO_NET_RSS_HASH_TYPE_UDPv4;
+	if (rss->hash_types & UK_NETDEV_RSS_HASH_IPV6)
+		vndev->rss.hash_types |= VIRTIO_NET_RSS_HASH_TYPE_IPv6;
+	if (rss->hash_types & UK_NETDEV_RSS_HASH_TCPV6)
+		vndev->rss.hash_types |= VIRTIO_NET_RSS_HASH_TYPE_TCPv6;
+	if (rss->hash_types & UK_NETDEV_RSS_HASH_UDPV6)
+		vndev->rss.hash_types |= VIRTIO_NET_RSS_HASH_TYPE_UDPv6;
+	vndev->rss.indirection_table_mask = reta_size - 1;
+	vndev->rss.unclassified_queue = 0;
+
+	if (rss->key) {
+		memcpy(vndev->rss_key_data, rss->key, rss->key_len);
+		vndev->rss_key.hash_key_length = rss->key_len;
+	} else {
+		vndev->rss_key.hash_key_length = vndev->rss_max_key_size;
+		memcpy(vndev->rss_key_data, rss_default_key,
+		       vndev->rss_key.hash_key_length);
+	}
+	vndev->rss_key.max_tx_vq = vndev->nb_queue_pairs;
+	return 0;
+}
+
 static int virtio_netdev_configure(struct uk_netdev *n,
 				   const struct uk_netdev_conf *conf)
 {
@@ -1058,8 +1618,20 @@ static int virtio_netdev_configure(struct uk_netdev *n,
 	if (rc < 0) {
 		uk_pr_err("%p: Failed to initialize rx and tx rings: %d\n",
 			  n, rc);
+		return rc;
 	}
 
+	if (conf->rss.hash_types) {
+		rc = virtio_netdev_rss_prepare(vndev, conf);
+		if (rc < 0) {
+			uk_pr_err("%p: Failed to configure RSS: %d\n", n, rc);
+			virtio_netdev_rxtx_free(vndev);
+			return rc;
+		}
+	}
+
+	vndev->lro = conf->lro;
+
 	/* Initialize the count of the virtio-net device */
 	vndev->rx_vqueue_cnt = 0;
 	vndev->tx_vqueue_cnt = 0;
@@ -1067,6 +1639,133 @@ static int virtio_netdev_configure(struct uk_netdev *n,
 	return rc;
 }
 
+/**
+ * Sends a command on the control virtqueue and waits for its completion.
+ * Commands are only issued during device start, so there is no concurrent
+ * use of the control virtqueue and its buffers. Returns -ETIMEDOUT if the
+ * device does not complete the command within VTNET_CTRL_TIMEOUT.
+ */
+static int virtio_netdev_ctrl_cmd(struct virtio_net_device *vndev,
+				  __u8 class, __u8 cmd,
+				  const struct virtio_net_ctrl_data *data,
+				  int nb_data)
+{
+	void *cookie;
+	__nsec end;
+	__u32 len;
+	int rc, i;
+
+	UK_ASSERT(vndev->cvq);
+	UK_ASSERT(nb_data <= VTNET_CTRL_MAX_DATA);
+
+	vndev->cvq_hdr.class = class;
+	vndev->cvq_hdr.cmd = cmd;
+	vndev->cvq_ack = VIRTIO_NET_ERR;
+
+	uk_sglist_reset(&vndev->cvq_sg);
+	rc = uk_sglist_append(&vndev->cvq_sg, &vndev->cvq_hdr,
+			      sizeof(vndev->cvq_hdr));
+	for (i = 0; i < nb_data && rc >= 0; i++)
+		rc = uk_sglist_append(&vndev->cvq_sg, data[i].buf,
+				      data[i].len);
+	if (rc >= 0)
+		rc = uk_sglist_append(&vndev->cvq_sg, &vndev->cvq_ack,
+				      sizeof(vndev->cvq_ack));
+	if (unlikely(rc < 0))
+		return rc;
+
+	rc = virtqueue_buffer_enqueue(vndev->cvq, vndev, &vndev->cvq_sg,
+				      vndev->cvq_sg.sg_nseg - 1, 1);
+	if (unlikely(rc < 0))
+		return rc;
+	virtqueue_host_notify(vndev->cvq);
+
+	/* The device completes control commands quickly, so we just spin */
+	end = ukplat_monotonic_clock() + VTNET_CTRL_TIMEOUT;
+	while (virtqueue_buffer_dequeue(vndev->cvq, &cookie, &len) < 0) {
+		if (unlikely(ukplat_monotonic_clock() >= end)) {
+			uk_pr_err("Control command %"__PRIu8".%"__PRIu8" timed out\n",
+				  class, cmd);
+			return -ETIMEDOUT;
+		}
+		ukarch_spinwait();
+	}
+	UK_ASSERT(cookie == vndev);
+
+	return (vndev->cvq_ack == VIRTIO_NET_OK) ? 0 : -EIO;
+}
+
+/**
+ * Enables the configured number of queue pairs and the RSS configuration.
+ */
+static int virtio_netdev_mq_setup(struct virtio_net_device *vndev)
+{
+	struct virtio_net_ctrl_data data[4];
+	int rc;
+
+	if (vndev->rss.hash_types) {
+		data[0].buf = &vndev->rss;
+		data[0].len = sizeof(vndev->rss);
+		data[1].buf = vndev->rss_reta;
+		data[1].len = (vndev->rss.indirection_table_mask + 1)
+			      * sizeof(*vndev->rss_reta);
+		data[2].buf = &vndev->rss_key;
+		data[2].len = sizeof(vndev->rss_key);
+		data[3].buf = vndev->rss_key_data;
+		data[3].len = vndev->rss_key.hash_key_length;
+
+		rc = virtio_netdev_ctrl_cmd(vndev, VIRTIO_NET_CTRL_MQ,
+					    VIRTIO_NET_CTRL_MQ_RSS_CONFIG,
+					    data, 4);
+		if (unlikely(rc < 0))
+			uk_pr_err(DRIVER_NAME": %"__PRIu16": Failed to configure RSS: %d\n",
+				  vndev->uid, rc);
+		return rc;
+	}
+
+	/* By default, the device only uses the first queue pair */
+	if (vndev->nb_queue_pairs == 1)
+		return 0;
+
+	vndev->cvq_mq.virtqueue_pairs = vndev->nb_queue_pairs;
+	data[0].buf = &vndev->cvq_mq;
+	data[0].len = sizeof(vndev->cvq_mq);
+
+	rc = virtio_netdev_ctrl_cmd(vndev, VIRTIO_NET_CTRL_MQ,
+				    VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET, data, 1);
+	if (unlikely(rc < 0))
+		uk_pr_err(DRIVER_NAME": %"__PRIu16": Failed to enable %"__PRIu16" queue pairs: %d\n",
+			  vndev->uid, vndev->nb_queue_pairs, rc);
+	return rc;
+}
+
+/**
+ * Turns off receive segmentation offloads again unless LRO was requested.
+ */
+static int virtio_netdev_offloads_setup(struct virtio_net_device *vndev)
+{
+	struct virtio_net_ctrl_data data;
+	int rc;
+
+	if (vndev->lro
+	    || !VIRTIO_FEATURE_HAS(vndev->vdev->features,
+				   VIRTIO_NET_F_CTRL_GUEST_OFFLOADS))
+		return 0;
+
+	vndev->cvq_offloads = 0;
+	VIRTIO_FEATURE_SET(vndev->cvq_offloads, VIRTIO_NET_F_GUEST_CSUM);
+	data.buf = &vndev->cvq_offloads;
+	data.len = sizeof(vndev->cvq_offloads);
+
+	rc = virtio_netdev_ctrl_cmd(vndev, VIRTIO_NET_CTRL_GUEST_OFFLOADS,
+				    VIRTIO_NET_CTRL_GUEST_OFFLOADS_SET,
+				    &data, 1);
+	if (unlikely(rc < 0))
+		uk_pr_err(DRIVER_NAME": %"__PRIu16": Failed to disable receive offloads: %d\n",
+			  vndev->uid, rc);
+	return rc;
+}
+
 static int virtio_net_rx_intr_enable(struct uk_netdev *n,
 				     struct uk_netdev_rx_queue *queue)
 {
@@ -1114,6 +1813,7 @@ static void virtio_net_info_get(struct uk_netdev *dev,
 
 	dev_info->max_rx_queues = vndev->max_vqueue_pairs;
 	dev_info->max_tx_queues = vndev->max_vqueue_pairs;
+	dev_info->in_queue_pairs = 1;
 	dev_info->max_mtu = vndev->max_mtu;
 	dev_info->nb_encap_tx = sizeof(struct virtio_net_hdr_padded);
 	dev_info->nb_encap_rx = sizeof(struct virtio_net_hdr_padded);
@@ -1121,12 +1821,47 @@ static void virtio_net_info_get(struct uk_netdev *dev,
 	dev_info->features = UK_NETDEV_F_RXQ_INTR
 		| (VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_CSUM)
 		   ? UK_NETDEV_F_PARTIAL_CSUM : 0);
+
+	if (VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_HOST_TSO4))
+		dev_info->features |= UK_NETDEV_F_TSO4;
+	if (VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_HOST_TSO6))
+		dev_info->features |= UK_NETDEV_F_TSO6;
+	if (VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_GUEST_TSO4)
+	    || VIRTIO_FEATURE_HAS(vndev->vdev->features,
+				  VIRTIO_NET_F_GUEST_TSO6))
+		dev_info->features |= UK_NETDEV_F_LRO;
+
+	if (VIRTIO_FEATURE_HAS(vndev->vdev->features, VIRTIO_NET_F_RSS)) {
+		dev_info->features |= UK_NETDEV_F_RSS;
+		dev_info->rss_key_size = vndev->rss_max_key_size;
+		dev_info->rss_reta_size = vndev->rss_max_reta_size;
+		dev_info->rss_hash_types =
+			((vndev->rss_hash_types_supported
+			  & VIRTIO_NET_RSS_HASH_TYPE_IPv4)
+			 ? UK_NETDEV_RSS_HASH_IPV4 : 0)
+			| ((vndev->rss_hash_types_supported
+			    & VIRTIO_NET_RSS_HASH_TYPE_TCPv4)
+			   ? UK_NETDEV_RSS_HASH_TCPV4 : 0)
+			| ((vndev->rss_hash_types_supported
+			    & VIRTIO_NET_RSS_HASH_TYPE_UDPv4)
+			   ? UK_NETDEV_RSS_HASH_UDPV4 : 0)
+			| ((vndev->rss_hash_types_supported
+			    & VIRTIO_NET_RSS_HASH_TYPE_IPv6)
+			   ? UK_NETDEV_RSS_HASH_IPV6 : 0)
+			| ((vndev->rss_hash_types_supported
+			    & VIRTIO_NET_RSS_HASH_TYPE_TCPv6)
+			   ? UK_NETDEV_RSS_HASH_TCPV6 : 0)
+			| ((vndev->rss_hash_types_supported
+			    & VIRTIO_NET_RSS_HASH_TYPE_UDPv6)
+			   ? UK_NETDEV_RSS_HASH_UDPV6 : 0);
+	}
 }
 
 static int virtio_net_start(struct uk_netdev *n)
 {
 	struct virtio_net_device *d;
 	int i = 0;
+	int rc;
 
 	UK_ASSERT(n != NULL);
 	d = to_virtionetdev(n);
@@ -1136,12 +1871,14 @@ static int virtio_net_start(struct uk_netdev *n)
 	 * network stack to manually enable them with a call to
 	 * enable_tx|rx_intr()
 	 */
-	for (i = 0; i < d->rx_vqueue_cnt; i++) {
+	for (i = 0; i < d->nb_queue_pairs; i++) {
+		if (!d->rxqs[i].vq || !d->txqs[i].vq) {
+			uk_pr_err(DRIVER_NAME": %"__PRIu16": Queue pair %d not configured\n",
+				  d->uid, i);
+			return -EINVAL;
+		}
 		virtqueue_intr_disable(d->rxqs[i].vq);
 		d->rxqs[i].intr_enabled = 0;
-	}
-
-	for (i = 0; i < d->tx_vqueue_cnt; i++) {
 		virtqueue_intr_disable(d->txqs[i].vq);
 		d->txqs[i].intr_enabled = 0;
 	}
@@ -1150,9 +1887,19 @@ static int virtio_net_start(struct uk_netdev *n)
 	 * Set the DRIVER_OK status bit. At this point the device is "live".
 	 */
 	virtio_dev_drv_up(d->vdev);
-	uk_pr_info(DRIVER_NAME": %"__PRIu16" started\n", d->uid);
 
-	for (i = 0; i < d->rx_vqueue_cnt; i++)
+	if (d->cvq) {
+		rc = virtio_netdev_mq_setup(d);
+		if (unlikely(rc < 0))
+			return rc;
+		rc = virtio_netdev_offloads_setup(d);
+		if (unlikely(rc < 0))
+			return rc;
+	}
+	uk_pr_info(DRIVER_NAME": %"__PRIu16" started with %"__PRIu16" queue pair(s)\n",
+		   d->uid, d->nb_queue_pairs);
+
+	for (i = 0; i < d->nb_queue_pairs; i++)
 		virtqueue_host_notify(d->rxqs[i].vq);
 
 	return 0;
@@ -1190,6 +1937,8 @@ static int virtio_net_add_dev(struct virtio_dev *vdev)
 	/* register netdev */
 	vndev->netdev.rx_one = virtio_netdev_recv;
 	vndev->netdev.tx_one = virtio_netdev_xmit;
+	vndev->netdev.rx_burst = virtio_netdev_recv_burst;
+	vndev->netdev.tx_burst = virtio_netdev_xmit_burst;
 	vndev->netdev.ops = &virtio_netdev_ops;
 
 	rc = uk_netdev_drv_register(&vndev->netdev, a, drv_name);
@@ -1200,11 +1949,6 @@ static int virtio_net_add_dev(struct virtio_dev *vdev)
 	vndev->uid = rc;
 	rc = 0;
 	vndev->promisc = 0;
-
-	/**
-	 * TODO:
-	 * Adding multiqueue support for the virtio net driver.
-	 */
 	vndev->max_vqueue_pairs = 1;
 	uk_pr_debug("virtio-net device registered with libuknet\n");
 
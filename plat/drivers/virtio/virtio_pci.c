@@ -48,6 +48,20 @@
 
 static struct uk_alloc *a;
 
+struct virtio_pci_dev;
+
+/**
+ * The structure declares an MSI-X vector of a pci device.
+ */
+struct virtio_pci_msix_vec {
+	/* Pci device the vector belongs to */
+	struct virtio_pci_dev *vpdev;
+	/* Virtqueue served by the vector, NULL for configuration changes */
+	struct virtqueue *vq;
+	/* Platform IRQ the vector is routed to */
+	unsigned long irq;
+};
+
 /**
  * The structure declares a pci device.
  */
@@ -60,8 +74,16 @@ struct virtio_pci_dev {
 	__u64 pci_isr_addr;
 	/* Pci device information */
 	struct pci_device *pdev;
+	/* MSI-X vectors: Configuration changes use vector 0 and virtqueue n
+	 * uses vector n + 1. There are none if legacy INTx is used.
+	 */
+	struct virtio_pci_msix_vec *msix_vecs;
+	__u16 msix_nvecs;
 };
 
+#define VPCI_MSIX_CONFIG_VECTOR		0
+#define VPCI_MSIX_VQ_VECTOR(queue_id)	((queue_id) + 1)
+
 /**
  * Fetch the virtio pci information from the virtio device.
  * @param vdev
@@ -92,6 +114,9 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 					      struct uk_alloc *a);
 static void vpci_legacy_vq_release(struct virtio_dev *vdev,
 		struct virtqueue *vq, struct uk_alloc *a);
+static int vpci_legacy_vq_affinity_set(struct virtio_dev *vdev,
+				       struct virtqueue *vq,
+				       unsigned int lcpu_idx);
 static int virtio_pci_handle(void *arg);
 static int vpci_legacy_notify(struct virtio_dev *vdev, __u16 queue_id);
 static int virtio_pci_legacy_add_dev(struct pci_device *pci_dev,
@@ -111,8 +136,15 @@ static struct virtio_config_ops vpci_legacy_ops = {
 	.vqs_find     = vpci_legacy_pci_vq_find,
 	.vq_setup     = vpci_legacy_vq_setup,
 	.vq_release   = vpci_legacy_vq_release,
+	.vq_affinity_set = vpci_legacy_vq_affinity_set,
 };
 
+static inline __u16 vpci_legacy_config_off(struct virtio_pci_dev *vpdev)
+{
+	return (vpdev->msix_nvecs) ? VIRTIO_PCI_CONFIG_OFF_MSIX
+				   : VIRTIO_PCI_CONFIG_OFF;
+}
+
 static int vpci_legacy_notify(struct virtio_dev *vdev, __u16 queue_id)
 {
 	struct virtio_pci_dev *vpdev;
@@ -150,6 +182,110 @@ static int virtio_pci_handle(void *arg)
 	return rc;
 }
 
+static int virtio_pci_msix_config_handle(void *arg)
+{
+	struct virtio_pci_msix_vec *vec = (struct virtio_pci_msix_vec *) arg;
+
+	UK_ASSERT(vec);
+
+	/* We don't support configuration interrupt on the device */
+	uk_pr_warn("Unsupported config change interrupt received on virtio-pci device %p\n",
+		   vec->vpdev);
+	return 1;
+}
+
+static int virtio_pci_msix_vq_handle(void *arg)
+{
+	struct virtio_pci_msix_vec *vec = (struct virtio_pci_msix_vec *) arg;
+	struct virtqueue *vq;
+
+	UK_ASSERT(vec);
+
+	/* Each virtqueue has its own vector, so there is no need to read the
+	 * ISR status or to look at other virtqueues
+	 */
+	vq = vec->vq;
+	if (likely(vq))
+		virtqueue_ring_interrupt(vq);
+	return 1;
+}
+
+/**
+ * Sets up one MSI-X vector for configuration changes and one for each
+ * virtqueue. All vectors are initially routed to the current lcpu.
+ */
+static int vpci_msix_setup(struct virtio_pci_dev *vpdev, __u16 num_vqs)
+{
+	struct virtio_pci_msix_vec *vecs;
+	__u16 nvecs = num_vqs + 1;
+	__u16 i, n = 0;
+	int rc, irq;
+
+	rc = pci_msix_init(vpdev->pdev);
+	if (rc < 0)
+		return rc;
+	if (rc < nvecs)
+		return -ENOSPC;
+
+	vecs = uk_calloc(a, nvecs, sizeof(*vecs));
+	if (unlikely(!vecs))
+		return -ENOMEM;
+
+	for (n = 0; n < nvecs; n++) {
+		irq = pci_msi_irq_alloc();
+		if (irq < 0) {
+			rc = irq;
+			goto err_free_irqs;
+		}
+		vecs[n].vpdev = vpdev;
+		vecs[n].irq = irq;
+	}
+
+	for (i = 0; i < nvecs; i++) {
+		rc = pci_msix_vector_set(vpdev->pdev, i, vecs[i].irq,
+					 ukplat_lcpu_idx());
+		if (unlikely(rc))
+			goto err_mask;
+	}
+
+	/* Interrupt handlers cannot be unregistered, so this must be the
+	 * last step that can fail. Since the IRQs are fresh, it will not.
+	 */
+	for (i = 0; i < nvecs; i++) {
+		rc = ukplat_irq_register(vecs[i].irq,
+					 (i == VPCI_MSIX_CONFIG_VECTOR)
+					 ? virtio_pci_msix_config_handle
+					 : virtio_pci_msix_vq_handle,
+					 &vecs[i]);
+		if (unlikely(rc))
+			UK_CRASH("Failed to register MSI-X IRQ %lu: %d\n",
+				 vecs[i].irq, rc);
+	}
+
+	pci_msix_enable(vpdev->pdev);
+	vpdev->msix_vecs = vecs;
+	vpdev->msix_nvecs = nvecs;
+
+	virtio_cwrite16((void *)(unsigned long)vpdev->pci_base_addr,
+			VIRTIO_MSI_CONFIG_VECTOR, VPCI_MSIX_CONFIG_VECTOR);
+	if (virtio_cread16((void *)(unsigned long)vpdev->pci_base_addr,
+			   VIRTIO_MSI_CONFIG_VECTOR) == VIRTIO_MSI_NO_VECTOR)
+		uk_pr_warn("Configuration change interrupts not available\n");
+
+	uk_pr_info("virtio-pci device %p uses %"__PRIu16" MSI-X vectors\n",
+		   vpdev, nvecs);
+	return 0;
+
+err_mask:
+	for (i = 0; i < nvecs; i++)
+		pci_msix_vector_mask(vpdev->pdev, i);
+err_free_irqs:
+	while (n--)
+		pci_msi_irq_free(vecs[n].irq);
+	uk_free(a, vecs);
+	return rc;
+}
+
 static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 					      __u16 queue_id,
 					      __u16 num_desc,
@@ -164,6 +300,14 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 	UK_ASSERT(vdev != NULL);
 
 	vpdev = to_virtiopcidev(vdev);
+	if (vpdev->msix_nvecs &&
+	    unlikely(VPCI_MSIX_VQ_VECTOR(queue_id) >= vpdev->msix_nvecs)) {
+		uk_pr_err("No MSI-X vector for virtqueue %"__PRIu16"\n",
+			  queue_id);
+		vq = ERR2PTR(-ENOSPC);
+		goto err_exit;
+	}
+
 	vq = virtqueue_create(queue_id, num_desc, VIRTIO_PCI_VRING_ALIGN,
 			      callback, vpci_legacy_notify, vdev, a);
 	if (PTRISERR(vq)) {
@@ -177,6 +321,26 @@ static struct virtqueue *vpci_legacy_vq_setup(struct virtio_dev *vdev,
 	/* Select the queue of interest */
 	virtio_cwrite16((void *)(unsigned long)vpdev->pci_base_addr,
 			VIRTIO_PCI_QUEUE_SEL, queue_id);
+
+	if (vpdev->msix_nvecs) {
+		vpdev->msix_vecs[VPCI_MSIX_VQ_VECTOR(queue_id)].vq = vq;
+		virtio_cwrite16((void *)(unsigned long)vpdev->pci_base_addr,
+				VIRTIO_MSI_QUEUE_VECTOR,
+				VPCI_MSIX_VQ_VECTOR(queue_id));
+		if (unlikely(virtio_cread16(
+				(void *)(unsigned long)vpdev->pci_base_addr,
+				VIRTIO_MSI_QUEUE_VECTOR)
+			     == VIRTIO_MSI_NO_VECTOR)) {
+			uk_pr_err("Failed to assign MSI-X vector to virtqueue %"__PRIu16"\n",
+				  queue_id);
+			vpdev->msix_vecs[VPCI_MSIX_VQ_VECTOR(queue_id)].vq =
+				NULL;
+			virtqueue_destroy(vq, a);
+			vq = ERR2PTR(-EIO);
+			goto err_exit;
+		}
+	}
+
 	virtio_cwrite32((void *)(unsigned long)vpdev->pci_base_addr,
 			VIRTIO_PCI_QUEUE_PFN,
 			addr >> VIRTIO_PCI_QUEUE_ADDR_SHIFT);
@@ -204,6 +368,11 @@ static void vpci_legacy_vq_release(struct virtio_dev *vdev,
 			VIRTIO_PCI_QUEUE_SEL, vq->queue_id);
 	virtio_cwrite32((void *)(unsigned long)vpdev->pci_base_addr,
 			VIRTIO_PCI_QUEUE_PFN, 0);
+	if (vpdev->msix_nvecs) {
+		virtio_cwrite16((void *)(unsigned long)vpdev->pci_base_addr,
+				VIRTIO_MSI_QUEUE_VECTOR, VIRTIO_MSI_NO_VECTOR);
+		vpdev->msix_vecs[VPCI_MSIX_VQ_VECTOR(vq->queue_id)].vq = NULL;
+	}
 
 	flags = ukplat_lcpu_save_irqf();
 	UK_TAILQ_REMOVE(&vpdev->vdev.vqs, vq, next);
@@ -212,6 +381,31 @@ static void vpci_legacy_vq_release(struct virtio_dev *vdev,
 	virtqueue_destroy(vq, a);
 }
 
+static int vpci_legacy_vq_affinity_set(struct virtio_dev *vdev,
+				       struct virtqueue *vq,
+				       unsigned int lcpu_idx)
+{
+	struct virtio_pci_dev *vpdev;
+	__u16 vector;
+
+	UK_ASSERT(vdev);
+	UK_ASSERT(vq);
+	vpdev = to_virtiopcidev(vdev);
+
+	/* With INTx, all virtqueues share the interrupt of the device */
+	if (!vpdev->msix_nvecs)
+		return -ENOTSUP;
+
+	if (unlikely(lcpu_idx >= ukplat_lcpu_count()))
+		return -EINVAL;
+
+	vector = VPCI_MSIX_VQ_VECTOR(vq->queue_id);
+	UK_ASSERT(vector < vpdev->msix_nvecs);
+
+	return pci_msix_vector_set(vpdev->pdev, vector,
+				   vpdev->msix_vecs[vector].irq, lcpu_idx);
+}
+
 static int vpci_legacy_pci_vq_find(struct virtio_dev *vdev, __u16 num_vqs,
 				   __u16 *qdesc_size)
 {
@@ -221,11 +415,24 @@ static int vpci_legacy_pci_vq_find(struct virtio_dev *vdev, __u16 num_vqs,
 	UK_ASSERT(vdev);
 	vpdev = to_virtiopcidev(vdev);
 
-	/* Registering the interrupt for the queue */
-	rc = ukplat_irq_register(vpdev->pdev->irq, virtio_pci_handle, vpdev);
-	if (rc != 0) {
-		uk_pr_err("Failed to register the interrupt\n");
-		return rc;
+	/* Prefer a dedicated MSI-X vector per virtqueue. Fall back to the
+	 * shared legacy interrupt if the device or platform lacks MSI-X or
+	 * there are not enough vectors.
+	 */
+	if (!vpdev->msix_nvecs) {
+		rc = vpci_msix_setup(vpdev, num_vqs);
+		if (rc != 0) {
+			uk_pr_debug("MSI-X not available (%d), using INTx\n",
+				    rc);
+
+			/* Registering the interrupt for the queue */
+			rc = ukplat_irq_register(vpdev->pdev->irq,
+						 virtio_pci_handle, vpdev);
+			if (rc != 0) {
+				uk_pr_err("Failed to register the interrupt\n");
+				return rc;
+			}
+		}
 	}
 
 	for (i = 0; i < num_vqs; i++) {
@@ -252,7 +459,8 @@ static int vpci_legacy_pci_config_set(struct virtio_dev *vdev, __u16 offset,
 	vpdev = to_virtiopcidev(vdev);
 
 	_virtio_cwrite_bytes((void *)(unsigned long)vpdev->pci_base_addr,
-			     VIRTIO_PCI_CONFIG_OFF + offset, buf, len, 1);
+			     vpci_legacy_config_off(vpdev) + offset, buf, len,
+			     1);
 
 	return 0;
 }
@@ -270,8 +478,8 @@ static int vpci_legacy_pci_config_get(struct virtio_dev *vdev, __u16 offset,
 	if (type_len == len && type_len <= 4) {
 		_virtio_cread_bytes(
 				(void *) (unsigned long)vpdev->pci_base_addr,
-				VIRTIO_PCI_CONFIG_OFF + offset, buf, len,
-				type_len);
+				vpci_legacy_config_off(vpdev) + offset, buf,
+				len, type_len);
 	} else {
 		__u32 len_bytes;
 
@@ -280,7 +488,8 @@ static int vpci_legacy_pci_config_get(struct virtio_dev *vdev, __u16 offset,
 
 		rc = virtio_cread_bytes_many(
 				(void *) (unsigned long)vpdev->pci_base_addr,
-				VIRTIO_PCI_CONFIG_OFF + offset,	buf, len_bytes);
+				vpci_legacy_config_off(vpdev) + offset, buf,
+				len_bytes);
 		if (unlikely(rc != (int) len_bytes))
 			return -EFAULT;
 	}
@@ -408,6 +617,8 @@ static int virtio_pci_add_dev(struct pci_device *pci_dev)
 	/* Fetch PCI Device information */
 	vpci_dev->pdev = pci_dev;
 	vpci_dev->pci_base_addr = pci_dev->base;
+	vpci_dev->msix_vecs = NULL;
+	vpci_dev->msix_nvecs = 0;
 
 	/**
 	 * Probing for the legacy virtio device. We separate the legacy probing
@@ -71,6 +71,10 @@ struct virtqueue_vring {
 	__u16 head_free_desc;
 	/* Index of the last used descriptor by the host */
 	__u16 last_used_desc_idx;
+	/* Index of the next entry of the available ring */
+	__u16 shadow_avail_idx;
+	/* Defer publishing new entries of the available ring */
+	int batch;
 	/* Cookie to identify driver buffer */
 	struct virtqueue_desc_info vq_info[];
 };
@@ -143,20 +147,26 @@ int virtqueue_intr_enable(struct virtqueue *vq)
 	return rc;
 }
 
+static inline void virtqueue_ring_publish_avail(struct virtqueue_vring *vrq)
+{
+	/**
+	 * Write barrier to make sure we push the descriptor(s) on the
+	 * available ring and then update the available index.
+	 */
+	wmb();
+	vrq->vring.avail->idx = vrq->shadow_avail_idx;
+}
+
 static inline void virtqueue_ring_update_avail(struct virtqueue_vring *vrq,
 					__u16 idx)
 {
 	__u16 avail_idx;
 
-	avail_idx = vrq->vring.avail->idx & (vrq->vring.num - 1);
+	avail_idx = vrq->shadow_avail_idx++ & (vrq->vring.num - 1);
 	/* Adding the idx to available ring */
 	vrq->vring.avail->ring[avail_idx] = idx;
-	/**
-	 * Write barrier to make sure we push the descriptor on the available
-	 * descriptor and then increment available index.
-	 */
-	wmb();
-	vrq->vring.avail->idx++;
+	if (!vrq->batch)
+		virtqueue_ring_publish_avail(vrq);
 }
 
 static inline void virtqueue_detach_desc(struct virtqueue_vring *vrq,
@@ -219,6 +229,30 @@ static inline int virtqueue_buffer_enqueue_segments(
 	return idx;
 }
 
+void virtqueue_batch_begin(struct virtqueue *vq)
+{
+	struct virtqueue_vring *vrq;
+
+	UK_ASSERT(vq);
+
+	vrq = to_virtqueue_vring(vq);
+	UK_ASSERT(!vrq->batch);
+	vrq->batch = 1;
+}
+
+void virtqueue_batch_end(struct virtqueue *vq)
+{
+	struct virtqueue_vring *vrq;
+
+	UK_ASSERT(vq);
+
+	vrq = to_virtqueue_vring(vq);
+	UK_ASSERT(vrq->batch);
+	vrq->batch = 0;
+	if (vrq->vring.avail->idx != vrq->shadow_avail_idx)
+		virtqueue_ring_publish_avail(vrq);
+}
+
 int virtqueue_hasdata(struct virtqueue *vq)
 {
 	struct virtqueue_vring *vring;
@@ -234,9 +268,10 @@ __u64 virtqueue_feature_negotiate(__u64 feature_set)
 	__u64 feature = (1ULL << VIRTIO_TRANSPORT_F_START) - 1;
 
 	/**
-	 * Currently out vring driver does not support any ring feature. We will
-	 * add support to transport feature in the future.
+	 * Indirect descriptors are the only ring feature our vring driver
+	 * supports. Drivers use them with virtqueue_buffer_enqueue_indirect().
 	 */
+	feature |= 1ULL << VIRTIO_F_INDIRECT_DESC;
 	feature &= feature_set;
 	return feature;
 }
@@ -371,6 +406,61 @@ int virtqueue_buffer_enqueue(struct virtqueue *vq, void *cookie,
 	return vrq->desc_avail;
 }
 
+int virtqueue_buffer_enqueue_indirect(struct virtqueue *vq, void *cookie,
+				      struct uk_sglist *sg, __u16 read_bufs,
+				      __u16 write_bufs,
+				      struct vring_desc *table)
+{
+	__u32 total_desc = 0;
+	__u16 head_idx = 0, i;
+	struct virtqueue_vring *vrq = NULL;
+	struct uk_sglist_seg *segs;
+
+	UK_ASSERT(vq);
+	UK_ASSERT(table);
+
+	vrq = to_virtqueue_vring(vq);
+	total_desc = read_bufs + write_bufs;
+	if (unlikely(total_desc < 1)) {
+		uk_pr_err("%"__PRIu32" invalid number of descriptor\n",
+			  total_desc);
+		return -EINVAL;
+	} else if (vrq->desc_avail < 1) {
+		return -ENOSPC;
+	}
+
+	/* The whole chain goes to the table, the ring only holds a
+	 * reference to it.
+	 */
+	for (i = 0; i < total_desc; i++) {
+		segs = &sg->sg_segs[i];
+		table[i].addr = segs->ss_paddr;
+		table[i].len = segs->ss_len;
+		table[i].flags = 0;
+		if (i >= read_bufs)
+			table[i].flags |= VRING_DESC_F_WRITE;
+		if (i < total_desc - 1) {
+			table[i].flags |= VRING_DESC_F_NEXT;
+			table[i].next = i + 1;
+		}
+	}
+
+	head_idx = vrq->head_free_desc;
+	UK_ASSERT(cookie);
+	vrq->vq_info[head_idx].cookie = cookie;
+	vrq->vq_info[head_idx].desc_count = 1;
+
+	vrq->vring.desc[head_idx].addr = ukplat_virt_to_phys(table);
+	vrq->vring.desc[head_idx].len = total_desc * sizeof(*table);
+	vrq->vring.desc[head_idx].flags = VRING_DESC_F_INDIRECT;
+
+	vrq->head_free_desc = vrq->vring.desc[head_idx].next;
+	vrq->desc_avail--;
+
+	virtqueue_ring_update_avail(vrq, head_idx);
+	return vrq->desc_avail;
+}
+
 static void virtqueue_vring_init(struct virtqueue_vring *vrq, __u16 nr_desc,
 				 __u16 align)
 {
@@ -381,6 +471,8 @@ static void virtqueue_vring_init(struct virtqueue_vring *vrq, __u16 nr_desc,
 	vrq->desc_avail = vrq->vring.num;
 	vrq->head_free_desc = 0;
 	vrq->last_used_desc_idx = 0;
+	vrq->shadow_avail_idx = 0;
+	vrq->batch = 0;
 	for (i = 0; i < nr_desc - 1; i++)
 		vrq->vring.desc[i].next = i + 1;
 	/**
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#ifndef __KVM_X86_KVMCLOCK_H__
+#define __KVM_X86_KVMCLOCK_H__
+
+#include <uk/arch/types.h>
+#include <uk/arch/time.h>
+#include <uk/essentials.h>
+
+/* KVM paravirtualized clock (pvclock) interface */
+#define KVM_CPUID_SIGNATURE		0x40000000
+#define KVM_CPUID_FEATURES		0x40000001
+#define KVM_FEATURE_CLOCKSOURCE2	(1 << 3)
+#define KVM_FEATURE_CLOCKSOURCE_STABLE_BIT (1 << 24)
+
+#define MSR_KVM_WALL_CLOCK_NEW		0x4b564d00
+#define MSR_KVM_SYSTEM_TIME_NEW		0x4b564d01
+#define KVM_SYSTEM_TIME_ENABLE		0x1
+
+#define PVCLOCK_TSC_STABLE_BIT		(1 << 0)
+
+/* Shared with the hypervisor, one per vCPU. The layout is fixed by the ABI
+ * and naturally aligned.
+ */
+struct pvclock_vcpu_time_info {
+	__u32 version;
+	__u32 pad0;
+	__u64 tsc_timestamp;
+	__u64 system_time;
+	__u32 tsc_to_system_mul;
+	__s8 tsc_shift;
+	__u8 flags;
+	__u8 pad[2];
+};
+
+struct pvclock_wall_clock {
+	__u32 version;
+	__u32 sec;
+	__u32 nsec;
+};
+
+/**
+ * Registers the pvclock page of the current CPU with KVM.
+ *
+ * @return 0 on success, -ENOTSUP if there is no kvmclock
+ */
+int kvmclock_init(void);
+
+/**
+ * Returns non-zero if the kvmclock of the boot CPU can be read on all CPUs
+ * and is guaranteed to be monotonic.
+ */
+int kvmclock_stable(void);
+
+/**
+ * Returns the nanoseconds since the host-defined kvmclock epoch.
+ */
+__nsec kvmclock_system_time(void);
+
+/**
+ * Returns the wall time at the kvmclock epoch in nanoseconds.
+ */
+__nsec kvmclock_wall_clock(void);
+
+/**
+ * Returns the TSC frequency in Hz as derived from the pvclock scale.
+ */
+__u64 kvmclock_tsc_freq(void);
+
+#endif /* __KVM_X86_KVMCLOCK_H__ */
@@ -88,4 +88,4 @@
 #define IDT_DESC_DPL_USER	GDT_DESC_DPL_USER
 
 #define IDT_DESC_OFFSET(n)	GDT_DESC_OFFSET(n)
-#define IDT_NUM_ENTRIES		48
+#define IDT_NUM_ENTRIES		80
@@ -30,8 +30,32 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <uk/arch/types.h>
+
 void intctrl_init(void);
 void intctrl_clear_irq(unsigned int irq);
 void intctrl_mask_irq(unsigned int irq);
 void intctrl_ack_irq(unsigned int irq);
 void intctrl_send_ipi(uint8_t sgintid, uint32_t cpuid);
+
+/**
+ * Allocates an IRQ for a message-signaled interrupt. On x86, this can also
+ * be used for other interrupts that are delivered by the local APIC.
+ *
+ * @return the IRQ number on success, a negative errno otherwise
+ */
+int intctrl_msi_alloc(void);
+
+/**
+ * Releases an IRQ obtained with intctrl_msi_alloc().
+ */
+void intctrl_msi_free(unsigned int irq);
+
+/**
+ * Composes the message address and data that a device has to write to raise
+ * the given MSI IRQ on the CPU with the given interrupt controller ID.
+ *
+ * @return 0 on success, a negative errno otherwise
+ */
+int intctrl_msi_compose(unsigned int irq, __u32 cpu_id,
+			__u64 *addr, __u32 *data);
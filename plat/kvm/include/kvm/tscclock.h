@@ -36,5 +36,9 @@
 int tscclock_init(void);
 __u64 tscclock_monotonic(void);
 __u64 tscclock_epochoffset(void);
+__u64 tscclock_tsc_freq(void);
+
+/* Returns the IRQ of the timer that is used to wake up from blocking */
+unsigned int tscclock_timer_irq(void);
 
 #endif /* __KVM_TSCCLOCK_H__ */
@@ -91,7 +91,7 @@ int ukplat_irq_register(unsigned long irq, irq_handler_func_t func, void *arg)
  * TODO: This is a temporary solution used to identify non TSC clock
  * interrupts in order to stop waiting for interrupts with deadline.
  */
-extern unsigned long sched_have_pending_events;
+extern UKPLAT_PER_LCPU_DEFINE(unsigned long, sched_have_pending_events);
 
 void _ukplat_irq_handle(struct __regs *regs, unsigned long irq)
 {
@@ -129,7 +129,8 @@ void _ukplat_irq_handle(struct __regs *regs, unsigned long irq)
 			 * the halting loop, and let it take care of
 			 * that work.
 			 */
-			__uk_test_and_set_bit(0, &sched_have_pending_events);
+			__uk_test_and_set_bit(0,
+				&ukplat_per_lcpu_current(sched_have_pending_events));
 
 		if (h->func(h->arg) == 1)
 			goto exit_ack;
@@ -23,7 +23,12 @@
 /* Taken from solo5 platform_intr.c */
 
 #include <stdint.h>
+#include <errno.h>
+#include <uk/bitops.h>
+#include <uk/essentials.h>
 #include <x86/cpu.h>
+#include <x86/irq.h>
+#include <x86/apic.h>
 #include <kvm/intctrl.h>
 
 #define PIC1             0x20    /* IO base address for master PIC */
@@ -48,6 +53,17 @@
 #define ICW4_BUF_MASTER  0x0C /* Buffered mode/master */
 #define ICW4_SFN         0x10 /* Special fully nested (not) */
 
+#define IRQ_IS_MSI(n)    ((n) >= __MAX_PIC_IRQ)
+#define MSI_IRQ_COUNT    (__MAX_IRQ - __MAX_PIC_IRQ)
+
+#define MSI_ADDR_BASE    0xfee00000 /* Interrupt address range */
+#define MSI_ADDR_DEST_SHIFT 12     /* Destination APIC ID */
+#define MSI_ADDR_DEST_MAX 0xff     /* Max. APIC ID without remapping */
+
+/* Bitmap of allocated MSI IRQs */
+static unsigned long msi_irqs[UK_BITS_TO_LONGS(MSI_IRQ_COUNT)];
+static int msi_apic_ready;
+
 /*
  * arguments:
  * offset1 - vector offset for master PIC vectors on the master become
@@ -88,6 +104,11 @@ void intctrl_init(void)
 
 void intctrl_ack_irq(unsigned int irq)
 {
+	if (IRQ_IS_MSI(irq)) {
+		apic_ack_interrupt();
+		return;
+	}
+
 	if (!IRQ_ON_MASTER(irq))
 		outb(PIC2_COMMAND, PIC_EOI);
 
@@ -98,6 +119,10 @@ void intctrl_mask_irq(unsigned int irq)
 {
 	__u16 port;
 
+	/* MSIs are masked at the device */
+	if (IRQ_IS_MSI(irq))
+		return;
+
 	port = IRQ_PORT(irq);
 	outb(port, inb(port) | (1 << IRQ_OFFSET(irq)));
 }
@@ -106,6 +131,58 @@ void intctrl_clear_irq(unsigned int irq)
 {
 	__u16 port;
 
+	if (IRQ_IS_MSI(irq))
+		return;
+
 	port = IRQ_PORT(irq);
 	outb(port, inb(port) & ~(1 << IRQ_OFFSET(irq)));
 }
+
+int intctrl_msi_alloc(void)
+{
+	unsigned int i;
+	int rc;
+
+	/* MSIs are delivered by the local APIC, which we only enable for SMP
+	 * configurations during CPU initialization. Make sure it is enabled
+	 * on the BSP in any case.
+	 */
+	if (!msi_apic_ready) {
+		rc = apic_enable();
+		if (unlikely(rc))
+			return rc;
+		msi_apic_ready = 1;
+	}
+
+	for (i = 0; i < MSI_IRQ_COUNT; i++)
+		if (!uk_test_and_set_bit(i, msi_irqs))
+			return __MAX_PIC_IRQ + i;
+
+	return -ENOSPC;
+}
+
+void intctrl_msi_free(unsigned int irq)
+{
+	UK_ASSERT(IRQ_IS_MSI(irq) && irq < __MAX_IRQ);
+
+	uk_clear_bit(irq - __MAX_PIC_IRQ, msi_irqs);
+}
+
+int intctrl_msi_compose(unsigned int irq, __u32 apic_id,
+			__u64 *addr, __u32 *data)
+{
+	UK_ASSERT(addr && data);
+
+	if (unlikely(!IRQ_IS_MSI(irq) || irq >= __MAX_IRQ))
+		return -EINVAL;
+
+	/* Without interrupt remapping, the destination field is 8 bits */
+	if (unlikely(apic_id > MSI_ADDR_DEST_MAX))
+		return -ERANGE;
+
+	/* Fixed delivery in physical destination mode, edge-triggered */
+	*addr = MSI_ADDR_BASE | (apic_id << MSI_ADDR_DEST_SHIFT);
+	*data = 32 + irq;
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+/* Copyright (c) 2023, Unikraft GmbH and The Unikraft Authors.
+ * Licensed under the BSD-3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <uk/arch/atomic.h>
+#include <uk/arch/lcpu.h>
+#include <uk/plat/io.h>
+#include <uk/assert.h>
+#include <uk/print.h>
+#include <x86/cpu.h>
+#include <kvm-x86/kvmclock.h>
+
+/* The hypervisor updates the time info whenever the relation between TSC and
+ * system time changes (e.g., after migration). It must not cross a page
+ * boundary.
+ */
+static struct pvclock_vcpu_time_info kvmclock_ti __align(64);
+static struct pvclock_wall_clock kvmclock_wc __align(16);
+static int kvmclock_ready;
+
+UK_CTASSERT(sizeof(struct pvclock_vcpu_time_info) == 32);
+UK_CTASSERT(sizeof(struct pvclock_wall_clock) == 12);
+
+static inline __u64 pvclock_scale_delta(__u64 delta, __u32 mul, __s8 shift)
+{
+	if (shift < 0)
+		delta >>= -shift;
+	else
+		delta <<= shift;
+
+	return mul64_32(delta, mul);
+}
+
+int kvmclock_init(void)
+{
+	__u32 eax, ebx, ecx, edx;
+	char sig[12];
+
+	cpuid(KVM_CPUID_SIGNATURE, 0, &eax, &ebx, &ecx, &edx);
+	memcpy(&sig[0], &ebx, 4);
+	memcpy(&sig[4], &ecx, 4);
+	memcpy(&sig[8], &edx, 4);
+	if (memcmp(sig, "KVMKVMKVM\0\0\0", sizeof(sig)) ||
+	    eax < KVM_CPUID_FEATURES)
+		return -ENOTSUP;
+
+	cpuid(KVM_CPUID_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+	if (!(eax & KVM_FEATURE_CLOCKSOURCE2))
+		return -ENOTSUP;
+
+	wrmsrl(MSR_KVM_SYSTEM_TIME_NEW,
+	       ukplat_virt_to_phys(&kvmclock_ti) | KVM_SYSTEM_TIME_ENABLE);
+	wrmsrl(MSR_KVM_WALL_CLOCK_NEW, ukplat_virt_to_phys(&kvmclock_wc));
+
+	/* The hypervisor fills in the time info before returning to us */
+	if (unlikely(!kvmclock_ti.tsc_to_system_mul)) {
+		wrmsrl(MSR_KVM_SYSTEM_TIME_NEW, 0);
+		return -ENOTSUP;
+	}
+
+	/* Without the stable bit in the features, the flag is meaningless */
+	if (!(eax & KVM_FEATURE_CLOCKSOURCE_STABLE_BIT))
+		kvmclock_ti.flags &= ~PVCLOCK_TSC_STABLE_BIT;
+
+	kvmclock_ready = 1;
+	return 0;
+}
+
+int kvmclock_stable(void)
+{
+	UK_ASSERT(kvmclock_ready);
+
+	return !!(ukarch_load_n(&kvmclock_ti.flags) & PVCLOCK_TSC_STABLE_BIT);
+}
+
+__nsec kvmclock_system_time(void)
+{
+	__u32 version;
+	__nsec time;
+
+	UK_ASSERT(kvmclock_ready);
+
+	/* The hypervisor increments the version before and after an update */
+	do {
+		version = ukarch_load_n(&kvmclock_ti.version);
+		rmb();
+		time = kvmclock_ti.system_time +
+		       pvclock_scale_delta(rdtsc() - kvmclock_ti.tsc_timestamp,
+					   kvmclock_ti.tsc_to_system_mul,
+					   kvmclock_ti.tsc_shift);
+		rmb();
+	} while ((version & 1) ||
+		 version != ukarch_load_n(&kvmclock_ti.version));
+
+	return time;
+}
+
+__nsec kvmclock_wall_clock(void)
+{
+	__u32 version;
+	__nsec wall;
+
+	UK_ASSERT(kvmclock_ready);
+
+	do {
+		version = ukarch_load_n(&kvmclock_wc.version);
+		rmb();
+		wall = (__nsec) kvmclock_wc.sec * UKARCH_NSEC_PER_SEC +
+		       kvmclock_wc.nsec;
+		rmb();
+	} while ((version & 1) ||
+		 version != ukarch_load_n(&kvmclock_wc.version));
+
+	return wall;
+}
+
+__u64 kvmclock_tsc_freq(void)
+{
+	__u64 freq;
+
+	UK_ASSERT(kvmclock_ready);
+
+	/* Inverse of pvclock_scale_delta() */
+	freq = (UKARCH_NSEC_PER_SEC << 32) / kvmclock_ti.tsc_to_system_mul;
+	if (kvmclock_ti.tsc_shift < 0)
+		freq <<= -kvmclock_ti.tsc_shift;
+	else
+		freq >>= kvmclock_ti.tsc_shift;
+
+	return freq;
+}
@@ -71,13 +71,13 @@ void ukplat_time_init(void)
 {
 	int rc;
 
-	rc = ukplat_irq_register(0, timer_handler, NULL);
-	if (rc < 0)
-		UK_CRASH("Failed to register timer interrupt handler\n");
-
 	rc = tscclock_init();
 	if (rc < 0)
 		UK_CRASH("Failed to initialize TSCCLOCK\n");
+
+	rc = ukplat_irq_register(tscclock_timer_irq(), timer_handler, NULL);
+	if (rc < 0)
+		UK_CRASH("Failed to register timer interrupt handler\n");
 }
 
 void ukplat_time_fini(void)
@@ -86,5 +86,5 @@ void ukplat_time_fini(void)
 
 uint32_t ukplat_time_get_irq(void)
 {
-	return 0;
+	return tscclock_timer_irq();
 }
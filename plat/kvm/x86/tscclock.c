@@ -52,6 +52,8 @@
  * SUCH DAMAGE.
  */
 
+#include <string.h>
+#include <uk/config.h>
 #include <uk/plat/lcpu.h>
 #include <uk/plat/time.h>
 #include <x86/cpu.h>
@@ -59,6 +61,12 @@
 #include <uk/print.h>
 #include <uk/assert.h>
 #include <uk/bitops.h>
+#include <uk/essentials.h>
+#include <kvm/tscclock.h>
+#include <kvm-x86/kvmclock.h>
+#include <kvm/intctrl.h>
+#include <x86/apic_defs.h>
+#include <errno.h>
 
 #define TIMER_CNTR           0x40
 #define TIMER_MODE           0x43
@@ -102,8 +110,29 @@ static __u64 rtc_epochoffset;
 static __u64 time_base;
 static __u64 tsc_base;
 
-/* Multiplier for converting TSC ticks to nsecs. (0.32) fixed point. */
+/*
+ * Multiplier and shift for converting TSC ticks to nsecs:
+ *
+ *     nsecs = ((ticks << tsc_shift) * tsc_mult) >> 32
+ *
+ * A negative shift is a right shift. The shift keeps the multiplier within
+ * (0.32) fixed point for TSC frequencies below 1 GHz.
+ */
 static __u32 tsc_mult;
+static __s8 tsc_shift;
+
+/* TSC frequency in Hz */
+static __u64 tsc_freq;
+
+/* If set, monotonic time is read from the kvmclock, relative to this base */
+static int pvclock_active;
+static __u64 pvclock_base;
+
+/* Name of the clock source in use */
+static const char *tscclock_src_name;
+
+/* Set if we had to calibrate the TSC against the i8254 */
+static int tscclock_pit_calibrated;
 
 /*
  * Multiplier for converting nsecs to PIT ticks. (1.32) fixed point.
@@ -193,6 +222,16 @@ static __u64 rtc_gettimeofday(void)
 	return uktimeconv_bmkclock_to_nsec(&dt);
 }
 
+static inline __u64 tsc_scale_delta(__u64 delta)
+{
+	if (tsc_shift < 0)
+		delta >>= -tsc_shift;
+	else
+		delta <<= tsc_shift;
+
+	return mul64_32(delta, tsc_mult);
+}
+
 /*
  * Return monotonic time using TSC clock.
  */
@@ -200,6 +239,9 @@ __u64 tscclock_monotonic(void)
 {
 	__u64 tsc_now, tsc_delta;
 
+	if (pvclock_active)
+		return kvmclock_system_time() - pvclock_base;
+
 	/*
 	 * Update time_base (monotonic time) and tsc_base (TSC time).
 	 */
@@ -207,92 +249,335 @@ __u64 tscclock_monotonic(void)
 	tsc_delta = tsc_now - tsc_base;
 	if (tsc_delta >= UINT64_MAX / 2)
 		tsc_delta = 1;
-	time_base += mul64_32(tsc_delta, tsc_mult);
+	time_base += tsc_scale_delta(tsc_delta);
 	tsc_base = tsc_now;
 
 	return time_base;
 }
 
 /*
- * Calibrate TSC and initialise TSC clock.
+ * Clock sources. Each one is asked for the TSC frequency in the order
+ * given by CONFIG_KVM_CLOCKSOURCE_ORDER until one returns a non-zero
+ * frequency.
  */
-int tscclock_init(void)
+
+/*
+ * KVM paravirtualized clock. If the host guarantees a stable clock, we read
+ * the time from it. The pvclock scale also tells us the exact TSC frequency.
+ */
+static __u64 tscclock_src_kvmclock(void)
+{
+	if (kvmclock_init())
+		return 0;
+
+	/* On SMP configurations, all CPUs read the pvclock of the BSP. This
+	 * is only correct if the clock is stable across CPUs. Otherwise, we
+	 * just use the TSC frequency.
+	 */
+#ifdef CONFIG_HAVE_SMP
+	if (!kvmclock_stable())
+		return kvmclock_tsc_freq();
+#endif /* CONFIG_HAVE_SMP */
+
+	pvclock_base = kvmclock_system_time();
+	pvclock_active = 1;
+
+	return kvmclock_tsc_freq();
+}
+
+/*
+ * The hypervisor generic cpuid timing information leaf. 0x40000010 returns
+ * the (virtual) TSC frequency in kHz, or 0 if the feature is not supported by
+ * the hypervisor.
+ */
+static __u64 tscclock_src_hv(void)
 {
-	__u64 tsc_freq = 0, rtc_boot;
 	__u32 eax, ebx, ecx, edx;
 
-	/* Initialise i8254 timer channel 0 to mode 2 at CONFIG_HZ frequency */
-	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
-	outb(TIMER_CNTR, (TIMER_HZ / CONFIG_HZ) & 0xff);
-	outb(TIMER_CNTR, (TIMER_HZ / CONFIG_HZ) >> 8);
+	cpuid(0x40000000, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < 0x40000010)
+		return 0;
+
+	cpuid(0x40000010, 0, &eax, &ebx, &ecx, &edx);
+	return (__u64) eax * 1000;
+}
+
+/*
+ * The TSC/core crystal clock ratio of CPUID leaf 0x15. If the crystal clock
+ * frequency is not enumerated, the processor base frequency of leaf 0x16 is
+ * the nominal TSC frequency.
+ */
+static __u64 tscclock_src_cpuid(void)
+{
+	__u32 max_leaf, eax, ebx, ecx, edx;
+
+	cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+	if (max_leaf < 0x15)
+		return 0;
+
+	/* eax: denominator, ebx: numerator, ecx: crystal clock in Hz */
+	cpuid(0x15, 0, &eax, &ebx, &ecx, &edx);
+	if (!eax || !ebx)
+		return 0;
+
+	if (ecx)
+		return (__u64) ecx * ebx / eax;
+
+	if (max_leaf < 0x16)
+		return 0;
+
+	/* eax[15:0]: processor base frequency in MHz */
+	cpuid(0x16, 0, &eax, &ebx, &ecx, &edx);
+	return (__u64) (eax & 0xffff) * 1000000;
+}
+
+/*
+ * Calibrate against an 0.1s delay using the i8254 timer. This is
+ * undesirable as it delays the boot sequence.
+ */
+static __u64 tscclock_src_pit(void)
+{
+	__u64 tsc_start;
+
+	uk_pr_info("Calibrating TSC clock against i8254 timer\n");
+	tscclock_pit_calibrated = 1;
+	tsc_start = rdtsc();
+	i8254_delay(100000);
+	return (rdtsc() - tsc_start) * 10;
+}
+
+struct tscclock_src {
+	const char *name;
+	__u64 (*probe)(void);
+};
+
+static const struct tscclock_src tscclock_srcs[] = {
+	{ "kvmclock",	tscclock_src_kvmclock },
+	{ "tsc-hv",	tscclock_src_hv },
+	{ "tsc-cpuid",	tscclock_src_cpuid },
+	{ "tsc-pit",	tscclock_src_pit },
+};
+
+static const struct tscclock_src *tscclock_src_find(const char *name,
+						    __sz len)
+{
+	__sz i;
+
+	for (i = 0; i < ARRAY_SIZE(tscclock_srcs); i++)
+		if (strlen(tscclock_srcs[i].name) == len &&
+		    !memcmp(tscclock_srcs[i].name, name, len))
+			return &tscclock_srcs[i];
+
+	return NULL;
+}
+
+/*
+ * Walk the configured order of clock sources and return the TSC frequency
+ * of the first one that provides it. Fall back to the i8254 if none does.
+ */
+static __u64 tscclock_probe(void)
+{
+	const char *order = CONFIG_KVM_CLOCKSOURCE_ORDER;
+	const struct tscclock_src *src;
+	__u64 freq;
+	__sz len;
+
+	while (*order) {
+		len = strcspn(order, " ,");
+		if (len) {
+			src = tscclock_src_find(order, len);
+			if (src) {
+				freq = src->probe();
+				if (freq) {
+					tscclock_src_name = src->name;
+					return freq;
+				}
+			} else {
+				uk_pr_warn("Unknown clock source '%.*s'\n",
+					   (int) len, order);
+			}
+		}
+		order += len;
+		order += strspn(order, " ,");
+	}
+
+	tscclock_src_name = "tsc-pit";
+	return tscclock_src_pit();
+}
+
+__u64 tscclock_tsc_freq(void)
+{
+	return tsc_freq;
+}
+
+#if CONFIG_KVM_LAPIC_TIMER
+/*
+ * Local APIC timer in TSC-deadline mode. Each lcpu has its own timer, which
+ * is armed with a single write to the TSC deadline MSR and which interrupts
+ * only the lcpu that armed it. The IRQ is taken from the range that is
+ * delivered by the local APIC so that it is acknowledged there.
+ */
+static int lapic_timer_irq = -1;
+static UKPLAT_PER_LCPU_DEFINE(__u8, lapic_timer_ready);
+
+/*
+ * Maximum delta that we program at once. This just keeps the conversion to
+ * TSC ticks from overflowing; we will simply be woken up once per hour.
+ */
+#define LAPIC_TIMER_MAX_DELTA	(3600 * UKARCH_NSEC_PER_SEC)
+
+static int lapic_timer_init(void)
+{
+	__u32 eax, ebx, ecx, edx;
+	int irq;
+
+	cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & X86_CPUID1_ECX_x2APIC) ||
+	    !(ecx & X86_CPUID1_ECX_TSC_DEADLINE))
+		return -ENOTSUP;
+
+	irq = intctrl_msi_alloc();
+	if (unlikely(irq < 0))
+		return irq;
+
+	lapic_timer_irq = irq;
+	return 0;
+}
+
+/*
+ * Switches the timer of the current lcpu to TSC-deadline mode. This is done
+ * lazily on the first block of each lcpu, after its local APIC has been
+ * enabled.
+ */
+static void lapic_timer_lcpu_init(void)
+{
+	wrmsrl(X86_MSR_TSC_DEADLINE, 0);
+	wrmsrl(APIC_MSR_LVT_TIMER,
+	       APIC_LVT_TIMER_TSC_DEADLINE | (32 + lapic_timer_irq));
+	ukplat_per_lcpu_current(lapic_timer_ready) = 1;
+}
+
+/* Converts a duration in nanoseconds to TSC ticks */
+static inline __u64 tsc_ticks(__u64 ns)
+{
+	return (ns / UKARCH_NSEC_PER_SEC) * tsc_freq +
+	       (ns % UKARCH_NSEC_PER_SEC) * tsc_freq / UKARCH_NSEC_PER_SEC;
+}
+
+static void lapic_timer_cpu_block(__u64 until)
+{
+	__u64 now, delta_ns;
+
+	UK_ASSERT(ukplat_lcpu_irqs_disabled());
+
+	if (unlikely(!ukplat_per_lcpu_current(lapic_timer_ready)))
+		lapic_timer_lcpu_init();
+
+	now = ukplat_monotonic_clock();
+	if (unlikely(until <= now))
+		return;
+	delta_ns = MIN(until - now, LAPIC_TIMER_MAX_DELTA);
 
 	/*
-	 * Read RTC "time at boot". This must be done just before tsc_base is
-	 * initialised in order to get a correct offset below.
+	 * A deadline that has already passed fires immediately, so there is
+	 * no minimum delta. We also do not disarm the timer after wakeup: a
+	 * stale deadline only causes a spurious timer interrupt, which is
+	 * cheaper than an additional MSR write on every block.
 	 */
-	rtc_boot = rtc_gettimeofday();
+	wrmsrl(X86_MSR_TSC_DEADLINE, rdtsc() + tsc_ticks(delta_ns));
+	ukplat_lcpu_halt_irq();
+}
+#endif /* CONFIG_KVM_LAPIC_TIMER */
+
+unsigned int tscclock_timer_irq(void)
+{
+#if CONFIG_KVM_LAPIC_TIMER
+	if (lapic_timer_irq >= 0)
+		return lapic_timer_irq;
+#endif /* CONFIG_KVM_LAPIC_TIMER */
+	return 0;
+}
+
+/*
+ * Calibrate TSC and initialise TSC clock.
+ */
+int tscclock_init(void)
+{
+	__u64 wall_boot, tsc_start, probe_ns;
 
 	/*
-	 * Attempt to retrieve TSC frequency via the hypervisor generic cpuid
-	 * timing information leaf. 0x40000010 returns the (virtual) TSC
-	 * frequency in kHz, or 0 if the feature is not supported by the
-	 * hypervisor.
+	 * Monotonic time begins at tsc_base (first read of TSC before
+	 * probing the clock sources).
 	 */
-	cpuid(0x40000000, 0, &eax, &ebx, &ecx, &edx);
-	if (eax >= 0x40000010) {
-		uk_pr_info("Retrieving TSC clock frequency from hypervisor\n");
-		tsc_base = rdtsc();
-		cpuid(0x40000010, 0, &eax, &ebx, &ecx, &edx);
-		tsc_freq = eax * 1000;
-	}
+	tsc_start = rdtsc();
+	tsc_base = tsc_start;
+
+	/* Initialise i8254 timer channel 0 to mode 2 at CONFIG_HZ frequency */
+	outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
+	outb(TIMER_CNTR, (TIMER_HZ / CONFIG_HZ) & 0xff);
+	outb(TIMER_CNTR, (TIMER_HZ / CONFIG_HZ) >> 8);
 
 	/*
-	 * If we could not retrieve the TSC frequency from the hypervisor,
-	 * calibrate against an 0.1s delay using the i8254 timer. This is
-	 * undesirable as it delays the boot sequence.
+	 * Warning, do not print anything between probing the TSC frequency
+	 * and the setting of tsc_mult: if CONFIG_LIBUKDEBUG_PRINT_TIME is
+	 * enabled this will trigger a reset of tsc_base via
+	 * tscclock_monotonic and delay the clock starting point.
 	 */
-	if (!tsc_freq) {
-		uk_pr_info("Calibrating TSC clock against i8254 timer\n");
-		tsc_base = rdtsc();
-		i8254_delay(100000);
-		tsc_freq = (rdtsc() - tsc_base) * 10;
-	}
+	tsc_freq = tscclock_probe();
+	UK_ASSERT(tsc_freq);
 
 	/*
-	 * Calculate TSC scaling multiplier.
+	 * Calculate TSC scaling multiplier and shift such that
 	 *
-	 * (0.32) tsc_mult = UKARCH_NSEC_PER_SEC (32.32) / tsc_freq (32.0)
+	 * (0.32) tsc_mult = UKARCH_NSEC_PER_SEC (32.32) / (tsc_freq << shift)
 	 *
-	 * Warning, do not print anything between TSC calibration and the
-	 * setting of tsc_mult: if CONFIG_LIBUKDEBUG_PRINT_TIME is enabled
-	 * this will trigger a reset of tsc_base via tscclock_monotonic
-	 * and delay the clock starting point.
-	 *
-	 * FIXME: this will overflow with small TSC frequencies. We should
-	 * probably calculate the TSC shift dynamically like solo5/hvt does.
+	 * does not overflow.
 	 */
-	tsc_mult = (UKARCH_NSEC_PER_SEC << 32) / tsc_freq;
+	tsc_shift = 0;
+	while ((tsc_freq << tsc_shift) <= UKARCH_NSEC_PER_SEC)
+		tsc_shift++;
+	tsc_mult = (UKARCH_NSEC_PER_SEC << 32) / (tsc_freq << tsc_shift);
 
-	uk_pr_info("Clock source: TSC, frequency estimate is %llu Hz\n",
-		   (unsigned long long) tsc_freq);
+	/* Boot-time instrumentation: how long finding the TSC frequency took */
+	probe_ns = tsc_scale_delta(rdtsc() - tsc_start);
 
 	/*
-	 * Monotonic time begins at tsc_base (first read of TSC before
-	 * calibration).
+	 * Read "time at boot". With kvmclock, the hypervisor provides the
+	 * wall time. Otherwise, this requires waiting for the RTC.
 	 */
-	tscclock_monotonic();
+	if (!strcmp(tscclock_src_name, "kvmclock"))
+		wall_boot = kvmclock_wall_clock() + kvmclock_system_time();
+	else
+		wall_boot = rtc_gettimeofday();
 
 	/*
-	 * Compute RTC epoch offset by subtracting monotonic time_base from RTC
-	 * time at boot.
+	 * Compute RTC epoch offset by subtracting monotonic time_base from
+	 * the wall time at boot.
 	 */
-	rtc_epochoffset = rtc_boot - time_base;
+	rtc_epochoffset = wall_boot - tscclock_monotonic();
+
+	uk_pr_info("Clock source: %s, TSC frequency %llu Hz, probed in %llu ns%s\n",
+		   tscclock_src_name, (unsigned long long) tsc_freq,
+		   (unsigned long long) probe_ns,
+		   tscclock_pit_calibrated ? "" : " (i8254 calibration skipped)");
 
 	/*
-	 * Initialise i8254 timer channel 0 to mode 4 (one shot).
+	 * Initialise i8254 timer channel 0 to mode 4 (one shot). This also
+	 * stops the periodic mode that was used for calibration. The counter
+	 * only starts when a count is loaded, so the i8254 stays quiet if the
+	 * local APIC timer is used instead.
 	 */
 	outb(TIMER_MODE, TIMER_SEL0 | TIMER_ONESHOT | TIMER_16BIT);
 
+#if CONFIG_KVM_LAPIC_TIMER
+	if (lapic_timer_init() == 0) {
+		uk_pr_info("Timer: local APIC in TSC-deadline mode (IRQ %d)\n",
+			   lapic_timer_irq);
+		return 0;
+	}
+	uk_pr_info("Timer: TSC-deadline mode not available, using i8254\n");
+#endif /* CONFIG_KVM_LAPIC_TIMER */
+
 	return 0;
 }
 
@@ -380,14 +665,22 @@ static void tscclock_cpu_block(__u64 until)
 	ukplat_lcpu_halt_irq();
 }
 
-unsigned long sched_have_pending_events;
+UKPLAT_PER_LCPU_DEFINE(unsigned long, sched_have_pending_events);
 
 void time_block_until(__snsec until)
 {
+	unsigned long *pending =
+		&ukplat_per_lcpu_current(sched_have_pending_events);
+
 	while ((__snsec) ukplat_monotonic_clock() < until) {
-		tscclock_cpu_block(until);
+#if CONFIG_KVM_LAPIC_TIMER
+		if (lapic_timer_irq >= 0)
+			lapic_timer_cpu_block(until);
+		else
+#endif /* CONFIG_KVM_LAPIC_TIMER */
+			tscclock_cpu_block(until);
 
-		if (__uk_test_and_clear_bit(0, &sched_have_pending_events))
+		if (__uk_test_and_clear_bit(0, pending))
 			break;
 	}
 }